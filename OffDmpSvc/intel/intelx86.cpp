@@ -289,6 +289,11 @@ Intelx86::BuildInfoBuffer(
         DeviceSpecificInfo->BugCheckParam2 = m_Context->DumpHeader->BugCheckParameter2;
         DeviceSpecificInfo->BugCheckParam3 = m_Context->DumpHeader->BugCheckParameter3;
         DeviceSpecificInfo->BugCheckParam4 = m_Context->DumpHeader->BugCheckParameter4;
+
+        //
+        // The in-memory data location is not known on Intel; raw2dump scans for the header.
+        //
+        DeviceSpecificInfo->DumpHeaderPA = 0;
     }
 
     return hr;
@@ -25,6 +25,7 @@ Environment:
 #include <new.h>
 #include <werapi.h>
 #include <Pathcch.h>
+#include "Chunked_Section.h"
 
 
 #define LENGTH_PATH_TO_LOG_FILE     50
@@ -36,19 +37,69 @@ Environment:
 #define DRIVE_LAYOUT_INFO_MAX_TRIES 8
 
 typedef bool (CALLBACK* ConvertRawToDump)(LPWSTR, LPWSTR, LPWSTR); // raw2dump.dll export
+typedef HRESULT (CALLBACK* ConvertRawToDumpWithBudget)(LPWSTR, LPWSTR, LPWSTR, LPWSTR, UINT64, PUINT64); // raw2dump.dll export
+
+UINT64 GetRaw2DumpMemoryBudget(void)
+{
+    HKEY hKey;
+    DWORD rc;
+    DWORD val = 0;
+    DWORD vallen;
+
+    //
+    // HKLM\System\CurrentControlSet\Control\CrashControl\Raw2DumpMemoryBudgetMB limits the memory
+    // raw2dump.dll uses for the conversion, in megabytes. Absent or zero means no limit.
+    //
+    rc = RegOpenKeyExW(HKEY_LOCAL_MACHINE, CRASHCONTROL_PATH, 0, KEY_READ, &hKey);
+    if (rc == ERROR_SUCCESS) {
+        vallen = sizeof(val);
+        rc = RegQueryValueExW(hKey, CRASHCONTROL_RAW2DUMP_BUDGET, nullptr, nullptr, (LPBYTE)&val, (LPDWORD)&vallen);
+        if (rc != ERROR_SUCCESS) {
+            val = 0;
+        }
+
+        RegCloseKey(hKey);
+    }
+
+    return (UINT64)val * 1024 * 1024;
+}
+
 
 HRESULT ConvertRaw2WindowsDump(
     _In_ PDMP_CONTEXT Context
 )
 {
     //
-    // Load raw2dump.dll and call its ConvertRawToDump function
+    // Load raw2dump.dll and call its ConvertRawToDump function, or
+    // ConvertRawToDumpWithBudget if the conversion has a memory budget.
     //
     ConvertRawToDump pfnConvertRawToDump = nullptr;
+    ConvertRawToDumpWithBudget pfnConvertRawToDumpWithBudget = nullptr;
+    UINT64 memoryBudget = GetRaw2DumpMemoryBudget();
+    UINT64 peakBytes = 0;
     HRESULT hr = E_FAIL;
     HINSTANCE const hRaw2Dump = LoadLibraryExW(L"raw2dump.dll", nullptr, 0);
 
-    if (nullptr != hRaw2Dump) {
+    if ((nullptr != hRaw2Dump) && (0 != memoryBudget)) {
+        pfnConvertRawToDumpWithBudget = (ConvertRawToDumpWithBudget)GetProcAddress(hRaw2Dump, "ConvertRawToDumpWithBudget");
+    }
+
+    if (nullptr != pfnConvertRawToDumpWithBudget) {
+        hr = pfnConvertRawToDumpWithBudget(
+                 Context->RawDumpPath,
+                 Context->RawDumpInfoPath,
+                 RAW2DUMP_LOG_FILE,
+                 WINDOWSDUMP_FILE_PATH,
+                 memoryBudget,
+                 &peakBytes
+                 );
+        if (FAILED(hr)) {
+            TraceHRESULT("ConvertRawToDumpWithBudget failed", hr);
+        }
+
+        TraceInfo2("raw2dump memory", "Budget", memoryBudget, "Peak", peakBytes);
+        FreeLibrary(hRaw2Dump);
+    } else if (nullptr != hRaw2Dump) {
         pfnConvertRawToDump = (ConvertRawToDump)GetProcAddress(hRaw2Dump, "ConvertRawToDump");
         if (nullptr != pfnConvertRawToDump) {
             bool ret = pfnConvertRawToDump(
@@ -107,6 +158,37 @@ bool ShouldConvertRaw2WindowsDump(void)
 }
 
 
+bool ShouldCompressRawDump(void)
+{
+    HKEY hKey;
+    DWORD rc;
+    DWORD val;
+    DWORD vallen;
+    bool ret = false;
+
+    //
+    // If HKLM\System\CurrentControlSet\Control\CrashControl\RawDumpCompressionEnabled is nonzero, then
+    // the DDR sections are compressed while the raw dump partition is copied to rawdump.bin.
+    // The absence of this registry value implies that the feature is disabled.
+    //
+    rc = RegOpenKeyExW(HKEY_LOCAL_MACHINE, CRASHCONTROL_PATH, 0, KEY_READ, &hKey);
+    if (rc == ERROR_SUCCESS) {
+        vallen = sizeof(val);
+        val = 0;
+        rc = RegQueryValueExW(hKey, CRASHCONTROL_RAWDUMP_COMPRESSION, nullptr, nullptr, (LPBYTE)&val, (LPDWORD)&vallen);
+        if (rc == ERROR_SUCCESS) {
+            if (val != 0) {
+                ret = true;
+            }
+        }
+
+        RegCloseKey(hKey);
+    }
+
+    return ret;
+}
+
+
 HRESULT
 SubmitOfflineCrashDump(
 _In_ PDMP_CONTEXT Context
@@ -995,8 +1077,42 @@ HRESULT
     ULONGLONG   currentOffset = 0;
     size_t      dwBytesWritten = 0;
     WCHAR       rawDumpFolder[MAX_PATH];
+    RAW_DUMP_COPY_JOURNAL   journal;
+    UINT32      firstSection = 0;
+    BOOL        appendFailed = FALSE;
 
-    if( FALSE == CopyFileW(Context->RawDumpOnSDPath, Context->RawDumpPath, FALSE) )
+    //
+    // The journal holds the header tables as extent zero and then one extent
+    // per section file. Sections appended by an earlier attempt at this dump
+    // get their offsets back and are not appended again.
+    //
+    if ( FAILED(OpenCopyJournal(Context,
+                                Context->RawDumpPath,
+                                Context->hDisk.GetCurrentFileSize(),
+                                RAW_DUMP_COPY_FORMAT_PLAIN,
+                                Context->RawDumpHeader->SectionsCount + 1,
+                                &journal)) )
+    {
+        TraceInfo("Collating the section files without a copy journal");
+    }
+
+    for (UINT32 extentIndex = 0; extentIndex < journal.Header.ExtentCount; extentIndex++)
+    {
+        PRAW_DUMP_COPY_EXTENT extent = &journal.Extents[extentIndex];
+
+        if (extent->Section < Context->RawDumpHeader->SectionsCount)
+        {
+            if (0 == (extent->Flags & RAW_DUMP_COPY_EXTENT_SKIPPED))
+            {
+                Context->RawDumpHeader->SectionTable[extent->Section].Offset = extent->Offset;
+            }
+
+            firstSection = extent->Section + 1;
+        }
+    }
+
+    if( (0 == journal.Header.ExtentCount)
+        && (FALSE == CopyFileW(Context->RawDumpOnSDPath, Context->RawDumpPath, FALSE)) )
     {
         hr = HRESULT_FROM_NT(GetLastError());
         TraceHRESULT("Cannot copy rawdump.bin to  a new location.", hr);
@@ -1005,22 +1121,34 @@ HRESULT
     {
         TraceHRESULT("Cannot open destination file for processing", hr);
     }
-    else if ( FAILED(hr = Context->hDisk.SetPos(0))
-              || FAILED(hr = Context->hDisk.Write((PCHAR)Context->RawDumpHeader, Context->RawDumpTableSize, &dwBytesWritten))
-              || FAILED(Context->hDisk.GetPos(&currentOffset))
+    else if ( FAILED(hr = Context->hDisk.SetPos(journal.ResumeOffset))
+              || ( (0 == journal.Header.ExtentCount)
+                   && FAILED(hr = Context->hDisk.Write((PCHAR)Context->RawDumpHeader, Context->RawDumpTableSize, &dwBytesWritten)) )
+              || FAILED(hr = Context->hDisk.GetPos(&currentOffset))
             )
     { // Failed to write the current header and sections table, at the file's beginning
         TraceHRESULT("ERROR: Write() - Write Raw Dump Header Tables failed", hr);
     }
     else
     { // Append the sections
+        if (0 == journal.Header.ExtentCount)
+        {
+            AppendCopyJournalExtent(&journal,
+                                    &Context->hDisk,
+                                    0,
+                                    currentOffset,
+                                    ComputeCrc32(Context->RawDumpHeader, Context->RawDumpTableSize, 0),
+                                    RAW_DUMP_COPY_NO_SECTION,
+                                    0);
+        }
+
         //
         // get directory path for section files.
         //
         memcpy(rawDumpFolder, Context->RawDumpOnSDPath, MAX_PATH);
         PathCchRemoveFileSpec(rawDumpFolder, MAX_PATH);
 
-        for (UINT32 sectionIndex = 0; sectionIndex < Context->RawDumpHeader->SectionsCount; sectionIndex++)
+        for (UINT32 sectionIndex = firstSection; sectionIndex < Context->RawDumpHeader->SectionsCount; sectionIndex++)
         {
             DEVICE_IO   sectionFile;
             WCHAR       sectionName[RAW_DUMP_SECTION_HEADER_NAME_LENGTH + 1];
@@ -1034,23 +1162,48 @@ HRESULT
                         rawDumpFolder, sectionName)) )
             {
                 TraceHRESULT("StringCchPrintfW: Skipping the section", hr);
+                AppendCopyJournalExtent(&journal, &Context->hDisk, currentOffset, 0, 0, sectionIndex, RAW_DUMP_COPY_EXTENT_SKIPPED);
                 continue;
             }
             else if ( FAILED(hr = sectionFile.Open(sectionPath)) )
             {
                 TraceHRESULT("Cannot open the file, not appending this for further processing", hr);
+                AppendCopyJournalExtent(&journal, &Context->hDisk, currentOffset, 0, 0, sectionIndex, RAW_DUMP_COPY_EXTENT_SKIPPED);
                 continue;
             }
             else
-            { // update the section table in the rawdump header.
+            { // append the file to our rawdump.bin
                 ULONGLONG fileSize = 0;
+                ULONGLONG sourceSize = sectionFile.GetCurrentFileSize();
+                UINT32    crc = 0;
 
-                Context->RawDumpHeader->SectionTable[sectionIndex].Offset = currentOffset;
+                if ( FAILED(hr = AppendFile(&Context->hDisk, &sectionFile, &fileSize, &crc)) )
+                {
+                    TraceHRESULT("AppendFile failed, stopping before journaling the section", hr);
+                }
+                else if (fileSize != sourceSize)
+                {
+                    hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+                    TraceHRESULT("AppendFile appended part of the section, stopping before journaling it", hr);
+                }
 
-                // append the file to our rawdump.bin
-                AppendFile(&Context->hDisk, &sectionFile, &fileSize);
-                currentOffset += fileSize;
                 sectionFile.Close();
+
+                //
+                // Only a complete append is journaled. A later attempt truncates
+                // the destination back to the last journaled extent and appends
+                // this section again.
+                //
+                if (FAILED(hr))
+                {
+                    appendFailed = TRUE;
+                    break;
+                }
+
+                // update the section table in the rawdump header.
+                Context->RawDumpHeader->SectionTable[sectionIndex].Offset = currentOffset;
+                AppendCopyJournalExtent(&journal, &Context->hDisk, currentOffset, fileSize, crc, sectionIndex, 0);
+                currentOffset += fileSize;
             }
 
         }
@@ -1058,7 +1211,11 @@ HRESULT
         //
         // We we are done appending, we should update the rawdump header.
         //
-        if ( FAILED(hr = Context->hDisk.SetPos(0)) )
+        if (appendFailed)
+        { // Leave the header tables as they are, the collation is incomplete
+            TraceInfo("Not updating the rawdump header, a section was not appended");
+        }
+        else if ( FAILED(hr = Context->hDisk.SetPos(0)) )
         {
             TraceHRESULT("ERROR: SetPos() - Append failure", hr);
         }
@@ -1069,6 +1226,8 @@ HRESULT
 
     }
 
+    CloseCopyJournal(&journal);
+
     return hr;
 }
 
@@ -1076,8 +1235,27 @@ HRESULT
 AppendFile(
     _In_ DEVICE_IO      *destinationFile,
     _In_ DEVICE_IO      *sourceFile,
-    _Inout_ PULONGLONG  bytesAppended
+    _Inout_ PULONGLONG  bytesAppended,
+    _Out_opt_ PUINT32   crc
 )
+/*++
+
+Routine Description:
+
+    This function appends a file at the current position of the destination.
+
+Arguments:
+
+    destinationFile - File to append to.
+    sourceFile - File to append.
+    bytesAppended - Receives the number of bytes appended.
+    crc - Optional, receives the CRC32 of the bytes appended.
+
+Return Value:
+
+    HRESULT
+
+--*/
 {
     HRESULT hr = E_FAIL;
 
@@ -1086,6 +1264,11 @@ AppendFile(
         *bytesAppended = 0;
     }
 
+    if (nullptr != crc)
+    {
+        *crc = 0;
+    }
+
     if ( DEVICE_IO::IO_OK != sourceFile->GetError() )
     {
         TraceHRESULT("Source file not ready", hr);
@@ -1094,9 +1277,7 @@ AppendFile(
     {
         TraceHRESULT("Destination file not ready", hr);
     }
-    else if ( SUCCEEDED(hr = sourceFile->SetPos(0)) &&
-              SUCCEEDED(hr = destinationFile->SetPos(0))
-            )
+    else if ( SUCCEEDED(hr = sourceFile->SetPos(0)) )
     {
         ULONGLONG   bytesToCopy = sourceFile->GetCurrentFileSize();
 
@@ -1133,6 +1314,11 @@ AppendFile(
             }
             else
             {
+                if (nullptr != crc)
+                {
+                    *crc = ComputeCrc32(buff, stBytesWritten, *crc);
+                }
+
                 bytesToCopy -= stBytesWritten;
                 if (stBytesRead != stBytesWritten)
                 { // Wrote an unexpected number of bytes
@@ -1490,12 +1676,40 @@ NT status code.
     // will be approximately similar to the size RAM on the device.
     //
     TraceInfo("Starting to write the rawdump file ... \n\r");
-    result = ReadRawDumpPartitionToFile(Context, Context->RawDumpPath);
+    if (ShouldCompressRawDump()) {
+        result = CompressRawDumpPartitionToFile(Context, Context->RawDumpPath);
+        if (FAILED(result)) {
+            TraceHRESULT("Compressed copy failed, copying the raw dump partition as is", result);
+            result = ReadRawDumpPartitionToFile(Context, Context->RawDumpPath);
+        }
+
+    } else {
+        result = ReadRawDumpPartitionToFile(Context, Context->RawDumpPath);
+    }
 
     return result;
 }
 
 
+static int __cdecl
+CompareDDRMemoryMapByBase(
+    _In_ const void *First,
+    _In_ const void *Second
+)
+/*++
+
+Routine Description:
+    qsort comparison of two DDR_MEMORY_MAP entries, ascending by base address.
+
+--*/
+{
+    UINT64 firstBase = ((const DDR_MEMORY_MAP *)First)->Base;
+    UINT64 secondBase = ((const DDR_MEMORY_MAP *)Second)->Base;
+
+    return (firstBase < secondBase) ? -1 : ((firstBase > secondBase) ? 1 : 0);
+}
+
+
 HRESULT
 BuildDDRMemoryMap(
     PDMP_CONTEXT Context
@@ -1522,8 +1736,6 @@ HRESULT
     UINT64  currentStart;
     HRESULT result = E_FAIL;
 
-    DDR_MEMORY_MAP tmpDdrRecord;
-
     Context->TotalDDRSizeInBytes = 0;
     Context->DDRMemoryMapCount = 0;
     Context->DDRMemoryMap = nullptr;
@@ -1559,21 +1771,10 @@ HRESULT
 
     //
     // DDR sections layout may be random,
-    // sort by base address in ascending order
+    // sort by base address in ascending order, FindDDRMemoryMapIndex relies on it
     //
     TraceInfo("Sorting DDR sections");
-    for (UINT32 i = 0; i < Context->DDRMemoryMapCount - 1; i++)
-    {
-        for (UINT32 j = 0; j < Context->DDRMemoryMapCount - 1 - i; j++)
-        {
-            if (Context->DDRMemoryMap[j].Base > Context->DDRMemoryMap[j+1].Base)
-            {
-                memcpy(&tmpDdrRecord, &Context->DDRMemoryMap[j], sizeof(tmpDdrRecord));
-                memcpy(&Context->DDRMemoryMap[j], &Context->DDRMemoryMap[j+1], sizeof(tmpDdrRecord));
-                memcpy(&Context->DDRMemoryMap[j+1], &tmpDdrRecord, sizeof(tmpDdrRecord));
-            }
-        }
-    }
+    qsort(Context->DDRMemoryMap, Context->DDRMemoryMapCount, sizeof(DDR_MEMORY_MAP), CompareDDRMemoryMapByBase);
 
     //
     // Check for sane DDR sections (no overlap, no negative size, no swapped boundaries)
@@ -1612,6 +1813,15 @@ HRESULT
             {
                 Context->DDRSectionsOverlapCount++;
             }
+            else
+            {
+                Context->DDRMemoryMap[index].Contiguous = TRUE;
+            }
+        }
+        else
+        {
+            // The first section is contiguous by default
+            Context->DDRMemoryMap[index].Contiguous = TRUE;
         }
     }
 
@@ -1633,6 +1843,56 @@ Exit:
     return result;
 }
 
+UINT32
+FindDDRMemoryMapIndex(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 PhysicalAddress
+)
+/*++
+
+Routine Description:
+    This function finds the DDR memory map entry holding a physical address
+    with a binary search. The map must be built by BuildDDRMemoryMap, sorted
+    by base and without overlaps.
+
+Arguments:
+    Context - Dmp_CONTEXT
+    PhysicalAddress - Physical address to look up.
+
+Return Value:
+    Index of the entry, DDRMemoryMapCount if no entry holds the address.
+
+--*/
+{
+    UINT32  low = 0;
+    UINT32  high = Context->DDRMemoryMapCount;
+    UINT32  middle;
+
+    //
+    // Find the first entry with a base above the address, the entry before
+    // it is the only one that can hold the address.
+    //
+    while (low < high)
+    {
+        middle = low + ((high - low) / 2);
+        if (Context->DDRMemoryMap[middle].Base <= PhysicalAddress)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if ((low == 0) || (Context->DDRMemoryMap[low - 1].End < PhysicalAddress))
+    {
+        return Context->DDRMemoryMapCount;
+    }
+
+    return low - 1;
+}
+
 HRESULT
 GetDumpInstance(
     _Out_ PULARGE_INTEGER DumpInstance
@@ -1701,6 +1961,10 @@ Routine Description:
     On successful read, it makes Context->hDisk = the handle of
     of the newly created file.
 
+    Every block copied is checkpointed in the copy journal, so a copy
+    cut short by a reboot or a killed service resumes after the last
+    block that is still in the file.
+
 Arguments:
 
     Context - Pointer to PDMP_CONTEXT
@@ -1712,26 +1976,43 @@ Return Value:
 
 --*/
 {
-    HRESULT         result;
+    HRESULT         result = E_FAIL;
     DEVICE_IO       hFile;
     PCHAR           buffer;
+    RAW_DUMP_COPY_JOURNAL   journal;
+    ULONGLONG       partitionSize = Context->hDisk.GetCurrentPartitionSize();
+
+    if ( FAILED(OpenCopyJournal(Context,
+                                FilePath,
+                                partitionSize,
+                                RAW_DUMP_COPY_FORMAT_PLAIN,
+                                (UINT32)((partitionSize + DEFAULT_DMP_BUF_SZ - 1) / DEFAULT_DMP_BUF_SZ),
+                                &journal)) )
+    {
+        TraceInfo("Copying the raw dump partition without a copy journal");
+    }
 
     if( nullptr == (buffer = (PCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, DEFAULT_DMP_BUF_SZ)) )
     {
         result = E_OUTOFMEMORY;
         TraceHRESULT("Could not allocate memory for buffer", result);
     }
-    else if ( FAILED(result = Context->hDisk.SetPos(0)) )
+    else if ( (journal.ResumeOffset < partitionSize)    // Nothing left to read when the copy completed earlier
+              && FAILED(result = Context->hDisk.SetPos(journal.ResumeOffset)) )
     {
-        TraceHRESULT("FAILED: SetPos(0) - cannot go to beginning of partition", result);
+        TraceHRESULT("FAILED: SetPos() - cannot go to the resume offset of the partition", result);
     }
-    else if ( FAILED(result = hFile.Open(FilePath)) )
+    else if ( FAILED(result = hFile.SetDirectIo(TRUE))     // Written once, keep it out of the file cache
+              || FAILED(result = hFile.Open(FilePath))
+              || FAILED(result = hFile.SetPos(journal.ResumeOffset))
+            )
     {
         TraceHRESULT("FAILED: cannot open destination file", result);
     }
     else
     {
-        ULONGLONG   RemainingSize = Context->hDisk.GetCurrentPartitionSize();
+        ULONGLONG   currentOffset = journal.ResumeOffset;
+        ULONGLONG   RemainingSize = partitionSize - currentOffset;
 
         while ( (RemainingSize > 0)
                 && (DEVICE_IO::IO_ERROR_EOF != Context->hDisk.GetError())
@@ -1757,7 +2038,15 @@ Return Value:
 
             }
             else
-            { // update the bytes remainig and continue
+            { // checkpoint the block, update the bytes remainig and continue
+                AppendCopyJournalExtent(&journal,
+                                        &hFile,
+                                        currentOffset,
+                                        bytesWritten,
+                                        ComputeCrc32(buffer, bytesWritten, 0),
+                                        RAW_DUMP_COPY_NO_SECTION,
+                                        0);
+                currentOffset += bytesWritten;
                 RemainingSize -= bytesWritten;
             }
 
@@ -1779,6 +2068,8 @@ Return Value:
         HeapFree(GetProcessHeap(), 0, buffer);
     }
 
+    CloseCopyJournal(&journal);
+
     if (SUCCEEDED(result))
     {
         TraceInfo("Writing raw memory data to file completed successfully!");
@@ -1816,9 +2107,17 @@ NTSTATUS
     //
 
     if (Context->RawDumpPath != nullptr) {
+        WCHAR journalPath[MAX_PATH];
+
         if (!DeleteFileW(Context->RawDumpPath)) {
             TraceWIN32("DeleteFile Context->RawDumpPath returned error ", GetLastError());
         }
+
+        if (SUCCEEDED(GetCopyJournalPath(Context->RawDumpPath, journalPath, ARRAYSIZE(journalPath)))
+            && !DeleteFileW(journalPath)
+            && (GetLastError() != ERROR_FILE_NOT_FOUND)) {
+            TraceWIN32("DeleteFile of the copy journal returned error ", GetLastError());
+        }
         HeapFree(GetProcessHeap(), 0, Context->RawDumpPath);
     }
 
@@ -1915,9 +2214,10 @@ Return Value:
     temp = Buffer;
 
     //
-    // Determine the right section.
+    // Determine the right section, then move on to the next ones if the
+    // read spans sections.
     //
-    for (index = 0; index < ddrSectionsCount; index++) {
+    for (index = FindDDRMemoryMapIndex(Context, addressStart); index < ddrSectionsCount; index++) {
         sectionStart = ddrMap[index].Base;
         sectionEnd = ddrMap[index].End;
 
@@ -1970,7 +2270,7 @@ Return Value:
                 // Time to move to next section.
                 // Update temp.
                 //
-                temp = (PVOID)((UINT32)(temp)+bytesToRead);
+                temp = (PVOID)((PUCHAR)temp + bytesToRead);
 
                 //
                 // Update addressStart.
@@ -2008,6 +2308,59 @@ Exit:
     return result;
 }
 
+
+HRESULT
+ReadFromDDRSectionBatch(
+    _In_ PDMP_CONTEXT Context,
+    _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+    _In_ UINT32 RequestCount
+)
+/*++
+
+Routine Description:
+    This function reads a list of physical address ranges from the DDR sections.
+    Requests that are close to each other are fetched with a single read of the
+    partition, see ReadPhysicalBatch.
+
+Arguments:
+    Context - Dmp_CONTEXT
+    Requests - (PA, length, buffer) requests. Each Result is updated.
+    RequestCount - Number of requests.
+
+Return Value:
+    HRESULT of the first failing request, S_OK if all were read.
+
+--*/
+{
+    HRESULT                     result = S_OK;
+    PPHYSICAL_EXTENT            extents = nullptr;
+    UINT32                      index = 0;
+
+    extents = (PPHYSICAL_EXTENT)HeapAlloc(GetProcessHeap(),
+                                          HEAP_ZERO_MEMORY,
+                                          (Context->DDRMemoryMapCount + 1) * sizeof(PHYSICAL_EXTENT));
+    if (extents == nullptr) {
+        result = E_ALLOCATION_ERROR;
+        TraceHRESULT("ReadFromDDRSectionBatch: Failed to allocate extents", result);
+        goto Exit;
+    }
+
+    for (index = 0; index < Context->DDRMemoryMapCount; index++) {
+        extents[index].Base = Context->DDRMemoryMap[index].Base;
+        extents[index].Size = Context->DDRMemoryMap[index].Size;
+        extents[index].FileOffset = Context->diskoffset.QuadPart + Context->DDRMemoryMap[index].Offset;
+    }
+
+    result = ReadPhysicalBatch(&Context->hDisk, nullptr, extents, Context->DDRMemoryMapCount, Requests, RequestCount);
+
+Exit:
+    if (extents != nullptr) {
+        HeapFree(GetProcessHeap(), 0, extents);
+    }
+
+    return result;
+}
+
 HRESULT
 AppendDeviceSpecificInfoToRawDump(
     _Inout_ PDMP_CONTEXT Context,
@@ -2016,7 +2369,7 @@ AppendDeviceSpecificInfoToRawDump(
 {
     HRESULT hr = S_OK;
 
-    DEVICE_SPECIFIC_INFO devSpeInfo;
+    DEVICE_SPECIFIC_INFO devSpeInfo = { 0 };
     if (FAILED(hr = SVData->BuildInfoBuffer(&devSpeInfo)))
     {
         TraceHRESULT("AppendDeviceSpecificInfoToRawDump:Failed to build Device Specific Info", hr);
@@ -213,6 +213,62 @@ TRACELOGGING_DECLARE_PROVIDER(g_hOffdmpsvcTraceLoggingProvider);
     //  This is the current number of partitions in a raw dump file.
 #define PARTITION_INFORMATION_SECTION_COUNT     16
 
+//
+// Checkpoint journal of the copy of a raw dump to RawDumpPath, kept beside it
+// in <RawDumpPath>.journal. Every extent is journaled once its data has been
+// written and flushed, so a copy cut short by a reboot or a killed service
+// resumes after the last extent that still matches its CRC. A journal written
+// for another RAW_DUMP_HEADER, dump instance, source or format is discarded.
+//
+// The file is a RAW_DUMP_COPY_JOURNAL_HEADER followed by ExtentCount
+// RAW_DUMP_COPY_EXTENTs, in the order they were copied.
+//
+#define RAW_DUMP_COPY_JOURNAL_EXTENSION     L".journal"
+#define RAW_DUMP_COPY_JOURNAL_SIGNATURE     (UINT64)(0x4C4E524A59504F43)  // "COPYJRNL"
+#define RAW_DUMP_COPY_JOURNAL_VERSION       2
+
+#define RAW_DUMP_COPY_NO_SECTION            ((UINT32)-1)
+#define RAW_DUMP_COPY_EXTENT_SKIPPED        0x1     // Section file that could not be appended
+
+#define RAW_DUMP_COPY_FORMAT_PLAIN          0       // Byte for byte copy of the source
+#define RAW_DUMP_COPY_FORMAT_CHUNKED        1       // DDR sections compressed, see rawdumpcompress.cpp
+
+typedef struct _RAW_DUMP_COPY_JOURNAL_HEADER
+{
+    //
+    // Identity of the copy, a journal is only used when all of these match.
+    //
+    UINT64              Signature;
+    UINT32              Version;
+    UINT32              RawDumpTableSize;
+    UINT32              RawDumpTableCrc;    // CRC32 of the RAW_DUMP_HEADER and its section table
+    UINT32              SourceLocation;     // SBL_DUMP_LOCATION
+    ULARGE_INTEGER      DumpInstance;
+    UINT64              SourceSize;         // Bytes in the partition or in rawdump.bin on the SD card
+    UINT32              Format;             // RAW_DUMP_COPY_FORMAT_*
+
+    UINT32              ExtentCount;
+} RAW_DUMP_COPY_JOURNAL_HEADER, *PRAW_DUMP_COPY_JOURNAL_HEADER;
+
+typedef struct _RAW_DUMP_COPY_EXTENT
+{
+    UINT64              Offset;             // In RawDumpPath
+    UINT64              Size;
+    UINT32              Crc;                // CRC32 of the Size bytes at Offset
+    UINT32              Section;            // Section file appended, RAW_DUMP_COPY_NO_SECTION for other data
+    UINT32              Flags;
+    UINT32              Reserved;
+} RAW_DUMP_COPY_EXTENT, *PRAW_DUMP_COPY_EXTENT;
+
+typedef struct _RAW_DUMP_COPY_JOURNAL
+{
+    DEVICE_IO                       File;
+    RAW_DUMP_COPY_JOURNAL_HEADER    Header;
+    PRAW_DUMP_COPY_EXTENT           Extents;        // nullptr when the copy is not journaled
+    UINT32                          MaxExtents;
+    ULONGLONG                       ResumeOffset;   // End of the last verified extent
+} RAW_DUMP_COPY_JOURNAL, *PRAW_DUMP_COPY_JOURNAL;
+
 //
 // Function Prototypes
 //
@@ -262,7 +318,8 @@ HRESULT
 AppendFile(
     _In_ DEVICE_IO      *destinationFile,
     _In_ DEVICE_IO      *sourceFile,
-    _Inout_ PULONGLONG  bytesAppended
+    _Inout_ PULONGLONG  bytesAppended,
+    _Out_opt_ PUINT32   crc
 );
 
 HRESULT
@@ -299,6 +356,12 @@ BuildDDRMemoryMap(
     _Inout_  PDMP_CONTEXT Context
 );
 
+UINT32
+FindDDRMemoryMapIndex(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 PhysicalAddress
+);
+
 HRESULT
 GetDumpInstance(
     _Out_ PULARGE_INTEGER DumpInstance
@@ -316,6 +379,17 @@ ReadRawDumpPartitionToFile(
     _In_    LPCWSTR FilePath
 );
 
+HRESULT
+CompressRawDumpPartitionToFile(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_    LPCWSTR FilePath
+);
+
+bool
+ShouldCompressRawDump(
+    void
+);
+
 HRESULT
 AppendDeviceSpecificInfoToRawDump(
     _Inout_ PDMP_CONTEXT Context,
@@ -332,6 +406,63 @@ CleanupContext(
     _In_ PDMP_CONTEXT Context
 );
 
+//
+// Copy journal, see copyjournal.cpp
+//
+HRESULT
+GetCopyJournalPath(
+    _In_ LPCWSTR DestinationPath,
+    _Out_writes_(PathLength) LPWSTR JournalPath,
+    _In_ size_t PathLength
+);
+
+HRESULT
+OpenCopyJournal(
+    _In_    PDMP_CONTEXT Context,
+    _In_    LPCWSTR DestinationPath,
+    _In_    UINT64 SourceSize,
+    _In_    UINT32 Format,
+    _In_    UINT32 MaxExtents,
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal
+);
+
+VOID
+AppendCopyJournalExtent(
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal,
+    _In_    DEVICE_IO *Destination,
+    _In_    UINT64 Offset,
+    _In_    UINT64 Size,
+    _In_    UINT32 Crc,
+    _In_    UINT32 Section,
+    _In_    UINT32 Flags
+);
+
+VOID
+CloseCopyJournal(
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal
+);
+
+HRESULT
+ComputeCopyExtentCrc(
+    _In_  DEVICE_IO *File,
+    _In_  UINT64 Offset,
+    _In_  UINT64 Size,
+    _Out_ PUINT32 Crc
+);
+
+UINT32
+VerifyCopyJournalExtents(
+    _In_ LPCWSTR DestinationPath,
+    _In_reads_(ExtentCount) const RAW_DUMP_COPY_EXTENT *Extents,
+    _In_ UINT32 ExtentCount
+);
+
+HRESULT
+TruncateCopyDestination(
+    _In_ LPCWSTR DestinationPath,
+    _In_ UINT64 Size
+);
+
 
 //
 // Helper functions
@@ -344,6 +475,13 @@ ReadFromDDRSectionByPhysicalAddress(
    _Out_ PVOID Buffer
 );
 
+HRESULT
+ReadFromDDRSectionBatch(
+   _In_  PDMP_CONTEXT Context,
+   _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+   _In_  UINT32 RequestCount
+);
+
 BOOLEAN
 ValidateRawDumpHeaderFlags(
     _In_ UINT32 Flags
@@ -364,6 +502,9 @@ _In_ const PRAW_DUMP_HEADER Header
 //
 #define CRASHCONTROL_PATH               L"SYSTEM\\CurrentControlSet\\Control\\CrashControl"
 #define CRASHCONTROL_RAW2DUMP_ENABLED   L"Raw2DumpEnabled"
+#define CRASHCONTROL_RAW2DUMP_BUDGET    L"Raw2DumpMemoryBudgetMB"
+#define CRASHCONTROL_RAWDUMP_COMPRESSION L"RawDumpCompressionEnabled"
+#define RAW2DUMP_LOG_FILE               L"raw2dump.log"
 
 //
 // For multi-sbl-dump scenarios, wpdmp.efi will write a 
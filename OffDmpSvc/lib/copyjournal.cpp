@@ -0,0 +1,513 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    copyjournal.cpp
+
+Abstract:
+    Checkpoint journal that lets the copy of a raw dump to RawDumpPath, from
+    the raw dump partition or from the section files on the SD card, resume
+    after a reboot or a killed service instead of starting over.
+
+Environment:
+    User Mode
+
+--*/
+#include "buildparams.h"
+#include "Chunked_Section.h"
+
+
+HRESULT
+GetCopyJournalPath(
+    _In_ LPCWSTR DestinationPath,
+    _Out_writes_(PathLength) LPWSTR JournalPath,
+    _In_ size_t PathLength
+)
+/*++
+
+Routine Description:
+
+    This function builds the path of the journal kept beside a copy.
+
+Arguments:
+
+    DestinationPath - File the raw dump is copied to.
+    JournalPath - Receives DestinationPath with RAW_DUMP_COPY_JOURNAL_EXTENSION.
+    PathLength - Characters in JournalPath.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    return StringCchPrintfW(JournalPath, PathLength, L"%s%s", DestinationPath, RAW_DUMP_COPY_JOURNAL_EXTENSION);
+}
+
+HRESULT
+ComputeCopyExtentCrc(
+    _In_  DEVICE_IO *File,
+    _In_  UINT64 Offset,
+    _In_  UINT64 Size,
+    _Out_ PUINT32 Crc
+)
+/*++
+
+Routine Description:
+
+    This function reads back an extent of a file and computes its CRC32.
+
+Arguments:
+
+    File - Open file to read.
+    Offset - Start of the extent.
+    Size - Bytes in the extent.
+    Crc - Receives the CRC32 of the extent.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT     hr = S_OK;
+    PCHAR       buffer = nullptr;
+
+    *Crc = 0;
+
+    if (0 == Size)
+    { // Nothing to read, the CRC of no data is zero
+    }
+    else if ( nullptr == (buffer = (PCHAR)HeapAlloc(GetProcessHeap(), 0, DEFAULT_DMP_BUF_SZ)) )
+    {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Could not allocate memory for the extent buffer", hr);
+    }
+    else if ( FAILED(hr = File->SetPos(Offset)) )
+    {
+        TraceHRESULT("FAILED: SetPos() - cannot go to the extent", hr);
+    }
+    else
+    {
+        while (Size > 0)
+        {
+            size_t  bytesRead = 0;
+
+            if ( FAILED(hr = File->Read(buffer, (size_t)min(Size, (UINT64)DEFAULT_DMP_BUF_SZ), &bytesRead))
+                 || (0 == bytesRead)
+               )
+            {
+                hr = FAILED(hr) ? hr : E_FAIL;
+                TraceHRESULT("FAILED: cannot read back the extent", hr);
+                break;
+            }
+
+            *Crc = ComputeCrc32(buffer, bytesRead, *Crc);
+            Size -= bytesRead;
+        }
+    }
+
+    if (nullptr != buffer)
+    {
+        HeapFree(GetProcessHeap(), 0, buffer);
+    }
+
+    return hr;
+}
+
+UINT32
+VerifyCopyJournalExtents(
+    _In_ LPCWSTR DestinationPath,
+    _In_reads_(ExtentCount) const RAW_DUMP_COPY_EXTENT *Extents,
+    _In_ UINT32 ExtentCount
+)
+/*++
+
+Routine Description:
+
+    This function finds the last journaled extent that the destination file
+    still holds. Extents are checked from the last one backwards; an extent
+    past the end of the file or with a different CRC is dropped and copied
+    again, together with everything journaled after it.
+
+Arguments:
+
+    DestinationPath - File the raw dump is copied to.
+    Extents - Journaled extents, in the order they were copied.
+    ExtentCount - Number of journaled extents.
+
+Return Value:
+
+    Number of extents, from the first, that can be kept.
+
+--*/
+{
+    DEVICE_IO   destination;
+    UINT32      crc = 0;
+
+    if (0 == ExtentCount)
+    {
+        return 0;
+    }
+
+    if (FAILED(destination.Open(DestinationPath)))
+    {
+        TraceInfo("Cannot open the destination of the journaled copy, copying from the start");
+        return 0;
+    }
+
+    while (ExtentCount > 0)
+    {
+        const RAW_DUMP_COPY_EXTENT *extent = &Extents[ExtentCount - 1];
+
+        if ( ((extent->Offset + extent->Size) <= destination.GetCurrentFileSize())
+             && SUCCEEDED(ComputeCopyExtentCrc(&destination, extent->Offset, extent->Size, &crc))
+             && (crc == extent->Crc)
+           )
+        {
+            break;
+        }
+
+        TraceInfo2("Journaled extent failed verification, copying it again", "Offset", extent->Offset, "Size", extent->Size);
+        ExtentCount--;
+    }
+
+    destination.Close();
+
+    return ExtentCount;
+}
+
+HRESULT
+TruncateCopyDestination(
+    _In_ LPCWSTR DestinationPath,
+    _In_ UINT64 Size
+)
+/*++
+
+Routine Description:
+
+    This function cuts the destination of a copy back to the resume offset,
+    dropping unverified data and anything appended after an earlier copy
+    completed, such as the device specific info.
+
+Arguments:
+
+    DestinationPath - File the raw dump is copied to.
+    Size - New size of the file.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT         hr = S_OK;
+    HANDLE          file;
+    LARGE_INTEGER   position;
+
+    position.QuadPart = (LONGLONG)Size;
+
+    file = CreateFileW(DestinationPath,
+                       FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL,
+                       OPEN_ALWAYS,
+                       0,
+                       NULL);
+
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("FAILED: cannot open the destination file to truncate it", hr);
+    }
+    else
+    {
+        if ( !SetFilePointerEx(file, position, nullptr, FILE_BEGIN)
+             || !SetEndOfFile(file)
+           )
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            TraceHRESULT1("FAILED: cannot truncate the destination file", "Size", Size, hr);
+        }
+
+        CloseHandle(file);
+    }
+
+    return hr;
+}
+
+HRESULT
+OpenCopyJournal(
+    _In_    PDMP_CONTEXT Context,
+    _In_    LPCWSTR DestinationPath,
+    _In_    UINT64 SourceSize,
+    _In_    UINT32 Format,
+    _In_    UINT32 MaxExtents,
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal
+)
+/*++
+
+Routine Description:
+
+    This function opens the journal of a copy to DestinationPath, creating it
+    if needed. The extents of a journal written for the same RAW_DUMP_HEADER,
+    dump instance, source and format are verified against the destination, which is
+    then truncated to the end of the last verified extent. Any other journal is
+    reset and the copy starts from the beginning.
+
+    Context->RawDumpHeader must hold the header and section table read from the
+    source, before the copy changes any of it.
+
+Arguments:
+
+    Context - Pointer to PDMP_CONTEXT
+    DestinationPath - File the raw dump is copied to.
+    SourceSize - Bytes in the source of the copy.
+    Format - RAW_DUMP_COPY_FORMAT_* the destination is written in.
+    MaxExtents - Most extents the copy journals.
+    Journal - Receives the journal. On failure the copy goes on without one,
+              from offset zero; CloseCopyJournal must be called either way.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT                         hr = E_FAIL;
+    RAW_DUMP_COPY_JOURNAL_HEADER    expected;
+    WCHAR                           journalPath[MAX_PATH];
+    size_t                          bytesProcessed = 0;
+    size_t                          extentBytes = 0;
+    UINT32                          extentCount = 0;
+
+    RtlZeroMemory(&Journal->Header, sizeof(Journal->Header));
+    Journal->Extents = nullptr;
+    Journal->MaxExtents = 0;
+    Journal->ResumeOffset = 0;
+
+    RtlZeroMemory(&expected, sizeof(expected));
+    expected.Signature = RAW_DUMP_COPY_JOURNAL_SIGNATURE;
+    expected.Version = RAW_DUMP_COPY_JOURNAL_VERSION;
+    expected.RawDumpTableSize = Context->RawDumpTableSize;
+    expected.RawDumpTableCrc = ComputeCrc32(Context->RawDumpHeader, Context->RawDumpTableSize, 0);
+    expected.SourceLocation = (UINT32)Context->SBLDumpLocation;
+    expected.SourceSize = SourceSize;
+    expected.Format = Format;
+
+    //
+    // The copy of a SD card dump runs before the dump instance is put in the
+    // context, read it here for both.
+    //
+    GetDumpInstance(&expected.DumpInstance);
+
+    if ( (0 == MaxExtents) || (MaxExtents > (MAXSIZE_T / sizeof(RAW_DUMP_COPY_EXTENT))) )
+    {
+        hr = E_INVALIDARG;
+        TraceHRESULT1("Invalid number of copy journal extents", "MaxExtents", MaxExtents, hr);
+    }
+    else if ( FAILED(hr = GetCopyJournalPath(DestinationPath, journalPath, ARRAYSIZE(journalPath))) )
+    {
+        TraceHRESULT("GetCopyJournalPath failed", hr);
+    }
+    else if ( nullptr == (Journal->Extents = (PRAW_DUMP_COPY_EXTENT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MaxExtents * sizeof(RAW_DUMP_COPY_EXTENT))) )
+    {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT1("Could not allocate memory for the copy journal", "MaxExtents", MaxExtents, hr);
+    }
+    else if ( FAILED(hr = Journal->File.Open(journalPath)) )
+    {
+        TraceHRESULT("FAILED: cannot open the copy journal", hr);
+    }
+    else
+    {
+        Journal->MaxExtents = MaxExtents;
+
+        if ( (Journal->File.GetCurrentFileSize() >= sizeof(Journal->Header))
+             && SUCCEEDED(Journal->File.SetPos(0))
+             && SUCCEEDED(Journal->File.Read((PCHAR)&Journal->Header, sizeof(Journal->Header), &bytesProcessed))
+             && (sizeof(Journal->Header) == bytesProcessed)
+             && (0 == memcmp(&Journal->Header, &expected, FIELD_OFFSET(RAW_DUMP_COPY_JOURNAL_HEADER, ExtentCount)))
+             && (Journal->Header.ExtentCount <= MaxExtents)
+           )
+        {
+            extentCount = Journal->Header.ExtentCount;
+            extentBytes = extentCount * sizeof(RAW_DUMP_COPY_EXTENT);
+
+            if ( (0 != extentCount)
+                 && ( FAILED(Journal->File.Read((PCHAR)Journal->Extents, extentBytes, &bytesProcessed))
+                      || (extentBytes != bytesProcessed) )
+               )
+            { // A journal cut short is as good as none
+                extentCount = 0;
+            }
+
+            TraceInfo1("Found a copy journal for this dump", "Extents", extentCount);
+        }
+        else
+        {
+            TraceInfo("No copy journal for this dump, copying from the start");
+        }
+
+        extentCount = VerifyCopyJournalExtents(DestinationPath, Journal->Extents, extentCount);
+        if (0 != extentCount)
+        {
+            Journal->ResumeOffset = Journal->Extents[extentCount - 1].Offset + Journal->Extents[extentCount - 1].Size;
+        }
+
+        if (FAILED(TruncateCopyDestination(DestinationPath, Journal->ResumeOffset)))
+        { // Without a clean end the copy cannot resume, start over
+            extentCount = 0;
+            Journal->ResumeOffset = 0;
+        }
+
+        //
+        // Rewrite the header for this dump, extents past ExtentCount are stale
+        // and overwritten as the copy goes on.
+        //
+        Journal->Header = expected;
+        Journal->Header.ExtentCount = extentCount;
+
+        if ( FAILED(hr = Journal->File.SetPos(0))
+             || FAILED(hr = Journal->File.Write((PCHAR)&Journal->Header, sizeof(Journal->Header), &bytesProcessed))
+           )
+        {
+            TraceHRESULT("FAILED: cannot write the copy journal header", hr);
+        }
+        else if (0 != Journal->ResumeOffset)
+        {
+            TraceInfo2("Resuming the copy from the journal", "Offset", Journal->ResumeOffset, "Extents", extentCount);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        CloseCopyJournal(Journal);
+        Journal->ResumeOffset = 0;
+        RtlZeroMemory(&Journal->Header, sizeof(Journal->Header));
+    }
+
+    return hr;
+}
+
+VOID
+AppendCopyJournalExtent(
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal,
+    _In_    DEVICE_IO *Destination,
+    _In_    UINT64 Offset,
+    _In_    UINT64 Size,
+    _In_    UINT32 Crc,
+    _In_    UINT32 Section,
+    _In_    UINT32 Flags
+)
+/*++
+
+Routine Description:
+
+    This function journals an extent once its data has been written to the
+    destination. The destination is written through the file cache, so it is
+    flushed before the extent is journaled; the journal then never lists an
+    extent that is not on disk. The extent is written before the count that
+    covers it. A destination that cannot be flushed or a journal that cannot
+    be written is closed and the copy goes on without checkpoints.
+
+Arguments:
+
+    Journal - Journal opened by OpenCopyJournal.
+    Destination - File the extent was written to.
+    Offset - Start of the extent in the destination.
+    Size - Bytes in the extent.
+    Crc - CRC32 of the extent.
+    Section - Section file the extent holds, or RAW_DUMP_COPY_NO_SECTION.
+    Flags - RAW_DUMP_COPY_EXTENT_* flags.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    HRESULT                 hr = E_FAIL;
+    PRAW_DUMP_COPY_EXTENT   extent;
+    UINT32                  extentCount;
+    size_t                  bytesWritten = 0;
+
+    if (nullptr == Journal->Extents)
+    { // The copy is not journaled
+        return;
+    }
+
+    if (Journal->Header.ExtentCount >= Journal->MaxExtents)
+    {
+        hr = E_UNEXPECTED;
+        TraceHRESULT1("Copy journal is full", "MaxExtents", Journal->MaxExtents, hr);
+    }
+    else if ( (0 != Size)
+              && FAILED(hr = Destination->Flush()) )
+    {
+        TraceHRESULT("FAILED: cannot flush the extent to the destination", hr);
+    }
+    else
+    {
+        extentCount = Journal->Header.ExtentCount + 1;
+        extent = &Journal->Extents[Journal->Header.ExtentCount];
+        extent->Offset = Offset;
+        extent->Size = Size;
+        extent->Crc = Crc;
+        extent->Section = Section;
+        extent->Flags = Flags;
+        extent->Reserved = 0;
+
+        if ( FAILED(hr = Journal->File.SetPos(sizeof(Journal->Header) + (Journal->Header.ExtentCount * sizeof(RAW_DUMP_COPY_EXTENT))))
+             || FAILED(hr = Journal->File.Write((PCHAR)extent, sizeof(RAW_DUMP_COPY_EXTENT), &bytesWritten))
+             || FAILED(hr = Journal->File.SetPos(FIELD_OFFSET(RAW_DUMP_COPY_JOURNAL_HEADER, ExtentCount)))
+             || FAILED(hr = Journal->File.Write((PCHAR)&extentCount, sizeof(extentCount), &bytesWritten))
+           )
+        {
+            TraceHRESULT("FAILED: cannot write to the copy journal", hr);
+        }
+        else
+        {
+            Journal->Header.ExtentCount = extentCount;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        TraceInfo("Continuing the copy without a journal");
+        CloseCopyJournal(Journal);
+    }
+}
+
+VOID
+CloseCopyJournal(
+    _Inout_ PRAW_DUMP_COPY_JOURNAL Journal
+)
+/*++
+
+Routine Description:
+
+    This function closes a copy journal. The file is kept, so that the copy can
+    still resume until CleanupContext deletes it with the destination.
+
+Arguments:
+
+    Journal - Journal opened by OpenCopyJournal.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    Journal->File.Close();
+
+    if (nullptr != Journal->Extents)
+    {
+        HeapFree(GetProcessHeap(), 0, Journal->Extents);
+        Journal->Extents = nullptr;
+    }
+
+    Journal->MaxExtents = 0;
+}
@@ -0,0 +1,874 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    rawdumpcompress.cpp
+
+Abstract:
+    Copy of the raw dump partition to RawDumpPath that compresses the DDR
+    sections as it goes. Every DDR section is written as a raw dump v2 chunked
+    section: a chunk index followed by RAW_DUMP_CHUNK_SIZE_DEFAULT chunks, each
+    encoded on its own, so raw2dump reads any part of the file without
+    decoding the rest of it. Other sections are copied as they are.
+
+    The chunks are encoded by a pool of worker threads, one batch at a time,
+    while the copy loop reads the next batch from the partition and writes the
+    one before it.
+
+Environment:
+    User Mode
+
+--*/
+#include "buildparams.h"
+#include "Chunked_Section.h"
+
+#define COMPRESS_MAX_THREADS        8
+#define COMPRESS_BATCH_COUNT        2       // One batch is encoded while the other is read and written
+#define COMPRESS_BATCH_CHUNKS       (DEFAULT_DMP_BUF_SZ / RAW_DUMP_CHUNK_SIZE_DEFAULT)
+#define COMPRESS_BATCH_SIZE         (COMPRESS_BATCH_CHUNKS * RAW_DUMP_CHUNK_SIZE_DEFAULT)
+
+//
+// ------------------------- Local Types ----------------------------------------------------------------------
+//
+
+typedef struct _COMPRESS_BATCH
+{
+    PUCHAR                  Data;           // Section data read from the partition
+    PUCHAR                  Stored;         // Encoded chunks, each at the offset of its chunk in Data
+    PRAW_DUMP_CHUNK_ENTRY   Entries;        // Entries of the batch in the chunk index of the section
+    UINT32                  Length;         // Bytes in Data
+    UINT32                  ChunkCount;
+    UINT32                  NextChunk;      // First chunk not taken by a worker
+    UINT32                  Remaining;      // Chunks not encoded yet
+    HRESULT                 hr;             // First encoding failure
+} COMPRESS_BATCH, *PCOMPRESS_BATCH;
+
+//
+// State shared by the copy loop and the encoding threads. All fields below
+// Lock are guarded by it; WorkReady is signalled when a batch is queued or the
+// pool stops, BatchDone when the last chunk of a batch is encoded.
+//
+typedef struct _COMPRESS_POOL
+{
+    COMPRESS_BATCH          Batches[COMPRESS_BATCH_COUNT];
+    PUCHAR                  Output;         // Encoded chunks of a batch, packed for one write
+    PVOID                   Workspaces[COMPRESS_MAX_THREADS];
+    HANDLE                  Threads[COMPRESS_MAX_THREADS];
+    UINT32                  ThreadCount;
+    CRITICAL_SECTION        Lock;
+    CONDITION_VARIABLE      WorkReady;
+    CONDITION_VARIABLE      BatchDone;
+    PCOMPRESS_BATCH         Queue[COMPRESS_BATCH_COUNT];    // Batches with chunks left to take, oldest first
+    UINT32                  QueueCount;
+    UINT32                  WorkersStarted;
+    BOOL                    Stop;
+} COMPRESS_POOL, *PCOMPRESS_POOL;
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+static DWORD
+WINAPI
+CompressWorkerThread(
+    _In_ LPVOID Parameter
+)
+/*++
+
+Routine Description:
+
+    This function encodes chunks of the queued batches, oldest batch first,
+    until the pool stops.
+
+Arguments:
+
+    Parameter - PCOMPRESS_POOL
+
+Return Value:
+
+    0
+
+--*/
+{
+    PCOMPRESS_POOL  pool = (PCOMPRESS_POOL)Parameter;
+    PCOMPRESS_BATCH batch;
+    PVOID           workspace;
+    UINT32          chunk;
+    UINT32          offset;
+    HRESULT         hr;
+
+    EnterCriticalSection(&pool->Lock);
+
+    workspace = pool->Workspaces[pool->WorkersStarted++];
+
+    for (;;)
+    {
+        while ( (FALSE == pool->Stop) && (0 == pool->QueueCount) )
+        {
+            SleepConditionVariableCS(&pool->WorkReady, &pool->Lock, INFINITE);
+        }
+
+        if (FALSE != pool->Stop)
+        {
+            break;
+        }
+
+        batch = pool->Queue[0];
+        chunk = batch->NextChunk++;
+
+        if (batch->NextChunk == batch->ChunkCount)
+        { // Every chunk of the batch is taken
+            pool->Queue[0] = pool->Queue[1];
+            pool->QueueCount--;
+        }
+
+        LeaveCriticalSection(&pool->Lock);
+
+        offset = chunk * RAW_DUMP_CHUNK_SIZE_DEFAULT;
+        hr = EncodeChunk(&batch->Data[offset],
+                         min((UINT32)RAW_DUMP_CHUNK_SIZE_DEFAULT, batch->Length - offset),
+                         &batch->Stored[offset],
+                         workspace,
+                         &batch->Entries[chunk]);
+
+        EnterCriticalSection(&pool->Lock);
+
+        if (FAILED(hr) && SUCCEEDED(batch->hr))
+        {
+            batch->hr = hr;
+        }
+
+        if (0 == --batch->Remaining)
+        {
+            WakeAllConditionVariable(&pool->BatchDone);
+        }
+    }
+
+    LeaveCriticalSection(&pool->Lock);
+
+    return 0;
+}
+
+static HRESULT
+StartCompressPool(
+    _Out_ PCOMPRESS_POOL Pool
+)
+/*++
+
+Routine Description:
+
+    This function allocates the batches of the pool and starts one encoding
+    thread per processor, up to COMPRESS_MAX_THREADS.
+
+Arguments:
+
+    Pool - Receives the pool. StopCompressPool must be called even if this
+           function fails.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT         hr = S_OK;
+    SYSTEM_INFO     systemInfo = { 0 };
+    UINT32          workspaceSize = 0;
+    UINT32          threadCount;
+
+    RtlZeroMemory(Pool, sizeof(*Pool));
+    InitializeCriticalSection(&Pool->Lock);
+    InitializeConditionVariable(&Pool->WorkReady);
+    InitializeConditionVariable(&Pool->BatchDone);
+
+    GetSystemInfo(&systemInfo);
+    threadCount = min(max((UINT32)systemInfo.dwNumberOfProcessors, 1u), (UINT32)COMPRESS_MAX_THREADS);
+
+    if ( FAILED(hr = GetChunkWorkspaceSize(&workspaceSize)) )
+    {
+        TraceHRESULT("GetChunkWorkspaceSize failed", hr);
+    }
+    else if ( nullptr == (Pool->Output = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, COMPRESS_BATCH_SIZE)) )
+    {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Could not allocate memory for the compressed output", hr);
+    }
+
+    for (UINT32 index = 0; SUCCEEDED(hr) && (index < COMPRESS_BATCH_COUNT); index++)
+    {
+        if ( (nullptr == (Pool->Batches[index].Data = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, COMPRESS_BATCH_SIZE)))
+             || (nullptr == (Pool->Batches[index].Stored = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, COMPRESS_BATCH_SIZE)))
+           )
+        {
+            hr = E_OUTOFMEMORY;
+            TraceHRESULT("Could not allocate memory for a compression batch", hr);
+        }
+    }
+
+    for (UINT32 index = 0; SUCCEEDED(hr) && (index < threadCount); index++)
+    {
+        if ( nullptr == (Pool->Workspaces[index] = HeapAlloc(GetProcessHeap(), 0, workspaceSize)) )
+        {
+            hr = E_OUTOFMEMORY;
+            TraceHRESULT("Could not allocate memory for a compression workspace", hr);
+        }
+    }
+
+    while ( SUCCEEDED(hr) && (Pool->ThreadCount < threadCount) )
+    {
+        if ( NULL == (Pool->Threads[Pool->ThreadCount] = CreateThread(nullptr, 0, CompressWorkerThread, Pool, 0, nullptr)) )
+        { // The threads already started stop with the pool
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            TraceHRESULT("FAILED: cannot start a compression thread", hr);
+        }
+        else
+        {
+            Pool->ThreadCount++;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        TraceInfo1("Compressing the raw dump", "Threads", Pool->ThreadCount);
+    }
+
+    return hr;
+}
+
+static VOID
+StopCompressPool(
+    _Inout_ PCOMPRESS_POOL Pool
+)
+/*++
+
+Routine Description:
+
+    This function stops the encoding threads and frees the pool. Batches that
+    were queued must have been waited for.
+
+Arguments:
+
+    Pool - Pool set up by StartCompressPool.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    EnterCriticalSection(&Pool->Lock);
+    Pool->Stop = TRUE;
+    WakeAllConditionVariable(&Pool->WorkReady);
+    LeaveCriticalSection(&Pool->Lock);
+
+    if (0 != Pool->ThreadCount)
+    {
+        WaitForMultipleObjects(Pool->ThreadCount, Pool->Threads, TRUE, INFINITE);
+    }
+
+    for (UINT32 index = 0; index < Pool->ThreadCount; index++)
+    {
+        CloseHandle(Pool->Threads[index]);
+    }
+
+    for (UINT32 index = 0; index < COMPRESS_MAX_THREADS; index++)
+    {
+        if (nullptr != Pool->Workspaces[index])
+        {
+            HeapFree(GetProcessHeap(), 0, Pool->Workspaces[index]);
+        }
+    }
+
+    for (UINT32 index = 0; index < COMPRESS_BATCH_COUNT; index++)
+    {
+        if (nullptr != Pool->Batches[index].Data)
+        {
+            HeapFree(GetProcessHeap(), 0, Pool->Batches[index].Data);
+        }
+
+        if (nullptr != Pool->Batches[index].Stored)
+        {
+            HeapFree(GetProcessHeap(), 0, Pool->Batches[index].Stored);
+        }
+    }
+
+    if (nullptr != Pool->Output)
+    {
+        HeapFree(GetProcessHeap(), 0, Pool->Output);
+    }
+
+    DeleteCriticalSection(&Pool->Lock);
+    RtlZeroMemory(Pool, sizeof(*Pool));
+}
+
+static VOID
+SubmitCompressBatch(
+    _Inout_ PCOMPRESS_POOL Pool,
+    _Inout_ PCOMPRESS_BATCH Batch
+)
+/*++
+
+Routine Description:
+
+    This function queues a batch whose Data, Length, ChunkCount and Entries
+    are set for the encoding threads.
+
+Arguments:
+
+    Pool - Pool set up by StartCompressPool.
+    Batch - One of the batches of the pool, not queued yet.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    EnterCriticalSection(&Pool->Lock);
+
+    Batch->NextChunk = 0;
+    Batch->Remaining = Batch->ChunkCount;
+    Batch->hr = S_OK;
+    Pool->Queue[Pool->QueueCount++] = Batch;
+    WakeAllConditionVariable(&Pool->WorkReady);
+
+    LeaveCriticalSection(&Pool->Lock);
+}
+
+static HRESULT
+WaitCompressBatch(
+    _Inout_ PCOMPRESS_POOL Pool,
+    _In_    PCOMPRESS_BATCH Batch
+)
+/*++
+
+Routine Description:
+
+    This function waits until every chunk of a queued batch is encoded.
+
+Arguments:
+
+    Pool - Pool set up by StartCompressPool.
+    Batch - Batch queued by SubmitCompressBatch.
+
+Return Value:
+
+    HRESULT of the first chunk that could not be encoded, S_OK otherwise.
+
+--*/
+{
+    HRESULT hr;
+
+    EnterCriticalSection(&Pool->Lock);
+
+    while (0 != Batch->Remaining)
+    {
+        SleepConditionVariableCS(&Pool->BatchDone, &Pool->Lock, INFINITE);
+    }
+
+    hr = Batch->hr;
+
+    LeaveCriticalSection(&Pool->Lock);
+
+    return hr;
+}
+
+static HRESULT
+WriteCompressBatch(
+    _Inout_ PCOMPRESS_POOL Pool,
+    _In_    PCOMPRESS_BATCH Batch,
+    _Inout_ DEVICE_IO *File,
+    _Inout_ PRAW_DUMP_CHUNK_INDEX_HEADER Index
+)
+/*++
+
+Routine Description:
+
+    This function packs the encoded chunks of a batch and writes them after
+    the chunk data already written for the section, filling in the offsets of
+    their entries.
+
+Arguments:
+
+    Pool - Pool set up by StartCompressPool.
+    Batch - Batch with every chunk encoded.
+    File - Destination, positioned after the chunk data already written.
+    Index - Chunk index of the section, DataSize is updated.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT hr = S_OK;
+    size_t  packed = 0;
+    size_t  bytesWritten = 0;
+
+    for (UINT32 chunk = 0; chunk < Batch->ChunkCount; chunk++)
+    {
+        PRAW_DUMP_CHUNK_ENTRY entry = &Batch->Entries[chunk];
+
+        entry->Offset = Index->DataSize + packed;
+        memcpy(&Pool->Output[packed], &Batch->Stored[(size_t)chunk * RAW_DUMP_CHUNK_SIZE_DEFAULT], entry->StoredSize);
+        packed += entry->StoredSize;
+    }
+
+    if ( (0 != packed)
+         && FAILED(hr = File->Write((PCHAR)Pool->Output, packed, &bytesWritten))
+       )
+    {
+        TraceHRESULT("FAILED: cannot write the compressed chunks", hr);
+    }
+    else
+    {
+        Index->DataSize += packed;
+    }
+
+    return hr;
+}
+
+static HRESULT
+CopyChunkedSection(
+    _Inout_ PDMP_CONTEXT Context,
+    _Inout_ PCOMPRESS_POOL Pool,
+    _Inout_ DEVICE_IO *File,
+    _In_    const RAW_DUMP_SECTION_HEADER *Source,
+    _In_    UINT64 FileOffset,
+    _Out_   PUINT64 BytesWritten
+)
+/*++
+
+Routine Description:
+
+    This function copies a DDR section from the partition as a chunked
+    section at FileOffset. The chunks are written after the space of the
+    chunk index, which is written last, once the size of every chunk is known.
+
+Arguments:
+
+    Context - Pointer to PDMP_CONTEXT, hDisk is the raw dump partition.
+    Pool - Pool set up by StartCompressPool.
+    File - Destination.
+    Source - Section entry in the partition's section table.
+    FileOffset - Where the section is written.
+    BytesWritten - Receives the bytes written, chunk index included.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT                         hr = S_OK;
+    HRESULT                         batchHr;
+    RAW_DUMP_CHUNK_INDEX_HEADER     index;
+    PRAW_DUMP_CHUNK_ENTRY           entries = nullptr;
+    PCOMPRESS_BATCH                 batch;
+    PCOMPRESS_BATCH                 pending = nullptr;
+    UINT64                          remaining = Source->Size;
+    UINT32                          nextChunk = 0;
+    UINT32                          nextBatch = 0;
+    size_t                          bytesProcessed = 0;
+
+    *BytesWritten = 0;
+
+    RtlZeroMemory(&index, sizeof(index));
+    index.Signature = RAW_DUMP_CHUNK_INDEX_SIGNATURE;
+    index.Version = RAW_DUMP_CHUNK_INDEX_VERSION;
+    index.ChunkSize = RAW_DUMP_CHUNK_SIZE_DEFAULT;
+    index.ChunkCount = RAW_DUMP_CHUNK_COUNT(Source->Size, (UINT64)RAW_DUMP_CHUNK_SIZE_DEFAULT);
+
+    if ( nullptr == (entries = (PRAW_DUMP_CHUNK_ENTRY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (size_t)index.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY))) )
+    {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT1("Could not allocate memory for the chunk index", "Chunks", index.ChunkCount, hr);
+    }
+    else if ( FAILED(hr = Context->hDisk.SetPos(Source->Offset)) )
+    {
+        TraceHRESULT("FAILED: SetPos() - cannot go to the DDR section in the partition", hr);
+    }
+    else if ( FAILED(hr = File->SetPos(FileOffset + RAW_DUMP_CHUNK_INDEX_SIZE(index.ChunkCount))) )
+    {
+        TraceHRESULT("FAILED: SetPos() - cannot go to the chunk data", hr);
+    }
+    else
+    {
+        //
+        // Read and queue a batch, then write the one queued before it while
+        // the workers encode the new one.
+        //
+        while ( SUCCEEDED(hr) && ((0 != remaining) || (nullptr != pending)) )
+        {
+            batch = nullptr;
+
+            if (0 != remaining)
+            {
+                batch = &Pool->Batches[nextBatch];
+                batch->Length = (UINT32)min(remaining, (UINT64)COMPRESS_BATCH_SIZE);
+                batch->ChunkCount = RAW_DUMP_CHUNK_COUNT(batch->Length, RAW_DUMP_CHUNK_SIZE_DEFAULT);
+                batch->Entries = &entries[nextChunk];
+
+                if ( FAILED(hr = Context->hDisk.Read((PCHAR)batch->Data, batch->Length, &bytesProcessed))
+                     || (batch->Length != bytesProcessed)
+                   )
+                {
+                    hr = FAILED(hr) ? hr : HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+                    TraceHRESULT1("FAILED: cannot read the DDR section from the partition", "Offset", Source->Offset + (Source->Size - remaining), hr);
+                    batch = nullptr;
+                }
+                else
+                {
+                    SubmitCompressBatch(Pool, batch);
+                    remaining -= batch->Length;
+                    nextChunk += batch->ChunkCount;
+                    nextBatch = (nextBatch + 1) % COMPRESS_BATCH_COUNT;
+                }
+            }
+
+            if (nullptr == pending)
+            { // First batch of the section, nothing to write yet
+            }
+            else if ( FAILED(batchHr = WaitCompressBatch(Pool, pending)) )
+            {
+                hr = FAILED(hr) ? hr : batchHr;
+                TraceHRESULT("FAILED: cannot encode the chunks of a DDR section", batchHr);
+            }
+            else if (SUCCEEDED(hr))
+            {
+                hr = WriteCompressBatch(Pool, pending, File, &index);
+            }
+
+            pending = batch;
+        }
+
+        if (nullptr != pending)
+        { // Stopped by a failure, the workers may still use the batch
+            WaitCompressBatch(Pool, pending);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            index.EntriesCrc = ComputeCrc32(entries, (size_t)index.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY), 0);
+
+            if ( FAILED(hr = File->SetPos(FileOffset))
+                 || FAILED(hr = File->Write((PCHAR)&index, sizeof(index), &bytesProcessed))
+                 || FAILED(hr = File->Write((PCHAR)entries, (size_t)index.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY), &bytesProcessed))
+               )
+            {
+                TraceHRESULT("FAILED: cannot write the chunk index", hr);
+            }
+            else
+            {
+                *BytesWritten = RAW_DUMP_CHUNK_INDEX_SIZE(index.ChunkCount) + index.DataSize;
+                TraceInfo3("DDR section compressed", "Base", Source->u.DDRInformation.Base, "Size", Source->Size, "Written", *BytesWritten);
+            }
+        }
+    }
+
+    if (nullptr != entries)
+    {
+        HeapFree(GetProcessHeap(), 0, entries);
+    }
+
+    return hr;
+}
+
+static HRESULT
+CopyPlainSection(
+    _Inout_ PDMP_CONTEXT Context,
+    _Out_writes_bytes_(COMPRESS_BATCH_SIZE) PUCHAR Buffer,
+    _Inout_ DEVICE_IO *File,
+    _In_    UINT64 SourceOffset,
+    _In_    UINT64 FileOffset,
+    _In_    UINT64 Size,
+    _Out_   PUINT32 Crc
+)
+/*++
+
+Routine Description:
+
+    This function copies a section from the partition as it is.
+
+Arguments:
+
+    Context - Pointer to PDMP_CONTEXT, hDisk is the raw dump partition.
+    Buffer - COMPRESS_BATCH_SIZE bytes to copy through.
+    File - Destination.
+    SourceOffset - Offset of the section in the partition.
+    FileOffset - Where the section is written.
+    Size - Bytes to copy.
+    Crc - Receives the CRC32 of the bytes copied.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT hr = S_OK;
+
+    *Crc = 0;
+
+    if (0 == Size)
+    { // Nothing to copy
+    }
+    else if ( FAILED(hr = Context->hDisk.SetPos(SourceOffset))
+              || FAILED(hr = File->SetPos(FileOffset))
+            )
+    {
+        TraceHRESULT("FAILED: SetPos() - cannot go to the section", hr);
+    }
+    else
+    {
+        while (Size > 0)
+        {
+            size_t  length = (size_t)min(Size, (UINT64)COMPRESS_BATCH_SIZE);
+            size_t  bytesRead = 0;
+            size_t  bytesWritten = 0;
+
+            if ( FAILED(hr = Context->hDisk.Read((PCHAR)Buffer, length, &bytesRead))
+                 || (length != bytesRead)
+               )
+            {
+                hr = FAILED(hr) ? hr : HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+                TraceHRESULT("FAILED: cannot read the section from the partition", hr);
+                break;
+            }
+            else if ( FAILED(hr = File->Write((PCHAR)Buffer, length, &bytesWritten)) )
+            {
+                TraceHRESULT("FAILED: cannot write the section", hr);
+                break;
+            }
+
+            *Crc = ComputeCrc32(Buffer, length, *Crc);
+            Size -= length;
+        }
+    }
+
+    return hr;
+}
+
+static BOOL
+PlanCompressedSection(
+    _Inout_ PRAW_DUMP_SECTION_HEADER Section,
+    _In_    UINT64 PartitionSize
+)
+/*++
+
+Routine Description:
+
+    This function decides how a section is written to the compressed copy and
+    updates its entry to match, all but the Offset, which is only known once
+    the section is written. DDR sections the partition holds entirely become
+    chunked sections. Other sections are copied as they are, cut to the part
+    the partition holds, since in the copy the next section follows them
+    directly.
+
+Arguments:
+
+    Section - Entry of the section, in the destination's section table.
+    PartitionSize - Bytes in the raw dump partition.
+
+Return Value:
+
+    TRUE if the section is written as a chunked section.
+
+--*/
+{
+    UINT64  available = (Section->Offset < PartitionSize) ? (PartitionSize - Section->Offset) : 0;
+
+    if ( (RAW_DUMP_SECTION_TYPE_DDR_RANGE == Section->Type)
+         && (0 != Section->Size)
+         && (Section->Size <= available)
+       )
+    {
+        Section->Version = RAW_DUMP_SECTION_HEADER_VERSION_V2;
+        Section->Flags |= RAW_DUMP_SECTION_FLAGS_CHUNKED;
+        return TRUE;
+    }
+
+    Section->Size = min(Section->Size, available);
+    return FALSE;
+}
+
+HRESULT
+CompressRawDumpPartitionToFile(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_    LPCWSTR FilePath
+)
+/*++
+
+Routine Description:
+
+    This function copies the raw dump partition to a single file, compressing
+    its DDR sections, see PlanCompressedSection. The sections follow the
+    header and section table in table order; the space between sections and
+    after the last one is not copied. The section table is written with the
+    offsets in the file and DumpSize is the size of the file, so the device
+    specific info is appended at its end as it is to an uncompressed copy.
+
+    On success Context->hDisk is the handle of the new file. DDR reads
+    through Context->DDRMemoryMap must be done before the copy, its offsets
+    are the partition's.
+
+    Every section copied is checkpointed in the copy journal, so a copy cut
+    short by a reboot or a killed service resumes after the last section that
+    is still in the file.
+
+Arguments:
+
+    Context - Pointer to PDMP_CONTEXT
+    FilePath - the bin file name
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    HRESULT                 result = E_FAIL;
+    DEVICE_IO               hFile;
+    COMPRESS_POOL           pool;
+    RAW_DUMP_COPY_JOURNAL   journal;
+    PRAW_DUMP_HEADER        header = nullptr;
+    ULONGLONG               partitionSize = Context->hDisk.GetCurrentPartitionSize();
+    ULONGLONG               fileOffset = Context->RawDumpTableSize;
+    UINT32                  firstSection = 0;
+    size_t                  bytesWritten = 0;
+
+    if ( FAILED(OpenCopyJournal(Context,
+                                FilePath,
+                                partitionSize,
+                                RAW_DUMP_COPY_FORMAT_CHUNKED,
+                                Context->RawDumpHeader->SectionsCount,
+                                &journal)) )
+    {
+        TraceInfo("Compressing the raw dump partition without a copy journal");
+    }
+
+    if ( FAILED(result = StartCompressPool(&pool)) )
+    {
+        TraceHRESULT("FAILED: cannot start the compression threads", result);
+    }
+    else if ( nullptr == (header = (PRAW_DUMP_HEADER)HeapAlloc(GetProcessHeap(), 0, Context->RawDumpTableSize)) )
+    {
+        result = E_OUTOFMEMORY;
+        TraceHRESULT("Could not allocate memory for the section table", result);
+    }
+    else if ( FAILED(result = hFile.SetDirectIo(TRUE))     // Written once, keep it out of the file cache
+              || FAILED(result = hFile.Open(FilePath))
+            )
+    {
+        TraceHRESULT("FAILED: cannot open destination file", result);
+    }
+    else
+    {
+        memcpy(header, Context->RawDumpHeader, Context->RawDumpTableSize);
+
+        for (UINT32 sectionIndex = 0; sectionIndex < header->SectionsCount; sectionIndex++)
+        {
+            PlanCompressedSection(&header->SectionTable[sectionIndex], partitionSize);
+        }
+
+        //
+        // Sections copied by an earlier attempt at this dump get their
+        // offsets back and are not copied again.
+        //
+        for (UINT32 extentIndex = 0; extentIndex < journal.Header.ExtentCount; extentIndex++)
+        {
+            PRAW_DUMP_COPY_EXTENT extent = &journal.Extents[extentIndex];
+
+            if (extent->Section < header->SectionsCount)
+            {
+                header->SectionTable[extent->Section].Offset = extent->Offset;
+                firstSection = extent->Section + 1;
+                fileOffset = extent->Offset + extent->Size;
+            }
+        }
+
+        //
+        // The header and section table are written first to hold their place,
+        // and again once every section has its offset.
+        //
+        if ( FAILED(result = hFile.SetPos(0))
+             || FAILED(result = hFile.Write((PCHAR)header, Context->RawDumpTableSize, &bytesWritten))
+           )
+        {
+            TraceHRESULT("ERROR: Write() - Write Raw Dump Header Tables failed", result);
+        }
+
+        for (UINT32 sectionIndex = firstSection; SUCCEEDED(result) && (sectionIndex < header->SectionsCount); sectionIndex++)
+        {
+            PRAW_DUMP_SECTION_HEADER    section = &header->SectionTable[sectionIndex];
+            const RAW_DUMP_SECTION_HEADER *source = &Context->RawDumpHeader->SectionTable[sectionIndex];
+            UINT64                      sectionSize = section->Size;
+            UINT32                      crc = 0;
+
+            if (0 == (section->Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED))
+            {
+                result = CopyPlainSection(Context, pool.Batches[0].Data, &hFile, source->Offset, fileOffset, sectionSize, &crc);
+            }
+            else if ( SUCCEEDED(result = CopyChunkedSection(Context, &pool, &hFile, source, fileOffset, &sectionSize))
+                      && (nullptr != journal.Extents)
+                    )
+            { // The chunk index is written after the chunks, read the section back for its CRC
+                result = ComputeCopyExtentCrc(&hFile, fileOffset, sectionSize, &crc);
+            }
+
+            if (SUCCEEDED(result))
+            {
+                section->Offset = fileOffset;
+                AppendCopyJournalExtent(&journal, &hFile, fileOffset, sectionSize, crc, sectionIndex, 0);
+                fileOffset += sectionSize;
+            }
+        }
+
+        if (SUCCEEDED(result))
+        {
+            header->DumpSize = fileOffset;
+
+            if ( FAILED(result = hFile.SetPos(0))
+                 || FAILED(result = hFile.Write((PCHAR)header, Context->RawDumpTableSize, &bytesWritten))
+               )
+            {
+                TraceHRESULT("ERROR: Write() - Update Raw Dump Header Tables failed", result);
+            }
+        }
+
+        hFile.Close();
+
+        //
+        // Drop anything an earlier copy left past the last section, the device
+        // specific info is appended right after it.
+        //
+        if ( SUCCEEDED(result)
+             && SUCCEEDED(result = TruncateCopyDestination(FilePath, fileOffset))
+           )
+        { // exchange original handle with the new file
+            if ( FAILED(Context->hDisk.Close())
+                 || FAILED(Context->hDisk.Open(FilePath))
+               )
+            {
+                result = HRESULT_FROM_WIN32(GetLastError());
+                TraceHRESULT("ERROR: Failed to re-open file!", result);
+            }
+            else
+            {
+                TraceInfo2("Raw dump partition compressed", "Partition", partitionSize, "File", fileOffset);
+            }
+        }
+    }
+
+    StopCompressPool(&pool);
+
+    if (nullptr != header)
+    {
+        HeapFree(GetProcessHeap(), 0, header);
+    }
+
+    CloseCopyJournal(&journal);
+
+    return result;
+}
@@ -19,6 +19,9 @@ Environment:
 #include "offdmpistream.h"
 #include "buildparams.h"
 
+static_assert(sizeof(SENTINEL) == IN_MEM_DATA_DUMP_HEADER_OFFSET,
+              "raw2dump finds the DUMP_HEADER at DataPA + IN_MEM_DATA_DUMP_HEADER_OFFSET");
+
 //
 // Converting all GUID to human readable form.
 //
@@ -213,8 +216,9 @@ QCom32::GetAPReg(
 _Out_ bool* IsApRegValid
 )
 {
-    AP_REG_B_FAMILY_HEADER  apRegHeader = {0};
     ULONG                   dataSize = sizeof(m_APRegAddress);
+    UINT32                  apRegSize = 0;
+    BATCH_READ_REQUEST      requests[2];
     NTSTATUS                status = STATUS_UNSUCCESSFUL;
     HRESULT                 result = E_FAIL;
     UNICODE_STRING          apRegAddressVarName;
@@ -250,31 +254,68 @@ _Out_ bool* IsApRegValid
     
     TraceInfo1("AP_REG address is ", " Physical address", m_APRegAddress.QuadPart);
 
-    result = ReadFromDDRSectionByPhysicalAddress(m_Context,
-        m_APRegAddress,
+    //
+    // Read the header together with the CPU_STATUS array that follows it in a
+    // legacy AP_REG. BuildDiagBuffer and BuildBugCheckParams need both.
+    //
+    apRegSize = sizeof(AP_REG_B_FAMILY_HEADER) + (AP_REG_MAX_CPUS * sizeof(CPU_STATUS));
+    m_ApReg = (PAP_REG_B_FAMILY_HEADER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, apRegSize);
+    if (m_ApReg == nullptr) {
+        result = E_ALLOCATION_ERROR;
+        TraceHRESULT("Failed to allocate memory for AP_REG", result);
+        goto Exit;
+    }
+
+    BATCH_READ_REQUEST_INIT(requests[0],
+        m_APRegAddress.QuadPart,
         sizeof(AP_REG_B_FAMILY_HEADER),
-        &apRegHeader);    
+        m_ApReg);
+
+    BATCH_READ_REQUEST_INIT(requests[1],
+        m_APRegAddress.QuadPart + sizeof(AP_REG_B_FAMILY_HEADER),
+        AP_REG_MAX_CPUS * sizeof(CPU_STATUS),
+        Add2Ptr(m_ApReg, sizeof(AP_REG_B_FAMILY_HEADER)));
+
+    (VOID)ReadFromDDRSectionBatch(m_Context, requests, ARRAYSIZE(requests));
 
+    result = requests[0].Result;
     if (!SUCCEEDED(result)) {
-        TraceNTSTATUS("Read AP_REG failed", status);
+        TraceHRESULT("Read AP_REG failed", result);
         goto Exit;
     }
+
+    //
+    // The header is present, so AP_REG is valid from here on. Problems with
+    // the CPU_STATUS array below only drop the per-CPU data.
+    //
+    *IsApRegValid = TRUE;
+    result = S_OK;
     
     //
     // Check signature. If it has a magic string, it is a Legacy type of 
     // APREG. Else it is the new 64 bit compatible structure.
     // We dont need any more validation here. Those can be done at the back end.
     //
-    if (apRegHeader.Magic != AP_REG_STRUCTURE_MAGIC_VALUE) {
+    if (m_ApReg->Magic != AP_REG_STRUCTURE_MAGIC_VALUE) {
         
         //
         // Assuming the this is a 64 bit APREG structure.
         //
         m_Context->IsAPREG64Bit = TRUE;
+        HeapFree(GetProcessHeap(), 0, m_ApReg);
+        m_ApReg = nullptr;
+    }
+    else if (!SUCCEEDED(requests[1].Result) ||
+             (m_ApReg->CPU_Count == 0) ||
+             (m_ApReg->CPU_Count > AP_REG_MAX_CPUS)) {
+        //
+        // The CPU_STATUS array can't be used. Keep the header validity and
+        // skip only the per-CPU data.
+        //
+        TraceInfo1("Unexpected AP_REG CPU count", "Actual", m_ApReg->CPU_Count);
+        HeapFree(GetProcessHeap(), 0, m_ApReg);
+        m_ApReg = nullptr;
     }
-
-    *IsApRegValid = TRUE;
-    result = S_OK;
 
 Exit:
 
@@ -384,11 +425,10 @@ QCom32::BuildDiagBuffer(VOID)
 {
     HRESULT                     result = E_FAIL;
     PINMEM_DIAG_BUFFER          buffer = nullptr;
-    UINT32                      bytesToRead = 0;
     UINT32                      cpuCount = 0;
     PCPU_STATUS                 cpuStatus = nullptr;
-    PHYSICAL_ADDRESS            temp = { 0 };
     UCHAR                       tempSig[] = ONEFOURC_DIAG_BUFFER_SIGNATURE;
+    BATCH_READ_REQUEST          requests[IN_MEM_READ_COUNT];
 
     TraceInfo("Building diag buffer.\r\n");
     m_Context->SBLDumpProgress.IsDiagBufferBuilt = CHKLIST_FALSE;
@@ -440,16 +480,37 @@ QCom32::BuildDiagBuffer(VOID)
         "AdditionalData", buffer->OneFourCBuffer.AdditionalData);
 
     //
-    // First is to validate signature.
+    // The signature, the bugcheck data and DUMP_HEADER.Comment all sit at the
+    // start of the in mem data, so fetch them together.
+    // The bugcheck data and Comment are located after the Sentinel structure.
+    //
+    TraceInfo("Reading in mem data buffer signature, bugcheck data and dummy function address...");
+    BATCH_READ_REQUEST_INIT(requests[IN_MEM_READ_SIGNATURE],
+        m_InMemDataInfo.DataPA.QuadPart,
+        ONEFOURC_DIAG_BUFFER_SIGNATURE_LENGTH,
+        &buffer->OneFourCBuffer.Signature[0]);
+
+    BATCH_READ_REQUEST_INIT(requests[IN_MEM_READ_BUGCHECK_DATA],
+        m_InMemDataInfo.DataPA.QuadPart + IN_MEM_DATA_DUMP_HEADER_OFFSET + FIELD_OFFSET(DUMP_HEADER32, BugCheckCode),
+        sizeof(buffer->OneFourCBuffer.BugCheckData[0]) * ONEFOURC_DIAG_BUFFER_BUGCHECK_DATA_COUNT,
+        &buffer->OneFourCBuffer.BugCheckData[0]);
+
+    //
+    // Get the dummy function address from DUMP_HEADER.Comments. 
+    // This gets used when we update AP m_Context and when we aren't sure
+    // if PC is valid.
+    //
+    BATCH_READ_REQUEST_INIT(requests[IN_MEM_READ_DUMMY_FUNCTION],
+        m_InMemDataInfo.DataPA.QuadPart + IN_MEM_DATA_DUMP_HEADER_OFFSET + FIELD_OFFSET(DUMP_HEADER32, Comment),
+        sizeof(m_AddressOfDummyFunction),
+        &m_AddressOfDummyFunction);
+
+    //
+    // Each request is checked below, the dummy function address is optional.
     //
-    TraceInfo("Validating in mem data buffer signature...");
-    temp.QuadPart = m_InMemDataInfo.DataPA.QuadPart;
-    bytesToRead = ONEFOURC_DIAG_BUFFER_SIGNATURE_LENGTH;
-    result = ReadFromDDRSectionByPhysicalAddress(m_Context,
-                temp,
-                bytesToRead,
-                &buffer->OneFourCBuffer.Signature[0]);
+    (VOID)ReadFromDDRSectionBatch(m_Context, requests, IN_MEM_READ_COUNT);
 
+    result = requests[IN_MEM_READ_SIGNATURE].Result;
     if (!SUCCEEDED(result))
     {
         TraceHRESULT("Failed to read signature from in memory structure.", result);
@@ -467,22 +528,7 @@ QCom32::BuildDiagBuffer(VOID)
         goto Exit;
     }
 
-    //
-    // Now get the bugcheck data located after the Sentinel structure.
-    //
-    TraceInfo("Retrieve bugcheck data.");
-    temp.QuadPart = m_InMemDataInfo.DataPA.QuadPart +
-        sizeof(SENTINEL)+
-        FIELD_OFFSET(DUMP_HEADER32, BugCheckCode);
-
-    bytesToRead = sizeof(buffer->OneFourCBuffer.BugCheckData[0]) *
-        ONEFOURC_DIAG_BUFFER_BUGCHECK_DATA_COUNT;
-
-    result = ReadFromDDRSectionByPhysicalAddress(m_Context,
-        temp,
-        bytesToRead,
-        &buffer->OneFourCBuffer.BugCheckData[0]);
-
+    result = requests[IN_MEM_READ_BUGCHECK_DATA].Result;
     if (!SUCCEEDED(result)) {
         TraceHRESULT("Failed to read bugcheck data from in memory structure.", result);
         goto Exit;
@@ -495,26 +541,9 @@ QCom32::BuildDiagBuffer(VOID)
     TraceInfo1("Param3", "Value", buffer->OneFourCBuffer.BugCheckData[3]);
     TraceInfo1("Param4", "Value", buffer->OneFourCBuffer.BugCheckData[4]);
 
-    //
-    // Get the dummy function address from DUMP_HEADER.Comments. 
-    // This gets used when we update AP m_Context and when we aren't sure
-    // if PC is valid.
-    //
-    TraceInfo("Retrieve bugcheck data.");
-    temp.QuadPart = m_InMemDataInfo.DataPA.QuadPart +
-        sizeof(SENTINEL)+
-        FIELD_OFFSET(DUMP_HEADER32, Comment);
-
-    bytesToRead = sizeof(m_AddressOfDummyFunction);
-
-    result = ReadFromDDRSectionByPhysicalAddress(m_Context,
-                temp,
-                bytesToRead,
-                &m_AddressOfDummyFunction);
-
-    if (!SUCCEEDED(result)) {
+    if (!SUCCEEDED(requests[IN_MEM_READ_DUMMY_FUNCTION].Result)) {
         TraceHRESULT("Failed to read dummy function address from in memory structure.",
-            result);
+            requests[IN_MEM_READ_DUMMY_FUNCTION].Result);
     }
     else
     {
@@ -526,7 +555,7 @@ QCom32::BuildDiagBuffer(VOID)
     //
     buffer->QCData.Version = QC_ADDITIONAL_DATA_VERSION;
 
-    if (m_Context->SBLDumpProgress.IsAPRegPresent == CHKLIST_TRUE)
+    if ((m_Context->SBLDumpProgress.IsAPRegPresent == CHKLIST_TRUE) && (m_ApReg != nullptr))
     {
         TraceInfo("Adding m_ApReg data...");
 
@@ -675,7 +704,7 @@ QCom32::BuildBugCheckParams(VOID)
         //
         if (m_Context->SBLDumpProgress.IsAPRegPresent == CHKLIST_TRUE)
         {
-            if(!m_Context->IsAPREG64Bit)
+            if(!m_Context->IsAPREG64Bit && (m_ApReg != nullptr))
             {            
                 cpuStatus = (PCPU_STATUS)Add2Ptr(m_ApReg, sizeof(AP_REG_B_FAMILY_HEADER));
                 cpuCount = m_ApReg->CPU_Count;
@@ -824,6 +853,15 @@ QCom32::BuildInfoFile(VOID)
         goto Exit;
     }
 
+    //
+    // PA="DataPA + IN_MEM_DATA_DUMP_HEADER_OFFSET", a hint to where the DUMP_HEADER is.
+    //
+    if (FAILED(hr = WriteUINT64AttrString(pWriter,
+                        GetDumpHeaderPAHint(),
+                        L"PA"))) {
+        goto Exit;
+    }
+
     //
     // </DumpHeader>
     //
@@ -1021,11 +1059,22 @@ QCom32::BuildInfoBuffer(
         DeviceSpecificInfo->BugCheckParam2 = m_Context->DumpHeader->BugCheckParameter2;
         DeviceSpecificInfo->BugCheckParam3 = m_Context->DumpHeader->BugCheckParameter3;
         DeviceSpecificInfo->BugCheckParam4 = m_Context->DumpHeader->BugCheckParameter4;
+        DeviceSpecificInfo->DumpHeaderPA = GetDumpHeaderPAHint();
     }
 
     return hr;
 }
 
+ULONGLONG
+QCom32::GetDumpHeaderPAHint(VOID)
+{
+    if (m_InMemDataInfo.DataPA.QuadPart == 0) {
+        return 0;
+    }
+
+    return m_InMemDataInfo.DataPA.QuadPart + IN_MEM_DATA_DUMP_HEADER_OFFSET;
+}
+
 //
 //----------------- Helper function -----------------------------
 //
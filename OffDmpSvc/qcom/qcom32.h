@@ -24,6 +24,17 @@ Environment:
 
 #define CP15_MIDR              15, 0,  0,  0, 0         // Main ID Register
 
+//
+// Fields of the in mem data that BuildDiagBuffer fetches in one batch.
+//
+typedef enum
+{
+    IN_MEM_READ_SIGNATURE = 0,
+    IN_MEM_READ_BUGCHECK_DATA,
+    IN_MEM_READ_DUMMY_FUNCTION,
+    IN_MEM_READ_COUNT
+} IN_MEM_READ_INDEX;
+
 // nonstandard extension used : bit field types other than int
 #pragma warning(disable: 4214) 
 #include "wponefourc.h"
@@ -210,6 +221,26 @@ private:
 
     /*++
 
+    Routine Description:
+        This routine returns the physical address of the in-memory DUMP_HEADER.
+        The kernel lays out the in-memory data as head sentinel, DUMP_HEADER,
+        tail sentinel (see wpcrdmpsentinel.h), so the header follows the head
+        sentinel at m_InMemDataInfo.DataPA. raw2dump tries this address before
+        scanning DDR for the sentinel.
+
+    Arguments:
+        None
+
+    Return Value:
+        Physical address of the DUMP_HEADER, or zero if the in-memory data
+        location is not known.
+
+    --*/
+    ULONGLONG
+    GetDumpHeaderPAHint(VOID);
+
+    /*++
+
     Routine Description:
         This function fills in the contents of ONEFOURC_DIAG_BUFFER.
 
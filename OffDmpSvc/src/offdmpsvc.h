@@ -42,6 +42,7 @@ Environment:
 #include "Device_IO.h"
 #include "logging.h"
 #include "Device_Specific.h"
+#include "Batch_Read.h"
 
 // nonstandard extension used : bit field types other than int
 #pragma warning(disable: 4214) 
@@ -72,7 +73,6 @@ Environment:
 // an ntfs limit
 //
 #define MAX_FILE_SIZE 0xFFFFFFF0000 
-#define MAX_ALLOWED_DDR_SECTIONS 10
 #define CHKLIST_TRUE    0x1
 #define CHKLIST_FALSE   0x0
 
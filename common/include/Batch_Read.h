@@ -0,0 +1,73 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Batch_Read.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "DEVICE_IO.h"
+
+/******************************************************************************
+** Coalescing limits
+**   Requests closer than BATCH_READ_MAX_GAP bytes are fetched with one read;
+**   the gap is read and discarded since it is cheaper than another seek.
+**   A single coalesced read never exceeds BATCH_READ_MAX_SPAN bytes.
+*******************************************************************************/
+#define BATCH_READ_MAX_GAP                  0x1000
+#define BATCH_READ_MAX_SPAN                 0x100000
+
+/******************************************************************************
+** A physically contiguous range stored contiguously in the file/device.
+** FileOffset is the absolute position of Base in the file/device.
+*******************************************************************************/
+typedef struct _PHYSICAL_EXTENT
+{
+    UINT64      Base;
+    UINT64      Size;
+    UINT64      FileOffset;
+} PHYSICAL_EXTENT, *PPHYSICAL_EXTENT;
+
+/******************************************************************************
+** One (PA, length, destination) request. Result is filled in by
+** ReadPhysicalBatch so callers can tolerate individual failures.
+*******************************************************************************/
+typedef struct _BATCH_READ_REQUEST
+{
+    UINT64      PhysicalAddress;
+    UINT32      Length;
+    PVOID       Buffer;
+    HRESULT     Result;
+} BATCH_READ_REQUEST, *PBATCH_READ_REQUEST;
+
+#define BATCH_READ_REQUEST_INIT(req, pa, len, buf) \
+    { \
+        (req).PhysicalAddress = (UINT64)(pa); \
+        (req).Length = (UINT32)(len); \
+        (req).Buffer = (PVOID)(buf); \
+        (req).Result = E_PENDING; \
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+** ReadPhysicalBatch positions hFile before every read, so it is NOT
+** thread-safe on a DEVICE_IO shared with other threads unless those threads
+** serialize their SetPos + Read/Write with the same critical section passed
+** as Lock. Pass nullptr when hFile is not shared.
+*******************************************************************************/
+HRESULT
+ReadPhysicalBatch(
+    _In_    DEVICE_IO *hFile,
+    _In_opt_ PCRITICAL_SECTION Lock,
+    _In_reads_(ExtentCount) const PHYSICAL_EXTENT *Extents,
+    _In_    UINT32 ExtentCount,
+    _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+    _In_    UINT32 RequestCount
+);
@@ -0,0 +1,152 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Chunked_Section.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "DEVICE_IO.h"
+
+/******************************************************************************
+** Raw Dump v2 - chunked sections
+**
+**   A v2 section is flagged with RAW_DUMP_SECTION_FLAGS_CHUNKED and carries
+**   RAW_DUMP_SECTION_HEADER_VERSION_V2. Its Size is still the size of the
+**   data it describes, but Offset points to a chunk index instead of the data:
+**
+**      RAW_DUMP_CHUNK_INDEX_HEADER
+**      RAW_DUMP_CHUNK_ENTRY[ChunkCount]
+**      chunk data (DataSize bytes)
+**
+**   Every chunk covers ChunkSize bytes of the section (the last one may be
+**   shorter) and is encoded on its own, so any part of the section can be read
+**   by decoding only the chunks it touches. Sections without the flag keep the
+**   v1 layout, a dump may mix both.
+*******************************************************************************/
+#define RAW_DUMP_SECTION_HEADER_VERSION_V2      0x00002000
+#define RAW_DUMP_SECTION_FLAGS_CHUNKED          0x4
+
+#define RAW_DUMP_CHUNK_INDEX_SIGNATURE          (UINT64)(0x78496B6E68434452)  // "RDChnkIx"
+#define RAW_DUMP_CHUNK_INDEX_VERSION            0x00001000
+
+#define RAW_DUMP_CHUNK_SIZE_DEFAULT             0x10000
+#define RAW_DUMP_CHUNK_SIZE_MIN                 0x1000
+#define RAW_DUMP_CHUNK_SIZE_MAX                 0x400000
+
+typedef enum _RAW_DUMP_CHUNK_ENCODING
+{
+    RAW_DUMP_CHUNK_ENCODING_STORED  = 0x0,      // Data as is
+    RAW_DUMP_CHUNK_ENCODING_ZERO    = 0x1,      // All zero, nothing stored
+    RAW_DUMP_CHUNK_ENCODING_XPRESS  = 0x2,      // RtlCompressBuffer(COMPRESSION_FORMAT_XPRESS)
+    RAW_DUMP_CHUNK_ENCODING_MAX
+} RAW_DUMP_CHUNK_ENCODING;
+
+#pragma pack(1)
+typedef struct
+{
+    UINT64  Signature;
+    UINT32  Version;
+    UINT32  ChunkSize;
+    UINT32  ChunkCount;
+    UINT64  DataSize;           // Bytes of chunk data following the entries
+    UINT32  EntriesCrc;         // CRC32 of the RAW_DUMP_CHUNK_ENTRY array
+} RAW_DUMP_CHUNK_INDEX_HEADER, *PRAW_DUMP_CHUNK_INDEX_HEADER;
+
+typedef struct
+{
+    UINT64  Offset;             // From the start of the chunk data
+    UINT32  StoredSize;
+    UINT16  Encoding;           // RAW_DUMP_CHUNK_ENCODING
+    UINT16  Reserved;
+    UINT32  Crc;                // CRC32 of the decoded chunk
+} RAW_DUMP_CHUNK_ENTRY, *PRAW_DUMP_CHUNK_ENTRY;
+#pragma pack()
+
+#define RAW_DUMP_CHUNK_INDEX_SIZE(count)        (sizeof(RAW_DUMP_CHUNK_INDEX_HEADER) + ((UINT64)(count) * sizeof(RAW_DUMP_CHUNK_ENTRY)))
+#define RAW_DUMP_CHUNK_COUNT(size, chunkSize)   ((UINT32)(((size) + (chunkSize) - 1) / (chunkSize)))
+
+/******************************************************************************
+** Reader state for one chunked section. The last decoded chunk is cached so
+** that sequential small reads decode each chunk once.
+*******************************************************************************/
+typedef struct _CHUNKED_SECTION
+{
+    DEVICE_IO                       *hFile;
+    UINT64                          FileOffset;     // Position of the chunk index
+    UINT64                          DataOffset;     // Position of the chunk data
+    UINT64                          Size;           // Decoded size of the section
+    RAW_DUMP_CHUNK_INDEX_HEADER     Header;
+    PRAW_DUMP_CHUNK_ENTRY           Entries;
+    PUCHAR                          Stored;         // ChunkSize bytes, encoded chunk
+    PUCHAR                          Cache;          // ChunkSize bytes, decoded chunk
+    UINT32                          CachedChunk;
+} CHUNKED_SECTION, *PCHUNKED_SECTION;
+
+#define CHUNKED_SECTION_NO_CHUNK                ((UINT32)(-1))
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+UINT32
+ComputeCrc32(
+    _In_reads_bytes_(Length) const VOID *Buffer,
+    _In_    size_t Length,
+    _In_    UINT32 Crc
+);
+
+HRESULT
+GetChunkWorkspaceSize(
+    _Out_   UINT32 *WorkspaceSize
+);
+
+HRESULT
+EncodeChunk(
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_    UINT32 Length,
+    _Out_writes_bytes_to_(Length, Entry->StoredSize) PUCHAR Output,
+    _In_    PVOID Workspace,
+    _Out_   PRAW_DUMP_CHUNK_ENTRY Entry
+);
+
+HRESULT
+DecodeChunk(
+    _In_    const RAW_DUMP_CHUNK_ENTRY *Entry,
+    _In_reads_bytes_(Entry->StoredSize) const UCHAR *Stored,
+    _Out_writes_bytes_(Length) PUCHAR Output,
+    _In_    UINT32 Length
+);
+
+HRESULT
+ValidateChunkIndex(
+    _In_    const RAW_DUMP_CHUNK_INDEX_HEADER *Header,
+    _In_reads_opt_(Header->ChunkCount) const RAW_DUMP_CHUNK_ENTRY *Entries,
+    _In_    UINT64 SectionSize
+);
+
+HRESULT
+OpenChunkedSection(
+    _In_    DEVICE_IO *hFile,
+    _In_    UINT64 FileOffset,
+    _In_    UINT64 SectionSize,
+    _Out_   PCHUNKED_SECTION *Section
+);
+
+HRESULT
+ReadChunkedSection(
+    _Inout_ PCHUNKED_SECTION Section,
+    _In_    UINT64 Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_    size_t Length,
+    _Out_opt_ size_t *BytesRead
+);
+
+VOID
+CloseChunkedSection(
+    _In_opt_ PCHUNKED_SECTION Section
+);
@@ -18,6 +18,7 @@ Author:
 #pragma once
 
 #include "GUIDDefs.h"
+#include "Extent_Set.h"
 
 using namespace std;
 
@@ -33,6 +34,24 @@ using namespace std;
 #define  MAX_DEV_ID_VALUE                       1000        // number of disks should be less than 1000
 #define  DEFAULT_BLOCK_SIZE                     0x1000      // Taking the current UFS block size as the default
 #define  DEFAULT_CACHE_BLOCK_COUNT              0x2000      // Default number of blocks in the cache
+#define  DIRECT_IO_BUFFER_SIZE                  0x100000    // Aligned bounce buffer for unbuffered file I/O
+#define  OVERLAY_DELTA_SIGNATURE                0x41544C44  // 'DLTA'
+#define  OVERLAY_DELTA_VERSION                  1
+
+/*************************************************************************************************
+** Delta file of an overlay device (see DEVICE_IO::OpenOverlay). The header is followed by one
+** record per patched block of the base file: the UINT64 offset of the block in the base file,
+** then BlockSize bytes of data. Records are appended the first time a block is written and
+** rewritten in place after that, so the delta holds each patched block once.
+**************************************************************************************************/
+typedef struct _OVERLAY_DELTA_HEADER
+{
+    UINT32      Signature;
+    UINT32      Version;
+    UINT32      BlockSize;
+    UINT32      Reserved;
+    UINT64      BaseSize;
+} OVERLAY_DELTA_HEADER, *POVERLAY_DELTA_HEADER;
 
 class DEVICE_IO
 {
@@ -62,7 +81,8 @@ class DEVICE_IO
             UNSUPPORTED_DEVICE_TYPE   = 0,
             RAW_DEVICE_TYPE,
             REMOVABLE_MEDIA_DEVICE_TYPE,
-            PLAIN_FILE_DEVICE_TYPE
+            PLAIN_FILE_DEVICE_TYPE,
+            OVERLAY_FILE_DEVICE_TYPE
         } IO_DEVICE_TYPE;
 
         // Error codes to be returned by GetError()
@@ -121,6 +141,7 @@ class DEVICE_IO
             IO_ERROR_SET_NAME_ON_OPENED_DEVICE,
             IO_ERROR_SET_ID_ON_OPENED_DEVICE,
             IO_ERROR_ALREADY_OPENED,
+            IO_ERROR_INVALID_OVERLAY_DELTA,
             IO_ERROR_MAX_ERROR_VALUE
         } IO_ERROR;
 
@@ -146,15 +167,19 @@ class DEVICE_IO
         ULONGLONG                       GetCurrentPartitionSize(void) { return ((IsIoReady() && (m_pCurrentPartition != nullptr)) ? (ULONGLONG)(m_pCurrentPartition->PartitionLength.QuadPart) : 0); };
 
         ULONGLONG                       GetCurrentFileSize(void) const { return m_IOSize.QuadPart; };
+        UINT32                          GetOverlayBlockCount(void) const { return m_OverlayBlockCount; };
         HRESULT                         GetPos(_Inout_ ULONGLONG *curPos);
         HRESULT                         GetIoPos(_Inout_ ULONGLONG *curPos);
 
         HRESULT                         SetDeviceName(_In_ wstring strFileName);
         HRESULT                         SetDeviceID(_In_ UINT devID);
+        HRESULT                         SetDirectIo(_In_ BOOL enable);
+        BOOL                            IsDirectIo(void) const { return m_DirectIo; };
 
         HRESULT                         Open(void);
         HRESULT                         Open(_In_ wstring fName);
         HRESULT                         Open(_In_ UINT devID);
+        HRESULT                         OpenOverlay(_In_ wstring baseName, _In_ wstring deltaName);
         HRESULT                         Close(void);
 
         HRESULT                         SetPartition(_In_ UINT ndx);
@@ -168,6 +193,7 @@ class DEVICE_IO
         HRESULT                         Read(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t* bytesRead);
         HRESULT                         ReadAtOffset(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _In_ LARGE_INTEGER offset, _In_ READ_EXACT_OPTIONS readExact);
         HRESULT                         Write(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t* bytesWritten);
+        HRESULT                         Flush(void);
 
     private:
         // Object variables
@@ -194,6 +220,14 @@ class DEVICE_IO
         ULONG                           m_CacheSize;
         PCHAR                           m_pCache;
 
+        BOOL                            m_DirectIo;
+        PCHAR                           m_pBounce;
+
+        HANDLE                          m_DeltaHandle;
+        EXTENT_SET                      m_OverlayMap;
+        UINT32                          m_OverlayBlockCount;
+        PCHAR                           m_pOverlayRecord;
+
         // Copy Constructor -  making this private makes it a compile time error to pass by value
         DEVICE_IO(_In_ const DEVICE_IO &obj);
 
@@ -211,11 +245,20 @@ class DEVICE_IO
         HRESULT                         ReadBlocksFromDevice(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesRead);
         HRESULT                         ReadFromBlockDevice(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesRead);
         HRESULT                         ReadFromFile(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesRead);
+        HRESULT                         ReadFromFileDirect(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesRead);
 
         HRESULT                         WriteCacheAndFlush(_In_reads_bytes_(bufferSize) PCHAR pBuffer, _In_ size_t bufferSize);
         HRESULT                         WriteBlocksToDevice(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesWritten);
         HRESULT                         WriteToBlockDevice(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesWritten);
         HRESULT                         WriteToFile(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_opt_ size_t *bytesWritten);
+        HRESULT                         WriteToFileDirect(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesWritten);
+        HRESULT                         ReadDirectBlock(_In_ ULONGLONG offset, _Out_writes_bytes_(m_BlockSize) PCHAR pBlock);
+
+        HRESULT                         LoadOverlayDelta(void);
+        HRESULT                         MapOverlayBlock(_In_ ULONGLONG blockOffset, _In_ UINT32 record);
+        HRESULT                         ReadFromOverlay(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesRead);
+        HRESULT                         WriteToOverlay(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesWritten);
+        ULONGLONG                       GetOverlayRecordOffset(_In_ UINT32 record) const { return sizeof(OVERLAY_DELTA_HEADER) + ((ULONGLONG)record * (sizeof(UINT64) + m_BlockSize)); }
 
         HRESULT                         OpenPhysicalDisk(void);
         HRESULT                         ReadDiskGeometry(void);
@@ -15,6 +15,7 @@ Author:
 #pragma once
 
 #include "DEVICE_IO.h"
+#include "Struct_View.h"
 
 #pragma warning( push )
 
@@ -23,9 +24,15 @@ Author:
 
 #define DEVICE_SPECIFIC_INFO_STRUCT_OLDEST_SIGNED_VERSION   1
 #define DEVICE_SPECIFIC_INFO_SIGNATURE                      ((UINT64)0x666e497053766544)  // "DevSpInf"
-#define DEVICE_SPECIFIC_INFO_STRUCT_VERSION                 1
+#define DEVICE_SPECIFIC_INFO_STRUCT_VERSION                 2
+#define DEVICE_SPECIFIC_INFO_VERSION_DUMP_HEADER_PA         2     // First version carrying DumpHeaderPA
 #define BUGCHECK_CODE                                       (0x14c)
 
+// The in memory DUMP_HEADER follows the head SENTINEL (wpcrdmpsentinel.h) at
+// IN_MEM_DATA_INFO.DataPA. OffDmpSvc publishes DataPA plus this offset as
+// DumpHeaderPA and raw2dump derives the same hint from DataPA.
+#define IN_MEM_DATA_DUMP_HEADER_OFFSET                      28    // sizeof(SENTINEL)
+
 // The size of the buffer that is appended at the end of the rawdump
 #define DEVICE_SPECIFIC_INFO_BUFFER_LENGTH                  1024
 
@@ -81,31 +88,79 @@ typedef enum
 // // // // // // // // // // // // // // // // // // // // // //
 
 /******************************************************************************
-** Get data from packed vs unpacked data
+** Stored layouts of the three structures below, read in place with
+** STRUCT_VIEW. The offsets are fixed by the data already written to rawdump.bin
+** files and are checked against the structures below.
 *******************************************************************************/
-typedef enum
+struct DEVICE_SPECIFIC_INFO_UNPACKED_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Type,                     ULONG,      0x00);
+    VIEW_LAYOUT_FIELD(DumpHeaderInstanceID,     ULONGLONG,  0x08);
+    VIEW_LAYOUT_FIELD(APRegPA,                  ULONGLONG,  0x10);
+    VIEW_LAYOUT_FIELD(CpuContextAddress,        ULONGLONG,  0x10);
+    VIEW_LAYOUT_FIELD(VA,                       ULONGLONG,  0x18);
+    VIEW_LAYOUT_FIELD(PA,                       ULONGLONG,  0x20);
+    VIEW_LAYOUT_FIELD(Size,                     ULONG,      0x28);
+    VIEW_LAYOUT_FIELD(BugCheckCode,             ULONG,      0x30);
+    VIEW_LAYOUT_FIELD(BugCheckParam1,           ULONG,      0x34);
+    VIEW_LAYOUT_FIELD(BugCheckParam2,           ULONG,      0x38);
+    VIEW_LAYOUT_FIELD(BugCheckParam3,           ULONG,      0x3C);
+    VIEW_LAYOUT_FIELD(BugCheckParam4,           ULONG,      0x40);
+    static const size_t Length = 0x48;
+};
+
+struct DEVICE_SPECIFIC_INFO_PACKED_LAYOUT
 {
-    USE_PACK_UNDEFINED = 0,
-    USE_LATEST,
-    USE_UNSIGNED_PACKED,
-    USE_UNSIGNED_UNPACKED
-} PACK_FLAG;
-
-
-#define DEVICE_SPECIFIC_INFO_SIGNED_DATA(base, var) \
-            (((PDEVICE_SPECIFIC_INFO)&base)->var)
-
-#define DEVICE_SPECIFIC_INFO_BASE_DATA(packFlag, base, var) \
-    ( (USE_LATEST==packFlag) \
-        ? (((PDEVICE_SPECIFIC_INFO)&base)->var) \
-        : ( (USE_UNSIGNED_PACKED==packFlag) \
-            ? ((PDEVICE_SPECIFIC_INFO_UNSIGNED_PACKED)&base)->var \
-            : ( (USE_UNSIGNED_UNPACKED==packFlag) \
-                ? ((PDEVICE_SPECIFIC_INFO_UNSIGNED_UNPACKED)&base)->var \
-                : -1 \
-              ) \
-          ) \
-    )
+    VIEW_LAYOUT_FIELD(Type,                     ULONG,      0x00);
+    VIEW_LAYOUT_FIELD(DumpHeaderInstanceID,     ULONGLONG,  0x04);
+    VIEW_LAYOUT_FIELD(APRegPA,                  ULONGLONG,  0x0C);
+    VIEW_LAYOUT_FIELD(CpuContextAddress,        ULONGLONG,  0x0C);
+    VIEW_LAYOUT_FIELD(VA,                       ULONGLONG,  0x14);
+    VIEW_LAYOUT_FIELD(PA,                       ULONGLONG,  0x1C);
+    VIEW_LAYOUT_FIELD(Size,                     ULONG,      0x24);
+    VIEW_LAYOUT_FIELD(BugCheckCode,             ULONG,      0x28);
+    VIEW_LAYOUT_FIELD(BugCheckParam1,           ULONG,      0x2C);
+    VIEW_LAYOUT_FIELD(BugCheckParam2,           ULONG,      0x30);
+    VIEW_LAYOUT_FIELD(BugCheckParam3,           ULONG,      0x34);
+    VIEW_LAYOUT_FIELD(BugCheckParam4,           ULONG,      0x38);
+    static const size_t Length = 0x3C;
+};
+
+struct DEVICE_SPECIFIC_INFO_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature,                UINT64,     0x00);
+    VIEW_LAYOUT_FIELD(Version,                  UINT,       0x08);
+    VIEW_LAYOUT_FIELD(PayloadSize,              UINT,       0x0C);
+    VIEW_LAYOUT_FIELD(Type,                     ULONG,      0x10);
+    VIEW_LAYOUT_FIELD(DumpHeaderInstanceID,     ULONGLONG,  0x14);
+    VIEW_LAYOUT_FIELD(APRegPA,                  ULONGLONG,  0x1C);
+    VIEW_LAYOUT_FIELD(CpuContextAddress,        ULONGLONG,  0x1C);
+    VIEW_LAYOUT_FIELD(VA,                       ULONGLONG,  0x24);
+    VIEW_LAYOUT_FIELD(PA,                       ULONGLONG,  0x2C);
+    VIEW_LAYOUT_FIELD(Size,                     ULONG,      0x34);
+    VIEW_LAYOUT_FIELD(BugCheckCode,             ULONG,      0x38);
+    VIEW_LAYOUT_FIELD(BugCheckParam1,           ULONG,      0x3C);
+    VIEW_LAYOUT_FIELD(BugCheckParam2,           ULONG,      0x40);
+    VIEW_LAYOUT_FIELD(BugCheckParam3,           ULONG,      0x44);
+    VIEW_LAYOUT_FIELD(BugCheckParam4,           ULONG,      0x48);
+    VIEW_LAYOUT_FIELD(DumpHeaderPA,             ULONGLONG,  0x4C);
+    static const size_t Length = 0x54;
+};
+
+#define DEVICE_SPECIFIC_INFO_BASE_LAYOUT_CHECKS(layout, structure) \
+    VIEW_LAYOUT_CHECK(layout, structure, Type); \
+    VIEW_LAYOUT_CHECK(layout, structure, DumpHeaderInstanceID); \
+    VIEW_LAYOUT_CHECK(layout, structure, APRegPA); \
+    VIEW_LAYOUT_CHECK(layout, structure, CpuContextAddress); \
+    VIEW_LAYOUT_CHECK(layout, structure, VA); \
+    VIEW_LAYOUT_CHECK(layout, structure, PA); \
+    VIEW_LAYOUT_CHECK(layout, structure, Size); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckCode); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckParam1); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckParam2); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckParam3); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckParam4); \
+    VIEW_LAYOUT_CHECK_SIZE(layout, structure)
 
 #define PAYLOAD_SIZE \
         ( sizeof DEVICE_SPECIFIC_INFO \
@@ -147,9 +202,22 @@ typedef struct _DEVICE_SPECIFIC_INFO
     UINT        PayloadSize; // reflects the size below this field (use macro above)
     DEVICE_SPECIFIC_INFO_STRUCT_TEMPLATE;
     // NOTE: additional fields can be added below this point
+
+    // Version 2: physical address of the in-memory DUMP_HEADER (just past the
+    // head sentinel), or zero if unknown. This is a hint only; the reader must
+    // still validate the header found there.
+    ULONGLONG   DumpHeaderPA;
 } DEVICE_SPECIFIC_INFO, *PDEVICE_SPECIFIC_INFO;
 #pragma pack()
 
+DEVICE_SPECIFIC_INFO_BASE_LAYOUT_CHECKS(DEVICE_SPECIFIC_INFO_UNPACKED_LAYOUT, DEVICE_SPECIFIC_INFO_UNSIGNED_UNPACKED);
+DEVICE_SPECIFIC_INFO_BASE_LAYOUT_CHECKS(DEVICE_SPECIFIC_INFO_PACKED_LAYOUT, DEVICE_SPECIFIC_INFO_UNSIGNED_PACKED);
+DEVICE_SPECIFIC_INFO_BASE_LAYOUT_CHECKS(DEVICE_SPECIFIC_INFO_LAYOUT, DEVICE_SPECIFIC_INFO);
+VIEW_LAYOUT_CHECK(DEVICE_SPECIFIC_INFO_LAYOUT, DEVICE_SPECIFIC_INFO, Signature);
+VIEW_LAYOUT_CHECK(DEVICE_SPECIFIC_INFO_LAYOUT, DEVICE_SPECIFIC_INFO, Version);
+VIEW_LAYOUT_CHECK(DEVICE_SPECIFIC_INFO_LAYOUT, DEVICE_SPECIFIC_INFO, PayloadSize);
+VIEW_LAYOUT_CHECK(DEVICE_SPECIFIC_INFO_LAYOUT, DEVICE_SPECIFIC_INFO, DumpHeaderPA);
+
 // Restore all warnings
 #pragma warning( pop )
 
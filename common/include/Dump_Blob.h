@@ -0,0 +1,84 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Dump_Blob.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "Batch_Read.h"
+
+/******************************************************************************
+** Windows dump file view
+**
+**   A full dump written by raw2dump (or the kernel) is laid out as:
+**
+**      DUMP_HEADER32 / DUMP_HEADER64
+**      the pages of PhysicalMemoryBlock, run after run
+**      DUMP_BLOB_FILE_HEADER
+**      DUMP_BLOB_HEADER, PrePad, data, PostPad     (repeated)
+**
+**   OpenDumpFileView maps the file read only, reads the header in place and
+**   indexes the secondary data blobs by their Tag. Blob data and physical
+**   memory are handed out as slices of the mapping, nothing is copied and no
+**   debugger engine is involved. The slices stay valid until the view is
+**   closed.
+*******************************************************************************/
+#define DUMP_FILE_BLOB_SIGNATURE1           0x706D7544      // "Dump"
+#define DUMP_FILE_BLOB_SIGNATURE2           0x626F6C42      // "Blob"
+
+typedef struct _DUMP_BLOB
+{
+    GUID            Tag;
+    const UCHAR     *Data;              // DataSize bytes, in the mapping
+    UINT32          DataSize;
+    UINT64          FileOffset;         // Position of Data in the file
+} DUMP_BLOB, *PDUMP_BLOB;
+
+typedef struct _DUMP_FILE_VIEW
+{
+    HANDLE              File;
+    HANDLE              Mapping;
+    const UCHAR         *Base;
+    UINT64              Size;
+    BOOL                Is64Bit;
+    UINT32              HeaderSize;
+    PPHYSICAL_EXTENT    Runs;           // FileOffset is the position in the file
+    UINT32              RunCount;
+    UINT64              SecondaryDataOffset;
+    PDUMP_BLOB          Blobs;          // Sorted by Tag, then by FileOffset
+    UINT32              BlobCount;
+} DUMP_FILE_VIEW, *PDUMP_FILE_VIEW;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+HRESULT
+OpenDumpFileView(
+    _In_    LPCWSTR Path,
+    _Out_   PDUMP_FILE_VIEW *View
+);
+
+VOID
+CloseDumpFileView(
+    _In_opt_ PDUMP_FILE_VIEW View
+);
+
+const DUMP_BLOB *
+FindDumpBlob(
+    _In_    const DUMP_FILE_VIEW *View,
+    _In_    REFGUID Tag
+);
+
+HRESULT
+GetDumpPhysicalSlice(
+    _In_    const DUMP_FILE_VIEW *View,
+    _In_    UINT64 PhysicalAddress,
+    _In_    UINT64 Length,
+    _Outptr_result_bytebuffer_(Length) const UCHAR **Data
+);
@@ -18,6 +18,7 @@ Author:
 #include <stdio.h>
 
 #include "RawDumpDefs.h"
+#include "Chunked_Section.h"
 
 /**************************************************************************************************
 ** macros, constants and enums
@@ -62,6 +63,9 @@ typedef struct _SECTION_TABLE_STATS
     UINT64                      TotalSVSpecificSizeInBytes;
     UINT64                      LargestSVSpecificSectionSize;
 
+    // v2 section(s) data
+    UINT32                      ChunkedSectionCount;
+
     // Count of invalids
     UINT32                      InvalidVersionCount;
     UINT32                      InvalidFlagsCount;
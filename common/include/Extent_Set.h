@@ -0,0 +1,123 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Extent_Set.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+/******************************************************************************
+** An inclusive physical address range [Base, End]. Tag is caller data that is
+** carried along, e.g. the index of the DDR section or memory run the extent
+** came from. Results of the set operations keep the Tag of the left operand.
+*******************************************************************************/
+typedef struct _EXTENT
+{
+    UINT64      Base;
+    UINT64      End;
+    UINT32      Tag;
+} EXTENT, *PEXTENT;
+
+/******************************************************************************
+** A growable array of extents, allocated from the process heap.
+** Initialize with ExtentSetInit and release with ExtentSetFree.
+**
+** The binary operations work on "normalized" sets: sorted by Base with no two
+** extents overlapping (they may touch). ExtentSetSort plus ExtentSetCheck or
+** ExtentSetCoalesce produce one. All of them are a single linear sweep over
+** both inputs and size their output as they go.
+*******************************************************************************/
+typedef struct _EXTENT_SET
+{
+    PEXTENT     Extents;
+    UINT32      Count;
+    UINT32      Capacity;
+} EXTENT_SET, *PEXTENT_SET;
+
+#define EXTENT_SIZE(ext)        ((ext).End - (ext).Base + 1)
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+VOID
+ExtentSetInit(
+    _Out_   PEXTENT_SET Set
+);
+
+VOID
+ExtentSetFree(
+    _Inout_ PEXTENT_SET Set
+);
+
+HRESULT
+ExtentSetAppend(
+    _Inout_ PEXTENT_SET Set,
+    _In_    UINT64 Base,
+    _In_    UINT64 Size,
+    _In_    UINT32 Tag
+);
+
+HRESULT
+ExtentSetInsert(
+    _Inout_ PEXTENT_SET Set,
+    _In_    UINT32 Index,
+    _In_    UINT64 Base,
+    _In_    UINT64 Size,
+    _In_    UINT32 Tag
+);
+
+UINT32
+ExtentSetFind(
+    _In_    const EXTENT_SET *Set,
+    _In_    UINT64 Address
+);
+
+VOID
+ExtentSetSort(
+    _Inout_ PEXTENT_SET Set
+);
+
+VOID
+ExtentSetCheck(
+    _In_    const EXTENT_SET *Set,
+    _Out_opt_ PUINT32 HoleCount,
+    _Out_opt_ PUINT32 OverlapCount
+);
+
+HRESULT
+ExtentSetCoalesce(
+    _In_    const EXTENT_SET *Set,
+    _Out_   PEXTENT_SET Result
+);
+
+HRESULT
+ExtentSetUnion(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+);
+
+HRESULT
+ExtentSetIntersect(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+);
+
+HRESULT
+ExtentSetDifference(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+);
+
+UINT32
+ExtentSetContains(
+    _In_    const EXTENT_SET *Outer,
+    _In_    const EXTENT_SET *Inner
+);
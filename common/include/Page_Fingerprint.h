@@ -0,0 +1,131 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Page_Fingerprint.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "Extent_Set.h"
+
+/******************************************************************************
+** Page fingerprint of a dump
+**
+**   A fingerprint holds a 64 bit hash of every 4 KB page of memory captured in
+**   a dump, so that two dumps can be compared without reading either of them:
+**
+**      PAGE_FINGERPRINT_HEADER
+**      PAGE_FINGERPRINT_RUN[RunCount]      sorted by BasePage, not overlapping
+**      UINT64 Sketch[SketchCount]          ascending
+**      UINT64 Hash[PageCount]              a run's pages from its HashIndex on
+**
+**   The sketch is a bottom-k MinHash: the SketchCount smallest distinct page
+**   hashes, all-zero pages left out. Comparing the sketches of two dumps
+**   estimates the share of distinct pages they have in common; comparing the
+**   hashes page by page gives the physical ranges that differ.
+*******************************************************************************/
+#define PAGE_FINGERPRINT_SIGNATURE          (UINT64)(0x746E697250656750)  // "PgePrint"
+#define PAGE_FINGERPRINT_VERSION            0x00001000
+#define PAGE_FINGERPRINT_PAGE_SIZE          0x1000
+#define PAGE_FINGERPRINT_PAGE_SHIFT         12
+#define PAGE_FINGERPRINT_SKETCH_SIZE        256
+#define PAGE_FINGERPRINT_FILE_EXTENSION     L".pfp"
+
+typedef enum _PAGE_FINGERPRINT_REGION
+{
+    PAGE_FINGERPRINT_REGION_OS      = 0x1,      // Pages of the PhysicalMemoryBlock
+    PAGE_FINGERPRINT_REGION_NONOS   = 0x2,      // DDR carved out from the OS
+} PAGE_FINGERPRINT_REGION;
+
+#pragma pack(1)
+typedef struct
+{
+    UINT64  Signature;
+    UINT32  Version;
+    UINT32  HeaderSize;
+    UINT32  RunCount;
+    UINT32  SketchCount;
+    UINT64  PageCount;
+    UINT32  HeaderCrc;          // CRC32 of the header with HeaderCrc zero
+    UINT32  Reserved;
+} PAGE_FINGERPRINT_HEADER, *PPAGE_FINGERPRINT_HEADER;
+
+typedef struct
+{
+    UINT64  BasePage;
+    UINT64  PageCount;
+    UINT64  HashIndex;          // Index of the hash of BasePage
+    UINT32  Region;             // PAGE_FINGERPRINT_REGION
+    UINT32  Reserved;
+} PAGE_FINGERPRINT_RUN, *PPAGE_FINGERPRINT_RUN;
+#pragma pack()
+
+/******************************************************************************
+** A fingerprint, either being built page by page while a dump is converted or
+** read back from a file. All arrays are allocated from the process heap;
+** release with PageFingerprintFree. A zero initialized structure is an empty
+** fingerprint.
+*******************************************************************************/
+typedef struct _PAGE_FINGERPRINT
+{
+    PPAGE_FINGERPRINT_RUN   Runs;
+    UINT32                  RunCount;
+    UINT32                  RunCapacity;
+    PUINT64                 Hashes;
+    UINT64                  PageCount;
+    UINT64                  HashCapacity;
+    PUINT64                 Sketch;
+    UINT32                  SketchCount;
+} PAGE_FINGERPRINT, *PPAGE_FINGERPRINT;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+UINT64
+HashPage(
+    _In_reads_bytes_(PAGE_FINGERPRINT_PAGE_SIZE) const VOID *Page
+);
+
+VOID
+PageFingerprintFree(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint
+);
+
+HRESULT
+PageFingerprintAddPages(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint,
+    _In_    UINT64 PhysicalAddress,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_    UINT64 Length,
+    _In_    PAGE_FINGERPRINT_REGION Region
+);
+
+HRESULT
+PageFingerprintWrite(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint,
+    _In_    LPCWSTR Path
+);
+
+HRESULT
+PageFingerprintRead(
+    _In_    LPCWSTR Path,
+    _Out_   PPAGE_FINGERPRINT Fingerprint
+);
+
+UINT32
+PageFingerprintSimilarity(
+    _In_    const PAGE_FINGERPRINT *First,
+    _In_    const PAGE_FINGERPRINT *Second
+);
+
+HRESULT
+PageFingerprintDiff(
+    _In_    const PAGE_FINGERPRINT *First,
+    _In_    const PAGE_FINGERPRINT *Second,
+    _Out_   PEXTENT_SET Differences
+);
@@ -0,0 +1,155 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    Struct_View.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include <windows.h>
+#include <stddef.h>
+
+/******************************************************************************
+** Typed views over on-disk/in-memory structures
+**
+**   A layout lists the fields of a structure as it is stored, each with its
+**   type and byte offset, and the stored Length:
+**
+**      struct FOO_LAYOUT
+**      {
+**          VIEW_LAYOUT_FIELD(Signature,  UINT64,  0x00);
+**          VIEW_LAYOUT_FIELD(Version,    UINT32,  0x08);
+**          static const size_t Length = 0x0C;
+**      };
+**
+**   A STRUCT_VIEW<FOO_LAYOUT> reads those fields in place from a byte buffer
+**   with explicit little-endian loads, so the buffer needs no alignment and
+**   is never copied into a struct. Offsets are compile time constants, code
+**   that handles several layouts picks the layout once, when the view is
+**   created, and is instantiated per layout (see ReadDeviceSpecificInfo).
+**
+**   VIEW_LAYOUT_CHECK static_asserts that a C structure matches the layout,
+**   which catches packing differences between compilers and targets.
+**
+**   VIEW_SET stores a field the same way, for code that builds a stored
+**   structure in a byte buffer (see makeRawDump /Synthetic).
+*******************************************************************************/
+template <typename T, size_t FieldOffset>
+struct VIEW_FIELD
+{
+    typedef T   Type;
+    static const size_t Offset = FieldOffset;
+    static const size_t End = FieldOffset + sizeof(T);
+};
+
+#define VIEW_LAYOUT_FIELD(name, type, offset)       typedef VIEW_FIELD<type, (offset)> name
+
+#define VIEW_LAYOUT_CHECK(layout, structure, field) \
+    static_assert((layout::field::Offset == offsetof(structure, field)) && \
+                  (sizeof(layout::field::Type) == sizeof(((structure *)0)->field)), \
+                  #structure "." #field " does not match " #layout)
+
+//
+// For fields read narrower than they are declared, e.g. the first ULONGLONG of
+// an array or the LowPart of a LARGE_INTEGER.
+//
+#define VIEW_LAYOUT_CHECK_OFFSET(layout, structure, field) \
+    static_assert((layout::field::Offset == offsetof(structure, field)) && \
+                  (sizeof(layout::field::Type) <= sizeof(((structure *)0)->field)), \
+                  #structure "." #field " does not match " #layout)
+
+#define VIEW_LAYOUT_CHECK_SIZE(layout, structure) \
+    static_assert(layout::Length == sizeof(structure), "sizeof(" #structure ") does not match " #layout)
+
+//
+// Reads a field of a view, usable in templates taking the layout as parameter.
+//
+#define VIEW_GET(view, layout, field)               ((view).template Get<typename layout::field>())
+
+//
+// Writes a field of a layout into a buffer of at least layout::Length bytes.
+//
+#define VIEW_SET(data, layout, field, value) \
+    StoreLittleEndian<layout::field::Type>((PUCHAR)(data) + layout::field::Offset, (layout::field::Type)(value))
+
+
+template <typename T>
+inline T
+LoadLittleEndian(
+    _In_reads_bytes_(sizeof(T)) const UCHAR *Data
+)
+{
+    static_assert((sizeof(T) <= sizeof(UINT64)) && ((T)(-1) > (T)0),
+                  "LoadLittleEndian only loads unsigned integers");
+
+    UINT64  value = 0;
+
+    for (size_t index = sizeof(T); index > 0; index--)
+    {
+        value = (value << 8) | Data[index - 1];
+    }
+
+    return (T)value;
+}
+
+
+template <typename T>
+inline VOID
+StoreLittleEndian(
+    _Out_writes_bytes_(sizeof(T)) UCHAR *Data,
+    _In_ T Value
+)
+{
+    static_assert((sizeof(T) <= sizeof(UINT64)) && ((T)(-1) > (T)0),
+                  "StoreLittleEndian only stores unsigned integers");
+
+    UINT64  value = Value;
+
+    for (size_t index = 0; index < sizeof(T); index++)
+    {
+        Data[index] = (UCHAR)value;
+        value >>= 8;
+    }
+}
+
+
+template <class Layout>
+class STRUCT_VIEW
+{
+    public:
+        STRUCT_VIEW(_In_reads_bytes_opt_(Length) const VOID *Data, _In_ size_t Length) :
+            m_Data((const UCHAR *)Data),
+            m_Length(Length)
+        {
+        }
+
+        //
+        // The buffer holds the whole layout. Check once before calling Get.
+        //
+        BOOL IsValid(void) const
+        {
+            return (nullptr != m_Data) && (Layout::Length <= m_Length);
+        }
+
+        template <class Field>
+        typename Field::Type Get(void) const
+        {
+            static_assert(Field::End <= Layout::Length, "Field is outside of the layout");
+            return LoadLittleEndian<typename Field::Type>(m_Data + Field::Offset);
+        }
+
+        const UCHAR *GetData(void) const
+        {
+            return m_Data;
+        }
+
+    private:
+        const UCHAR     *m_Data;
+        size_t          m_Length;
+};
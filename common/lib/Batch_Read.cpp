@@ -0,0 +1,306 @@
+/*++
+
+    Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+   Batch_Read.cpp
+
+Environment:
+   User Mode
+
+--*/
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "Batch_Read.h"
+
+/****************************************************************************************
+**  static helpers
+*****************************************************************************************/
+static int __cdecl
+CompareRequestByAddress(
+    _In_    const void *First,
+    _In_    const void *Second
+)
+{
+    UINT64 firstPA = (*(const PBATCH_READ_REQUEST *)First)->PhysicalAddress;
+    UINT64 secondPA = (*(const PBATCH_READ_REQUEST *)Second)->PhysicalAddress;
+
+    return (firstPA < secondPA) ? -1 : ((firstPA > secondPA) ? 1 : 0);
+}
+
+
+static const PHYSICAL_EXTENT *
+FindExtent(
+    _In_reads_(ExtentCount) const PHYSICAL_EXTENT *Extents,
+    _In_    UINT32 ExtentCount,
+    _In_    UINT64 Address
+)
+{
+    for (UINT32 index = 0; index < ExtentCount; index++)
+    {
+        if ((Extents[index].Base <= Address) && ((Address - Extents[index].Base) < Extents[index].Size))
+        {
+            return &Extents[index];
+        }
+    }
+
+    return nullptr;
+}
+
+
+//
+// SetPos + Read on hFile. The pair is only atomic if every other user of hFile
+// holds the same Lock around its own SetPos + Read/Write.
+//
+static HRESULT
+ReadAtFileOffset(
+    _In_    DEVICE_IO *hFile,
+    _In_opt_ PCRITICAL_SECTION Lock,
+    _In_    ULONGLONG Offset,
+    _Out_writes_bytes_(Length) PCHAR Buffer,
+    _In_    size_t Length
+)
+{
+    HRESULT hr = S_OK;
+    size_t  bytesProcessed = 0;
+
+    if (nullptr != Lock)
+    {
+        EnterCriticalSection(Lock);
+    }
+
+    if (FAILED(hr = hFile->SetPos(Offset)) ||
+        FAILED(hr = hFile->Read(Buffer, Length, &bytesProcessed)))
+    { // Keep the device error
+    }
+    else if (Length != bytesProcessed)
+    { // Short read
+        hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    if (nullptr != Lock)
+    {
+        LeaveCriticalSection(Lock);
+    }
+
+    return hr;
+}
+
+
+//
+// Reads a range that may cross extent boundaries, one piece per extent.
+//
+static HRESULT
+ReadAcrossExtents(
+    _In_    DEVICE_IO *hFile,
+    _In_opt_ PCRITICAL_SECTION Lock,
+    _In_reads_(ExtentCount) const PHYSICAL_EXTENT *Extents,
+    _In_    UINT32 ExtentCount,
+    _In_    UINT64 Address,
+    _In_    UINT64 Length,
+    _Out_writes_bytes_(Length) PCHAR Buffer
+)
+{
+    HRESULT                 hr = S_OK;
+    const PHYSICAL_EXTENT   *extent = nullptr;
+    UINT64                  bytesToRead = 0;
+
+    while ((0 != Length) && SUCCEEDED(hr))
+    {
+        if (nullptr == (extent = FindExtent(Extents, ExtentCount, Address)))
+        { // Address is not backed by any extent
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS);
+        }
+        else
+        {
+            bytesToRead = extent->Base + extent->Size - Address;
+            bytesToRead = (bytesToRead < Length) ? bytesToRead : Length;
+
+            if (SUCCEEDED(hr = ReadAtFileOffset(hFile, Lock, extent->FileOffset + (Address - extent->Base), Buffer, (size_t)bytesToRead)))
+            {
+                Address += bytesToRead;
+                Buffer += bytesToRead;
+                Length -= bytesToRead;
+            }
+        }
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  HRESULT ReadPhysicalBatch(
+**              _In_    DEVICE_IO *hFile,
+**              _In_opt_ PCRITICAL_SECTION Lock,
+**              _In_reads_(ExtentCount) const PHYSICAL_EXTENT *Extents,
+**              _In_    UINT32 ExtentCount,
+**              _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+**              _In_    UINT32 RequestCount
+**          )
+**
+**  This function satisfies a list of (PA, length, destination) requests with as
+**  few device reads as possible. SV specific analysers tend to read many small
+**  fields (signatures, bugcheck data, per CPU status) that sit next to each other
+**  in DDR, and every ReadFromDDRSectionByPhysicalAddress call costs a seek and a
+**  read on the partition.
+**
+**  The requests are sorted by physical address and neighbours in the same extent
+**  that are at most BATCH_READ_MAX_GAP bytes apart are merged into a single read
+**  of up to BATCH_READ_MAX_SPAN bytes. The data is then copied to each request's
+**  buffer. Requests that cross extents or are larger than the span limit are
+**  read on their own.
+**
+**  Requests may overlap and may be given in any order. The Result of every
+**  request is updated.
+**
+**  Every device read is a SetPos + Read pair on hFile. When hFile is shared with
+**  other threads, pass the lock those threads hold around their own SetPos +
+**  Read/Write as Lock; it is held for each device read. Without a Lock the
+**  function is not thread-safe with respect to hFile.
+**
+**  Return Value:
+**      S_OK if all requests were read, otherwise the first failing request's
+**      HRESULT (in caller order).
+**
+*****************************************************************************************/
+HRESULT
+ReadPhysicalBatch(
+    _In_    DEVICE_IO *hFile,
+    _In_opt_ PCRITICAL_SECTION Lock,
+    _In_reads_(ExtentCount) const PHYSICAL_EXTENT *Extents,
+    _In_    UINT32 ExtentCount,
+    _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+    _In_    UINT32 RequestCount
+)
+{
+    HRESULT                 hr = S_OK;
+    PBATCH_READ_REQUEST     *sorted = nullptr;
+    PCHAR                   scratch = nullptr;
+    const PHYSICAL_EXTENT   *extent = nullptr;
+    UINT64                  extentEnd = 0;
+    UINT64                  runStart = 0;
+    UINT64                  runEnd = 0;
+    UINT64                  requestEnd = 0;
+    UINT32                  first = 0;
+    UINT32                  last = 0;
+
+    if ((nullptr == hFile) || (nullptr == Requests) || ((nullptr == Extents) && (0 != ExtentCount)))
+    {
+        hr = E_INVALIDARG;
+        goto Exit;
+    }
+
+    if (0 == RequestCount)
+    {
+        goto Exit;
+    }
+
+    sorted = (PBATCH_READ_REQUEST *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, RequestCount * sizeof(PBATCH_READ_REQUEST));
+    scratch = (PCHAR)HeapAlloc(GetProcessHeap(), 0, BATCH_READ_MAX_SPAN);
+
+    if ((nullptr == sorted) || (nullptr == scratch))
+    {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < RequestCount; index++)
+    {
+        Requests[index].Result = E_PENDING;
+        sorted[index] = &Requests[index];
+    }
+
+    qsort(sorted, RequestCount, sizeof(PBATCH_READ_REQUEST), CompareRequestByAddress);
+
+    first = 0;
+    while (first < RequestCount)
+    {
+        PBATCH_READ_REQUEST request = sorted[first];
+
+        if (0 == request->Length)
+        { // Nothing to read
+            request->Result = S_OK;
+            first++;
+            continue;
+        }
+
+        extent = FindExtent(Extents, ExtentCount, request->PhysicalAddress);
+        extentEnd = (nullptr != extent) ? (extent->Base + extent->Size) : 0;
+        runStart = request->PhysicalAddress;
+        runEnd = runStart + request->Length;
+
+        if ((nullptr == extent) || (runEnd > extentEnd) || (request->Length > BATCH_READ_MAX_SPAN))
+        { // Crosses extents, is not backed by one, or is too large to stage
+            request->Result = ReadAcrossExtents(hFile, Lock, Extents, ExtentCount, runStart, request->Length, (PCHAR)request->Buffer);
+            first++;
+            continue;
+        }
+
+        //
+        // Grow the run while the next request is close, in the same extent and within the span limit.
+        //
+        for (last = first + 1; last < RequestCount; last++)
+        {
+            requestEnd = sorted[last]->PhysicalAddress + sorted[last]->Length;
+
+            if ((sorted[last]->PhysicalAddress > (runEnd + BATCH_READ_MAX_GAP)) ||
+                (requestEnd > extentEnd) ||
+                ((((requestEnd > runEnd) ? requestEnd : runEnd) - runStart) > BATCH_READ_MAX_SPAN))
+            {
+                break;
+            }
+
+            runEnd = (requestEnd > runEnd) ? requestEnd : runEnd;
+        }
+
+        if ((last - first) == 1)
+        { // Nothing to merge with, read straight into the caller's buffer
+            request->Result = ReadAtFileOffset(hFile, Lock, extent->FileOffset + (runStart - extent->Base), (PCHAR)request->Buffer, request->Length);
+        }
+        else
+        {
+            hr = ReadAtFileOffset(hFile, Lock, extent->FileOffset + (runStart - extent->Base), scratch, (size_t)(runEnd - runStart));
+
+            for (UINT32 index = first; index < last; index++)
+            {
+                if (SUCCEEDED(hr))
+                {
+                    memcpy(sorted[index]->Buffer, scratch + (sorted[index]->PhysicalAddress - runStart), sorted[index]->Length);
+                }
+
+                sorted[index]->Result = hr;
+            }
+        }
+
+        first = last;
+    }
+
+    //
+    // Report the first failure in the caller's order.
+    //
+    hr = S_OK;
+    for (UINT32 index = 0; index < RequestCount; index++)
+    {
+        if (FAILED(Requests[index].Result))
+        {
+            hr = Requests[index].Result;
+            break;
+        }
+    }
+
+Exit:
+    if (nullptr != sorted)
+    {
+        HeapFree(GetProcessHeap(), 0, sorted);
+    }
+
+    if (nullptr != scratch)
+    {
+        HeapFree(GetProcessHeap(), 0, scratch);
+    }
+
+    return hr;
+}
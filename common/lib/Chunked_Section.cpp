@@ -0,0 +1,573 @@
+/*++
+
+    Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+   Chunked_Section.cpp
+
+Environment:
+   User Mode
+
+--*/
+#include <nt.h>
+#include <ntrtl.h>
+#include <nturtl.h>
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "Chunked_Section.h"
+
+#define CHUNK_COMPRESSION_FORMAT            (COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD)
+#define CHUNK_COMPRESSION_UNIT              0x1000
+
+static UINT32       crc32Table[256];
+static INIT_ONCE    crc32TableOnce = INIT_ONCE_STATIC_INIT;
+
+/**************************************************************************************************
+** static helpers
+**************************************************************************************************/
+static BOOL CALLBACK
+BuildCrc32Table(
+    _Inout_ PINIT_ONCE InitOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Outptr_opt_result_maybenull_ PVOID *Context
+)
+{
+    UNREFERENCED_PARAMETER(InitOnce);
+    UNREFERENCED_PARAMETER(Parameter);
+    UNREFERENCED_PARAMETER(Context);
+
+    for (UINT32 index = 0; index < ARRAYSIZE(crc32Table); index++)
+    {
+        UINT32 crc = index;
+
+        for (UINT32 bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+        }
+
+        crc32Table[index] = crc;
+    }
+
+    return TRUE;
+}
+
+
+static BOOL
+IsZeroBuffer(
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_    UINT32 Length
+)
+{
+    for (UINT32 index = 0; index < Length; index++)
+    {
+        if (0 != Data[index])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/**************************************************************************************************
+** UINT32 ComputeCrc32(
+**         _In_reads_bytes_(Length) const VOID *Buffer,
+**         _In_    size_t Length,
+**         _In_    UINT32 Crc
+**       )
+**
+** Description:
+**   Standard (IEEE 802.3) CRC32 of Buffer. Pass 0 as Crc to start, or the
+**   previous result to continue over several buffers.
+**************************************************************************************************/
+UINT32
+ComputeCrc32(
+    _In_reads_bytes_(Length) const VOID *Buffer,
+    _In_    size_t Length,
+    _In_    UINT32 Crc
+)
+{
+    const UCHAR *data = (const UCHAR *)Buffer;
+
+    // BuildCrc32Table cannot fail, InitOnceExecuteOnce publishes the table to every thread
+    InitOnceExecuteOnce(&crc32TableOnce, BuildCrc32Table, nullptr, nullptr);
+
+    Crc = ~Crc;
+    for (size_t index = 0; index < Length; index++)
+    {
+        Crc = crc32Table[(Crc ^ data[index]) & 0xFF] ^ (Crc >> 8);
+    }
+
+    return ~Crc;
+}
+
+
+/**************************************************************************************************
+** HRESULT GetChunkWorkspaceSize(_Out_ UINT32 *WorkspaceSize)
+**
+** Description:
+**   Size of the workspace EncodeChunk needs, allocate one per encoding thread.
+**************************************************************************************************/
+HRESULT
+GetChunkWorkspaceSize(
+    _Out_   UINT32 *WorkspaceSize
+)
+{
+    ULONG       compressWorkspace = 0;
+    ULONG       fragmentWorkspace = 0;
+    NTSTATUS    status;
+
+    *WorkspaceSize = 0;
+    status = RtlGetCompressionWorkSpaceSize(CHUNK_COMPRESSION_FORMAT, &compressWorkspace, &fragmentWorkspace);
+    if (NT_SUCCESS(status))
+    {
+        *WorkspaceSize = compressWorkspace;
+    }
+
+    return HRESULT_FROM_NT(status);
+}
+
+
+/**************************************************************************************************
+** HRESULT EncodeChunk(
+**         _In_reads_bytes_(Length) const UCHAR *Data,
+**         _In_    UINT32 Length,
+**         _Out_writes_bytes_to_(Length, Entry->StoredSize) PUCHAR Output,
+**         _In_    PVOID Workspace,
+**         _Out_   PRAW_DUMP_CHUNK_ENTRY Entry
+**       )
+**
+** Description:
+**   Encodes one chunk into Output (Length bytes) and fills in the Encoding,
+**   StoredSize and Crc of Entry, the caller sets Offset. All zero chunks are not
+**   stored, chunks that do not compress are stored as is.
+**************************************************************************************************/
+HRESULT
+EncodeChunk(
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_    UINT32 Length,
+    _Out_writes_bytes_to_(Length, Entry->StoredSize) PUCHAR Output,
+    _In_    PVOID Workspace,
+    _Out_   PRAW_DUMP_CHUNK_ENTRY Entry
+)
+{
+    HRESULT     hr = S_OK;
+    ULONG       compressedSize = 0;
+    NTSTATUS    status;
+
+    if ((nullptr == Data) || (nullptr == Output) || (nullptr == Workspace) || (nullptr == Entry) || (0 == Length))
+    {
+        hr = E_INVALIDARG;
+        goto Exit;
+    }
+
+    ZeroMemory(Entry, sizeof(*Entry));
+    Entry->Crc = ComputeCrc32(Data, Length, 0);
+
+    if (IsZeroBuffer(Data, Length))
+    {
+        Entry->Encoding = RAW_DUMP_CHUNK_ENCODING_ZERO;
+        goto Exit;
+    }
+
+    //
+    // Only keep the compressed form if it saves something.
+    //
+    status = RtlCompressBuffer(CHUNK_COMPRESSION_FORMAT,
+                               (PUCHAR)Data,
+                               Length,
+                               Output,
+                               Length - 1,
+                               CHUNK_COMPRESSION_UNIT,
+                               &compressedSize,
+                               Workspace);
+
+    if (NT_SUCCESS(status) && (0 != compressedSize) && (compressedSize < Length))
+    {
+        Entry->Encoding = RAW_DUMP_CHUNK_ENCODING_XPRESS;
+        Entry->StoredSize = compressedSize;
+    }
+    else
+    { // STATUS_BUFFER_TOO_SMALL, the data does not compress
+        memcpy(Output, Data, Length);
+        Entry->Encoding = RAW_DUMP_CHUNK_ENCODING_STORED;
+        Entry->StoredSize = Length;
+    }
+
+Exit:
+    return hr;
+}
+
+
+/**************************************************************************************************
+** HRESULT DecodeChunk(
+**         _In_    const RAW_DUMP_CHUNK_ENTRY *Entry,
+**         _In_reads_bytes_(Entry->StoredSize) const UCHAR *Stored,
+**         _Out_writes_bytes_(Length) PUCHAR Output,
+**         _In_    UINT32 Length
+**       )
+**
+** Description:
+**   Decodes one chunk of Length bytes and checks it against the CRC of its entry.
+**
+** Return Value:
+**   S_OK, HRESULT_FROM_WIN32(ERROR_CRC) on a CRC mismatch,
+**   HRESULT_FROM_WIN32(ERROR_INVALID_DATA) if the chunk cannot be decoded.
+**************************************************************************************************/
+HRESULT
+DecodeChunk(
+    _In_    const RAW_DUMP_CHUNK_ENTRY *Entry,
+    _In_reads_bytes_(Entry->StoredSize) const UCHAR *Stored,
+    _Out_writes_bytes_(Length) PUCHAR Output,
+    _In_    UINT32 Length
+)
+{
+    HRESULT     hr = S_OK;
+    ULONG       decodedSize = 0;
+
+    if ((nullptr == Entry) || (nullptr == Output) || ((nullptr == Stored) && (0 != Entry->StoredSize)))
+    {
+        hr = E_INVALIDARG;
+        goto Exit;
+    }
+
+    switch (Entry->Encoding)
+    {
+        case RAW_DUMP_CHUNK_ENCODING_ZERO:
+            ZeroMemory(Output, Length);
+            break;
+
+        case RAW_DUMP_CHUNK_ENCODING_STORED:
+            if (Entry->StoredSize != Length)
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                goto Exit;
+            }
+
+            memcpy(Output, Stored, Length);
+            break;
+
+        case RAW_DUMP_CHUNK_ENCODING_XPRESS:
+            if (!NT_SUCCESS(RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS,
+                                                Output,
+                                                Length,
+                                                (PUCHAR)Stored,
+                                                Entry->StoredSize,
+                                                &decodedSize)) ||
+                (decodedSize != Length))
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                goto Exit;
+            }
+            break;
+
+        default:
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            goto Exit;
+    }
+
+    if (ComputeCrc32(Output, Length, 0) != Entry->Crc)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_CRC);
+    }
+
+Exit:
+    return hr;
+}
+
+
+/**************************************************************************************************
+** HRESULT ValidateChunkIndex(
+**         _In_    const RAW_DUMP_CHUNK_INDEX_HEADER *Header,
+**         _In_reads_opt_(Header->ChunkCount) const RAW_DUMP_CHUNK_ENTRY *Entries,
+**         _In_    UINT64 SectionSize
+**       )
+**
+** Description:
+**   Checks a chunk index against the section it belongs to.
+**   The following are checked:
+**       1. Signature and version.
+**       2. Chunk size is within limits and the chunk count covers SectionSize.
+**       3. (with Entries) the CRC of the entries, known encodings, stored sizes
+**          no larger than a chunk and chunks within DataSize.
+**
+**   Pass nullptr as Entries to check the header only.
+**
+** Return Value:
+**   S_OK, E_INVALIDARG or HRESULT_FROM_WIN32(ERROR_INVALID_DATA).
+**************************************************************************************************/
+HRESULT
+ValidateChunkIndex(
+    _In_    const RAW_DUMP_CHUNK_INDEX_HEADER *Header,
+    _In_reads_opt_(Header->ChunkCount) const RAW_DUMP_CHUNK_ENTRY *Entries,
+    _In_    UINT64 SectionSize
+)
+{
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    if (nullptr == Header)
+    {
+        hr = E_INVALIDARG;
+    }
+    else if ((RAW_DUMP_CHUNK_INDEX_SIGNATURE != Header->Signature) ||
+             (RAW_DUMP_CHUNK_INDEX_VERSION != Header->Version))
+    { // Not a chunk index
+    }
+    else if ((Header->ChunkSize < RAW_DUMP_CHUNK_SIZE_MIN) ||
+             (Header->ChunkSize > RAW_DUMP_CHUNK_SIZE_MAX) ||
+             (0 != (Header->ChunkSize % RAW_DUMP_CHUNK_SIZE_MIN)))
+    { // Unsupported chunk size
+    }
+    else if (RAW_DUMP_CHUNK_COUNT(SectionSize, (UINT64)Header->ChunkSize) != Header->ChunkCount)
+    { // Chunks do not cover the section
+    }
+    else if ((nullptr != Entries) &&
+             (ComputeCrc32(Entries, (size_t)Header->ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY), 0) != Header->EntriesCrc))
+    { // Index is corrupted
+    }
+    else
+    {
+        hr = S_OK;
+
+        for (UINT32 index = 0; (nullptr != Entries) && (index < Header->ChunkCount); index++)
+        {
+            if ((Entries[index].Encoding >= RAW_DUMP_CHUNK_ENCODING_MAX) ||
+                (Entries[index].StoredSize > Header->ChunkSize) ||
+                (Entries[index].Offset > Header->DataSize) ||
+                (Entries[index].StoredSize > (Header->DataSize - Entries[index].Offset)))
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                break;
+            }
+        }
+    }
+
+    return hr;
+}
+
+
+/**************************************************************************************************
+** HRESULT OpenChunkedSection(
+**         _In_    DEVICE_IO *hFile,
+**         _In_    UINT64 FileOffset,
+**         _In_    UINT64 SectionSize,
+**         _Out_   PCHUNKED_SECTION *Section
+**       )
+**
+** Description:
+**   Reads and validates the chunk index of a v2 section at FileOffset and
+**   returns a reader for it. Free it with CloseChunkedSection.
+**************************************************************************************************/
+HRESULT
+OpenChunkedSection(
+    _In_    DEVICE_IO *hFile,
+    _In_    UINT64 FileOffset,
+    _In_    UINT64 SectionSize,
+    _Out_   PCHUNKED_SECTION *Section
+)
+{
+    HRESULT             hr = S_OK;
+    PCHUNKED_SECTION    section = nullptr;
+    size_t              bytesRead = 0;
+    size_t              entriesSize = 0;
+
+    if ((nullptr == hFile) || (nullptr == Section))
+    {
+        hr = E_INVALIDARG;
+        goto Exit;
+    }
+
+    *Section = nullptr;
+
+    section = (PCHUNKED_SECTION)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CHUNKED_SECTION));
+    if (nullptr == section)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    section->hFile = hFile;
+    section->FileOffset = FileOffset;
+    section->Size = SectionSize;
+    section->CachedChunk = CHUNKED_SECTION_NO_CHUNK;
+
+    if (FAILED(hr = hFile->SetPos(FileOffset)) ||
+        FAILED(hr = hFile->Read((PCHAR)&section->Header, sizeof(section->Header), &bytesRead)))
+    {
+        goto Exit;
+    }
+
+    if ((sizeof(section->Header) != bytesRead) ||
+        FAILED(hr = ValidateChunkIndex(&section->Header, nullptr, SectionSize)))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        goto Exit;
+    }
+
+    entriesSize = (size_t)section->Header.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY);
+    section->DataOffset = FileOffset + RAW_DUMP_CHUNK_INDEX_SIZE(section->Header.ChunkCount);
+    section->Entries = (PRAW_DUMP_CHUNK_ENTRY)HeapAlloc(GetProcessHeap(), 0, (0 != entriesSize) ? entriesSize : 1);
+    section->Stored = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, section->Header.ChunkSize);
+    section->Cache = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, section->Header.ChunkSize);
+
+    if ((nullptr == section->Entries) || (nullptr == section->Stored) || (nullptr == section->Cache))
+    {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    if (FAILED(hr = hFile->Read((PCHAR)section->Entries, entriesSize, &bytesRead)))
+    {
+        goto Exit;
+    }
+
+    if ((entriesSize != bytesRead) ||
+        FAILED(hr = ValidateChunkIndex(&section->Header, section->Entries, SectionSize)))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        goto Exit;
+    }
+
+    *Section = section;
+    section = nullptr;
+
+Exit:
+    CloseChunkedSection(section);
+    return hr;
+}
+
+
+/**************************************************************************************************
+** HRESULT ReadChunkedSection(
+**         _Inout_ PCHUNKED_SECTION Section,
+**         _In_    UINT64 Offset,
+**         _Out_writes_bytes_(Length) PVOID Buffer,
+**         _In_    size_t Length,
+**         _Out_opt_ size_t *BytesRead
+**       )
+**
+** Description:
+**   Reads Length bytes at Offset (relative to the start of the section) by
+**   decoding the chunks that hold them. Like a file read, a read that runs past
+**   the end of the section is cut short and BytesRead tells how much was read.
+**************************************************************************************************/
+HRESULT
+ReadChunkedSection(
+    _Inout_ PCHUNKED_SECTION Section,
+    _In_    UINT64 Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_    size_t Length,
+    _Out_opt_ size_t *BytesRead
+)
+{
+    HRESULT     hr = S_OK;
+    PUCHAR      output = (PUCHAR)Buffer;
+    size_t      totalRead = 0;
+    size_t      bytesRead = 0;
+    UINT32      chunk = 0;
+    UINT32      chunkOffset = 0;
+    UINT32      chunkLength = 0;
+    size_t      bytesToCopy = 0;
+
+    if ((nullptr == Section) || (nullptr == Buffer))
+    {
+        hr = E_INVALIDARG;
+        goto Exit;
+    }
+
+    if (Offset >= Section->Size)
+    {
+        goto Exit;
+    }
+
+    if (Length > (Section->Size - Offset))
+    {
+        Length = (size_t)(Section->Size - Offset);
+    }
+
+    while (totalRead < Length)
+    {
+        chunk = (UINT32)(Offset / Section->Header.ChunkSize);
+        chunkOffset = (UINT32)(Offset % Section->Header.ChunkSize);
+        chunkLength = (UINT32)min((UINT64)Section->Header.ChunkSize, Section->Size - ((UINT64)chunk * Section->Header.ChunkSize));
+
+        if (chunk != Section->CachedChunk)
+        {
+            const RAW_DUMP_CHUNK_ENTRY *entry = &Section->Entries[chunk];
+
+            Section->CachedChunk = CHUNKED_SECTION_NO_CHUNK;
+
+            if (0 != entry->StoredSize)
+            {
+                if (FAILED(hr = Section->hFile->SetPos(Section->DataOffset + entry->Offset)) ||
+                    FAILED(hr = Section->hFile->Read((PCHAR)Section->Stored, entry->StoredSize, &bytesRead)))
+                {
+                    goto Exit;
+                }
+
+                if (entry->StoredSize != bytesRead)
+                {
+                    hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+                    goto Exit;
+                }
+            }
+
+            if (FAILED(hr = DecodeChunk(entry, Section->Stored, Section->Cache, chunkLength)))
+            {
+                goto Exit;
+            }
+
+            Section->CachedChunk = chunk;
+        }
+
+        bytesToCopy = min((size_t)(chunkLength - chunkOffset), Length - totalRead);
+        memcpy(output + totalRead, Section->Cache + chunkOffset, bytesToCopy);
+
+        totalRead += bytesToCopy;
+        Offset += bytesToCopy;
+    }
+
+Exit:
+    if (nullptr != BytesRead)
+    {
+        *BytesRead = totalRead;
+    }
+
+    return hr;
+}
+
+
+/**************************************************************************************************
+** VOID CloseChunkedSection(_In_opt_ PCHUNKED_SECTION Section)
+**
+** Description:
+**   Frees a reader returned by OpenChunkedSection.
+**************************************************************************************************/
+VOID
+CloseChunkedSection(
+    _In_opt_ PCHUNKED_SECTION Section
+)
+{
+    if (nullptr != Section)
+    {
+        if (nullptr != Section->Entries)
+        {
+            HeapFree(GetProcessHeap(), 0, Section->Entries);
+        }
+
+        if (nullptr != Section->Stored)
+        {
+            HeapFree(GetProcessHeap(), 0, Section->Stored);
+        }
+
+        if (nullptr != Section->Cache)
+        {
+            HeapFree(GetProcessHeap(), 0, Section->Cache);
+        }
+
+        HeapFree(GetProcessHeap(), 0, Section);
+    }
+}
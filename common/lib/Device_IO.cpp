@@ -295,6 +295,14 @@ DEVICE_IO::Init(_In_ wstring devName, _In_ UINT devID)
     m_CacheSize = 0;
     m_pCache = nullptr;
 
+    m_DirectIo = FALSE;
+    m_pBounce = nullptr;
+
+    m_DeltaHandle = INVALID_HANDLE_VALUE;
+    ExtentSetInit(&m_OverlayMap);
+    m_OverlayBlockCount = 0;
+    m_pOverlayRecord = nullptr;
+
     return;
 }
 
@@ -850,6 +858,92 @@ DEVICE_IO::Open(_In_ UINT devID)
 }
 
 
+/**************************************************************************************************
+** HRESULT OpenOverlay(_In_ wstring baseName, _In_ wstring deltaName)
+**    Opens a patched view of a file without copying it. Reads fall through to the base file,
+**    which is opened read-only and never changed. Writes go to the delta file, one record per
+**    patched block (see OVERLAY_DELTA_HEADER), created if it does not exist. The delta of an
+**    earlier session is picked up again, it must have been made for a base of the same size.
+**    The in-memory map (m_OverlayMap) holds runs of patched blocks, each extent tagged with
+**    the record of its first block. The view has the size of the base file.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::OpenOverlay(_In_ wstring baseName, _In_ wstring deltaName)
+{
+    HRESULT ret = E_FAIL;
+
+    if (IsDeviceReady())
+    {
+        m_LastError = IO_ERROR_ALREADY_OPENED;
+    }
+    else if (baseName.empty() || deltaName.empty())
+    {
+        m_LastError = IO_ERROR_INVALID_DEVICE_NAME;
+    }
+    else
+    {
+        m_Name = baseName;
+        m_ID = INVALID_DEVICE_ID;
+        m_Type = OVERLAY_FILE_DEVICE_TYPE;
+        m_IOCurPos = { 0 };
+
+        m_Handle = CreateFileW(
+            baseName.c_str(),
+            FILE_GENERIC_READ,
+            FILE_SHARE_READ,
+            NULL,
+            OPEN_EXISTING,
+            0,
+            NULL);
+
+        if (INVALID_HANDLE_VALUE == m_Handle)
+        {
+            m_LastError = IO_ERROR_INVALID_HANDLE;
+            ret = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else if (FALSE == GetFileSizeEx(m_Handle, (PLARGE_INTEGER)&m_IOSize))
+        {
+            m_LastError = IO_ERROR_INVALID_FILE_SIZE;
+            ret = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else if (INVALID_HANDLE_VALUE == (m_DeltaHandle = CreateFileW(
+                                                              deltaName.c_str(),
+                                                              FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+                                                              FILE_SHARE_READ,
+                                                              NULL,
+                                                              OPEN_ALWAYS,
+                                                              0,
+                                                              NULL)))
+        {
+            m_LastError = IO_ERROR_INVALID_HANDLE;
+            ret = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else if (nullptr == (m_pOverlayRecord = (PCHAR)malloc(sizeof(UINT64) + m_BlockSize)))
+        {
+            m_LastError = IO_ERROR_NO_MEMORY;
+            ret = E_OUTOFMEMORY;
+        }
+        else
+        {
+            SetIOBlockCount();
+            ret = LoadOverlayDelta(); // LoadOverlayDelta() sets m_LastError
+        }
+
+        if (FAILED(ret))
+        { // Close() resets m_LastError, keep the cause
+            IO_ERROR lastError = m_LastError;
+
+            Close();
+            m_Type = UNINITIALIZED_DEVICE_TYPE;
+            m_LastError = lastError;
+        }
+
+    }
+
+    return ret;
+}
+
+
 /**************************************************************************************************
 ** HRESULT  Close(void)
 **    Function for closing a physical device or file.  Closing means to free allocated memory
@@ -876,6 +970,28 @@ DEVICE_IO::Close(void)
         m_pDriveLayout = nullptr;
     }
 
+    if (nullptr != m_pBounce)
+    {
+        VirtualFree(m_pBounce, 0, MEM_RELEASE);
+        m_pBounce = nullptr;
+    }
+
+    if (nullptr != m_pOverlayRecord)
+    {
+        free(m_pOverlayRecord);
+        m_pOverlayRecord = nullptr;
+    }
+
+    ExtentSetFree(&m_OverlayMap);
+    m_OverlayBlockCount = 0;
+
+    if ( (INVALID_HANDLE_VALUE != m_DeltaHandle) &&
+         (FALSE != CloseHandle(m_DeltaHandle))
+       )
+    {
+        m_DeltaHandle = INVALID_HANDLE_VALUE;
+    }
+
     if (INVALID_HANDLE_VALUE != m_Handle)
     {
         if (FALSE == CloseHandle(m_Handle))
@@ -893,6 +1009,70 @@ DEVICE_IO::Close(void)
 }
 
 
+/**************************************************************************************************
+** ULONG  QueryVolumeSectorSize(_In_ LPCWSTR fileName)
+**    Sector size of the volume holding a file, unbuffered I/O on the file must be aligned to it.
+**    The logical sector size comes from the file system, the physical one from the storage
+**    stack; the larger is returned so 512e disks are not written with read-modify-write cycles.
+**    Returns 0 when neither can be read, e.g. for files on a network share.
+**************************************************************************************************/
+static
+ULONG
+QueryVolumeSectorSize(_In_ LPCWSTR fileName)
+{
+    ULONG   sectorSize = 0;
+    WCHAR   volumePath[MAX_PATH + 1] = { 0 };
+    WCHAR   volumeName[MAX_PATH + 1] = { 0 };
+    DWORD   sectorsPerCluster = 0;
+    DWORD   bytesPerSector = 0;
+    DWORD   freeClusters = 0;
+    DWORD   totalClusters = 0;
+
+    if (FALSE == GetVolumePathNameW(fileName, volumePath, ARRAYSIZE(volumePath)))
+    { // Not on a local volume
+        return 0;
+    }
+
+    if (FALSE != GetDiskFreeSpaceW(volumePath, &sectorsPerCluster, &bytesPerSector, &freeClusters, &totalClusters))
+    {
+        sectorSize = bytesPerSector;
+    }
+
+    if (FALSE != GetVolumeNameForVolumeMountPointW(volumePath, volumeName, ARRAYSIZE(volumeName)))
+    { // "\\?\Volume{GUID}\" names the volume's root, the volume itself has no trailing backslash
+        size_t  nameLength = wcslen(volumeName);
+        HANDLE  volume = INVALID_HANDLE_VALUE;
+
+        if ((nameLength > 0) && (L'\\' == volumeName[nameLength - 1]))
+        {
+            volumeName[nameLength - 1] = L'\0';
+        }
+
+        // No access is needed to query the storage properties
+        volume = CreateFileW(volumeName, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        if (INVALID_HANDLE_VALUE != volume)
+        {
+            STORAGE_PROPERTY_QUERY              query = { StorageAccessAlignmentProperty, PropertyStandardQuery };
+            STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment = { 0 };
+            DWORD                               bytesReturned = 0;
+
+            if ( (FALSE != DeviceIoControl(volume, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &alignment, sizeof(alignment), &bytesReturned, NULL)) &&
+                 (bytesReturned >= (FIELD_OFFSET(STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR, BytesPerPhysicalSector) + sizeof(alignment.BytesPerPhysicalSector))) &&
+                 (alignment.BytesPerPhysicalSector > sectorSize)
+               )
+            {
+                sectorSize = alignment.BytesPerPhysicalSector;
+            }
+
+            CloseHandle(volume);
+        }
+
+    }
+
+    return sectorSize;
+}
+
+
 /**************************************************************************************************
 ** HRESULT  OpenPhysicalDisk(void)
 **    Create an I/O handle and read the device geometry or file size
@@ -930,7 +1110,7 @@ DEVICE_IO::OpenPhysicalDisk(void)
             FILE_SHARE_READ | FILE_SHARE_WRITE,
             NULL,
             ( ((RAW_DEVICE_TYPE == m_Type) || (REMOVABLE_MEDIA_DEVICE_TYPE == m_Type)) ? OPEN_EXISTING : OPEN_ALWAYS),
-            0,
+            ( (m_DirectIo && (PLAIN_FILE_DEVICE_TYPE == m_Type)) ? (FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH) : 0),
             NULL);
 
         if (m_Handle == INVALID_HANDLE_VALUE)
@@ -960,9 +1140,40 @@ DEVICE_IO::OpenPhysicalDisk(void)
                         m_LastError = IO_ERROR_INVALID_FILE_SIZE;
                         ret = HRESULT_FROM_WIN32(GetLastError());
                     }
-                    else if (m_IOSize.QuadPart > 0)
+                    else
                     {
-                        SetIOBlockCount();
+                        // Unbuffered I/O is done in whole sectors of the volume
+                        ULONG sectorSize = m_DirectIo ? QueryVolumeSectorSize(m_Name.c_str()) : 0;
+
+                        if ( (0 != (sectorSize & (sectorSize - 1))) ||
+                             (sectorSize > DIRECT_IO_BUFFER_SIZE)
+                           )
+                        { // The block arithmetic and the bounce buffer need a power of two that fits it
+                            m_LastError = IO_ERROR_INVALID_BLOCK;
+                            ret = HRESULT_FROM_WIN32(ERROR_INVALID_BLOCK_LENGTH);
+                        }
+                        else
+                        {
+                            if (sectorSize > m_BlockSize)
+                            { // Both are powers of two, the sector size is a multiple of the block size
+                                m_BlockSize = sectorSize;
+                            }
+
+                            if (m_IOSize.QuadPart > 0)
+                            {
+                                SetIOBlockCount();
+                            }
+
+                            if ( m_DirectIo &&
+                                 (nullptr == (m_pBounce = (PCHAR)VirtualAlloc(NULL, DIRECT_IO_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)))
+                               )
+                            { // Unbuffered I/O needs a block aligned buffer
+                                m_LastError = IO_ERROR_NO_MEMORY;
+                                ret = E_OUTOFMEMORY;
+                            }
+
+                        }
+
                     }
                     break;
 
@@ -1064,6 +1275,35 @@ DEVICE_IO::SetDeviceID(_In_ UINT devID)
 }
 
 
+/**************************************************************************************************
+** HRESULT  SetDirectIo(_In_ BOOL enable)
+**    Selects unbuffered (FILE_FLAG_NO_BUFFERING) I/O for a plain file, so bulk copies of data
+**    that is used only once do not push everything else out of the system file cache.
+**    Unaligned reads and writes go through a block aligned bounce buffer, the head and tail
+**    blocks of a write are read back first so the bytes around the data are kept. The block
+**    size is rounded up to the sector size of the file's volume when the file is opened.
+**    Physical devices are opened without file caching already and are not affected.
+**    Must be set before the file is opened.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::SetDirectIo(_In_ BOOL enable)
+{
+    HRESULT ret = E_FAIL;
+
+    if (INVALID_HANDLE_VALUE != m_Handle)
+    {
+        m_LastError = IO_ERROR_ALREADY_OPENED;
+    }
+    else
+    {
+        m_DirectIo = enable;
+        ret = S_OK;
+    }
+
+    return ret;
+}
+
+
 // // // // // // // // // // // // // // // // //
 // // // //     Position functions     // // // //
 // // // // // // // // // // // // // // // // //
@@ -1095,6 +1335,7 @@ DEVICE_IO::GetPos(_Inout_ ULONGLONG *ullPos)
                 break;
 
             case PLAIN_FILE_DEVICE_TYPE:
+            case OVERLAY_FILE_DEVICE_TYPE:
                 if (IsDeviceReady())
                 {
                     *ullPos = m_IOCurPos.QuadPart;
@@ -1131,7 +1372,13 @@ DEVICE_IO::GetIoPos(_Inout_ ULONGLONG *curPos)
         m_LastError = IO_ERROR_GET_POSITION_FAILED;
         if (IsDeviceReady())
         { // Only make the call if there is a sucessful open and ready
-            if (FALSE != SetFilePointerEx(m_Handle, LARGE_INTEGER{ 0 }, &filePos, FILE_CURRENT))
+            if ((nullptr != m_pBounce) || (OVERLAY_FILE_DEVICE_TYPE == m_Type))
+            { // Unbuffered and overlay I/O are positional and do not use the file pointer
+                *curPos = m_IOCurPos.QuadPart;
+                m_LastError = IO_OK;
+                ret = S_OK;
+            }
+            else if (FALSE != SetFilePointerEx(m_Handle, LARGE_INTEGER{ 0 }, &filePos, FILE_CURRENT))
             { // success is non-zero
                 *curPos = filePos.QuadPart;
                 m_LastError = IO_OK;
@@ -1444,7 +1691,13 @@ DEVICE_IO::SetFileOffset(_In_ ULONGLONG newPos)
     ULONGLONG       currPosition;
     HRESULT         ret = E_FAIL;
 
-    if (FAILED(GetIoPos(&currPosition)))
+    if (nullptr != m_pBounce)
+    { // Unbuffered I/O is positional, only the I/O pointer moves
+        m_IOCurPos.QuadPart = newPos;
+        m_LastError = (newPos >= m_IOSize.QuadPart) ? IO_ERROR_EOF : IO_OK;
+        ret = S_OK;
+    }
+    else if (FAILED(GetIoPos(&currPosition)))
     {
         m_LastError = IO_ERROR_SET_POSITION_FAILED;
     }
@@ -1542,6 +1795,13 @@ DEVICE_IO::SetIoPosition(_In_ ULONGLONG newPos)
                 ret = SetFileOffset(newPos);
                 break;
 
+            case OVERLAY_FILE_DEVICE_TYPE:
+                // Overlay I/O is positional, only the I/O pointer moves
+                m_IOCurPos.QuadPart = newPos;
+                m_LastError = (newPos >= m_IOSize.QuadPart) ? IO_ERROR_EOF : IO_OK;
+                ret = S_OK;
+                break;
+
             default:
                 m_LastError = IO_ERROR_UNSUPPORTED_DEVICE_TYPE;
                 break;
@@ -1809,22 +2069,35 @@ SafeIO( _In_ HANDLE hdl,
         do
         {
             DWORD bProcessed = 0;
+            DWORD ioError = ERROR_SUCCESS;
 
             // Read using the smallest chunk size possible or cap at MAX_DWORD
             DWORD bytesThisRead = (bytesToProcess > (size_t)maxIOSize) ? maxIOSize : (DWORD)bytesToProcess;
 
-            if (
-                 ( (IO_TYPE_READ == IO_FLAG)  &&    // Process a read
-                   (FALSE == ReadFile(hdl, buffer, bytesThisRead, &bProcessed, NULL))
-                 ) ||
-                 ( (IO_TYPE_WRITE == IO_FLAG) &&    // Process a write
-                   (FALSE == WriteFile(hdl, buffer, bytesThisRead, &bProcessed, NULL)) &&
-                   (FALSE == FlushFileBuffers(hdl)) // Always flush after a write
-                 ) ||
+            // The error is taken right after the failing call, before anything else can replace it
+            if (IO_TYPE_READ == IO_FLAG)
+            { // Process a read
+                if (FALSE == ReadFile(hdl, pBuffer, bytesThisRead, &bProcessed, NULL))
+                {
+                    ioError = GetLastError();
+                }
+
+            }
+            else if (FALSE == WriteFile(hdl, pBuffer, bytesThisRead, &bProcessed, NULL))
+            { // Process a write, a failed write is still flushed but its error is the one returned
+                ioError = GetLastError();
+                (VOID)FlushFileBuffers(hdl);
+            }
+            else if (0 == bProcessed)
+            { // A write that succeeds without writing anything is a failure, unlike a read at EOF
+                ioError = ERROR_WRITE_FAULT;
+            }
+
+            if ( (ERROR_SUCCESS != ioError) ||
                  (0 == bProcessed)
                )
             { // Stop reading if any IO fails
-                ret = HRESULT_FROM_WIN32(GetLastError());
+                ret = HRESULT_FROM_WIN32(ioError);
                 break;
             }
             else
@@ -1846,6 +2119,59 @@ SafeIO( _In_ HANDLE hdl,
 }
 
 
+/*************************************************************************************************
+** HRESULT PositionalIO( _In_ HANDLE hdl,
+**                      _In_ ULONGLONG offset,
+**                      _Inout_updates_bytes_(size) PCHAR buffer,
+**                      _In_ ULONG size,
+**                      _In_ IO_TYPE IO_FLAG,
+**                      _Out_ ULONG* bytesProcessed
+**                    )
+**  Read or write at an explicit offset, without using or moving the file pointer of the handle
+**  the way SafeIO() does. For unbuffered handles the offset, size and buffer must be block
+**  aligned. Reading at or past the end of the file returns zero bytes and is not an error.
+**************************************************************************************************/
+static
+HRESULT
+PositionalIO( _In_ HANDLE hdl,
+              _In_ ULONGLONG offset,
+              _Inout_updates_bytes_(size) PCHAR buffer,
+              _In_ ULONG size,
+              _In_ IO_TYPE IO_FLAG,
+              _Out_ ULONG* bytesProcessed
+            )
+{
+    OVERLAPPED  overlapped = { 0 };
+    DWORD       bProcessed = 0;
+    DWORD       ioError = ERROR_SUCCESS;
+
+    overlapped.Offset = (DWORD)(offset & MAX_DWORD);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+    if (IO_TYPE_WRITE == IO_FLAG)
+    { // Process a write
+        if (FALSE == WriteFile(hdl, buffer, size, &bProcessed, &overlapped))
+        {
+            ioError = GetLastError();
+        }
+
+    }
+    else if (FALSE == ReadFile(hdl, buffer, size, &bProcessed, &overlapped))
+    { // Process a read, the end of the file is not an error
+        ioError = GetLastError();
+        if (ERROR_HANDLE_EOF == ioError)
+        {
+            ioError = ERROR_SUCCESS;
+        }
+
+    }
+
+    *bytesProcessed = bProcessed;
+
+    return HRESULT_FROM_WIN32(ioError);
+}
+
+
 /*************************************************************************************************
 ** HRESULT ReadBlocksFromDevice(
 **                       _Out_writes_bytes_(bufferSize) PCHAR buffer,
@@ -1896,9 +2222,8 @@ DEVICE_IO::ReadBlocksFromDevice (_Out_writes_bytes_(bufferSize) PCHAR buffer, _I
             }
 
             if (FAILED(ret = SafeIO(m_Handle, buffer, bytesToRead, m_BlockSize, IO_TYPE_READ, bytesRead)))
-            { // Read failed
+            { // Read failed, SafeIO() returns the error of the failing ReadFile()
                 m_LastError = IO_ERROR_READ_FILE;
-                ret = HRESULT_FROM_WIN32 (GetLastError ());
             }
             else if (*bytesRead != bufferSize)
             { // If a full buffer was not read OR the read was short
@@ -2084,6 +2409,87 @@ DEVICE_IO::ReadFromBlockDevice(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_
 }
 
 
+/*************************************************************************************************
+** HRESULT ReadDirectBlock(
+**                  _In_ ULONGLONG  offset,
+**                  _Out_writes_bytes_(m_BlockSize) PCHAR pBlock)
+**    Read one block of an unbuffered file into the bounce buffer. The part of the block past
+**    the end of the file is zeroed.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::ReadDirectBlock(_In_ ULONGLONG offset, _Out_writes_bytes_(m_BlockSize) PCHAR pBlock)
+{
+    HRESULT ret;
+    ULONG   bRead = 0;
+
+    if (SUCCEEDED(ret = PositionalIO(m_Handle, offset, pBlock, m_BlockSize, IO_TYPE_READ, &bRead)))
+    {
+        ZeroMemory(pBlock + bRead, m_BlockSize - bRead);
+    }
+
+    return ret;
+}
+
+
+/*************************************************************************************************
+** HRESULT ReadFromFileDirect(
+**                  _Out_writes_bytes_(bufferSize) PCHAR buffer,
+**                  _In_ size_t     bufferSize,
+**                  _Out_ size_t    *bytesRead)
+**    Unbuffered counterpart of SafeIO() reads. Data is read at m_IOCurPos, in block aligned
+**    spans of at most DIRECT_IO_BUFFER_SIZE, and copied out of the bounce buffer. Reads stop
+**    at the end of the file. The caller updates m_IOCurPos.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::ReadFromFileDirect(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesRead)
+{
+    HRESULT     ret = S_OK;
+    ULONGLONG   position = m_IOCurPos.QuadPart;
+    ULONGLONG   blockMask = (ULONGLONG)m_BlockSize - 1;
+    size_t      remaining = 0;
+
+    *bytesRead = 0;
+    if (position < m_IOSize.QuadPart)
+    { // Never read past the end of the file
+        remaining = ((m_IOSize.QuadPart - position) < bufferSize) ? (size_t)(m_IOSize.QuadPart - position) : bufferSize;
+    }
+
+    while (SUCCEEDED(ret) && (remaining > 0))
+    {
+        ULONGLONG   blockStart = position & ~blockMask;
+        ULONG       skip = (ULONG)(position - blockStart);
+        ULONGLONG   span = (skip + remaining + blockMask) & ~blockMask;
+        ULONG       bRead = 0;
+
+        if (span > DIRECT_IO_BUFFER_SIZE)
+        {
+            span = DIRECT_IO_BUFFER_SIZE;
+        }
+
+        if (SUCCEEDED(ret = PositionalIO(m_Handle, blockStart, m_pBounce, (ULONG)span, IO_TYPE_READ, &bRead)))
+        {
+            if (bRead <= skip)
+            { // The file is shorter than m_IOSize says
+                remaining = 0;
+            }
+            else
+            {
+                size_t bytesThisRead = ((bRead - skip) < remaining) ? (bRead - skip) : remaining;
+
+                memcpy(buffer + *bytesRead, m_pBounce + skip, bytesThisRead);
+                *bytesRead += bytesThisRead;
+                position += bytesThisRead;
+                remaining -= bytesThisRead;
+            }
+
+        }
+
+    }
+
+    return ret;
+}
+
+
 /*************************************************************************************************
 ** HRESULT ReadFromFile(
 **                  _Out_writes_bytes_(bufferSize) PCHAR buffer,
@@ -2113,10 +2519,10 @@ DEVICE_IO::ReadFromFile (_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_
         }
         else
         {
-            if (FAILED(hr = SafeIO(m_Handle, buffer, bufferSize, 0, IO_TYPE_READ, bytesRead)))
-            {
+            if (FAILED(hr = ( (nullptr != m_pBounce) ? ReadFromFileDirect(buffer, bufferSize, bytesRead)
+                                                     : SafeIO(m_Handle, buffer, bufferSize, 0, IO_TYPE_READ, bytesRead) )))
+            { // Both return the error of the failing ReadFile(), GetLastError() may have changed since
                 m_LastError = IO_ERROR_READ_FILE;
-                hr = HRESULT_FROM_WIN32 (GetLastError ());
             }
             else if (0 == *bytesRead)
             {
@@ -2187,6 +2593,10 @@ DEVICE_IO::Read (_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t buffer
                 hr = ReadFromFile (buffer, bufferSize, &bRead);
                 break;
 
+            case OVERLAY_FILE_DEVICE_TYPE:
+                hr = ReadFromOverlay (buffer, bufferSize, &bRead);
+                break;
+
             default:
                 m_LastError = IO_ERROR_UNSUPPORTED_DEVICE_TYPE;
                 break;
@@ -2289,11 +2699,10 @@ DEVICE_IO::WriteBlocksToDevice(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ s
             }
 
             // Write buffer to device and check that some bytes were written.
-            // SafeIO() performs a flush after write.
+            // SafeIO() only flushes after a failed write, device handles are not cached by the system.
             if (FAILED(ret = SafeIO(m_Handle, buffer, bytesToWrite, m_BlockSize, IO_TYPE_WRITE, bytesWritten)))
-            { // Failed write
+            { // Failed write, SafeIO() returns the error of the failing WriteFile()
                 m_LastError = IO_ERROR_WRITE_FILE;
-                ret = HRESULT_FROM_WIN32(GetLastError());
             }
             else if (*bytesWritten != bufferSize)
             { // PARTIAL - write was clamped OR less than requested were written
@@ -2568,6 +2977,103 @@ DEVICE_IO::WriteToBlockDevice(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ si
 }
 
 
+/*************************************************************************************************
+**  HRESULT WriteToFileDirect(
+**                   _In_reads_bytes_(bufferSize) PCHAR buffer,
+**                   _In_ size_t bufferSize,
+**                   _Out_ size_t *bytesWritten)
+**    Unbuffered counterpart of SafeIO() writes. Data is copied into the bounce buffer and
+**    written at m_IOCurPos in block aligned spans. When the data starts or ends inside a block,
+**    that block is read first so the bytes around the data are kept. Since whole blocks are
+**    written, the file is cut back to the last byte of data when a write extends it.
+**    The caller updates m_IOCurPos and m_IOSize.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::WriteToFileDirect(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesWritten)
+{
+    HRESULT     ret = S_OK;
+    ULONGLONG   position = m_IOCurPos.QuadPart;
+    ULONGLONG   blockMask = (ULONGLONG)m_BlockSize - 1;
+    ULONGLONG   blocksEnd = m_IOSize.QuadPart;
+    size_t      remaining = bufferSize;
+
+    *bytesWritten = 0;
+    while (SUCCEEDED(ret) && (remaining > 0))
+    {
+        ULONGLONG   blockStart = position & ~blockMask;
+        ULONG       skip = (ULONG)(position - blockStart);
+        ULONGLONG   span = (skip + remaining + blockMask) & ~blockMask;
+        ULONG       tailBlock;
+        size_t      bytesThisWrite;
+        ULONG       bWritten = 0;
+
+        if (span > DIRECT_IO_BUFFER_SIZE)
+        {
+            span = DIRECT_IO_BUFFER_SIZE;
+        }
+
+        tailBlock = (ULONG)span - m_BlockSize;
+        bytesThisWrite = ((span - skip) < remaining) ? (size_t)(span - skip) : remaining;
+
+        if ( (0 != skip) &&     // Data starts inside the first block
+             FAILED(ret = ReadDirectBlock(blockStart, m_pBounce))
+           )
+        {
+            m_LastError = IO_ERROR_READ_FILE;
+        }
+        else if ( (0 != ((skip + bytesThisWrite) & blockMask)) &&   // Data ends inside the last block
+                  ((0 != tailBlock) || (0 == skip)) &&              // which was not read above
+                  FAILED(ret = ReadDirectBlock(blockStart + tailBlock, m_pBounce + tailBlock))
+                )
+        {
+            m_LastError = IO_ERROR_READ_FILE;
+        }
+        else
+        {
+            memcpy(m_pBounce + skip, buffer + *bytesWritten, bytesThisWrite);
+            if (SUCCEEDED(ret = PositionalIO(m_Handle, blockStart, m_pBounce, (ULONG)span, IO_TYPE_WRITE, &bWritten)))
+            {
+                if ((blockStart + bWritten) > blocksEnd)
+                {
+                    blocksEnd = blockStart + bWritten;
+                }
+
+                if (bWritten < span)
+                { // Partial write, report the data that made it and stop
+                    bytesThisWrite = (bWritten <= skip) ? 0 : (((bWritten - skip) < bytesThisWrite) ? (bWritten - skip) : bytesThisWrite);
+                    remaining = bytesThisWrite;
+                }
+
+                *bytesWritten += bytesThisWrite;
+                position += bytesThisWrite;
+                remaining -= bytesThisWrite;
+            }
+
+        }
+
+    }
+
+    if ( (blocksEnd > m_IOSize.QuadPart) &&
+         (blocksEnd > position)
+       )
+    { // The last block was written whole, drop what is past the data
+        FILE_END_OF_FILE_INFO endOfFile;
+
+        endOfFile.EndOfFile.QuadPart = (position > m_IOSize.QuadPart) ? position : m_IOSize.QuadPart;
+        if ( (FALSE == SetFileInformationByHandle(m_Handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) &&
+             SUCCEEDED(ret)
+           )
+        {
+            m_LastError = IO_ERROR_INVALID_FILE_SIZE;
+            ret = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+    }
+
+    return ret;
+}
+
+
 /*************************************************************************************************
 ** HRESULT  WriteToFile(
 **                       _In_reads_bytes_(bufferSize) PCHAR buffer,
@@ -2598,11 +3104,12 @@ DEVICE_IO::WriteToFile ( _In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t
         else
         {
             // Write buffer to device and check that some bytes were written.
-            // SafeIO() performs a flush after write.
-            if (FAILED(hr = SafeIO(m_Handle, buffer, bufferSize, 0, IO_TYPE_WRITE, bytesWritten)) )
-            {
+            // SafeIO() only flushes after a failed write, cached writes reach the disk on Flush().
+            // Unbuffered writes are write through.
+            if (FAILED(hr = ( (nullptr != m_pBounce) ? WriteToFileDirect(buffer, bufferSize, bytesWritten)
+                                                     : SafeIO(m_Handle, buffer, bufferSize, 0, IO_TYPE_WRITE, bytesWritten) )))
+            { // Both return the error of the failing WriteFile(), GetLastError() may have changed since
                 m_LastError = IO_ERROR_WRITE_FILE;
-                hr = HRESULT_FROM_WIN32(GetLastError());
             }
             else
             {
@@ -2673,6 +3180,10 @@ DEVICE_IO::Write (_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferS
                 hr = WriteToFile(buffer, bufferSize, &bWritten);
                 break;
 
+            case OVERLAY_FILE_DEVICE_TYPE:
+                hr = WriteToOverlay(buffer, bufferSize, &bWritten);
+                break;
+
             default:
                 m_LastError = IO_ERROR_UNSUPPORTED_DEVICE_TYPE;
                 break;
@@ -2687,3 +3198,370 @@ DEVICE_IO::Write (_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferS
 
     return hr;
 }
+
+/*************************************************************************************************
+**  HRESULT Flush(void)
+**  Public method to write out whatever the system still caches for the device, so everything
+**  written before the call is on the media when it returns. An overlay only ever writes to its
+**  delta file, so that is the file flushed.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::Flush(void)
+{
+    HRESULT hr = E_FAIL;
+
+    if (IsIoReady())
+    {
+        HANDLE  hdl = (OVERLAY_FILE_DEVICE_TYPE == m_Type) ? m_DeltaHandle : m_Handle;
+
+        if (FALSE == FlushFileBuffers(hdl))
+        {
+            m_LastError = IO_ERROR_WRITE_FILE;
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else
+        {
+            m_LastError = IO_OK;
+            hr = S_OK;
+        }
+
+    }
+
+    return hr;
+}
+
+
+// // // // // // // // // // // // // //
+// // //  Overlay Functionality  // // //
+// // // // // // // // // // // // // //
+/*************************************************************************************************
+** HRESULT LoadOverlayDelta(void)
+**    Writes the header of a new delta file, or checks the header of an existing one against
+**    the base file and rebuilds m_OverlayMap from its records. A record cut short at the end
+**    of the file, by a write that did not complete, is dropped and overwritten by the next
+**    patched block.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::LoadOverlayDelta(void)
+{
+    HRESULT                 ret = S_OK;
+    OVERLAY_DELTA_HEADER    header = { 0 };
+    LARGE_INTEGER           deltaSize = { 0 };
+    ULONG                   bProcessed = 0;
+    ULONGLONG               recordCount = 0;
+    UINT64                  blockOffset = 0;
+
+    if (FALSE == GetFileSizeEx(m_DeltaHandle, &deltaSize))
+    {
+        m_LastError = IO_ERROR_INVALID_FILE_SIZE;
+        ret = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (0 == deltaSize.QuadPart)
+    { // New delta, nothing is patched yet
+        header.Signature = OVERLAY_DELTA_SIGNATURE;
+        header.Version = OVERLAY_DELTA_VERSION;
+        header.BlockSize = m_BlockSize;
+        header.BaseSize = m_IOSize.QuadPart;
+
+        if (FAILED(ret = PositionalIO(m_DeltaHandle, 0, (PCHAR)&header, sizeof(header), IO_TYPE_WRITE, &bProcessed)))
+        {
+            m_LastError = IO_ERROR_WRITE_FILE;
+        }
+        else
+        {
+            m_LastError = IO_OK;
+        }
+
+    }
+    else if (FAILED(ret = PositionalIO(m_DeltaHandle, 0, (PCHAR)&header, sizeof(header), IO_TYPE_READ, &bProcessed)))
+    {
+        m_LastError = IO_ERROR_READ_FILE;
+    }
+    else if ( (sizeof(header) != bProcessed) ||
+              (OVERLAY_DELTA_SIGNATURE != header.Signature) ||
+              (OVERLAY_DELTA_VERSION != header.Version) ||
+              (m_BlockSize != header.BlockSize) ||
+              (m_IOSize.QuadPart != header.BaseSize)
+            )
+    { // Not a delta of this base file
+        m_LastError = IO_ERROR_INVALID_OVERLAY_DELTA;
+        ret = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else
+    {
+        recordCount = ((ULONGLONG)deltaSize.QuadPart - sizeof(header)) / (sizeof(UINT64) + m_BlockSize);
+        m_LastError = IO_OK;
+
+        for (UINT32 record = 0; SUCCEEDED(ret) && (record < recordCount); record++)
+        {
+            if (FAILED(ret = PositionalIO(m_DeltaHandle, GetOverlayRecordOffset(record), (PCHAR)&blockOffset, sizeof(blockOffset), IO_TYPE_READ, &bProcessed)))
+            {
+                m_LastError = IO_ERROR_READ_FILE;
+            }
+            else if ( (sizeof(blockOffset) != bProcessed) ||
+                      (0 != (blockOffset % m_BlockSize)) ||
+                      (blockOffset >= m_IOSize.QuadPart)
+                    )
+            { // The record does not patch a block of the base file
+                m_LastError = IO_ERROR_INVALID_OVERLAY_DELTA;
+                ret = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+            else
+            {
+                ret = MapOverlayBlock(blockOffset, record); // MapOverlayBlock() sets m_LastError
+            }
+
+        }
+
+        if (SUCCEEDED(ret))
+        {
+            m_OverlayBlockCount = (UINT32)recordCount;
+        }
+
+    }
+
+    return ret;
+}
+
+
+/*************************************************************************************************
+** HRESULT MapOverlayBlock(_In_ ULONGLONG blockOffset, _In_ UINT32 record)
+**    Adds the block at blockOffset, held in delta record "record", to m_OverlayMap. A block
+**    that follows the previous extent, in both the base file and the delta, grows that extent
+**    so a patch spanning several blocks costs one extent.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::MapOverlayBlock(_In_ ULONGLONG blockOffset, _In_ UINT32 record)
+{
+    HRESULT ret = S_OK;
+    UINT32  index = ExtentSetFind(&m_OverlayMap, blockOffset);
+    PEXTENT previous = (index > 0) ? &m_OverlayMap.Extents[index - 1] : nullptr;
+
+    if ( (index < m_OverlayMap.Count) &&
+         (m_OverlayMap.Extents[index].Base <= blockOffset)
+       )
+    { // Each block has a single record
+        m_LastError = IO_ERROR_INVALID_OVERLAY_DELTA;
+        ret = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else if ( (nullptr != previous) &&
+              ((previous->End + 1) == blockOffset) &&
+              ((previous->Tag + (EXTENT_SIZE(*previous) / m_BlockSize)) == record)
+            )
+    { // Next block of the previous extent, in the next record
+        previous->End += m_BlockSize;
+    }
+    else if (FAILED(ret = ExtentSetInsert(&m_OverlayMap, index, blockOffset, m_BlockSize, record)))
+    {
+        m_LastError = IO_ERROR_NO_MEMORY;
+    }
+
+    return ret;
+}
+
+
+/*************************************************************************************************
+** HRESULT ReadFromOverlay(
+**                  _Out_writes_bytes_(bufferSize) PCHAR buffer,
+**                  _In_ size_t     bufferSize,
+**                  _Out_ size_t    *bytesRead)
+**    Reads the view at m_IOCurPos. Runs of blocks that were never patched are read from the
+**    base file with one read each, patched blocks from their delta records. Reads stop at the
+**    end of the base file.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::ReadFromOverlay(_Out_writes_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesRead)
+{
+    HRESULT     ret = S_OK;
+    ULONGLONG   position = m_IOCurPos.QuadPart;
+    size_t      remaining = 0;
+
+    *bytesRead = 0;
+    if (position < m_IOSize.QuadPart)
+    { // Never read past the end of the view
+        remaining = ((m_IOSize.QuadPart - position) < bufferSize) ? (size_t)(m_IOSize.QuadPart - position) : bufferSize;
+    }
+
+    while (SUCCEEDED(ret) && (remaining > 0))
+    {
+        UINT32      index = ExtentSetFind(&m_OverlayMap, position);
+        HANDLE      hdl = m_Handle;
+        ULONGLONG   fileOffset = position;
+        ULONGLONG   runEnd = (index < m_OverlayMap.Count) ? m_OverlayMap.Extents[index].Base : m_IOSize.QuadPart;
+        size_t      bytesThisRead;
+        ULONG       bRead = 0;
+
+        if (position >= runEnd)
+        { // Patched, read the rest of this block from its record
+            ULONGLONG   blockStart = position - (position % m_BlockSize);
+            UINT32      record = m_OverlayMap.Extents[index].Tag + (UINT32)((blockStart - m_OverlayMap.Extents[index].Base) / m_BlockSize);
+
+            hdl = m_DeltaHandle;
+            fileOffset = GetOverlayRecordOffset(record) + sizeof(UINT64) + (position - blockStart);
+            runEnd = blockStart + m_BlockSize;
+        }
+
+        bytesThisRead = ((runEnd - position) < remaining) ? (size_t)(runEnd - position) : remaining;
+        if (bytesThisRead > MAX_ULONG)
+        {
+            bytesThisRead = MAX_ULONG;
+        }
+
+        if (FAILED(ret = PositionalIO(hdl, fileOffset, buffer + *bytesRead, (ULONG)bytesThisRead, IO_TYPE_READ, &bRead)))
+        {
+            m_LastError = IO_ERROR_READ_FILE;
+        }
+        else if (0 == bRead)
+        { // The base file is shorter than when it was opened
+            remaining = 0;
+        }
+        else
+        {
+            *bytesRead += bRead;
+            position += bRead;
+            remaining -= bRead;
+        }
+
+    }
+
+    m_IOCurPos.QuadPart = position;
+    if (SUCCEEDED(ret))
+    {
+        if (0 == *bytesRead)
+        {
+            m_LastError = IO_ERROR_EOF;
+        }
+        else if (*bytesRead != bufferSize)
+        {
+            m_LastError = IO_ERROR_READ_PARTIAL;
+        }
+        else
+        {
+            m_LastError = IO_OK;
+        }
+
+    }
+
+    return ret;
+}
+
+
+/*************************************************************************************************
+** HRESULT WriteToOverlay(
+**                  _In_reads_bytes_(bufferSize) PCHAR buffer,
+**                  _In_ size_t     bufferSize,
+**                  _Out_ size_t    *bytesWritten)
+**    Writes the view at m_IOCurPos, block by block. A block patched before is updated in its
+**    delta record. The first write to a block appends a record holding the whole block, with
+**    the bytes around the data taken from the base file. The view cannot grow, writes stop at
+**    the end of the base file. The delta is flushed once the whole write is done.
+**************************************************************************************************/
+HRESULT
+DEVICE_IO::WriteToOverlay(_In_reads_bytes_(bufferSize) PCHAR buffer, _In_ size_t bufferSize, _Out_ size_t *bytesWritten)
+{
+    HRESULT     ret = S_OK;
+    ULONGLONG   position = m_IOCurPos.QuadPart;
+    size_t      remaining = 0;
+    PCHAR       pBlock = m_pOverlayRecord + sizeof(UINT64);
+
+    *bytesWritten = 0;
+    if (position < m_IOSize.QuadPart)
+    { // Never write past the end of the view
+        remaining = ((m_IOSize.QuadPart - position) < bufferSize) ? (size_t)(m_IOSize.QuadPart - position) : bufferSize;
+    }
+
+    while (SUCCEEDED(ret) && (remaining > 0))
+    {
+        UINT32      index = ExtentSetFind(&m_OverlayMap, position);
+        ULONGLONG   blockStart = position - (position % m_BlockSize);
+        ULONG       skip = (ULONG)(position - blockStart);
+        size_t      bytesThisWrite = ((m_BlockSize - skip) < remaining) ? (m_BlockSize - skip) : remaining;
+        ULONG       bProcessed = 0;
+
+        if ( (index < m_OverlayMap.Count) &&
+             (m_OverlayMap.Extents[index].Base <= position)
+           )
+        { // Patched before, update the record in place
+            UINT32 record = m_OverlayMap.Extents[index].Tag + (UINT32)((blockStart - m_OverlayMap.Extents[index].Base) / m_BlockSize);
+
+            if (FAILED(ret = PositionalIO(m_DeltaHandle, GetOverlayRecordOffset(record) + sizeof(UINT64) + skip, buffer + *bytesWritten, (ULONG)bytesThisWrite, IO_TYPE_WRITE, &bProcessed)))
+            {
+                m_LastError = IO_ERROR_WRITE_FILE;
+            }
+            else if (bytesThisWrite != bProcessed)
+            {
+                m_LastError = IO_ERROR_WRITE_PARTIAL;
+                ret = HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+            }
+
+        }
+        else if ( (bytesThisWrite != m_BlockSize) &&    // Partial block, start from the base data
+                  FAILED(ret = PositionalIO(m_Handle, blockStart, pBlock, m_BlockSize, IO_TYPE_READ, &bProcessed))
+                )
+        {
+            m_LastError = IO_ERROR_READ_FILE;
+        }
+        else
+        { // First write to this block, append its record
+            if (bytesThisWrite != m_BlockSize)
+            { // The last block of the base file may be short
+                ZeroMemory(pBlock + bProcessed, m_BlockSize - bProcessed);
+            }
+
+            *(PUINT64)m_pOverlayRecord = blockStart;
+            memcpy(pBlock + skip, buffer + *bytesWritten, bytesThisWrite);
+
+            if (FAILED(ret = PositionalIO(m_DeltaHandle, GetOverlayRecordOffset(m_OverlayBlockCount), m_pOverlayRecord, sizeof(UINT64) + m_BlockSize, IO_TYPE_WRITE, &bProcessed)))
+            {
+                m_LastError = IO_ERROR_WRITE_FILE;
+            }
+            else if ((sizeof(UINT64) + m_BlockSize) != bProcessed)
+            {
+                m_LastError = IO_ERROR_WRITE_PARTIAL;
+                ret = HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+            }
+            else if (SUCCEEDED(ret = MapOverlayBlock(blockStart, m_OverlayBlockCount)))
+            {
+                m_OverlayBlockCount++;
+            }
+
+        }
+
+        if (SUCCEEDED(ret))
+        {
+            *bytesWritten += bytesThisWrite;
+            position += bytesThisWrite;
+            remaining -= bytesThisWrite;
+        }
+
+    }
+
+    if ( (0 != *bytesWritten) &&
+         (FALSE == FlushFileBuffers(m_DeltaHandle)) &&
+         SUCCEEDED(ret)
+       )
+    {
+        m_LastError = IO_ERROR_WRITE_FILE;
+        ret = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_IOCurPos.QuadPart = position;
+    if (SUCCEEDED(ret))
+    {
+        if (0 == *bytesWritten)
+        {
+            m_LastError = IO_ERROR_EOF;
+        }
+        else if (*bytesWritten != bufferSize)
+        {
+            m_LastError = IO_ERROR_WRITE_PARTIAL;
+        }
+        else
+        {
+            m_LastError = IO_OK;
+        }
+
+    }
+
+    return ret;
+}
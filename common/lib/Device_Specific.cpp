@@ -17,6 +17,63 @@ Author:
 
 #include "Device_Specific.h"
 
+/****************************************************************************************
+**  template <class Layout>
+**  HRESULT ReadDeviceSpecificBaseData(
+**              _In_    const STRUCT_VIEW<Layout> &View,
+**              _Out_   PDEVICE_SPECIFIC_INFO Context
+**          )
+**
+**  Copies the fields of DEVICE_SPECIFIC_INFO_STRUCT_TEMPLATE, which all three
+**  layouts share at different offsets, from the view to the Context.
+**
+**  Return Value:
+**      HRESULT, E_FAIL for an unknown device type
+**
+*****************************************************************************************/
+template <class Layout>
+HRESULT
+ReadDeviceSpecificBaseData(
+    _In_    const STRUCT_VIEW<Layout> &View,
+    _Out_   PDEVICE_SPECIFIC_INFO Context
+)
+{
+    HRESULT     hr = S_OK;
+
+    Context->Type = VIEW_GET(View, Layout, Type);
+    Context->DumpHeaderInstanceID = VIEW_GET(View, Layout, DumpHeaderInstanceID);
+
+    Context->BugCheckCode = VIEW_GET(View, Layout, BugCheckCode);
+    Context->BugCheckParam1 = VIEW_GET(View, Layout, BugCheckParam1);
+    Context->BugCheckParam2 = VIEW_GET(View, Layout, BugCheckParam2);
+    Context->BugCheckParam3 = VIEW_GET(View, Layout, BugCheckParam3);
+    Context->BugCheckParam4 = VIEW_GET(View, Layout, BugCheckParam4);
+
+    switch (Context->Type)
+    { // TYPE is the first item of all struct's (PACKED/UNPACKED) which never changes position
+        case DEVICE_TYPE_INTELx86:          // Retained for backward compatibility
+        case PROCESSOR_ARCHITECTURE_INTEL:
+            Context->CpuContextAddress = VIEW_GET(View, Layout, CpuContextAddress);
+            break;
+
+        case DEVICE_TYPE_QCOM32:            // Retained for backward compatibility
+        case PROCESSOR_ARCHITECTURE_ARM:
+        case PROCESSOR_ARCHITECTURE_ARM64:
+            Context->APRegPA = VIEW_GET(View, Layout, APRegPA);
+            Context->VA = VIEW_GET(View, Layout, VA);
+            Context->PA = VIEW_GET(View, Layout, PA);
+            Context->Size = VIEW_GET(View, Layout, Size);
+            break;
+
+        default:
+            hr = E_FAIL;
+            break;
+    }
+
+    return hr;
+}
+
+
 /****************************************************************************************
 **  HRESULT ReadDeviceSpecificInfo(
 **              _In_    DEVICE_IO hFile,
@@ -38,6 +95,9 @@ Author:
 **  any data was added to the struct. This requirement forced reworking of this
 **  function such that the structures could be distinguished.
 **
+**  The layout is picked once and the buffer is then read in place through a
+**  STRUCT_VIEW of that layout, see Device_Specific.h for the offsets.
+**
 **  Return Value:
 **      HRESULT
 **
@@ -50,11 +110,15 @@ ReadDeviceSpecificInfo(
 )
 {
     HRESULT     hr = S_OK;
-    PACK_FLAG   Packing = USE_PACK_UNDEFINED;
     CHAR        DeviceSpecificInfo[DEVICE_SPECIFIC_INFO_BUFFER_LENGTH] = { 0 };
-    ULONG       dataVersion = DEVICE_SPECIFIC_INFO_STRUCT_OLDEST_SIGNED_VERSION;
     size_t      bytesProcessed = 0;
 
+    STRUCT_VIEW<DEVICE_SPECIFIC_INFO_LAYOUT>            latest(DeviceSpecificInfo, sizeof(DeviceSpecificInfo));
+    STRUCT_VIEW<DEVICE_SPECIFIC_INFO_PACKED_LAYOUT>     packed(DeviceSpecificInfo, sizeof(DeviceSpecificInfo));
+    STRUCT_VIEW<DEVICE_SPECIFIC_INFO_UNPACKED_LAYOUT>   unpacked(DeviceSpecificInfo, sizeof(DeviceSpecificInfo));
+
+    Context->DumpHeaderPA = 0;
+
     if ((DEVICE_IO::IO_OK != hFile->GetError()) ||
         FAILED(hr = hFile->SetPos(offset)) ||
         FAILED(hr = hFile->Read(DeviceSpecificInfo, sizeof(DeviceSpecificInfo), &bytesProcessed)) ||
@@ -63,60 +127,33 @@ ReadDeviceSpecificInfo(
     { // Failed to read buffer with struct
         hr = E_FAIL;
     }
-    else if (DEVICE_SPECIFIC_INFO_SIGNATURE == DEVICE_SPECIFIC_INFO_SIGNED_DATA(DeviceSpecificInfo, Signature))
+    else if (DEVICE_SPECIFIC_INFO_SIGNATURE == VIEW_GET(latest, DEVICE_SPECIFIC_INFO_LAYOUT, Signature))
     { // There is a signature at position zero - this is a new structure
-        Packing = USE_LATEST;
-        dataVersion = ((PDEVICE_SPECIFIC_INFO)&DeviceSpecificInfo)->Version;
+        hr = ReadDeviceSpecificBaseData(latest, Context);
+
+        // NOTE: below this point, process the remaining structure elements as signed, based on structure version
+        if (SUCCEEDED(hr) &&
+            (DEVICE_SPECIFIC_INFO_VERSION_DUMP_HEADER_PA <= VIEW_GET(latest, DEVICE_SPECIFIC_INFO_LAYOUT, Version)) &&
+            (DEVICE_SPECIFIC_INFO_LAYOUT::DumpHeaderPA::End <=
+                (DEVICE_SPECIFIC_INFO_LAYOUT::PayloadSize::End + (size_t)VIEW_GET(latest, DEVICE_SPECIFIC_INFO_LAYOUT, PayloadSize)))
+            )
+        { // Version 2 added the DUMP_HEADER physical address hint
+            Context->DumpHeaderPA = VIEW_GET(latest, DEVICE_SPECIFIC_INFO_LAYOUT, DumpHeaderPA);
+        }
     }
-    else if (BUGCHECK_CODE == DEVICE_SPECIFIC_INFO_BASE_DATA(USE_UNSIGNED_PACKED, DeviceSpecificInfo, BugCheckCode))
+    else if (BUGCHECK_CODE == VIEW_GET(packed, DEVICE_SPECIFIC_INFO_PACKED_LAYOUT, BugCheckCode))
     { // No signature means an old structure, pre 16/12. Therefore, check if the first data field (Type) is unpacked
-        Packing = USE_UNSIGNED_PACKED;
+        hr = ReadDeviceSpecificBaseData(packed, Context);
     }
-    else if(BUGCHECK_CODE == DEVICE_SPECIFIC_INFO_BASE_DATA(USE_UNSIGNED_UNPACKED, DeviceSpecificInfo, BugCheckCode))
+    else if (BUGCHECK_CODE == VIEW_GET(unpacked, DEVICE_SPECIFIC_INFO_UNPACKED_LAYOUT, BugCheckCode))
     { // No signature means an old structure, pre 16/12. Using UnPacked structure
-        Packing = USE_UNSIGNED_UNPACKED;
+        hr = ReadDeviceSpecificBaseData(unpacked, Context);
     }
     else
     { //Failed to determine packing
         hr = E_FAIL;
     }
 
-    if (SUCCEEDED(hr) && (USE_PACK_UNDEFINED != Packing))
-    { // Always retrieve the BASE data
-        Context->Type = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, Type);
-        Context->DumpHeaderInstanceID = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, DumpHeaderInstanceID);
-
-        Context->BugCheckCode = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, BugCheckCode);
-        Context->BugCheckParam1 = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, BugCheckParam1);
-        Context->BugCheckParam2 = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, BugCheckParam2);
-        Context->BugCheckParam3 = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, BugCheckParam3);
-        Context->BugCheckParam4 = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, BugCheckParam4);
-
-        switch (Context->Type)
-        { // TYPE is the first item of all struct's (PACKED/UNPACKED) which never changes position
-            case DEVICE_TYPE_INTELx86:          // Retained for backward compatibility
-            case PROCESSOR_ARCHITECTURE_INTEL:
-                Context->CpuContextAddress = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, CpuContextAddress);
-                break;
-
-            case DEVICE_TYPE_QCOM32:            // Retained for backward compatibility
-            case PROCESSOR_ARCHITECTURE_ARM:
-            case PROCESSOR_ARCHITECTURE_ARM64:
-                Context->APRegPA = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, APRegPA);
-                Context->VA = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, VA);
-                Context->PA = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, PA);
-                Context->Size = DEVICE_SPECIFIC_INFO_BASE_DATA(Packing, DeviceSpecificInfo, Size);
-                break;
-
-            default:
-                hr = E_FAIL;
-                break;
-        }
-
-    }
-
-    // NOTE: below this point, process the remaining structure elements as signed, based on structure version
-
     return hr;
 }
 
@@ -0,0 +1,545 @@
+/*++
+
+    Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+   Dump_Blob.cpp
+
+Environment:
+   User Mode
+
+--*/
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Struct_View.h"
+#include "Dump_Blob.h"
+
+#define DUMP_FILE_PAGE_SHIFT                12
+
+/****************************************************************************************
+**  Stored layouts
+**    Only the fields needed to find the memory runs and the secondary data.
+**    The run arrays live in PhysicalMemoryBlockBuffer (700 bytes) of the header.
+*****************************************************************************************/
+struct DUMP_FILE_RUN32_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(BasePage,             ULONG,      0x00);
+    VIEW_LAYOUT_FIELD(PageCount,            ULONG,      0x04);
+    static const size_t Length = 0x08;
+};
+
+struct DUMP_FILE_RUN64_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(BasePage,             ULONGLONG,  0x00);
+    VIEW_LAYOUT_FIELD(PageCount,            ULONGLONG,  0x08);
+    static const size_t Length = 0x10;
+};
+
+struct DUMP_FILE_HEADER32_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature,            ULONG,      0x000);
+    VIEW_LAYOUT_FIELD(ValidDump,            ULONG,      0x004);
+    VIEW_LAYOUT_FIELD(NumberOfRuns,         ULONG,      0x064);
+    VIEW_LAYOUT_FIELD(NumberOfPages,        ULONG,      0x068);
+    typedef DUMP_FILE_RUN32_LAYOUT Run;
+    static const size_t RunOffset = 0x06C;
+    static const ULONG MaxRuns = (700 - 8) / Run::Length;
+    static const ULONG ValidDumpSignature = 0x504D5544;     // "DUMP"
+    static const size_t Length = 0x1000;
+};
+
+struct DUMP_FILE_HEADER64_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature,            ULONG,      0x000);
+    VIEW_LAYOUT_FIELD(ValidDump,            ULONG,      0x004);
+    VIEW_LAYOUT_FIELD(NumberOfRuns,         ULONG,      0x088);
+    VIEW_LAYOUT_FIELD(NumberOfPages,        ULONGLONG,  0x090);
+    typedef DUMP_FILE_RUN64_LAYOUT Run;
+    static const size_t RunOffset = 0x098;
+    static const ULONG MaxRuns = (700 - 16) / Run::Length;
+    static const ULONG ValidDumpSignature = 0x34365544;     // "DU64"
+    static const size_t Length = 0x2000;
+};
+
+#define DUMP_FILE_HEADER_SIGNATURE          0x45474150      // "PAGE"
+
+struct DUMP_BLOB_FILE_HEADER_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature1,           ULONG,      0x00);
+    VIEW_LAYOUT_FIELD(Signature2,           ULONG,      0x04);
+    VIEW_LAYOUT_FIELD(HeaderSize,           ULONG,      0x08);
+    VIEW_LAYOUT_FIELD(BuildNumber,          ULONG,      0x0C);
+    static const size_t Length = 0x10;
+};
+
+struct DUMP_BLOB_HEADER_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(HeaderSize,           ULONG,      0x00);
+    VIEW_LAYOUT_FIELD(TagData1,             ULONG,      0x04);
+    VIEW_LAYOUT_FIELD(TagData2,             USHORT,     0x08);
+    VIEW_LAYOUT_FIELD(TagData3,             USHORT,     0x0A);
+    VIEW_LAYOUT_FIELD(TagData4,             ULONGLONG,  0x0C);
+    VIEW_LAYOUT_FIELD(DataSize,             ULONG,      0x14);
+    VIEW_LAYOUT_FIELD(PrePad,               ULONG,      0x18);
+    VIEW_LAYOUT_FIELD(PostPad,              ULONG,      0x1C);
+    static const size_t Length = 0x20;
+};
+
+
+/****************************************************************************************
+**  static helpers
+*****************************************************************************************/
+static int __cdecl
+CompareBlobByTag(
+    _In_    const void *First,
+    _In_    const void *Second
+)
+{
+    const DUMP_BLOB *first = (const DUMP_BLOB *)First;
+    const DUMP_BLOB *second = (const DUMP_BLOB *)Second;
+    int             result = memcmp(&first->Tag, &second->Tag, sizeof(GUID));
+
+    if (result != 0)
+    {
+        return result;
+    }
+
+    return (first->FileOffset < second->FileOffset) ? -1 : ((first->FileOffset > second->FileOffset) ? 1 : 0);
+}
+
+
+//
+// Reads the memory runs of the header. Returns the offset of the first byte
+// after the header and its pages in SecondaryDataOffset.
+//
+template <class Layout>
+static HRESULT
+ReadMemoryRuns(
+    _Inout_ PDUMP_FILE_VIEW View
+)
+{
+    STRUCT_VIEW<Layout>     header(View->Base, (size_t)View->Size);
+    UINT64                  fileOffset = Layout::Length;
+    UINT64                  pageCount = 0;
+    ULONG                   runCount = 0;
+
+    if (!header.IsValid())
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    runCount = VIEW_GET(header, Layout, NumberOfRuns);
+    if (runCount > Layout::MaxRuns)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    View->HeaderSize = (UINT32)Layout::Length;
+    View->Runs = (PPHYSICAL_EXTENT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (runCount + 1) * sizeof(PHYSICAL_EXTENT));
+    if (View->Runs == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (ULONG index = 0; index < runCount; index++)
+    {
+        STRUCT_VIEW<typename Layout::Run> runView(View->Base + Layout::RunOffset + (index * Layout::Run::Length),
+                                                  Layout::Run::Length);
+
+        pageCount = VIEW_GET(runView, typename Layout::Run, PageCount);
+        if (pageCount == 0)
+        {
+            continue;
+        }
+
+        View->Runs[View->RunCount].Base = (UINT64)VIEW_GET(runView, typename Layout::Run, BasePage) << DUMP_FILE_PAGE_SHIFT;
+        View->Runs[View->RunCount].Size = pageCount << DUMP_FILE_PAGE_SHIFT;
+        View->Runs[View->RunCount].FileOffset = fileOffset;
+        fileOffset += View->Runs[View->RunCount].Size;
+        View->RunCount++;
+    }
+
+    View->SecondaryDataOffset = Layout::Length + ((UINT64)VIEW_GET(header, Layout, NumberOfPages) << DUMP_FILE_PAGE_SHIFT);
+
+    return S_OK;
+}
+
+
+//
+// Walks the blobs of the secondary data. Called once with Blobs set to
+// nullptr to count them, then again to fill the array.
+//
+static HRESULT
+WalkBlobs(
+    _In_    const DUMP_FILE_VIEW *View,
+    _Out_writes_opt_(*BlobCount) PDUMP_BLOB Blobs,
+    _Out_   UINT32 *BlobCount
+)
+{
+    UINT64      offset = View->SecondaryDataOffset;
+    UINT64      dataOffset = 0;
+    UINT32      dataSize = 0;
+    UINT32      headerSize = 0;
+
+    *BlobCount = 0;
+
+    if ((offset >= View->Size) || ((View->Size - offset) < DUMP_BLOB_FILE_HEADER_LAYOUT::Length))
+    {
+        return S_OK;
+    }
+
+    STRUCT_VIEW<DUMP_BLOB_FILE_HEADER_LAYOUT> fileHeader(View->Base + offset, (size_t)(View->Size - offset));
+
+    if ((VIEW_GET(fileHeader, DUMP_BLOB_FILE_HEADER_LAYOUT, Signature1) != DUMP_FILE_BLOB_SIGNATURE1) ||
+        (VIEW_GET(fileHeader, DUMP_BLOB_FILE_HEADER_LAYOUT, Signature2) != DUMP_FILE_BLOB_SIGNATURE2))
+    {
+        //
+        // No secondary data.
+        //
+        return S_OK;
+    }
+
+    headerSize = VIEW_GET(fileHeader, DUMP_BLOB_FILE_HEADER_LAYOUT, HeaderSize);
+    if (headerSize < DUMP_BLOB_FILE_HEADER_LAYOUT::Length)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    offset += headerSize;
+
+    while ((offset < View->Size) && ((View->Size - offset) >= DUMP_BLOB_HEADER_LAYOUT::Length))
+    {
+        STRUCT_VIEW<DUMP_BLOB_HEADER_LAYOUT> blobHeader(View->Base + offset, (size_t)(View->Size - offset));
+
+        headerSize = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, HeaderSize);
+        dataSize = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, DataSize);
+
+        //
+        // A blob without data ends the tagged data.
+        //
+        if ((headerSize == 0) || (dataSize == 0))
+        {
+            break;
+        }
+
+        if (headerSize < DUMP_BLOB_HEADER_LAYOUT::Length)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        dataOffset = offset + headerSize + VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, PrePad);
+        if ((dataOffset > View->Size) || ((View->Size - dataOffset) < dataSize))
+        {
+            return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        }
+
+        if (Blobs != nullptr)
+        {
+            ULONGLONG tagData4 = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, TagData4);
+
+            Blobs[*BlobCount].Tag.Data1 = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, TagData1);
+            Blobs[*BlobCount].Tag.Data2 = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, TagData2);
+            Blobs[*BlobCount].Tag.Data3 = VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, TagData3);
+            for (UINT32 index = 0; index < sizeof(Blobs[*BlobCount].Tag.Data4); index++)
+            {
+                Blobs[*BlobCount].Tag.Data4[index] = (UCHAR)(tagData4 >> (index * 8));
+            }
+
+            Blobs[*BlobCount].Data = View->Base + dataOffset;
+            Blobs[*BlobCount].DataSize = dataSize;
+            Blobs[*BlobCount].FileOffset = dataOffset;
+        }
+
+        (*BlobCount)++;
+        offset = dataOffset + dataSize + VIEW_GET(blobHeader, DUMP_BLOB_HEADER_LAYOUT, PostPad);
+    }
+
+    return S_OK;
+}
+
+
+/****************************************************************************************
+**  HRESULT OpenDumpFileView(
+**              _In_    LPCWSTR Path,
+**              _Out_   PDUMP_FILE_VIEW *View
+**          )
+**
+**  Maps a Windows dump file read only, reads its memory runs and indexes the
+**  secondary data blobs. A dump without secondary data opens with no blobs.
+**
+**  Return Value:
+**      S_OK, the Win32 error of the file or mapping calls,
+**      HRESULT_FROM_WIN32(ERROR_INVALID_DATA) for a bad header or blob chain.
+**
+*****************************************************************************************/
+HRESULT
+OpenDumpFileView(
+    _In_    LPCWSTR Path,
+    _Out_   PDUMP_FILE_VIEW *View
+)
+{
+    HRESULT             hr = S_OK;
+    LARGE_INTEGER       fileSize;
+    PDUMP_FILE_VIEW     view = nullptr;
+    UINT32              blobCount = 0;
+    ULONG               signature = 0;
+    ULONG               validDump = 0;
+
+    *View = nullptr;
+
+    view = (PDUMP_FILE_VIEW)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DUMP_FILE_VIEW));
+    if (view == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    view->File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (view->File == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    if (!GetFileSizeEx(view->File, &fileSize))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    if ((UINT64)fileSize.QuadPart < DUMP_FILE_HEADER32_LAYOUT::Length)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        goto Exit;
+    }
+
+    if ((UINT64)fileSize.QuadPart > (SIZE_T)(-1))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+        goto Exit;
+    }
+
+    view->Size = (UINT64)fileSize.QuadPart;
+
+    view->Mapping = CreateFileMappingW(view->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (view->Mapping == nullptr)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    view->Base = (const UCHAR *)MapViewOfFile(view->Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view->Base == nullptr)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    signature = LoadLittleEndian<ULONG>(view->Base + DUMP_FILE_HEADER32_LAYOUT::Signature::Offset);
+    validDump = LoadLittleEndian<ULONG>(view->Base + DUMP_FILE_HEADER32_LAYOUT::ValidDump::Offset);
+
+    if (signature != DUMP_FILE_HEADER_SIGNATURE)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else if (validDump == DUMP_FILE_HEADER64_LAYOUT::ValidDumpSignature)
+    {
+        view->Is64Bit = TRUE;
+        hr = ReadMemoryRuns<DUMP_FILE_HEADER64_LAYOUT>(view);
+    }
+    else if (validDump == DUMP_FILE_HEADER32_LAYOUT::ValidDumpSignature)
+    {
+        view->Is64Bit = FALSE;
+        hr = ReadMemoryRuns<DUMP_FILE_HEADER32_LAYOUT>(view);
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    if (FAILED(hr))
+    {
+        goto Exit;
+    }
+
+    hr = WalkBlobs(view, nullptr, &blobCount);
+    if (FAILED(hr) || (blobCount == 0))
+    {
+        goto Exit;
+    }
+
+    view->Blobs = (PDUMP_BLOB)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, blobCount * sizeof(DUMP_BLOB));
+    if (view->Blobs == nullptr)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    hr = WalkBlobs(view, view->Blobs, &view->BlobCount);
+    if (FAILED(hr))
+    {
+        goto Exit;
+    }
+
+    qsort(view->Blobs, view->BlobCount, sizeof(DUMP_BLOB), CompareBlobByTag);
+
+Exit:
+    if (FAILED(hr))
+    {
+        CloseDumpFileView(view);
+    }
+    else
+    {
+        *View = view;
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  VOID CloseDumpFileView(_In_opt_ PDUMP_FILE_VIEW View)
+**
+**  Unmaps the file. Slices handed out by the view are no longer valid.
+**
+*****************************************************************************************/
+VOID
+CloseDumpFileView(
+    _In_opt_ PDUMP_FILE_VIEW View
+)
+{
+    if (View == nullptr)
+    {
+        return;
+    }
+
+    if (View->Blobs != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, View->Blobs);
+    }
+
+    if (View->Runs != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, View->Runs);
+    }
+
+    if (View->Base != nullptr)
+    {
+        UnmapViewOfFile(View->Base);
+    }
+
+    if (View->Mapping != nullptr)
+    {
+        CloseHandle(View->Mapping);
+    }
+
+    if ((View->File != nullptr) && (View->File != INVALID_HANDLE_VALUE))
+    {
+        CloseHandle(View->File);
+    }
+
+    HeapFree(GetProcessHeap(), 0, View);
+}
+
+
+/****************************************************************************************
+**  const DUMP_BLOB *FindDumpBlob(
+**              _In_    const DUMP_FILE_VIEW *View,
+**              _In_    REFGUID Tag
+**          )
+**
+**  Binary search of the blob index. When a tag is present more than once the
+**  first one in the file is returned, as the debugger does.
+**
+**  Return Value:
+**      The blob, nullptr if the dump has no blob with the tag.
+**
+*****************************************************************************************/
+const DUMP_BLOB *
+FindDumpBlob(
+    _In_    const DUMP_FILE_VIEW *View,
+    _In_    REFGUID Tag
+)
+{
+    UINT32      low = 0;
+    UINT32      high = View->BlobCount;
+    UINT32      middle = 0;
+
+    while (low < high)
+    {
+        middle = low + ((high - low) / 2);
+        if (memcmp(&View->Blobs[middle].Tag, &Tag, sizeof(GUID)) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if ((low == View->BlobCount) || (memcmp(&View->Blobs[low].Tag, &Tag, sizeof(GUID)) != 0))
+    {
+        return nullptr;
+    }
+
+    return &View->Blobs[low];
+}
+
+
+/****************************************************************************************
+**  HRESULT GetDumpPhysicalSlice(
+**              _In_    const DUMP_FILE_VIEW *View,
+**              _In_    UINT64 PhysicalAddress,
+**              _In_    UINT64 Length,
+**              _Outptr_result_bytebuffer_(Length) const UCHAR **Data
+**          )
+**
+**  Returns the dump's copy of [PhysicalAddress, PhysicalAddress + Length) as a
+**  slice of the mapping. The range must lie within one memory run.
+**
+**  Return Value:
+**      S_OK, HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS) if the range is not in
+**      a single run, HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) if the file is
+**      truncated.
+**
+*****************************************************************************************/
+HRESULT
+GetDumpPhysicalSlice(
+    _In_    const DUMP_FILE_VIEW *View,
+    _In_    UINT64 PhysicalAddress,
+    _In_    UINT64 Length,
+    _Outptr_result_bytebuffer_(Length) const UCHAR **Data
+)
+{
+    UINT64                  fileOffset = 0;
+    const PHYSICAL_EXTENT   *run = nullptr;
+
+    *Data = nullptr;
+
+    for (UINT32 index = 0; index < View->RunCount; index++)
+    {
+        if ((View->Runs[index].Base <= PhysicalAddress) &&
+            ((PhysicalAddress - View->Runs[index].Base) < View->Runs[index].Size))
+        {
+            run = &View->Runs[index];
+            break;
+        }
+    }
+
+    if ((run == nullptr) || (Length > (run->Size - (PhysicalAddress - run->Base))))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS);
+    }
+
+    fileOffset = run->FileOffset + (PhysicalAddress - run->Base);
+    if ((fileOffset > View->Size) || (Length > (View->Size - fileOffset)))
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    *Data = View->Base + fileOffset;
+
+    return S_OK;
+}
@@ -111,6 +111,7 @@ IsValidRawDumpHeader(PRAW_DUMP_HEADER pRawDumpHeader)
 **       2. No sections with unrecognized section type.
 **       3. SectionsCount matches number of valid sections.
 **       4. Only the last section should have the RAW_DUMP_HEADER_FLAGS_INSUFFICIENT_STORAGE flag.
+**       5. Section version is v1, or v2 with the RAW_DUMP_SECTION_FLAGS_CHUNKED flag.
 **
 ** Arguments:
 **     PRAW_DUMP_SECTION_HEADER  SectionTable - ptr to section table, of RAW_DUMP_SECTION_HEADER elemnts
@@ -145,7 +146,15 @@ ValidateRawDumpSectionTable( PRAW_DUMP_SECTION_HEADER  SectionTable, UINT32 Tabl
         for (UINT32 index = 0; index < TableEntryCount; index++)
         { // Check for valid values in each table entry
 
-            if (RAW_DUMP_SECTION_HEADER_VERSION != SectionTable[index].Version)
+            if ((RAW_DUMP_SECTION_HEADER_VERSION_V2 == SectionTable[index].Version) &&
+                ((SectionTable[index].Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED) == RAW_DUMP_SECTION_FLAGS_CHUNKED)
+                )
+            { // v2 sections are chunked, Offset points to the chunk index
+                SectionStats->ChunkedSectionCount++;
+            }
+            else if ((RAW_DUMP_SECTION_HEADER_VERSION != SectionTable[index].Version) ||
+                     ((SectionTable[index].Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED) == RAW_DUMP_SECTION_FLAGS_CHUNKED)
+                     )
             {
                 SectionStats->InvalidVersionCount++;
                 lastError = RAW_DUMP_SECTION_VERSION_INVALID;
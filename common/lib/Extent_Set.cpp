@@ -0,0 +1,653 @@
+/*++
+
+    Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+   Extent_Set.cpp
+
+Environment:
+   User Mode
+
+--*/
+#include <windows.h>
+#include <stdlib.h>
+
+#include "Extent_Set.h"
+
+#define EXTENT_SET_INITIAL_CAPACITY         16
+
+/****************************************************************************************
+**  static helpers
+*****************************************************************************************/
+static int __cdecl
+CompareExtentByBase(
+    _In_    const void *First,
+    _In_    const void *Second
+)
+{
+    const EXTENT *first = (const EXTENT *)First;
+    const EXTENT *second = (const EXTENT *)Second;
+
+    if (first->Base != second->Base)
+    {
+        return (first->Base < second->Base) ? -1 : 1;
+    }
+
+    return (first->End < second->End) ? -1 : ((first->End > second->End) ? 1 : 0);
+}
+
+
+static HRESULT
+ExtentSetGrow(
+    _Inout_ PEXTENT_SET Set
+)
+{
+    UINT32      capacity = 0;
+    PEXTENT     extents = nullptr;
+
+    if (Set->Capacity == 0)
+    {
+        capacity = EXTENT_SET_INITIAL_CAPACITY;
+        extents = (PEXTENT)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(EXTENT));
+    }
+    else
+    {
+        if (Set->Capacity > (MAXDWORD / 2 / sizeof(EXTENT)))
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+
+        capacity = Set->Capacity * 2;
+        extents = (PEXTENT)HeapReAlloc(GetProcessHeap(), 0, Set->Extents, capacity * sizeof(EXTENT));
+    }
+
+    if (extents == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    Set->Extents = extents;
+    Set->Capacity = capacity;
+
+    return S_OK;
+}
+
+
+static HRESULT
+ExtentSetPush(
+    _Inout_ PEXTENT_SET Set,
+    _In_    UINT64 Base,
+    _In_    UINT64 End,
+    _In_    UINT32 Tag
+)
+{
+    HRESULT     hr = S_OK;
+
+    if (Set->Count == Set->Capacity)
+    {
+        hr = ExtentSetGrow(Set);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    Set->Extents[Set->Count].Base = Base;
+    Set->Extents[Set->Count].End = End;
+    Set->Extents[Set->Count].Tag = Tag;
+    Set->Count++;
+
+    return S_OK;
+}
+
+
+//
+// Appends an extent that starts at or after the last one, merging it into the
+// last extent when the two overlap or touch.
+//
+static HRESULT
+ExtentSetPushCoalesced(
+    _Inout_ PEXTENT_SET Set,
+    _In_    const EXTENT *Extent
+)
+{
+    PEXTENT     last = nullptr;
+
+    if (Set->Count > 0)
+    {
+        last = &Set->Extents[Set->Count - 1];
+        if ((last->End == MAXULONGLONG) || (Extent->Base <= last->End + 1))
+        {
+            if (Extent->End > last->End)
+            {
+                last->End = Extent->End;
+            }
+            return S_OK;
+        }
+    }
+
+    return ExtentSetPush(Set, Extent->Base, Extent->End, Extent->Tag);
+}
+
+
+/****************************************************************************************
+**  VOID ExtentSetInit(_Out_ PEXTENT_SET Set)
+**  VOID ExtentSetFree(_Inout_ PEXTENT_SET Set)
+**
+**  Set up an empty set, and release a set's storage leaving it empty.
+**
+*****************************************************************************************/
+VOID
+ExtentSetInit(
+    _Out_   PEXTENT_SET Set
+)
+{
+    Set->Extents = nullptr;
+    Set->Count = 0;
+    Set->Capacity = 0;
+}
+
+
+VOID
+ExtentSetFree(
+    _Inout_ PEXTENT_SET Set
+)
+{
+    if (Set->Extents != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, Set->Extents);
+    }
+
+    ExtentSetInit(Set);
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetAppend(
+**              _Inout_ PEXTENT_SET Set,
+**              _In_    UINT64 Base,
+**              _In_    UINT64 Size,
+**              _In_    UINT32 Tag
+**          )
+**
+**  Appends [Base, Base + Size - 1] to the end of the set. No ordering is
+**  enforced, call ExtentSetSort once all extents are in.
+**
+**  Return Value:
+**      E_INVALIDARG for an empty extent or one that wraps the address space.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetAppend(
+    _Inout_ PEXTENT_SET Set,
+    _In_    UINT64 Base,
+    _In_    UINT64 Size,
+    _In_    UINT32 Tag
+)
+{
+    if ((Size == 0) || ((Size - 1) > (MAXULONGLONG - Base)))
+    {
+        return E_INVALIDARG;
+    }
+
+    return ExtentSetPush(Set, Base, Base + Size - 1, Tag);
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetInsert(
+**              _Inout_ PEXTENT_SET Set,
+**              _In_    UINT32 Index,
+**              _In_    UINT64 Base,
+**              _In_    UINT64 Size,
+**              _In_    UINT32 Tag
+**          )
+**
+**  Inserts [Base, Base + Size - 1] before the extent at Index, Index == Count
+**  appends. With Index from ExtentSetFind a normalized set stays sorted, as
+**  long as the new extent does not overlap the ones around it.
+**
+**  Return Value:
+**      E_INVALIDARG for an empty extent, one that wraps the address space or
+**      an Index past the end of the set.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetInsert(
+    _Inout_ PEXTENT_SET Set,
+    _In_    UINT32 Index,
+    _In_    UINT64 Base,
+    _In_    UINT64 Size,
+    _In_    UINT32 Tag
+)
+{
+    HRESULT     hr = S_OK;
+
+    if ((Size == 0) || ((Size - 1) > (MAXULONGLONG - Base)) || (Index > Set->Count))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (Set->Count == Set->Capacity)
+    {
+        hr = ExtentSetGrow(Set);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    memmove(&Set->Extents[Index + 1], &Set->Extents[Index], (Set->Count - Index) * sizeof(EXTENT));
+    Set->Extents[Index].Base = Base;
+    Set->Extents[Index].End = Base + Size - 1;
+    Set->Extents[Index].Tag = Tag;
+    Set->Count++;
+
+    return S_OK;
+}
+
+
+/****************************************************************************************
+**  UINT32 ExtentSetFind(
+**              _In_    const EXTENT_SET *Set,
+**              _In_    UINT64 Address
+**          )
+**
+**  Binary search of a normalized set for the first extent that ends at or after
+**  Address. Address is in that extent when its Base is not above Address,
+**  otherwise the returned index is where an extent holding Address would go.
+**
+**  Return Value:
+**      Index of the extent, Set->Count if every extent ends before Address.
+**
+*****************************************************************************************/
+UINT32
+ExtentSetFind(
+    _In_    const EXTENT_SET *Set,
+    _In_    UINT64 Address
+)
+{
+    UINT32      low = 0;
+    UINT32      high = Set->Count;
+    UINT32      middle = 0;
+
+    while (low < high)
+    {
+        middle = low + ((high - low) / 2);
+        if (Set->Extents[middle].End < Address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+
+/****************************************************************************************
+**  VOID ExtentSetSort(_Inout_ PEXTENT_SET Set)
+**
+**  Sorts the set ascending by Base, then by End. Sets that are already in order,
+**  as memory descriptors and most section tables are, only cost a linear pass.
+**
+*****************************************************************************************/
+VOID
+ExtentSetSort(
+    _Inout_ PEXTENT_SET Set
+)
+{
+    for (UINT32 index = 1; index < Set->Count; index++)
+    {
+        if (CompareExtentByBase(&Set->Extents[index - 1], &Set->Extents[index]) > 0)
+        {
+            qsort(Set->Extents, Set->Count, sizeof(EXTENT), CompareExtentByBase);
+            break;
+        }
+    }
+}
+
+
+/****************************************************************************************
+**  VOID ExtentSetCheck(
+**              _In_    const EXTENT_SET *Set,
+**              _Out_opt_ PUINT32 HoleCount,
+**              _Out_opt_ PUINT32 OverlapCount
+**          )
+**
+**  Counts the holes between and the overlaps among the extents of a sorted set.
+**  An extent overlaps if it starts inside any earlier extent, not only the one
+**  right before it. A set with no overlaps is normalized.
+**
+*****************************************************************************************/
+VOID
+ExtentSetCheck(
+    _In_    const EXTENT_SET *Set,
+    _Out_opt_ PUINT32 HoleCount,
+    _Out_opt_ PUINT32 OverlapCount
+)
+{
+    UINT32      holes = 0;
+    UINT32      overlaps = 0;
+    UINT64      reach = 0;
+
+    for (UINT32 index = 0; index < Set->Count; index++)
+    {
+        if (index > 0)
+        {
+            if (Set->Extents[index].Base <= reach)
+            {
+                overlaps++;
+            }
+            else if (Set->Extents[index].Base - 1 > reach)
+            {
+                holes++;
+            }
+        }
+
+        if ((index == 0) || (Set->Extents[index].End > reach))
+        {
+            reach = Set->Extents[index].End;
+        }
+    }
+
+    if (HoleCount != nullptr)
+    {
+        *HoleCount = holes;
+    }
+
+    if (OverlapCount != nullptr)
+    {
+        *OverlapCount = overlaps;
+    }
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetCoalesce(
+**              _In_    const EXTENT_SET *Set,
+**              _Out_   PEXTENT_SET Result
+**          )
+**
+**  Merges overlapping and touching extents of a sorted set, so that every
+**  extent of Result is a maximal contiguous range. Each merged extent keeps the
+**  Tag of its first member.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetCoalesce(
+    _In_    const EXTENT_SET *Set,
+    _Out_   PEXTENT_SET Result
+)
+{
+    HRESULT     hr = S_OK;
+
+    ExtentSetInit(Result);
+
+    for (UINT32 index = 0; index < Set->Count; index++)
+    {
+        hr = ExtentSetPushCoalesced(Result, &Set->Extents[index]);
+        if (FAILED(hr))
+        {
+            ExtentSetFree(Result);
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetUnion(
+**              _In_    const EXTENT_SET *First,
+**              _In_    const EXTENT_SET *Second,
+**              _Out_   PEXTENT_SET Result
+**          )
+**
+**  Result is the coalesced union of two sorted sets.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetUnion(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+)
+{
+    HRESULT         hr = S_OK;
+    UINT32          indexFirst = 0;
+    UINT32          indexSecond = 0;
+    const EXTENT    *next = nullptr;
+
+    ExtentSetInit(Result);
+
+    while ((indexFirst < First->Count) || (indexSecond < Second->Count))
+    {
+        if ((indexSecond == Second->Count) ||
+            ((indexFirst < First->Count) &&
+             (First->Extents[indexFirst].Base <= Second->Extents[indexSecond].Base)))
+        {
+            next = &First->Extents[indexFirst++];
+        }
+        else
+        {
+            next = &Second->Extents[indexSecond++];
+        }
+
+        hr = ExtentSetPushCoalesced(Result, next);
+        if (FAILED(hr))
+        {
+            ExtentSetFree(Result);
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetIntersect(
+**              _In_    const EXTENT_SET *First,
+**              _In_    const EXTENT_SET *Second,
+**              _Out_   PEXTENT_SET Result
+**          )
+**
+**  Result holds the parts of First that are covered by Second. Both sets must be
+**  normalized. Extents of First are clipped, not merged, so every result extent
+**  lies within one extent of First and carries its Tag.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetIntersect(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+)
+{
+    HRESULT         hr = S_OK;
+    UINT32          indexSecond = 0;
+    UINT32          scan = 0;
+    const EXTENT    *current = nullptr;
+    const EXTENT    *other = nullptr;
+
+    ExtentSetInit(Result);
+
+    for (UINT32 indexFirst = 0; indexFirst < First->Count; indexFirst++)
+    {
+        current = &First->Extents[indexFirst];
+
+        while ((indexSecond < Second->Count) && (Second->Extents[indexSecond].End < current->Base))
+        {
+            indexSecond++;
+        }
+
+        //
+        // Every extent of Second passed here ends inside current, so the next
+        // extent of First can resume from the last one scanned.
+        //
+        for (scan = indexSecond; (scan < Second->Count) && (Second->Extents[scan].Base <= current->End); scan++)
+        {
+            other = &Second->Extents[scan];
+
+            hr = ExtentSetPush(Result,
+                               max(current->Base, other->Base),
+                               min(current->End, other->End),
+                               current->Tag);
+            if (FAILED(hr))
+            {
+                goto Exit;
+            }
+
+            if (other->End > current->End)
+            {
+                break;
+            }
+        }
+
+        indexSecond = scan;
+    }
+
+Exit:
+    if (FAILED(hr))
+    {
+        ExtentSetFree(Result);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  HRESULT ExtentSetDifference(
+**              _In_    const EXTENT_SET *First,
+**              _In_    const EXTENT_SET *Second,
+**              _Out_   PEXTENT_SET Result
+**          )
+**
+**  Result holds the parts of First that are not covered by Second. Both sets
+**  must be normalized. As with ExtentSetIntersect, every result extent lies
+**  within one extent of First and carries its Tag.
+**
+*****************************************************************************************/
+HRESULT
+ExtentSetDifference(
+    _In_    const EXTENT_SET *First,
+    _In_    const EXTENT_SET *Second,
+    _Out_   PEXTENT_SET Result
+)
+{
+    HRESULT         hr = S_OK;
+    UINT32          indexSecond = 0;
+    UINT64          cursor = 0;
+    BOOL            covered = FALSE;
+    const EXTENT    *current = nullptr;
+    const EXTENT    *other = nullptr;
+
+    ExtentSetInit(Result);
+
+    for (UINT32 indexFirst = 0; indexFirst < First->Count; indexFirst++)
+    {
+        current = &First->Extents[indexFirst];
+        cursor = current->Base;
+        covered = FALSE;
+
+        while ((indexSecond < Second->Count) && (Second->Extents[indexSecond].End < cursor))
+        {
+            indexSecond++;
+        }
+
+        while ((indexSecond < Second->Count) && (Second->Extents[indexSecond].Base <= current->End))
+        {
+            other = &Second->Extents[indexSecond];
+
+            if (other->Base > cursor)
+            {
+                hr = ExtentSetPush(Result, cursor, other->Base - 1, current->Tag);
+                if (FAILED(hr))
+                {
+                    goto Exit;
+                }
+            }
+
+            //
+            // Leave an extent of Second that runs past current in place, it
+            // may cover the next extent of First as well.
+            //
+            if (other->End >= current->End)
+            {
+                covered = TRUE;
+                break;
+            }
+
+            cursor = other->End + 1;
+            indexSecond++;
+        }
+
+        if (!covered)
+        {
+            hr = ExtentSetPush(Result, cursor, current->End, current->Tag);
+            if (FAILED(hr))
+            {
+                goto Exit;
+            }
+        }
+    }
+
+Exit:
+    if (FAILED(hr))
+    {
+        ExtentSetFree(Result);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  UINT32 ExtentSetContains(
+**              _In_    const EXTENT_SET *Outer,
+**              _In_    const EXTENT_SET *Inner
+**          )
+**
+**  Checks that every extent of Inner lies within a single extent of Outer.
+**  Outer must be coalesced (see ExtentSetCoalesce) so that a range spanning
+**  several touching extents counts as contained. Inner must be sorted.
+**
+**  Return Value:
+**      Index of the first extent of Inner that is not contained, Inner->Count
+**      if all of them are.
+**
+*****************************************************************************************/
+UINT32
+ExtentSetContains(
+    _In_    const EXTENT_SET *Outer,
+    _In_    const EXTENT_SET *Inner
+)
+{
+    UINT32          indexOuter = 0;
+    const EXTENT    *current = nullptr;
+
+    for (UINT32 indexInner = 0; indexInner < Inner->Count; indexInner++)
+    {
+        current = &Inner->Extents[indexInner];
+
+        while ((indexOuter < Outer->Count) && (Outer->Extents[indexOuter].End < current->Base))
+        {
+            indexOuter++;
+        }
+
+        if ((indexOuter == Outer->Count) ||
+            (Outer->Extents[indexOuter].Base > current->Base) ||
+            (Outer->Extents[indexOuter].End < current->End))
+        {
+            return indexInner;
+        }
+    }
+
+    return Inner->Count;
+}
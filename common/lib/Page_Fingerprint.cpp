@@ -0,0 +1,902 @@
+/*++
+
+    Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+   Page_Fingerprint.cpp
+
+Environment:
+   User Mode
+
+--*/
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chunked_Section.h"
+#include "Page_Fingerprint.h"
+
+#define PAGE_FINGERPRINT_INITIAL_RUNS       64
+#define PAGE_FINGERPRINT_INITIAL_PAGES      0x10000
+#define PAGE_FINGERPRINT_IO_SIZE            0x4000000
+
+//
+// xxHash64 primes
+//
+#define XXH_PRIME64_1                       0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2                       0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3                       0x165667B19E3779F9ULL
+#define XXH_PRIME64_4                       0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5                       0x27D4EB2F165667C5ULL
+
+//
+// Fingerprints are built by conversion phases running in parallel, the hash
+// of the zero page is computed once for all of them.
+//
+static INIT_ONCE    zeroPageHashOnce = INIT_ONCE_STATIC_INIT;
+static UINT64       zeroPageHash = 0;
+
+/****************************************************************************************
+**  static helpers
+*****************************************************************************************/
+static inline UINT64
+RotateLeft64(
+    _In_    UINT64 Value,
+    _In_    UINT32 Count
+)
+{
+    return (Value << Count) | (Value >> (64 - Count));
+}
+
+
+static inline UINT64
+XxhRound(
+    _In_    UINT64 Accumulator,
+    _In_    UINT64 Input
+)
+{
+    Accumulator += Input * XXH_PRIME64_2;
+    Accumulator = RotateLeft64(Accumulator, 31);
+    return Accumulator * XXH_PRIME64_1;
+}
+
+
+static inline UINT64
+XxhMergeRound(
+    _In_    UINT64 Hash,
+    _In_    UINT64 Accumulator
+)
+{
+    Hash ^= XxhRound(0, Accumulator);
+    return Hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+
+static BOOL CALLBACK
+InitZeroPageHash(
+    _Inout_     PINIT_ONCE InitOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Outptr_opt_result_maybenull_ PVOID *Context
+)
+{
+    static const UCHAR zeroPage[PAGE_FINGERPRINT_PAGE_SIZE] = { 0 };
+
+    UNREFERENCED_PARAMETER(InitOnce);
+    UNREFERENCED_PARAMETER(Parameter);
+    UNREFERENCED_PARAMETER(Context);
+
+    zeroPageHash = HashPage(zeroPage);
+
+    return TRUE;
+}
+
+
+static UINT64
+GetZeroPageHash()
+{
+    //
+    // InitZeroPageHash cannot fail.
+    //
+    InitOnceExecuteOnce(&zeroPageHashOnce, InitZeroPageHash, nullptr, nullptr);
+
+    return zeroPageHash;
+}
+
+
+static int __cdecl
+CompareRunByBase(
+    _In_    const void *First,
+    _In_    const void *Second
+)
+{
+    const PAGE_FINGERPRINT_RUN *first = (const PAGE_FINGERPRINT_RUN *)First;
+    const PAGE_FINGERPRINT_RUN *second = (const PAGE_FINGERPRINT_RUN *)Second;
+
+    if (first->BasePage != second->BasePage)
+    {
+        return (first->BasePage < second->BasePage) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+
+static int __cdecl
+CompareHash(
+    _In_    const void *First,
+    _In_    const void *Second
+)
+{
+    UINT64 first = *(const UINT64 *)First;
+    UINT64 second = *(const UINT64 *)Second;
+
+    return (first < second) ? -1 : ((first > second) ? 1 : 0);
+}
+
+
+static HRESULT
+GrowArray(
+    _Inout_ PVOID *Array,
+    _Inout_ PUINT64 Capacity,
+    _In_    UINT64 Needed,
+    _In_    UINT64 Initial,
+    _In_    size_t ElementSize
+)
+{
+    UINT64      capacity = (*Capacity == 0) ? Initial : *Capacity;
+    PVOID       array = nullptr;
+
+    if (Needed <= *Capacity)
+    {
+        return S_OK;
+    }
+
+    while (capacity < Needed)
+    {
+        if (capacity > (MAXSIZE_T / 2 / ElementSize))
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+        capacity *= 2;
+    }
+
+    if (*Array == nullptr)
+    {
+        array = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)(capacity * ElementSize));
+    }
+    else
+    {
+        array = HeapReAlloc(GetProcessHeap(), 0, *Array, (SIZE_T)(capacity * ElementSize));
+    }
+
+    if (array == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *Array = array;
+    *Capacity = capacity;
+
+    return S_OK;
+}
+
+
+static HRESULT
+TransferFile(
+    _In_    HANDLE File,
+    _Inout_updates_bytes_(Length) PVOID Buffer,
+    _In_    UINT64 Length,
+    _In_    BOOL Write
+)
+{
+    PUCHAR      buffer = (PUCHAR)Buffer;
+    DWORD       transferred = 0;
+    DWORD       thisTransfer = 0;
+    BOOL        result = FALSE;
+
+    while (Length > 0)
+    {
+        thisTransfer = (DWORD)min(Length, (UINT64)PAGE_FINGERPRINT_IO_SIZE);
+
+        if (Write)
+        {
+            result = WriteFile(File, buffer, thisTransfer, &transferred, nullptr);
+        }
+        else
+        {
+            result = ReadFile(File, buffer, thisTransfer, &transferred, nullptr);
+        }
+
+        if (!result)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        if (transferred != thisTransfer)
+        {
+            return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        }
+
+        buffer += thisTransfer;
+        Length -= thisTransfer;
+    }
+
+    return S_OK;
+}
+
+
+static HRESULT
+BuildSketch(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint
+)
+{
+    PUINT64     hashes = nullptr;
+    UINT64      count = 0;
+    UINT64      zeroHash = GetZeroPageHash();
+    UINT32      sketchCount = 0;
+
+    if (Fingerprint->Sketch != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, Fingerprint->Sketch);
+        Fingerprint->Sketch = nullptr;
+        Fingerprint->SketchCount = 0;
+    }
+
+    if (Fingerprint->PageCount == 0)
+    {
+        return S_OK;
+    }
+
+    hashes = (PUINT64)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)(Fingerprint->PageCount * sizeof(UINT64)));
+    Fingerprint->Sketch = (PUINT64)HeapAlloc(GetProcessHeap(), 0, PAGE_FINGERPRINT_SKETCH_SIZE * sizeof(UINT64));
+    if ((hashes == nullptr) || (Fingerprint->Sketch == nullptr))
+    {
+        if (hashes != nullptr)
+        {
+            HeapFree(GetProcessHeap(), 0, hashes);
+        }
+        return E_OUTOFMEMORY;
+    }
+
+    for (UINT64 index = 0; index < Fingerprint->PageCount; index++)
+    {
+        if (Fingerprint->Hashes[index] != zeroHash)
+        {
+            hashes[count++] = Fingerprint->Hashes[index];
+        }
+    }
+
+    qsort(hashes, (size_t)count, sizeof(UINT64), CompareHash);
+
+    for (UINT64 index = 0; (index < count) && (sketchCount < PAGE_FINGERPRINT_SKETCH_SIZE); index++)
+    {
+        if ((sketchCount == 0) || (hashes[index] != Fingerprint->Sketch[sketchCount - 1]))
+        {
+            Fingerprint->Sketch[sketchCount++] = hashes[index];
+        }
+    }
+
+    Fingerprint->SketchCount = sketchCount;
+    HeapFree(GetProcessHeap(), 0, hashes);
+
+    return S_OK;
+}
+
+
+//
+// Index of the run holding Page, or RunCount. Runs must be sorted.
+//
+static UINT32
+FindRun(
+    _In_    const PAGE_FINGERPRINT *Fingerprint,
+    _In_    UINT64 Page
+)
+{
+    UINT32      low = 0;
+    UINT32      high = Fingerprint->RunCount;
+    UINT32      middle = 0;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (Page < Fingerprint->Runs[middle].BasePage)
+        {
+            high = middle;
+        }
+        else if (Page - Fingerprint->Runs[middle].BasePage >= Fingerprint->Runs[middle].PageCount)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return middle;
+        }
+    }
+
+    return Fingerprint->RunCount;
+}
+
+
+static HRESULT
+BuildRunExtents(
+    _In_    const PAGE_FINGERPRINT *Fingerprint,
+    _Out_   PEXTENT_SET Extents
+)
+{
+    HRESULT     hr = S_OK;
+
+    ExtentSetInit(Extents);
+
+    for (UINT32 index = 0; index < Fingerprint->RunCount; index++)
+    {
+        hr = ExtentSetAppend(Extents,
+                             Fingerprint->Runs[index].BasePage << PAGE_FINGERPRINT_PAGE_SHIFT,
+                             Fingerprint->Runs[index].PageCount << PAGE_FINGERPRINT_PAGE_SHIFT,
+                             index);
+        if (FAILED(hr))
+        {
+            ExtentSetFree(Extents);
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  UINT64 HashPage(_In_reads_bytes_(PAGE_FINGERPRINT_PAGE_SIZE) const VOID *Page)
+**
+**  xxHash64 (seed 0) of one 4 KB page. The four accumulators are independent,
+**  so the compiler keeps them in registers and interleaves the multiplies; on
+**  x64 this runs at several GB/s without any intrinsics, and the result is the
+**  same on every architecture.
+**
+*****************************************************************************************/
+UINT64
+HashPage(
+    _In_reads_bytes_(PAGE_FINGERPRINT_PAGE_SIZE) const VOID *Page
+)
+{
+    const UCHAR *data = (const UCHAR *)Page;
+    UINT64      lane[4] = { 0 };
+    UINT64      v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    UINT64      v2 = XXH_PRIME64_2;
+    UINT64      v3 = 0;
+    UINT64      v4 = 0 - XXH_PRIME64_1;
+    UINT64      hash = 0;
+
+    for (UINT32 offset = 0; offset < PAGE_FINGERPRINT_PAGE_SIZE; offset += sizeof(lane))
+    {
+        memcpy(lane, data + offset, sizeof(lane));
+        v1 = XxhRound(v1, lane[0]);
+        v2 = XxhRound(v2, lane[1]);
+        v3 = XxhRound(v3, lane[2]);
+        v4 = XxhRound(v4, lane[3]);
+    }
+
+    hash = RotateLeft64(v1, 1) + RotateLeft64(v2, 7) + RotateLeft64(v3, 12) + RotateLeft64(v4, 18);
+    hash = XxhMergeRound(hash, v1);
+    hash = XxhMergeRound(hash, v2);
+    hash = XxhMergeRound(hash, v3);
+    hash = XxhMergeRound(hash, v4);
+    hash += PAGE_FINGERPRINT_PAGE_SIZE;
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
+/****************************************************************************************
+**  VOID PageFingerprintFree(_Inout_ PPAGE_FINGERPRINT Fingerprint)
+**
+**  Releases the arrays of a fingerprint and leaves it empty.
+**
+*****************************************************************************************/
+VOID
+PageFingerprintFree(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint
+)
+{
+    if (Fingerprint->Runs != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, Fingerprint->Runs);
+    }
+
+    if (Fingerprint->Hashes != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, Fingerprint->Hashes);
+    }
+
+    if (Fingerprint->Sketch != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, Fingerprint->Sketch);
+    }
+
+    ZeroMemory(Fingerprint, sizeof(PAGE_FINGERPRINT));
+}
+
+
+/****************************************************************************************
+**  HRESULT PageFingerprintAddPages(
+**              _Inout_ PPAGE_FINGERPRINT Fingerprint,
+**              _In_    UINT64 PhysicalAddress,
+**              _In_reads_bytes_(Length) const VOID *Data,
+**              _In_    UINT64 Length,
+**              _In_    PAGE_FINGERPRINT_REGION Region
+**          )
+**
+**  Hashes the pages of Data, which hold physical memory from PhysicalAddress on.
+**  Pages that follow on from the previous call in the same region extend its
+**  run, so converting a dump one buffer at a time still yields one run per
+**  memory range. Calls may come in any address order.
+**
+**  Return Value:
+**      E_INVALIDARG if PhysicalAddress or Length are not page aligned.
+**
+*****************************************************************************************/
+HRESULT
+PageFingerprintAddPages(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint,
+    _In_    UINT64 PhysicalAddress,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_    UINT64 Length,
+    _In_    PAGE_FINGERPRINT_REGION Region
+)
+{
+    HRESULT                 hr = S_OK;
+    const UCHAR             *data = (const UCHAR *)Data;
+    UINT64                  basePage = PhysicalAddress >> PAGE_FINGERPRINT_PAGE_SHIFT;
+    UINT64                  pageCount = Length >> PAGE_FINGERPRINT_PAGE_SHIFT;
+    UINT64                  capacity = 0;
+    PPAGE_FINGERPRINT_RUN   last = nullptr;
+
+    if (((PhysicalAddress | Length) & (PAGE_FINGERPRINT_PAGE_SIZE - 1)) != 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (pageCount == 0)
+    {
+        return S_OK;
+    }
+
+    hr = GrowArray((PVOID *)&Fingerprint->Hashes, &Fingerprint->HashCapacity,
+                   Fingerprint->PageCount + pageCount, PAGE_FINGERPRINT_INITIAL_PAGES, sizeof(UINT64));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (Fingerprint->RunCount > 0)
+    {
+        last = &Fingerprint->Runs[Fingerprint->RunCount - 1];
+    }
+
+    if ((last == nullptr) ||
+        (last->Region != (UINT32)Region) ||
+        (last->BasePage + last->PageCount != basePage) ||
+        (last->HashIndex + last->PageCount != Fingerprint->PageCount))
+    {
+        capacity = Fingerprint->RunCapacity;
+        hr = GrowArray((PVOID *)&Fingerprint->Runs, &capacity,
+                       (UINT64)Fingerprint->RunCount + 1, PAGE_FINGERPRINT_INITIAL_RUNS, sizeof(PAGE_FINGERPRINT_RUN));
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (capacity > MAXUINT32)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+
+        Fingerprint->RunCapacity = (UINT32)capacity;
+
+        last = &Fingerprint->Runs[Fingerprint->RunCount++];
+        ZeroMemory(last, sizeof(PAGE_FINGERPRINT_RUN));
+        last->BasePage = basePage;
+        last->HashIndex = Fingerprint->PageCount;
+        last->Region = (UINT32)Region;
+    }
+
+    for (UINT64 page = 0; page < pageCount; page++)
+    {
+        Fingerprint->Hashes[Fingerprint->PageCount++] = HashPage(data + (page << PAGE_FINGERPRINT_PAGE_SHIFT));
+    }
+
+    last->PageCount += pageCount;
+
+    return S_OK;
+}
+
+
+/****************************************************************************************
+**  HRESULT PageFingerprintWrite(
+**              _Inout_ PPAGE_FINGERPRINT Fingerprint,
+**              _In_    LPCWSTR Path
+**          )
+**
+**  Sorts the runs, builds the sketch and writes the fingerprint to Path.
+**
+**  Return Value:
+**      ERROR_INVALID_DATA if two runs cover the same page.
+**
+*****************************************************************************************/
+HRESULT
+PageFingerprintWrite(
+    _Inout_ PPAGE_FINGERPRINT Fingerprint,
+    _In_    LPCWSTR Path
+)
+{
+    HRESULT                 hr = S_OK;
+    HANDLE                  file = INVALID_HANDLE_VALUE;
+    PAGE_FINGERPRINT_HEADER header = { 0 };
+
+    qsort(Fingerprint->Runs, Fingerprint->RunCount, sizeof(PAGE_FINGERPRINT_RUN), CompareRunByBase);
+
+    for (UINT32 index = 1; index < Fingerprint->RunCount; index++)
+    {
+        if (Fingerprint->Runs[index - 1].BasePage + Fingerprint->Runs[index - 1].PageCount > Fingerprint->Runs[index].BasePage)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    hr = BuildSketch(Fingerprint);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    header.Signature = PAGE_FINGERPRINT_SIGNATURE;
+    header.Version = PAGE_FINGERPRINT_VERSION;
+    header.HeaderSize = sizeof(PAGE_FINGERPRINT_HEADER);
+    header.RunCount = Fingerprint->RunCount;
+    header.SketchCount = Fingerprint->SketchCount;
+    header.PageCount = Fingerprint->PageCount;
+    header.HeaderCrc = ComputeCrc32(&header, sizeof(header), 0);
+
+    file = CreateFileW(Path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    hr = TransferFile(file, &header, sizeof(header), TRUE);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = TransferFile(file, Fingerprint->Runs, (UINT64)Fingerprint->RunCount * sizeof(PAGE_FINGERPRINT_RUN), TRUE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = TransferFile(file, Fingerprint->Sketch, (UINT64)Fingerprint->SketchCount * sizeof(UINT64), TRUE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = TransferFile(file, Fingerprint->Hashes, Fingerprint->PageCount * sizeof(UINT64), TRUE);
+    }
+
+    CloseHandle(file);
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(Path);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  HRESULT PageFingerprintRead(
+**              _In_    LPCWSTR Path,
+**              _Out_   PPAGE_FINGERPRINT Fingerprint
+**          )
+**
+**  Reads a fingerprint written by PageFingerprintWrite and checks that its runs
+**  are sorted, do not overlap and only reference hashes present in the file.
+**
+*****************************************************************************************/
+HRESULT
+PageFingerprintRead(
+    _In_    LPCWSTR Path,
+    _Out_   PPAGE_FINGERPRINT Fingerprint
+)
+{
+    HRESULT                 hr = S_OK;
+    HANDLE                  file = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER           fileSize = { 0 };
+    PAGE_FINGERPRINT_HEADER header = { 0 };
+    UINT32                  headerCrc = 0;
+    UINT64                  expectedSize = 0;
+    PPAGE_FINGERPRINT_RUN   run = nullptr;
+
+    ZeroMemory(Fingerprint, sizeof(PAGE_FINGERPRINT));
+
+    file = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    hr = TransferFile(file, &header, sizeof(header), FALSE);
+    if (FAILED(hr))
+    {
+        goto Exit;
+    }
+
+    headerCrc = header.HeaderCrc;
+    header.HeaderCrc = 0;
+
+    if ((header.Signature != PAGE_FINGERPRINT_SIGNATURE) ||
+        (header.Version != PAGE_FINGERPRINT_VERSION) ||
+        (header.HeaderSize != sizeof(PAGE_FINGERPRINT_HEADER)) ||
+        (ComputeCrc32(&header, sizeof(header), 0) != headerCrc) ||
+        (header.SketchCount > PAGE_FINGERPRINT_SKETCH_SIZE) ||
+        (header.PageCount > ((UINT64)fileSize.QuadPart / sizeof(UINT64))))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        goto Exit;
+    }
+
+    expectedSize = sizeof(header) +
+                   (UINT64)header.RunCount * sizeof(PAGE_FINGERPRINT_RUN) +
+                   (UINT64)header.SketchCount * sizeof(UINT64) +
+                   header.PageCount * sizeof(UINT64);
+    if (expectedSize != (UINT64)fileSize.QuadPart)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        goto Exit;
+    }
+
+    Fingerprint->Runs = (PPAGE_FINGERPRINT_RUN)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)header.RunCount * sizeof(PAGE_FINGERPRINT_RUN) + 1);
+    Fingerprint->Sketch = (PUINT64)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)header.SketchCount * sizeof(UINT64) + 1);
+    Fingerprint->Hashes = (PUINT64)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)(header.PageCount * sizeof(UINT64)) + 1);
+    if ((Fingerprint->Runs == nullptr) || (Fingerprint->Sketch == nullptr) || (Fingerprint->Hashes == nullptr))
+    {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    Fingerprint->RunCount = Fingerprint->RunCapacity = header.RunCount;
+    Fingerprint->SketchCount = header.SketchCount;
+    Fingerprint->PageCount = Fingerprint->HashCapacity = header.PageCount;
+
+    hr = TransferFile(file, Fingerprint->Runs, (UINT64)header.RunCount * sizeof(PAGE_FINGERPRINT_RUN), FALSE);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = TransferFile(file, Fingerprint->Sketch, (UINT64)header.SketchCount * sizeof(UINT64), FALSE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = TransferFile(file, Fingerprint->Hashes, header.PageCount * sizeof(UINT64), FALSE);
+    }
+
+    if (FAILED(hr))
+    {
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < Fingerprint->RunCount; index++)
+    {
+        run = &Fingerprint->Runs[index];
+
+        if ((run->PageCount == 0) ||
+            (run->PageCount > header.PageCount) ||
+            (run->HashIndex > header.PageCount - run->PageCount) ||
+            (run->BasePage > (MAXULONGLONG >> PAGE_FINGERPRINT_PAGE_SHIFT) - run->PageCount) ||
+            ((index > 0) && (run[-1].BasePage + run[-1].PageCount > run->BasePage)))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            goto Exit;
+        }
+    }
+
+Exit:
+
+    CloseHandle(file);
+
+    if (FAILED(hr))
+    {
+        PageFingerprintFree(Fingerprint);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************
+**  UINT32 PageFingerprintSimilarity(
+**              _In_    const PAGE_FINGERPRINT *First,
+**              _In_    const PAGE_FINGERPRINT *Second
+**          )
+**
+**  Estimates, in percent, the Jaccard similarity of the distinct non-zero pages
+**  of two fingerprints: the share of the smallest hashes of the union of both
+**  sketches that appear in both. Only the sketches are read, so a new dump can
+**  be ranked against many earlier ones at the cost of a few hundred compares
+**  each.
+**
+*****************************************************************************************/
+UINT32
+PageFingerprintSimilarity(
+    _In_    const PAGE_FINGERPRINT *First,
+    _In_    const PAGE_FINGERPRINT *Second
+)
+{
+    UINT32      indexFirst = 0;
+    UINT32      indexSecond = 0;
+    UINT32      taken = 0;
+    UINT32      shared = 0;
+
+    while ((taken < PAGE_FINGERPRINT_SKETCH_SIZE) &&
+           ((indexFirst < First->SketchCount) || (indexSecond < Second->SketchCount)))
+    {
+        if ((indexFirst < First->SketchCount) && (indexSecond < Second->SketchCount) &&
+            (First->Sketch[indexFirst] == Second->Sketch[indexSecond]))
+        {
+            shared++;
+            indexFirst++;
+            indexSecond++;
+        }
+        else if ((indexSecond == Second->SketchCount) ||
+                 ((indexFirst < First->SketchCount) && (First->Sketch[indexFirst] < Second->Sketch[indexSecond])))
+        {
+            indexFirst++;
+        }
+        else
+        {
+            indexSecond++;
+        }
+
+        taken++;
+    }
+
+    return (taken == 0) ? 0 : (shared * 100) / taken;
+}
+
+
+/****************************************************************************************
+**  HRESULT PageFingerprintDiff(
+**              _In_    const PAGE_FINGERPRINT *First,
+**              _In_    const PAGE_FINGERPRINT *Second,
+**              _Out_   PEXTENT_SET Differences
+**          )
+**
+**  Differences receives the coalesced physical address ranges whose pages are
+**  present in only one of the fingerprints or hash differently in the two.
+**  Both fingerprints must have sorted runs, as written or read.
+**
+*****************************************************************************************/
+HRESULT
+PageFingerprintDiff(
+    _In_    const PAGE_FINGERPRINT *First,
+    _In_    const PAGE_FINGERPRINT *Second,
+    _Out_   PEXTENT_SET Differences
+)
+{
+    HRESULT         hr = S_OK;
+    EXTENT_SET      extentsFirst = { 0 };
+    EXTENT_SET      extentsSecond = { 0 };
+    EXTENT_SET      common = { 0 };
+    EXTENT_SET      onlyFirst = { 0 };
+    EXTENT_SET      onlySecond = { 0 };
+    EXTENT_SET      missing = { 0 };
+    EXTENT_SET      changed = { 0 };
+    const PAGE_FINGERPRINT_RUN *runFirst = nullptr;
+    const PAGE_FINGERPRINT_RUN *runSecond = nullptr;
+    UINT32          indexSecond = 0;
+    UINT64          page = 0;
+    UINT64          lastPage = 0;
+    UINT64          changedBase = 0;
+    UINT64          changedCount = 0;
+
+    ExtentSetInit(Differences);
+
+    hr = BuildRunExtents(First, &extentsFirst);
+    if (SUCCEEDED(hr))
+    {
+        hr = BuildRunExtents(Second, &extentsSecond);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ExtentSetIntersect(&extentsFirst, &extentsSecond, &common);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ExtentSetDifference(&extentsFirst, &extentsSecond, &onlyFirst);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ExtentSetDifference(&extentsSecond, &extentsFirst, &onlySecond);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ExtentSetUnion(&onlyFirst, &onlySecond, &missing);
+    }
+
+    //
+    // Every common extent lies within one run of First (its Tag) and, as runs
+    // do not overlap, within one run of Second.
+    //
+    for (UINT32 index = 0; SUCCEEDED(hr) && (index < common.Count); index++)
+    {
+        page = common.Extents[index].Base >> PAGE_FINGERPRINT_PAGE_SHIFT;
+        lastPage = common.Extents[index].End >> PAGE_FINGERPRINT_PAGE_SHIFT;
+        runFirst = &First->Runs[common.Extents[index].Tag];
+
+        indexSecond = FindRun(Second, page);
+        if (indexSecond == Second->RunCount)
+        {
+            hr = E_UNEXPECTED;
+            break;
+        }
+        runSecond = &Second->Runs[indexSecond];
+
+        for (; page <= lastPage; page++)
+        {
+            if (First->Hashes[runFirst->HashIndex + (page - runFirst->BasePage)] !=
+                Second->Hashes[runSecond->HashIndex + (page - runSecond->BasePage)])
+            {
+                if ((changedCount > 0) && (changedBase + changedCount == page))
+                {
+                    changedCount++;
+                    continue;
+                }
+
+                if (changedCount > 0)
+                {
+                    hr = ExtentSetAppend(&changed, changedBase << PAGE_FINGERPRINT_PAGE_SHIFT, changedCount << PAGE_FINGERPRINT_PAGE_SHIFT, 0);
+                    if (FAILED(hr))
+                    {
+                        break;
+                    }
+                }
+
+                changedBase = page;
+                changedCount = 1;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr) && (changedCount > 0))
+    {
+        hr = ExtentSetAppend(&changed, changedBase << PAGE_FINGERPRINT_PAGE_SHIFT, changedCount << PAGE_FINGERPRINT_PAGE_SHIFT, 0);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ExtentSetUnion(&missing, &changed, Differences);
+    }
+
+    ExtentSetFree(&extentsFirst);
+    ExtentSetFree(&extentsSecond);
+    ExtentSetFree(&common);
+    ExtentSetFree(&onlyFirst);
+    ExtentSetFree(&onlySecond);
+    ExtentSetFree(&missing);
+    ExtentSetFree(&changed);
+
+    return hr;
+}
@@ -1592,47 +1592,1294 @@ UINT Test_Open_Partition_Position_Read_Write_Chunk (DEVICE_IO *pIn, wstring devN
     return failCount;
 }
 
+//    UINT        Test_Overlay_File(DEVICE_IO *pIn, wstring baseName, wstring deltaName)
+UINT Test_Overlay_File(DEVICE_IO *pIn, wstring baseName, wstring deltaName)
+{
+    UINT        failCount = 0;
+    DEVICE_IO   baseFile(baseName);
+    CHAR        original[TEST_OVERLAY_SPAN] = { 0 };
+    CHAR        expected[TEST_OVERLAY_SPAN] = { 0 };
+    CHAR        actual[TEST_OVERLAY_SPAN] = { 0 };
+    CHAR        patch[TEST_OVERLAY_PATCH_SIZE];
+    LARGE_INTEGER offset;
+    size_t      bytesWritten = 0;
+
+    // The span read back starts before the patch, which crosses a block boundary
+    offset.QuadPart = TEST_OVERLAY_PATCH_OFFSET - (TEST_OVERLAY_SPAN - TEST_OVERLAY_PATCH_SIZE) / 2;
+    memset(patch, 'P', sizeof patch);
+
+    if ( SUCCEEDED(baseFile.Open())
+         && SUCCEEDED(baseFile.ReadAtOffset(original, sizeof original, offset, DEVICE_IO::READ_EXACT)) )
+    {
+        printf("\t\t   Base Read(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t   Base Read(): FAILED (Error: %#x)\r\n", baseFile.GetError());
+        failCount++;
+    }
+
+    baseFile.Close();
+    memcpy(expected, original, sizeof expected);
+    memcpy(&expected[TEST_OVERLAY_PATCH_OFFSET - offset.QuadPart], patch, sizeof patch);
+
+    // Start from an empty delta
+    DeleteFileW(deltaName.c_str());
+    if ( SUCCEEDED(pIn->OpenOverlay(baseName, deltaName))
+         && (DEVICE_IO::OVERLAY_FILE_DEVICE_TYPE == pIn->GetDeviceType())
+         && (0 == pIn->GetOverlayBlockCount()) )
+    {
+        printf("\t\t  OpenOverlay(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t  OpenOverlay(): FAILED (Error: %#x)\r\n", pIn->GetError());
+        failCount++;
+    }
+
+    // Unpatched, the view reads as the base
+    if ( SUCCEEDED(pIn->ReadAtOffset(actual, sizeof actual, offset, DEVICE_IO::READ_EXACT))
+         && (0 == memcmp(actual, original, sizeof actual)) )
+    {
+        printf("\t\t         Read(): PASSED - unpatched\r\n");
+    }
+    else
+    {
+        printf("\t\t         Read(): FAILED (Error: %#x) - unpatched\r\n", pIn->GetError());
+        failCount++;
+    }
+
+    if ( SUCCEEDED(pIn->SetPos((ULONGLONG)TEST_OVERLAY_PATCH_OFFSET))
+         && SUCCEEDED(pIn->Write(patch, sizeof patch, &bytesWritten))
+         && (sizeof patch == bytesWritten)
+         && (2 == pIn->GetOverlayBlockCount()) )
+    {
+        printf("\t\t        Write(): PASSED - patch over a block boundary\r\n");
+    }
+    else
+    {
+        printf("\t\t        Write(): FAILED (Error: %#x) (Blocks: %d)\r\n", pIn->GetError(), pIn->GetOverlayBlockCount());
+        failCount++;
+    }
+
+    if ( SUCCEEDED(pIn->ReadAtOffset(actual, sizeof actual, offset, DEVICE_IO::READ_EXACT))
+         && (0 == memcmp(actual, expected, sizeof actual)) )
+    {
+        printf("\t\t         Read(): PASSED - patched\r\n");
+    }
+    else
+    {
+        printf("\t\t         Read(): FAILED (Error: %#x) - patched\r\n", pIn->GetError());
+        failCount++;
+    }
+
+    // The delta is picked up again on the next open
+    pIn->Close();
+    if ( SUCCEEDED(pIn->OpenOverlay(baseName, deltaName))
+         && (2 == pIn->GetOverlayBlockCount())
+         && SUCCEEDED(pIn->ReadAtOffset(actual, sizeof actual, offset, DEVICE_IO::READ_EXACT))
+         && (0 == memcmp(actual, expected, sizeof actual)) )
+    {
+        printf("\t\t  OpenOverlay(): PASSED - reopened delta\r\n");
+    }
+    else
+    {
+        printf("\t\t  OpenOverlay(): FAILED (Error: %#x) - reopened delta\r\n", pIn->GetError());
+        failCount++;
+    }
+
+    pIn->Close();
+
+    // The base is never written
+    if ( SUCCEEDED(baseFile.Open())
+         && SUCCEEDED(baseFile.ReadAtOffset(actual, sizeof actual, offset, DEVICE_IO::READ_EXACT))
+         && (0 == memcmp(actual, original, sizeof actual)) )
+    {
+        printf("\t\t   Base Read(): PASSED - base unchanged\r\n");
+    }
+    else
+    {
+        printf("\t\t   Base Read(): FAILED (Error: %#x) - base unchanged\r\n", baseFile.GetError());
+        failCount++;
+    }
+
+    baseFile.Close();
+    DeleteFileW(deltaName.c_str());
+
+    return failCount;
+}
+
 //    UINT        Test_Device_Specific(DEVICE_IO *pIn, wstring devName, UINT devID)
 UINT Test_Device_Specific(DEVICE_IO *pIn, wstring devName, UINT devID)
 {
     UNREFERENCED_PARAMETER(devID);
 
     UINT        failCount = 0;
-    ULONGLONG   size = pIn->GetCurrentFileSize();
+    ULONGLONG   size = pIn->GetCurrentFileSize();
+
+    // remove the file if it already exists
+    if (0 != size )
+    {
+        pIn->Close();
+        DeleteFileW(devName.c_str());
+    }
+
+    //  This open should occur on an empty or a non-existing file
+    if ( FAILED(pIn->Open(devName))
+         && (DEVICE_IO::IO_ERROR_ALREADY_OPENED != pIn->GetError())
+       )
+    {
+        printf("\t\t         Open(): FAILED (Error: %#x)\r\n", pIn->GetError());
+        failCount++;
+    }
+    else
+    {
+        size = pIn->GetCurrentFileSize();
+
+        if (DEVICE_IO::PLAIN_FILE_DEVICE_TYPE == (pIn->GetDeviceType()) )
+        {
+            failCount = Test_Write_Read_Device_Specific(pIn);
+            size = pIn->GetCurrentFileSize();
+        }
+        else
+        {
+            failCount++;
+        }
+
+        pIn->Close();
+
+    }
+
+    return failCount;
+}
+
+//    UINT        Test_Batch_Read(DEVICE_IO *pIn, wstring devName)
+UINT Test_Batch_Read(DEVICE_IO *pIn, wstring devName)
+{
+    UINT                failCount = 0;
+    PCHAR               pattern = nullptr;
+    size_t              bytesWritten = 0;
+    CRITICAL_SECTION    lock;
+    CHAR                buffers[3][TEST_BATCH_REQUEST_SIZE];
+    BATCH_READ_REQUEST  requests[3];
+
+    // Two extents that are contiguous in PA but not in the file
+    const PHYSICAL_EXTENT extents[] =
+    {
+        { TEST_BATCH_BASE,          0x3000, 0x1000 },
+        { TEST_BATCH_BASE + 0x3000, 0x2000, 0x6000 },
+    };
+
+    // Start from a file that holds the test pattern
+    DeleteFileW(devName.c_str());
+    pattern = (PCHAR)HeapAlloc(GetProcessHeap(), 0, TEST_BATCH_FILE_SIZE);
+    if (nullptr != pattern)
+    {
+        for (ULONG i = 0; i < TEST_BATCH_FILE_SIZE; i++)
+        {
+            pattern[i] = OFFSET2VALUE(i);
+        }
+    }
+
+    if ( (nullptr != pattern)
+         && SUCCEEDED(pIn->Open(devName))
+         && SUCCEEDED(pIn->Write(pattern, TEST_BATCH_FILE_SIZE, &bytesWritten))
+         && (TEST_BATCH_FILE_SIZE == bytesWritten) )
+    {
+        printf("\t\t        Write(): PASSED - batch pattern\r\n");
+    }
+    else
+    {
+        printf("\t\t        Write(): FAILED (Error: %#x) - batch pattern\r\n", pIn->GetError());
+        failCount++;
+    }
+
+    if (nullptr != pattern)
+    {
+        HeapFree(GetProcessHeap(), 0, pattern);
+    }
+
+    if (0 != failCount)
+    {
+        pIn->Close();
+        DeleteFileW(devName.c_str());
+        return failCount;
+    }
+
+    // Adjacent requests are satisfied by one read
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x100, 0x80, buffers[0]);
+    BATCH_READ_REQUEST_INIT(requests[1], TEST_BATCH_BASE + 0x180, 0x80, buffers[1]);
+    if ( SUCCEEDED(ReadPhysicalBatch(pIn, nullptr, extents, ARRAYSIZE(extents), requests, 2))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[1]) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - adjacent\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Results: %#x %#x) - adjacent\r\n", requests[0].Result, requests[1].Result);
+        failCount++;
+    }
+
+    // Overlapping requests each get their own copy of the shared bytes
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x400, 0x100, buffers[0]);
+    BATCH_READ_REQUEST_INIT(requests[1], TEST_BATCH_BASE + 0x480, 0x100, buffers[1]);
+    if ( SUCCEEDED(ReadPhysicalBatch(pIn, nullptr, extents, ARRAYSIZE(extents), requests, 2))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[1]) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - overlapping\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Results: %#x %#x) - overlapping\r\n", requests[0].Result, requests[1].Result);
+        failCount++;
+    }
+
+    // Requests given in descending order land in the caller's buffers
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x2000, 0x40, buffers[0]);
+    BATCH_READ_REQUEST_INIT(requests[1], TEST_BATCH_BASE + 0x1000, 0x40, buffers[1]);
+    BATCH_READ_REQUEST_INIT(requests[2], TEST_BATCH_BASE + 0x0800, 0x40, buffers[2]);
+    if ( SUCCEEDED(ReadPhysicalBatch(pIn, nullptr, extents, ARRAYSIZE(extents), requests, 3))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[1])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[2]) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - out of order\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Results: %#x %#x %#x) - out of order\r\n", requests[0].Result, requests[1].Result, requests[2].Result);
+        failCount++;
+    }
+
+    // A request that crosses into the next DDR section is split between two file ranges
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x2F80, 0x100, buffers[0]);
+    if ( SUCCEEDED(ReadPhysicalBatch(pIn, nullptr, extents, ARRAYSIZE(extents), requests, 1))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0]) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - crosses a DDR section\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Result: %#x) - crosses a DDR section\r\n", requests[0].Result);
+        failCount++;
+    }
+
+    // An unbacked request fails on its own, the others are still read
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x200, 0x40, buffers[0]);
+    BATCH_READ_REQUEST_INIT(requests[1], TEST_BATCH_BASE + 0x5000, 0x40, buffers[1]);
+    if ( (HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS) == ReadPhysicalBatch(pIn, nullptr, extents, ARRAYSIZE(extents), requests, 2))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0])
+         && (HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS) == requests[1].Result) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - unbacked address\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Results: %#x %#x) - unbacked address\r\n", requests[0].Result, requests[1].Result);
+        failCount++;
+    }
+
+    // Same reads under a caller supplied lock
+    InitializeCriticalSection(&lock);
+    memset(buffers, 0, sizeof buffers);
+    BATCH_READ_REQUEST_INIT(requests[0], TEST_BATCH_BASE + 0x4000, 0x40, buffers[0]);
+    BATCH_READ_REQUEST_INIT(requests[1], TEST_BATCH_BASE + 0x2F80, 0x100, buffers[1]);
+    BATCH_READ_REQUEST_INIT(requests[2], TEST_BATCH_BASE + 0x0100, 0x80, buffers[2]);
+    if ( SUCCEEDED(ReadPhysicalBatch(pIn, &lock, extents, ARRAYSIZE(extents), requests, 3))
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[0])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[1])
+         && ValidateBatchRequest(extents, ARRAYSIZE(extents), &requests[2]) )
+    {
+        printf("\t\tReadPhysicalBatch(): PASSED - with lock\r\n");
+    }
+    else
+    {
+        printf("\t\tReadPhysicalBatch(): FAILED (Results: %#x %#x %#x) - with lock\r\n", requests[0].Result, requests[1].Result, requests[2].Result);
+        failCount++;
+    }
+
+    DeleteCriticalSection(&lock);
+
+    pIn->Close();
+    DeleteFileW(devName.c_str());
+
+    return failCount;
+}
+
+//    UINT        Test_Chunked_Section(DEVICE_IO *pIn, wstring devName)
+UINT Test_Chunked_Section(DEVICE_IO *pIn, wstring devName)
+{
+    UINT                        failCount = 0;
+    HRESULT                     hr = S_OK;
+    PUCHAR                      expected = nullptr;
+    PUCHAR                      stored = nullptr;
+    PUCHAR                      actual = nullptr;
+    PVOID                       workspace = nullptr;
+    UINT32                      workspaceSize = 0;
+    UINT64                      dataSize = 0;
+    size_t                      bytesProcessed = 0;
+    PCHUNKED_SECTION            section = nullptr;
+    RAW_DUMP_CHUNK_INDEX_HEADER header = { 0 };
+    RAW_DUMP_CHUNK_ENTRY        entries[TEST_CHUNK_COUNT] = { 0 };
+
+    expected = (PUCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, TEST_CHUNK_SECTION_SIZE);
+    stored = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, TEST_CHUNK_COUNT * TEST_CHUNK_SIZE);
+    actual = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, TEST_CHUNK_SECTION_SIZE);
+
+    if (SUCCEEDED(hr = GetChunkWorkspaceSize(&workspaceSize)))
+    {
+        workspace = HeapAlloc(GetProcessHeap(), 0, workspaceSize);
+    }
+
+    if ((nullptr == expected) || (nullptr == stored) || (nullptr == actual) || (nullptr == workspace))
+    {
+        printf("\t\t    Allocate(): FAILED (Error: %#x)\r\n", FAILED(hr) ? hr : E_OUTOFMEMORY);
+        failCount++;
+        goto Exit;
+    }
+
+    // Chunk 0 holds the pattern, chunk 1 is all zero and the last chunk is short
+    for (UINT32 i = 0; i < TEST_CHUNK_SIZE; i++)
+    {
+        expected[i] = OFFSET2VALUE(i);
+    }
+
+    for (UINT32 i = 2 * TEST_CHUNK_SIZE; i < TEST_CHUNK_SECTION_SIZE; i++)
+    {
+        expected[i] = OFFSET2VALUE(i);
+    }
+
+    for (UINT32 chunk = 0; chunk < TEST_CHUNK_COUNT; chunk++)
+    {
+        UINT32 length = min(TEST_CHUNK_SIZE, TEST_CHUNK_SECTION_SIZE - (chunk * TEST_CHUNK_SIZE));
+
+        if (FAILED(hr = EncodeChunk(&expected[chunk * TEST_CHUNK_SIZE], length, stored + dataSize, workspace, &entries[chunk])))
+        {
+            break;
+        }
+
+        entries[chunk].Offset = dataSize;
+        dataSize += entries[chunk].StoredSize;
+    }
+
+    if ( SUCCEEDED(hr)
+         && (RAW_DUMP_CHUNK_ENCODING_ZERO == entries[1].Encoding)
+         && (0 == entries[1].StoredSize) )
+    {
+        printf("\t\t  EncodeChunk(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t  EncodeChunk(): FAILED (Error: %#x) (Zero chunk encoding: %d)\r\n", hr, entries[1].Encoding);
+        failCount++;
+        goto Exit;
+    }
+
+    header.Signature = RAW_DUMP_CHUNK_INDEX_SIGNATURE;
+    header.Version = RAW_DUMP_CHUNK_INDEX_VERSION;
+    header.ChunkSize = TEST_CHUNK_SIZE;
+    header.ChunkCount = TEST_CHUNK_COUNT;
+    header.DataSize = dataSize;
+    header.EntriesCrc = ComputeCrc32(entries, sizeof entries, 0);
+
+    // The chunk count must cover the section, including the short last chunk
+    if ( SUCCEEDED(ValidateChunkIndex(&header, entries, TEST_CHUNK_SECTION_SIZE))
+         && SUCCEEDED(ValidateChunkIndex(&header, entries, (2 * TEST_CHUNK_SIZE) + 1))
+         && (HRESULT_FROM_WIN32(ERROR_INVALID_DATA) == ValidateChunkIndex(&header, entries, 2 * TEST_CHUNK_SIZE))
+         && (HRESULT_FROM_WIN32(ERROR_INVALID_DATA) == ValidateChunkIndex(&header, entries, TEST_CHUNK_SECTION_SIZE + TEST_CHUNK_SIZE)) )
+    {
+        printf("\t\tValidateChunkIndex(): PASSED - chunk count\r\n");
+    }
+    else
+    {
+        printf("\t\tValidateChunkIndex(): FAILED - chunk count\r\n");
+        failCount++;
+    }
+
+    // A changed entry no longer matches the CRC of the index
+    entries[0].StoredSize++;
+    if (HRESULT_FROM_WIN32(ERROR_INVALID_DATA) == ValidateChunkIndex(&header, entries, TEST_CHUNK_SECTION_SIZE))
+    {
+        printf("\t\tValidateChunkIndex(): PASSED - corrupted entries\r\n");
+    }
+    else
+    {
+        printf("\t\tValidateChunkIndex(): FAILED - corrupted entries\r\n");
+        failCount++;
+    }
+
+    entries[0].StoredSize--;
+
+    // Write the index and the chunk data after some leading bytes
+    DeleteFileW(devName.c_str());
+    if ( SUCCEEDED(pIn->Open(devName))
+         && SUCCEEDED(pIn->SetPos((ULONGLONG)TEST_CHUNK_FILE_OFFSET))
+         && SUCCEEDED(pIn->Write((PCHAR)&header, sizeof header, &bytesProcessed))
+         && SUCCEEDED(pIn->Write((PCHAR)entries, sizeof entries, &bytesProcessed))
+         && SUCCEEDED(pIn->Write((PCHAR)stored, (size_t)dataSize, &bytesProcessed))
+         && ((size_t)dataSize == bytesProcessed) )
+    {
+        printf("\t\t        Write(): PASSED - chunk index and data\r\n");
+    }
+    else
+    {
+        printf("\t\t        Write(): FAILED (Error: %#x) - chunk index and data\r\n", pIn->GetError());
+        failCount++;
+        goto Exit;
+    }
+
+    if ( SUCCEEDED(hr = OpenChunkedSection(pIn, TEST_CHUNK_FILE_OFFSET, TEST_CHUNK_SECTION_SIZE, &section))
+         && (TEST_CHUNK_COUNT == section->Header.ChunkCount)
+         && ((TEST_CHUNK_FILE_OFFSET + RAW_DUMP_CHUNK_INDEX_SIZE(TEST_CHUNK_COUNT)) == section->DataOffset) )
+    {
+        printf("\t\tOpenChunkedSection(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\tOpenChunkedSection(): FAILED (Error: %#x)\r\n", hr);
+        failCount++;
+        goto Exit;
+    }
+
+    // The index does not cover a larger section
+    {
+        PCHUNKED_SECTION wrongSize = nullptr;
+
+        if (HRESULT_FROM_WIN32(ERROR_INVALID_DATA) == OpenChunkedSection(pIn, TEST_CHUNK_FILE_OFFSET, TEST_CHUNK_SECTION_SIZE + TEST_CHUNK_SIZE, &wrongSize))
+        {
+            printf("\t\tOpenChunkedSection(): PASSED - wrong section size\r\n");
+        }
+        else
+        {
+            printf("\t\tOpenChunkedSection(): FAILED - wrong section size\r\n");
+            failCount++;
+        }
+
+        CloseChunkedSection(wrongSize);
+    }
+
+    // Reads that cross a chunk boundary, into and out of the zero chunk
+    memset(actual, 0xCC, TEST_CHUNK_SECTION_SIZE);
+    if ( SUCCEEDED(ReadChunkedSection(section, TEST_CHUNK_SIZE - 0x80, actual, 0x100, &bytesProcessed))
+         && (0x100 == bytesProcessed)
+         && (0 == memcmp(actual, &expected[TEST_CHUNK_SIZE - 0x80], 0x100))
+         && SUCCEEDED(ReadChunkedSection(section, (2 * TEST_CHUNK_SIZE) - 0x80, actual, 0x100, &bytesProcessed))
+         && (0x100 == bytesProcessed)
+         && (0 == memcmp(actual, &expected[(2 * TEST_CHUNK_SIZE) - 0x80], 0x100)) )
+    {
+        printf("\t\tReadChunkedSection(): PASSED - crosses chunks\r\n");
+    }
+    else
+    {
+        printf("\t\tReadChunkedSection(): FAILED - crosses chunks\r\n");
+        failCount++;
+    }
+
+    // The last chunk is short, a read past the end of the section is cut short
+    memset(actual, 0xCC, TEST_CHUNK_SECTION_SIZE);
+    if ( SUCCEEDED(ReadChunkedSection(section, TEST_CHUNK_SECTION_SIZE - 0x100, actual, 0x200, &bytesProcessed))
+         && (0x100 == bytesProcessed)
+         && (0 == memcmp(actual, &expected[TEST_CHUNK_SECTION_SIZE - 0x100], 0x100))
+         && SUCCEEDED(ReadChunkedSection(section, TEST_CHUNK_SECTION_SIZE, actual, 0x10, &bytesProcessed))
+         && (0 == bytesProcessed) )
+    {
+        printf("\t\tReadChunkedSection(): PASSED - partial last chunk\r\n");
+    }
+    else
+    {
+        printf("\t\tReadChunkedSection(): FAILED - partial last chunk\r\n");
+        failCount++;
+    }
+
+    // The whole section in one read
+    memset(actual, 0xCC, TEST_CHUNK_SECTION_SIZE);
+    if ( SUCCEEDED(ReadChunkedSection(section, 0, actual, TEST_CHUNK_SECTION_SIZE, &bytesProcessed))
+         && (TEST_CHUNK_SECTION_SIZE == bytesProcessed)
+         && (0 == memcmp(actual, expected, TEST_CHUNK_SECTION_SIZE)) )
+    {
+        printf("\t\tReadChunkedSection(): PASSED - whole section\r\n");
+    }
+    else
+    {
+        printf("\t\tReadChunkedSection(): FAILED - whole section\r\n");
+        failCount++;
+    }
+
+Exit:
+    CloseChunkedSection(section);
+    pIn->Close();
+    DeleteFileW(devName.c_str());
+
+    if (nullptr != workspace)
+    {
+        HeapFree(GetProcessHeap(), 0, workspace);
+    }
+
+    if (nullptr != actual)
+    {
+        HeapFree(GetProcessHeap(), 0, actual);
+    }
+
+    if (nullptr != stored)
+    {
+        HeapFree(GetProcessHeap(), 0, stored);
+    }
+
+    if (nullptr != expected)
+    {
+        HeapFree(GetProcessHeap(), 0, expected);
+    }
+
+    return failCount;
+}
+
+//    UINT        Test_Extent_Set(void)
+UINT Test_Extent_Set(void)
+{
+    UINT        failCount = 0;
+    UINT32      holes = 0;
+    UINT32      overlaps = 0;
+    EXTENT_SET  first;
+    EXTENT_SET  second;
+    EXTENT_SET  result;
+    EXTENT_SET  empty;
+
+    ExtentSetInit(&first);
+    ExtentSetInit(&second);
+    ExtentSetInit(&result);
+    ExtentSetInit(&empty);
+
+    // // // Empty sets
+    {
+        const EXTENT some[] = { { 0x1000, 0x1FFF, 1 } };
+
+        ExtentSetCheck(&empty, &holes, &overlaps);
+        if ( (0 == holes) && (0 == overlaps)
+             && (0 == ExtentSetFind(&empty, 0x1000))
+             && (E_INVALIDARG == ExtentSetAppend(&first, 0x1000, 0, 0))
+             && (0 == first.Count)
+             && SUCCEEDED(BuildExtentSet(&first, some, ARRAYSIZE(some)))
+             && (0 == ExtentSetContains(&first, &empty))
+             && (0 == ExtentSetContains(&empty, &first)) )
+        {
+            printf("\t\tExtentSetCheck(): PASSED - empty set\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetCheck(): FAILED - empty set\r\n");
+            failCount++;
+        }
+
+        if ( SUCCEEDED(ExtentSetUnion(&empty, &empty, &result)) && ValidateExtentSet(&result, nullptr, 0)
+             && SUCCEEDED(ExtentSetCoalesce(&empty, &result)) && ValidateExtentSet(&result, nullptr, 0)
+             && SUCCEEDED(ExtentSetIntersect(&first, &empty, &result)) && ValidateExtentSet(&result, nullptr, 0)
+             && SUCCEEDED(ExtentSetDifference(&empty, &first, &result)) && ValidateExtentSet(&result, nullptr, 0)
+             && SUCCEEDED(ExtentSetDifference(&first, &empty, &result)) && ValidateExtentSet(&result, some, ARRAYSIZE(some))
+             && (ExtentSetFree(&result), SUCCEEDED(ExtentSetUnion(&empty, &first, &result)))
+             && ValidateExtentSet(&result, some, ARRAYSIZE(some)) )
+        {
+            printf("\t\tExtentSetUnion/Intersect/Difference(): PASSED - empty set\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetUnion/Intersect/Difference(): FAILED - empty set\r\n");
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&first);
+    }
+
+    // // // Touching extents are neither holes nor overlaps, overlapping ones are merged the same way
+    {
+        const EXTENT touching[] = { { 0x1000, 0x1FFF, 1 }, { 0x2000, 0x2FFF, 2 } };
+        const EXTENT overlapping[] = { { 0x1000, 0x2FFF, 1 }, { 0x2000, 0x3FFF, 2 } };
+        const EXTENT apart[] = { { 0x1000, 0x1FFF, 1 }, { 0x3000, 0x3FFF, 2 } };
+        const EXTENT touchingMerged[] = { { 0x1000, 0x2FFF, 1 } };
+        const EXTENT overlappingMerged[] = { { 0x1000, 0x3FFF, 1 } };
+        const EXTENT straddle[] = { { 0x1800, 0x27FF, 3 } };
+
+        if ( SUCCEEDED(BuildExtentSet(&first, touching, ARRAYSIZE(touching)))
+             && (ExtentSetCheck(&first, &holes, &overlaps), ((0 == holes) && (0 == overlaps)))
+             && SUCCEEDED(ExtentSetCoalesce(&first, &result))
+             && ValidateExtentSet(&result, touchingMerged, ARRAYSIZE(touchingMerged))
+             && SUCCEEDED(BuildExtentSet(&second, straddle, ARRAYSIZE(straddle)))
+             && (ARRAYSIZE(straddle) == ExtentSetContains(&result, &second)) )
+        {
+            printf("\t\tExtentSetCoalesce(): PASSED - touching\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetCoalesce(): FAILED (Holes: %d) (Overlaps: %d) - touching\r\n", holes, overlaps);
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&second);
+        ExtentSetFree(&first);
+
+        if ( SUCCEEDED(BuildExtentSet(&first, overlapping, ARRAYSIZE(overlapping)))
+             && (ExtentSetCheck(&first, &holes, &overlaps), ((0 == holes) && (1 == overlaps)))
+             && SUCCEEDED(ExtentSetCoalesce(&first, &result))
+             && ValidateExtentSet(&result, overlappingMerged, ARRAYSIZE(overlappingMerged)) )
+        {
+            printf("\t\tExtentSetCoalesce(): PASSED - overlapping\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetCoalesce(): FAILED (Holes: %d) (Overlaps: %d) - overlapping\r\n", holes, overlaps);
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&first);
+
+        if ( SUCCEEDED(BuildExtentSet(&first, apart, ARRAYSIZE(apart)))
+             && (ExtentSetCheck(&first, &holes, &overlaps), ((1 == holes) && (0 == overlaps)))
+             && SUCCEEDED(ExtentSetCoalesce(&first, &result))
+             && ValidateExtentSet(&result, apart, ARRAYSIZE(apart))
+             && SUCCEEDED(BuildExtentSet(&second, straddle, ARRAYSIZE(straddle)))
+             && (0 == ExtentSetContains(&result, &second)) )
+        {
+            printf("\t\tExtentSetCoalesce(): PASSED - hole\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetCoalesce(): FAILED (Holes: %d) (Overlaps: %d) - hole\r\n", holes, overlaps);
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&second);
+        ExtentSetFree(&first);
+    }
+
+    // // // Extents that end at the top of the address space
+    {
+        const EXTENT low[] = { { MAXULONGLONG - 0x1FFF, MAXULONGLONG - 0x1000, 1 } };
+        const EXTENT top[] = { { MAXULONGLONG - 0xFFF, MAXULONGLONG, 2 } };
+        const EXTENT merged[] = { { MAXULONGLONG - 0x1FFF, MAXULONGLONG, 1 } };
+        const EXTENT clipped[] = { { MAXULONGLONG - 0xFFF, MAXULONGLONG, 1 } };
+
+        if ( (E_INVALIDARG == ExtentSetAppend(&first, MAXULONGLONG - 0xFFF, 0x1001, 0))
+             && SUCCEEDED(BuildExtentSet(&first, low, ARRAYSIZE(low)))
+             && SUCCEEDED(BuildExtentSet(&second, top, ARRAYSIZE(top)))
+             && (0 == ExtentSetFind(&second, MAXULONGLONG))
+             && (1 == ExtentSetFind(&first, MAXULONGLONG))
+             && SUCCEEDED(ExtentSetUnion(&first, &second, &result))
+             && ValidateExtentSet(&result, merged, ARRAYSIZE(merged)) )
+        {
+            printf("\t\tExtentSetUnion(): PASSED - ends at MAXULONGLONG\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetUnion(): FAILED - ends at MAXULONGLONG\r\n");
+            failCount++;
+        }
+
+        ExtentSetFree(&first);
+        ExtentSetFree(&second);
+
+        if ( SUCCEEDED(BuildExtentSet(&second, top, ARRAYSIZE(top)))
+             && SUCCEEDED(ExtentSetDifference(&result, &second, &first))
+             && ValidateExtentSet(&first, low, ARRAYSIZE(low))
+             && (ExtentSetFree(&first), SUCCEEDED(ExtentSetIntersect(&result, &second, &first)))
+             && ValidateExtentSet(&first, clipped, ARRAYSIZE(clipped))
+             && (ARRAYSIZE(top) == ExtentSetContains(&result, &second)) )
+        {
+            printf("\t\tExtentSetDifference/Intersect(): PASSED - ends at MAXULONGLONG\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetDifference/Intersect(): FAILED - ends at MAXULONGLONG\r\n");
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&second);
+        ExtentSetFree(&first);
+    }
+
+    // // // Difference splits an extent around the ones it removes
+    {
+        const EXTENT whole[] = { { 0x0000, 0xFFFF, 7 } };
+        const EXTENT holesIn[] = { { 0x4000, 0x4FFF, 1 }, { 0x8000, 0x8FFF, 2 } };
+        const EXTENT pieces[] = { { 0x0000, 0x3FFF, 7 }, { 0x5000, 0x7FFF, 7 }, { 0x9000, 0xFFFF, 7 } };
+        const EXTENT pair[] = { { 0x0000, 0x0FFF, 1 }, { 0x2000, 0x2FFF, 2 } };
+        const EXTENT across[] = { { 0x0800, 0x27FF, 3 } };
+        const EXTENT pairLeft[] = { { 0x0000, 0x07FF, 1 }, { 0x2800, 0x2FFF, 2 } };
+
+        if ( SUCCEEDED(BuildExtentSet(&first, whole, ARRAYSIZE(whole)))
+             && SUCCEEDED(BuildExtentSet(&second, holesIn, ARRAYSIZE(holesIn)))
+             && SUCCEEDED(ExtentSetDifference(&first, &second, &result))
+             && ValidateExtentSet(&result, pieces, ARRAYSIZE(pieces)) )
+        {
+            printf("\t\tExtentSetDifference(): PASSED - splits an extent\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetDifference(): FAILED (Count: %d) - splits an extent\r\n", result.Count);
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&second);
+        ExtentSetFree(&first);
+
+        if ( SUCCEEDED(BuildExtentSet(&first, pair, ARRAYSIZE(pair)))
+             && SUCCEEDED(BuildExtentSet(&second, across, ARRAYSIZE(across)))
+             && SUCCEEDED(ExtentSetDifference(&first, &second, &result))
+             && ValidateExtentSet(&result, pairLeft, ARRAYSIZE(pairLeft)) )
+        {
+            printf("\t\tExtentSetDifference(): PASSED - one extent removed from two\r\n");
+        }
+        else
+        {
+            printf("\t\tExtentSetDifference(): FAILED (Count: %d) - one extent removed from two\r\n", result.Count);
+            failCount++;
+        }
+
+        ExtentSetFree(&result);
+        ExtentSetFree(&second);
+        ExtentSetFree(&first);
+    }
+
+    return failCount;
+}
+
+// Tags of the blobs written by WriteTestDump
+static const GUID TestDumpBlobTag1 = { 0x3c4f1e6a, 0x51b2, 0x4d0e, { 0x9a, 0x7c, 0x21, 0x6e, 0x08, 0xd3, 0x4b, 0x95 } };
+static const GUID TestDumpBlobTag2 = { 0x8e02b7d1, 0x2a6f, 0x4c53, { 0xb1, 0x0e, 0x7d, 0x94, 0x3a, 0x62, 0xc8, 0x1f } };
+
+//    UINT        Test_Dump_Blob(DEVICE_IO *pIn, wstring devName)
+UINT Test_Dump_Blob(DEVICE_IO *pIn, wstring devName)
+{
+    UINT                failCount = 0;
+    HRESULT             hr = S_OK;
+    PDUMP_FILE_VIEW     view = nullptr;
+    const DUMP_BLOB     *blob = nullptr;
+    const UCHAR         *slice = nullptr;
+    UINT64              headerSize = 0;
+    UINT64              secondaryDataOffset = 0;
+    UINT64              blobOffset = 0;
+
+    for (UINT pass = 0; pass < 2; pass++)
+    {
+        BOOL        is64Bit = (0 == pass);
+        const char  *kind = is64Bit ? "DUMP_HEADER64" : "DUMP_HEADER32";
+
+        headerSize = is64Bit ? sizeof(DUMP_HEADER64) : sizeof(DUMP_HEADER32);
+        secondaryDataOffset = headerSize + (TEST_DUMP_PAGE_COUNT * TEST_DUMP_PAGE_SIZE);
+
+        DeleteFileW(devName.c_str());
+        if ( SUCCEEDED(hr = WriteTestDump(pIn, devName, is64Bit))
+             && SUCCEEDED(hr = pIn->Close()) )
+        {
+            printf("\t\t        Write(): PASSED - %s\r\n", kind);
+        }
+        else
+        {
+            printf("\t\t        Write(): FAILED (Error: %#x) - %s\r\n", hr, kind);
+            failCount++;
+            break;
+        }
+
+        if (FAILED(hr = OpenDumpFileView(devName.c_str(), &view)))
+        {
+            printf("\t\tOpenDumpFileView(): FAILED (Error: %#x) - %s\r\n", hr, kind);
+            failCount++;
+            break;
+        }
+
+        // The header and the runs, the empty run between the two is skipped
+        if ( (is64Bit == view->Is64Bit)
+             && (headerSize == view->HeaderSize)
+             && (2 == view->RunCount)
+             && ((TEST_DUMP_RUN0_BASE_PAGE * TEST_DUMP_PAGE_SIZE) == view->Runs[0].Base)
+             && ((TEST_DUMP_RUN0_PAGES * TEST_DUMP_PAGE_SIZE) == view->Runs[0].Size)
+             && (headerSize == view->Runs[0].FileOffset)
+             && ((TEST_DUMP_RUN1_BASE_PAGE * TEST_DUMP_PAGE_SIZE) == view->Runs[1].Base)
+             && ((headerSize + (TEST_DUMP_RUN0_PAGES * TEST_DUMP_PAGE_SIZE)) == view->Runs[1].FileOffset)
+             && (secondaryDataOffset == view->SecondaryDataOffset) )
+        {
+            printf("\t\tOpenDumpFileView(): PASSED - %s runs\r\n", kind);
+        }
+        else
+        {
+            printf("\t\tOpenDumpFileView(): FAILED (Header size: %#x) (Runs: %d) - %s runs\r\n", view->HeaderSize, view->RunCount, kind);
+            failCount++;
+        }
+
+        // Pages come back from their runs, a slice may not leave its run
+        if ( SUCCEEDED(GetDumpPhysicalSlice(view, (TEST_DUMP_RUN0_BASE_PAGE + 1) * TEST_DUMP_PAGE_SIZE, TEST_DUMP_PAGE_SIZE, &slice))
+             && ('B' == slice[0]) && ('B' == slice[TEST_DUMP_PAGE_SIZE - 1])
+             && SUCCEEDED(GetDumpPhysicalSlice(view, TEST_DUMP_RUN1_BASE_PAGE * TEST_DUMP_PAGE_SIZE, TEST_DUMP_PAGE_SIZE, &slice))
+             && ('C' == slice[0])
+             && (HRESULT_FROM_WIN32(ERROR_INVALID_ADDRESS) == GetDumpPhysicalSlice(view, ((TEST_DUMP_RUN0_BASE_PAGE + 1) * TEST_DUMP_PAGE_SIZE) + 0x800, TEST_DUMP_PAGE_SIZE, &slice)) )
+        {
+            printf("\t\tGetDumpPhysicalSlice(): PASSED - %s\r\n", kind);
+        }
+        else
+        {
+            printf("\t\tGetDumpPhysicalSlice(): FAILED - %s\r\n", kind);
+            failCount++;
+        }
+
+        // Blob data follows DUMP_BLOB_FILE_HEADER, DUMP_BLOB_HEADER and the PrePad,
+        // the next blob header follows the PostPad
+        blobOffset = secondaryDataOffset + sizeof(DUMP_BLOB_FILE_HEADER) + sizeof(DUMP_BLOB_HEADER);
+        blob = FindDumpBlob(view, TestDumpBlobTag1);
+        if ( (3 == view->BlobCount)
+             && (nullptr != blob)
+             && (blobOffset == blob->FileOffset)
+             && (TEST_DUMP_BLOB_SIZE == blob->DataSize)
+             && ('a' == blob->Data[0]) && ('a' == blob->Data[TEST_DUMP_BLOB_SIZE - 1]) )
+        {
+            printf("\t\t  FindDumpBlob(): PASSED - %s blob\r\n", kind);
+        }
+        else
+        {
+            printf("\t\t  FindDumpBlob(): FAILED (Blobs: %d) - %s blob\r\n", view->BlobCount, kind);
+            failCount++;
+        }
+
+        blobOffset += TEST_DUMP_BLOB_SIZE + sizeof(DUMP_BLOB_HEADER) + TEST_DUMP_BLOB_PREPAD;
+        blob = FindDumpBlob(view, TestDumpBlobTag2);
+        if ( (nullptr != blob)
+             && (blobOffset == blob->FileOffset)
+             && (TEST_DUMP_PADDED_BLOB_SIZE == blob->DataSize)
+             && ('b' == blob->Data[0]) && ('b' == blob->Data[TEST_DUMP_PADDED_BLOB_SIZE - 1]) )
+        {
+            printf("\t\t  FindDumpBlob(): PASSED - %s padded blob\r\n", kind);
+        }
+        else
+        {
+            printf("\t\t  FindDumpBlob(): FAILED - %s padded blob\r\n", kind);
+            failCount++;
+        }
+
+        // The second blob with the first tag sorts after it
+        blobOffset += TEST_DUMP_PADDED_BLOB_SIZE + TEST_DUMP_BLOB_POSTPAD + sizeof(DUMP_BLOB_HEADER);
+        blob = FindDumpBlob(view, TestDumpBlobTag1);
+        if ( (nullptr != blob)
+             && (&blob[1] < &view->Blobs[view->BlobCount])
+             && (0 == memcmp(&blob[1].Tag, &TestDumpBlobTag1, sizeof(GUID)))
+             && (blobOffset == blob[1].FileOffset)
+             && (TEST_DUMP_REPEATED_BLOB_SIZE == blob[1].DataSize)
+             && ('c' == blob[1].Data[0])
+             && (nullptr == FindDumpBlob(view, GUID_NULL)) )
+        {
+            printf("\t\t  FindDumpBlob(): PASSED - %s repeated tag\r\n", kind);
+        }
+        else
+        {
+            printf("\t\t  FindDumpBlob(): FAILED - %s repeated tag\r\n", kind);
+            failCount++;
+        }
+
+        CloseDumpFileView(view);
+        view = nullptr;
+    }
+
+    CloseDumpFileView(view);
+
+    return failCount;
+}
+
+//    UINT        Test_Page_Fingerprint(wstring devName)
+UINT Test_Page_Fingerprint(wstring devName)
+{
+    UINT                failCount = 0;
+    HRESULT             hr = S_OK;
+    PUCHAR              pages = nullptr;
+    PAGE_FINGERPRINT    first = { 0 };
+    PAGE_FINGERPRINT    second = { 0 };
+    PAGE_FINGERPRINT    changed = { 0 };
+    PAGE_FINGERPRINT    zero = { 0 };
+    PAGE_FINGERPRINT    readBack = { 0 };
+    EXTENT_SET          differences;
+    const EXTENT        changedPage[] = { { TEST_FINGERPRINT_BASE + (2 * PAGE_FINGERPRINT_PAGE_SIZE),
+                                            TEST_FINGERPRINT_BASE + (3 * PAGE_FINGERPRINT_PAGE_SIZE) - 1, 0 } };
+
+    ExtentSetInit(&differences);
+
+    // Pages 0 and 2 hold different patterns, pages 1 and 3 are zero
+    pages = (PUCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, TEST_FINGERPRINT_PAGES * PAGE_FINGERPRINT_PAGE_SIZE);
+    if (nullptr == pages)
+    {
+        printf("\t\t    Allocate(): FAILED (Error: %#x)\r\n", E_OUTOFMEMORY);
+        return 1;
+    }
+
+    for (UINT32 i = 0; i < PAGE_FINGERPRINT_PAGE_SIZE; i++)
+    {
+        pages[i] = OFFSET2VALUE(i);
+        pages[(2 * PAGE_FINGERPRINT_PAGE_SIZE) + i] = OFFSET2VALUE(i + 1);
+    }
+
+    if ( (HashPage(&pages[PAGE_FINGERPRINT_PAGE_SIZE]) == HashPage(&pages[3 * PAGE_FINGERPRINT_PAGE_SIZE]))
+         && (HashPage(pages) != HashPage(&pages[2 * PAGE_FINGERPRINT_PAGE_SIZE]))
+         && (HashPage(pages) != HashPage(&pages[PAGE_FINGERPRINT_PAGE_SIZE])) )
+    {
+        printf("\t\t     HashPage(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t     HashPage(): FAILED\r\n");
+        failCount++;
+    }
+
+    // Zero pages are hashed but left out of the sketch
+    if ( SUCCEEDED(hr = PageFingerprintAddPages(&first, TEST_FINGERPRINT_BASE, pages, TEST_FINGERPRINT_PAGES * PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintWrite(&first, devName.c_str()))
+         && (TEST_FINGERPRINT_PAGES == first.PageCount)
+         && (1 == first.RunCount)
+         && (2 == first.SketchCount)
+         && SUCCEEDED(hr = PageFingerprintAddPages(&zero, TEST_FINGERPRINT_BASE, &pages[PAGE_FINGERPRINT_PAGE_SIZE], PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintAddPages(&zero, TEST_FINGERPRINT_BASE + PAGE_FINGERPRINT_PAGE_SIZE, &pages[3 * PAGE_FINGERPRINT_PAGE_SIZE], PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintWrite(&zero, devName.c_str()))
+         && (0 == zero.SketchCount)
+         && (0 == PageFingerprintSimilarity(&zero, &zero)) )
+    {
+        printf("\t\tPageFingerprintWrite(): PASSED - zero pages\r\n");
+    }
+    else
+    {
+        printf("\t\tPageFingerprintWrite(): FAILED (Error: %#x) (Sketch: %d) - zero pages\r\n", hr, first.SketchCount);
+        failCount++;
+        goto Exit;
+    }
+
+    // The same pages added in two calls give the same single run
+    if ( SUCCEEDED(hr = PageFingerprintAddPages(&second, TEST_FINGERPRINT_BASE, pages, 2 * PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintAddPages(&second, TEST_FINGERPRINT_BASE + (2 * PAGE_FINGERPRINT_PAGE_SIZE), &pages[2 * PAGE_FINGERPRINT_PAGE_SIZE], 2 * PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintWrite(&second, devName.c_str()))
+         && SUCCEEDED(hr = PageFingerprintRead(devName.c_str(), &readBack))
+         && (1 == readBack.RunCount)
+         && (TEST_FINGERPRINT_PAGES == readBack.PageCount)
+         && (0 == memcmp(first.Hashes, readBack.Hashes, TEST_FINGERPRINT_PAGES * sizeof(UINT64)))
+         && (100 == PageFingerprintSimilarity(&first, &readBack))
+         && SUCCEEDED(hr = PageFingerprintDiff(&first, &readBack, &differences))
+         && (0 == differences.Count) )
+    {
+        printf("\t\tPageFingerprintDiff(): PASSED - equal\r\n");
+    }
+    else
+    {
+        printf("\t\tPageFingerprintDiff(): FAILED (Error: %#x) (Differences: %d) - equal\r\n", hr, differences.Count);
+        failCount++;
+    }
+
+    ExtentSetFree(&differences);
+
+    // One byte changed in page 2
+    pages[(2 * PAGE_FINGERPRINT_PAGE_SIZE) + 0x123] ^= 0x01;
+    if ( SUCCEEDED(hr = PageFingerprintAddPages(&changed, TEST_FINGERPRINT_BASE, pages, TEST_FINGERPRINT_PAGES * PAGE_FINGERPRINT_PAGE_SIZE, PAGE_FINGERPRINT_REGION_OS))
+         && SUCCEEDED(hr = PageFingerprintWrite(&changed, devName.c_str()))
+         && (100 > PageFingerprintSimilarity(&first, &changed))
+         && SUCCEEDED(hr = PageFingerprintDiff(&first, &changed, &differences))
+         && ValidateExtentSet(&differences, changedPage, ARRAYSIZE(changedPage)) )
+    {
+        printf("\t\tPageFingerprintDiff(): PASSED - one page changed\r\n");
+    }
+    else
+    {
+        printf("\t\tPageFingerprintDiff(): FAILED (Error: %#x) (Differences: %d) - one page changed\r\n", hr, differences.Count);
+        failCount++;
+    }
+
+Exit:
+    ExtentSetFree(&differences);
+    PageFingerprintFree(&readBack);
+    PageFingerprintFree(&zero);
+    PageFingerprintFree(&changed);
+    PageFingerprintFree(&second);
+    PageFingerprintFree(&first);
+    HeapFree(GetProcessHeap(), 0, pages);
+    DeleteFileW(devName.c_str());
+
+    return failCount;
+}
+
+//    UINT        Test_Direct_IO(DEVICE_IO *pIn, wstring devName)
+UINT Test_Direct_IO(DEVICE_IO *pIn, wstring devName)
+{
+    UINT        failCount = 0;
+    HRESULT     hr = S_OK;
+    PCHAR       expected = nullptr;
+    PCHAR       actual = nullptr;
+    ULONG       blockSize = 0;
+    ULONGLONG   fileSize = 0;
+    ULONGLONG   totalSize = 0;
+    ULONGLONG   patchOffset = 0;
+    size_t      patchSize = 0;
+    size_t      bytesProcessed = 0;
+    DEVICE_IO   plain;
 
-    // remove the file if it already exists
-    if (0 != size )
+    DeleteFileW(devName.c_str());
+    if ( SUCCEEDED(hr = pIn->SetDirectIo(TRUE))
+         && SUCCEEDED(hr = pIn->Open(devName))
+         && ((blockSize = pIn->GetBlockSize()) >= DEFAULT_BLOCK_SIZE)
+         && (0 == (blockSize & (blockSize - 1))) )
     {
-        pIn->Close();
-        DeleteFileW(devName.c_str());
+        printf("\t\t         Open(): PASSED - direct (Block size: %#x)\r\n", blockSize);
+    }
+    else
+    {
+        printf("\t\t         Open(): FAILED (Error: %#x) (Block size: %#x) - direct\r\n", hr, blockSize);
+        return ++failCount;
     }
 
-    //  This open should occur on an empty or a non-existing file
-    if ( FAILED(pIn->Open(devName))
-         && (DEVICE_IO::IO_ERROR_ALREADY_OPENED != pIn->GetError())
-       )
+    fileSize = TEST_DIRECT_BLOCKS * blockSize;
+    totalSize = fileSize + TEST_DIRECT_APPEND_SIZE;
+    expected = (PCHAR)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)totalSize);
+    actual = (PCHAR)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)totalSize);
+    if ((nullptr == expected) || (nullptr == actual))
     {
-        printf("\t\t         Open(): FAILED (Error: %#x)\r\n", pIn->GetError());
+        printf("\t\t    Allocate(): FAILED (Error: %#x)\r\n", E_OUTOFMEMORY);
         failCount++;
+        goto Exit;
+    }
+
+    for (ULONGLONG i = 0; i < totalSize; i++)
+    {
+        expected[i] = OFFSET2VALUE(i);
+    }
+
+    if ( SUCCEEDED(hr = pIn->Write(expected, (size_t)fileSize, &bytesProcessed))
+         && ((size_t)fileSize == bytesProcessed) )
+    {
+        printf("\t\t        Write(): PASSED - aligned\r\n");
     }
     else
     {
-        size = pIn->GetCurrentFileSize();
+        printf("\t\t        Write(): FAILED (Error: %#x) - aligned\r\n", hr);
+        failCount++;
+        goto Exit;
+    }
 
-        if (DEVICE_IO::PLAIN_FILE_DEVICE_TYPE == (pIn->GetDeviceType()) )
+    // Head and tail inside different blocks, then inside the same block
+    patchOffset = blockSize - TEST_DIRECT_HEAD_SIZE;
+    patchSize = TEST_DIRECT_HEAD_SIZE + blockSize + TEST_DIRECT_TAIL_SIZE;
+    memset(&expected[patchOffset], 'Z', patchSize);
+    memset(&expected[(3 * blockSize) + TEST_DIRECT_INNER_OFFSET], 'Y', TEST_DIRECT_INNER_SIZE);
+
+    if ( SUCCEEDED(hr = pIn->SetPos(patchOffset))
+         && SUCCEEDED(hr = pIn->Write(&expected[patchOffset], patchSize, &bytesProcessed))
+         && (patchSize == bytesProcessed)
+         && SUCCEEDED(hr = pIn->SetPos((3 * (ULONGLONG)blockSize) + TEST_DIRECT_INNER_OFFSET))
+         && SUCCEEDED(hr = pIn->Write(&expected[(3 * blockSize) + TEST_DIRECT_INNER_OFFSET], TEST_DIRECT_INNER_SIZE, &bytesProcessed))
+         && (TEST_DIRECT_INNER_SIZE == bytesProcessed) )
+    {
+        printf("\t\t        Write(): PASSED - unaligned head and tail\r\n");
+    }
+    else
+    {
+        printf("\t\t        Write(): FAILED (Error: %#x) - unaligned head and tail\r\n", hr);
+        failCount++;
+    }
+
+    // The file ends inside a block once the append is done
+    if ( SUCCEEDED(hr = pIn->SetPos(fileSize))
+         && SUCCEEDED(hr = pIn->Write(&expected[fileSize], TEST_DIRECT_APPEND_SIZE, &bytesProcessed))
+         && (TEST_DIRECT_APPEND_SIZE == bytesProcessed)
+         && (totalSize == pIn->GetCurrentFileSize()) )
+    {
+        printf("\t\t        Write(): PASSED - unaligned append\r\n");
+    }
+    else
+    {
+        printf("\t\t        Write(): FAILED (Error: %#x) (Size: %#lx) - unaligned append\r\n", hr, (ULONG)pIn->GetCurrentFileSize());
+        failCount++;
+    }
+
+    // Read back through the direct handle, from an unaligned offset and past the end
+    memset(actual, 0, (size_t)totalSize);
+    if ( SUCCEEDED(hr = pIn->SetPos(TEST_DIRECT_INNER_OFFSET))
+         && SUCCEEDED(hr = pIn->Read(actual, (size_t)(totalSize - TEST_DIRECT_INNER_OFFSET), &bytesProcessed))
+         && ((size_t)(totalSize - TEST_DIRECT_INNER_OFFSET) == bytesProcessed)
+         && (0 == memcmp(actual, &expected[TEST_DIRECT_INNER_OFFSET], bytesProcessed))
+         && SUCCEEDED(hr = pIn->SetPos(totalSize - TEST_DIRECT_INNER_SIZE))
+         && SUCCEEDED(hr = pIn->Read(actual, TEST_DIRECT_APPEND_SIZE, &bytesProcessed))
+         && (TEST_DIRECT_INNER_SIZE == bytesProcessed)
+         && (0 == memcmp(actual, &expected[totalSize - TEST_DIRECT_INNER_SIZE], bytesProcessed)) )
+    {
+        printf("\t\t         Read(): PASSED - direct, unaligned\r\n");
+    }
+    else
+    {
+        printf("\t\t         Read(): FAILED (Error: %#x) (Read: %#lx) - direct, unaligned\r\n", hr, (ULONG)bytesProcessed);
+        failCount++;
+    }
+
+    pIn->Close();
+
+    // The same bytes are on disk, as seen through a buffered handle
+    memset(actual, 0, (size_t)totalSize);
+    if ( SUCCEEDED(hr = plain.Open(devName))
+         && (totalSize == plain.GetCurrentFileSize())
+         && SUCCEEDED(hr = plain.Read(actual, (size_t)totalSize, &bytesProcessed))
+         && ((size_t)totalSize == bytesProcessed)
+         && (0 == memcmp(actual, expected, (size_t)totalSize)) )
+    {
+        printf("\t\t         Read(): PASSED - buffered\r\n");
+    }
+    else
+    {
+        printf("\t\t         Read(): FAILED (Error: %#x) (Size: %#lx) - buffered\r\n", hr, (ULONG)plain.GetCurrentFileSize());
+        failCount++;
+    }
+
+    plain.Close();
+
+Exit:
+    if (nullptr != expected)
+    {
+        HeapFree(GetProcessHeap(), 0, expected);
+    }
+
+    if (nullptr != actual)
+    {
+        HeapFree(GetProcessHeap(), 0, actual);
+    }
+
+    return failCount;
+}
+
+//    UINT        Test_DmpLog(wstring logName)
+UINT Test_DmpLog(wstring logName)
+{
+    UINT                failCount = 0;
+    HRESULT             hr = S_OK;
+    HANDLE              threads[TEST_DMPLOG_THREADS] = { 0 };
+    UINT                threadCount = 0;
+    std::vector<UCHAR>  log;
+    std::string         raw;
+    std::string         text;
+    CHAR                line[128];
+    size_t              formatCount = 0;
+    UINT                missing = 0;
+
+    DeleteFileW(logName.c_str());
+    if ( SUCCEEDED(hr = OpenLogFile(const_cast<LPWSTR>(logName.c_str()))) )
+    {
+        printf("\t\t  OpenLogFile(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t  OpenLogFile(): FAILED (Error: %#x)\r\n", hr);
+        return ++failCount;
+    }
+
+    DmpLog(TEST_DMPLOG_TEXT);
+
+    // The threads race on the first call of the same call site, it must only be registered once
+    for (threadCount = 0; threadCount < TEST_DMPLOG_THREADS; threadCount++)
+    {
+        threads[threadCount] = CreateThread(nullptr, 0, LogTestEvents, (LPVOID)(ULONG_PTR)threadCount, CREATE_SUSPENDED, nullptr);
+        if (NULL == threads[threadCount])
         {
-            failCount = Test_Write_Read_Device_Specific(pIn);
-            size = pIn->GetCurrentFileSize();
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            break;
         }
-        else
+    }
+
+    for (UINT i = 0; i < threadCount; i++)
+    {
+        ResumeThread(threads[i]);
+    }
+
+    if (threadCount > 0)
+    {
+        WaitForMultipleObjects(threadCount, threads, TRUE, INFINITE);
+    }
+
+    for (UINT i = 0; i < threadCount; i++)
+    {
+        CloseHandle(threads[i]);
+    }
+
+    if (TEST_DMPLOG_THREADS == threadCount)
+    {
+        printf("\t\t DMPLOG_INFO(): PASSED - %d threads\r\n", threadCount);
+    }
+    else
+    {
+        printf("\t\t DMPLOG_INFO(): FAILED (Error: %#x) - %d threads\r\n", hr, threadCount);
+        failCount++;
+    }
+
+    if ( SUCCEEDED(hr = CloseLogFile())
+         && SUCCEEDED(hr = ReadTestFile(logName, log)) )
+    {
+        printf("\t\t CloseLogFile(): PASSED (Size: %#x)\r\n", (ULONG)log.size());
+    }
+    else
+    {
+        printf("\t\t CloseLogFile(): FAILED (Error: %#x)\r\n", hr);
+        failCount++;
+        goto Exit;
+    }
+
+    // Format strings only show up in the raw log in their format records
+    raw.assign(log.begin(), log.end());
+    for (size_t pos = raw.find(TEST_DMPLOG_FORMAT); std::string::npos != pos; pos = raw.find(TEST_DMPLOG_FORMAT, pos + 1))
+    {
+        formatCount++;
+    }
+
+    if (1 == formatCount)
+    {
+        printf("\tDmpLogRegisterFormat(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\tDmpLogRegisterFormat(): FAILED (Format records: %d)\r\n", (UINT)formatCount);
+        failCount++;
+    }
+
+    if ( SUCCEEDED(hr = DmpLogDecode(log, text))
+         && (std::string::npos != text.find(TEST_DMPLOG_TEXT))
+         && (std::string::npos == text.find("not found"))
+         && (std::string::npos == text.find((CHAR)DMPLOG_RECORD_MARKER)) )
+    {
+        for (UINT thread = 0; thread < TEST_DMPLOG_THREADS; thread++)
         {
-            failCount++;
+            for (UINT event = 0; event < TEST_DMPLOG_EVENTS; event++)
+            {
+                sprintf_s(line, sizeof(line), TEST_DMPLOG_FORMAT, (ULONGLONG)thread, (ULONGLONG)event);
+                if (std::string::npos == text.find(line))
+                {
+                    missing++;
+                }
+            }
         }
+    }
+    else
+    {
+        missing = TEST_DMPLOG_THREADS * TEST_DMPLOG_EVENTS;
+    }
 
-        pIn->Close();
-
+    if (0 == missing)
+    {
+        printf("\t\t DmpLogDecode(): PASSED\r\n");
+    }
+    else
+    {
+        printf("\t\t DmpLogDecode(): FAILED (Error: %#x) (Missing: %d)\r\n", hr, missing);
+        failCount++;
     }
 
+Exit:
+    DeleteFileW(logName.c_str());
+
     return failCount;
 }
 
@@ -2050,6 +3297,7 @@ UINT Test_Write_Read_Device_Specific(DEVICE_IO *pIn)
     devInfoWrite2.BugCheckParam2 = 6;
     devInfoWrite2.BugCheckParam3 = 7;
     devInfoWrite2.BugCheckParam4 = 8;
+    devInfoWrite2.DumpHeaderPA = 0x5454545454545454 + 0x18; // Version 2 element
 
     // // //  Write the data  // // //
 
@@ -2117,4 +3365,267 @@ UINT Test_Write_Read_Device_Specific(DEVICE_IO *pIn)
 
 
     return failCount;
-}
\ No newline at end of file
+}
+
+// BOOL ValidateBatchRequest(const PHYSICAL_EXTENT *extents, UINT32 extentCount, const BATCH_READ_REQUEST *request)
+BOOL ValidateBatchRequest(const PHYSICAL_EXTENT *extents, UINT32 extentCount, const BATCH_READ_REQUEST *request)
+{
+    UINT64  address = request->PhysicalAddress;
+    UINT64  remaining = request->Length;
+    PCHAR   buff = (PCHAR)request->Buffer;
+
+    if (FAILED(request->Result))
+    {
+        return FALSE;
+    }
+
+    // Check the buffer against the pattern, one extent at a time
+    while (0 != remaining)
+    {
+        UINT32 index;
+
+        for (index = 0; index < extentCount; index++)
+        {
+            if ((extents[index].Base <= address) && ((address - extents[index].Base) < extents[index].Size))
+            {
+                break;
+            }
+        }
+
+        if (index == extentCount)
+        {
+            return FALSE;
+        }
+
+        UINT64 count = extents[index].Base + extents[index].Size - address;
+        count = (count < remaining) ? count : remaining;
+
+        if (!ValidateBuffer(buff, (ULONG)count, extents[index].FileOffset + (address - extents[index].Base)))
+        {
+            return FALSE;
+        }
+
+        address += count;
+        buff += count;
+        remaining -= count;
+    }
+
+    return TRUE;
+}
+
+// HRESULT BuildExtentSet(PEXTENT_SET set, const EXTENT *extents, UINT32 count)
+HRESULT BuildExtentSet(PEXTENT_SET set, const EXTENT *extents, UINT32 count)
+{
+    HRESULT hr = S_OK;
+
+    for (UINT32 i = 0; (i < count) && SUCCEEDED(hr); i++)
+    {
+        hr = ExtentSetAppend(set, extents[i].Base, EXTENT_SIZE(extents[i]), extents[i].Tag);
+    }
+
+    return hr;
+}
+
+// BOOL ValidateExtentSet(const EXTENT_SET *set, const EXTENT *expected, UINT32 count)
+BOOL ValidateExtentSet(const EXTENT_SET *set, const EXTENT *expected, UINT32 count)
+{
+    if (set->Count != count)
+    {
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < count; i++)
+    {
+        if ( (set->Extents[i].Base != expected[i].Base)
+             || (set->Extents[i].End != expected[i].End)
+             || (set->Extents[i].Tag != expected[i].Tag) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// HRESULT WriteTestDump(DEVICE_IO *pIn, wstring devName, BOOL is64Bit)
+//      Header, three pages filled with 'A', 'B' and 'C', then the secondary
+//      data: a blob, a padded blob, a second blob with the first tag and the
+//      empty blob that ends the chain.
+HRESULT WriteTestDump(DEVICE_IO *pIn, wstring devName, BOOL is64Bit)
+{
+    HRESULT                 hr = S_OK;
+    PUCHAR                  header = nullptr;
+    ULONG                   headerSize = is64Bit ? sizeof(DUMP_HEADER64) : sizeof(DUMP_HEADER32);
+    UCHAR                   page[TEST_DUMP_PAGE_SIZE];
+    size_t                  bytesProcessed = 0;
+    DUMP_BLOB_FILE_HEADER   fileHeader = { 0 };
+
+    header = (PUCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, headerSize);
+    if (nullptr == header)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    if (is64Bit)
+    {
+        PDUMP_HEADER64 header64 = (PDUMP_HEADER64)header;
+
+        header64->Signature = DUMP_SIGNATURE32;
+        header64->ValidDump = DUMP_VALID_DUMP64;
+        header64->DumpType = DUMP_TYPE_FULL;
+        header64->PhysicalMemoryBlock.NumberOfRuns = 3;
+        header64->PhysicalMemoryBlock.NumberOfPages = TEST_DUMP_PAGE_COUNT;
+        header64->PhysicalMemoryBlock.Run[0].BasePage = TEST_DUMP_RUN0_BASE_PAGE;
+        header64->PhysicalMemoryBlock.Run[0].PageCount = TEST_DUMP_RUN0_PAGES;
+        header64->PhysicalMemoryBlock.Run[1].BasePage = TEST_DUMP_EMPTY_RUN_BASE_PAGE;
+        header64->PhysicalMemoryBlock.Run[1].PageCount = 0;
+        header64->PhysicalMemoryBlock.Run[2].BasePage = TEST_DUMP_RUN1_BASE_PAGE;
+        header64->PhysicalMemoryBlock.Run[2].PageCount = TEST_DUMP_PAGE_COUNT - TEST_DUMP_RUN0_PAGES;
+    }
+    else
+    {
+        PDUMP_HEADER32 header32 = (PDUMP_HEADER32)header;
+
+        header32->Signature = DUMP_SIGNATURE32;
+        header32->ValidDump = DUMP_VALID_DUMP32;
+        header32->DumpType = DUMP_TYPE_FULL;
+        header32->PhysicalMemoryBlock.NumberOfRuns = 3;
+        header32->PhysicalMemoryBlock.NumberOfPages = TEST_DUMP_PAGE_COUNT;
+        header32->PhysicalMemoryBlock.Run[0].BasePage = TEST_DUMP_RUN0_BASE_PAGE;
+        header32->PhysicalMemoryBlock.Run[0].PageCount = TEST_DUMP_RUN0_PAGES;
+        header32->PhysicalMemoryBlock.Run[1].BasePage = TEST_DUMP_EMPTY_RUN_BASE_PAGE;
+        header32->PhysicalMemoryBlock.Run[1].PageCount = 0;
+        header32->PhysicalMemoryBlock.Run[2].BasePage = TEST_DUMP_RUN1_BASE_PAGE;
+        header32->PhysicalMemoryBlock.Run[2].PageCount = TEST_DUMP_PAGE_COUNT - TEST_DUMP_RUN0_PAGES;
+    }
+
+    fileHeader.Signature1 = DUMP_BLOB_SIGNATURE1;
+    fileHeader.Signature2 = DUMP_BLOB_SIGNATURE2;
+    fileHeader.HeaderSize = sizeof(DUMP_BLOB_FILE_HEADER);
+    fileHeader.BuildNumber = 1205;
+
+    if (FAILED(hr = pIn->Open(devName)) || FAILED(hr = pIn->Write((PCHAR)header, headerSize, &bytesProcessed)))
+    {
+        goto Exit;
+    }
+
+    for (UINT i = 0; i < TEST_DUMP_PAGE_COUNT; i++)
+    {
+        memset(page, 'A' + i, sizeof page);
+        if (FAILED(hr = pIn->Write((PCHAR)page, sizeof page, &bytesProcessed)))
+        {
+            goto Exit;
+        }
+    }
+
+    if ( FAILED(hr = pIn->Write((PCHAR)&fileHeader, sizeof fileHeader, &bytesProcessed))
+         || FAILED(hr = WriteTestDumpBlob(pIn, TestDumpBlobTag1, 'a', TEST_DUMP_BLOB_SIZE, 0, 0))
+         || FAILED(hr = WriteTestDumpBlob(pIn, TestDumpBlobTag2, 'b', TEST_DUMP_PADDED_BLOB_SIZE, TEST_DUMP_BLOB_PREPAD, TEST_DUMP_BLOB_POSTPAD))
+         || FAILED(hr = WriteTestDumpBlob(pIn, TestDumpBlobTag1, 'c', TEST_DUMP_REPEATED_BLOB_SIZE, 0, 0))
+         || FAILED(hr = WriteTestDumpBlob(pIn, GUID_NULL, 0, 0, 0, 0)) )
+    {
+        goto Exit;
+    }
+
+Exit:
+    HeapFree(GetProcessHeap(), 0, header);
+
+    return hr;
+}
+
+// HRESULT WriteTestDumpBlob(DEVICE_IO *pIn, REFGUID tag, UCHAR fill, ULONG dataSize, ULONG prePad, ULONG postPad)
+HRESULT WriteTestDumpBlob(DEVICE_IO *pIn, REFGUID tag, UCHAR fill, ULONG dataSize, ULONG prePad, ULONG postPad)
+{
+    HRESULT             hr = S_OK;
+    UCHAR               data[TEST_DUMP_BLOB_MAX_SIZE] = { 0 };
+    size_t              bytesProcessed = 0;
+    DUMP_BLOB_HEADER    blobHeader = { 0 };
+
+    if ((dataSize > sizeof data) || (prePad > sizeof data) || (postPad > sizeof data))
+    {
+        return E_INVALIDARG;
+    }
+
+    blobHeader.HeaderSize = sizeof(DUMP_BLOB_HEADER);
+    blobHeader.Tag = tag;
+    blobHeader.DataSize = dataSize;
+    blobHeader.PrePad = prePad;
+    blobHeader.PostPad = postPad;
+
+    if (FAILED(hr = pIn->Write((PCHAR)&blobHeader, sizeof blobHeader, &bytesProcessed)))
+    {
+        return hr;
+    }
+
+    if ((prePad > 0) && FAILED(hr = pIn->Write((PCHAR)data, prePad, &bytesProcessed)))
+    {
+        return hr;
+    }
+
+    memset(data, fill, dataSize);
+    if ((dataSize > 0) && FAILED(hr = pIn->Write((PCHAR)data, dataSize, &bytesProcessed)))
+    {
+        return hr;
+    }
+
+    memset(data, 0, sizeof data);
+    if ((postPad > 0) && FAILED(hr = pIn->Write((PCHAR)data, postPad, &bytesProcessed)))
+    {
+        return hr;
+    }
+
+    return hr;
+}
+
+//    DWORD       LogTestEvents(LPVOID Parameter)
+//    Logs TEST_DMPLOG_EVENTS binary records for the thread number in Parameter, all from one call site
+DWORD WINAPI LogTestEvents(LPVOID Parameter)
+{
+    ULONG thread = (ULONG)(ULONG_PTR)Parameter;
+
+    for (ULONG event = 0; event < TEST_DMPLOG_EVENTS; event++)
+    {
+        DMPLOG_INFO(TEST_DMPLOG_FORMAT, 2, thread, event, 0, 0);
+    }
+
+    return 0;
+}
+
+//    HRESULT     ReadTestFile(wstring devName, std::vector<UCHAR> &contents)
+//    Reads a whole file into contents
+HRESULT ReadTestFile(wstring devName, std::vector<UCHAR> &contents)
+{
+    HRESULT         hr = S_OK;
+    HANDLE          hdl = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER   size = { 0 };
+    DWORD           bytesRead = 0;
+
+    contents.clear();
+
+    hdl = CreateFileW(devName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (INVALID_HANDLE_VALUE == hdl)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (FALSE == GetFileSizeEx(hdl, &size))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (0 != size.QuadPart)
+    {
+        contents.resize((size_t)size.QuadPart);
+        if (FALSE == ReadFile(hdl, contents.data(), (DWORD)contents.size(), &bytesRead, nullptr))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else if (bytesRead != contents.size())
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        }
+    }
+
+    CloseHandle(hdl);
+
+    return hr;
+}
@@ -14,17 +14,63 @@ Author:
 
 #pragma once
 
+#include <nt.h>
+#include <ntrtl.h>
+#include <nturtl.h>
+
 #include <stdio.h>
 #include <DEVICE_IO.h>
 #include <RawDumpDefs.h>
 #include <Device_Specific.h>
 #include <DisplayFuncs.h>
+#include <Batch_Read.h>
+#include <Chunked_Section.h>
+#include <Extent_Set.h>
+#include <Dump_Blob.h>
+#include <Page_Fingerprint.h>
+#include <ntiodump.h>
+#include <logging.h>
+#include <dmplogdecode.h>
 
 #define TEST_PATTERN_BEGIN      32       // <space>
 #define TEST_PATTERN_END        126      // Last Ascii Char
 #define TEST_PATTERN_SIZE       (TEST_PATTERN_END - TEST_PATTERN_BEGIN + 1)
 #define OFFSET2VALUE(offset)    (CHAR)( ((offset) % TEST_PATTERN_SIZE) + TEST_PATTERN_BEGIN )
 #define TEST_FILLER_SIZE        1024    // Size of Device Specific filler
+#define TEST_OVERLAY_PATCH_OFFSET   0x1FF0  // Patch crosses the block boundary at 0x2000
+#define TEST_OVERLAY_PATCH_SIZE     0x20
+#define TEST_OVERLAY_SPAN           0x100   // Bytes read back around the patch
+#define TEST_BATCH_FILE_SIZE        0x8000  // Pattern file behind the batch read extents
+#define TEST_BATCH_BASE             0x80000000
+#define TEST_BATCH_REQUEST_SIZE     0x100
+#define TEST_CHUNK_SIZE             RAW_DUMP_CHUNK_SIZE_MIN
+#define TEST_CHUNK_COUNT            3
+#define TEST_CHUNK_SECTION_SIZE     ((2 * TEST_CHUNK_SIZE) + 0x800)     // Last chunk is half full
+#define TEST_CHUNK_FILE_OFFSET      0x200   // Chunk index position in the test file
+#define TEST_DUMP_PAGE_SIZE         0x1000
+#define TEST_DUMP_PAGE_COUNT        3
+#define TEST_DUMP_RUN0_BASE_PAGE    0x100
+#define TEST_DUMP_RUN0_PAGES        2
+#define TEST_DUMP_EMPTY_RUN_BASE_PAGE   0x180   // Run without pages between the two
+#define TEST_DUMP_RUN1_BASE_PAGE    0x200
+#define TEST_DUMP_BLOB_SIZE         0x30
+#define TEST_DUMP_PADDED_BLOB_SIZE  0x21
+#define TEST_DUMP_BLOB_PREPAD       0x10
+#define TEST_DUMP_BLOB_POSTPAD      0x7
+#define TEST_DUMP_REPEATED_BLOB_SIZE    0x10
+#define TEST_DUMP_BLOB_MAX_SIZE     0x40
+#define TEST_FINGERPRINT_BASE       0x80000000
+#define TEST_FINGERPRINT_PAGES      4
+#define TEST_DIRECT_BLOCKS          4       // File size, in blocks, before the append
+#define TEST_DIRECT_HEAD_SIZE       0x10    // Bytes of the patch in the block before
+#define TEST_DIRECT_TAIL_SIZE       0x30    // Bytes of the patch in the block after
+#define TEST_DIRECT_INNER_OFFSET    0x7     // Patch inside a single block
+#define TEST_DIRECT_INNER_SIZE      0x9
+#define TEST_DIRECT_APPEND_SIZE     0x33
+#define TEST_DMPLOG_THREADS         4
+#define TEST_DMPLOG_EVENTS          4
+#define TEST_DMPLOG_FORMAT          "DmpLog test thread 0x%llx event 0x%llx\r\n"
+#define TEST_DMPLOG_TEXT            "DmpLog test text record\r\n"
 
 // DEVICE_IO class tests
 UINT Test_Unopened(DEVICE_IO *pIn, wstring devName, UINT devID );
@@ -36,6 +82,16 @@ UINT Test_Open_Partition_Position(DEVICE_IO *pIn, wstring devName, UINT devID);
 UINT Test_Open_Partition_Position_Read_Headers(DEVICE_IO *pIn, wstring devName, UINT devID, ULONG bufSize);
 UINT Test_Open_Partition_Position_Read_Chunks (DEVICE_IO *pIn, wstring devName, UINT devID, ULONG bufSize);
 UINT Test_Open_Partition_Position_Read_Write_Chunk (DEVICE_IO *pIn, wstring devName, UINT devID, ULONG bufSize);
+UINT Test_Overlay_File(DEVICE_IO *pIn, wstring baseName, wstring deltaName);
+UINT Test_Direct_IO(DEVICE_IO *pIn, wstring devName);
+
+// Common library tests
+UINT Test_Batch_Read(DEVICE_IO *pIn, wstring devName);
+UINT Test_Chunked_Section(DEVICE_IO *pIn, wstring devName);
+UINT Test_Extent_Set(void);
+UINT Test_Dump_Blob(DEVICE_IO *pIn, wstring devName);
+UINT Test_Page_Fingerprint(wstring devName);
+UINT Test_DmpLog(wstring logName);
 
 // Device Specific data structure tests
 UINT Test_Device_Specific(DEVICE_IO *pIn, wstring devName, UINT devID);
@@ -48,5 +104,14 @@ BOOL TEST_SetPos_Func(DEVICE_IO * pIn, ULONGLONG newPos);
 BOOL TEST_Read_Func(DEVICE_IO * pIn, PCHAR buff, UINT buffSize);
 BOOL TEST_Write_Func (DEVICE_IO * pIn, PCHAR buff, UINT buffSize);
 
+// Common library helpers
+BOOL ValidateBatchRequest(const PHYSICAL_EXTENT *extents, UINT32 extentCount, const BATCH_READ_REQUEST *request);
+HRESULT BuildExtentSet(PEXTENT_SET set, const EXTENT *extents, UINT32 count);
+BOOL ValidateExtentSet(const EXTENT_SET *set, const EXTENT *expected, UINT32 count);
+HRESULT WriteTestDump(DEVICE_IO *pIn, wstring devName, BOOL is64Bit);
+HRESULT WriteTestDumpBlob(DEVICE_IO *pIn, REFGUID tag, UCHAR fill, ULONG dataSize, ULONG prePad, ULONG postPad);
+DWORD WINAPI LogTestEvents(LPVOID Parameter);
+HRESULT ReadTestFile(wstring devName, std::vector<UCHAR> &contents);
+
 // Device Specific data structure helpers
 UINT Test_Write_Read_Device_Specific(DEVICE_IO *pIn);
@@ -12,14 +12,21 @@ Author:
    José Pagán (jopagan)
 --*/
 
+#include <FunctionalTests.h>     // First, it brings in the nt headers ahead of windows.h
 #include <stdio.h>
 #include <DEVICE_IO.h>
-#include <FunctionalTests.h>
 #include <DisplayFuncs.h>
 
 #define DEFAULT_DEVICE_SPECIFIC_FILE_NAME   L"C:\\tmp\\Device_Specific_Test_File.bin"
 #define DEFAULT_PLAIN_INPUT_FILE_NAME       L"C:\\tmp\\8996_UFS_SMALL.bin"
 #define DEFAULT_PARTITION_FILE_NAME         L"C:\\tmp\\8996_SVRawDump_Partition.bin"
+#define DEFAULT_OVERLAY_DELTA_FILE_NAME     L"C:\\tmp\\8996_UFS_SMALL.delta"
+#define DEFAULT_DIRECT_IO_FILE_NAME         L"C:\\tmp\\Direct_IO_Test_File.bin"
+#define DEFAULT_BATCH_READ_FILE_NAME        L"C:\\tmp\\Batch_Read_Test_File.bin"
+#define DEFAULT_CHUNKED_SECTION_FILE_NAME   L"C:\\tmp\\Chunked_Section_Test_File.bin"
+#define DEFAULT_DUMP_BLOB_FILE_NAME         L"C:\\tmp\\Dump_Blob_Test_File.dmp"
+#define DEFAULT_FINGERPRINT_FILE_NAME       L"C:\\tmp\\Page_Fingerprint_Test_File.pfp"
+#define DEFAULT_DMPLOG_FILE_NAME            L"C:\\tmp\\DmpLog_Test_File.log"
 #define DEFAULT_DEVICE_ID                   3
 #define DEFAULT_BUFFER_SIZE                 0x5000
 
@@ -638,6 +645,161 @@ int __cdecl main(int argc, char **argv)
     }
     printf ("=== === (%d)   End: OPEN - Test for create + Open(ID) + Partition + SetPos + Read(Chunks) + Write(Chunk) + close, Headers, on a device ID: %d\r\n", testId++, DEVICE_ID);
 
+
+    // // // Test - OpenOverlay + Read + Write + Read + reopen  - Plain file
+    printf("=== === (%d) Begin: OVERLAY - Test for OpenOverlay + patch + read back + reopen on a plain file: %ls\r\n", testId, PLAIN_INPUT_FILE_NAME);
+    {
+        DEVICE_IO myTest;
+
+        UINT localFailures = Test_Overlay_File(&myTest, PLAIN_INPUT_FILE_NAME, DEFAULT_OVERLAY_DELTA_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+
+        myTest.Close();
+    }
+    printf("=== === (%d)   End: OVERLAY - Test for OpenOverlay + patch + read back + reopen on a plain file: %ls\r\n\n", testId++, PLAIN_INPUT_FILE_NAME);
+
+    // // // Test - SetDirectIo + Open + unaligned Write + Read + reopen - Plain file
+    printf("=== === (%d) Begin: DIRECT - Test for unaligned writes and reads on an unbuffered plain file: %ls\r\n", testId, DEFAULT_DIRECT_IO_FILE_NAME);
+    {
+        DEVICE_IO myTest;
+
+        UINT localFailures = Test_Direct_IO(&myTest, DEFAULT_DIRECT_IO_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+
+        myTest.Close();
+    }
+    printf("=== === (%d)   End: DIRECT - Test for unaligned writes and reads on an unbuffered plain file: %ls\r\n\n", testId++, DEFAULT_DIRECT_IO_FILE_NAME);
+
+    // // // // // //  Testing of Common Library  // // // // // //
+
+    // // // Test - ReadPhysicalBatch over two DDR sections - Plain file
+    printf("=== === (%d) Begin: BATCH - Test for ReadPhysicalBatch over two DDR sections on a plain file: %ls\r\n", testId, DEFAULT_BATCH_READ_FILE_NAME);
+    {
+        DEVICE_IO myTest;
+
+        UINT localFailures = Test_Batch_Read(&myTest, DEFAULT_BATCH_READ_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+
+        myTest.Close();
+    }
+    printf("=== === (%d)   End: BATCH - Test for ReadPhysicalBatch over two DDR sections on a plain file: %ls\r\n\n", testId++, DEFAULT_BATCH_READ_FILE_NAME);
+
+    // // // Test - Encode + write + open + read a chunked section - Plain file
+    printf("=== === (%d) Begin: CHUNKED - Test for reading a chunked section on a plain file: %ls\r\n", testId, DEFAULT_CHUNKED_SECTION_FILE_NAME);
+    {
+        DEVICE_IO myTest;
+
+        UINT localFailures = Test_Chunked_Section(&myTest, DEFAULT_CHUNKED_SECTION_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+
+        myTest.Close();
+    }
+    printf("=== === (%d)   End: CHUNKED - Test for reading a chunked section on a plain file: %ls\r\n\n", testId++, DEFAULT_CHUNKED_SECTION_FILE_NAME);
+
+    printf("=== === (%d) Begin: EXTENT - Test for extent set operations\r\n", testId);
+    {
+        UINT localFailures = Test_Extent_Set();
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+    }
+    printf("=== === (%d)   End: EXTENT - Test for extent set operations\r\n\n", testId++);
+
+    printf("=== === (%d) Begin: BLOB - Test for reading the blobs of a dump file: %ls\r\n", testId, DEFAULT_DUMP_BLOB_FILE_NAME);
+    {
+        DEVICE_IO myTest;
+
+        UINT localFailures = Test_Dump_Blob(&myTest, DEFAULT_DUMP_BLOB_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+
+        myTest.Close();
+    }
+    printf("=== === (%d)   End: BLOB - Test for reading the blobs of a dump file: %ls\r\n\n", testId++, DEFAULT_DUMP_BLOB_FILE_NAME);
+
+    printf("=== === (%d) Begin: FINGERPRINT - Test for page fingerprints: %ls\r\n", testId, DEFAULT_FINGERPRINT_FILE_NAME);
+    {
+        UINT localFailures = Test_Page_Fingerprint(DEFAULT_FINGERPRINT_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+    }
+    printf("=== === (%d)   End: FINGERPRINT - Test for page fingerprints: %ls\r\n\n", testId++, DEFAULT_FINGERPRINT_FILE_NAME);
+
+    printf("=== === (%d) Begin: DMPLOG - Test for binary log records and their decoding: %ls\r\n", testId, DEFAULT_DMPLOG_FILE_NAME);
+    {
+        UINT localFailures = Test_DmpLog(DEFAULT_DMPLOG_FILE_NAME);
+        if (localFailures > 0)
+        {
+            totalFailed += localFailures;
+            scenarioFailures++;
+            printf(">>> Test scenario: FAILED (Failures: %d)\r\n", localFailures);
+        }
+        else
+        {
+            printf("\tTest scenario: PASSED\r\n");
+        }
+    }
+    printf("=== === (%d)   End: DMPLOG - Test for binary log records and their decoding: %ls\r\n\n", testId++, DEFAULT_DMPLOG_FILE_NAME);
+
     // // // //
     printf("=== END: Test Application for File_IO\r\n");
 
@@ -0,0 +1,214 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    dmplogdecode.cpp
+
+Abstract:
+    Renders a wpdmp log file as text. Text records are copied as is and the
+    binary records written by the DMPLOG_* macros are formatted with the format
+    strings found in the same file.
+
+Environment:
+    User Mode
+
+--*/
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logging.h"
+#include "dmplogdecode.h"
+
+/****************************************************************************************************
+**
+** Description:
+**  Returns the size of the binary record at Offset, or 0 if the bytes there are
+**  not a well formed record (the marker byte is then treated as text).
+**
+*****************************************************************************************************/
+static size_t GetBinaryRecordSize(const std::vector<UCHAR> &log, size_t offset)
+{
+    DMPLOG_BINARY_RECORD    record;
+
+    if ((log[offset] != DMPLOG_RECORD_MARKER) || ((log.size() - offset) < sizeof(record)))
+    {
+        return 0;
+    }
+
+    memcpy(&record, &log[offset], sizeof(record));
+
+    if (record.Type == DMPLOG_RECORD_FORMAT)
+    {
+        if ((record.Length == 0) || (record.Length > DMPLOG_MAX_FORMAT_LENGTH))
+        {
+            return 0;
+        }
+    }
+    else if (record.Type == DMPLOG_RECORD_EVENT)
+    {
+        if ((record.ArgumentCount > DMPLOG_MAX_ARGUMENTS) || (record.Length != record.ArgumentCount * sizeof(ULONGLONG)))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if ((log.size() - offset - sizeof(record)) < record.Length)
+    { // Truncated, most likely cut by the log wrapping around
+        return 0;
+    }
+
+    return sizeof(record) + record.Length;
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  Checks that a format string only uses integer conversions, so that it can
+**  be handed to printf with ULONGLONG arguments.
+**
+*****************************************************************************************************/
+static bool IsIntegerOnlyFormat(const std::string &format)
+{
+    for (size_t index = 0; index < format.size(); index++)
+    {
+        if (format[index] != '%')
+        {
+            continue;
+        }
+
+        index++;
+        if ((index < format.size()) && (format[index] == '%'))
+        {
+            continue;
+        }
+
+        // Skip flags, width, precision and length modifiers
+        while ((index < format.size()) && (strchr("-+ #0123456789.lhIjzt", format[index]) != nullptr))
+        {
+            index++;
+        }
+
+        if ((index >= format.size()) || (strchr("diouxXc", format[index]) == nullptr))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  Appends one DMPLOG_RECORD_EVENT record as text.
+**
+*****************************************************************************************************/
+static void RenderEvent(std::string &text, const std::map<ULONG, std::string> &formats, const DMPLOG_BINARY_RECORD &record, const UCHAR *payload)
+{
+    ULONGLONG   arguments[DMPLOG_MAX_ARGUMENTS] = { 0 };
+    char        buffer[DMPLOG_MAX_FORMAT_LENGTH * 2];
+
+    memcpy(arguments, payload, record.ArgumentCount * sizeof(ULONGLONG));
+
+    auto format = formats.find(record.FormatId);
+    if ((format == formats.end()) || !IsIntegerOnlyFormat(format->second))
+    {
+        _snprintf_s(buffer, sizeof(buffer), _TRUNCATE, "[format %#010x not found]", record.FormatId);
+        text.append(buffer);
+        for (UCHAR index = 0; index < record.ArgumentCount; index++)
+        {
+            _snprintf_s(buffer, sizeof(buffer), _TRUNCATE, " 0x%llx", arguments[index]);
+            text.append(buffer);
+        }
+        text.append("\n");
+        return;
+    }
+
+    _snprintf_s(buffer, sizeof(buffer), _TRUNCATE, format->second.c_str(), arguments[0], arguments[1], arguments[2], arguments[3]);
+    text.append(buffer);
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  Renders the contents of a log file, header included, as text.
+**
+**  The log is decoded in two passes: the first collects the format strings,
+**  which may be written after records using them once the log has wrapped,
+**  the second renders the file in order.
+**
+** Return:
+**  S_OK on success, HRESULT_FROM_WIN32(ERROR_INVALID_DATA) if Log is too small to
+**  be a log file.
+**
+*****************************************************************************************************/
+HRESULT DmpLogDecode(const std::vector<UCHAR> &Log, std::string &Text)
+{
+    std::map<ULONG, std::string>    formats;
+    DMPLOG_BINARY_RECORD            record;
+    size_t                          recordSize = 0;
+    size_t                          offset = 0;
+    size_t                          textStart = 0;
+
+    Text.clear();
+
+    if (Log.size() < sizeof(LOG_FILE_HEADER))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    //
+    // Pass 1: collect the format strings.
+    //
+    for (offset = sizeof(LOG_FILE_HEADER); offset < Log.size(); offset++)
+    {
+        if (0 != (recordSize = GetBinaryRecordSize(Log, offset)))
+        {
+            memcpy(&record, &Log[offset], sizeof(record));
+            if (record.Type == DMPLOG_RECORD_FORMAT)
+            {
+                formats[record.FormatId].assign((const char *)&Log[offset + sizeof(record)], record.Length);
+            }
+            offset += recordSize - 1;
+        }
+    }
+
+    //
+    // Pass 2: render.
+    //
+    textStart = sizeof(LOG_FILE_HEADER);
+    for (offset = sizeof(LOG_FILE_HEADER); offset < Log.size(); offset++)
+    {
+        if (0 == (recordSize = GetBinaryRecordSize(Log, offset)))
+        {
+            continue;
+        }
+
+        Text.append((const char *)&Log[textStart], offset - textStart);
+
+        memcpy(&record, &Log[offset], sizeof(record));
+        if (record.Type == DMPLOG_RECORD_EVENT)
+        {
+            RenderEvent(Text, formats, record, Log.data() + offset + sizeof(record));
+        }
+
+        offset += recordSize - 1;
+        textStart = offset + 1;
+    }
+
+    Text.append((const char *)Log.data() + textStart, Log.size() - textStart);
+
+    return S_OK;
+}
@@ -0,0 +1,29 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    dmplogdecode.h
+
+Abstract:
+    Renders a wpdmp log file as text, see DMPLOG_TRACE in logging.h.
+
+Environment:
+    User Mode
+
+--*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+//
+// Largest format string accepted in a DMPLOG_RECORD_FORMAT record.
+//
+#define DMPLOG_MAX_FORMAT_LENGTH    4096
+
+HRESULT
+DmpLogDecode(
+    _In_ const std::vector<UCHAR> &Log,
+    _Out_ std::string &Text
+);
@@ -34,16 +34,466 @@ HANDLE g_LogFileHandle = NULL;
 LOG_FILE_HEADER g_logFileHeader;
 
 //
-// Global Scratch buffer
+// Size of a single formatted log message.
 //
 #define SCRATCH_BUFFER_SIZE  4096
-CHAR g_ScratchBuffer[SCRATCH_BUFFER_SIZE];
 
 //
 // Bytes written in the file starting from the Header location.
 //
 ULONGLONG g_bytesFromBeginning = 0;
 
+//
+// Log records are queued in a bounded lock-free ring (multiple producers, one
+// consumer) and written to the file by a background thread, so that DmpLog
+// never waits on the disk. Each slot carries a sequence number: a producer owns
+// slot (pos % LOG_QUEUE_DEPTH) once its Sequence equals pos, and publishes it
+// by setting Sequence to pos + 1. The writer frees it again with
+// pos + LOG_QUEUE_DEPTH.
+//
+// LOG_QUEUE_DEPTH must be a power of two.
+//
+#define LOG_QUEUE_DEPTH         64
+#define LOG_QUEUE_MASK          (LOG_QUEUE_DEPTH - 1)
+
+//
+// The writer wakes up on its own this often; producers only signal it once
+// the ring is half full.
+//
+#define LOG_WRITER_IDLE_MS      100
+
+typedef struct _LOG_RECORD {
+    volatile LONG64 Sequence;
+    DWORD           Length;
+    CHAR            Text[SCRATCH_BUFFER_SIZE];
+} LOG_RECORD, *PLOG_RECORD;
+
+LOG_RECORD g_LogQueue[LOG_QUEUE_DEPTH];
+volatile LONG64 g_LogEnqueuePos = 0;
+volatile LONG64 g_LogDequeuePos = 0;
+
+//
+// Messages dropped because the ring was full. Reported in the log by the
+// writer the next time it gets to run.
+//
+volatile LONG g_LogDroppedRecords = 0;
+
+HANDLE g_LogWriterThread = NULL;
+HANDLE g_LogWriterEvent = NULL;
+volatile LONG g_LogWriterStop = FALSE;
+
+//
+// Formats registered by DMPLOG_* call sites. They are written again every
+// time the log wraps so that the decoder can still render the records that
+// follow.
+//
+#define DMPLOG_MAX_FORMATS      256
+
+typedef struct _DMPLOG_FORMAT {
+    volatile ULONG  FormatId;       // Set last, 0 while the entry is being filled
+    ULONG           Level;
+    PCSTR           Format;
+} DMPLOG_FORMAT, *PDMPLOG_FORMAT;
+
+DMPLOG_FORMAT g_LogFormats[DMPLOG_MAX_FORMATS];
+volatile LONG g_LogFormatCount = 0;
+
+//
+// Entries of g_LogFormats already written by the writer thread. Format
+// definitions do not go through the ring, so they are never dropped.
+//
+LONG g_LogFormatsWritten = 0;
+
+static
+VOID
+WriteFormatTable(
+);
+
+static
+VOID
+WriteLogRecord(
+    _In_reads_bytes_(BufferLength) PCSTR Buffer,
+    _In_ DWORD BufferLength
+)
+/*++
+
+Routine Description:
+This routine writes one formatted record at the current file position and
+wraps around to the first byte after the header once LOG_FILE_SIZE is crossed.
+
+Arguments:
+Buffer - Formatted record.
+
+BufferLength - Length of the record in bytes.
+
+Return Value:
+None.
+
+--*/
+{
+    BOOL result;
+    DWORD dwBytesWritten;
+
+    result = WriteFile(g_LogFileHandle, Buffer,
+        BufferLength, &dwBytesWritten,
+        NULL);
+
+    g_bytesFromBeginning += BufferLength;
+    if (!result || g_bytesFromBeginning > LOG_FILE_SIZE) {
+        //
+        // We have crossed the 
+        LARGE_INTEGER offset;
+        offset.QuadPart = sizeof(LOG_FILE_HEADER);
+        result = SetFilePointerEx(g_LogFileHandle, offset,
+            NULL, FILE_BEGIN);
+        if (!result) {
+            //
+            // If there was an error writing to a file, most likely cause
+            // is that the log file is full. Resetting cursor to the
+            // beginning
+            //
+            WriteFile(g_LogFileHandle, Buffer,
+                BufferLength, &dwBytesWritten,
+                NULL);
+        } // if (SUCCEEDED(result) && !result)
+        else {
+            g_bytesFromBeginning = sizeof(LOG_FILE_HEADER);
+            WriteFormatTable();
+        }
+    } // if (!result || g_bytesFromBeginning > LOG_FILE_SIZE)
+}
+
+static
+DWORD
+BuildFormatRecord(
+    _Out_writes_bytes_(BufferSize) PCHAR Buffer,
+    _In_ DWORD BufferSize,
+    _In_ ULONG Level,
+    _In_ ULONG FormatId,
+    _In_ PCSTR Format
+)
+/*++
+
+Routine Description:
+This routine builds a DMPLOG_RECORD_FORMAT record.
+
+Return Value:
+Size of the record, 0 if it does not fit.
+
+--*/
+{
+    PDMPLOG_BINARY_RECORD header = (PDMPLOG_BINARY_RECORD)Buffer;
+    size_t length = strlen(Format);
+
+    if (length > BufferSize - sizeof(DMPLOG_BINARY_RECORD)) {
+        return 0;
+    }
+
+    header->Marker = DMPLOG_RECORD_MARKER;
+    header->Type = DMPLOG_RECORD_FORMAT;
+    header->Level = (UCHAR)Level;
+    header->ArgumentCount = 0;
+    header->FormatId = FormatId;
+    header->Length = (ULONG)length;
+    memcpy(header + 1, Format, length);
+
+    return (DWORD)(sizeof(DMPLOG_BINARY_RECORD) + length);
+}
+
+static
+DWORD
+BuildEventRecord(
+    _Out_writes_bytes_(BufferSize) PCHAR Buffer,
+    _In_ DWORD BufferSize,
+    _In_ ULONG Level,
+    _In_ ULONG FormatId,
+    _In_ ULONG ArgumentCount,
+    _In_reads_(ArgumentCount) const ULONGLONG *Arguments
+)
+/*++
+
+Routine Description:
+This routine builds a DMPLOG_RECORD_EVENT record.
+
+Return Value:
+Size of the record, 0 if it does not fit.
+
+--*/
+{
+    PDMPLOG_BINARY_RECORD header = (PDMPLOG_BINARY_RECORD)Buffer;
+    DWORD length = ArgumentCount * sizeof(ULONGLONG);
+
+    if (length > BufferSize - sizeof(DMPLOG_BINARY_RECORD)) {
+        return 0;
+    }
+
+    header->Marker = DMPLOG_RECORD_MARKER;
+    header->Type = DMPLOG_RECORD_EVENT;
+    header->Level = (UCHAR)Level;
+    header->ArgumentCount = (UCHAR)ArgumentCount;
+    header->FormatId = FormatId;
+    header->Length = length;
+    memcpy(header + 1, Arguments, length);
+
+    return (DWORD)(sizeof(DMPLOG_BINARY_RECORD) + length);
+}
+
+static
+VOID
+WriteFormatTable(
+)
+/*++
+
+Routine Description:
+This routine writes every registered format right after the log wrapped, the
+definitions written earlier may have been overwritten.
+
+Arguments:
+None
+
+Return Value:
+None.
+
+--*/
+{
+    CHAR buffer[SCRATCH_BUFFER_SIZE];
+    LONG count = g_LogFormatCount;
+    LONG index;
+    DWORD length;
+    DWORD dwBytesWritten;
+
+    if (count > DMPLOG_MAX_FORMATS) {
+        count = DMPLOG_MAX_FORMATS;
+    }
+
+    for (index = 0; index < count; index++) {
+        if (g_LogFormats[index].FormatId == 0) {
+            continue;
+        }
+
+        length = BuildFormatRecord(buffer, sizeof(buffer),
+                    g_LogFormats[index].Level,
+                    g_LogFormats[index].FormatId,
+                    g_LogFormats[index].Format);
+        if (length != 0 &&
+            WriteFile(g_LogFileHandle, buffer, length, &dwBytesWritten, NULL)) {
+            g_bytesFromBeginning += length;
+        }
+    }
+}
+
+static
+VOID
+WritePendingFormats(
+)
+/*++
+
+Routine Description:
+This routine writes the formats registered since it last ran. Only the writer
+thread (or CloseLogFile once the writer is gone) calls it.
+
+Arguments:
+None
+
+Return Value:
+None.
+
+--*/
+{
+    CHAR buffer[SCRATCH_BUFFER_SIZE];
+    LONG count = g_LogFormatCount;
+    PDMPLOG_FORMAT format;
+    DWORD length;
+
+    if (count > DMPLOG_MAX_FORMATS) {
+        count = DMPLOG_MAX_FORMATS;
+    }
+
+    while (g_LogFormatsWritten < count) {
+        format = &g_LogFormats[g_LogFormatsWritten];
+        if (format->FormatId == 0) {
+            //
+            // Still being filled in, pick it up on the next pass.
+            //
+            break;
+        }
+        MemoryBarrier();
+
+        length = BuildFormatRecord(buffer, sizeof(buffer),
+                    format->Level,
+                    format->FormatId,
+                    format->Format);
+        if (length != 0) {
+            WriteLogRecord(buffer, length);
+        }
+        g_LogFormatsWritten++;
+    }
+}
+
+static
+VOID
+DrainLogQueue(
+)
+/*++
+
+Routine Description:
+This routine writes every published record to the log file, in order. Only
+the writer thread (or CloseLogFile once the writer is gone) calls it.
+
+Arguments:
+None
+
+Return Value:
+None.
+
+--*/
+{
+    PLOG_RECORD record;
+    LONG64 sequence;
+    LONG dropped;
+    CHAR notice[64];
+
+    //
+    // Definitions go first so that the records using them can be decoded.
+    //
+    WritePendingFormats();
+
+    for (;;) {
+        record = &g_LogQueue[g_LogDequeuePos & LOG_QUEUE_MASK];
+        sequence = record->Sequence;
+        MemoryBarrier();
+        if (sequence != g_LogDequeuePos + 1) {
+            //
+            // Next slot is not published yet.
+            //
+            break;
+        }
+
+        if (record->Length != 0) {
+            WriteLogRecord(record->Text, record->Length);
+        }
+
+        InterlockedExchange64(&record->Sequence, g_LogDequeuePos + LOG_QUEUE_DEPTH);
+        g_LogDequeuePos++;
+    }
+
+    dropped = InterlockedExchange(&g_LogDroppedRecords, 0);
+    if (dropped != 0 &&
+        SUCCEEDED(StringCbPrintfA(notice, sizeof(notice),
+            "\r\n*** %ld log records dropped ***\r\n", dropped))) {
+        WriteLogRecord(notice, (DWORD)strlen(notice));
+    }
+}
+
+static
+DWORD
+WINAPI
+LogWriterThread(
+    _In_ LPVOID Parameter
+)
+{
+    BOOL stop;
+
+    UNREFERENCED_PARAMETER(Parameter);
+
+    for (;;) {
+        //
+        // Sample the stop flag before draining so that everything queued
+        // before CloseLogFile asked us to stop is written.
+        //
+        stop = (InterlockedCompareExchange(&g_LogWriterStop, FALSE, FALSE) != FALSE);
+        DrainLogQueue();
+        if (stop) {
+            break;
+        }
+
+        WaitForSingleObject(g_LogWriterEvent, LOG_WRITER_IDLE_MS);
+    }
+
+    return 0;
+}
+
+static
+HRESULT
+StartLogWriter(
+)
+/*++
+
+Routine Description:
+This routine resets the log queue and starts the background writer thread.
+
+Arguments:
+None
+
+Return Value:
+HRESULT
+
+--*/
+{
+    HRESULT hr = S_OK;
+    LONG64 index;
+
+    for (index = 0; index < LOG_QUEUE_DEPTH; index++) {
+        g_LogQueue[index].Sequence = index;
+        g_LogQueue[index].Length = 0;
+    }
+
+    g_LogEnqueuePos = 0;
+    g_LogDequeuePos = 0;
+    g_LogDroppedRecords = 0;
+    g_LogWriterStop = FALSE;
+    g_LogFormatsWritten = 0;
+
+    g_LogWriterEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (g_LogWriterEvent == NULL) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    g_LogWriterThread = CreateThread(nullptr, 0, LogWriterThread, nullptr, 0, nullptr);
+    if (g_LogWriterThread == NULL) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(g_LogWriterEvent);
+        g_LogWriterEvent = NULL;
+        goto Exit;
+    }
+
+Exit:
+    return hr;
+}
+
+static
+VOID
+StopLogWriter(
+)
+/*++
+
+Routine Description:
+This routine flushes the log queue and stops the background writer thread.
+Records still queued when it returns are written by the caller.
+
+Arguments:
+None
+
+Return Value:
+None.
+
+--*/
+{
+    if (g_LogWriterThread == NULL) {
+        return;
+    }
+
+    InterlockedExchange(&g_LogWriterStop, TRUE);
+    SetEvent(g_LogWriterEvent);
+    WaitForSingleObject(g_LogWriterThread, INFINITE);
+
+    CloseHandle(g_LogWriterThread);
+    g_LogWriterThread = NULL;
+    CloseHandle(g_LogWriterEvent);
+    g_LogWriterEvent = NULL;
+}
+
 
 
 VOID
@@ -130,6 +580,16 @@ HRESULT
 
     result = SetFilePointerEx(g_LogFileHandle, offset,
                 NULL, FILE_BEGIN);
+
+    //
+    // Without the writer thread DmpLog falls back to writing synchronously.
+    //
+    hr = StartLogWriter();
+    if (FAILED(hr)) {
+        wprintf(L"OpenLogFile:Failed to start log writer 0x%x\n\r", hr);
+        hr = S_OK;
+    }
+
     GetSystemTime(&st);
 
     DmpLog("\r\n\r\n********** Offline Crash log opened[%I64u]: %u/%u/%u %u:%u:%u:%u **********\r\n\r\n",
@@ -223,6 +683,12 @@ HRESULT
         st.wSecond,
         st.wMilliseconds);
 
+    //
+    // Write out everything still queued before the file position is saved.
+    //
+    StopLogWriter();
+    DrainLogQueue();
+
     low_word = SetFilePointer(g_LogFileHandle, offset, &high_word, FILE_CURRENT);
     if (low_word == INVALID_SET_FILE_POINTER) {
         hr = HRESULT_FROM_WIN32(GetLastError());
@@ -261,6 +727,7 @@ Cleanup:
     if (g_LogFileHandle != INVALID_HANDLE_VALUE) {
         CloseHandle(g_LogFileHandle);
     }
+    g_LogFileHandle = NULL;
 
 Exit:
     return hr;
@@ -285,17 +752,105 @@ HRESULT
 {
     HRESULT hr = E_FAIL;
     if (g_LogFileHandle != INVALID_HANDLE_VALUE) {
+        //
+        // Write out everything still queued before the handle goes away.
+        //
+        StopLogWriter();
+        DrainLogQueue();
+
         if(CloseHandle(g_LogFileHandle)) {
             hr = S_OK;
         }
         else {
             hr = HRESULT_FROM_WIN32(GetLastError());
         }
+        g_LogFileHandle = NULL;
     }
     return hr;
 }
 
 
+static
+PLOG_RECORD
+ClaimLogRecord(
+    _Out_ LONG64 *Position
+)
+/*++
+
+Routine Description:
+This routine claims the next free slot of the log queue. The caller fills it
+in and hands it to the writer with PublishLogRecord.
+
+Arguments:
+Position - Receives the queue position of the slot.
+
+Return Value:
+The slot, or nullptr if the queue is full. The message is then dropped
+rather than blocking the caller.
+
+--*/
+{
+    PLOG_RECORD record;
+    LONG64 position;
+    LONG64 sequence;
+    LONG64 claimed;
+
+    position = g_LogEnqueuePos;
+    for (;;) {
+        record = &g_LogQueue[position & LOG_QUEUE_MASK];
+        sequence = record->Sequence;
+        MemoryBarrier();
+
+        if (sequence == position) {
+            claimed = InterlockedCompareExchange64(&g_LogEnqueuePos, position + 1, position);
+            if (claimed == position) {
+                break;
+            }
+            position = claimed;
+        }
+        else if (sequence < position) {
+            //
+            // The ring is full, the writer is behind.
+            //
+            InterlockedIncrement(&g_LogDroppedRecords);
+            SetEvent(g_LogWriterEvent);
+            return nullptr;
+        }
+        else {
+            //
+            // Another producer took this slot, retry with the new position.
+            //
+            position = g_LogEnqueuePos;
+        }
+    }
+
+    *Position = position;
+    return record;
+}
+
+static
+VOID
+PublishLogRecord(
+    _Inout_ PLOG_RECORD Record,
+    _In_ LONG64 Position,
+    _In_ DWORD Length
+)
+/*++
+
+Routine Description:
+This routine hands a claimed slot to the writer. A slot has to be published
+even if there is nothing to write (Length 0), the writer skips it.
+
+--*/
+{
+    Record->Length = Length;
+    InterlockedExchange64(&Record->Sequence, Position + 1);
+
+    if ((Position + 1 - g_LogDequeuePos) >= (LOG_QUEUE_DEPTH / 2)) {
+        SetEvent(g_LogWriterEvent);
+    }
+}
+
 VOID
 DmpLog(
 _In_ PCSTR Format,
@@ -304,7 +859,10 @@ _In_ PCSTR Format,
 
 /*++
 Routine Description:
-This function writes to wpdmp log file.
+This function queues a message for the wpdmp log file. It is safe to call
+from several threads and does not wait on the disk: the message is formatted
+into a free slot of the log queue and written later by the writer thread.
+If the queue is full the message is dropped and counted.
 
 Arguments:
 Format - String format.
@@ -318,48 +876,197 @@ None.
 {
     HRESULT hr;
     va_list Arglist;
-    BOOL result;
-    DWORD dwBytesWritten;
-    DWORD bufferLength;
+    PLOG_RECORD record;
+    LONG64 position;
 
     if (g_LogFileHandle == NULL || g_LogFileHandle == INVALID_HANDLE_VALUE) {
         goto Exit;
     }
-        
+
+    if (g_LogWriterThread == NULL) {
+        //
+        // No writer thread (log opened without one, or it failed to start).
+        //
+        CHAR buffer[SCRATCH_BUFFER_SIZE];
+
+        va_start(Arglist, Format);
+        hr = RtlStringCbVPrintfA(buffer, SCRATCH_BUFFER_SIZE,
+            Format, Arglist);
+        va_end(Arglist);
+        if (SUCCEEDED(hr)) {
+            WriteLogRecord(buffer, (DWORD)strlen(buffer));
+        }
+        goto Exit;
+    }
+
+    record = ClaimLogRecord(&position);
+    if (record == nullptr) {
+        goto Exit;
+    }
+
     va_start(Arglist, Format);
-    hr = RtlStringCbVPrintfA(g_ScratchBuffer, SCRATCH_BUFFER_SIZE,
-        Format, Arglist);        
+    hr = RtlStringCbVPrintfA(record->Text, SCRATCH_BUFFER_SIZE,
+        Format, Arglist);
     va_end(Arglist);
-    if (!SUCCEEDED(hr)) {
+
+    PublishLogRecord(record, position, SUCCEEDED(hr) ? (DWORD)strlen(record->Text) : 0);
+
+Exit:
+    return;
+}
+
+
+VOID
+DmpLogRegisterFormat(
+_Inout_ volatile LONG *FormatId,
+_In_ ULONG Level,
+_In_ PCSTR Format
+)
+
+/*++
+Routine Description:
+This function registers the format string of a DMPLOG_* call site and hands
+its definition to the log file. Threads racing on the first call of a call
+site all publish the same ID, only the one that publishes it first adds the
+format to the table.
+
+Arguments:
+FormatId - Format ID of the call site, 0 until it is registered. Receives the
+    FNV-1a hash of the format string, never 0.
+
+Level - DMPLOG_LEVEL_* of the call site.
+
+Format - Format string, must stay valid for the life of the process.
+
+Return Value:
+None.
+
+--*/
+{
+    ULONG formatId = 2166136261;
+    PCSTR current;
+    LONG index;
+    PLOG_RECORD record;
+    LONG64 position;
+
+    for (current = Format; *current != '\0'; current++) {
+        formatId = (formatId ^ (UCHAR)*current) * 16777619;
+    }
+
+    if (formatId == 0) {
+        formatId = 1;
+    }
+
+    if (InterlockedCompareExchange(FormatId, (LONG)formatId, 0) != 0) {
+        //
+        // Another thread registered this call site first.
+        //
         goto Exit;
     }
 
-    bufferLength = (DWORD)strlen(g_ScratchBuffer);
-    result = WriteFile(g_LogFileHandle, g_ScratchBuffer,
-        bufferLength, &dwBytesWritten,
-        NULL);
+    index = InterlockedIncrement(&g_LogFormatCount) - 1;
+    if (index < DMPLOG_MAX_FORMATS) {
+        g_LogFormats[index].Level = Level;
+        g_LogFormats[index].Format = Format;
+        InterlockedExchange((volatile LONG *)&g_LogFormats[index].FormatId, (LONG)formatId);
+    }
 
-    g_bytesFromBeginning += bufferLength;
-    if (!result || g_bytesFromBeginning > LOG_FILE_SIZE) {
+    if (g_LogFileHandle == NULL || g_LogFileHandle == INVALID_HANDLE_VALUE) {
+        goto Exit;
+    }
+
+    if (g_LogWriterThread == NULL) {
+        CHAR buffer[SCRATCH_BUFFER_SIZE];
+        DWORD length = BuildFormatRecord(buffer, sizeof(buffer), Level, formatId, Format);
+
+        if (length != 0) {
+            WriteLogRecord(buffer, length);
+        }
+        goto Exit;
+    }
+
+    if (index < DMPLOG_MAX_FORMATS) {
         //
-        // We have crossed the 
-        LARGE_INTEGER offset;
-        offset.QuadPart = sizeof(LOG_FILE_HEADER);
-        result = SetFilePointerEx(g_LogFileHandle, offset,
-            NULL, FILE_BEGIN);
-        if (!result) {
-            //
-            // If there was an error writing to a file, most likely cause
-            // is that the log file is full. Resetting cursor to the
-            // beginning
-            //
-            WriteFile(g_LogFileHandle, g_ScratchBuffer,
-                bufferLength, &dwBytesWritten,
-                NULL);
-        } // if (SUCCEEDED(result) && !result)
-    } // if (!result || g_bytesFromBeginning > LOG_FILE_SIZE)
+        // The writer takes it from g_LogFormats, see WritePendingFormats.
+        //
+        goto Exit;
+    }
+
+    //
+    // The table is full, queue the definition. It is lost if the ring is
+    // full as well.
+    //
+    record = ClaimLogRecord(&position);
+    if (record == nullptr) {
+        goto Exit;
+    }
+
+    PublishLogRecord(record, position,
+        BuildFormatRecord(record->Text, SCRATCH_BUFFER_SIZE, Level, formatId, Format));
 
 Exit:
     return;
 }
 
+
+VOID
+DmpLogBinary(
+_In_ ULONG Level,
+_In_ ULONG FormatId,
+_In_ ULONG ArgumentCount,
+_In_ ULONGLONG Argument1,
+_In_ ULONGLONG Argument2,
+_In_ ULONGLONG Argument3,
+_In_ ULONGLONG Argument4
+)
+
+/*++
+Routine Description:
+This function queues a binary trace record: the format ID and the raw
+argument values, nothing is formatted.
+
+Arguments:
+Level - DMPLOG_LEVEL_* of the call site.
+
+FormatId - ID published by DmpLogRegisterFormat.
+
+ArgumentCount - Number of valid arguments, at most DMPLOG_MAX_ARGUMENTS.
+
+Argument1-4 - Argument values.
+
+Return Value:
+None.
+
+--*/
+{
+    ULONGLONG arguments[DMPLOG_MAX_ARGUMENTS] = { Argument1, Argument2, Argument3, Argument4 };
+    PLOG_RECORD record;
+    LONG64 position;
+
+    if (g_LogFileHandle == NULL || g_LogFileHandle == INVALID_HANDLE_VALUE) {
+        goto Exit;
+    }
+
+    if (ArgumentCount > DMPLOG_MAX_ARGUMENTS) {
+        ArgumentCount = DMPLOG_MAX_ARGUMENTS;
+    }
+
+    if (g_LogWriterThread == NULL) {
+        CHAR buffer[sizeof(DMPLOG_BINARY_RECORD) + sizeof(arguments)];
+        DWORD length = BuildEventRecord(buffer, sizeof(buffer), Level, FormatId, ArgumentCount, arguments);
+
+        WriteLogRecord(buffer, length);
+        goto Exit;
+    }
+
+    record = ClaimLogRecord(&position);
+    if (record == nullptr) {
+        goto Exit;
+    }
+
+    PublishLogRecord(record, position,
+        BuildEventRecord(record->Text, SCRATCH_BUFFER_SIZE, Level, FormatId, ArgumentCount, arguments));
+
+Exit:
+    return;
+}
@@ -42,4 +42,99 @@ VOID
 DmpLog(
 _In_ PCSTR Format,
 ...
-);
\ No newline at end of file
+);
+
+//
+// Binary trace records
+//
+// DMPLOG_* calls do not format anything on the device. Each call site registers
+// its format string once and from then on only logs the format ID and the raw
+// argument values. The ID is a hash of the format string so it is the same for
+// every run. Records are written between the text records of the log file and
+// DmpLogDecode (dmplogdecode.h) renders them back to text.
+//
+// Format strings may only use integer conversions, every argument is logged as
+// a ULONGLONG.
+//
+#define DMPLOG_LEVEL_VERBOSE        1
+#define DMPLOG_LEVEL_INFO           2
+#define DMPLOG_LEVEL_WARNING        3
+#define DMPLOG_LEVEL_ERROR          4
+
+//
+// Calls below this level compile to nothing. Override in C_DEFINES.
+//
+#ifndef DMPLOG_MIN_LEVEL
+#define DMPLOG_MIN_LEVEL            DMPLOG_LEVEL_VERBOSE
+#endif
+
+#define DMPLOG_MAX_ARGUMENTS        4
+
+//
+// Binary records start with the ASCII record separator, which never appears in
+// text records.
+//
+#define DMPLOG_RECORD_MARKER        0x1E
+#define DMPLOG_RECORD_FORMAT        1   // Followed by Length bytes of format string (no NUL)
+#define DMPLOG_RECORD_EVENT         2   // Followed by ArgumentCount ULONGLONGs
+
+typedef struct _DMPLOG_BINARY_RECORD {
+    UCHAR Marker;
+    UCHAR Type;
+    UCHAR Level;
+    UCHAR ArgumentCount;
+    ULONG FormatId;
+    ULONG Length;                   // Bytes following this header
+} DMPLOG_BINARY_RECORD, *PDMPLOG_BINARY_RECORD;
+
+VOID
+DmpLogRegisterFormat(
+_Inout_ volatile LONG *FormatId,
+_In_ ULONG Level,
+_In_ PCSTR Format
+);
+
+VOID
+DmpLogBinary(
+_In_ ULONG Level,
+_In_ ULONG FormatId,
+_In_ ULONG ArgumentCount,
+_In_ ULONGLONG Argument1,
+_In_ ULONGLONG Argument2,
+_In_ ULONGLONG Argument3,
+_In_ ULONGLONG Argument4
+);
+
+#define DMPLOG_TRACE(Level, Format, Count, A1, A2, A3, A4)                     \
+    do {                                                                        \
+        static volatile LONG s_DmpLogFormatId = 0;                              \
+        if (s_DmpLogFormatId == 0) {                                            \
+            DmpLogRegisterFormat(&s_DmpLogFormatId, (Level), (Format));         \
+        }                                                                       \
+        DmpLogBinary((Level), (ULONG)s_DmpLogFormatId, (Count),                 \
+            (ULONGLONG)(A1), (ULONGLONG)(A2), (ULONGLONG)(A3), (ULONGLONG)(A4));\
+    } while (0)
+
+#if DMPLOG_MIN_LEVEL <= DMPLOG_LEVEL_VERBOSE
+#define DMPLOG_VERBOSE(Format, Count, A1, A2, A3, A4) DMPLOG_TRACE(DMPLOG_LEVEL_VERBOSE, Format, Count, A1, A2, A3, A4)
+#else
+#define DMPLOG_VERBOSE(Format, Count, A1, A2, A3, A4) ((void)0)
+#endif
+
+#if DMPLOG_MIN_LEVEL <= DMPLOG_LEVEL_INFO
+#define DMPLOG_INFO(Format, Count, A1, A2, A3, A4) DMPLOG_TRACE(DMPLOG_LEVEL_INFO, Format, Count, A1, A2, A3, A4)
+#else
+#define DMPLOG_INFO(Format, Count, A1, A2, A3, A4) ((void)0)
+#endif
+
+#if DMPLOG_MIN_LEVEL <= DMPLOG_LEVEL_WARNING
+#define DMPLOG_WARNING(Format, Count, A1, A2, A3, A4) DMPLOG_TRACE(DMPLOG_LEVEL_WARNING, Format, Count, A1, A2, A3, A4)
+#else
+#define DMPLOG_WARNING(Format, Count, A1, A2, A3, A4) ((void)0)
+#endif
+
+#if DMPLOG_MIN_LEVEL <= DMPLOG_LEVEL_ERROR
+#define DMPLOG_ERROR(Format, Count, A1, A2, A3, A4) DMPLOG_TRACE(DMPLOG_LEVEL_ERROR, Format, Count, A1, A2, A3, A4)
+#else
+#define DMPLOG_ERROR(Format, Count, A1, A2, A3, A4) ((void)0)
+#endif
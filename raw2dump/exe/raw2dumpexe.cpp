@@ -9,11 +9,317 @@
 #include <Strsafe.h>
 #include "rawdump.h"
 #include "common.h"
+#include "ConversionServer.h"
 
 #define RAWDUMP_INFO_FILE_NAME L"rawdumpinfo.xml"
 #define RAWDUMP_LOGFILE_NAME L"offlinecrash.log"
 
 typedef HRESULT(CALLBACK* ConvertRawToDump)(LPWSTR, LPWSTR, LPWSTR, LPWSTR);
+typedef HRESULT(CALLBACK* VerifyRawToDump)(LPWSTR, LPWSTR, PUINT64);
+typedef HRESULT(CALLBACK* SearchRawDump)(LPWSTR, UINT32, LPWSTR*, LPWSTR, PUINT64);
+typedef HRESULT(CALLBACK* RunConversionServer)(LPWSTR, UINT32, UINT64);
+typedef HRESULT(CALLBACK* PlanRawToDumpShards)(LPWSTR, LPWSTR, LPWSTR, LPWSTR, UINT32);
+typedef HRESULT(CALLBACK* ConvertRawToDumpShard)(LPWSTR, LPWSTR, LPWSTR, LPWSTR, UINT32);
+typedef HRESULT(CALLBACK* StitchRawToDumpShards)(LPWSTR, LPWSTR, LPWSTR, LPWSTR);
+
+int VerifyDump(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR dumpFile)
+{
+    VerifyRawToDump pfnVerifyRawToDump = nullptr;
+    UINT64 mismatchedBytes = 0;
+
+    pfnVerifyRawToDump = (VerifyRawToDump)GetProcAddress(hoffdump, "VerifyRawToDump");
+    if (nullptr == pfnVerifyRawToDump) {
+        wprintf(L"GetProcAddress(VerifyRawToDump) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Verifying %s against %s\r\n", dumpFile, rawFile);
+    HRESULT hr = pfnVerifyRawToDump(rawFile, dumpFile, &mismatchedBytes);
+    if (FAILED(hr)) {
+        wprintf(L"VerifyRawToDump failed %x\r\n", hr);
+        return 2;
+    }
+    else if (S_FALSE == hr) {
+        wprintf(L"Dump file differs from the raw file, 0x%llx bytes of memory mismatched\r\n", mismatchedBytes);
+        return 5;
+    }
+
+    wprintf(L"Dump file matches the raw file\r\n");
+    return 0;
+}
+
+int SearchDump(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR resultFile, UINT32 patternCount, LPWSTR *patterns)
+{
+    SearchRawDump pfnSearchRawDump = nullptr;
+    UINT64 hitCount = 0;
+
+    pfnSearchRawDump = (SearchRawDump)GetProcAddress(hoffdump, "SearchRawDump");
+    if (nullptr == pfnSearchRawDump) {
+        wprintf(L"GetProcAddress(SearchRawDump) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Searching %s for %u patterns\r\n", rawFile, patternCount);
+    HRESULT hr = pfnSearchRawDump(rawFile, patternCount, patterns, resultFile, &hitCount);
+    if (FAILED(hr)) {
+        wprintf(L"SearchRawDump failed %x\r\n", hr);
+        return 2;
+    }
+    else if (S_FALSE == hr) {
+        wprintf(L"Search stopped after 0x%llx hits, see %s\r\n", hitCount, resultFile);
+        return 0;
+    }
+
+    wprintf(L"0x%llx hits written to %s\r\n", hitCount, resultFile);
+    return 0;
+}
+
+int ServeJobs(HINSTANCE hoffdump, LPWSTR budgetMB, LPWSTR maxJobs)
+{
+    RunConversionServer pfnRunConversionServer = nullptr;
+    UINT64 memoryBudget = (budgetMB != nullptr) ? (wcstoull(budgetMB, nullptr, 0) * 1024 * 1024) : 0;
+    UINT32 jobs = (maxJobs != nullptr) ? wcstoul(maxJobs, nullptr, 0) : 0;
+
+    pfnRunConversionServer = (RunConversionServer)GetProcAddress(hoffdump, "RunConversionServer");
+    if (nullptr == pfnRunConversionServer) {
+        wprintf(L"GetProcAddress(RunConversionServer) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Serving conversion jobs on %s\r\n", CONVERSION_SERVER_PIPE_NAME);
+    HRESULT hr = pfnRunConversionServer(nullptr, jobs, memoryBudget);
+    if (FAILED(hr)) {
+        wprintf(L"RunConversionServer failed %x\r\n", hr);
+        return 2;
+    }
+
+    return 0;
+}
+
+int SendToServer(PCONVERSION_SUBMIT_MESSAGE request)
+{
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    DWORD bytes = 0;
+    CONVERSION_STATUS_MESSAGE status;
+    int retVal = 6;
+
+    //
+    // Wait for a free pipe instance while the server is busy accepting another client.
+    //
+    for (;;) {
+        pipe = CreateFileW(CONVERSION_SERVER_PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (pipe != INVALID_HANDLE_VALUE) {
+            break;
+        }
+
+        if ((GetLastError() != ERROR_PIPE_BUSY) || !WaitNamedPipeW(CONVERSION_SERVER_PIPE_NAME, 30000)) {
+            wprintf(L"Failed to connect to the conversion server %d\r\n", GetLastError());
+            return 6;
+        }
+    }
+
+    if (!SetNamedPipeHandleState(pipe, &mode, nullptr, nullptr) ||
+        !WriteFile(pipe, request, sizeof(*request), &bytes, nullptr)) {
+        wprintf(L"Failed to send the request to the conversion server %d\r\n", GetLastError());
+        goto Exit;
+    }
+
+    for (;;) {
+        if (!ReadFile(pipe, &status, sizeof(status), &bytes, nullptr) ||
+            (bytes != sizeof(status)) ||
+            (status.Header.Signature != CONVERSION_MESSAGE_SIGNATURE)) {
+            wprintf(L"Conversion server closed the connection %d\r\n", GetLastError());
+            goto Exit;
+        }
+
+        status.Stage[ARRAYSIZE(status.Stage) - 1] = '\0';
+
+        if (status.Header.Type == ConversionMessageQueued) {
+            wprintf(L"Queued behind %llu jobs\r\n", status.Value1);
+        } else if (status.Header.Type == ConversionMessageProgress) {
+            wprintf(L"  %S: %llu%%\r\n", status.Stage, (status.Value2 != 0) ? ((status.Value1 * 100) / status.Value2) : 0);
+        } else if (status.Header.Type == ConversionMessageRejected) {
+            wprintf(L"Conversion server rejected the request %x\r\n", status.hr);
+            goto Exit;
+        } else if (status.Header.Type == ConversionMessageComplete) {
+            if (FAILED(status.hr)) {
+                wprintf(L"Conversion failed %x\r\n", status.hr);
+                retVal = 2;
+            } else {
+                wprintf(L"Conversion done, 0x%llx bytes of budgeted memory at peak\r\n", status.Value1);
+                retVal = 0;
+            }
+            goto Exit;
+        }
+    }
+
+Exit:
+    CloseHandle(pipe);
+    return retVal;
+}
+
+int SubmitJob(LPWSTR rawFile, LPWSTR dumpFile, LPWSTR infoFile, LPWSTR logFile)
+{
+    CONVERSION_SUBMIT_MESSAGE request = { 0 };
+
+    request.Header.Signature = CONVERSION_MESSAGE_SIGNATURE;
+    request.Header.Version = CONVERSION_MESSAGE_VERSION;
+    request.Header.Type = ConversionMessageSubmit;
+    request.Header.Size = sizeof(request);
+
+    //
+    // The server does not share our current directory.
+    //
+    if ((0 == GetFullPathNameW(rawFile, ARRAYSIZE(request.RawDumpPath), request.RawDumpPath, nullptr)) ||
+        (0 == GetFullPathNameW(dumpFile, ARRAYSIZE(request.DumpPath), request.DumpPath, nullptr)) ||
+        ((infoFile != nullptr) && (0 == GetFullPathNameW(infoFile, ARRAYSIZE(request.RawInfoPath), request.RawInfoPath, nullptr))) ||
+        ((logFile != nullptr) && (0 == GetFullPathNameW(logFile, ARRAYSIZE(request.LogPath), request.LogPath, nullptr)))) {
+        wprintf(L"GetFullPathName failed %d\r\n", GetLastError());
+        return 1;
+    }
+
+    wprintf(L"       RAWDUMP FILE: %s\r\n", request.RawDumpPath);
+    wprintf(L"  Windows Dump FILE: %s\r\n", request.DumpPath);
+    return SendToServer(&request);
+}
+
+int StopServer()
+{
+    CONVERSION_SUBMIT_MESSAGE request = { 0 };
+
+    request.Header.Signature = CONVERSION_MESSAGE_SIGNATURE;
+    request.Header.Version = CONVERSION_MESSAGE_VERSION;
+    request.Header.Type = ConversionMessageShutdown;
+    request.Header.Size = sizeof(request);
+
+    wprintf(L"Stopping the conversion server once its queued jobs are done\r\n");
+    return SendToServer(&request);
+}
+
+int PlanShards(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR dumpFile, UINT32 shardCount)
+{
+    PlanRawToDumpShards pfnPlanRawToDumpShards = nullptr;
+
+    pfnPlanRawToDumpShards = (PlanRawToDumpShards)GetProcAddress(hoffdump, "PlanRawToDumpShards");
+    if (nullptr == pfnPlanRawToDumpShards) {
+        wprintf(L"GetProcAddress(PlanRawToDumpShards) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Planning %u shards of %s\r\n", shardCount, dumpFile);
+    HRESULT hr = pfnPlanRawToDumpShards(rawFile, NULL, NULL, dumpFile, shardCount);
+    if (FAILED(hr)) {
+        wprintf(L"PlanRawToDumpShards failed %x\r\n", hr);
+        return 2;
+    }
+
+    return 0;
+}
+
+int ConvertShard(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR dumpFile, UINT32 shardIndex)
+{
+    ConvertRawToDumpShard pfnConvertRawToDumpShard = nullptr;
+
+    pfnConvertRawToDumpShard = (ConvertRawToDumpShard)GetProcAddress(hoffdump, "ConvertRawToDumpShard");
+    if (nullptr == pfnConvertRawToDumpShard) {
+        wprintf(L"GetProcAddress(ConvertRawToDumpShard) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Writing shard %u of %s\r\n", shardIndex, dumpFile);
+    HRESULT hr = pfnConvertRawToDumpShard(rawFile, NULL, NULL, dumpFile, shardIndex);
+    if (FAILED(hr)) {
+        wprintf(L"ConvertRawToDumpShard failed %x\r\n", hr);
+        return 2;
+    }
+
+    return 0;
+}
+
+int StitchShards(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR dumpFile)
+{
+    StitchRawToDumpShards pfnStitchRawToDumpShards = nullptr;
+
+    pfnStitchRawToDumpShards = (StitchRawToDumpShards)GetProcAddress(hoffdump, "StitchRawToDumpShards");
+    if (nullptr == pfnStitchRawToDumpShards) {
+        wprintf(L"GetProcAddress(StitchRawToDumpShards) failed %d\r\n", GetLastError());
+        return 3;
+    }
+
+    wprintf(L"Stitching the shards of %s\r\n", dumpFile);
+    HRESULT hr = pfnStitchRawToDumpShards(rawFile, NULL, NULL, dumpFile);
+    if (FAILED(hr)) {
+        wprintf(L"StitchRawToDumpShards failed %x\r\n", hr);
+        return 2;
+    }
+
+    return 0;
+}
+
+//
+// Stand-in for a sharded conversion across machines: plans the shards, runs
+// each in a child process of this tool and stitches the dump once all are done.
+//
+int ConvertSharded(HINSTANCE hoffdump, LPWSTR rawFile, LPWSTR dumpFile, UINT32 shardCount)
+{
+    WCHAR exePath[MAX_PATH];
+    WCHAR commandLine[3 * MAX_PATH];
+    STARTUPINFOW startupInfo = { 0 };
+    PROCESS_INFORMATION processInfo;
+    HANDLE *processes = nullptr;
+    UINT32 started = 0;
+    DWORD exitCode = 0;
+    int retVal = PlanShards(hoffdump, rawFile, dumpFile, shardCount);
+
+    if (retVal != 0) {
+        return retVal;
+    }
+
+    if (0 == GetModuleFileNameW(nullptr, exePath, ARRAYSIZE(exePath))) {
+        wprintf(L"GetModuleFileName failed %d\r\n", GetLastError());
+        return 2;
+    }
+
+    processes = (HANDLE *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, shardCount * sizeof(HANDLE));
+    if (nullptr == processes) {
+        wprintf(L"Failed to allocate the shard process table\r\n");
+        return 2;
+    }
+
+    startupInfo.cb = sizeof(startupInfo);
+
+    for (started = 0; started < shardCount; started++) {
+        if (FAILED(StringCchPrintfW(commandLine, ARRAYSIZE(commandLine), L"\"%s\" /shard \"%s\" \"%s\" %u",
+                                    exePath, rawFile, dumpFile, started)) ||
+            !CreateProcessW(exePath, commandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo)) {
+            wprintf(L"Failed to start shard %u %d\r\n", started, GetLastError());
+            retVal = 2;
+            break;
+        }
+
+        CloseHandle(processInfo.hThread);
+        processes[started] = processInfo.hProcess;
+    }
+
+    for (UINT32 index = 0; index < started; index++) {
+        WaitForSingleObject(processes[index], INFINITE);
+        if (!GetExitCodeProcess(processes[index], &exitCode) || (exitCode != 0)) {
+            wprintf(L"Shard %u failed %d\r\n", index, exitCode);
+            retVal = 2;
+        }
+
+        CloseHandle(processes[index]);
+    }
+
+    HeapFree(GetProcessHeap(), 0, processes);
+
+    if (retVal == 0) {
+        retVal = StitchShards(hoffdump, rawFile, dumpFile);
+    }
+
+    return retVal;
+}
 
 int __cdecl wmain(int argc, WCHAR ** argv)
 {
@@ -22,14 +328,56 @@ int __cdecl wmain(int argc, WCHAR ** argv)
     
     wprintf(L"RAW2DUMP library\r\n");
 
-    if (argc < 3) {
+    if ((argc < 2) ||
+        ((argc < 3) && (0 != _wcsicmp(argv[1], L"/serve")) && (0 != _wcsicmp(argv[1], L"/shutdown"))) ||
+        ((argc < 4) && ((0 == _wcsicmp(argv[1], L"/verify")) ||
+                        (0 == _wcsicmp(argv[1], L"/submit")) ||
+                        (0 == _wcsicmp(argv[1], L"/stitch")))) ||
+        ((argc < 5) && ((0 == _wcsicmp(argv[1], L"/search")) ||
+                        (0 == _wcsicmp(argv[1], L"/plan")) ||
+                        (0 == _wcsicmp(argv[1], L"/shard")) ||
+                        (0 == _wcsicmp(argv[1], L"/sharded"))))) {
         wprintf(L"Usage: raw2dumpexe <raw file path> <dump file path>, (argc==%d)\r\n", argc);
+        wprintf(L"       raw2dumpexe /verify <raw file path> <dump file path>\r\n");
+        wprintf(L"       raw2dumpexe /search <raw file path> <result file path> <pattern> [pattern ...]\r\n");
+        wprintf(L"         pattern: hex:4D5A??00 str:text wstr:text u32:0x.. u64:0x.. guid:{..}\r\n");
+        wprintf(L"                  kind/N:value only reports hits at multiples of N\r\n");
+        wprintf(L"       raw2dumpexe /serve [memory budget MB] [max jobs]\r\n");
+        wprintf(L"       raw2dumpexe /submit <raw file path> <dump file path> [rawdumpinfo file path] [log file path]\r\n");
+        wprintf(L"       raw2dumpexe /shutdown\r\n");
+        wprintf(L"       raw2dumpexe /plan <raw file path> <dump file path> <shard count>\r\n");
+        wprintf(L"       raw2dumpexe /shard <raw file path> <dump file path> <shard index>\r\n");
+        wprintf(L"       raw2dumpexe /stitch <raw file path> <dump file path>\r\n");
+        wprintf(L"       raw2dumpexe /sharded <raw file path> <dump file path> <shard count>\r\n");
         return 1;
     }
 
+    //
+    // Clients of the conversion server do not need the library.
+    //
+    if (0 == _wcsicmp(argv[1], L"/submit")) {
+        return SubmitJob(argv[2], argv[3], (argc > 5) ? argv[4] : nullptr, (argc > 5) ? argv[5] : nullptr);
+    } else if (0 == _wcsicmp(argv[1], L"/shutdown")) {
+        return StopServer();
+    }
+
     HINSTANCE const hoffdump = LoadLibrary(L"raw2dump.dll");
 
-    if (nullptr != hoffdump) {
+    if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/serve"))) {
+        retVal = ServeJobs(hoffdump, (argc > 2) ? argv[2] : nullptr, (argc > 3) ? argv[3] : nullptr);
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/plan"))) {
+        retVal = PlanShards(hoffdump, argv[2], argv[3], wcstoul(argv[4], nullptr, 0));
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/shard"))) {
+        retVal = ConvertShard(hoffdump, argv[2], argv[3], wcstoul(argv[4], nullptr, 0));
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/stitch"))) {
+        retVal = StitchShards(hoffdump, argv[2], argv[3]);
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/sharded"))) {
+        retVal = ConvertSharded(hoffdump, argv[2], argv[3], wcstoul(argv[4], nullptr, 0));
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/verify"))) {
+        retVal = VerifyDump(hoffdump, argv[2], argv[3]);
+    } else if ((nullptr != hoffdump) && (0 == _wcsicmp(argv[1], L"/search"))) {
+        retVal = SearchDump(hoffdump, argv[2], argv[3], (UINT32)(argc - 4), &argv[4]);
+    } else if (nullptr != hoffdump) {
         // Get the pointer to the function
         pfnConvertRawToDump = (ConvertRawToDump)GetProcAddress(hoffdump, "ConvertRawToDump");
         if (nullptr != pfnConvertRawToDump) {
@@ -0,0 +1,280 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    ConversionPhases.cpp
+
+Abstract:
+    Runs the phases of a raw dump conversion as a dependency graph, so that
+    phases that only parse the raw dump overlap with the bulk copy of memory.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+
+//
+// ------------------------- Local Types ----------------------------------------------------------------------
+//
+
+//
+// State shared by the threads running a phase table. All fields below Lock
+// are guarded by it; Changed is signalled whenever a phase finishes.
+//
+typedef struct _CONVERSION_GRAPH
+{
+    PDMP_CONTEXT                Context;
+    const CONVERSION_PHASE      *Phases;
+    UINT32                      PhaseCount;
+    CRITICAL_SECTION            Lock;
+    CONDITION_VARIABLE          Changed;
+    UINT32                      Started;
+    UINT32                      Finished;
+    UINT32                      FinishedCount;
+    HRESULT                     hr;
+} CONVERSION_GRAPH, *PCONVERSION_GRAPH;
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+VOID
+RunConversionGraph(
+    _Inout_ PCONVERSION_GRAPH Graph,
+    _In_ BOOL CallerThread
+    )
+/*++
+
+Routine Description:
+
+This function runs phases of the graph until none is left that this thread
+may run. A phase is started once all the phases it depends on have finished;
+the thread waits while the phases it could run are still blocked. After a
+required phase fails no further phase is started.
+
+Arguments:
+
+Graph - The phase table and its progress.
+
+CallerThread - TRUE on the thread that called RunConversionPhases, the only
+               one that runs phases flagged CONVERSION_PHASE_CALLER_THREAD.
+
+Return Value:
+
+None.
+
+--*/
+{
+    const CONVERSION_PHASE  *phase;
+    UINT32                  eligible = 0;
+    UINT32                  index;
+    UINT32                  finishedCount;
+    HRESULT                 hr;
+
+    for (index = 0; index < Graph->PhaseCount; index++) {
+        if (CallerThread || ((Graph->Phases[index].Flags & CONVERSION_PHASE_CALLER_THREAD) == 0)) {
+            eligible |= CONVERSION_PHASE_BIT(index);
+        }
+    }
+
+    EnterCriticalSection(&Graph->Lock);
+
+    while (SUCCEEDED(Graph->hr) && ((eligible & ~Graph->Started) != 0)) {
+        for (index = 0; index < Graph->PhaseCount; index++) {
+            if (((eligible & ~Graph->Started) & CONVERSION_PHASE_BIT(index)) &&
+                ((Graph->Phases[index].DependsOn & ~Graph->Finished) == 0)) {
+                break;
+            }
+        }
+
+        if (index == Graph->PhaseCount) {
+            SleepConditionVariableCS(&Graph->Changed, &Graph->Lock, INFINITE);
+            continue;
+        }
+
+        phase = &Graph->Phases[index];
+        Graph->Started |= CONVERSION_PHASE_BIT(index);
+        finishedCount = Graph->FinishedCount;
+        LeaveCriticalSection(&Graph->Lock);
+
+        TraceInfo(phase->Name);
+        ReportConversionProgress(Graph->Context, phase->Name, finishedCount, Graph->PhaseCount);
+        hr = phase->Routine(Graph->Context);
+        if (FAILED(hr)) {
+            TraceHRESULT(phase->Name, hr);
+        }
+
+        EnterCriticalSection(&Graph->Lock);
+
+        if (FAILED(hr) && (phase->Flags & CONVERSION_PHASE_REQUIRED) && SUCCEEDED(Graph->hr)) {
+            Graph->hr = hr;
+        }
+
+        Graph->Finished |= CONVERSION_PHASE_BIT(index);
+        Graph->FinishedCount++;
+        WakeAllConditionVariable(&Graph->Changed);
+    }
+
+    LeaveCriticalSection(&Graph->Lock);
+}
+
+
+DWORD
+WINAPI
+ConversionWorkerThread(
+    _In_ LPVOID Parameter
+    )
+{
+    RunConversionGraph((PCONVERSION_GRAPH)Parameter, FALSE);
+    return 0;
+}
+
+
+VOID
+ReportConversionProgress(
+    _In_ PDMP_CONTEXT Context,
+    _In_ PCSTR Stage,
+    _In_ UINT64 Done,
+    _In_ UINT64 Total
+    )
+/*++
+
+Routine Description:
+
+This function passes the progress of a stage to the caller of the conversion,
+if it asked for it. Phases report when they start, as their share of the phase
+table; long running phases report their own units of work as well.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Stage - Name of the stage.
+
+Done - Units of work done.
+
+Total - Units of work in the stage.
+
+Return Value:
+
+None.
+
+--*/
+{
+    if (Context->ProgressRoutine != nullptr) {
+        Context->ProgressRoutine(Context->ProgressContext, Stage, Done, Total);
+    }
+}
+
+
+HRESULT
+RunConversionPhases(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_reads_(PhaseCount) const CONVERSION_PHASE *Phases,
+    _In_ UINT32 PhaseCount
+    )
+/*++
+
+Routine Description:
+
+This function runs a table of conversion phases on up to
+CONVERSION_MAX_THREADS threads, the calling thread included, and returns once
+all started phases are done. Each phase starts as soon as the phases in its
+DependsOn have finished, whether they succeeded or not, so phases that only
+parse the raw dump run while memory is being copied. A failed required phase
+stops the conversion: phases not yet started are skipped.
+
+Reads of the raw dump go through ReadRawDumpFile or ReadFromDDRSectionBatch,
+both serialized with Context->RawDumpLock while the phases run. Phases that share any other state
+must be ordered by DependsOn.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Phases - The phases, each depending only on phases before it.
+
+PhaseCount - Number of phases, at most CONVERSION_MAX_PHASES.
+
+Return Value:
+
+HRESULT of the first required phase that failed, S_OK otherwise.
+
+--*/
+{
+    CONVERSION_GRAPH    graph;
+    HANDLE              threads[CONVERSION_MAX_THREADS] = { 0 };
+    SYSTEM_INFO         systemInfo = { 0 };
+    UINT32              workerPhases = 0;
+    UINT32              threadCount = 0;
+    UINT32              threadsStarted = 0;
+    HRESULT             hr = S_OK;
+
+    if ((PhaseCount == 0) || (PhaseCount > CONVERSION_MAX_PHASES)) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("Invalid conversion phase count", hr);
+        return hr;
+    }
+
+    for (UINT32 index = 0; index < PhaseCount; index++) {
+        //
+        // Depending only on earlier phases keeps the graph free of cycles.
+        //
+        if ((Phases[index].DependsOn >> index) != 0) {
+            hr = E_INVALIDARG;
+            TraceInfo1("Conversion phase depends on a later phase", "Phase", index);
+            return hr;
+        }
+
+        if ((Phases[index].Flags & CONVERSION_PHASE_CALLER_THREAD) == 0) {
+            workerPhases++;
+        }
+    }
+
+    RtlZeroMemory(&graph, sizeof(graph));
+    graph.Context = Context;
+    graph.Phases = Phases;
+    graph.PhaseCount = PhaseCount;
+    graph.hr = S_OK;
+    InitializeCriticalSection(&graph.Lock);
+    InitializeConditionVariable(&graph.Changed);
+
+    InitializeCriticalSection(&Context->RawDumpLock);
+    Context->RawDumpLockInitialized = TRUE;
+
+    //
+    // The calling thread runs phases as well, the workers cover the rest.
+    //
+    GetSystemInfo(&systemInfo);
+    threadCount = min(min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)CONVERSION_MAX_THREADS) - 1,
+                      workerPhases);
+
+    for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++) {
+        threads[threadsStarted] = CreateThread(nullptr, 0, ConversionWorkerThread, &graph, 0, nullptr);
+        if (threads[threadsStarted] == NULL) {
+            // Not fatal, the phases run on the threads already started
+            TraceInfo1("Failed to start conversion thread", "Error", GetLastError());
+            break;
+        }
+    }
+
+    RunConversionGraph(&graph, TRUE);
+
+    if (threadsStarted != 0) {
+        WaitForMultipleObjects(threadsStarted, threads, TRUE, INFINITE);
+    }
+
+    for (UINT32 index = 0; index < threadsStarted; index++) {
+        CloseHandle(threads[index]);
+    }
+
+    Context->RawDumpLockInitialized = FALSE;
+    DeleteCriticalSection(&Context->RawDumpLock);
+    DeleteCriticalSection(&graph.Lock);
+
+    hr = graph.hr;
+
+    return hr;
+}
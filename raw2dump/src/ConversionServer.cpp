@@ -0,0 +1,642 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    ConversionServer.cpp
+
+Abstract:
+    A long running conversion server. Jobs arrive over a local named pipe,
+    see ConversionServer.h, and are converted one at a time on a single
+    worker thread: the log file and the debugger engine are process wide.
+    The worker keeps its idle I/O buffers from one job to the next and
+    streams the progress of each job back to its client.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+#include "ConversionServer.h"
+
+//
+// ------------------------- Local Definitions ----------------------------------------------------------------
+//
+
+#define CONVERSION_PIPE_BUFFER_SIZE         (sizeof(CONVERSION_STATUS_MESSAGE) * 16)
+#define CONVERSION_PIPE_TIMEOUT_MS          30000   // Longest wait for a client to send or take a message
+#define CONVERSION_PROGRESS_STEPS           100     // Messages sent per stage at most, besides its start and end
+
+//
+// ------------------------- Local Types ----------------------------------------------------------------------
+//
+
+//
+// A submitted job. The pipe to its client belongs to the job from the moment
+// it is queued.
+//
+typedef struct _CONVERSION_JOB
+{
+    struct _CONVERSION_JOB      *Next;
+    HANDLE                      Pipe;
+    CONVERSION_SUBMIT_MESSAGE   Request;
+
+    //
+    // Progress may be reported by several conversion threads at once, all
+    // fields below are guarded by ProgressLock.
+    //
+    CRITICAL_SECTION            ProgressLock;
+    BOOL                        ClientGone;
+    CHAR                        LastStage[CONVERSION_STAGE_NAME_LENGTH];
+    UINT64                      LastDone;
+} CONVERSION_JOB, *PCONVERSION_JOB;
+
+//
+// The job queue, guarded by Lock. QueueChanged is signalled when a job is
+// queued and when the server stops.
+//
+typedef struct _CONVERSION_SERVER
+{
+    CRITICAL_SECTION            Lock;
+    CONDITION_VARIABLE          QueueChanged;
+    PCONVERSION_JOB             Head;
+    PCONVERSION_JOB             Tail;
+    UINT32                      JobCount;           // Queued or running
+    UINT32                      MaxJobs;
+    UINT64                      MemoryBudget;
+    BOOL                        Stopping;
+
+    //
+    // Only used by the worker thread.
+    //
+    WARM_BUFFER_POOL            WarmPool;
+} CONVERSION_SERVER, *PCONVERSION_SERVER;
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+HRESULT
+TransferPipeMessage(
+    _In_ HANDLE Pipe,
+    _In_ BOOL Write,
+    _Inout_updates_bytes_(Size) PVOID Buffer,
+    _In_ UINT32 Size,
+    _Out_opt_ PUINT32 Transferred
+    )
+/*++
+
+Routine Description:
+
+This function reads or writes one message on an overlapped pipe, giving up
+after CONVERSION_PIPE_TIMEOUT_MS so that a client that stalls cannot hold up
+the server.
+
+Arguments:
+
+Pipe - The pipe, opened for overlapped I/O.
+
+Write - TRUE to write Buffer, FALSE to read into it.
+
+Buffer - The message.
+
+Size - Bytes to write, or the size of Buffer.
+
+Transferred - Receives the bytes transferred.
+
+Return Value:
+
+HRESULT, HRESULT_FROM_WIN32(ERROR_TIMEOUT) if the client did not keep up.
+
+--*/
+{
+    OVERLAPPED  overlapped = { 0 };
+    DWORD       bytes = 0;
+    BOOL        done;
+    HRESULT     hr = S_OK;
+
+    if (Transferred != nullptr) {
+        *Transferred = 0;
+    }
+
+    overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (overlapped.hEvent == NULL) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        return hr;
+    }
+
+    done = Write ? WriteFile(Pipe, Buffer, Size, nullptr, &overlapped) :
+                   ReadFile(Pipe, Buffer, Size, nullptr, &overlapped);
+    if (!done && (GetLastError() != ERROR_IO_PENDING)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    if (WaitForSingleObject(overlapped.hEvent, CONVERSION_PIPE_TIMEOUT_MS) != WAIT_OBJECT_0) {
+        CancelIoEx(Pipe, &overlapped);
+        GetOverlappedResult(Pipe, &overlapped, &bytes, TRUE);
+        hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        goto Exit;
+    }
+
+    if (!GetOverlappedResult(Pipe, &overlapped, &bytes, FALSE)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Exit;
+    }
+
+    if (Transferred != nullptr) {
+        *Transferred = bytes;
+    }
+
+Exit:
+    CloseHandle(overlapped.hEvent);
+
+    return hr;
+}
+
+
+HRESULT
+SendConversionStatus(
+    _In_ HANDLE Pipe,
+    _In_ CONVERSION_MESSAGE_TYPE Type,
+    _In_ HRESULT Result,
+    _In_ UINT64 Value1,
+    _In_ UINT64 Value2,
+    _In_opt_ PCSTR Stage
+    )
+{
+    CONVERSION_STATUS_MESSAGE message = { 0 };
+
+    message.Header.Signature = CONVERSION_MESSAGE_SIGNATURE;
+    message.Header.Version = CONVERSION_MESSAGE_VERSION;
+    message.Header.Type = Type;
+    message.Header.Size = sizeof(message);
+    message.hr = Result;
+    message.Value1 = Value1;
+    message.Value2 = Value2;
+
+    if (Stage != nullptr) {
+        StringCchCopyA(message.Stage, ARRAYSIZE(message.Stage), Stage);
+    }
+
+    return TransferPipeMessage(Pipe, TRUE, &message, sizeof(message), nullptr);
+}
+
+
+HRESULT
+WaitForConversionClient(
+    _In_ HANDLE Pipe
+    )
+/*++
+
+Routine Description:
+
+This function waits, without a timeout, for a client to connect to an
+overlapped pipe.
+
+--*/
+{
+    OVERLAPPED  overlapped = { 0 };
+    DWORD       bytes = 0;
+    HRESULT     hr = S_OK;
+
+    overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (overlapped.hEvent == NULL) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        return hr;
+    }
+
+    if (!ConnectNamedPipe(Pipe, &overlapped)) {
+        switch (GetLastError()) {
+        case ERROR_PIPE_CONNECTED:
+            break;
+
+        case ERROR_IO_PENDING:
+            if (!GetOverlappedResult(Pipe, &overlapped, &bytes, TRUE)) {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+            break;
+
+        default:
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            break;
+        }
+    }
+
+    CloseHandle(overlapped.hEvent);
+
+    return hr;
+}
+
+
+VOID
+CloseConversionPipe(
+    _In_ HANDLE Pipe
+    )
+/*++
+
+Routine Description:
+
+This function closes the pipe of a client once it has read the last message.
+Disconnecting right away would throw away messages still in the pipe, so the
+server waits, up to CONVERSION_PIPE_TIMEOUT_MS, for the client to close its
+end first.
+
+--*/
+{
+    CONVERSION_MESSAGE_HEADER header;
+
+    TransferPipeMessage(Pipe, FALSE, &header, sizeof(header), nullptr);
+    DisconnectNamedPipe(Pipe);
+    CloseHandle(Pipe);
+}
+
+
+VOID
+SendJobProgress(
+    _In_opt_ PVOID ProgressContext,
+    _In_ PCSTR Stage,
+    _In_ UINT64 Done,
+    _In_ UINT64 Total
+    )
+/*++
+
+Routine Description:
+
+This function is the CONVERSION_PROGRESS_ROUTINE of a job. It sends the start
+and the end of every stage and at most CONVERSION_PROGRESS_STEPS messages in
+between. Once the client is gone the job runs on without sending anything.
+
+--*/
+{
+    PCONVERSION_JOB job = (PCONVERSION_JOB)ProgressContext;
+    BOOL            newStage;
+
+    EnterCriticalSection(&job->ProgressLock);
+
+    newStage = (strncmp(job->LastStage, Stage, ARRAYSIZE(job->LastStage) - 1) != 0);
+
+    if (!job->ClientGone &&
+        (newStage ||
+         (Done >= Total) ||
+         ((Done - min(job->LastDone, Done)) >= (Total / CONVERSION_PROGRESS_STEPS)))) {
+
+        if (FAILED(SendConversionStatus(job->Pipe, ConversionMessageProgress, S_OK, Done, Total, Stage))) {
+            TraceInfo("Conversion client is gone, the job goes on without it");
+            job->ClientGone = TRUE;
+        }
+
+        StringCchCopyA(job->LastStage, ARRAYSIZE(job->LastStage), Stage);
+        job->LastDone = Done;
+    }
+
+    LeaveCriticalSection(&job->ProgressLock);
+}
+
+
+VOID
+RunConversionJob(
+    _Inout_ PCONVERSION_SERVER Server,
+    _Inout_ PCONVERSION_JOB Job
+    )
+/*++
+
+Routine Description:
+
+This function converts the raw dump of a job, sends the result to its client
+and closes its pipe.
+
+Arguments:
+
+Server - The server, for the memory budget and the warm buffers.
+
+Job - The job, freed by the caller.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PCONVERSION_SUBMIT_MESSAGE  request = &Job->Request;
+    CONVERSION_OPTIONS          options = { 0 };
+    UINT64                      peakBytes = 0;
+    HRESULT                     hr;
+
+    options.MemoryBudget = (request->MemoryBudget != 0) ? request->MemoryBudget : Server->MemoryBudget;
+    if ((Server->MemoryBudget != 0) && (options.MemoryBudget > Server->MemoryBudget)) {
+        options.MemoryBudget = Server->MemoryBudget;
+    }
+
+    options.WarmPool = &Server->WarmPool;
+    options.ProgressRoutine = SendJobProgress;
+    options.ProgressContext = Job;
+
+    hr = ConvertRawDumpWithOptions(request->RawDumpPath,
+                                   (request->RawInfoPath[0] != L'\0') ? request->RawInfoPath : nullptr,
+                                   (request->LogPath[0] != L'\0') ? request->LogPath : nullptr,
+                                   request->DumpPath,
+                                   &options,
+                                   &peakBytes);
+    if (FAILED(hr)) {
+        TraceHRESULT("Conversion job failed", hr);
+    }
+
+    if (!Job->ClientGone) {
+        SendConversionStatus(Job->Pipe, ConversionMessageComplete, hr, peakBytes, 0, nullptr);
+    }
+
+    CloseConversionPipe(Job->Pipe);
+}
+
+
+DWORD
+WINAPI
+ConversionServerWorker(
+    _In_ LPVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+This function runs the queued jobs in order until the server stops and the
+queue is empty. Conversions are bound to this thread, so the debugger engine
+each one uses is opened and closed on it.
+
+--*/
+{
+    PCONVERSION_SERVER  server = (PCONVERSION_SERVER)Parameter;
+    PCONVERSION_JOB     job;
+
+    for (;;) {
+        EnterCriticalSection(&server->Lock);
+
+        while ((server->Head == nullptr) && !server->Stopping) {
+            SleepConditionVariableCS(&server->QueueChanged, &server->Lock, INFINITE);
+        }
+
+        job = server->Head;
+        if (job != nullptr) {
+            server->Head = job->Next;
+            if (server->Head == nullptr) {
+                server->Tail = nullptr;
+            }
+        }
+
+        LeaveCriticalSection(&server->Lock);
+
+        if (job == nullptr) {
+            break;
+        }
+
+        RunConversionJob(server, job);
+
+        DeleteCriticalSection(&job->ProgressLock);
+        HeapFree(GetProcessHeap(), 0, job);
+
+        EnterCriticalSection(&server->Lock);
+        server->JobCount--;
+        LeaveCriticalSection(&server->Lock);
+    }
+
+    FreeWarmBuffers(&server->WarmPool);
+
+    return 0;
+}
+
+
+HRESULT
+AcceptConversionRequest(
+    _Inout_ PCONVERSION_SERVER Server,
+    _In_ HANDLE Pipe,
+    _Out_ PBOOL Shutdown
+    )
+/*++
+
+Routine Description:
+
+This function reads the request of a connected client. A valid job is queued
+and owns the pipe from then on; for anything else the client gets an answer
+and the pipe is closed.
+
+Arguments:
+
+Server - The server.
+
+Pipe - The connected pipe.
+
+Shutdown - Receives TRUE if the client asked the server to stop.
+
+Return Value:
+
+HRESULT, S_FALSE if the request was rejected.
+
+--*/
+{
+    PCONVERSION_JOB     job = nullptr;
+    UINT32              bytesRead = 0;
+    UINT32              jobsAhead = 0;
+    HRESULT             hr = S_OK;
+
+    *Shutdown = FALSE;
+
+    job = (PCONVERSION_JOB)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONVERSION_JOB));
+    if (job == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Failed to allocate a conversion job", hr);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    hr = TransferPipeMessage(Pipe, FALSE, &job->Request, sizeof(job->Request), &bytesRead);
+    if (FAILED(hr)) {
+        TraceHRESULT("Failed to read a conversion request", hr);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    if ((bytesRead < sizeof(CONVERSION_MESSAGE_HEADER)) ||
+        (job->Request.Header.Signature != CONVERSION_MESSAGE_SIGNATURE) ||
+        (job->Request.Header.Version != CONVERSION_MESSAGE_VERSION) ||
+        (job->Request.Header.Size != bytesRead)) {
+        hr = E_INVALIDARG;
+        TraceInfo1("Invalid conversion request", "Bytes", bytesRead);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    if (job->Request.Header.Type == ConversionMessageShutdown) {
+        TraceInfo("Conversion server asked to stop");
+        *Shutdown = TRUE;
+        SendConversionStatus(Pipe, ConversionMessageComplete, S_OK, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    if ((job->Request.Header.Type != ConversionMessageSubmit) ||
+        (bytesRead != sizeof(CONVERSION_SUBMIT_MESSAGE))) {
+        hr = E_INVALIDARG;
+        TraceInfo1("Invalid conversion request", "Type", job->Request.Header.Type);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    job->Request.RawDumpPath[ARRAYSIZE(job->Request.RawDumpPath) - 1] = L'\0';
+    job->Request.RawInfoPath[ARRAYSIZE(job->Request.RawInfoPath) - 1] = L'\0';
+    job->Request.LogPath[ARRAYSIZE(job->Request.LogPath) - 1] = L'\0';
+    job->Request.DumpPath[ARRAYSIZE(job->Request.DumpPath) - 1] = L'\0';
+
+    if ((job->Request.RawDumpPath[0] == L'\0') || (job->Request.DumpPath[0] == L'\0')) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("Conversion request without a raw dump or dump file", hr);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    job->Pipe = Pipe;
+    InitializeCriticalSection(&job->ProgressLock);
+
+    EnterCriticalSection(&Server->Lock);
+
+    if (Server->JobCount >= Server->MaxJobs) {
+        LeaveCriticalSection(&Server->Lock);
+        DeleteCriticalSection(&job->ProgressLock);
+        hr = HRESULT_FROM_WIN32(ERROR_BUSY);
+        TraceInfo1("Conversion queue is full", "Jobs", Server->MaxJobs);
+        SendConversionStatus(Pipe, ConversionMessageRejected, hr, 0, 0, nullptr);
+        goto Exit;
+    }
+
+    //
+    // Answered before the worker can see the job, so that the client gets
+    // this message ahead of any progress.
+    //
+    jobsAhead = Server->JobCount;
+    SendConversionStatus(Pipe, ConversionMessageQueued, S_OK, jobsAhead, 0, nullptr);
+
+    if (Server->Tail != nullptr) {
+        Server->Tail->Next = job;
+    }
+    else {
+        Server->Head = job;
+    }
+
+    Server->Tail = job;
+    Server->JobCount++;
+    WakeConditionVariable(&Server->QueueChanged);
+
+    LeaveCriticalSection(&Server->Lock);
+
+    return S_OK;
+
+Exit:
+    if (job != nullptr) {
+        HeapFree(GetProcessHeap(), 0, job);
+    }
+
+    CloseConversionPipe(Pipe);
+
+    return FAILED(hr) ? S_FALSE : hr;
+}
+
+
+HRESULT
+ServeConversionJobs(
+    _In_ LPCWSTR PipeName,
+    _In_ UINT32 MaxJobs,
+    _In_ UINT64 MemoryBudget
+    )
+/*++
+
+Routine Description:
+
+This function accepts conversion jobs on a named pipe until a client asks it
+to stop, then finishes the jobs already queued. Only local clients are
+accepted. A job is rejected while MaxJobs jobs are queued or running.
+
+Arguments:
+
+PipeName - Name of the pipe, \\.\pipe\<name>. Fails if another server has
+           the pipe open.
+
+MaxJobs - Most jobs queued or running at once.
+
+MemoryBudget - Bytes a conversion may use for its buffers, maps and caches, 0
+               for no limit. Jobs may ask for less, not more.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    CONVERSION_SERVER   server;
+    HANDLE              worker = NULL;
+    HANDLE              pipe = INVALID_HANDLE_VALUE;
+    BOOL                firstInstance = TRUE;
+    BOOL                shutdown = FALSE;
+    HRESULT             hr = S_OK;
+
+    if ((PipeName == nullptr) || (MaxJobs == 0)) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("Invalid conversion server parameters", hr);
+        return hr;
+    }
+
+    RtlZeroMemory(&server, sizeof(server));
+    server.MaxJobs = MaxJobs;
+    server.MemoryBudget = MemoryBudget;
+    InitializeCriticalSection(&server.Lock);
+    InitializeConditionVariable(&server.QueueChanged);
+
+    worker = CreateThread(nullptr, 0, ConversionServerWorker, &server, 0, nullptr);
+    if (worker == NULL) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to start the conversion worker", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("Conversion server started", "MaxJobs", MaxJobs, "MemoryBudget", MemoryBudget);
+
+    while (!shutdown) {
+        pipe = CreateNamedPipeW(PipeName,
+                                PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED |
+                                    (firstInstance ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                                PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                PIPE_UNLIMITED_INSTANCES,
+                                CONVERSION_PIPE_BUFFER_SIZE,
+                                sizeof(CONVERSION_SUBMIT_MESSAGE),
+                                0,
+                                nullptr);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            TraceHRESULT("CreateNamedPipe failed", hr);
+            break;
+        }
+
+        firstInstance = FALSE;
+
+        hr = WaitForConversionClient(pipe);
+        if (FAILED(hr)) {
+            TraceHRESULT("ConnectNamedPipe failed", hr);
+            CloseHandle(pipe);
+            break;
+        }
+
+        AcceptConversionRequest(&server, pipe, &shutdown);
+    }
+
+    EnterCriticalSection(&server.Lock);
+    server.Stopping = TRUE;
+    WakeAllConditionVariable(&server.QueueChanged);
+    LeaveCriticalSection(&server.Lock);
+
+    WaitForSingleObject(worker, INFINITE);
+    CloseHandle(worker);
+
+    TraceInfo("Conversion server stopped");
+
+Exit:
+    DeleteCriticalSection(&server.Lock);
+
+    return hr;
+}
@@ -0,0 +1,77 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name: ConversionServer.h
+
+Abstract:
+    Messages exchanged over the named pipe of the raw2dump conversion server,
+    see RunConversionServer. The pipe is in message mode: every message is one
+    write and starts with a CONVERSION_MESSAGE_HEADER.
+
+    A client connects, writes one CONVERSION_SUBMIT_MESSAGE and reads
+    CONVERSION_STATUS_MESSAGEs until ConversionMessageComplete or
+    ConversionMessageRejected, after which it closes the pipe.
+
+Environment: User Mode
+
+--*/
+
+#pragma once
+
+#include <windows.h>
+
+#define CONVERSION_SERVER_PIPE_NAME         L"\\\\.\\pipe\\raw2dump"
+
+#define CONVERSION_MESSAGE_SIGNATURE        (UINT64)(0x2121626F4A443252)  // "R2DJob!!"
+#define CONVERSION_MESSAGE_VERSION          1
+
+#define CONVERSION_SERVER_DEFAULT_QUEUE     16      // Jobs waiting or running before new ones are rejected
+#define CONVERSION_STAGE_NAME_LENGTH        64
+
+typedef enum _CONVERSION_MESSAGE_TYPE
+{
+    ConversionMessageSubmit = 1,        // Client: convert a raw dump
+    ConversionMessageShutdown,          // Client: finish the queued jobs and exit
+    ConversionMessageQueued,            // Server: accepted, Value1 is the number of jobs ahead
+    ConversionMessageRejected,          // Server: not accepted, see hr
+    ConversionMessageProgress,          // Server: Stage has done Value1 of Value2 units of work
+    ConversionMessageComplete           // Server: done with hr, Value1 is the peak of budgeted memory
+} CONVERSION_MESSAGE_TYPE;
+
+typedef struct _CONVERSION_MESSAGE_HEADER
+{
+    UINT64      Signature;
+    UINT32      Version;
+    UINT32      Type;                   // CONVERSION_MESSAGE_TYPE
+    UINT32      Size;                   // Bytes in the message, header included
+    UINT32      Reserved;
+} CONVERSION_MESSAGE_HEADER, *PCONVERSION_MESSAGE_HEADER;
+
+//
+// ConversionMessageSubmit and ConversionMessageShutdown. Paths are full paths
+// on the server's machine; an empty RawInfoPath or LogPath means the device
+// info is embedded in the raw dump, as for ConvertRawToDump.
+//
+typedef struct _CONVERSION_SUBMIT_MESSAGE
+{
+    CONVERSION_MESSAGE_HEADER   Header;
+    UINT64                      MemoryBudget;       // Bytes, 0 for the server's budget
+    WCHAR                       RawDumpPath[MAX_PATH];
+    WCHAR                       RawInfoPath[MAX_PATH];
+    WCHAR                       LogPath[MAX_PATH];
+    WCHAR                       DumpPath[MAX_PATH];
+} CONVERSION_SUBMIT_MESSAGE, *PCONVERSION_SUBMIT_MESSAGE;
+
+//
+// Every message from the server.
+//
+typedef struct _CONVERSION_STATUS_MESSAGE
+{
+    CONVERSION_MESSAGE_HEADER   Header;
+    HRESULT                     hr;
+    UINT32                      Reserved;
+    UINT64                      Value1;
+    UINT64                      Value2;
+    CHAR                        Stage[CONVERSION_STAGE_NAME_LENGTH];
+} CONVERSION_STATUS_MESSAGE, *PCONVERSION_STATUS_MESSAGE;
@@ -28,11 +28,26 @@ GetKdDebuggerDataBlock64(
 _Inout_ PDMP_CONTEXT Context
 );
 
+HRESULT
+FindCPUContext64(
+_Inout_ PDMP_CONTEXT Context
+);
+
+HRESULT
+UpdateCPUContext64(
+_Inout_ PDMP_CONTEXT Context
+);
+
+HRESULT
+FinishDumpFile64(
+_Inout_ PDMP_CONTEXT Context
+);
+
 NTSTATUS
 ExtractWindowsDumpFile64(PDMP_CONTEXT Context)
 {
-    NTSTATUS    status = STATUS_UNSUCCESSFUL;
     HRESULT     hr = S_OK;
+    HRESULT     patchHr = S_OK;
     
     TraceInfo("Validating DUMP_HEADER's memory descriptors against DDR sections");
     hr = ValidateDDRAgainstPhysicalMemoryBlock64(Context);          
@@ -58,6 +73,11 @@ ExtractWindowsDumpFile64(PDMP_CONTEXT Context)
         goto ExitHR;
     }
 
+    if (Context->ShardMode == ConversionShardWorker) {
+        hr = WriteDumpShard(Context);
+        goto ExitHR;
+    }
+
     TraceInfo("Writing DUMP_HEADER to the dump file");
     hr = WriteDumpHeader64(Context);
     if (FAILED(hr)) {
@@ -65,66 +85,186 @@ ExtractWindowsDumpFile64(PDMP_CONTEXT Context)
         goto ExitHR;
     }
 
-    TraceInfo("Writing DDR section to the dump file");
-    hr = WriteDDR64(Context);
-    if (FAILED(hr)) {
-        TraceHRESULT("WriteDDR failed", hr);
+    if (Context->ShardMode == ConversionShardPlan) {
+        hr = PlanDumpShards(Context);
         goto ExitHR;
     }
-    
-    TraceInfo("Writing secondary data to the dump file");
-    hr = WriteSVSpecific(Context);
+
+    hr = BuildDumpRunIndex(Context);
     if (FAILED(hr)) {
-        TraceHRESULT("WriteSVSpecific failed", hr);
+        TraceHRESULT("BuildDumpRunIndex failed", hr);
         goto ExitHR;
     }
 
-    if (!DbgClient::Initialize(Context->WindowsDumpFilePath, NULL))
-    {
-        TraceInfo("Error: Failed to initialize Debug Client");
-        goto Exit;
+    //
+    // The rest runs as a dependency graph, ordered as in ExtractWindowsDumpFile.
+    //
+    static const CONVERSION_PHASE phases[ExtractPhaseCount] = {
+        { "Writing DDR section to the dump file",
+          WriteDDR64,
+          0,
+          CONVERSION_PHASE_REQUIRED },
+        { "Writing secondary data to the dump file",
+          WriteSVSpecific,
+          CONVERSION_PHASE_BIT(ExtractPhaseDDR),
+          CONVERSION_PHASE_REQUIRED },
+        { "Writing the page fingerprint",
+          WritePageFingerprint,
+          CONVERSION_PHASE_BIT(ExtractPhaseSecondaryData),
+          0 },
+        { "Locating the CPU context",
+          FindCPUContext64,
+          0,
+          CONVERSION_PHASE_REQUIRED },
+        { "Reading the InMemDiag buffer",
+          ReadInMemDiagBuffer,
+          0,
+          0 },
+        { "Try to determine if KdDebuggerDataBlock is encoded",
+          FindKdDebuggerDataBlock,
+          CONVERSION_PHASE_BIT(ExtractPhaseSecondaryData),
+          CONVERSION_PHASE_REQUIRED | CONVERSION_PHASE_CALLER_THREAD },
+        { "Update CPU context",
+          UpdateCPUContext64,
+          CONVERSION_PHASE_BIT(ExtractPhaseFindCPUContext) | CONVERSION_PHASE_BIT(ExtractPhaseKdDebuggerDataBlock),
+          CONVERSION_PHASE_REQUIRED | CONVERSION_PHASE_CALLER_THREAD },
+        { "Writing the InMemDiag buffer",
+          FinishDumpFile64,
+          CONVERSION_PHASE_BIT(ExtractPhaseReadInMemDiag) | CONVERSION_PHASE_BIT(ExtractPhaseUpdateCPUContext),
+          0 },
+    };
+
+    hr = RunConversionPhases(Context, phases, ARRAYSIZE(phases));
+    if (FAILED(hr)) {
+        TraceHRESULT("RunConversionPhases failed", hr);
     }
 
-    TraceInfo("Try to determine if KdDebuggerDataBlock is encoded");
-    status = GetKdDebuggerDataBlock(Context);
-    if (FAILED(status)) {
-        TraceNTSTATUS("GetKdDebuggerDataBlock failed", status);
-        goto Exit;
+    //
+    // Whatever the phases patched before one failed still goes to the dump.
+    //
+    patchHr = ApplyDumpPatches(Context);
+    if (FAILED(patchHr)) {
+        TraceHRESULT("ApplyDumpPatches failed", patchHr);
+        if (SUCCEEDED(hr)) {
+            hr = patchHr;
+        }
+    }
+
+    if (FAILED(hr)) {
+        goto ExitHR;
     }
 
-    TraceInfo("Update CPU context");
+    TraceInfo("Wrote to Dump file successfully");
+
+ExitHR:
+    return hr;
+}
+
+HRESULT
+FindCPUContext64(
+_Inout_ PDMP_CONTEXT Context
+)
+/*++
+
+Routine Description:
+
+Parses the register context of the processors out of the raw dump, for
+UpdateCPUContext64 to write once the KdDebuggerDataBlock is known.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    switch (Context->DumpHeader64->MachineImageType){
+    case IMAGE_FILE_MACHINE_ARM:
+    case IMAGE_FILE_MACHINE_ARM64:
+        //
+        // Get the AP_REG data from memory and do some validation.
+        //
+        return GetAPReg64(Context);
+
+    default:
+        return S_OK;
+    }
+}
+
+HRESULT
+UpdateCPUContext64(
+_Inout_ PDMP_CONTEXT Context
+)
+/*++
+
+Routine Description:
+
+Writes the register context of the processors to the dump file. Needs the
+KdDebuggerDataBlock and dbgeng to translate its virtual addresses.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT, only failures to update an ARM context are returned.
+
+--*/
+{
+    HRESULT     hr = S_OK;
+    NTSTATUS    status = STATUS_SUCCESS;
+
     switch (Context->DumpHeader64->MachineImageType){
     case IMAGE_FILE_MACHINE_I386:
         if (Context->CPUContextSectionCount >0){
             status = UpdateContextX86(Context);
+            if (FAILED(status)) {
+                // not fatal
+                TraceNTSTATUS("UpdateContextX86 failed", status);
+            }
         }
         break;
 
     case IMAGE_FILE_MACHINE_ARM:
     case IMAGE_FILE_MACHINE_ARM64:
-        //
-        // Get the AP_REG data from memory and do some validation.
-        //
-        TraceInfo("Try getting AP_REG");
-
-        hr = GetAPReg64(Context);
-        if (FAILED(hr)) {
-            TraceHRESULT("GetAPReg64 failed", hr);
-            goto ExitHR;
-        }
-        status = UpdateContextWithAPReg64(Context);
-        if (FAILED(status)) {
-            TraceHRESULT("UpdateContextWithAPReg64 failed", hr);
-            goto Exit;
-        }
+        hr = UpdateContextWithAPReg64(Context);
         break;
 
     default:
-        hr = E_FAIL;
-        TraceHRESULT("Unsupported CPU Context type", hr);
+        TraceHRESULT("Unsupported CPU Context type", E_FAIL);
         break;
     }
 
+    return hr;
+}
+
+HRESULT
+FinishDumpFile64(
+_Inout_ PDMP_CONTEXT Context
+)
+/*++
+
+Routine Description:
+
+Marks a best effort DUMP_HEADER as such and writes the InMemDiag buffer, the
+last changes made to the dump file. Failures are not fatal.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT of the InMemDiag buffer write.
+
+--*/
+{
+    HRESULT     hr = S_OK;
+
     if (Context->DumpHeaderStatus != DHS_VALID) {
         if (FAILED(hr = WriteFakeDumpHeader(Context))) {
             // not fatal
@@ -132,20 +272,7 @@ ExtractWindowsDumpFile64(PDMP_CONTEXT Context)
         }
     }
 
-    if (FAILED(hr = WriteInMemDiagBuffer(Context))) {
-        // not fatal
-        TraceHRESULT("WriteInMemDiagBuffer failed", hr);
-    }
-
-    status = STATUS_SUCCESS;
-
-    TraceInfo("Wrote to Dump file successfully");
-
-Exit:
-    return HRESULT_FROM_NT(status);
-
-ExitHR:
-    return hr;
+    return WriteInMemDiagBuffer(Context);
 }
 
 NTSTATUS
@@ -176,19 +303,10 @@ NT status code.
 
 --*/
 {
-    PDDR_MEMORY_MAP               ddrMemoryMap = NULL;
-    UINT64                        endPD;
-    UINT32                        indexDDR;
-    UINT32                        indexPD;
-    UINT64                        startPD;
-    UINT32                        spanCount;
     UINT64                        memorySizeFromPD = 0;
     PPHYSICAL_MEMORY_DESCRIPTOR64 physDesc = NULL;
     NTSTATUS                      status = STATUS_UNSUCCESSFUL;
-    BOOLEAN                       startInSection;
-    BOOLEAN                       endInSection;
 
-    ddrMemoryMap = Context->DDRMemoryMap;
     physDesc = &(Context->DumpHeader64->PhysicalMemoryBlock);
 
     memorySizeFromPD = physDesc->NumberOfPages * PAGE_SIZE;
@@ -203,91 +321,9 @@ NT status code.
         //goto Exit;
     }
 
-    for (indexPD = 0; indexPD < physDesc->NumberOfRuns; indexPD++) {
-        startPD = (UINT64)(physDesc->Run[indexPD].BasePage * PAGE_SIZE);
-        endPD = startPD + (UINT64)(physDesc->Run[indexPD].PageCount * PAGE_SIZE) - 1;
-        spanCount = 0;
-        startInSection = FALSE;
-        endInSection = FALSE;
-
-        LogLibInfoPrintf(L"Looking at descriptor 0x%llx\r\n", indexPD);
-
-        for (indexDDR = 0; indexDDR < Context->DDRSectionCount; indexDDR++) {
-            if ((spanCount > 0) &&
-                (!ddrMemoryMap[indexDDR].Contiguous))
-            {
-                //
-                // We got a problem. We got a run that spans 
-                // DDR sections but we are hitting a DDR section 
-                // which don't have memory that's contiguous with 
-                // previous. 
-                //
-                LogLibInfoPrintf(L"Error verifying memory run. Run is spanning discontiguous DDR sections.\r\n");
-                LogLibInfoPrintf(L"Run Index: 0x%llx\r\n");
-                LogLibInfoPrintf(L"DDR Index: 0x%llx\r\n", indexDDR);
-                LogLibInfoPrintf(L"Previous DDR Index: 0x%llx\r\n", (indexDDR - 1));
-
-                status = STATUS_BAD_DATA;
-                goto Exit;
-            }
-
-            //
-            // Is startPD in this DDR section?
-            //
-            if ((startPD >= ddrMemoryMap[indexDDR].Base) &&
-                (startPD <= ddrMemoryMap[indexDDR].End))
-            {
-                startInSection = TRUE;
-                //
-                // Does endPD also fall into this section?
-                //
-                if ((endPD >= ddrMemoryMap[indexDDR].Base) &&
-                    (endPD <= ddrMemoryMap[indexDDR].End))
-                {
-                    //
-                    // Range is within this section. 
-                    //
-                    endInSection = TRUE;
-                    break;
-                }
-                else
-                {
-                    //
-                    // Range is not contained in this section. 
-                    // Move startPD to the end plus 1. 
-                    //
-                    startPD = ddrMemoryMap[indexDDR].End + 1;
-                    spanCount++;
-                }
-            }
-        } //indexDDR
+    LogLibInfoPrintf(L"Checking 0x%x memory runs against DDR sections.\r\n", physDesc->NumberOfRuns);
+    status = ValidateMemoryRunsInDDR(Context);
 
-        //
-        // Check if the start or the end of a run fell within any DDR section.
-        //
-        if (!startInSection)
-        {
-            LogLibInfoPrintf(L"The start (0x%I64x) of run 0x%llx does not fall into any DDR section.\r\n",
-                (UINT64)(physDesc->Run[indexPD].BasePage * PAGE_SIZE),
-                indexPD);
-            status = STATUS_BAD_DATA;
-            goto Exit;
-        }
-
-        if (!endInSection)
-        {
-            LogLibInfoPrintf(L"The end (0x%I64x) of run 0x%llx does not fall into any DDR section.\r\n",
-                endPD,
-                indexPD);
-            status = STATUS_BAD_DATA;
-            goto Exit;
-        }
-
-        LogLibInfoPrintf(L"Descriptor 0x%llx checked out.\r\n", indexPD);
-    }//indexPD
-
-    status = STATUS_SUCCESS;
-Exit:
     return status;
 }
 
@@ -395,16 +431,25 @@ NT status code.
     LARGE_INTEGER   runSize;
     LARGE_INTEGER   startPA;
     UINT32          ioSize = 0;
-    ULONG           buffersize = DEFAULT_DMP_BUF_SZ;
+    UINT32          buffersize = 0;
     NTSTATUS        status = STATUS_UNSUCCESSFUL;
     PVOID           tempBuffer = NULL;
     IO_STATUS_BLOCK statusBlock;
-    
+    HANDLE          ddrHandle;
+
+    //
+    // When stitching a sharded conversion, the shards have written DDR.
+    //
+    if (Context->ShardMode == ConversionShardStitch) {
+        return SUCCEEDED(CheckDumpShards(Context)) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+    }
+
     //
     // Allocate the intermediate buffer to read memory from DDR section
-    // to the dump file.
+    // to the dump file, smaller than DEFAULT_DMP_BUF_SZ if the memory budget
+    // is short.
     //
-    tempBuffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buffersize);
+    AllocatePooledBuffer(Context, DEFAULT_DMP_BUF_SZ, PAGE_SIZE, &tempBuffer, &buffersize);
     if (tempBuffer == nullptr) {
          TraceNTSTATUS("Unable to allocate 0x%x bytes buffer for writing DDR memory to dump.\n", PAGE_SIZE);
         status = STATUS_NO_MEMORY;
@@ -412,6 +457,7 @@ NT status code.
     }
 
     //ZeroMemory(tempBuffer, buffersize);
+    ddrHandle = GetDDRWriteHandle(Context, Context->WindowsDumpFileOffset);
 
     for (index = 0; index < Context->DumpHeader64->PhysicalMemoryBlock.NumberOfRuns; index++)  {
 
@@ -442,7 +488,9 @@ NT status code.
                 goto Exit;
             }
 
-            status = NtWriteFile(Context->WindowsDumpHandle,
+            AddPagesToFingerprint(Context, startPA.QuadPart, tempBuffer, ioSize, PAGE_FINGERPRINT_REGION_OS);
+
+            status = NtWriteFile(ddrHandle,
                 nullptr,
                 nullptr,
                 nullptr,
@@ -456,11 +504,17 @@ NT status code.
                 goto Exit;
 
             }
-            NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+            if (ddrHandle == Context->WindowsDumpHandle) {
+                NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+            }
             bytesWritten.QuadPart += ioSize;
             Context->WindowsDumpFileOffset.QuadPart += ioSize;
             PageRemain -= ioSize / PAGE_SIZE;
-            TraceInfo2("Memory Run", "Index", index, "Pages remaining", PageRemain);
+            TraceInfoBinary2("Memory Run", "Index", index, "Pages remaining", PageRemain);
+            ReportConversionProgress(Context,
+                                     "Writing DDR section to the dump file",
+                                     bytesWritten.QuadPart,
+                                     Context->DumpHeader64->PhysicalMemoryBlock.NumberOfPages * PAGE_SIZE);
         }// for io
 
 #ifdef VERBOSE
@@ -478,10 +532,8 @@ NT status code.
 
 Exit:
 
-    if (tempBuffer != nullptr) {
-        HeapFree(GetProcessHeap(), NULL, tempBuffer);
-        tempBuffer = nullptr;
-    }
+    FreePooledBuffer(Context, tempBuffer, buffersize);
+
     return status;
 }
 
@@ -0,0 +1,470 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    DumpPatches.cpp
+
+Abstract:
+    Maps physical addresses to offsets in the dump file and holds back the
+    writes made to memory already in the dump, the decoded KdDebuggerDataBlock,
+    the bugcheck data, the CPU contexts and the InMemDiag buffer, until the
+    conversion is done. They are then written as one batch, sorted by offset
+    with adjacent and overlapping writes merged.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+static int __cdecl
+CompareDumpPatchByOffset(
+    _In_ const void *First,
+    _In_ const void *Second
+    )
+{
+    const DUMP_PATCH *first = (const DUMP_PATCH *)First;
+    const DUMP_PATCH *second = (const DUMP_PATCH *)Second;
+
+    if (first->FileOffset != second->FileOffset) {
+        return (first->FileOffset < second->FileOffset) ? -1 : 1;
+    }
+
+    return (first->Sequence < second->Sequence) ? -1 : ((first->Sequence > second->Sequence) ? 1 : 0);
+}
+
+
+static int __cdecl
+CompareDumpPatchBySequence(
+    _In_ const void *First,
+    _In_ const void *Second
+    )
+{
+    const DUMP_PATCH *first = (const DUMP_PATCH *)First;
+    const DUMP_PATCH *second = (const DUMP_PATCH *)Second;
+
+    return (first->Sequence < second->Sequence) ? -1 : ((first->Sequence > second->Sequence) ? 1 : 0);
+}
+
+
+HRESULT
+BuildDumpRunIndex(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function indexes the runs of the DUMP_HEADER.PhysicalMemoryBlock for
+LookupDumpFileOffset: the runs sorted by base, and the offset of every run in
+the dump file, the pages of the runs before it summed up. Called once the
+DUMP_HEADER is written and DDRFileOffset is known.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    UINT64      basePage = 0;
+    UINT64      pageCount = 0;
+    UINT64      fileOffset = 0;
+    UINT32      runCount = GetPhysicalMemoryRunCount(Context);
+    UINT32      overlapCount = 0;
+    HRESULT     hr = S_OK;
+
+    FreeDumpRunIndex(Context);
+
+    hr = BuildMemoryRunExtentSet(Context, &Context->RunIndex);
+    if (FAILED(hr)) {
+        TraceHRESULT("BuildMemoryRunExtentSet failed", hr);
+        goto Exit;
+    }
+
+    //
+    // Lookups take the run with the highest base at or below the address, the
+    // first run holding it in DUMP_HEADER order is only found without overlaps.
+    //
+    ExtentSetCheck(&Context->RunIndex, nullptr, &overlapCount);
+    if (overlapCount != 0) {
+        TraceInfo1("Memory runs of the DUMP_HEADER overlap", "Count", overlapCount);
+    }
+
+    Context->RunFileOffsets = (PUINT64)HeapAlloc(GetProcessHeap(), 0, max(runCount, 1) * sizeof(UINT64));
+    if (Context->RunFileOffsets == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Failed to allocate the run index", hr);
+        goto Exit;
+    }
+
+    fileOffset = Context->DDRFileOffset.QuadPart;
+    for (UINT32 index = 0; index < runCount; index++) {
+        GetPhysicalMemoryRun(Context, index, &basePage, &pageCount);
+        Context->RunFileOffsets[index] = fileOffset;
+        fileOffset += PAGES_TO_BYTES(pageCount);
+    }
+
+    TraceInfo1("Indexed memory runs", "Count", Context->RunIndex.Count);
+
+Exit:
+    if (FAILED(hr)) {
+        FreeDumpRunIndex(Context);
+    }
+
+    return hr;
+}
+
+
+VOID
+FreeDumpRunIndex(
+    _Inout_ PDMP_CONTEXT Context
+    )
+{
+    ExtentSetFree(&Context->RunIndex);
+
+    if (Context->RunFileOffsets != nullptr) {
+        HeapFree(GetProcessHeap(), 0, Context->RunFileOffsets);
+        Context->RunFileOffsets = nullptr;
+    }
+}
+
+
+NTSTATUS
+LookupDumpFileOffset(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 PhysicalAddress,
+    _In_ UINT32 Size,
+    _Out_ PUINT64 FileOffset
+    )
+/*++
+
+Routine Description:
+
+This function finds where physical memory is in the dump file with a binary
+search of the run index built by BuildDumpRunIndex. The memory must lie in a
+single run.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+PhysicalAddress - Start of the memory.
+
+Size - Bytes of memory, at least one.
+
+FileOffset - Receives the offset of PhysicalAddress in the dump file.
+
+Return Value:
+
+STATUS_INVALID_PARAMETER if no run holds all of the memory.
+
+--*/
+{
+    const EXTENT    *runs = Context->RunIndex.Extents;
+    UINT32          low = 0;
+    UINT32          high = Context->RunIndex.Count;
+    UINT32          middle;
+    UINT64          endAddress = PhysicalAddress + Size - 1;
+
+    *FileOffset = 0;
+
+    if ((Size == 0) || (endAddress < PhysicalAddress)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // Find the first run with a base above the address, the run before it is
+    // the only one that can hold the address.
+    //
+    while (low < high) {
+        middle = low + ((high - low) / 2);
+        if (runs[middle].Base <= PhysicalAddress) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    if ((low == 0) || (runs[low - 1].End < endAddress)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *FileOffset = Context->RunFileOffsets[runs[low - 1].Tag] + (PhysicalAddress - runs[low - 1].Base);
+
+    return STATUS_SUCCESS;
+}
+
+
+HRESULT
+QueueDumpPatch(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT64 FileOffset,
+    _In_reads_bytes_(Size) const VOID *Buffer,
+    _In_ UINT32 Size
+    )
+/*++
+
+Routine Description:
+
+This function copies a write to the dump file for ApplyDumpPatches. The
+caller's buffer may be reused as soon as this returns. Where patches overlap,
+the one queued last wins.
+
+Patches are queued by conversion phases ordered by DependsOn, never by two
+phases at once.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+FileOffset - Offset in the dump file.
+
+Buffer - Data to write.
+
+Size - Bytes to write.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDUMP_PATCH     patches = nullptr;
+    PVOID           data = nullptr;
+    UINT32          capacity;
+    HRESULT         hr = S_OK;
+
+    if (Context->PatchCount == Context->PatchCapacity) {
+        capacity = (Context->PatchCapacity == 0) ? DUMP_PATCH_INITIAL_CAPACITY : (Context->PatchCapacity * 2);
+
+        if (Context->Patches == nullptr) {
+            patches = (PDUMP_PATCH)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(DUMP_PATCH));
+        }
+        else {
+            patches = (PDUMP_PATCH)HeapReAlloc(GetProcessHeap(), 0, Context->Patches, capacity * sizeof(DUMP_PATCH));
+        }
+
+        if (patches == nullptr) {
+            hr = E_OUTOFMEMORY;
+            TraceHRESULT("Failed to grow the patch list", hr);
+            goto Exit;
+        }
+
+        Context->Patches = patches;
+        Context->PatchCapacity = capacity;
+    }
+
+    data = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (data == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Failed to allocate a patch", hr);
+        goto Exit;
+    }
+
+    RtlCopyMemory(data, Buffer, Size);
+    ChargeMemoryBudget(Context, Size, TRUE);
+    Context->PatchBytes += Size;
+
+    Context->Patches[Context->PatchCount].FileOffset = FileOffset;
+    Context->Patches[Context->PatchCount].Size = Size;
+    Context->Patches[Context->PatchCount].Sequence = Context->PatchCount;
+    Context->Patches[Context->PatchCount].Data = data;
+    Context->PatchCount++;
+
+Exit:
+    return hr;
+}
+
+
+NTSTATUS
+WriteDumpPatchBatch(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 FileOffset,
+    _In_reads_bytes_(Size) PVOID Buffer,
+    _In_ UINT32 Size
+    )
+/*++
+
+Routine Description:
+
+This function writes one coalesced batch of patches and waits for it, the
+dump file is opened for overlapped I/O and the buffer is freed afterwards.
+
+--*/
+{
+    IO_STATUS_BLOCK     statusBlock;
+    LARGE_INTEGER       ioOffset;
+    NTSTATUS            status;
+
+    ioOffset.QuadPart = (LONGLONG)FileOffset;
+
+    status = NtWriteFile(Context->WindowsDumpHandle,
+                         nullptr,
+                         nullptr,
+                         nullptr,
+                         &statusBlock,
+                         Buffer,
+                         Size,
+                         &ioOffset,
+                         nullptr);
+    if (status == STATUS_PENDING) {
+        WaitForSingleObject(Context->WindowsDumpHandle, INFINITE);
+        status = statusBlock.Status;
+    }
+
+    if (!NT_SUCCESS(status)) {
+        TraceNTSTATUS("Failed to write patches to dump file", status);
+    }
+
+    return status;
+}
+
+
+HRESULT
+ApplyDumpPatches(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function writes the patches queued with QueueDumpPatch, in file order.
+Patches that touch or overlap, up to DUMP_PATCH_BATCH_SIZE, are merged into
+one write, later patches over earlier ones. The dump file is flushed once at
+the end and the patches are freed whether they were written or not.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT of the first write that failed.
+
+--*/
+{
+    PDUMP_PATCH         patches = Context->Patches;
+    UINT32              first;
+    UINT32              last;
+    UINT64              batchStart;
+    UINT64              batchEnd;
+    UINT32              batchCount = 0;
+    PUCHAR              batch = nullptr;
+    IO_STATUS_BLOCK     statusBlock;
+    NTSTATUS            status = STATUS_SUCCESS;
+    HRESULT             hr = S_OK;
+
+    if (Context->PatchCount == 0) {
+        goto Exit;
+    }
+
+    qsort(patches, Context->PatchCount, sizeof(DUMP_PATCH), CompareDumpPatchByOffset);
+
+    for (first = 0; first < Context->PatchCount; first = last) {
+        batchStart = patches[first].FileOffset;
+        batchEnd = batchStart + patches[first].Size;
+
+        //
+        // Overlapping patches always share a batch so that the last one wins,
+        // patches that only touch are merged while the batch stays small.
+        //
+        for (last = first + 1; last < Context->PatchCount; last++) {
+            if ((patches[last].FileOffset > batchEnd) ||
+                ((patches[last].FileOffset == batchEnd) &&
+                 ((batchEnd + patches[last].Size - batchStart) > DUMP_PATCH_BATCH_SIZE))) {
+                break;
+            }
+
+            batchEnd = max(batchEnd, patches[last].FileOffset + patches[last].Size);
+        }
+
+        batchCount++;
+
+        if ((last - first) == 1) {
+            status = WriteDumpPatchBatch(Context, batchStart, patches[first].Data, patches[first].Size);
+        }
+        else if ((batchEnd - batchStart) > MAXULONG) {
+            status = STATUS_INVALID_PARAMETER;
+            TraceInfo2("Overlapping patches are too large", "Offset", batchStart, "Size", batchEnd - batchStart);
+        }
+        else if ((batch = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)(batchEnd - batchStart))) == nullptr) {
+            status = STATUS_NO_MEMORY;
+            TraceNTSTATUS("Failed to allocate a patch batch", status);
+        }
+        else {
+            qsort(&patches[first], last - first, sizeof(DUMP_PATCH), CompareDumpPatchBySequence);
+            for (UINT32 index = first; index < last; index++) {
+                RtlCopyMemory(batch + (patches[index].FileOffset - batchStart), patches[index].Data, patches[index].Size);
+            }
+
+            status = WriteDumpPatchBatch(Context, batchStart, batch, (UINT32)(batchEnd - batchStart));
+
+            HeapFree(GetProcessHeap(), 0, batch);
+            batch = nullptr;
+        }
+
+        if (!NT_SUCCESS(status) && SUCCEEDED(hr)) {
+            hr = HRESULT_FROM_NT(status);
+        }
+    }
+
+    NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+
+    TraceInfo2("Wrote patches to the dump file", "Patches", Context->PatchCount, "Writes", batchCount);
+
+Exit:
+    FreeDumpPatches(Context);
+    return hr;
+}
+
+
+VOID
+DiscardDumpPatches(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT32 FirstPatch
+    )
+/*++
+
+Routine Description:
+
+This function drops the patches queued since there were FirstPatch of them,
+for a phase that found out its writes were wrong.
+
+--*/
+{
+    for (UINT32 index = FirstPatch; index < Context->PatchCount; index++) {
+        HeapFree(GetProcessHeap(), 0, Context->Patches[index].Data);
+        ReturnMemoryBudget(Context, Context->Patches[index].Size);
+        Context->PatchBytes -= Context->Patches[index].Size;
+    }
+
+    if (FirstPatch < Context->PatchCount) {
+        Context->PatchCount = FirstPatch;
+    }
+}
+
+
+VOID
+FreeDumpPatches(
+    _Inout_ PDMP_CONTEXT Context
+    )
+{
+    DiscardDumpPatches(Context, 0);
+
+    if (Context->Patches != nullptr) {
+        HeapFree(GetProcessHeap(), 0, Context->Patches);
+        Context->Patches = nullptr;
+    }
+
+    Context->PatchCapacity = 0;
+}
@@ -0,0 +1,623 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    KernelProfile.cpp
+
+Abstract:
+    Caches what dbgeng finds out about a kernel build, so that later dumps of
+    the same build are converted without opening the dump in dbgeng.
+
+    The build is read from the PE header of the kernel image in the raw dump,
+    found through DUMP_HEADER.PsLoadedModuleList with the page tables of the
+    dump. A profile is only cached once that page walk translated the same
+    addresses as dbgeng did, since it takes dbgeng's place on a cache hit.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+
+//
+// Offset of KLDR_DATA_TABLE_ENTRY.DllBase, the first entry of PsLoadedModuleList
+// is the kernel.
+//
+#define KLDR_DLL_BASE_OFFSET64      0x30
+#define KLDR_DLL_BASE_OFFSET32      0x18
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+static NTSTATUS
+TranslateByPageWalk(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 VirtualAddress,
+    _Out_ PLARGE_INTEGER PhysicalAddress
+    )
+{
+    if (Context->Is64Bit) {
+        return VirtualToPhysical64(Context, VirtualAddress, PhysicalAddress);
+    }
+
+    //
+    // KDDEBUGGER_DATA64 holds the pointers of a 32 bit kernel sign extended.
+    //
+    if (((VirtualAddress >> 32) != 0) && ((VirtualAddress >> 32) != MAXULONG)) {
+        PhysicalAddress->QuadPart = ADDRESS_NOT_PRESENT;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return VirtualToPhysical(Context, (UINT32)VirtualAddress, PhysicalAddress);
+}
+
+
+NTSTATUS
+ReadVirtualByPageWalk(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 VirtualAddress,
+    _In_ UINT32 Length,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _Out_opt_ PLARGE_INTEGER PhysicalAddress
+    )
+/*++
+
+Routine Description:
+
+This function reads memory of the raw dump by virtual address, translated a
+page at a time with the page tables of the dump instead of dbgeng.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+VirtualAddress - Start of the memory.
+
+Length - Bytes to read.
+
+Buffer - Receives the memory.
+
+PhysicalAddress - Optional. Receives the physical address of VirtualAddress.
+
+Return Value:
+
+NT status code.
+
+--*/
+{
+    LARGE_INTEGER   pageAddress;
+    UINT32          pageLength;
+    UINT32          done = 0;
+    NTSTATUS        status = STATUS_SUCCESS;
+
+    while (done < Length) {
+        pageLength = (UINT32)min(Length - done, PAGE_SIZE - ((VirtualAddress + done) & (PAGE_SIZE - 1)));
+
+        status = TranslateByPageWalk(Context, VirtualAddress + done, &pageAddress);
+        if (!NT_SUCCESS(status)) {
+            TraceNTSTATUS("Failed to convert virtual address to physical address", status);
+            goto Exit;
+        }
+
+        if ((done == 0) && (PhysicalAddress != nullptr)) {
+            PhysicalAddress->QuadPart = pageAddress.QuadPart;
+        }
+
+        status = ReadFromDDRSectionByPhysicalAddress(Context, pageAddress, pageLength, (PUCHAR)Buffer + done);
+        if (!NT_SUCCESS(status)) {
+            TraceInfo1("Failed to read from physical address", "PA", pageAddress.QuadPart);
+            goto Exit;
+        }
+
+        done += pageLength;
+    }
+
+Exit:
+    return status;
+}
+
+
+static HRESULT
+ReadKernelImageKey(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function finds the kernel base through DUMP_HEADER.PsLoadedModuleList
+and reads the key of the kernel profile from the PE header of the image.
+
+--*/
+{
+    UINT64              listHead = Context->Is64Bit ? Context->DumpHeader64->PsLoadedModuleList : Context->DumpHeader32->PsLoadedModuleList;
+    UINT32              pointerSize = Context->Is64Bit ? sizeof(UINT64) : sizeof(UINT32);
+    UINT64              entry = 0;
+    UINT64              imageBase = 0;
+    IMAGE_DOS_HEADER    dosHeader;
+    UINT32              ntSignature = 0;
+    IMAGE_FILE_HEADER   fileHeader;
+    UINT32              sizeOfImage = 0;
+    UINT64              ntHeaders;
+    NTSTATUS            status;
+    HRESULT             hr = S_OK;
+
+    status = ReadVirtualByPageWalk(Context, listHead, pointerSize, &entry, nullptr);
+    if (NT_SUCCESS(status)) {
+        status = ReadVirtualByPageWalk(Context,
+                                       entry + (Context->Is64Bit ? KLDR_DLL_BASE_OFFSET64 : KLDR_DLL_BASE_OFFSET32),
+                                       pointerSize,
+                                       &imageBase,
+                                       nullptr);
+    }
+
+    if (NT_SUCCESS(status)) {
+        status = ReadVirtualByPageWalk(Context, imageBase, sizeof(dosHeader), &dosHeader, nullptr);
+    }
+
+    if (!NT_SUCCESS(status)) {
+        hr = HRESULT_FROM_NT(status);
+        TraceHRESULT("Failed to find the kernel image", hr);
+        goto Exit;
+    }
+
+    if ((dosHeader.e_magic != IMAGE_DOS_SIGNATURE) || (dosHeader.e_lfanew <= 0) || (dosHeader.e_lfanew >= PAGE_SIZE)) {
+        hr = HRESULT_FROM_WIN32(ERROR_BAD_EXE_FORMAT);
+        TraceHRESULT("The kernel image has no DOS header", hr);
+        goto Exit;
+    }
+
+    //
+    // SizeOfImage is at the same offset in IMAGE_OPTIONAL_HEADER32 and 64.
+    //
+    ntHeaders = imageBase + dosHeader.e_lfanew;
+    status = ReadVirtualByPageWalk(Context, ntHeaders, sizeof(ntSignature), &ntSignature, nullptr);
+    if (NT_SUCCESS(status)) {
+        status = ReadVirtualByPageWalk(Context, ntHeaders + sizeof(ntSignature), sizeof(fileHeader), &fileHeader, nullptr);
+    }
+
+    if (NT_SUCCESS(status)) {
+        status = ReadVirtualByPageWalk(Context,
+                                       ntHeaders + sizeof(ntSignature) + sizeof(fileHeader) + FIELD_OFFSET(IMAGE_OPTIONAL_HEADER32, SizeOfImage),
+                                       sizeof(sizeOfImage),
+                                       &sizeOfImage,
+                                       nullptr);
+    }
+
+    if (!NT_SUCCESS(status)) {
+        hr = HRESULT_FROM_NT(status);
+        TraceHRESULT("Failed to read the PE header of the kernel image", hr);
+        goto Exit;
+    }
+
+    if (ntSignature != IMAGE_NT_SIGNATURE) {
+        hr = HRESULT_FROM_WIN32(ERROR_BAD_EXE_FORMAT);
+        TraceHRESULT("The kernel image has no PE header", hr);
+        goto Exit;
+    }
+
+    Context->KernelBase = imageBase;
+    Context->KernelProfile.TimeDateStamp = fileHeader.TimeDateStamp;
+    Context->KernelProfile.SizeOfImage = sizeOfImage;
+    Context->KernelProfile.Machine = fileHeader.Machine;
+    Context->KernelProfileKnown = TRUE;
+
+    TraceInfo3("Kernel image", "TimeDateStamp", fileHeader.TimeDateStamp, "SizeOfImage", sizeOfImage, "Machine", fileHeader.Machine);
+
+Exit:
+    return hr;
+}
+
+
+static HRESULT
+GetKernelProfileCachePath(
+    _In_ PDMP_CONTEXT Context,
+    _In_opt_ LPCWSTR Suffix,
+    _Outptr_ LPWSTR *Path
+    )
+/*++
+
+Routine Description:
+
+This function makes the path of the kernel profile cache, in the directory of
+the dump, with Suffix appended. The caller frees it with HeapFree.
+
+--*/
+{
+    LPCWSTR     fileName = wcsrchr(Context->WindowsDumpFilePath, L'\\');
+    size_t      directoryLength = (fileName == nullptr) ? 0 : (fileName - Context->WindowsDumpFilePath + 1);
+    size_t      pathLength;
+    HRESULT     hr = S_OK;
+
+    if (Suffix == nullptr) {
+        Suffix = L"";
+    }
+
+    pathLength = directoryLength + ARRAYSIZE(KERNEL_PROFILE_CACHE_FILE_NAME) + wcslen(Suffix);
+    *Path = (LPWSTR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, pathLength * sizeof(WCHAR));
+    if (*Path == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the kernel profile cache path", hr);
+        goto Exit;
+    }
+
+    hr = StringCchPrintfW(*Path,
+                          pathLength,
+                          L"%.*s%s%s",
+                          (int)directoryLength,
+                          Context->WindowsDumpFilePath,
+                          KERNEL_PROFILE_CACHE_FILE_NAME,
+                          Suffix);
+    if (FAILED(hr)) {
+        TraceHRESULT("StringCchPrintfW failed", hr);
+        HeapFree(GetProcessHeap(), NULL, *Path);
+        *Path = nullptr;
+        goto Exit;
+    }
+
+Exit:
+    return hr;
+}
+
+
+static HRESULT
+ReadKernelProfileCache(
+    _In_ PDMP_CONTEXT Context,
+    _Out_ PKERNEL_PROFILE_CACHE Cache
+    )
+/*++
+
+Routine Description:
+
+This function reads the kernel profile cache. A missing or damaged cache reads
+as an empty one.
+
+--*/
+{
+    HANDLE      cacheHandle = INVALID_HANDLE_VALUE;
+    LPWSTR      path = nullptr;
+    DWORD       bytesRead = 0;
+    HRESULT     hr = S_OK;
+
+    RtlZeroMemory(Cache, sizeof(*Cache));
+
+    hr = GetKernelProfileCachePath(Context, nullptr, &path);
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    cacheHandle = CreateFileW(path,
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (cacheHandle == INVALID_HANDLE_VALUE) {
+        if (GetLastError() != ERROR_FILE_NOT_FOUND) {
+            TraceHRESULT("Failed to open the kernel profile cache", HRESULT_FROM_WIN32(GetLastError()));
+        }
+
+        goto Empty;
+    }
+
+    if (!ReadFile(cacheHandle, Cache, sizeof(*Cache), &bytesRead, nullptr)) {
+        TraceHRESULT("Failed to read the kernel profile cache", HRESULT_FROM_WIN32(GetLastError()));
+        goto Empty;
+    }
+
+    if ((bytesRead < FIELD_OFFSET(KERNEL_PROFILE_CACHE, Profiles)) ||
+        (Cache->Signature != KERNEL_PROFILE_CACHE_SIGNATURE) ||
+        (Cache->Version != KERNEL_PROFILE_CACHE_VERSION) ||
+        (Cache->Count > KERNEL_PROFILE_CACHE_MAX_COUNT) ||
+        (bytesRead != FIELD_OFFSET(KERNEL_PROFILE_CACHE, Profiles[Cache->Count]))) {
+        TraceInfo1("Ignoring a damaged kernel profile cache", "Bytes", bytesRead);
+        goto Empty;
+    }
+
+    goto Exit;
+
+Empty:
+    RtlZeroMemory(Cache, sizeof(*Cache));
+    Cache->Signature = KERNEL_PROFILE_CACHE_SIGNATURE;
+    Cache->Version = KERNEL_PROFILE_CACHE_VERSION;
+
+Exit:
+    if (cacheHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(cacheHandle);
+    }
+
+    if (path != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, path);
+    }
+
+    return hr;
+}
+
+
+static HRESULT
+WriteKernelProfileCache(
+    _In_ PDMP_CONTEXT Context,
+    _In_ PKERNEL_PROFILE_CACHE Cache
+    )
+/*++
+
+Routine Description:
+
+This function replaces the kernel profile cache. The cache is written next to
+it first and renamed over it, so that conversions reading it at the same time
+see either the old or the new one.
+
+--*/
+{
+    HANDLE      cacheHandle = INVALID_HANDLE_VALUE;
+    LPWSTR      path = nullptr;
+    LPWSTR      newPath = nullptr;
+    WCHAR       suffix[16];
+    DWORD       size = FIELD_OFFSET(KERNEL_PROFILE_CACHE, Profiles[Cache->Count]);
+    DWORD       bytesWritten = 0;
+    HRESULT     hr = S_OK;
+
+    hr = StringCchPrintfW(suffix, ARRAYSIZE(suffix), L".%08x", GetCurrentThreadId());
+    if (SUCCEEDED(hr)) {
+        hr = GetKernelProfileCachePath(Context, nullptr, &path);
+    }
+
+    if (SUCCEEDED(hr)) {
+        hr = GetKernelProfileCachePath(Context, suffix, &newPath);
+    }
+
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    cacheHandle = CreateFileW(newPath,
+                              GENERIC_WRITE,
+                              0,
+                              nullptr,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (cacheHandle == INVALID_HANDLE_VALUE) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to create the kernel profile cache", hr);
+        goto Exit;
+    }
+
+    if (!WriteFile(cacheHandle, Cache, size, &bytesWritten, nullptr) || (bytesWritten != size)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to write the kernel profile cache", hr);
+        goto Exit;
+    }
+
+    CloseHandle(cacheHandle);
+    cacheHandle = INVALID_HANDLE_VALUE;
+
+    if (!MoveFileExW(newPath, path, MOVEFILE_REPLACE_EXISTING)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to replace the kernel profile cache", hr);
+        goto Exit;
+    }
+
+Exit:
+    if (cacheHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(cacheHandle);
+    }
+
+    if (FAILED(hr) && (newPath != nullptr)) {
+        DeleteFileW(newPath);
+    }
+
+    if (newPath != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, newPath);
+    }
+
+    if (path != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, path);
+    }
+
+    return hr;
+}
+
+
+static UINT32
+FindKernelProfile(
+    _In_ PKERNEL_PROFILE_CACHE Cache,
+    _In_ PKERNEL_PROFILE Key
+    )
+{
+    UINT32  index;
+
+    for (index = 0; index < Cache->Count; index++) {
+        if ((Cache->Profiles[index].TimeDateStamp == Key->TimeDateStamp) &&
+            (Cache->Profiles[index].SizeOfImage == Key->SizeOfImage) &&
+            (Cache->Profiles[index].Machine == Key->Machine)) {
+            break;
+        }
+    }
+
+    return index;
+}
+
+
+VOID
+LookupKernelProfile(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function reads the build of the kernel from the raw dump and looks it up
+in the kernel profile cache. On a hit KernelProfileHit is set, and virtual
+addresses are translated by ReadVirtualByPageWalk until CheckKernelProfile
+has confirmed the profile against the KdDebuggerDataBlock.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the DUMP_HEADER.
+
+Return Value:
+
+None, the conversion goes on through dbgeng if there is no usable profile.
+
+--*/
+{
+    PKERNEL_PROFILE_CACHE   cache = nullptr;
+    UINT64                  kdDebuggerDataBlockVA = Context->Is64Bit ? Context->DumpHeader64->KdDebuggerDataBlock : Context->DumpHeader32->KdDebuggerDataBlock;
+    UINT32                  index;
+
+    Context->KernelProfileKnown = FALSE;
+    Context->KernelProfileHit = FALSE;
+
+    if (FAILED(ReadKernelImageKey(Context))) {
+        goto Exit;
+    }
+
+    cache = (PKERNEL_PROFILE_CACHE)HeapAlloc(GetProcessHeap(), 0, sizeof(KERNEL_PROFILE_CACHE));
+    if (cache == nullptr) {
+        TraceHRESULT("Unable to allocate the kernel profile cache", E_OUTOFMEMORY);
+        goto Exit;
+    }
+
+    if (FAILED(ReadKernelProfileCache(Context, cache))) {
+        goto Exit;
+    }
+
+    index = FindKernelProfile(cache, &Context->KernelProfile);
+    if (index == cache->Count) {
+        TraceInfo1("No cached profile of the kernel", "Profiles", cache->Count);
+        goto Exit;
+    }
+
+    if ((kdDebuggerDataBlockVA - Context->KernelBase) != cache->Profiles[index].KdDebuggerDataBlockRva) {
+        TraceInfo1("The cached kernel profile does not match the DUMP_HEADER", "KdDebuggerDataBlock", kdDebuggerDataBlockVA);
+        goto Exit;
+    }
+
+    Context->KernelProfile = cache->Profiles[index];
+    Context->KernelProfileHit = TRUE;
+    TraceInfo("Using the cached kernel profile instead of dbgeng");
+
+Exit:
+    if (cache != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, cache);
+    }
+}
+
+
+BOOL
+CheckKernelProfile(
+    _In_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function checks the KdDebuggerDataBlock read with a cached profile
+against the profile.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the KdDebuggerDataBlock.
+
+Return Value:
+
+TRUE if the block is the one the profile was made from.
+
+--*/
+{
+    PKDDEBUGGER_DATA64  block = Context->KdDebuggerDataBlock;
+
+    return (block != nullptr) &&
+           (block->Header.Size == Context->KernelProfile.KdDebuggerDataBlockSize) &&
+           (((UINT64)block->KiProcessorBlock - Context->KernelBase) == Context->KernelProfile.KiProcessorBlockRva) &&
+           (block->OffsetPrcbContext == Context->KernelProfile.OffsetPrcbContext);
+}
+
+
+VOID
+SaveKernelProfile(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function adds the profile of the kernel to the cache once dbgeng found
+the KdDebuggerDataBlock, if the page walk of ReadVirtualByPageWalk translates
+the addresses the conversion uses the same way dbgeng does. The oldest
+profile makes room when the cache is full.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the KdDebuggerDataBlock.
+
+Return Value:
+
+None, a profile that could not be saved is only traced.
+
+--*/
+{
+    PKERNEL_PROFILE_CACHE   cache = nullptr;
+    IDebugDataSpaces2       *dataSpaces = DbgClient::GetDataSpaces();
+    PKDDEBUGGER_DATA64      block = Context->KdDebuggerDataBlock;
+    UINT64                  addresses[3];
+    ULONG64                 debuggerAddress;
+    LARGE_INTEGER           walkedAddress;
+    UINT32                  index;
+
+    if (!Context->KernelProfileKnown || (block == nullptr) || (dataSpaces == nullptr)) {
+        goto Exit;
+    }
+
+    addresses[0] = Context->Is64Bit ? Context->DumpHeader64->KdDebuggerDataBlock : Context->DumpHeader32->KdDebuggerDataBlock;
+    addresses[1] = Context->Is64Bit ? Context->DumpHeader64->PsLoadedModuleList : Context->DumpHeader32->PsLoadedModuleList;
+    addresses[2] = block->KiProcessorBlock;
+
+    for (index = 0; index < ARRAYSIZE(addresses); index++) {
+        if (FAILED(dataSpaces->VirtualToPhysical(addresses[index], &debuggerAddress)) ||
+            !NT_SUCCESS(TranslateByPageWalk(Context, addresses[index], &walkedAddress)) ||
+            ((UINT64)walkedAddress.QuadPart != debuggerAddress)) {
+            TraceInfo1("The page walk disagrees with dbgeng, not caching the kernel profile", "VA", addresses[index]);
+            goto Exit;
+        }
+    }
+
+    Context->KernelProfile.KdDebuggerDataBlockSize = block->Header.Size;
+    Context->KernelProfile.KdDebuggerDataBlockRva = addresses[0] - Context->KernelBase;
+    Context->KernelProfile.KiProcessorBlockRva = block->KiProcessorBlock - Context->KernelBase;
+    Context->KernelProfile.OffsetPrcbContext = block->OffsetPrcbContext;
+
+    cache = (PKERNEL_PROFILE_CACHE)HeapAlloc(GetProcessHeap(), 0, sizeof(KERNEL_PROFILE_CACHE));
+    if (cache == nullptr) {
+        TraceHRESULT("Unable to allocate the kernel profile cache", E_OUTOFMEMORY);
+        goto Exit;
+    }
+
+    if (FAILED(ReadKernelProfileCache(Context, cache))) {
+        goto Exit;
+    }
+
+    index = FindKernelProfile(cache, &Context->KernelProfile);
+    if (index == KERNEL_PROFILE_CACHE_MAX_COUNT) {
+        RtlMoveMemory(&cache->Profiles[0], &cache->Profiles[1], (KERNEL_PROFILE_CACHE_MAX_COUNT - 1) * sizeof(KERNEL_PROFILE));
+        index = KERNEL_PROFILE_CACHE_MAX_COUNT - 1;
+    }
+    else if (index == cache->Count) {
+        cache->Count++;
+    }
+
+    cache->Profiles[index] = Context->KernelProfile;
+
+    if (SUCCEEDED(WriteKernelProfileCache(Context, cache))) {
+        TraceInfo1("Cached the kernel profile", "Profiles", cache->Count);
+    }
+
+Exit:
+    if (cache != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, cache);
+    }
+}
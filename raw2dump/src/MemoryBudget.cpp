@@ -0,0 +1,520 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    MemoryBudget.cpp
+
+Abstract:
+    Keeps the memory used by a conversion under a limit. I/O buffers come
+    from a pool of page aligned buffers shared by all phases and shrink when
+    the limit is near; other large allocations are charged to the same limit.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+#include <psapi.h>
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+VOID
+InitializeMemoryBudget(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT64 Limit
+    )
+/*++
+
+Routine Description:
+
+This function sets the number of bytes the conversion may allocate for its
+buffers, maps and caches. Release with ReleaseMemoryBudget.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Limit - Budget in bytes, 0 for no limit.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PMEMORY_BUDGET budget = &Context->MemoryBudget;
+
+    RtlZeroMemory(budget, sizeof(*budget));
+    budget->Limit = Limit;
+    InitializeCriticalSection(&budget->Lock);
+    budget->LockInitialized = TRUE;
+
+    if (Limit != 0) {
+        TraceInfo1("Conversion memory budget", "Bytes", Limit);
+    }
+}
+
+
+VOID
+LockMemoryBudget(
+    _Inout_ PMEMORY_BUDGET Budget
+    )
+{
+    if (Budget->LockInitialized) {
+        EnterCriticalSection(&Budget->Lock);
+    }
+}
+
+
+VOID
+UnlockMemoryBudget(
+    _Inout_ PMEMORY_BUDGET Budget
+    )
+{
+    if (Budget->LockInitialized) {
+        LeaveCriticalSection(&Budget->Lock);
+    }
+}
+
+
+VOID
+AddMemoryBudgetUse(
+    _Inout_ PMEMORY_BUDGET Budget,
+    _In_ UINT64 Size
+    )
+/*++
+
+Routine Description:
+
+This function adds to the bytes in use and tracks their peak. Called with the
+budget locked.
+
+--*/
+{
+    Budget->InUse += Size;
+    if (Budget->InUse > Budget->Peak) {
+        Budget->Peak = Budget->InUse;
+    }
+}
+
+
+BOOL
+FitsMemoryBudget(
+    _In_ PMEMORY_BUDGET Budget,
+    _In_ UINT64 Size
+    )
+{
+    return (Budget->Limit == 0) ||
+           ((Budget->InUse <= Budget->Limit) && (Size <= (Budget->Limit - Budget->InUse)));
+}
+
+
+VOID
+TrimBufferPool(
+    _Inout_ PMEMORY_BUDGET Budget
+    )
+/*++
+
+Routine Description:
+
+This function frees the buffers idle in the pool and returns their bytes to
+the budget. Called with the budget locked.
+
+--*/
+{
+    for (UINT32 index = 0; index < Budget->FreeCount; index++) {
+        VirtualFree(Budget->Free[index].Buffer, 0, MEM_RELEASE);
+        Budget->InUse -= Budget->Free[index].Size;
+    }
+
+    Budget->FreeCount = 0;
+}
+
+
+HRESULT
+ChargeMemoryBudget(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT64 Size,
+    _In_ BOOL Required
+    )
+/*++
+
+Routine Description:
+
+This function charges an allocation made outside the buffer pool to the
+budget, freeing idle pooled buffers to make room. An allocation the
+conversion cannot do without is charged even over the limit, so that I/O
+buffers allocated after it shrink instead.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Size - Bytes allocated.
+
+Required - TRUE to charge the bytes even if they exceed the budget.
+
+Return Value:
+
+S_OK if the bytes fit the budget, S_FALSE if a required allocation exceeds it,
+E_OUTOFMEMORY if an optional one does; nothing is charged then.
+
+--*/
+{
+    PMEMORY_BUDGET  budget = &Context->MemoryBudget;
+    HRESULT         hr = S_OK;
+
+    LockMemoryBudget(budget);
+
+    if (!FitsMemoryBudget(budget, Size)) {
+        TrimBufferPool(budget);
+    }
+
+    if (!FitsMemoryBudget(budget, Size)) {
+        if (!Required) {
+            hr = E_OUTOFMEMORY;
+            goto Exit;
+        }
+
+        TraceInfo2("Required allocation exceeds the memory budget", "Bytes", Size, "InUse", budget->InUse);
+        hr = S_FALSE;
+    }
+
+    AddMemoryBudgetUse(budget, Size);
+
+Exit:
+    UnlockMemoryBudget(budget);
+
+    return hr;
+}
+
+
+VOID
+ReturnMemoryBudget(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT64 Size
+    )
+/*++
+
+Routine Description:
+
+This function returns the bytes of a freed allocation charged with
+ChargeMemoryBudget.
+
+--*/
+{
+    PMEMORY_BUDGET budget = &Context->MemoryBudget;
+
+    LockMemoryBudget(budget);
+    budget->InUse -= min(Size, budget->InUse);
+    UnlockMemoryBudget(budget);
+}
+
+
+HRESULT
+AllocatePooledBuffer(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT32 PreferredSize,
+    _In_ UINT32 MinimumSize,
+    _Outptr_result_bytebuffer_(*Size) PVOID *Buffer,
+    _Out_ PUINT32 Size
+    )
+/*++
+
+Routine Description:
+
+This function gets a page aligned buffer for I/O. An idle pooled buffer of at
+least MinimumSize bytes is reused, the one closest to PreferredSize first.
+Otherwise a new buffer is allocated, halving its size from PreferredSize
+while it does not fit the budget or the allocation fails. A new buffer is
+zero filled, a reused one holds whatever its last user left in it.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+PreferredSize - Size the caller works best with.
+
+MinimumSize - Smallest size the caller can work with.
+
+Buffer - Receives the buffer, free with FreePooledBuffer.
+
+Size - Receives the size of the buffer, a multiple of PAGE_SIZE.
+
+Return Value:
+
+HRESULT, E_OUTOFMEMORY if not even MinimumSize bytes could be had.
+
+--*/
+{
+    PMEMORY_BUDGET  budget = &Context->MemoryBudget;
+    UINT32          minimum = MEMORY_POOL_ROUND(max(MinimumSize, 1U));
+    UINT32          preferred = max(MEMORY_POOL_ROUND(PreferredSize), minimum);
+    UINT32          size = preferred;
+    UINT32          best = MEMORY_POOL_MAX_FREE;
+    UINT32          bestDistance = MAXUINT32;
+    UINT32          distance;
+    PVOID           buffer = nullptr;
+    HRESULT         hr = S_OK;
+
+    *Buffer = nullptr;
+    *Size = 0;
+
+    LockMemoryBudget(budget);
+
+    for (UINT32 index = 0; index < budget->FreeCount; index++) {
+        if (budget->Free[index].Size < minimum) {
+            continue;
+        }
+
+        distance = (budget->Free[index].Size >= preferred) ?
+                   (budget->Free[index].Size - preferred) :
+                   (preferred - budget->Free[index].Size);
+        if (distance < bestDistance) {
+            best = index;
+            bestDistance = distance;
+        }
+    }
+
+    if (best != MEMORY_POOL_MAX_FREE) {
+        *Buffer = budget->Free[best].Buffer;
+        *Size = budget->Free[best].Size;
+        budget->Free[best] = budget->Free[--budget->FreeCount];
+        goto Exit;
+    }
+
+    if (!FitsMemoryBudget(budget, size)) {
+        TrimBufferPool(budget);
+    }
+
+    for (; size >= minimum; size = MEMORY_POOL_ROUND(size / 2)) {
+        if (FitsMemoryBudget(budget, size)) {
+            buffer = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (buffer != nullptr) {
+                break;
+            }
+        }
+
+        if (size == minimum) {
+            break;
+        }
+    }
+
+    if (buffer == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceInfo2("No buffer fits the memory budget", "Minimum", minimum, "InUse", budget->InUse);
+        goto Exit;
+    }
+
+    if (size < preferred) {
+        TraceInfo2("I/O buffer reduced to fit the memory budget", "Preferred", PreferredSize, "Size", size);
+    }
+
+    AddMemoryBudgetUse(budget, size);
+    *Buffer = buffer;
+    *Size = size;
+
+Exit:
+    UnlockMemoryBudget(budget);
+
+    return hr;
+}
+
+
+VOID
+FreePooledBuffer(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_opt_ PVOID Buffer,
+    _In_ UINT32 Size
+    )
+/*++
+
+Routine Description:
+
+This function puts a buffer from AllocatePooledBuffer back in the pool for
+the next phase, or frees it if the pool is full.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Buffer - The buffer, may be nullptr.
+
+Size - Size returned with the buffer.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PMEMORY_BUDGET budget = &Context->MemoryBudget;
+
+    if (Buffer == nullptr) {
+        return;
+    }
+
+    LockMemoryBudget(budget);
+
+    if (budget->FreeCount < MEMORY_POOL_MAX_FREE) {
+        budget->Free[budget->FreeCount].Buffer = Buffer;
+        budget->Free[budget->FreeCount].Size = Size;
+        budget->FreeCount++;
+    }
+    else {
+        VirtualFree(Buffer, 0, MEM_RELEASE);
+        budget->InUse -= min((UINT64)Size, budget->InUse);
+    }
+
+    UnlockMemoryBudget(budget);
+}
+
+
+VOID
+ReleaseMemoryBudget(
+    _Inout_ PDMP_CONTEXT Context,
+    _Out_opt_ PUINT64 PeakBytes
+    )
+/*++
+
+Routine Description:
+
+This function frees the buffer pool and reports the peak of memory charged to
+the budget and the peak working set of the process.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+PeakBytes - Receives the peak of memory charged to the budget.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PMEMORY_BUDGET              budget = &Context->MemoryBudget;
+    PROCESS_MEMORY_COUNTERS     counters = { 0 };
+
+    TrimBufferPool(budget);
+
+    if (PeakBytes != nullptr) {
+        *PeakBytes = budget->Peak;
+    }
+
+    if (!budget->LockInitialized) {
+        return;
+    }
+
+    counters.cb = sizeof(counters);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        TraceInfo2("Conversion memory peak", "Budgeted", budget->Peak, "WorkingSet", (UINT64)counters.PeakWorkingSetSize);
+    }
+    else {
+        TraceInfo1("Conversion memory peak", "Budgeted", budget->Peak);
+    }
+
+    DeleteCriticalSection(&budget->Lock);
+    budget->LockInitialized = FALSE;
+}
+
+
+VOID
+AttachWarmBuffers(
+    _Inout_ PDMP_CONTEXT Context,
+    _Inout_ PWARM_BUFFER_POOL Pool
+    )
+/*++
+
+Routine Description:
+
+This function moves the buffers kept from an earlier conversion into the pool
+of this one, charging them to its budget. Buffers that do not fit the budget
+are freed. Call after InitializeMemoryBudget.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Pool - Buffers kept by DetachWarmBuffers, empty on return.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PMEMORY_BUDGET budget = &Context->MemoryBudget;
+
+    LockMemoryBudget(budget);
+
+    for (UINT32 index = 0; index < Pool->Count; index++) {
+        if ((budget->FreeCount < MEMORY_POOL_MAX_FREE) && FitsMemoryBudget(budget, Pool->Buffers[index].Size)) {
+            budget->Free[budget->FreeCount++] = Pool->Buffers[index];
+            AddMemoryBudgetUse(budget, Pool->Buffers[index].Size);
+        }
+        else {
+            VirtualFree(Pool->Buffers[index].Buffer, 0, MEM_RELEASE);
+        }
+    }
+
+    Pool->Count = 0;
+
+    UnlockMemoryBudget(budget);
+}
+
+
+VOID
+DetachWarmBuffers(
+    _Inout_ PDMP_CONTEXT Context,
+    _Inout_ PWARM_BUFFER_POOL Pool
+    )
+/*++
+
+Routine Description:
+
+This function takes the idle buffers out of the pool of a finished conversion
+so that the next one can start with them, see AttachWarmBuffers. Call before
+ReleaseMemoryBudget, once the buffers in use have been freed.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Pool - Receives the buffers, up to MEMORY_POOL_MAX_FREE in all.
+
+Return Value:
+
+None.
+
+--*/
+{
+    PMEMORY_BUDGET budget = &Context->MemoryBudget;
+
+    LockMemoryBudget(budget);
+
+    while ((budget->FreeCount != 0) && (Pool->Count < MEMORY_POOL_MAX_FREE)) {
+        budget->FreeCount--;
+        Pool->Buffers[Pool->Count++] = budget->Free[budget->FreeCount];
+        budget->InUse -= min((UINT64)budget->Free[budget->FreeCount].Size, budget->InUse);
+    }
+
+    UnlockMemoryBudget(budget);
+}
+
+
+VOID
+FreeWarmBuffers(
+    _Inout_ PWARM_BUFFER_POOL Pool
+    )
+{
+    for (UINT32 index = 0; index < Pool->Count; index++) {
+        VirtualFree(Pool->Buffers[index].Buffer, 0, MEM_RELEASE);
+    }
+
+    Pool->Count = 0;
+}
@@ -176,7 +176,7 @@ XmlAttrToULONGLONG(
 //
 // Extract several values from an offline dump XML:
 //
-// 1. Dump header instance
+// 1. Dump header instance and physical address hint
 // 2. AP_REG physical address
 // 3. BugCheck parameters
 //
@@ -203,6 +203,12 @@ SetContextSettingsFromXml(
                 if (FAILED(hr = XmlAttrToULONGLONG(XmlReader, L"Instance", &pContext->DumpInstance.QuadPart))) {
                     goto Error;
                 }
+
+                // Newer OffDumpSvc also records where it expects the header to be. Older XML
+                // files do not have the attribute, in which case the hint stays zero.
+                if (FAILED(hr = XmlAttrToULONGLONG(XmlReader, L"PA", (ULONGLONG *)&pContext->DumpHeaderPAHint.QuadPart))) {
+                    goto Error;
+                }
             } else if (!_wcsicmp(ElementName, L"APREGAddress")) {
                 TraceInfo("At APREGAddress\n");
                 // OffDumpSvc finds this SV-specific block and indicates its file offset with this element.
@@ -264,6 +270,7 @@ SetContextSettingsFromXml(
     hr = S_OK;
 
     TraceInfo1("From XML", "DumpHeaderInstance", pContext->DumpInstance.QuadPart);
+    TraceInfo1("From XML", "DumpHeaderPAHint", pContext->DumpHeaderPAHint.QuadPart);
     TraceInfo1("From XML", "APREGAddress", pContext->APRegAddress.QuadPart);
     TraceInfo1("From XML", "BugCheckCode", pContext->BugCheckCode);
     TraceInfo1("From XML", "BugCheck Param1", pContext->BugCheckParam1);
@@ -0,0 +1,979 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    SearchDump.cpp
+
+Abstract:
+    Searches the physical memory held in a raw dump for byte patterns.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+
+//
+// ------------------------- Local Types ----------------------------------------------------------------------
+//
+
+#define SEARCH_ROOT_STATE           0
+#define SEARCH_NO_STATE             ((UINT32)(-1))
+#define SEARCH_NO_MATCH             ((UINT32)(-1))
+
+//
+// A pattern and the bytes of it the automaton looks for. Bytes is already
+// masked: a byte matches when (byte & Mask[i]) == Bytes[i]. The anchor is the
+// longest run of bytes with a full mask.
+//
+typedef struct _SEARCH_PATTERN
+{
+    UCHAR       Bytes[SEARCH_MAX_PATTERN_LENGTH];
+    UCHAR       Mask[SEARCH_MAX_PATTERN_LENGTH];
+    UINT32      Length;
+    UINT32      Alignment;
+    UINT32      AnchorOffset;
+    UINT32      AnchorLength;
+} SEARCH_PATTERN, *PSEARCH_PATTERN;
+
+//
+// Aho-Corasick automaton over the anchors, with the failure links folded into
+// a full transition table. Matches of a state are a linked list of patterns
+// whose tail is the list of the state's failure state.
+//
+typedef struct _SEARCH_MATCH
+{
+    UINT32      Pattern;
+    UINT32      Next;
+} SEARCH_MATCH, *PSEARCH_MATCH;
+
+typedef struct _SEARCH_AUTOMATON
+{
+    PUINT32         Next;           // StateCount * 256 transitions
+    PUINT32         FirstMatch;     // StateCount entries, index into Matches
+    PSEARCH_MATCH   Matches;        // One per pattern
+    UINT32          StateCount;
+    UINT64          PairFilter[0x10000 / 64];
+} SEARCH_AUTOMATON, *PSEARCH_AUTOMATON;
+
+typedef struct _SEARCH_HIT
+{
+    UINT64      PhysicalAddress;
+    UINT32      Pattern;
+    UINT32      ContextBefore;
+    UINT32      ContextLength;
+    UCHAR       Context[SEARCH_CONTEXT_BYTES * 2 + SEARCH_MAX_PATTERN_LENGTH];
+} SEARCH_HIT, *PSEARCH_HIT;
+
+//
+// Shared by the search threads. Every slice lies in one DDR memory map entry
+// (the extent Tag); a thread reads the slice plus enough of what follows it to
+// see patterns that start in the slice and end past it.
+//
+typedef struct _SEARCH_CONTEXT
+{
+    PDMP_CONTEXT        Context;
+    HANDLE              hRawFile;
+    CRITICAL_SECTION    Lock;
+    PSEARCH_PATTERN     Patterns;
+    UINT32              PatternCount;
+    UINT32              MaxPatternLength;
+    PSEARCH_AUTOMATON   Automaton;
+    EXTENT_SET          Slices;
+    PSEARCH_HIT         Hits;
+    UINT32              HitCount;
+    UINT32              HitCapacity;
+    volatile LONG       Truncated;
+    volatile LONG       NextSlice;
+    volatile LONG       hr;
+    volatile LONG64     BytesSearched;
+} SEARCH_CONTEXT, *PSEARCH_CONTEXT;
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+static int __cdecl
+CompareSearchHits(
+    _In_ const void *First,
+    _In_ const void *Second
+    )
+{
+    const SEARCH_HIT *first = (const SEARCH_HIT *)First;
+    const SEARCH_HIT *second = (const SEARCH_HIT *)Second;
+
+    if (first->PhysicalAddress != second->PhysicalAddress) {
+        return (first->PhysicalAddress < second->PhysicalAddress) ? -1 : 1;
+    }
+
+    return (first->Pattern < second->Pattern) ? -1 : ((first->Pattern > second->Pattern) ? 1 : 0);
+}
+
+
+static int
+HexDigitValue(
+    _In_ WCHAR Digit
+    )
+{
+    if ((Digit >= L'0') && (Digit <= L'9')) {
+        return Digit - L'0';
+    }
+    else if ((Digit >= L'a') && (Digit <= L'f')) {
+        return Digit - L'a' + 10;
+    }
+    else if ((Digit >= L'A') && (Digit <= L'F')) {
+        return Digit - L'A' + 10;
+    }
+
+    return -1;
+}
+
+
+HRESULT
+ParseSearchPattern(
+    _In_ LPCWSTR Text,
+    _Out_ PSEARCH_PATTERN Pattern
+    )
+/*++
+
+Routine Description:
+
+This function turns the text form of a pattern into bytes and a mask.
+
+    <kind>[/<alignment>]:<value>
+
+    hex     Hex bytes, '?' matches any nibble: "hex:4D5A??00", "hex/16:0?"
+    str     ASCII text: "str:Proc"
+    wstr    UTF-16LE text: "wstr:ntoskrnl.exe"
+    u32     32 bit little endian value: "u32/4:0xE0E0E0E0"
+    u64     64 bit little endian value: "u64/8:0xfffff80312345000"
+    guid    GUID in its registry form: "guid:{3B9DEA8E-75BE-478F-9FB4-7D2C5F9DDE31}"
+
+With an alignment only hits at physical addresses that are a multiple of it
+are reported. At least one byte of the pattern must be fully significant.
+
+Arguments:
+
+Text - The pattern.
+
+Pattern - Receives the parsed pattern.
+
+Return Value:
+
+E_INVALIDARG if the pattern is malformed.
+
+--*/
+{
+    LPCWSTR     value = wcschr(Text, L':');
+    LPWSTR      end = nullptr;
+    size_t      kindLength = 0;
+    UINT64      number = 0;
+    GUID        guid;
+    UINT32      runStart = 0;
+
+    RtlZeroMemory(Pattern, sizeof(SEARCH_PATTERN));
+    Pattern->Alignment = 1;
+
+    if (value == nullptr) {
+        return E_INVALIDARG;
+    }
+
+    kindLength = value - Text;
+    value++;
+
+    for (size_t index = 0; index < kindLength; index++) {
+        if (Text[index] == L'/') {
+            number = wcstoull(&Text[index + 1], &end, 0);
+            if ((end != value - 1) || (number == 0) || (number > MAXUINT32)) {
+                return E_INVALIDARG;
+            }
+            Pattern->Alignment = (UINT32)number;
+            kindLength = index;
+            break;
+        }
+    }
+
+    if ((kindLength == 3) && (0 == _wcsnicmp(Text, L"hex", 3))) {
+        for (LPCWSTR digit = value; *digit != L'\0'; ) {
+            UCHAR   byte = 0;
+            UCHAR   mask = 0;
+
+            if (*digit == L' ') {
+                digit++;
+                continue;
+            }
+
+            for (UINT32 nibble = 0; nibble < 2; nibble++, digit++) {
+                int digitValue = HexDigitValue(*digit);
+
+                byte <<= 4;
+                mask <<= 4;
+                if (*digit == L'?') {
+                    continue;
+                }
+                else if (digitValue < 0) {
+                    return E_INVALIDARG;
+                }
+
+                byte |= (UCHAR)digitValue;
+                mask |= 0xF;
+            }
+
+            if (Pattern->Length == SEARCH_MAX_PATTERN_LENGTH) {
+                return E_INVALIDARG;
+            }
+
+            Pattern->Bytes[Pattern->Length] = byte;
+            Pattern->Mask[Pattern->Length] = mask;
+            Pattern->Length++;
+        }
+    }
+    else if (((kindLength == 3) && (0 == _wcsnicmp(Text, L"str", 3))) ||
+             ((kindLength == 4) && (0 == _wcsnicmp(Text, L"wstr", 4)))) {
+        UINT32  charSize = (kindLength == 4) ? sizeof(WCHAR) : sizeof(CHAR);
+
+        for (LPCWSTR character = value; *character != L'\0'; character++) {
+            if ((Pattern->Length + charSize > SEARCH_MAX_PATTERN_LENGTH) ||
+                ((charSize == sizeof(CHAR)) && (*character > 0x7F))) {
+                return E_INVALIDARG;
+            }
+
+            Pattern->Bytes[Pattern->Length++] = (UCHAR)(*character & 0xFF);
+            if (charSize == sizeof(WCHAR)) {
+                Pattern->Bytes[Pattern->Length++] = (UCHAR)(*character >> 8);
+            }
+        }
+
+        RtlFillMemory(Pattern->Mask, Pattern->Length, 0xFF);
+    }
+    else if (((kindLength == 3) && (0 == _wcsnicmp(Text, L"u32", 3))) ||
+             ((kindLength == 3) && (0 == _wcsnicmp(Text, L"u64", 3)))) {
+        Pattern->Length = (Text[1] == L'3') ? sizeof(UINT32) : sizeof(UINT64);
+
+        number = wcstoull(value, &end, 0);
+        if ((end == value) || (*end != L'\0') ||
+            ((Pattern->Length == sizeof(UINT32)) && (number > MAXUINT32))) {
+            return E_INVALIDARG;
+        }
+
+        RtlCopyMemory(Pattern->Bytes, &number, Pattern->Length);
+        RtlFillMemory(Pattern->Mask, Pattern->Length, 0xFF);
+    }
+    else if ((kindLength == 4) && (0 == _wcsnicmp(Text, L"guid", 4))) {
+        if (FAILED(IIDFromString(value, &guid))) {
+            return E_INVALIDARG;
+        }
+
+        Pattern->Length = sizeof(GUID);
+        RtlCopyMemory(Pattern->Bytes, &guid, sizeof(GUID));
+        RtlFillMemory(Pattern->Mask, Pattern->Length, 0xFF);
+    }
+    else {
+        return E_INVALIDARG;
+    }
+
+    //
+    // The anchor is the longest run of fully significant bytes
+    //
+    for (UINT32 index = 0; index <= Pattern->Length; index++) {
+        if ((index < Pattern->Length) && (Pattern->Mask[index] == 0xFF)) {
+            continue;
+        }
+
+        if (index - runStart > Pattern->AnchorLength) {
+            Pattern->AnchorOffset = runStart;
+            Pattern->AnchorLength = index - runStart;
+        }
+        runStart = index + 1;
+    }
+
+    for (UINT32 index = 0; index < Pattern->Length; index++) {
+        Pattern->Bytes[index] &= Pattern->Mask[index];
+    }
+
+    return (Pattern->AnchorLength == 0) ? E_INVALIDARG : S_OK;
+}
+
+
+VOID
+FreeSearchAutomaton(
+    _In_opt_ PSEARCH_AUTOMATON Automaton
+    )
+{
+    if (Automaton == nullptr) {
+        return;
+    }
+
+    if (Automaton->Next != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, Automaton->Next);
+    }
+
+    if (Automaton->FirstMatch != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, Automaton->FirstMatch);
+    }
+
+    if (Automaton->Matches != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, Automaton->Matches);
+    }
+
+    HeapFree(GetProcessHeap(), NULL, Automaton);
+}
+
+
+HRESULT
+BuildSearchAutomaton(
+    _In_reads_(PatternCount) const SEARCH_PATTERN *Patterns,
+    _In_ UINT32 PatternCount,
+    _Out_ PSEARCH_AUTOMATON *Automaton
+    )
+/*++
+
+Routine Description:
+
+This function builds the Aho-Corasick automaton over the anchors of the
+patterns and the byte pair filter that lets the scan skip ahead while the
+automaton is in its root state: a bit is set for every pair of bytes an anchor
+starts with, and for every pair starting with the byte of a one byte anchor.
+
+Arguments:
+
+Patterns - Parsed patterns.
+
+PatternCount - Number of patterns.
+
+Automaton - Receives the automaton, release with FreeSearchAutomaton.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PSEARCH_AUTOMATON   automaton = nullptr;
+    PUINT32             failure = nullptr;
+    PUINT32             queue = nullptr;
+    UINT64              maxStates = 1;
+    UINT32              queueHead = 0;
+    UINT32              queueTail = 0;
+    HRESULT             hr = S_OK;
+
+    *Automaton = nullptr;
+
+    for (UINT32 index = 0; index < PatternCount; index++) {
+        maxStates += Patterns[index].AnchorLength;
+    }
+
+    if (maxStates > (MAXUINT32 / 256)) {
+        return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+    }
+
+    automaton = (PSEARCH_AUTOMATON)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SEARCH_AUTOMATON));
+    if (automaton == nullptr) {
+        return E_OUTOFMEMORY;
+    }
+
+    automaton->Next = (PUINT32)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)maxStates * 256 * sizeof(UINT32));
+    automaton->FirstMatch = (PUINT32)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)maxStates * sizeof(UINT32));
+    automaton->Matches = (PSEARCH_MATCH)HeapAlloc(GetProcessHeap(), 0, max(PatternCount, 1U) * sizeof(SEARCH_MATCH));
+    failure = (PUINT32)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)maxStates * sizeof(UINT32));
+    queue = (PUINT32)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)maxStates * sizeof(UINT32));
+    if ((automaton->Next == nullptr) || (automaton->FirstMatch == nullptr) || (automaton->Matches == nullptr) ||
+        (failure == nullptr) || (queue == nullptr)) {
+        hr = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    memset(automaton->Next, 0xFF, (SIZE_T)maxStates * 256 * sizeof(UINT32));
+    memset(automaton->FirstMatch, 0xFF, (SIZE_T)maxStates * sizeof(UINT32));
+    automaton->StateCount = 1;
+
+    //
+    // Trie of the anchors
+    //
+    for (UINT32 index = 0; index < PatternCount; index++) {
+        const UCHAR *anchor = &Patterns[index].Bytes[Patterns[index].AnchorOffset];
+        UINT32      state = SEARCH_ROOT_STATE;
+
+        for (UINT32 position = 0; position < Patterns[index].AnchorLength; position++) {
+            PUINT32 next = &automaton->Next[state * 256 + anchor[position]];
+
+            if (*next == SEARCH_NO_STATE) {
+                *next = automaton->StateCount++;
+            }
+            state = *next;
+        }
+
+        automaton->Matches[index].Pattern = index;
+        automaton->Matches[index].Next = automaton->FirstMatch[state];
+        automaton->FirstMatch[state] = index;
+
+        if (Patterns[index].AnchorLength == 1) {
+            for (UINT32 second = 0; second < 256; second++) {
+                UINT32 pair = (anchor[0] << 8) | second;
+                automaton->PairFilter[pair / 64] |= (1ULL << (pair % 64));
+            }
+        }
+        else {
+            UINT32 pair = (anchor[0] << 8) | anchor[1];
+            automaton->PairFilter[pair / 64] |= (1ULL << (pair % 64));
+        }
+    }
+
+    //
+    // Failure links, breadth first so a state's failure state is complete
+    // before the state itself
+    //
+    for (UINT32 byte = 0; byte < 256; byte++) {
+        PUINT32 next = &automaton->Next[SEARCH_ROOT_STATE * 256 + byte];
+
+        if (*next == SEARCH_NO_STATE) {
+            *next = SEARCH_ROOT_STATE;
+        }
+        else {
+            failure[*next] = SEARCH_ROOT_STATE;
+            queue[queueTail++] = *next;
+        }
+    }
+
+    while (queueHead < queueTail) {
+        UINT32 state = queue[queueHead++];
+
+        //
+        // Append the matches of the failure state to this state's own
+        //
+        if (automaton->FirstMatch[state] == SEARCH_NO_MATCH) {
+            automaton->FirstMatch[state] = automaton->FirstMatch[failure[state]];
+        }
+        else {
+            UINT32 match = automaton->FirstMatch[state];
+
+            while ((automaton->Matches[match].Next != SEARCH_NO_MATCH) &&
+                   (automaton->Matches[match].Next != automaton->FirstMatch[failure[state]])) {
+                match = automaton->Matches[match].Next;
+            }
+            automaton->Matches[match].Next = automaton->FirstMatch[failure[state]];
+        }
+
+        for (UINT32 byte = 0; byte < 256; byte++) {
+            PUINT32 next = &automaton->Next[state * 256 + byte];
+
+            if (*next == SEARCH_NO_STATE) {
+                *next = automaton->Next[failure[state] * 256 + byte];
+            }
+            else {
+                failure[*next] = automaton->Next[failure[state] * 256 + byte];
+                queue[queueTail++] = *next;
+            }
+        }
+    }
+
+    *Automaton = automaton;
+    automaton = nullptr;
+
+Exit:
+    if (failure != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, failure);
+    }
+
+    if (queue != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, queue);
+    }
+
+    FreeSearchAutomaton(automaton);
+    return hr;
+}
+
+
+HRESULT
+RecordSearchHit(
+    _Inout_ PSEARCH_CONTEXT Search,
+    _In_ UINT64 PhysicalAddress,
+    _In_ UINT32 Pattern,
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ UINT32 Length,
+    _In_ UINT32 Start
+    )
+/*++
+
+Routine Description:
+
+This function adds a hit, with the bytes around it, to Search->Hits. Once
+SEARCH_MAX_HITS are recorded further hits are dropped and the search stops.
+
+Arguments:
+
+Search - SEARCH_CONTEXT
+
+PhysicalAddress - Physical address of the first byte of the hit.
+
+Pattern - Index of the pattern that matched.
+
+Data - The slice being searched.
+
+Length - Bytes in Data.
+
+Start - Position of the hit in Data.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PSEARCH_HIT     hit = nullptr;
+    PSEARCH_HIT     hits = nullptr;
+    UINT32          before = min(Start, (UINT32)SEARCH_CONTEXT_BYTES);
+    HRESULT         hr = S_OK;
+
+    EnterCriticalSection(&Search->Lock);
+
+    if (Search->HitCount == SEARCH_MAX_HITS) {
+        InterlockedExchange(&Search->Truncated, TRUE);
+        goto Exit;
+    }
+
+    if (Search->HitCount == Search->HitCapacity) {
+        UINT32 capacity = (Search->HitCapacity == 0) ? 1024 : min(Search->HitCapacity * 2, (UINT32)SEARCH_MAX_HITS);
+
+        if (Search->Hits == nullptr) {
+            hits = (PSEARCH_HIT)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(SEARCH_HIT));
+        }
+        else {
+            hits = (PSEARCH_HIT)HeapReAlloc(GetProcessHeap(), 0, Search->Hits, capacity * sizeof(SEARCH_HIT));
+        }
+
+        if (hits == nullptr) {
+            hr = E_OUTOFMEMORY;
+            goto Exit;
+        }
+
+        Search->Hits = hits;
+        Search->HitCapacity = capacity;
+    }
+
+    hit = &Search->Hits[Search->HitCount++];
+    hit->PhysicalAddress = PhysicalAddress;
+    hit->Pattern = Pattern;
+    hit->ContextBefore = before;
+    hit->ContextLength = min(Length - (Start - before), (UINT32)sizeof(hit->Context));
+    hit->ContextLength = min(hit->ContextLength, before + Search->Patterns[Pattern].Length + SEARCH_CONTEXT_BYTES);
+    RtlCopyMemory(hit->Context, Data + Start - before, hit->ContextLength);
+
+Exit:
+    LeaveCriticalSection(&Search->Lock);
+    return hr;
+}
+
+
+HRESULT
+SearchSlice(
+    _Inout_ PSEARCH_CONTEXT Search,
+    _In_ const EXTENT *Slice,
+    _Out_writes_bytes_(SEARCH_SLICE_SIZE + SEARCH_MAX_PATTERN_LENGTH) PUCHAR Buffer
+    )
+/*++
+
+Routine Description:
+
+This function searches one slice of physical memory for all patterns.
+
+While the automaton is in its root state no anchor is partly matched, so the
+scan only has to look at the pair filter and can skip every position no anchor
+starts at. That is almost every position, and the inner loop is a table lookup
+on two bytes. From a candidate position on the automaton runs until it is back
+in its root state; each anchor it finds is checked against the whole pattern,
+its mask and alignment.
+
+Only hits starting inside the slice are recorded, hits starting in the bytes
+read past its end belong to the next slice.
+
+Arguments:
+
+Search - SEARCH_CONTEXT
+
+Slice - Physical range to search, Tag is its DDR memory map index.
+
+Buffer - Per thread buffer, SEARCH_SLICE_SIZE + SEARCH_MAX_PATTERN_LENGTH bytes.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDDR_MEMORY_MAP             entry = &Search->Context->DDRMemoryMap[Slice->Tag];
+    const SEARCH_AUTOMATON      *automaton = Search->Automaton;
+    UINT32                      sliceLength = (UINT32)EXTENT_SIZE(*Slice);
+    UINT32                      length = 0;
+    UINT64                      rawOffset = Search->Context->fileOffset.QuadPart + entry->Offset + (Slice->Base - entry->Base);
+    UINT32                      state = SEARCH_ROOT_STATE;
+    UINT32                      position = 0;
+    HRESULT                     hr = S_OK;
+
+    //
+    // Read on into the rest of the DDR section for patterns crossing the end
+    //
+    length = (UINT32)min((UINT64)sliceLength + Search->MaxPatternLength - 1, entry->End - Slice->Base + 1);
+
+    if (FAILED(hr = ReadRawDumpSlice(Search->Context, Search->hRawFile, &Search->Lock, rawOffset, Buffer, length))) {
+        TraceInfo2("Failed to read DDR from the raw dump", "PA", Slice->Base, "Length", length);
+        goto Exit;
+    }
+
+    while (position < length) {
+        if (state == SEARCH_ROOT_STATE) {
+            while ((position + 1 < length) &&
+                   (0 == (automaton->PairFilter[Buffer[position]  * 4 + (Buffer[position + 1] >> 6)] &
+                          (1ULL << (Buffer[position + 1] & 63))))) {
+                position++;
+            }
+
+            //
+            // Nothing can start at or after the end of the slice
+            //
+            if (position >= sliceLength) {
+                break;
+            }
+        }
+
+        state = automaton->Next[state * 256 + Buffer[position]];
+
+        for (UINT32 match = automaton->FirstMatch[state]; match != SEARCH_NO_MATCH; match = automaton->Matches[match].Next) {
+            const SEARCH_PATTERN    *pattern = &Search->Patterns[automaton->Matches[match].Pattern];
+            UINT32                  anchorStart = position + 1 - pattern->AnchorLength;
+            UINT32                  start = anchorStart - pattern->AnchorOffset;
+            UINT32                  index = 0;
+
+            if ((anchorStart < pattern->AnchorOffset) ||
+                (start >= sliceLength) ||
+                (pattern->Length > length - start) ||
+                (((Slice->Base + start) % pattern->Alignment) != 0)) {
+                continue;
+            }
+
+            for (index = 0; index < pattern->Length; index++) {
+                if ((Buffer[start + index] & pattern->Mask[index]) != pattern->Bytes[index]) {
+                    break;
+                }
+            }
+
+            if (index == pattern->Length) {
+                hr = RecordSearchHit(Search, Slice->Base + start, automaton->Matches[match].Pattern, Buffer, length, start);
+                if (FAILED(hr)) {
+                    goto Exit;
+                }
+            }
+        }
+
+        position++;
+    }
+
+    InterlockedExchangeAdd64(&Search->BytesSearched, sliceLength);
+
+Exit:
+    return hr;
+}
+
+
+DWORD WINAPI
+SearchWorkerThread(
+    _In_ LPVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+Searches slices, taken in order from the shared context, until all are done,
+any thread fails or the hit limit is reached.
+
+Arguments:
+
+Parameter - PSEARCH_CONTEXT
+
+Return Value:
+
+0
+
+--*/
+{
+    PSEARCH_CONTEXT     search = (PSEARCH_CONTEXT)Parameter;
+    PUCHAR              buffer = nullptr;
+    HRESULT             hr = S_OK;
+
+    buffer = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, SEARCH_SLICE_SIZE + SEARCH_MAX_PATTERN_LENGTH);
+    if (buffer == nullptr) {
+        InterlockedCompareExchange(&search->hr, E_OUTOFMEMORY, S_OK);
+        return 0;
+    }
+
+    while ((S_OK == InterlockedCompareExchange(&search->hr, S_OK, S_OK)) && !search->Truncated) {
+        UINT32  slice = (UINT32)(InterlockedIncrement(&search->NextSlice) - 1);
+
+        if (slice >= search->Slices.Count) {
+            break;
+        }
+        else if (FAILED(hr = SearchSlice(search, &search->Slices.Extents[slice], buffer))) {
+            InterlockedCompareExchange(&search->hr, hr, S_OK);
+            break;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), NULL, buffer);
+    return 0;
+}
+
+
+HRESULT
+WriteSearchHits(
+    _In_ PSEARCH_CONTEXT Search,
+    _In_reads_(Search->PatternCount) LPCWSTR *Patterns,
+    _In_ LPCWSTR ResultPath
+    )
+/*++
+
+Routine Description:
+
+This function writes the hits, lowest address first, one per line:
+
+    <physical address> <pattern> <bytes before> [<matched bytes>] <bytes after>
+
+Arguments:
+
+Search - SEARCH_CONTEXT, with the hits sorted.
+
+Patterns - The patterns as given, written at the top of the file.
+
+ResultPath - File to write.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    FILE        *result = nullptr;
+    HRESULT     hr = S_OK;
+
+    if ((0 != _wfopen_s(&result, ResultPath, L"w")) || (result == nullptr)) {
+        hr = HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+        TraceHRESULT("Failed to create the search result file", hr);
+        return hr;
+    }
+
+    for (UINT32 index = 0; index < Search->PatternCount; index++) {
+        fwprintf(result, L"# pattern %u: %s\n", index, Patterns[index]);
+    }
+
+    for (UINT32 index = 0; index < Search->HitCount; index++) {
+        PSEARCH_HIT hit = &Search->Hits[index];
+        UINT32      matchEnd = hit->ContextBefore + Search->Patterns[hit->Pattern].Length;
+
+        fwprintf(result, L"0x%016llx %u ", hit->PhysicalAddress, hit->Pattern);
+
+        for (UINT32 offset = 0; offset < hit->ContextLength; offset++) {
+            if (offset == hit->ContextBefore) {
+                fwprintf(result, L"[");
+            }
+
+            fwprintf(result, L"%02x", hit->Context[offset]);
+
+            if (offset + 1 == matchEnd) {
+                fwprintf(result, L"]");
+            }
+
+            if (offset + 1 < hit->ContextLength) {
+                fwprintf(result, L" ");
+            }
+        }
+
+        fwprintf(result, L"\n");
+    }
+
+    if (Search->Truncated) {
+        fwprintf(result, L"# stopped after %u hits\n", Search->HitCount);
+    }
+
+    if (0 != fclose(result)) {
+        hr = HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+        TraceHRESULT("Failed to write the search result file", hr);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+SearchRawDumpFile(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ LPCWSTR RawDumpPath,
+    _In_ UINT32 PatternCount,
+    _In_reads_(PatternCount) LPCWSTR *Patterns,
+    _In_ LPCWSTR ResultPath,
+    _Out_opt_ PUINT64 HitCount
+    )
+/*++
+
+Routine Description:
+
+This function searches all DDR sections of a raw dump for any of the given
+patterns, see ParseSearchPattern for their form, and writes the physical
+address of every hit with the bytes around it to ResultPath.
+
+The DDR memory map is cut into slices of SEARCH_SLICE_SIZE bytes that are
+searched by up to SEARCH_MAX_THREADS threads with positional reads, so the
+search runs at the speed of the disk rather than of one core. A pattern that
+crosses from one DDR section into the next is not found, the sections need not
+be contiguous in the raw dump.
+
+Arguments:
+
+Context - DMP_CONTEXT, zero initialized.
+
+RawDumpPath - The raw dump to search.
+
+PatternCount - Number of patterns.
+
+Patterns - The patterns, in text form.
+
+ResultPath - File receiving the hits.
+
+HitCount - Number of hits found.
+
+Return Value:
+
+S_OK, S_FALSE if the search stopped at SEARCH_MAX_HITS hits, E_INVALIDARG for
+a malformed pattern, otherwise the error reading the raw dump.
+
+--*/
+{
+    SEARCH_CONTEXT      search;
+    HANDLE              threads[SEARCH_MAX_THREADS] = { 0 };
+    SYSTEM_INFO         systemInfo = { 0 };
+    UINT32              threadCount = 0;
+    UINT32              threadsStarted = 0;
+    BOOL                lockInitialized = FALSE;
+    HRESULT             hr = S_OK;
+
+    RtlZeroMemory(&search, sizeof(search));
+    search.Context = Context;
+    search.hRawFile = INVALID_HANDLE_VALUE;
+    search.hr = S_OK;
+    ExtentSetInit(&search.Slices);
+
+    if (HitCount != nullptr) {
+        *HitCount = 0;
+    }
+
+    if (PatternCount == 0) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("No search pattern given", hr);
+        goto Exit;
+    }
+
+    search.Patterns = (PSEARCH_PATTERN)HeapAlloc(GetProcessHeap(), 0, PatternCount * sizeof(SEARCH_PATTERN));
+    if (search.Patterns == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Failed to allocate the search patterns", hr);
+        goto Exit;
+    }
+
+    search.PatternCount = PatternCount;
+    for (UINT32 index = 0; index < PatternCount; index++) {
+        if (FAILED(hr = ParseSearchPattern(Patterns[index], &search.Patterns[index]))) {
+            TraceHRESULT("Search pattern is malformed", hr);
+            TraceInfo1("  ", "Pattern", index);
+            goto Exit;
+        }
+
+        search.MaxPatternLength = max(search.MaxPatternLength, search.Patterns[index].Length);
+    }
+
+    if (FAILED(hr = BuildSearchAutomaton(search.Patterns, PatternCount, &search.Automaton))) {
+        TraceHRESULT("Failed to build the search automaton", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("Search automaton built", "Patterns", PatternCount, "States", search.Automaton->StateCount);
+
+    if (FAILED(hr = OpenRawDumpForSlices(Context, RawDumpPath, &search.hRawFile))) {
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; SUCCEEDED(hr) && (index < Context->DDRMemoryMapCount); index++) {
+        for (UINT64 pa = Context->DDRMemoryMap[index].Base; SUCCEEDED(hr) && (pa <= Context->DDRMemoryMap[index].End); pa += SEARCH_SLICE_SIZE) {
+            hr = ExtentSetAppend(&search.Slices, pa, min(Context->DDRMemoryMap[index].End - pa + 1, (UINT64)SEARCH_SLICE_SIZE), index);
+            if (Context->DDRMemoryMap[index].End - pa < SEARCH_SLICE_SIZE) {
+                break;
+            }
+        }
+    }
+
+    if (FAILED(hr)) {
+        TraceHRESULT("Failed to split the DDR sections", hr);
+        goto Exit;
+    }
+
+    InitializeCriticalSection(&search.Lock);
+    lockInitialized = TRUE;
+
+    GetSystemInfo(&systemInfo);
+    threadCount = min(min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)SEARCH_MAX_THREADS),
+                      max(search.Slices.Count, 1U));
+
+    for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++) {
+        threads[threadsStarted] = CreateThread(nullptr, 0, SearchWorkerThread, &search, 0, nullptr);
+        if (threads[threadsStarted] == NULL) {
+            // The threads already started stop at the failure
+            InterlockedCompareExchange(&search.hr, HRESULT_FROM_WIN32(GetLastError()), S_OK);
+            break;
+        }
+    }
+
+    if (threadsStarted != 0) {
+        WaitForMultipleObjects(threadsStarted, threads, TRUE, INFINITE);
+    }
+
+    for (UINT32 index = 0; index < threadsStarted; index++) {
+        CloseHandle(threads[index]);
+    }
+
+    if (FAILED(hr = search.hr)) {
+        TraceHRESULT("Failed to search the DDR sections", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("DDR searched", "Bytes", search.BytesSearched, "Hits", search.HitCount);
+
+    if (search.HitCount != 0) {
+        qsort(search.Hits, search.HitCount, sizeof(SEARCH_HIT), CompareSearchHits);
+    }
+
+    if (FAILED(hr = WriteSearchHits(&search, Patterns, ResultPath))) {
+        goto Exit;
+    }
+
+    if (HitCount != nullptr) {
+        *HitCount = search.HitCount;
+    }
+
+    hr = search.Truncated ? S_FALSE : S_OK;
+
+Exit:
+    if (lockInitialized) {
+        DeleteCriticalSection(&search.Lock);
+    }
+
+    if (search.Hits != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, search.Hits);
+    }
+
+    if (search.Patterns != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, search.Patterns);
+    }
+
+    FreeSearchAutomaton(search.Automaton);
+    ExtentSetFree(&search.Slices);
+    CloseRawDumpForSlices(Context, search.hRawFile);
+    return hr;
+}
@@ -0,0 +1,545 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    ShardedConversion.cpp
+
+Abstract:
+    Splits the copy of DDR into the dump file across processes, which may
+    run on other machines sharing the storage of the raw dump and the dump.
+
+    The plan step writes the DUMP_HEADER, sizes the dump file for all of DDR
+    and writes <dump>.shards, which divides the pages of the dump into
+    shards. Each worker copies the pages of one shard to their place in the
+    dump file and marks its shard done in the plan. The stitch step checks
+    that all shards are done, then appends the secondary data and patches in
+    the CPU context as a full conversion does.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+VOID
+GetPhysicalMemoryRun(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT32 Index,
+    _Out_ PUINT64 BasePage,
+    _Out_ PUINT64 PageCount
+    )
+{
+    if (Context->Is64Bit) {
+        *BasePage = Context->DumpHeader64->PhysicalMemoryBlock.Run[Index].BasePage;
+        *PageCount = Context->DumpHeader64->PhysicalMemoryBlock.Run[Index].PageCount;
+    }
+    else {
+        *BasePage = Context->DumpHeader32->PhysicalMemoryBlock.Run[Index].BasePage;
+        *PageCount = Context->DumpHeader32->PhysicalMemoryBlock.Run[Index].PageCount;
+    }
+}
+
+
+UINT32
+GetPhysicalMemoryRunCount(
+    _In_ PDMP_CONTEXT Context
+    )
+{
+    return Context->Is64Bit ? Context->DumpHeader64->PhysicalMemoryBlock.NumberOfRuns :
+                              Context->DumpHeader32->PhysicalMemoryBlock.NumberOfRuns;
+}
+
+
+UINT64
+GetPhysicalMemoryPageCount(
+    _In_ PDMP_CONTEXT Context
+    )
+{
+    return Context->Is64Bit ? Context->DumpHeader64->PhysicalMemoryBlock.NumberOfPages :
+                              Context->DumpHeader32->PhysicalMemoryBlock.NumberOfPages;
+}
+
+
+HRESULT
+OpenShardPlan(
+    _In_ PDMP_CONTEXT Context,
+    _In_ BOOL Create,
+    _Out_ PHANDLE PlanHandle
+    )
+/*++
+
+Routine Description:
+
+This function opens <dump>.shards, the plan of a sharded conversion.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Create - TRUE to create or replace the plan, FALSE to open the existing one.
+
+PlanHandle - Receives the handle.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT hr = S_OK;
+    LPWSTR  path = nullptr;
+    size_t  pathLength = 0;
+
+    *PlanHandle = INVALID_HANDLE_VALUE;
+
+    pathLength = wcslen(Context->WindowsDumpFilePath) + ARRAYSIZE(DUMP_SHARD_PLAN_EXTENSION);
+    path = (LPWSTR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, pathLength * sizeof(WCHAR));
+    if (path == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the shard plan path", hr);
+        goto Exit;
+    }
+
+    hr = StringCchPrintfW(path, pathLength, L"%s%s", Context->WindowsDumpFilePath, DUMP_SHARD_PLAN_EXTENSION);
+    if (FAILED(hr)) {
+        TraceHRESULT("StringCchPrintfW failed", hr);
+        goto Exit;
+    }
+
+    //
+    // Workers update their own shard of the plan while others read it.
+    //
+    *PlanHandle = CreateFileW(path,
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr,
+                              Create ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (*PlanHandle == INVALID_HANDLE_VALUE) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to open the shard plan", hr);
+        goto Exit;
+    }
+
+Exit:
+    if (path != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, path);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+ReadShardPlan(
+    _In_ PDMP_CONTEXT Context,
+    _Out_ PHANDLE PlanHandle,
+    _Out_ PDUMP_SHARD_PLAN Plan
+    )
+/*++
+
+Routine Description:
+
+This function reads the plan of a sharded conversion and checks that it was
+made for the raw dump being converted.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the DUMP_HEADER.
+
+PlanHandle - Receives the handle of the plan, to update a shard with.
+
+Plan - Receives the plan.
+
+Return Value:
+
+HRESULT, HRESULT_FROM_WIN32(ERROR_INVALID_DATA) if the plan does not match.
+
+--*/
+{
+    DWORD   bytesRead = 0;
+    HRESULT hr = S_OK;
+
+    hr = OpenShardPlan(Context, FALSE, PlanHandle);
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    if (!ReadFile(*PlanHandle, Plan, sizeof(*Plan), &bytesRead, nullptr)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to read the shard plan", hr);
+        goto Exit;
+    }
+
+    if ((bytesRead != sizeof(*Plan)) ||
+        (Plan->Signature != DUMP_SHARD_PLAN_SIGNATURE) ||
+        (Plan->Version != DUMP_SHARD_PLAN_VERSION) ||
+        (Plan->ShardCount == 0) ||
+        (Plan->ShardCount > DUMP_SHARD_MAX_COUNT) ||
+        (Plan->DumpInstance != Context->DumpInstance.QuadPart) ||
+        (Plan->DDRPageCount != GetPhysicalMemoryPageCount(Context))) {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        TraceHRESULT("The shard plan does not belong to this raw dump", hr);
+        goto Exit;
+    }
+
+Exit:
+    if (FAILED(hr) && (*PlanHandle != INVALID_HANDLE_VALUE)) {
+        CloseHandle(*PlanHandle);
+        *PlanHandle = INVALID_HANDLE_VALUE;
+    }
+
+    return hr;
+}
+
+
+HRESULT
+PlanDumpShards(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function plans a sharded conversion once the DUMP_HEADER is written. The
+dump file is sized for the header and all of DDR, so that workers can write
+their pages in place, and the pages are split in Context->ShardCount shards of
+about the same size.
+
+Arguments:
+
+Context - Pointer to the global context structure.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDUMP_SHARD_PLAN        plan = nullptr;
+    HANDLE                  planHandle = INVALID_HANDLE_VALUE;
+    FILE_END_OF_FILE_INFO   endOfFile = { 0 };
+    UINT64                  pagesPerShard;
+    UINT64                  firstPage = 0;
+    DWORD                   bytesWritten = 0;
+    HRESULT                 hr = S_OK;
+
+    if ((Context->ShardCount == 0) || (Context->ShardCount > DUMP_SHARD_MAX_COUNT)) {
+        hr = E_INVALIDARG;
+        TraceInfo1("Invalid shard count", "Shards", Context->ShardCount);
+        goto Exit;
+    }
+
+    plan = (PDUMP_SHARD_PLAN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DUMP_SHARD_PLAN));
+    if (plan == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the shard plan", hr);
+        goto Exit;
+    }
+
+    plan->Signature = DUMP_SHARD_PLAN_SIGNATURE;
+    plan->Version = DUMP_SHARD_PLAN_VERSION;
+    plan->ShardCount = Context->ShardCount;
+    plan->DumpInstance = Context->DumpInstance.QuadPart;
+    plan->DDRFileOffset = Context->DDRFileOffset.QuadPart;
+    plan->DDRPageCount = GetPhysicalMemoryPageCount(Context);
+
+    pagesPerShard = (plan->DDRPageCount + plan->ShardCount - 1) / plan->ShardCount;
+
+    for (UINT32 index = 0; index < plan->ShardCount; index++) {
+        plan->Shards[index].FirstPage = firstPage;
+        plan->Shards[index].PageCount = min(pagesPerShard, plan->DDRPageCount - firstPage);
+        plan->Shards[index].State = DUMP_SHARD_PENDING;
+        firstPage += plan->Shards[index].PageCount;
+    }
+
+    endOfFile.EndOfFile.QuadPart = plan->DDRFileOffset + (plan->DDRPageCount * PAGE_SIZE);
+    if (!SetFileInformationByHandle(Context->WindowsDumpHandle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to size the dump file for its shards", hr);
+        goto Exit;
+    }
+
+    hr = OpenShardPlan(Context, TRUE, &planHandle);
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    if (!WriteFile(planHandle, plan, sizeof(*plan), &bytesWritten, nullptr)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to write the shard plan", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("Planned the conversion shards", "Shards", plan->ShardCount, "PagesPerShard", pagesPerShard);
+
+Exit:
+    if (planHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(planHandle);
+    }
+
+    if (plan != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, plan);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+UpdateShardState(
+    _In_ HANDLE PlanHandle,
+    _In_ UINT32 Index,
+    _In_ UINT32 State,
+    _In_ HRESULT Result
+    )
+{
+    DUMP_SHARD_STATUS   status = { 0 };
+    OVERLAPPED          overlapped = { 0 };
+    DWORD               bytesWritten = 0;
+    HRESULT             hr = S_OK;
+
+    //
+    // Only the status of this shard is written, other workers update theirs
+    // at the same time.
+    //
+    overlapped.Offset = (DWORD)FIELD_OFFSET(DUMP_SHARD_PLAN, Shards[Index].Status);
+    status.State = State;
+    status.hr = Result;
+
+    if (!WriteFile(PlanHandle, &status, sizeof(status), &bytesWritten, &overlapped) ||
+        !FlushFileBuffers(PlanHandle)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to update the shard plan", hr);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+WriteDumpShard(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function copies the pages of shard Context->ShardIndex from the raw dump
+to their place in the dump file sized by PlanDumpShards, then marks the shard
+done in the plan. A failure is recorded in the plan as well.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the dump file open.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDUMP_SHARD_PLAN    plan = nullptr;
+    HANDLE              planHandle = INVALID_HANDLE_VALUE;
+    PDUMP_SHARD         shard = nullptr;
+    PVOID               buffer = nullptr;
+    UINT32              bufferSize = 0;
+    UINT64              runFirstPage = 0;
+    UINT64              basePage;
+    UINT64              pageCount;
+    UINT64              page;
+    UINT64              endPage;
+    UINT64              pagesWritten = 0;
+    UINT32              ioSize;
+    LARGE_INTEGER       physicalAddress;
+    LARGE_INTEGER       fileOffset;
+    IO_STATUS_BLOCK     statusBlock;
+    NTSTATUS            status;
+    HANDLE              ddrHandle;
+    HRESULT             hr = S_OK;
+
+    plan = (PDUMP_SHARD_PLAN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DUMP_SHARD_PLAN));
+    if (plan == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the shard plan", hr);
+        goto Exit;
+    }
+
+    hr = ReadShardPlan(Context, &planHandle, plan);
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    if (Context->ShardIndex >= plan->ShardCount) {
+        hr = E_INVALIDARG;
+        TraceInfo2("Shard not in the plan", "Shard", Context->ShardIndex, "Shards", plan->ShardCount);
+        goto Exit;
+    }
+
+    shard = &plan->Shards[Context->ShardIndex];
+    Context->DDRFileOffset.QuadPart = plan->DDRFileOffset;
+    ddrHandle = GetDDRWriteHandle(Context, Context->DDRFileOffset);
+
+    TraceInfo3("Writing DDR shard",
+               "Shard", Context->ShardIndex,
+               "FirstPage", shard->FirstPage,
+               "Pages", shard->PageCount);
+
+    hr = AllocatePooledBuffer(Context, DEFAULT_DMP_BUF_SZ, PAGE_SIZE, &buffer, &bufferSize);
+    if (FAILED(hr)) {
+        TraceHRESULT("Unable to allocate the shard buffer", hr);
+        goto Exit;
+    }
+
+    //
+    // The DDR part of the dump holds the runs of the PhysicalMemoryBlock one
+    // after the other, copy the part of each run that falls in the shard.
+    //
+    for (UINT32 run = 0; run < GetPhysicalMemoryRunCount(Context); run++) {
+        GetPhysicalMemoryRun(Context, run, &basePage, &pageCount);
+
+        page = max(runFirstPage, shard->FirstPage);
+        endPage = min(runFirstPage + pageCount, shard->FirstPage + shard->PageCount);
+
+        while (page < endPage) {
+            ioSize = (UINT32)min((UINT64)bufferSize, (endPage - page) * PAGE_SIZE);
+            physicalAddress.QuadPart = (basePage + (page - runFirstPage)) * PAGE_SIZE;
+            fileOffset.QuadPart = plan->DDRFileOffset + (page * PAGE_SIZE);
+
+            status = ReadFromDDRSectionByPhysicalAddress(Context, physicalAddress, ioSize, buffer);
+            if (!NT_SUCCESS(status)) {
+                hr = HRESULT_FROM_NT(status);
+                TraceNTSTATUS("Failed to read from DDR sections", status);
+                goto Exit;
+            }
+
+            status = NtWriteFile(ddrHandle,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 &statusBlock,
+                                 buffer,
+                                 ioSize,
+                                 &fileOffset,
+                                 nullptr);
+            if (!NT_SUCCESS(status)) {
+                hr = HRESULT_FROM_NT(status);
+                TraceNTSTATUS("NtWriteFile failed", status);
+                goto Exit;
+            }
+
+            page += ioSize / PAGE_SIZE;
+            pagesWritten += ioSize / PAGE_SIZE;
+            ReportConversionProgress(Context, "Writing DDR shard", pagesWritten, shard->PageCount);
+        }
+
+        runFirstPage += pageCount;
+    }
+
+    if (ddrHandle == Context->WindowsDumpHandle) {
+        NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+    }
+
+    if (pagesWritten != shard->PageCount) {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        TraceExpectedActual("Shard pages written not", shard->PageCount, pagesWritten);
+        goto Exit;
+    }
+
+Exit:
+    if ((planHandle != INVALID_HANDLE_VALUE) && (shard != nullptr)) {
+        HRESULT updateHr = UpdateShardState(planHandle,
+                                            Context->ShardIndex,
+                                            SUCCEEDED(hr) ? DUMP_SHARD_DONE : DUMP_SHARD_FAILED,
+                                            hr);
+        if (SUCCEEDED(hr)) {
+            hr = updateHr;
+        }
+    }
+
+    FreePooledBuffer(Context, buffer, bufferSize);
+
+    if (planHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(planHandle);
+    }
+
+    if (plan != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, plan);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+CheckDumpShards(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function stands in for WriteDDR when stitching a sharded conversion. It
+checks that every shard of the plan is done and moves the dump file offset
+past DDR, where the secondary data goes.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the DUMP_HEADER written.
+
+Return Value:
+
+HRESULT, HRESULT_FROM_WIN32(ERROR_INCOMPLETE) if a shard is not done.
+
+--*/
+{
+    PDUMP_SHARD_PLAN    plan = nullptr;
+    HANDLE              planHandle = INVALID_HANDLE_VALUE;
+    HRESULT             hr = S_OK;
+
+    plan = (PDUMP_SHARD_PLAN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DUMP_SHARD_PLAN));
+    if (plan == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the shard plan", hr);
+        goto Exit;
+    }
+
+    hr = ReadShardPlan(Context, &planHandle, plan);
+    if (FAILED(hr)) {
+        goto Exit;
+    }
+
+    if (plan->DDRFileOffset != (UINT64)Context->DDRFileOffset.QuadPart) {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        TraceExpectedActual("Shard plan DDR offset not", Context->DDRFileOffset.QuadPart, plan->DDRFileOffset);
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < plan->ShardCount; index++) {
+        if (plan->Shards[index].Status.State != DUMP_SHARD_DONE) {
+            hr = HRESULT_FROM_WIN32(ERROR_INCOMPLETE);
+            TraceInfo2("Shard is not done", "Shard", index, "State", plan->Shards[index].Status.State);
+            goto Exit;
+        }
+    }
+
+    Context->WindowsDumpFileOffset.QuadPart = plan->DDRFileOffset + (plan->DDRPageCount * PAGE_SIZE);
+    TraceInfo1("All shards are done", "Shards", plan->ShardCount);
+
+Exit:
+    if (planHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(planHandle);
+    }
+
+    if (plan != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, plan);
+    }
+
+    return hr;
+}
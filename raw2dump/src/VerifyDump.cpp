@@ -0,0 +1,697 @@
+/*++
+
+Copyright (c) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+    VerifyDump.cpp
+
+Abstract:
+    Checks a converted Windows dump file against the raw dump it came from.
+
+Environment:
+    User Mode
+
+--*/
+#include "dumputil.h"
+#include "Dump_Blob.h"
+
+//
+// ------------------------- Local Types ----------------------------------------------------------------------
+//
+
+//
+// Shared by the verifier threads. Slices holds the pieces of the dump's memory
+// runs to compare, each within one DDR memory map entry (the extent Tag).
+// Mismatches collects the pages whose contents differ.
+//
+typedef struct _VERIFY_CONTEXT
+{
+    PDMP_CONTEXT        Context;
+    PDUMP_FILE_VIEW     View;
+    HANDLE              hRawFile;
+    CRITICAL_SECTION    Lock;
+    EXTENT_SET          Slices;
+    EXTENT_SET          Mismatches;
+    volatile LONG       NextSlice;
+    volatile LONG       hr;
+    volatile LONG64     BytesCompared;
+} VERIFY_CONTEXT, *PVERIFY_CONTEXT;
+
+//
+// ------------------------- Function Definitions -------------------------------------------------------------
+//
+
+HRESULT
+ReadRawDumpSlice(
+    _In_ PDMP_CONTEXT Context,
+    _In_ HANDLE hRawFile,
+    _In_ PCRITICAL_SECTION Lock,
+    _In_ UINT64 Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ UINT32 Length
+    )
+/*++
+
+Routine Description:
+
+This function reads a piece of a DDR section for a worker thread. Plain
+sections are read with a positional read on the caller's own handle, so the
+threads do not wait on each other. Chunked sections are decoded by
+ReadRawDumpFile, which keeps state in the context and is called under the
+lock.
+
+Arguments:
+
+Context - DMP_CONTEXT, opened with OpenRawDumpForSlices.
+
+hRawFile - Handle to the raw dump returned by OpenRawDumpForSlices.
+
+Lock - Serializes the calls to ReadRawDumpFile.
+
+Offset - Offset in the raw dump, including Context->fileOffset.
+
+Buffer - Buffer holding the contents of the read.
+
+Length - Number of bytes to read.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT         hr = S_OK;
+    OVERLAPPED      position = { 0 };
+    DWORD           bytesRead = 0;
+    size_t          bytesProcessed = 0;
+    LARGE_INTEGER   offset;
+
+    if ((Context->ChunkedSectionCount != 0) && (Offset >= RAW_DUMP_CHUNKED_VIRTUAL_BASE)) {
+        offset.QuadPart = Offset;
+
+        EnterCriticalSection(Lock);
+        hr = ReadRawDumpFile(Context, offset, Buffer, Length, &bytesProcessed);
+        LeaveCriticalSection(Lock);
+
+        if (SUCCEEDED(hr) && (bytesProcessed != Length)) {
+            hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        }
+
+        goto Exit;
+    }
+
+    position.Offset = (DWORD)Offset;
+    position.OffsetHigh = (DWORD)(Offset >> 32);
+
+    if (!ReadFile(hRawFile, Buffer, Length, &bytesRead, &position)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (bytesRead != Length) {
+        hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+Exit:
+    return hr;
+}
+
+
+HRESULT
+OpenRawDumpForSlices(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ LPCWSTR RawDumpPath,
+    _Out_ PHANDLE hRawFile
+    )
+/*++
+
+Routine Description:
+
+This function opens a raw dump to be read by physical address from several
+threads: the section table is checked, chunked sections are opened and the DDR
+memory map is built. A second handle is opened for ReadRawDumpSlice's
+positional reads. Release with CloseRawDumpForSlices, also on failure.
+
+Arguments:
+
+Context - DMP_CONTEXT, zero initialized.
+
+RawDumpPath - The raw dump.
+
+hRawFile - Receives the handle for ReadRawDumpSlice.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT     hr = S_OK;
+
+    *hRawFile = INVALID_HANDLE_VALUE;
+
+    Context->fileOffset.QuadPart = 0;
+    if (FAILED(hr = Context->hRawFile.Open(RawDumpPath))) {
+        TraceHRESULT("Failed to open the raw dump", hr);
+        goto Exit;
+    }
+    else if (0 == (Context->RawDumpFileLength.QuadPart = Context->hRawFile.GetCurrentFileSize())) {
+        hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        TraceInfo("Error: RawDumpFileLength is invalid");
+        goto Exit;
+    }
+    else if (FAILED(hr = VerifyRawDumpHeader(Context))) {
+        TraceHRESULT("Raw Dump header is invalid", hr);
+        goto Exit;
+    }
+    else if (FAILED(hr = HRESULT_FROM_NT(VerifyRawDumpSectionTable(Context)))) {
+        TraceHRESULT("Raw Dump section table is invalid", hr);
+        goto Exit;
+    }
+    else if (FAILED(hr = OpenChunkedSections(Context))) {
+        TraceHRESULT("Failed to open chunked sections", hr);
+        goto Exit;
+    }
+    else if (FAILED(hr = HRESULT_FROM_NT(BuildDDRMemoryMap(Context)))) {
+        TraceHRESULT("Failed to Build DDR Memory Map", hr);
+        goto Exit;
+    }
+
+    *hRawFile = CreateFileW(RawDumpPath,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+    if (*hRawFile == INVALID_HANDLE_VALUE) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TraceHRESULT("Failed to open the raw dump for positional reads", hr);
+        goto Exit;
+    }
+
+Exit:
+    return hr;
+}
+
+
+VOID
+CloseRawDumpForSlices(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ HANDLE hRawFile
+    )
+/*++
+
+Routine Description:
+
+This function releases what OpenRawDumpForSlices opened.
+
+Arguments:
+
+Context - DMP_CONTEXT
+
+hRawFile - Handle returned by OpenRawDumpForSlices.
+
+Return Value:
+
+None
+
+--*/
+{
+    if (hRawFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hRawFile);
+    }
+
+    CloseChunkedSections(Context);
+    Context->hRawFile.Close();
+}
+
+
+HRESULT
+VerifySlice(
+    _Inout_ PVERIFY_CONTEXT Verify,
+    _In_ const EXTENT *Slice,
+    _Out_writes_bytes_(VERIFY_SLICE_SIZE) PUCHAR Buffer
+    )
+/*++
+
+Routine Description:
+
+This function compares one slice of physical memory, page by page, between
+the raw dump and the dump file. Runs of differing pages are added to
+Verify->Mismatches.
+
+Arguments:
+
+Verify - VERIFY_CONTEXT
+
+Slice - Physical range to compare, Tag is its DDR memory map index.
+
+Buffer - Per thread buffer, VERIFY_SLICE_SIZE bytes.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDDR_MEMORY_MAP     entry = &Verify->Context->DDRMemoryMap[Slice->Tag];
+    UINT32              length = (UINT32)EXTENT_SIZE(*Slice);
+    UINT64              rawOffset = Verify->Context->fileOffset.QuadPart + entry->Offset + (Slice->Base - entry->Base);
+    const UCHAR         *dumpData = nullptr;
+    UINT32              mismatchStart = 0;
+    UINT32              mismatchLength = 0;
+    HRESULT             hr = S_OK;
+
+    if (FAILED(hr = GetDumpPhysicalSlice(Verify->View, Slice->Base, length, &dumpData))) {
+        TraceInfo2("Memory run is not in the dump file", "PA", Slice->Base, "Length", length);
+        goto Exit;
+    }
+    else if (FAILED(hr = ReadRawDumpSlice(Verify->Context, Verify->hRawFile, &Verify->Lock, rawOffset, Buffer, length))) {
+        TraceInfo2("Failed to read DDR from the raw dump", "PA", Slice->Base, "Length", length);
+        goto Exit;
+    }
+
+    for (UINT32 page = 0; page < length; page += PAGE_SIZE) {
+        UINT32  pageLength = min((UINT32)PAGE_SIZE, length - page);
+        BOOL    differs = (memcmp(Buffer + page, dumpData + page, pageLength) != 0);
+
+        if (differs) {
+            if (mismatchLength == 0) {
+                mismatchStart = page;
+            }
+            mismatchLength += pageLength;
+        }
+
+        //
+        // Record a run of differing pages where it ends
+        //
+        if ((mismatchLength != 0) && (!differs || (page + pageLength == length))) {
+            EnterCriticalSection(&Verify->Lock);
+            hr = ExtentSetAppend(&Verify->Mismatches, Slice->Base + mismatchStart, mismatchLength, Slice->Tag);
+            LeaveCriticalSection(&Verify->Lock);
+
+            if (FAILED(hr)) {
+                goto Exit;
+            }
+            mismatchLength = 0;
+        }
+    }
+
+    InterlockedExchangeAdd64(&Verify->BytesCompared, length);
+
+Exit:
+    return hr;
+}
+
+
+DWORD WINAPI
+VerifyWorkerThread(
+    _In_ LPVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+Compares slices, taken in order from the shared context, until all are done
+or any thread fails.
+
+Arguments:
+
+Parameter - PVERIFY_CONTEXT
+
+Return Value:
+
+0
+
+--*/
+{
+    PVERIFY_CONTEXT     verify = (PVERIFY_CONTEXT)Parameter;
+    PUCHAR              buffer = nullptr;
+    HRESULT             hr = S_OK;
+
+    buffer = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, VERIFY_SLICE_SIZE);
+    if (buffer == nullptr) {
+        InterlockedCompareExchange(&verify->hr, E_OUTOFMEMORY, S_OK);
+        return 0;
+    }
+
+    while (S_OK == InterlockedCompareExchange(&verify->hr, S_OK, S_OK)) {
+        UINT32  slice = (UINT32)(InterlockedIncrement(&verify->NextSlice) - 1);
+
+        if (slice >= verify->Slices.Count) {
+            break;
+        }
+        else if (FAILED(hr = VerifySlice(verify, &verify->Slices.Extents[slice], buffer))) {
+            InterlockedCompareExchange(&verify->hr, hr, S_OK);
+            break;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), NULL, buffer);
+    return 0;
+}
+
+
+HRESULT
+BuildVerifySlices(
+    _Inout_ PVERIFY_CONTEXT Verify,
+    _Inout_ PEXTENT_SET Missing
+    )
+/*++
+
+Routine Description:
+
+This function cuts the memory runs of the dump file into slices of at most
+VERIFY_SLICE_SIZE bytes that each fall in one DDR memory map entry. Pages of
+a run that no DDR section holds are added to Missing.
+
+Arguments:
+
+Verify - VERIFY_CONTEXT, with the view and the DDR memory map built.
+
+Missing - Receives the ranges of the runs not found in the raw dump.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    PDMP_CONTEXT    Context = Verify->Context;
+    HRESULT         hr = S_OK;
+
+    for (UINT32 indexRun = 0; indexRun < Verify->View->RunCount; indexRun++) {
+        UINT64  pa = Verify->View->Runs[indexRun].Base;
+        UINT64  end = pa + Verify->View->Runs[indexRun].Size;
+
+        while (SUCCEEDED(hr) && (pa < end)) {
+            UINT32  indexDDR = FindDDRMemoryMapIndex(Context, pa);
+            UINT64  length = 0;
+
+            if (indexDDR == Context->DDRMemoryMapCount) {
+                //
+                // Skip to the next DDR section or the end of the run
+                //
+                length = end - pa;
+                for (UINT32 index = 0; index < Context->DDRMemoryMapCount; index++) {
+                    if (Context->DDRMemoryMap[index].Base > pa) {
+                        length = min(length, Context->DDRMemoryMap[index].Base - pa);
+                        break;
+                    }
+                }
+
+                hr = ExtentSetAppend(Missing, pa, length, indexRun);
+            }
+            else {
+                length = min(min(end, Context->DDRMemoryMap[indexDDR].End + 1) - pa, (UINT64)VERIFY_SLICE_SIZE);
+                hr = ExtentSetAppend(&Verify->Slices, pa, length, indexDDR);
+            }
+
+            pa += length;
+        }
+    }
+
+    return hr;
+}
+
+
+HRESULT
+VerifySecondaryData(
+    _In_ PDMP_CONTEXT Context,
+    _In_ const DUMP_FILE_VIEW *View,
+    _Out_ PUINT32 MismatchCount
+    )
+/*++
+
+Routine Description:
+
+This function checks the secondary data blobs written by WriteSVSpecific
+against their source: the raw dump table blob against the RAW_DUMP_HEADER
+and section table, and each SV specific section against the blob carrying
+its GUID. Sections sharing a GUID are matched to the blobs of that GUID in
+the order both were written.
+
+Arguments:
+
+Context - DMP_CONTEXT, with the section table read.
+
+View - The dump file.
+
+MismatchCount - Number of blobs missing or differing from their source.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    const DUMP_BLOB     *blob = nullptr;
+    PUCHAR              buffer = nullptr;
+    UINT32              tableSize = RawDumpTableSize(Context->RawDumpHeader.SectionsCount);
+    LARGE_INTEGER       offset;
+    size_t              bytesRead = 0;
+    HRESULT             hr = S_OK;
+
+    *MismatchCount = 0;
+
+    blob = FindDumpBlob(View, RAW_DUMP_TABLE_GUID);
+    if ((blob == nullptr) ||
+        (blob->DataSize != sizeof(RAW_DUMP_HEADER) + tableSize) ||
+        (memcmp(blob->Data, &Context->RawDumpHeader, sizeof(RAW_DUMP_HEADER)) != 0) ||
+        (memcmp(blob->Data + sizeof(RAW_DUMP_HEADER), Context->RawDumpSectionTable, tableSize) != 0)) {
+        TraceInfo("Raw dump table blob is missing or differs from the raw dump");
+        (*MismatchCount)++;
+    }
+
+    if (Context->LargestSVSpecificSectionSize != 0) {
+        buffer = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)Context->LargestSVSpecificSectionSize);
+        if (buffer == nullptr) {
+            hr = E_OUTOFMEMORY;
+            TraceHRESULT("Failed to allocate the SV section buffer", hr);
+            goto Exit;
+        }
+    }
+
+    for (UINT32 sectionIndex = 0; sectionIndex < Context->RawDumpHeader.SectionsCount; sectionIndex++) {
+        PRAW_DUMP_SECTION_HEADER    section = &Context->RawDumpSectionTable[sectionIndex];
+        const GUID                  *guid = nullptr;
+        UINT32                      ordinal = 0;
+
+        if (section->Type != RAW_DUMP_SECTION_TYPE_SV_SPECIFIC) {
+            continue;
+        }
+
+        //
+        // Earlier SV sections with the same GUID were written first
+        //
+        guid = LookupSVSectionGuid(section);
+        for (UINT32 index = 0; index < sectionIndex; index++) {
+            if ((Context->RawDumpSectionTable[index].Type == RAW_DUMP_SECTION_TYPE_SV_SPECIFIC) &&
+                (LookupSVSectionGuid(&Context->RawDumpSectionTable[index]) == guid)) {
+                ordinal++;
+            }
+        }
+
+        blob = FindDumpBlob(View, *guid);
+        if ((blob != nullptr) &&
+            ((UINT32)((blob - View->Blobs) + ordinal) < View->BlobCount) &&
+            IsEqualGUID(blob[ordinal].Tag, *guid)) {
+            blob += ordinal;
+        }
+        else {
+            blob = nullptr;
+        }
+
+        if ((blob == nullptr) || (blob->DataSize != (UINT32)section->Size + RAW_DUMP_SECTION_HEADER_NAME_LENGTH)) {
+            TraceInfo1("SV section blob is missing or has the wrong size", "Section Index", sectionIndex);
+            (*MismatchCount)++;
+            continue;
+        }
+
+        offset.QuadPart = Context->fileOffset.QuadPart + GetRawDumpSectionOffset(Context, sectionIndex);
+        if (FAILED(hr = ReadRawDumpFile(Context, offset, buffer, (size_t)section->Size, &bytesRead)) ||
+            (bytesRead != (size_t)section->Size)) {
+            hr = FAILED(hr) ? hr : HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+            TraceInfo1("Failed to read SV section from raw dump", "Section Index", sectionIndex);
+            goto Exit;
+        }
+
+        if ((memcmp(blob->Data, section->Name, RAW_DUMP_SECTION_HEADER_NAME_LENGTH) != 0) ||
+            (memcmp(blob->Data + RAW_DUMP_SECTION_HEADER_NAME_LENGTH, buffer, (size_t)section->Size) != 0)) {
+            TraceInfo1("SV section blob differs from the raw dump", "Section Index", sectionIndex);
+            (*MismatchCount)++;
+        }
+    }
+
+Exit:
+    if (buffer != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, buffer);
+    }
+
+    return hr;
+}
+
+
+HRESULT
+VerifyWindowsDumpFile(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ LPCWSTR RawDumpPath,
+    _In_ LPCWSTR WindowsDumpPath,
+    _Out_opt_ PUINT64 MismatchedBytes
+    )
+/*++
+
+Routine Description:
+
+This function checks a Windows dump file produced from a raw dump.
+
+Every page the DUMP_HEADER.PhysicalMemoryBlock of the dump file describes is
+compared with the same physical page of the raw dump, located through the DDR
+memory map. The comparison is spread over up to VERIFY_MAX_THREADS threads;
+the dump file is mapped and the raw dump is read with positional reads, so
+the threads only wait on each other to decode chunked sections. Both copies
+are in memory for the comparison, so the pages are compared directly rather
+than through a hash of each side.
+
+The differing and missing ranges are traced. Note that the conversion patches
+a few pages on purpose (processor context, decoded KdDebuggerDataBlock), so a
+handful of mismatched pages is expected for a good dump.
+
+Arguments:
+
+Context - DMP_CONTEXT, zero initialized.
+
+RawDumpPath - The raw dump the dump file was converted from.
+
+WindowsDumpPath - The dump file to check.
+
+MismatchedBytes - Size of the memory that is missing or differs, in bytes.
+
+Return Value:
+
+S_OK if everything matches, S_FALSE if anything is missing or differs,
+an error if either file could not be read.
+
+--*/
+{
+    VERIFY_CONTEXT      verify;
+    EXTENT_SET          missing;
+    EXTENT_SET          ranges;
+    HANDLE              threads[VERIFY_MAX_THREADS] = { 0 };
+    SYSTEM_INFO         systemInfo = { 0 };
+    UINT32              threadCount = 0;
+    UINT32              threadsStarted = 0;
+    UINT32              blobMismatches = 0;
+    UINT64              mismatched = 0;
+    BOOL                lockInitialized = FALSE;
+    HRESULT             hr = S_OK;
+
+    RtlZeroMemory(&verify, sizeof(verify));
+    verify.Context = Context;
+    verify.hRawFile = INVALID_HANDLE_VALUE;
+    verify.hr = S_OK;
+    ExtentSetInit(&verify.Slices);
+    ExtentSetInit(&verify.Mismatches);
+    ExtentSetInit(&missing);
+    ExtentSetInit(&ranges);
+
+    if (MismatchedBytes != nullptr) {
+        *MismatchedBytes = 0;
+    }
+
+    //
+    // The raw dump side: section table and DDR memory map
+    //
+    if (FAILED(hr = OpenRawDumpForSlices(Context, RawDumpPath, &verify.hRawFile))) {
+        goto Exit;
+    }
+
+    //
+    // The dump file side
+    //
+    if (FAILED(hr = OpenDumpFileView(WindowsDumpPath, &verify.View))) {
+        TraceHRESULT("Failed to open the dump file", hr);
+        goto Exit;
+    }
+    else if (FAILED(hr = BuildVerifySlices(&verify, &missing))) {
+        TraceHRESULT("Failed to split the memory runs", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("Comparing memory runs", "Runs", verify.View->RunCount, "Slices", verify.Slices.Count);
+
+    InitializeCriticalSection(&verify.Lock);
+    lockInitialized = TRUE;
+
+    GetSystemInfo(&systemInfo);
+    threadCount = min(min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)VERIFY_MAX_THREADS),
+                      max(verify.Slices.Count, 1U));
+
+    for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++) {
+        threads[threadsStarted] = CreateThread(nullptr, 0, VerifyWorkerThread, &verify, 0, nullptr);
+        if (threads[threadsStarted] == NULL) {
+            // The threads already started stop at the failure
+            InterlockedCompareExchange(&verify.hr, HRESULT_FROM_WIN32(GetLastError()), S_OK);
+            break;
+        }
+    }
+
+    if (threadsStarted != 0) {
+        WaitForMultipleObjects(threadsStarted, threads, TRUE, INFINITE);
+    }
+
+    for (UINT32 index = 0; index < threadsStarted; index++) {
+        CloseHandle(threads[index]);
+    }
+
+    if (FAILED(hr = verify.hr)) {
+        TraceHRESULT("Failed to compare the memory runs", hr);
+        goto Exit;
+    }
+
+    //
+    // Report the differing ranges, lowest address first
+    //
+    ExtentSetSort(&verify.Mismatches);
+    if (FAILED(hr = ExtentSetCoalesce(&verify.Mismatches, &ranges))) {
+        TraceHRESULT("Failed to merge the mismatched pages", hr);
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < ranges.Count; index++) {
+        TraceInfo2("Memory differs from the raw dump", "Base", ranges.Extents[index].Base, "End", ranges.Extents[index].End);
+        mismatched += EXTENT_SIZE(ranges.Extents[index]);
+    }
+
+    for (UINT32 index = 0; index < missing.Count; index++) {
+        TraceInfo2("Memory is not in the raw dump", "Base", missing.Extents[index].Base, "End", missing.Extents[index].End);
+        mismatched += EXTENT_SIZE(missing.Extents[index]);
+    }
+
+    TraceInfo2("Memory compared", "Bytes", verify.BytesCompared, "Mismatched Bytes", mismatched);
+
+    if (FAILED(hr = VerifySecondaryData(Context, verify.View, &blobMismatches))) {
+        TraceHRESULT("Failed to check the secondary data", hr);
+        goto Exit;
+    }
+
+    TraceInfo1("Secondary data checked", "Mismatched Blobs", blobMismatches);
+
+    if (MismatchedBytes != nullptr) {
+        *MismatchedBytes = mismatched;
+    }
+
+    hr = ((mismatched == 0) && (blobMismatches == 0)) ? S_OK : S_FALSE;
+
+Exit:
+    if (lockInitialized) {
+        DeleteCriticalSection(&verify.Lock);
+    }
+
+    CloseDumpFileView(verify.View);
+    ExtentSetFree(&ranges);
+    ExtentSetFree(&missing);
+    ExtentSetFree(&verify.Mismatches);
+    ExtentSetFree(&verify.Slices);
+    CloseRawDumpForSlices(Context, verify.hRawFile);
+    return hr;
+}
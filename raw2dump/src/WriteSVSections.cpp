@@ -174,11 +174,12 @@ WpDmppReadFromRawDump(
     
     --*/
 {
-    NTSTATUS    status = STATUS_SUCCESS;
-    size_t      bytesProcessed = 0;
+    NTSTATUS        status = STATUS_SUCCESS;
+    size_t          bytesProcessed = 0;
+    LARGE_INTEGER   offset;
 
-    if ( FAILED(status = Context->hRawFile.SetPos(Offset))
-         || FAILED(status = Context->hRawFile.Read((PCHAR)Buffer, BytesToRead, &bytesProcessed))
+    offset.QuadPart = Offset;
+    if ( FAILED(status = ReadRawDumpFile(Context, offset, Buffer, BytesToRead, &bytesProcessed))
          || (0 == bytesProcessed)
        )
     {
@@ -196,6 +197,7 @@ NTSTATUS
 WpDmppCopyDDRFromRawDumpToDumpFileByOffset(
     _Inout_ PDMP_CONTEXT Context,
     _In_ UINT64 RawDumpOffset,
+    _In_ UINT64 PhysicalAddress,
     _In_ LARGE_INTEGER DumpFileOffset,
     _In_ UINT32 BytesToCopy,
     _Out_opt_ PUINT32 BytesCopied
@@ -212,6 +214,9 @@ Arguments:
 
     RawDumpOffset - Byte offset into the raw dump.
 
+    PhysicalAddress - Physical address of the memory at RawDumpOffset, used to
+                      add its pages to the page fingerprint.
+
     DumpFileOffset - Byte offset into the Windows crash dump file.
 
     BytesToCopy - Specifies the number of bytes to copy from raw dump to the 
@@ -234,14 +239,15 @@ Return Value:
     UINT32      iterationsRequired = 0;
     UINT32      iteration = 0;
     ULONGLONG   rawDumpOffset = 0;
+    UINT64      physicalAddress = PhysicalAddress;
     ULONG       totalBytesCopied = 0;
     NTSTATUS    status = STATUS_SUCCESS;
 
-    iterationsRequired = (UINT32)(BytesToCopy / IO_BUFFER_SIZE);
+    iterationsRequired = (UINT32)(BytesToCopy / Context->IoBufferSize);
 
     ioBuffer = Context->IoBuffer;
 
-    if ((BytesToCopy % IO_BUFFER_SIZE) != 0) {
+    if ((BytesToCopy % Context->IoBufferSize) != 0) {
         iterationsRequired += 1;
     }
 
@@ -252,7 +258,7 @@ Return Value:
     dumpFileOffset = DumpFileOffset;
 
     for (iteration = 0; iteration < iterationsRequired; iteration++) {
-        bytesToCopy = (bytesRemain < IO_BUFFER_SIZE) ? bytesRemain : IO_BUFFER_SIZE;
+        bytesToCopy = (bytesRemain < Context->IoBufferSize) ? bytesRemain : Context->IoBufferSize;
 
         //
         // Read into the buffer.
@@ -270,6 +276,9 @@ Return Value:
 
         rawDumpOffset += bytesToCopy;
 
+        AddPagesToFingerprint(Context, physicalAddress, ioBuffer, bytesToCopy, PAGE_FINGERPRINT_REGION_NONOS);
+        physicalAddress += bytesToCopy;
+
         //
         // Write to dump file.
         //
@@ -408,6 +417,7 @@ Return Value:
             status = WpDmppCopyDDRFromRawDumpToDumpFileByOffset(
                          Context,
                          Context->CompleteMemoryMap[index].Offset,
+                         Context->CompleteMemoryMap[index].Base,
                          Context->WindowsDumpFileOffset,
                          (UINT32)Context->CompleteMemoryMap[index].Size,
                          &bytesCopied
@@ -484,6 +494,44 @@ Exit:
 }
 
 
+const GUID *
+LookupSVSectionGuid(
+    _In_ PRAW_DUMP_SECTION_HEADER Section
+    )
+/*++
+
+Routine Description:
+
+    This function returns the GUID an SV specific section is written under,
+    found by the section name. Sections with an unknown name use the GUID of
+    the last GUIDToName entry.
+
+Arguments:
+
+    Section - SV specific section.
+
+Return Value:
+
+    Pointer to the GUID in GUIDToName.
+
+--*/
+{
+    UINT32  guidToNameTableSize = sizeof(GUIDToName) / sizeof(GUIDToName[0]);
+    UINT32  guidToNameIndex = 0;
+
+    for (guidToNameIndex = 0; guidToNameIndex < guidToNameTableSize - 1; guidToNameIndex++) {
+        if (RtlEqualMemory(Section->Name,
+                           GUIDToName[guidToNameIndex].Name,
+                           RAW_DUMP_SECTION_HEADER_NAME_LENGTH))
+        {
+            break;
+        }
+    }
+
+    return &GUIDToName[guidToNameIndex].Guid;
+}
+
+
 HRESULT WriteSVSpecific(_Inout_ PDMP_CONTEXT Context)
 /*++
 
@@ -504,9 +552,6 @@ Return Value:
 {
     UINT32                   blobSize = 0;
     ULONG                    bytesWritten = 0;
-    BOOLEAN                  foundName = FALSE;
-    UINT32                   guidToNameIndex = 0;
-    UINT32                   guidToNameTableSize = 0;
     UINT32                   sectionsCount = Context->RawDumpHeader.SectionsCount;
     UINT32                   sectionIndex = 0;
     NTSTATUS                 status = STATUS_SUCCESS;
@@ -584,8 +629,6 @@ Return Value:
         TraceInfo("Wrote AP_REG to secondary data.\n");
     }
 
-    guidToNameTableSize = sizeof(GUIDToName) / sizeof(GUIDToName[0]);
-
     tempBuffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (UINT32)Context->LargestSVSpecificSectionSize);
 
     if (tempBuffer == nullptr) {
@@ -601,26 +644,6 @@ Return Value:
         PRAW_DUMP_SECTION_HEADER section = &(Context->RawDumpSectionTable[sectionIndex]);
 
         if (section->Type == RAW_DUMP_SECTION_TYPE_SV_SPECIFIC) {
-            foundName = FALSE;
-
-            //
-            // Find the matching GUID for the section name.
-            //
-            for (guidToNameIndex = 0; guidToNameIndex <  guidToNameTableSize; guidToNameIndex++) {
-                if (RtlEqualMemory(section->Name, 
-                                   GUIDToName[guidToNameIndex].Name,
-                                   RAW_DUMP_SECTION_HEADER_NAME_LENGTH))
-                {
-                    foundName = TRUE;
-                    break;
-                }
-            }//for guidToNameIndex
-
-            if (!foundName) {
-                //use UNKNOWN_GUID
-                guidToNameIndex = guidToNameTableSize - 1;
-            }
-
             RtlZeroMemory(tempBuffer, (UINT32)Context->LargestSVSpecificSectionSize);
 
             //
@@ -628,7 +651,7 @@ Return Value:
             //
             status = WpDmppReadFromRawDump(
                          Context,
-                         section->Offset,
+                         GetRawDumpSectionOffset(Context, sectionIndex),
                          (UINT32)section->Size,
                          tempBuffer
                          );
@@ -644,7 +667,7 @@ Return Value:
 
             status = WriteBlobHeader(
                          Context->WindowsDumpHandle,
-                         GUIDToName[guidToNameIndex].Guid,
+                         *LookupSVSectionGuid(section),
                          blobSize,
                          &Context->WindowsDumpFileOffset
                          );
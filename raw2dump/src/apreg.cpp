@@ -274,6 +274,8 @@ NTSTATUS UpdateContextWithAPRegLegacy(_Inout_ PDMP_CONTEXT Context)
     LARGE_INTEGER       physicalAddress;
     LARGE_INTEGER       ContextPAOffset;
     PLARGE_INTEGER      ContextPA = nullptr;
+    PARM_CONTEXT        prefetchedContexts = nullptr;
+    PBATCH_READ_REQUEST contextRequests = nullptr;
 
     //
     // Check prereqs...
@@ -329,6 +331,32 @@ NTSTATUS UpdateContextWithAPRegLegacy(_Inout_ PDMP_CONTEXT Context)
         goto Exit;
     }
 
+    //
+    // When the CONTEXT physical addresses are known, fetch all of them up front
+    // so that neighbouring CONTEXTs are read together.
+    //
+    if (Context->GetKdBlockPAFromImMemData == TRUE) {
+        prefetchedContexts = (PARM_CONTEXT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, processorCount * dataSize);
+        contextRequests = (PBATCH_READ_REQUEST)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, processorCount * sizeof(BATCH_READ_REQUEST));
+        if ((prefetchedContexts == nullptr) || (contextRequests == nullptr)) {
+            status = STATUS_NO_MEMORY;
+            TraceNTSTATUS("Failed to allocate memory for CONTEXT batch", status);
+            goto Exit;
+        }
+
+        for (indexProcessor = 0; indexProcessor < processorCount; indexProcessor++) {
+            BATCH_READ_REQUEST_INIT(contextRequests[indexProcessor],
+                ContextPA[indexProcessor].QuadPart,
+                dataSize,
+                &prefetchedContexts[indexProcessor]);
+        }
+
+        //
+        // Each CONTEXT is checked in the loop below.
+        //
+        (VOID)ReadFromDDRSectionBatch(Context, contextRequests, processorCount);
+    }
+
     //
     // Update the CONTEXT for each processor.
     //
@@ -336,21 +364,16 @@ NTSTATUS UpdateContextWithAPRegLegacy(_Inout_ PDMP_CONTEXT Context)
         if (Context->GetKdBlockPAFromImMemData == TRUE) {
 
             //
-            // Read the CONTEXT
+            // The CONTEXT was read above.
             //
-            RtlZeroMemory(armContext, dataSize);
-
-            // Read the Physical address where you would get the 
-            status = ReadFromDDRSectionByPhysicalAddress(Context,
-                ContextPA[indexProcessor],
-                sizeof(ARM_CONTEXT),
-                armContext);
-
-            if (!NT_SUCCESS(status)) {
-                TraceNTSTATUS("Failed to read the address for CONTEXT", status);
+            if (FAILED(contextRequests[indexProcessor].Result)) {
+                status = STATUS_UNSUCCESSFUL;
+                TraceHRESULT("Failed to read the address for CONTEXT", contextRequests[indexProcessor].Result);
                 goto Exit;
             }
 
+            RtlCopyMemory(armContext, &prefetchedContexts[indexProcessor], dataSize);
+
             ArmContextPA = ContextPA[indexProcessor];
         }
         else {
@@ -489,6 +512,14 @@ Exit:
         HeapFree(GetProcessHeap(), NULL, ContextPA);
     }
 
+    if (prefetchedContexts != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, prefetchedContexts);
+    }
+
+    if (contextRequests != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, contextRequests);
+    }
+
 
     return status;
 }
@@ -35,7 +35,6 @@ LARGE_INTEGER   address
 HRESULT
 parseDumpData(
 _Inout_  PDMP_CONTEXT   Context,
-LARGE_INTEGER           address,
 PSDICPUCtxtType        pCPUContext
 );
 
@@ -128,16 +127,15 @@ HRESULT
 
     if(g_Shared_IMEM == TRUE) {
         TraceInfo("Shared IMEM  is set");
-        offset.QuadPart = Context->RawDumpSectionTable[index].Offset + 0x7F000 + 0x10;
+        offset.QuadPart = GetRawDumpSectionOffset(Context, index) + 0x7F000 + 0x10;
     }
     else {
         TraceInfo("Shared IMEM is not set, IMEM_BASE = SharedIMEM");
-        offset.QuadPart = Context->RawDumpSectionTable[index].Offset + 0x10;
+        offset.QuadPart = GetRawDumpSectionOffset(Context, index) + 0x10;
     }
 
     TraceInfo1("Reading from ", "Offset", offset.QuadPart);
-    if ( FAILED(Context->hRawFile.SetPos(offset))
-         || FAILED(Context->hRawFile.Read((PCHAR)&(Context->APRegAddress.QuadPart), sizeof(UINT32), &bytesProcessed))
+    if ( FAILED(ReadRawDumpFile(Context, offset, &(Context->APRegAddress.QuadPart), sizeof(UINT32), &bytesProcessed))
          || (0 == bytesProcessed)
        )
     {
@@ -214,6 +212,10 @@ LARGE_INTEGER           address
     UINT32                  tableSize;
     PCPUContext64           currentContext = nullptr;
     PCPUContext64           prevContext = nullptr;
+    UINT32                  entryCount = 0;
+    PAP_AP_REG_MSM_DUMP_DATA dumpData = nullptr;
+    PCPUContext64           *contexts = nullptr;
+    PBATCH_READ_REQUEST     requests = nullptr;
 
     status = ReadFromDDRSectionByPhysicalAddress(Context, 
         address,
@@ -260,10 +262,39 @@ LARGE_INTEGER           address
     
     dumpAPREGDumpTable(papreg_dump_table); 
     
+    entryCount = papreg_dump_table->Num_Entries;
+    dumpData = (PAP_AP_REG_MSM_DUMP_DATA) HeapAlloc (GetProcessHeap(), HEAP_ZERO_MEMORY, entryCount * sizeof(AP_REG_MSM_DUMP_DATA));
+    contexts = (PCPUContext64 *) HeapAlloc (GetProcessHeap(), HEAP_ZERO_MEMORY, entryCount * sizeof(PCPUContext64));
+    requests = (PBATCH_READ_REQUEST) HeapAlloc (GetProcessHeap(), HEAP_ZERO_MEMORY, entryCount * sizeof(BATCH_READ_REQUEST));
+    if ((dumpData == nullptr) || (contexts == nullptr) || (requests == nullptr)) {
+        hr = E_OUTOFMEMORY;
+        TraceInfo("parseDumpTable: Failed to allocate memory for dump data entries");
+        goto Exit;
+    }
+
+    //
+    // Fetch the AP_REG_MSM_DUMP_DATA of every CPU context entry of this table
+    // in one batch. Requests for other entries are left empty.
+    //
+    for(index = 0; index < entryCount; index++) {
+        if ((papreg_dump_table->Entries[index].type == MSM_DUMP_TYPE_DATA) &&
+            (papreg_dump_table->Entries[index].id >> 4 == MSM_DUMP_DATA_CPU_CTX)) {
+            BATCH_READ_REQUEST_INIT(requests[index],
+                papreg_dump_table->Entries[index].Address,
+                sizeof(AP_REG_MSM_DUMP_DATA),
+                &dumpData[index]);
+        }
+        else {
+            BATCH_READ_REQUEST_INIT(requests[index], 0, 0, nullptr);
+        }
+    }
+
+    (VOID)ReadFromDDRSectionBatch(Context, requests, entryCount);
+
     //
     // perform some checks here.
     //
-    for(index = 0; index < papreg_dump_table->Num_Entries; index++) {
+    for(index = 0; index < entryCount; index++) {
         // 
         // Do some sanity checks.
         //
@@ -293,11 +324,8 @@ LARGE_INTEGER           address
                     gAPRegCPUConextList.listHead = currentContext;
                     prevContext = currentContext;
                 }
-                //
-                // now parse it and fill the entry.
-                //
                 prevContext->Flink = currentContext;
-                parseDumpData(Context, elementAddress, &(currentContext->cpuContext));
+                contexts[index] = currentContext;
                        
                 prevContext = currentContext;
                 gAPRegCPUConextList.numProcressors++;
@@ -307,50 +335,67 @@ LARGE_INTEGER           address
             
         }
     }    
+
+    //
+    // Now fetch the CPU contexts the dump data entries point at, again in one batch.
+    //
+    for(index = 0; index < entryCount; index++) {
+        if ((contexts[index] != nullptr) && SUCCEEDED(requests[index].Result)) {
+            BATCH_READ_REQUEST_INIT(requests[index],
+                dumpData[index].address,
+                sizeof(SDICPUCtxtType), /*dumpData[index].len,*/
+                &(contexts[index]->cpuContext));
+        }
+        else {
+            BATCH_READ_REQUEST_INIT(requests[index], 0, 0, nullptr);
+        }
+    }
+
+    (VOID)ReadFromDDRSectionBatch(Context, requests, entryCount);
+
+    //
+    // now parse them.
+    //
+    for(index = 0; index < entryCount; index++) {
+        if (contexts[index] == nullptr) {
+            continue;
+        }
+
+        if ((requests[index].Length == 0) || FAILED(requests[index].Result)) {
+            TraceInfo1("parseDumpTable: Failed to read CPU context", "Entry", index);
+            continue;
+        }
+
+        parseDumpData(Context, &(contexts[index]->cpuContext));
+    }
     
     
  Exit:
     if(papreg_dump_table != nullptr) {
         HeapFree(GetProcessHeap(), NULL, papreg_dump_table);
     }        
+    if(dumpData != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, dumpData);
+    }
+    if(contexts != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, contexts);
+    }
+    if(requests != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, requests);
+    }
     return hr;
 }
 
 HRESULT
 parseDumpData(
 _Inout_  PDMP_CONTEXT   Context,
-LARGE_INTEGER           address,
 PSDICPUCtxtType        pCPUContext
 )
+// The CPU context has already been read by parseDumpTable.
 {
     HRESULT                     hr = E_FAIL;
-    AP_REG_MSM_DUMP_DATA        apregDumpData;
-    LARGE_INTEGER               contextAddress;
     UINT32                      cpuStatus = 0;
     
-    ReadFromDDRSectionByPhysicalAddress(Context, 
-           address,
-           sizeof(AP_REG_MSM_DUMP_DATA),
-           &apregDumpData);
-           
-    //dumpAPREGDumpData(&apregDumpData);
-    
-    // 
-    // TODO: Do some sanity checks here.
-    //
-    
-    
-    
-    //
-    // Read the Context.
-    //
-    contextAddress.QuadPart = apregDumpData.address;
-    
-    ReadFromDDRSectionByPhysicalAddress(Context, 
-           contextAddress,
-           sizeof(SDICPUCtxtType), /*apregDumpData.len,*/
-           pCPUContext);    
-         
     //
     // Analysing CPU Status word 0 
     //
@@ -656,11 +701,6 @@ Exit:
         hr = S_OK;
     }
 
-    if (Context->WindowsDumpHandle != INVALID_HANDLE_VALUE){
-        CloseHandle(Context->WindowsDumpHandle);
-        Context->WindowsDumpHandle = INVALID_HANDLE_VALUE;
-    }
-    
     //
     //  Cleanup the context linked list.
     //
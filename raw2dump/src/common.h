@@ -20,7 +20,6 @@
 #define VOLUME_NAME_SIZE 50
 #define DEVICE_NAME_SIZE 40
 #define MAX_FILE_SIZE 0xFFFFFFF0000 // a ntfs limit
-#define MAX_ALLOWED_DDR_SECTIONS 10
 // {0x66C9B323-F7FC-48B6-BF96-6F32E335A428}
 static const GUID RAWDUMP_GUID = 
 { 0x66C9B323, 0xF7FC, 0x48B6, { 0xBF, 0x96, 0x6F, 0x32, 0xE3, 0x35, 0xA4, 0x28 } };
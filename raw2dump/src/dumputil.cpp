@@ -57,6 +57,16 @@ HRESULT
 GetAPReg(
     _Inout_ PDMP_CONTEXT Context
 );
+
+HRESULT
+FindCPUContext(
+    _Inout_ PDMP_CONTEXT Context
+    );
+
+HRESULT
+UpdateCPUContext(
+    _Inout_ PDMP_CONTEXT Context
+    );
 //
 // ------------------------- Function Definitions -------------------------------------------------------------
 //
@@ -107,6 +117,7 @@ ExtractRawDumpFile(
     hr = HRESULT_FROM_NT(status);
 
 Exit:
+    CloseChunkedSections(Context);
     Context->hRawFile.Close();
     return hr;
 }
@@ -133,6 +144,13 @@ ExtractRawDumpToFile(PDMP_CONTEXT Context)
         goto Exit;
     }
 
+    hr = OpenChunkedSections(Context);
+    if (FAILED(hr)) {
+        TraceHRESULT("Failed to open chunked sections", hr);
+        status = STATUS_UNSUCCESSFUL;
+        goto Exit;
+    }
+
     TraceInfo("Got a valid section table. Building a memory based on DDR sections");
     status = BuildDDRMemoryMap(Context);
     if (FAILED(status)) {
@@ -143,10 +161,20 @@ ExtractRawDumpToFile(PDMP_CONTEXT Context)
     TraceInfo("Built memory map. Reading rawdumpinfo xml file to get more info.");
 
     //
-    // Allocate a large chunk of memory for buffering.
+    // The tables are needed whatever the budget, charge them first so that the
+    // buffers shrink instead.
     //
-    Context->IoBuffer = (PVOID)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, IO_BUFFER_SIZE);
-    if (Context->IoBuffer == nullptr) {
+    ChargeMemoryBudget(Context,
+                       RawDumpTableSize((UINT64)Context->RawDumpHeader.SectionsCount) +
+                       ((UINT64)Context->DDRSectionCount * sizeof(DDR_MEMORY_MAP)),
+                       TRUE);
+
+    //
+    // Allocate a large chunk of memory for buffering, as much of
+    // IO_BUFFER_SIZE as the memory budget allows.
+    //
+    hr = AllocatePooledBuffer(Context, IO_BUFFER_SIZE, PAGE_SIZE, &Context->IoBuffer, &Context->IoBufferSize);
+    if (FAILED(hr)) {
         status = STATUS_NO_MEMORY;
         TraceNTSTATUS("Failed to allocate IoBuffer", status);
         goto Exit;
@@ -189,11 +217,14 @@ The function does the following.
 5. write dump header to dump file
 6. write DDR to dump file
 7. update dump file with cpu context
+8. write the queued patches to dump file
+
+Steps 6 and 7 run as a dependency graph, see RunConversionPhases.
 
 ++*/
 {
-    NTSTATUS    status = STATUS_UNSUCCESSFUL;
     HRESULT     hr = S_OK;
+    HRESULT     patchHr = S_OK;
 
     TraceInfo("Validating DUMP_HEADER's memory descriptors against DDR sections");
     hr = ValidateDDRAgainstPhysicalMemoryBlock(Context);
@@ -219,6 +250,11 @@ The function does the following.
         goto ExitHR;
     }
 
+    if (Context->ShardMode == ConversionShardWorker) {
+        hr = WriteDumpShard(Context);
+        goto ExitHR;
+    }
+
     TraceInfo("Writing DUMP_HEADER to the dump file");
     hr = WriteDumpHeader(Context);
     if (FAILED(hr)) {
@@ -226,88 +262,225 @@ The function does the following.
         goto ExitHR;
     }
 
-    TraceInfo("Writing DDR section to the dump file");
-    hr = WriteDDR(Context);
-    if (FAILED(hr)) {
-        TraceHRESULT("WriteDDR failed", hr);
+    if (Context->ShardMode == ConversionShardPlan) {
+        hr = PlanDumpShards(Context);
         goto ExitHR;
     }
 
-    TraceInfo("Writing secondary data to the dump file");
-    hr = WriteSVSpecific(Context);
+    hr = BuildDumpRunIndex(Context);
     if (FAILED(hr)) {
-        TraceHRESULT("WriteSVSpecific failed", hr);
+        TraceHRESULT("BuildDumpRunIndex failed", hr);
         goto ExitHR;
     }
 
-    if (!DbgClient::Initialize(Context->WindowsDumpFilePath, NULL)) {
-        TraceInfo("Error: Failed to initialize Debug Client");
-        goto Exit;
+    //
+    // The rest runs as a dependency graph. The secondary data is appended after
+    // DDR at the same file offset and both feed the page fingerprint, so they
+    // stay in order. dbgeng reads the dump file, so the KdDebuggerDataBlock
+    // search waits for it to be complete. Locating AP_REG and reading the
+    // InMemDiag buffer only read the raw dump and overlap with the copy.
+    //
+    static const CONVERSION_PHASE phases[ExtractPhaseCount] = {
+        { "Writing DDR section to the dump file",
+          WriteDDR,
+          0,
+          CONVERSION_PHASE_REQUIRED },
+        { "Writing secondary data to the dump file",
+          WriteSVSpecific,
+          CONVERSION_PHASE_BIT(ExtractPhaseDDR),
+          CONVERSION_PHASE_REQUIRED },
+        { "Writing the page fingerprint",
+          WritePageFingerprint,
+          CONVERSION_PHASE_BIT(ExtractPhaseSecondaryData),
+          0 },
+        { "Locating the CPU context",
+          FindCPUContext,
+          0,
+          0 },
+        { "Reading the InMemDiag buffer",
+          ReadInMemDiagBuffer,
+          0,
+          0 },
+        { "Try to determine if KdDebuggerDataBlock is encoded",
+          FindKdDebuggerDataBlock,
+          CONVERSION_PHASE_BIT(ExtractPhaseSecondaryData),
+          CONVERSION_PHASE_REQUIRED | CONVERSION_PHASE_CALLER_THREAD },
+        { "Update CPU context",
+          UpdateCPUContext,
+          CONVERSION_PHASE_BIT(ExtractPhaseFindCPUContext) | CONVERSION_PHASE_BIT(ExtractPhaseKdDebuggerDataBlock),
+          CONVERSION_PHASE_REQUIRED | CONVERSION_PHASE_CALLER_THREAD },
+        { "Writing the InMemDiag buffer",
+          WriteInMemDiagBuffer,
+          CONVERSION_PHASE_BIT(ExtractPhaseReadInMemDiag) | CONVERSION_PHASE_BIT(ExtractPhaseUpdateCPUContext),
+          0 },
+    };
+
+    hr = RunConversionPhases(Context, phases, ARRAYSIZE(phases));
+    if (FAILED(hr)) {
+        TraceHRESULT("RunConversionPhases failed", hr);
     }
 
-    TraceInfo("Try to determine if KdDebuggerDataBlock is encoded");
-    status = GetKdDebuggerDataBlock(Context);
-    if (FAILED(status)) {
-        TraceNTSTATUS("GetKdDebuggerDataBlock failed", status);
-        hr = E_FAIL;
-        goto Exit;
+    //
+    // Whatever the phases patched before one failed still goes to the dump.
+    //
+    patchHr = ApplyDumpPatches(Context);
+    if (FAILED(patchHr)) {
+        TraceHRESULT("ApplyDumpPatches failed", patchHr);
+        if (SUCCEEDED(hr)) {
+            hr = patchHr;
+        }
     }
 
-    TraceInfo("Update CPU context");
-    switch (Context->DumpHeader32->MachineImageType){
-    case IMAGE_FILE_MACHINE_I386:
-        if (Context->CPUContextSectionCount >0){
-            status = UpdateContextX86(Context);
-        }
-        break;
+    if (FAILED(hr)) {
+        goto ExitHR;
+    }
 
+    TraceInfo("Wrote to Dump file successfully");
+
+ExitHR:
+    return hr;
+
+}
+
+
+HRESULT
+FindCPUContext(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+    Parses the register context of the processors out of the raw dump, for
+    UpdateCPUContext to write once the KdDebuggerDataBlock is known. Only reads
+    the raw dump, failures are not fatal.
+
+Arguments:
+    Context - Pointer to the global context structure.
+
+Return Value:
+    HRESULT
+
+--*/
+{
+    switch (Context->DumpHeader32->MachineImageType){
     case IMAGE_FILE_MACHINE_ARM:
     case IMAGE_FILE_MACHINE_ARMNT:
         //
         // Get the AP_REG data from memory and do some validation.
         //
-        TraceInfo("Try getting AP_REG");
+        return GetAPReg(Context);
 
-        hr = GetAPReg(Context);
-        if (FAILED(hr)) {
-            TraceHRESULT("GetAPReg failed", hr);
-        }
+    default:
+        return S_OK;
+    }
+}
 
-        status = UpdateContextWithAPReg(Context);
-        if (FAILED(status)) {
-            TraceHRESULT("UpdateContextWithAPReg failed", hr);
-            goto Exit;
+
+HRESULT
+UpdateCPUContext(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+    Writes the register context of the processors to the dump file. Needs the
+    KdDebuggerDataBlock and dbgeng to translate its virtual addresses.
+
+Arguments:
+    Context - Pointer to the global context structure.
+
+Return Value:
+    HRESULT, only failures to update an ARM context are returned.
+
+--*/
+{
+    HRESULT     hr = S_OK;
+    NTSTATUS    status = STATUS_SUCCESS;
+
+    switch (Context->DumpHeader32->MachineImageType){
+    case IMAGE_FILE_MACHINE_I386:
+        if (Context->CPUContextSectionCount >0){
+            status = UpdateContextX86(Context);
+            if (FAILED(status)) {
+                // not fatal
+                TraceNTSTATUS("UpdateContextX86 failed", status);
+            }
         }
         break;
 
+    case IMAGE_FILE_MACHINE_ARM:
+    case IMAGE_FILE_MACHINE_ARMNT:
+        hr = UpdateContextWithAPReg(Context);
+        break;
+
     default:
-        hr = E_FAIL;
-        TraceHRESULT("Unsupported CPU Context type", hr);
+        TraceHRESULT("Unsupported CPU Context type", E_FAIL);
         break;
     }
 
- //   if (Context->DumpHeaderStatus != DHS_VALID) {
- //       if (FAILED(hr = WriteFakeDumpHeader(Context))) {
- //           // not fatal
- //           TraceHRESULT("WriteFakeDumpHeader failed", hr);
- //       }
- //   }
+    return hr;
+}
 
-    if (FAILED(hr = WriteInMemDiagBuffer(Context))) {
-        // not fatal
-        TraceHRESULT("WriteInMemDiagBuffer failed", hr);
-    }
 
-    status = STATUS_SUCCESS;
+HRESULT
+FindKdDebuggerDataBlock(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
 
-    TraceInfo("Wrote to Dump file successfully");
+Routine Description:
+    Opens the dump file in dbgeng and locates the KdDebuggerDataBlock through
+    it. dbgeng is bound to the thread that opened the dump, so this and every
+    later use of it run on the same thread.
 
-Exit:
-    return HRESULT_FROM_NT(status);
+Arguments:
+    Context - Pointer to the global context structure.
 
-ExitHR:
-    return hr;
+Return Value:
+    HRESULT
+
+--*/
+{
+    NTSTATUS    status = STATUS_UNSUCCESSFUL;
+    UINT32      firstPatch = Context->PatchCount;
 
+    //
+    // A kernel build converted before needs no dbgeng, if what its cached
+    // profile leads to is not the same KdDebuggerDataBlock, start over.
+    //
+    LookupKernelProfile(Context);
+    if (Context->KernelProfileHit) {
+        status = GetKdDebuggerDataBlock(Context);
+        if (NT_SUCCESS(status) && CheckKernelProfile(Context)) {
+            goto Exit;
+        }
+
+        TraceInfo("The cached kernel profile does not fit this dump");
+        Context->KernelProfileHit = FALSE;
+        DiscardDumpPatches(Context, firstPatch);
+        if (Context->KdDebuggerDataBlock != nullptr) {
+            HeapFree(GetProcessHeap(), NULL, Context->KdDebuggerDataBlock);
+            Context->KdDebuggerDataBlock = nullptr;
+        }
+
+        status = STATUS_UNSUCCESSFUL;
+    }
+
+    if (!DbgClient::Initialize(Context->WindowsDumpFilePath, NULL)) {
+        TraceInfo("Error: Failed to initialize Debug Client");
+        goto Exit;
+    }
+
+    status = GetKdDebuggerDataBlock(Context);
+    if (FAILED(status)) {
+        TraceNTSTATUS("GetKdDebuggerDataBlock failed", status);
+        goto Exit;
+    }
+
+    SaveKernelProfile(Context);
+
+Exit:
+    return NT_SUCCESS(status) ? S_OK : HRESULT_FROM_NT(status);
 }
 
 HRESULT
@@ -525,6 +698,7 @@ NTSTATUS VerifyRawDumpSectionTable(PDMP_CONTEXT Context)
     4. No sections with unrecognized section type.
     5. SectionsCount matches number of valid sections.
     6. Only the last section should have the RAW_DUMP_HEADER_FLAGS_INSUFFICIENT_STORAGE flag.
+    7. Section version is v1, or v2 with the RAW_DUMP_SECTION_FLAGS_CHUNKED flag.
 
     Arguments:
 
@@ -557,6 +731,7 @@ NTSTATUS VerifyRawDumpSectionTable(PDMP_CONTEXT Context)
     Context->InsufficientStorageSectionsCount = 0;
     Context->InvalidVersionCount = 0;
     Context->LargestSVSpecificSectionSize = 0;
+    Context->ChunkedSectionCount = 0;
 
 
 
@@ -564,7 +739,12 @@ NTSTATUS VerifyRawDumpSectionTable(PDMP_CONTEXT Context)
         //
         // Check version
         //
-        if (Context->RawDumpSectionTable[index].Version != RAW_DUMP_SECTION_HEADER_VERSION) {
+        if ((Context->RawDumpSectionTable[index].Version == RAW_DUMP_SECTION_HEADER_VERSION_V2) &&
+            ((Context->RawDumpSectionTable[index].Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED) == RAW_DUMP_SECTION_FLAGS_CHUNKED)) {
+            Context->ChunkedSectionCount++;
+        }
+        else if ((Context->RawDumpSectionTable[index].Version != RAW_DUMP_SECTION_HEADER_VERSION) ||
+                 ((Context->RawDumpSectionTable[index].Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED) == RAW_DUMP_SECTION_FLAGS_CHUNKED)) {
             TraceInfo2("Section has invalid version", "Index", index, "Version", Context->RawDumpSectionTable[index].Version);
             Context->InvalidVersionCount++;
         }
@@ -659,6 +839,7 @@ NTSTATUS VerifyRawDumpSectionTable(PDMP_CONTEXT Context)
     TraceInfo1("DDR Sections", "Count", Context->DDRSectionCount);
     TraceInfo1("SV Specific Sections", "Count", Context->SVSectionCount);
     TraceInfo1("CPU Context Sections", "Count", Context->CPUContextSectionCount);
+    TraceInfo1("Chunked Sections", "Count", Context->ChunkedSectionCount);
 
     if (Context->InvalidVersionCount > 0) {
         TraceInfo1("Sections with invalid versions detected", "Count", Context->InvalidVersionCount);
@@ -691,6 +872,239 @@ Exit:
 }
 
 
+HRESULT
+OpenChunkedSections(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function opens every chunked (v2) section of the raw dump and gives it
+an offset from RAW_DUMP_CHUNKED_VIRTUAL_BASE and up in Context->ChunkedSections.
+ReadRawDumpFile decompresses the chunks such offsets point to. The section
+table is left as read from the raw dump, it is copied to the dump file as is.
+Offsets derived from the table must come from GetRawDumpSectionOffset.
+
+Must be called after VerifyRawDumpSectionTable and before BuildDDRMemoryMap.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT     hr = S_OK;
+    UINT64      virtualOffset = RAW_DUMP_CHUNKED_VIRTUAL_BASE;
+    UINT32      chunkedCount = Context->ChunkedSectionCount;
+    UINT32      index;
+
+    Context->ChunkedSections = nullptr;
+    Context->ChunkedSectionCount = 0;
+
+    if (chunkedCount == 0) {
+        goto Exit;
+    }
+
+    Context->ChunkedSections = (PCHUNKED_SECTION_MAP)HeapAlloc(GetProcessHeap(),
+                                                               HEAP_ZERO_MEMORY,
+                                                               chunkedCount * sizeof(CHUNKED_SECTION_MAP));
+    if (Context->ChunkedSections == nullptr) {
+        hr = HRESULT_FROM_NT(STATUS_NO_MEMORY);
+        TraceHRESULT("Failed to allocate chunked section map", hr);
+        goto Exit;
+    }
+
+    for (index = 0; index < Context->RawDumpHeader.SectionsCount; index++) {
+        PRAW_DUMP_SECTION_HEADER    section = &Context->RawDumpSectionTable[index];
+        PCHUNKED_SECTION_MAP        map = &Context->ChunkedSections[Context->ChunkedSectionCount];
+
+        if ((section->Flags & RAW_DUMP_SECTION_FLAGS_CHUNKED) != RAW_DUMP_SECTION_FLAGS_CHUNKED) {
+            continue;
+        }
+
+        hr = OpenChunkedSection(&Context->hRawFile,
+                                Context->fileOffset.QuadPart + section->Offset,
+                                section->Size,
+                                &map->Section);
+        if (FAILED(hr)) {
+            TraceInfo1("Chunk index is invalid", "Index", index);
+            TraceHRESULT("Failed to open chunked section", hr);
+            goto Exit;
+        }
+
+        ChargeMemoryBudget(Context, CHUNKED_SECTION_MEMORY(map->Section), TRUE);
+
+        map->VirtualOffset = virtualOffset;
+        map->SectionIndex = index;
+        virtualOffset += section->Size;
+
+        Context->ChunkedSectionCount++;
+    }
+
+    TraceInfo1("Chunked sections opened", "Count", Context->ChunkedSectionCount);
+
+Exit:
+    return hr;
+}
+
+
+VOID
+CloseChunkedSections(
+    _Inout_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function releases the sections opened by OpenChunkedSections.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+Return Value:
+
+None.
+
+--*/
+{
+    if (Context->ChunkedSections != nullptr) {
+        for (UINT32 index = 0; index < Context->ChunkedSectionCount; index++) {
+            ReturnMemoryBudget(Context, CHUNKED_SECTION_MEMORY(Context->ChunkedSections[index].Section));
+            CloseChunkedSection(Context->ChunkedSections[index].Section);
+        }
+
+        HeapFree(GetProcessHeap(), NULL, Context->ChunkedSections);
+    }
+
+    Context->ChunkedSections = nullptr;
+    Context->ChunkedSectionCount = 0;
+}
+
+
+UINT64
+GetRawDumpSectionOffset(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT32 SectionIndex
+    )
+/*++
+
+Routine Description:
+
+This function returns the offset of a section's data for ReadRawDumpFile,
+relative to Context->fileOffset. That is the Offset from the section table,
+or the offset OpenChunkedSections gave the section if it is chunked.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+SectionIndex - Index in Context->RawDumpSectionTable.
+
+Return Value:
+
+Offset of the section data.
+
+--*/
+{
+    for (UINT32 index = 0; index < Context->ChunkedSectionCount; index++) {
+        if (Context->ChunkedSections[index].SectionIndex == SectionIndex) {
+            return Context->ChunkedSections[index].VirtualOffset - Context->fileOffset.QuadPart;
+        }
+    }
+
+    return Context->RawDumpSectionTable[SectionIndex].Offset;
+}
+
+
+HRESULT
+ReadRawDumpFile(
+    _In_ PDMP_CONTEXT Context,
+    _In_ LARGE_INTEGER Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ size_t Length,
+    _Out_opt_ size_t *BytesRead
+    )
+/*++
+
+Routine Description:
+
+This function reads from the raw dump at an offset taken from the section
+table. Offsets of chunked sections (see OpenChunkedSections) are served by
+decompressing the chunks they fall in, any other offset is read from the file.
+A read does not cross from one section into the next. Reads are serialized
+while RunConversionPhases runs phases in parallel.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+Offset - Offset in the raw dump, including Context->fileOffset.
+
+Buffer - Buffer holding the contents of the read.
+
+Length - Number of bytes to read.
+
+BytesRead - Number of bytes read.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT     hr = S_OK;
+    UINT64      offset = (UINT64)Offset.QuadPart;
+    UINT32      low = 0;
+    UINT32      high = Context->ChunkedSectionCount;
+    UINT32      middle;
+
+    if (Context->RawDumpLockInitialized) {
+        EnterCriticalSection(&Context->RawDumpLock);
+    }
+
+    if ((Context->ChunkedSectionCount == 0) || (offset < RAW_DUMP_CHUNKED_VIRTUAL_BASE)) {
+        if (SUCCEEDED(hr = Context->hRawFile.SetPos(Offset))) {
+            hr = Context->hRawFile.Read((PCHAR)Buffer, Length, BytesRead);
+        }
+
+        goto Exit;
+    }
+
+    //
+    // Find the last section starting at or before offset, the map is in
+    // ascending order.
+    //
+    while ((high - low) > 1) {
+        middle = low + ((high - low) / 2);
+        if (Context->ChunkedSections[middle].VirtualOffset <= offset) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    hr = ReadChunkedSection(Context->ChunkedSections[low].Section,
+                            offset - Context->ChunkedSections[low].VirtualOffset,
+                            Buffer,
+                            Length,
+                            BytesRead);
+
+Exit:
+    if (Context->RawDumpLockInitialized) {
+        LeaveCriticalSection(&Context->RawDumpLock);
+    }
+
+    return hr;
+}
+
+
 NTSTATUS
 BuildDDRMemoryMap(
     PDMP_CONTEXT Context
@@ -712,10 +1126,15 @@ NT status code.
 --*/
 {
     UINT32              allocationSize = 0;
-    UINT64              previousEnd = 0;
-    UINT64              currentStart = 0;
+    UINT32              holeCount = 0;
+    UINT32              overlapCount = 0;
+    EXTENT_SET          ddrExtents;
+    PEXTENT             extent = nullptr;
+    HRESULT             hr = S_OK;
     NTSTATUS            status = STATUS_UNSUCCESSFUL;
 
+    ExtentSetInit(&ddrExtents);
+
     //
     // We should have aborted if the DDR assumptions were violated.
     // Let's make sure.
@@ -741,7 +1160,8 @@ NT status code.
     }
 
     //
-    // Fill in the table.
+    // Collect the DDR ranges, tagged with their section index.
+    // Empty and wrapping sections are rejected here.
     //
     for (UINT32 index = 0; index < Context->DDRSectionCount; index++)  {
         if (Context->DDRSections[index].Type != RAW_DUMP_SECTION_TYPE_DDR_RANGE) {
@@ -751,98 +1171,310 @@ NT status code.
             goto Exit;
         }
 
-        Context->DDRMemoryMapCount++;
-        Context->DDRMemoryMap[index].Base = Context->DDRSections[index].u.DDRInformation.Base;
-        Context->DDRMemoryMap[index].Size = Context->DDRSections[index].Size;
-        Context->DDRMemoryMap[index].Offset = Context->DDRSections[index].Offset;
-        Context->DDRMemoryMap[index].End = Context->DDRMemoryMap[index].Base +
-            Context->DDRMemoryMap[index].Size - 
-            1;
-        Context->TotalDDRSizeInBytes += Context->DDRMemoryMap[index].Size;
+        hr = ExtentSetAppend(&ddrExtents,
+                             Context->DDRSections[index].u.DDRInformation.Base,
+                             Context->DDRSections[index].Size,
+                             index);
+        if (hr == E_INVALIDARG) {
+            LogLibInfoPrintf(L"DDR Section %u is empty or wraps the address space", index);
+            status = STATUS_BAD_DATA;
+            goto Exit;
+        }
+        else if (FAILED(hr)) {
+            status = STATUS_NO_MEMORY;
+            TraceHRESULT("Failed to collect DDR sections", hr);
+            goto Exit;
+        }
     }
 
     // DDR sections layout may be out of order, by base.
-    // Need to sort ascending by base address.
+    // Need to sort ascending by base address, FindDDRMemoryMapIndex relies on it.
     LogLibInfoPrintf(L"Sorting DDR sections");
-    for (UINT32 i = 0; i < Context->DDRMemoryMapCount - 1; i++)
-    {
-        for (UINT32 j = 0; j < Context->DDRMemoryMapCount - 1 - i; j++)
-        {
-            if (Context->DDRMemoryMap[j].Base > Context->DDRMemoryMap[j + 1].Base)
-            {
-                DDR_MEMORY_MAP tmpDdrRecord;
+    ExtentSetSort(&ddrExtents);
 
-                memcpy(&tmpDdrRecord, &Context->DDRMemoryMap[j], sizeof(tmpDdrRecord));
-                memcpy(&Context->DDRMemoryMap[j], &Context->DDRMemoryMap[j + 1], sizeof(tmpDdrRecord));
-                memcpy(&Context->DDRMemoryMap[j + 1], &tmpDdrRecord, sizeof(tmpDdrRecord));
-            }
+    //
+    // Ideal layout is each new segment starts at the previous end + 1
+    // Anything else is a hole (harmless) or overlap (fatal)
+    //
+    LogLibInfoPrintf(L"Checking DDR section sanity");
+    ExtentSetCheck(&ddrExtents, &holeCount, &overlapCount);
+    Context->DDRSectionFragmentationCount += holeCount;
+    Context->DDRSectionsOverlapCount += overlapCount;
 
-        }
+    //
+    // Fill in the table.
+    //
+    for (UINT32 index = 0; index < ddrExtents.Count; index++) {
+        extent = &ddrExtents.Extents[index];
+
+        Context->DDRMemoryMapCount++;
+        Context->DDRMemoryMap[index].Base = extent->Base;
+        Context->DDRMemoryMap[index].End = extent->End;
+        Context->DDRMemoryMap[index].Size = EXTENT_SIZE(*extent);
+        Context->DDRMemoryMap[index].Offset = GetRawDumpSectionOffset(Context,
+                                                                      (UINT32)(Context->DDRSections - Context->RawDumpSectionTable) + extent->Tag);
+        Context->TotalDDRSizeInBytes += Context->DDRMemoryMap[index].Size;
 
+        //
+        // The first section is contiguous by default.
+        //
+        Context->DDRMemoryMap[index].Contiguous =
+            (index == 0) || (extent->Base == Context->DDRMemoryMap[index - 1].End + 1);
     }
 
-    //
-    // Check for sane DDR sections (no overlap, no negative size, no swapped boundaries)
-    //
-    LogLibInfoPrintf(L"Checking DDR section sanity");
-    for (UINT32 index = 0; index < Context->DDRMemoryMapCount; index++)
+    if (Context->DDRSectionFragmentationCount != 0)
     {
-        if (Context->DDRMemoryMap[index].End < Context->DDRMemoryMap[index].Base)
-        {
-            LogLibInfoPrintf(L"DDR Section %u end before start", index);
-            status = STATUS_BAD_DATA;
-            goto Exit;
+        LogLibInfoPrintf(L"Hole count %u in DDR Sections is harmless", Context->DDRSectionFragmentationCount);
+    }
+
+    if (Context->DDRSectionsOverlapCount != 0)
+    {
+        LogLibInfoPrintf(L"Overlap count %u in DDR Sections is fatal", Context->DDRSectionsOverlapCount);
+        goto Exit;
+    }
+
+    status = STATUS_SUCCESS;
+Exit:
+    ExtentSetFree(&ddrExtents);
+    return status;
+}
+
+
+HRESULT
+BuildDDRExtentSet(
+    _In_ PDMP_CONTEXT Context,
+    _Out_ PEXTENT_SET DDRExtents
+    )
+/*++
+
+Routine Description:
+
+This function copies the DDR memory map into an extent set. Each extent is
+tagged with its DDR memory map index. The set is normalized since the map is
+sorted and free of overlaps.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+DDRExtents - Receives the set, to be released with ExtentSetFree.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    HRESULT     hr = S_OK;
+
+    ExtentSetInit(DDRExtents);
+
+    for (UINT32 index = 0; index < Context->DDRMemoryMapCount; index++) {
+        hr = ExtentSetAppend(DDRExtents,
+                             Context->DDRMemoryMap[index].Base,
+                             Context->DDRMemoryMap[index].Size,
+                             index);
+        if (FAILED(hr)) {
+            ExtentSetFree(DDRExtents);
+            break;
         }
+    }
 
-        if (Context->DDRMemoryMap[index].Size == 0)
-        {
-            LogLibInfoPrintf(L"DDR Section %u size is zero", index);
-            status = STATUS_BAD_DATA;
+    return hr;
+}
+
+
+HRESULT
+BuildMemoryRunExtentSet(
+    _In_ PDMP_CONTEXT Context,
+    _Out_ PEXTENT_SET Runs
+    )
+/*++
+
+Routine Description:
+
+This function collects the runs of the DUMP_HEADER.PhysicalMemoryBlock into
+a sorted extent set, tagged with the run index. Runs without pages are left
+out since they describe no memory.
+
+Arguments:
+
+Context - Dmp_CONTEXT, with MemoryDescriptors or MemoryDescriptors64 set.
+
+Runs - Receives the set, to be released with ExtentSetFree.
+
+Return Value:
+
+HRESULT
+
+--*/
+{
+    UINT64      basePage = 0;
+    UINT64      pageCount = 0;
+    UINT32      runCount = 0;
+    HRESULT     hr = S_OK;
+
+    ExtentSetInit(Runs);
+
+    runCount = (Context->Is64Bit) ? Context->MemoryDescriptors64->NumberOfRuns : Context->MemoryDescriptors->NumberOfRuns;
+
+    for (UINT32 index = 0; index < runCount; index++) {
+        if (Context->Is64Bit) {
+            basePage = Context->MemoryDescriptors64->Run[index].BasePage;
+            pageCount = Context->MemoryDescriptors64->Run[index].PageCount;
+        }
+        else {
+            basePage = Context->MemoryDescriptors->Run[index].BasePage;
+            pageCount = Context->MemoryDescriptors->Run[index].PageCount;
+        }
+
+        if (pageCount == 0) {
+            continue;
+        }
+
+        hr = ExtentSetAppend(Runs, PAGES_TO_BYTES(basePage), PAGES_TO_BYTES(pageCount), index);
+        if (FAILED(hr)) {
+            TraceInfo1("Memory run wraps the address space", "Index", index);
+            ExtentSetFree(Runs);
             goto Exit;
         }
+    }
 
-        if (index > 0)
-        {
-            previousEnd = Context->DDRMemoryMap[index - 1].End;
-            currentStart = Context->DDRMemoryMap[index].Base;
+    ExtentSetSort(Runs);
 
-            //
-            // Ideal layout is each new segment starts at the previous end + 1
-            // Anything else is a hole (harmless) or overlap (fatal)
-            //
-            if (previousEnd < currentStart - 1)
-            {
-                Context->DDRSectionFragmentationCount++;
-            }
-            else if (previousEnd >= currentStart)
-            {
-                Context->DDRSectionsOverlapCount++;
-            }
-            else
-            {
-                Context->DDRMemoryMap[index].Contiguous = TRUE;
-            }
+Exit:
+    return hr;
+}
+
+
+UINT32
+FindDDRMemoryMapIndex(
+    _In_ PDMP_CONTEXT Context,
+    _In_ UINT64 PhysicalAddress
+    )
+/*++
+
+Routine Description:
+
+This function finds the DDR memory map entry holding a physical address with
+a binary search. The map must be built by BuildDDRMemoryMap, sorted by base
+and without overlaps.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+PhysicalAddress - Physical address to look up.
+
+Return Value:
+
+Index of the entry, DDRMemoryMapCount if no entry holds the address.
+
+--*/
+{
+    UINT32      low = 0;
+    UINT32      high = Context->DDRMemoryMapCount;
+    UINT32      middle;
+
+    //
+    // Find the first entry with a base above the address, the entry before
+    // it is the only one that can hold the address.
+    //
+    while (low < high) {
+        middle = low + ((high - low) / 2);
+        if (Context->DDRMemoryMap[middle].Base <= PhysicalAddress) {
+            low = middle + 1;
         }
-        else
-        {
-            // The first section is contiguous by default
-            Context->DDRMemoryMap[index].Contiguous = TRUE;
+        else {
+            high = middle;
         }
     }
 
-    if (Context->DDRSectionFragmentationCount != 0)
-    {
-        LogLibInfoPrintf(L"Hole count %u in DDR Sections is harmless", Context->DDRSectionFragmentationCount);
+    if ((low == 0) || (Context->DDRMemoryMap[low - 1].End < PhysicalAddress)) {
+        return Context->DDRMemoryMapCount;
+    }
+
+    return low - 1;
+}
+
+
+NTSTATUS
+ValidateMemoryRunsInDDR(
+    _In_ PDMP_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+This function checks that each run of the DUMP_HEADER.PhysicalMemoryBlock is
+contained in contiguous DDR sections. The DDR sections are coalesced into
+contiguous ranges and the sorted runs are swept against them once.
+
+Arguments:
+
+Context - PDMP_CONTEXT, with MemoryDescriptors or MemoryDescriptors64 set.
+
+Return Value:
+
+NT status code.
+
+--*/
+{
+    EXTENT_SET      ddrExtents;
+    EXTENT_SET      contiguousDDR;
+    EXTENT_SET      runs;
+    PEXTENT         run = nullptr;
+    UINT32          indexRun = 0;
+    HRESULT         hr = S_OK;
+    NTSTATUS        status = STATUS_UNSUCCESSFUL;
+
+    ExtentSetInit(&ddrExtents);
+    ExtentSetInit(&contiguousDDR);
+    ExtentSetInit(&runs);
+
+    hr = BuildMemoryRunExtentSet(Context, &runs);
+    if (hr == E_INVALIDARG) {
+        status = STATUS_BAD_DATA;
+        goto Exit;
+    }
+    else if (SUCCEEDED(hr)) {
+        hr = BuildDDRExtentSet(Context, &ddrExtents);
+    }
+
+    if (SUCCEEDED(hr)) {
+        hr = ExtentSetCoalesce(&ddrExtents, &contiguousDDR);
     }
 
-    if (Context->DDRSectionsOverlapCount != 0)
-    {
-        LogLibInfoPrintf(L"Overlap count %u in DDR Sections is fatal", Context->DDRSectionsOverlapCount);
+    if (FAILED(hr)) {
+        status = STATUS_NO_MEMORY;
+        TraceHRESULT("Failed to build extent sets", hr);
+        goto Exit;
+    }
+
+    indexRun = ExtentSetContains(&contiguousDDR, &runs);
+    if (indexRun < runs.Count) {
+        run = &runs.Extents[indexRun];
+
+        if (FindDDRMemoryMapIndex(Context, run->Base) == Context->DDRMemoryMapCount) {
+            TraceInfo2("Start of run does not fall into any DDR section",
+                       "Base Addr", run->Base, "IndexPD", run->Tag);
+        }
+        else {
+            TraceInfo2("Run is not contained in contiguous DDR sections",
+                       "EndPD", run->End, "IndexPD", run->Tag);
+        }
+
+        status = STATUS_BAD_DATA;
         goto Exit;
     }
 
+    TraceInfo1("All descriptors checked out", "Count", runs.Count);
     status = STATUS_SUCCESS;
+
 Exit:
+    ExtentSetFree(&runs);
+    ExtentSetFree(&contiguousDDR);
+    ExtentSetFree(&ddrExtents);
     return status;
 }
 
@@ -872,19 +1504,10 @@ NT status code.
 
 --*/
 {
-    PDDR_MEMORY_MAP               ddrMemoryMap = nullptr;
-    UINT64                        endPD;
-    UINT32                        indexDDR;
-    UINT32                        indexPD;
-    UINT64                        startPD;
-    UINT32                        spanCount;
     UINT32                        memorySizeFromPD = 0;
     PPHYSICAL_MEMORY_DESCRIPTOR32 physDesc = nullptr;
     NTSTATUS                      status = STATUS_UNSUCCESSFUL;
-    BOOLEAN                       startInSection;
-    BOOLEAN                       endInSection;
 
-    ddrMemoryMap = Context->DDRMemoryMap;
     physDesc = &(Context->DumpHeader32->PhysicalMemoryBlock);
 
     memorySizeFromPD = PAGES_TO_BYTES(physDesc->NumberOfPages);
@@ -898,77 +1521,7 @@ NT status code.
         goto Exit;
     }
 
-    for (indexPD = 0; indexPD < physDesc->NumberOfRuns; indexPD++) {
-        startPD = (UINT64)(physDesc->Run[indexPD].BasePage * PAGE_SIZE);
-        endPD = startPD + (UINT64)(physDesc->Run[indexPD].PageCount * PAGE_SIZE) - 1;
-        spanCount = 0;
-        startInSection = FALSE;
-        endInSection = FALSE;
-
-        TraceInfo1("Looking at descriptor", "Index", indexPD);
-
-        for (indexDDR = 0; indexDDR < Context->DDRSectionCount; indexDDR++) {
-            if ((spanCount > 0) && (!ddrMemoryMap[indexDDR].Contiguous)) {
-                //
-                // We got a problem. We got a run that spans 
-                // DDR sections but we are hitting a DDR section 
-                // which don't have memory that's contiguous with 
-                // previous. 
-                //
-                TraceInfo("Error verifying memory run. Run is spanning discontiguous DDR sections.\n");
-                TraceInfo1("Run Index", "Index", indexPD);
-                TraceInfo1("DDR Index", "Index", indexDDR);
-                TraceInfo1("Previous DDR Index", "Index", (indexDDR - 1));
-
-                status = STATUS_BAD_DATA;
-                goto Exit;
-            }
-
-            //
-            // Is startPD in this DDR section?
-            //
-            if ((startPD >= ddrMemoryMap[indexDDR].Base) && (startPD <= ddrMemoryMap[indexDDR].End)) {
-                startInSection = TRUE;
-                //
-                // Does endPD also fall into this section?
-                //
-                if ((endPD >= ddrMemoryMap[indexDDR].Base) && (endPD <= ddrMemoryMap[indexDDR].End)) {
-                    //
-                    // Range is within this section. 
-                    //
-                    endInSection = TRUE;
-                    break;
-                } else {
-                    //
-                    // Range is not contained in this section. 
-                    // Move startPD to the end plus 1. 
-                    //
-                    startPD = ddrMemoryMap[indexDDR].End + 1;
-                    spanCount++;
-                }
-            }
-        } //indexDDR
-
-        //
-        // Check if the start or the end of a run fell within any DDR section.
-        //
-        if (!startInSection) {
-            TraceInfo2("Start of run does not fall into any DDR section",
-                       "Base Addr", (UINT64)(physDesc->Run[indexPD].BasePage * PAGE_SIZE), "IndexPD", indexPD);
-            status = STATUS_BAD_DATA;
-            goto Exit;
-        }
-
-        if (!endInSection) {
-            TraceInfo2("The end of a run does not fall into any DDR section", "EndPD", endPD, "IndexPD", indexPD);
-            status = STATUS_BAD_DATA;
-            goto Exit;
-        }
-
-        TraceInfo1("Descriptor checked out", "Index", indexPD);
-    }//indexPD
-
-    status = STATUS_SUCCESS;
+    status = ValidateMemoryRunsInDDR(Context);
 
 Exit:
     return HRESULT_FROM_NT(status);
@@ -984,6 +1537,7 @@ InitDumpFile(
     DWORD            flag = 0;
     HRESULT          hr = E_FAIL;
     Context->WindowsDumpHandle = INVALID_HANDLE_VALUE;
+    Context->WindowsDumpDirectHandle = INVALID_HANDLE_VALUE;
 
     fileoffset.QuadPart = 0;
     flag = FILE_ATTRIBUTE_NORMAL;
@@ -1005,6 +1559,25 @@ InitDumpFile(
         goto Exit;
     }
 
+    //
+    // The DDR pages are most of the dump and are written once, keep them out
+    // of the file cache so a conversion does not evict everything else on the
+    // host. The cached handle is used if the volume refuses this one.
+    //
+    Context->WindowsDumpDirectHandle = CreateFileW(
+                                          Context->WindowsDumpFilePath,
+                                          GENERIC_WRITE,
+                                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                          nullptr,
+                                          OPEN_EXISTING,
+                                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
+                                          nullptr
+                                          );
+
+    if (Context->WindowsDumpDirectHandle == INVALID_HANDLE_VALUE) {
+        TraceInfo1("Unbuffered DDR writes not available", "Error", GetLastError());
+    }
+
     Context->SecondaryDataBlobCount = Context->CPUContextSectionCount + 
                                       Context->SVSectionCount + 
                                       1 +  //memory map 
@@ -1035,6 +1608,40 @@ Exit:
 }
 
 
+HANDLE
+GetDDRWriteHandle(
+    _In_ PDMP_CONTEXT Context,
+    _In_ LARGE_INTEGER FileOffset
+    )
+/*++
+
+Routine Description:
+
+This function picks the handle DDR pages are written with. The unbuffered
+handle needs page aligned offsets, sizes and buffers, the DDR writers use
+pooled buffers and whole pages, so only the offset is checked here.
+
+Arguments:
+
+Context - Pointer to the global context structure, with the dump file open.
+
+FileOffset - Offset in the dump file the DDR pages start at.
+
+Return Value:
+
+Handle to write with. Writes on Context->WindowsDumpHandle still need a flush.
+
+--*/
+{
+    if ((Context->WindowsDumpDirectHandle != INVALID_HANDLE_VALUE) &&
+        ((FileOffset.QuadPart & (PAGE_SIZE - 1)) == 0)) {
+        return Context->WindowsDumpDirectHandle;
+    }
+
+    return Context->WindowsDumpHandle;
+}
+
+
 HRESULT WriteDumpHeader(_Inout_ PDMP_CONTEXT Context)
 /*++
 
@@ -1140,17 +1747,25 @@ HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context)
     LARGE_INTEGER                   runSize;
     LARGE_INTEGER                   startPA;
     ULONG                           ioSize = 0;
-    ULONG                           buffersize = DEFAULT_DMP_BUF_SZ;
+    UINT32                          buffersize = 0;
     NTSTATUS                        status = STATUS_UNSUCCESSFUL;
     PVOID                           tempBuffer = nullptr;
     IO_STATUS_BLOCK                 statusBlock;
+    HANDLE                          ddrHandle;
 
+    //
+    // When stitching a sharded conversion, the shards have written DDR.
+    //
+    if (Context->ShardMode == ConversionShardStitch) {
+        return CheckDumpShards(Context);
+    }
 
     //
     // Allocate the intermediate buffer to read memory from DDR section
-    // to the dump file.
+    // to the dump file, smaller than DEFAULT_DMP_BUF_SZ if the memory budget
+    // is short.
     //
-    tempBuffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buffersize);
+    AllocatePooledBuffer(Context, DEFAULT_DMP_BUF_SZ, PAGE_SIZE, &tempBuffer, &buffersize);
     if (tempBuffer == nullptr) {
         TraceNTSTATUS("Unable to allocate 0x%x bytes buffer for writing DDR memory to dump.\n", PAGE_SIZE);
         status = STATUS_NO_MEMORY;
@@ -1158,6 +1773,7 @@ HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context)
     }
 
     ZeroMemory(tempBuffer, buffersize);
+    ddrHandle = GetDDRWriteHandle(Context, Context->WindowsDumpFileOffset);
 
     for (index = 0; index < Context->DumpHeader32->PhysicalMemoryBlock.NumberOfRuns; index++)  {
 
@@ -1188,8 +1804,10 @@ HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context)
                 goto Exit;
             }
 
+            AddPagesToFingerprint(Context, startPA.QuadPart, tempBuffer, ioSize, PAGE_FINGERPRINT_REGION_OS);
+
             status = NtWriteFile(
-                         Context->WindowsDumpHandle,
+                         ddrHandle,
                          nullptr,
                          nullptr,
                          nullptr,
@@ -1204,11 +1822,17 @@ HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context)
                 goto Exit;
 
             }
-            NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+            if (ddrHandle == Context->WindowsDumpHandle) {
+                NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
+            }
             bytesWritten.QuadPart += ioSize;
             Context->WindowsDumpFileOffset.QuadPart += ioSize;
             PageRemain -= ioSize / PAGE_SIZE;
-            TraceInfo2("Memory Run", "Index", index, "Pages remaining", PageRemain);
+            TraceInfoBinary2("Memory Run", "Index", index, "Pages remaining", PageRemain);
+            ReportConversionProgress(Context,
+                                     "Writing DDR section to the dump file",
+                                     bytesWritten.QuadPart,
+                                     (UINT64)Context->DumpHeader32->PhysicalMemoryBlock.NumberOfPages * PAGE_SIZE);
         }// for io
 
 #ifdef VERBOSE
@@ -1227,14 +1851,149 @@ HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context)
 
 Exit:
 
-    if (tempBuffer != nullptr) {
-        HeapFree(GetProcessHeap(), NULL, tempBuffer);
-        tempBuffer = nullptr;
-    }
+    FreePooledBuffer(Context, tempBuffer, buffersize);
 
     return HRESULT_FROM_NT(status);
 }
 
+
+VOID AddPagesToFingerprint(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ UINT64 PhysicalAddress,
+    _In_reads_bytes_(Size) PVOID Buffer,
+    _In_ UINT32 Size,
+    _In_ PAGE_FINGERPRINT_REGION Region
+    )
+/*++
+
+    Routine Description:
+
+    This function hashes the pages of memory just read for the dump file into
+    Context->PageFingerprint. A partial page at the end of Buffer is left out.
+    The first failure is logged and drops the fingerprint for this conversion,
+    as does growing the fingerprint beyond the memory budget.
+
+    Arguments:
+
+        Context - Pointer to the global context structure.
+
+        PhysicalAddress - Physical address of the first byte of Buffer.
+
+        Buffer - Memory read from the raw dump.
+
+        Size - Size of Buffer in bytes.
+
+        Region - Whether the memory belongs to the OS or is carved out from it.
+
+    Return Value:
+
+        None.
+
+--*/
+{
+    HRESULT hr = S_OK;
+    UINT64  charge = 0;
+
+    if (Context->PageFingerprintFailed) {
+        return;
+    }
+
+    hr = PageFingerprintAddPages(
+             &Context->PageFingerprint,
+             PhysicalAddress,
+             Buffer,
+             Size & ~(PAGE_FINGERPRINT_PAGE_SIZE - 1),
+             Region
+             );
+    if (FAILED(hr)) {
+        TraceHRESULT("PageFingerprintAddPages failed, no fingerprint will be written", hr);
+        goto Drop;
+    }
+
+    charge = (Context->PageFingerprint.HashCapacity * sizeof(UINT64)) +
+             ((UINT64)Context->PageFingerprint.RunCapacity * sizeof(PAGE_FINGERPRINT_RUN));
+    if (charge > Context->PageFingerprintCharge) {
+        hr = ChargeMemoryBudget(Context, charge - Context->PageFingerprintCharge, FALSE);
+        if (FAILED(hr)) {
+            TraceHRESULT("Page fingerprint exceeds the memory budget, no fingerprint will be written", hr);
+            goto Drop;
+        }
+
+        Context->PageFingerprintCharge = charge;
+    }
+
+    return;
+
+Drop:
+    PageFingerprintFree(&Context->PageFingerprint);
+    ReturnMemoryBudget(Context, Context->PageFingerprintCharge);
+    Context->PageFingerprintCharge = 0;
+    Context->PageFingerprintFailed = TRUE;
+}
+
+
+HRESULT WritePageFingerprint(_Inout_ PDMP_CONTEXT Context)
+/*++
+
+    Routine Description:
+
+    This function saves the page hashes collected while writing the dump next
+    to the dump file, as <dump file>.pfp, for dmpfingerprint to compare dumps
+    with. Failing to do so does not fail the conversion.
+
+    Arguments:
+
+        Context - Pointer to the global context structure.
+
+    Return Value:
+
+        HRESULT, S_OK when there is no fingerprint to write.
+
+--*/
+{
+    HRESULT hr = S_OK;
+    LPWSTR  path = nullptr;
+    size_t  pathLength = 0;
+
+    if (Context->PageFingerprintFailed || (Context->PageFingerprint.PageCount == 0)) {
+        goto Exit;
+    }
+
+    pathLength = wcslen(Context->WindowsDumpFilePath) + ARRAYSIZE(PAGE_FINGERPRINT_FILE_EXTENSION);
+    path = (LPWSTR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, pathLength * sizeof(WCHAR));
+    if (path == nullptr) {
+        hr = E_OUTOFMEMORY;
+        TraceHRESULT("Unable to allocate the fingerprint path", hr);
+        goto Exit;
+    }
+
+    hr = StringCchPrintfW(path, pathLength, L"%s%s", Context->WindowsDumpFilePath, PAGE_FINGERPRINT_FILE_EXTENSION);
+    if (FAILED(hr)) {
+        TraceHRESULT("StringCchPrintfW failed", hr);
+        goto Exit;
+    }
+
+    hr = PageFingerprintWrite(&Context->PageFingerprint, path);
+    if (FAILED(hr)) {
+        TraceHRESULT("PageFingerprintWrite failed", hr);
+        goto Exit;
+    }
+
+    TraceInfo2("Page fingerprint written", "Pages", Context->PageFingerprint.PageCount, "Runs", Context->PageFingerprint.RunCount);
+
+Exit:
+
+    if (path != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, path);
+    }
+
+    PageFingerprintFree(&Context->PageFingerprint);
+    ReturnMemoryBudget(Context, Context->PageFingerprintCharge);
+    Context->PageFingerprintCharge = 0;
+
+    return hr;
+}
+
 NTSTATUS
 ReadFromDDRSectionByPhysicalAddress(
     _In_ PDMP_CONTEXT Context,
@@ -1288,9 +2047,10 @@ NT status code.
     temp = Buffer;
 
     //
-    // Determine the right section.
+    // Determine the right section, then move on to the next ones if the
+    // read spans sections.
     //
-    for (index = 0; index < ddrSectionsCount; index++) {
+    for (index = FindDDRMemoryMapIndex(Context, addressStart); index < ddrSectionsCount; index++) {
         sectionStart = ddrMap[index].Base;
         sectionEnd = ddrMap[index].End;
 
@@ -1325,14 +2085,7 @@ NT status code.
             TraceInfo2("Reading 0x%x bytes at offset 0x%I64x\n", bytesToRead, offset.QuadPart);
 #endif
             status = STATUS_UNSUCCESSFUL;
-            if (FAILED(Context->hRawFile.SetPos(offset)))
-            {
-#ifdef VERBOSE
-                TraceInfo("Failed to set position for disk read ", "Result");
-#endif
-                goto Exit;
-            }
-            else if (FAILED(Context->hRawFile.Read((PCHAR)temp, bytesToRead, &bytesProcessed)))
+            if (FAILED(ReadRawDumpFile(Context, offset, temp, bytesToRead, &bytesProcessed)))
             {
 #ifdef VERBOSE
                 TraceInfo("Failed to read disk", "Result");
@@ -1364,7 +2117,7 @@ NT status code.
                 // Time to move to next section.
                 // Update temp.
                 //
-                Buffer = (PVOID)((UINT32)(Buffer)+bytesToRead);
+                temp = (PVOID)((PUCHAR)temp + bytesToRead);
 
                 //
                 // Update addressStart.
@@ -1398,6 +2151,91 @@ Exit:
     return status;
 }
 
+HRESULT
+ReadFromDDRSectionBatch(
+    _In_ PDMP_CONTEXT Context,
+    _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+    _In_ UINT32 RequestCount
+    )
+/*++
+
+Routine Description:
+
+This function reads a list of physical address ranges from the DDR sections.
+Requests that are close to each other are fetched with a single read, see
+ReadPhysicalBatch. Use it instead of several ReadFromDDRSectionByPhysicalAddress
+calls when the addresses are known up front. Reads are serialized with the
+other reads of the raw dump while RunConversionPhases runs phases in parallel.
+
+Arguments:
+
+Context - Dmp_CONTEXT
+
+Requests - (PA, length, buffer) requests. Each Result is updated.
+
+RequestCount - Number of requests.
+
+Return Value:
+
+HRESULT of the first failing request, S_OK if all were read.
+
+--*/
+{
+    HRESULT             hr = S_OK;
+    PPHYSICAL_EXTENT    extents = nullptr;
+    UINT32              index;
+
+    if (Context->ChunkedSectionCount != 0) {
+        //
+        // Chunked sections are not contiguous in the file, read each request
+        // on its own. The chunk cache keeps nearby requests cheap.
+        //
+        for (index = 0; index < RequestCount; index++) {
+            LARGE_INTEGER physicalAddress;
+
+            physicalAddress.QuadPart = Requests[index].PhysicalAddress;
+            Requests[index].Result = HRESULT_FROM_NT(ReadFromDDRSectionByPhysicalAddress(Context,
+                                                                                         physicalAddress,
+                                                                                         Requests[index].Length,
+                                                                                         Requests[index].Buffer));
+            if (FAILED(Requests[index].Result) && SUCCEEDED(hr)) {
+                hr = Requests[index].Result;
+            }
+        }
+
+        goto Exit;
+    }
+
+    extents = (PPHYSICAL_EXTENT)HeapAlloc(GetProcessHeap(),
+                                          HEAP_ZERO_MEMORY,
+                                          (Context->DDRMemoryMapCount + 1) * sizeof(PHYSICAL_EXTENT));
+    if (extents == nullptr) {
+        hr = HRESULT_FROM_NT(STATUS_NO_MEMORY);
+        TraceHRESULT("Failed to allocate extents for batch read", hr);
+        goto Exit;
+    }
+
+    for (index = 0; index < Context->DDRMemoryMapCount; index++) {
+        extents[index].Base = Context->DDRMemoryMap[index].Base;
+        extents[index].Size = Context->DDRMemoryMap[index].Size;
+        extents[index].FileOffset = Context->fileOffset.QuadPart + Context->DDRMemoryMap[index].Offset;
+    }
+
+    hr = ReadPhysicalBatch(&Context->hRawFile,
+                           Context->RawDumpLockInitialized ? &Context->RawDumpLock : nullptr,
+                           extents,
+                           Context->DDRMemoryMapCount,
+                           Requests,
+                           RequestCount);
+
+Exit:
+    if (extents != nullptr) {
+        HeapFree(GetProcessHeap(), NULL, extents);
+    }
+
+    return hr;
+}
+
 NTSTATUS
 GetKdDebuggerBlockFromInMemAddresses(
 _Inout_ PDMP_CONTEXT Context,
@@ -1666,9 +2504,17 @@ ReadFromDDRSectionByVirtualAddress(
     NTSTATUS status;
     ULONG64 PA64;
     HRESULT hr;
-    UNREFERENCED_PARAMETER(Context);
+    IDebugDataSpaces2 *DebugDataSpaces = nullptr;
 
-    IDebugDataSpaces2 *DebugDataSpaces = DbgClient::GetDataSpaces();
+    //
+    // With a cached kernel profile dbgeng is not opened, see LookupKernelProfile.
+    //
+    if (Context->KernelProfileHit) {
+        status = ReadVirtualByPageWalk(Context, VirtualAddress, (UINT32)Length, Buffer, PhysicalAddress);
+        goto Exit;
+    }
+
+    DebugDataSpaces = DbgClient::GetDataSpaces();
     if (DebugDataSpaces == nullptr) {
         LogLibInfoPrintf(L"Failure in dbgeng, KdDebuggerDataBlock may be unreadable");
         status = STATUS_UNSUCCESSFUL;
@@ -2074,8 +2920,7 @@ UpdateContextX86(
 
             RtlZeroMemory(x86Context, dataSize);
             curoffset.QuadPart = Context->fileOffset.QuadPart + Context->CPUContextAddress.QuadPart + indexProcessor*dataSize;
-            if ( FAILED(hr = Context->hRawFile.SetPos(curoffset))
-                 || FAILED(hr = Context->hRawFile.Read((PCHAR)x86Context, dataSize, &bytesProcessed))
+            if ( FAILED(hr = ReadRawDumpFile(Context, curoffset, x86Context, dataSize, &bytesProcessed))
                  || (0 == bytesProcessed)
                )
             {
@@ -2119,15 +2964,6 @@ Exit:
     return status;
 }
 
-// JFP - ARM64
-typedef struct _GenericPhysicalDecriptor_ 
-{
-    ULONG   NumberOfRuns;
-    ULONG64 NumberOfPages;
-    PVOID   pRun;
-} PHYS_DESCRIPTOR, *pPHYS_DESCRIPTOR;
-
-
 NTSTATUS
 WriteToDumpByPhysicalAddress(
     _Inout_ PDMP_CONTEXT Context,
@@ -2139,18 +2975,17 @@ WriteToDumpByPhysicalAddress(
 
     Routine Description:
 
-    This function reads and writes to the dedicated dump file based on physical address.
+    This function writes to the dedicated dump file based on physical address.
 
-    Important assumption is that the physical memory descriptors are not contiguous and that
-    all pages should be contained in one run.
+    The write is queued with QueueDumpPatch and reaches the dump file when
+    ApplyDumpPatches runs at the end of the conversion. The memory must be
+    contained in one run of the DUMP_HEADER.PhysicalMemoryBlock.
 
     Arguments:
 
     Context - Pointer to PDMP_CONTEXT
 
-    IsWrite - Boolean. TRUE for write. FALSE for read.
-
-    PhysicalAddress - The base physical address of memory to be read from or written to in the
+    PhysicalAddress - The base physical address of memory to be written to in the
                         dedicated dump file.
 
     Size - Size of buffer in bytes to write.
@@ -2163,112 +2998,28 @@ WriteToDumpByPhysicalAddress(
 
 --*/
 {
-    UNREFERENCED_PARAMETER(Buffer);
-
-    BOOLEAN                         foundDescriptor = FALSE;
-    LARGE_INTEGER                   endPA;
-    LARGE_INTEGER                   endPD;
-    UINT32                          indexPD = 0;
-    LARGE_INTEGER                   ioOffset;
-    LARGE_INTEGER                   lengthPD;
-    LARGE_INTEGER                   offset;
-    PHYS_DESCRIPTOR                 physDesc = { 0 };
-    LARGE_INTEGER                   startPA;
-    LARGE_INTEGER                   startPD;
+    UINT64                          fileOffset = 0;
     NTSTATUS                        status = STATUS_UNSUCCESSFUL;
-    IO_STATUS_BLOCK                 statusBlock;
-
-    endPA.QuadPart = 0;
-    endPD.QuadPart = 0;
-    startPA.QuadPart = 0;
-    startPD.QuadPart = 0;
-    ioOffset.QuadPart = 0;
-    offset.QuadPart = 0;
-    lengthPD.QuadPart = 0;
-
-    physDesc.NumberOfRuns = (Context->Is64Bit ? Context->DumpHeader64->PhysicalMemoryBlock.NumberOfRuns : Context->DumpHeader32->PhysicalMemoryBlock.NumberOfRuns);
-    physDesc.NumberOfPages = (Context->Is64Bit ? Context->DumpHeader64->PhysicalMemoryBlock.NumberOfPages : Context->DumpHeader32->PhysicalMemoryBlock.NumberOfPages);
-    physDesc.pRun = (Context->Is64Bit ? (PVOID)&Context->DumpHeader64->PhysicalMemoryBlock.Run[0] : (PVOID)&Context->DumpHeader32->PhysicalMemoryBlock.Run[0]);
-
-    startPA.QuadPart = PhysicalAddress.QuadPart;
-    endPA.QuadPart = startPA.QuadPart + Size - 1;
-
-    TraceInfo2("Looking up physical memory descriptor", "Start PA", startPA.QuadPart, "End PA", endPA.QuadPart);
 
-    //
-    // Look for the descriptor containing the memory
-    //
-    for (indexPD = 0; indexPD < physDesc.NumberOfRuns; indexPD++) {
-        if (Context->Is64Bit)
-        {
-            PPHYSICAL_MEMORY_RUN64 tmp = (PPHYSICAL_MEMORY_RUN64)physDesc.pRun;
-            startPD.QuadPart = tmp[indexPD].BasePage * PAGE_SIZE;
-            lengthPD.QuadPart = tmp[indexPD].PageCount * PAGE_SIZE;
-        }
-        else
-        {
-            PPHYSICAL_MEMORY_RUN32 tmp = (PPHYSICAL_MEMORY_RUN32)physDesc.pRun;
-            startPD.QuadPart = tmp[indexPD].BasePage * PAGE_SIZE;
-            lengthPD.QuadPart = tmp[indexPD].PageCount * PAGE_SIZE;
-        }
-
-        endPD.QuadPart = startPD.QuadPart + lengthPD.QuadPart - 1;
-
-        if ((startPA.QuadPart >= startPD.QuadPart) &&
-            (endPD.QuadPart >= endPA.QuadPart)) {
-            foundDescriptor = TRUE;
-#ifdef VERBOSE_MSGS
-            wprintf(L"Descriptor %u contains the memory. Base: 0x%I64x End:0x%I64x Offset: 0x%I64x\n",
-                indexPD,
-                startPD.QuadPart,
-                endPD.QuadPart,
-                offset.QuadPart);
-#endif
-            break;
-        }
-
-        offset.QuadPart += lengthPD.QuadPart;
-    }
-
-    if (!foundDescriptor) {
-        status = STATUS_INVALID_PARAMETER;
+    status = LookupDumpFileOffset(Context, PhysicalAddress.QuadPart, Size, &fileOffset);
+    if (!NT_SUCCESS(status)) {
+        TraceInfo2("Looking up physical memory descriptor", "Start PA", PhysicalAddress.QuadPart, "Size", Size);
         TraceNTSTATUS("Failed to locate physical memory descriptor", status);
         goto Exit;
     }
 
-    //
-    // Now that we got the memory descriptor, calculate the offset and
-    // perform the IO.
-    //
-    ioOffset.QuadPart = (startPA.QuadPart - startPD.QuadPart) + offset.QuadPart + Context->DDRFileOffset.QuadPart;
-
-#ifdef VERBOSE_MSGS
-    wprintf(L"IO offset is: 0x%I64x\n", ioOffset.QuadPart);
-#endif
-
-    status = NtWriteFile(
-                 Context->WindowsDumpHandle,
-                 nullptr,
-                 nullptr,
-                 nullptr,
-                 &statusBlock,
-                 Buffer,
-                 Size,
-                 &ioOffset,
-                 nullptr
-                 );
-    if (FAILED(status)) {
+#ifdef VERBOSE_MSGS
+    wprintf(L"IO offset is: 0x%I64x\n", fileOffset);
+#endif
+
+    if (FAILED(QueueDumpPatch(Context, fileOffset, Buffer, Size))) {
+        status = STATUS_NO_MEMORY;
         TraceNTSTATUS("Failed to write to dump file", status);
         goto Exit;
     }
 
-    NtFlushBuffersFile(Context->WindowsDumpHandle, &statusBlock);
     status = STATUS_SUCCESS;
 
-#ifdef VERBOSE_MSGS
-    wprintf(L"Context: 0x%I64x\n", (Context->Is64Bit ? (PVOID)&(Context->DumpHeader64->PhysicalMemoryBlock) : (PVOID)&(Context->DumpHeader32->PhysicalMemoryBlock)));
-#endif
-
 Exit:
     return status;
 }
@@ -2301,7 +3052,7 @@ NT status code.
     {
         if (Context->RawDumpSectionTable[idx].Type == RAW_DUMP_SECTION_TYPE_CPU_CONTEXT)
         {
-            Context->CPUContextAddress.QuadPart = Context->RawDumpSectionTable[idx].Offset;
+            Context->CPUContextAddress.QuadPart = GetRawDumpSectionOffset(Context, idx);
             Context->TotalCpuContextSizeInBytes = Context->RawDumpSectionTable[idx].Size;
             status = STATUS_SUCCESS;
         }
@@ -2672,7 +3423,7 @@ NT status code.
         goto Exit;
     }
 
-    PhysicalAddress->QuadPart = (pte & ARM64_VALID_PFN_MASK) + (VirtualAddress & ARM64_VALID_PFN_MASK);
+    PhysicalAddress->QuadPart = (pte & ARM64_VALID_PFN_MASK) + (VirtualAddress & (PAGE_SIZE - 1));
     LogLibInfoPrintf(L"Virtual address= 0x%llx  decoded physical address= 0x%llx \r\n", VirtualAddress, PhysicalAddress->QuadPart);
     status = STATUS_SUCCESS;
 Exit:
@@ -2683,15 +3434,83 @@ Exit:
 }
 
 
-HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
+template <class Layout>
+BOOL IsValidDumpHeader(
+    _In_ const STRUCT_VIEW<Layout> &Header,
+    _Out_ PULONGLONG DumpInstance
+    )
+/*++
+
+    Routine Description:
+
+    This function checks the fields of a DUMP_HEADER32 or DUMP_HEADER64 that
+    do not depend on the dump being 32 or 64 bit, once the layout is known.
+
+    1. DUMP_HEADER.BugCheckCode
+    2. DUMP_HEADER.DumpType
+    3. DUMP_HEADER.RequiredDumpSpace
+
+    Arguments:
+
+        Header - View of the header.
+
+        DumpInstance - Receives the instance ID stored in DUMP_HEADER.Comment.
+
+    Return Value:
+
+        TRUE if the header is valid.
+
+--*/
+{
+    *DumpInstance = VIEW_GET(Header, Layout, Comment);
+
+    //
+    // Check bugcheck code.
+    //
+    if (VIEW_GET(Header, Layout, BugCheckCode) != FATAL_ABNORMAL_RESET_ERROR) {
+        TraceExpectedActual("Invalid DUMP_HEADER.BugCheckCode",
+                            FATAL_ABNORMAL_RESET_ERROR, VIEW_GET(Header, Layout, BugCheckCode));
+        return FALSE;
+    }
+
+    //
+    // Check dump type
+    //
+    if (VIEW_GET(Header, Layout, DumpType) != DUMP_TYPE_FULL) {
+        TraceExpectedActual("Invalid DUMP_HEADER.DumpType",
+            (ULONG)DUMP_TYPE_FULL, VIEW_GET(Header, Layout, DumpType));
+        return FALSE;
+    }
+
+    //
+    // Check RequiredDumpSpace
+    //
+    if (VIEW_GET(Header, Layout, RequiredDumpSpace) != DUMP_SIGNATURE) {
+        TraceExpectedActual("Invalid DUMP_HEADER.RequiredDumpSpace.LowPart",
+                            DUMP_SIGNATURE, VIEW_GET(Header, Layout, RequiredDumpSpace));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+HRESULT ValidateDumpHeaderAtPA(
+    _Inout_ PDMP_CONTEXT Context,
+    _In_ LARGE_INTEGER DumpHeaderPA,
+    _Out_writes_bytes_(sizeof(DUMP_HEADER64)) PUCHAR DumpHeader
+    )
 /*++
 
     Routine Description:
 
-    This function searches DDR sections for the in-memory dump data built by
-    nt!IopInitializeInMemoryDumpData. This is accomplished by searching for the
-    InMemoryDumpHeaderMagicString at page intervals. DUMP_HEADER.ValidDump values
-    determines if the dump is 32 bit or a 64 bit format.
+    This function reads a candidate DUMP_HEADER at the given physical address
+    and validates it. DUMP_HEADER.ValidDump determines if the dump is 32 bit
+    or 64 bit format and Context->Is64Bit is updated accordingly.
+
+    The first sizeof(DUMP_HEADER32) bytes are read and, for a 64 bit dump,
+    only the remainder of the DUMP_HEADER64 is read after them. The fields are
+    read in place through a STRUCT_VIEW of the matching layout.
 
     The following items are checked.
     1. DUMP_HEADER.Signature
@@ -2701,6 +3520,123 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
     5. DUMP_HEADER.RequiredDumpSpace
     6. Instance ID matches.
 
+    Arguments:
+
+        Context - DMP_CONTEXT
+
+        DumpHeaderPA - Physical address of the candidate header.
+
+        DumpHeader - Receives the header, a DUMP_HEADER64 if Context->Is64Bit
+                     is set on return, otherwise a DUMP_HEADER32.
+
+    Return Value:
+
+        S_OK if the header is valid, S_FALSE if it is not, otherwise the
+        error reading DDR.
+
+--*/
+{
+    HRESULT         hr;
+    LARGE_INTEGER   remainderPA;
+    ULONGLONG       dumpInstance = 0;
+    BOOL            isValid = FALSE;
+
+    STRUCT_VIEW<DUMP_HEADER32_LAYOUT>   header32(DumpHeader, sizeof(DUMP_HEADER32));
+    STRUCT_VIEW<DUMP_HEADER64_LAYOUT>   header64(DumpHeader, sizeof(DUMP_HEADER64));
+
+    Context->Is64Bit = FALSE;
+
+    if (FAILED(hr = HRESULT_FROM_NT(ReadFromDDRSectionByPhysicalAddress(Context, DumpHeaderPA, sizeof(DUMP_HEADER32), DumpHeader))))
+    {
+        TraceHRESULT("ReadFromDDRSectionByPhysicalAddress failed", hr);
+        goto Exit;
+    }
+
+    hr = S_FALSE;
+
+    //
+    // Check signature. Signatures for 64 bit and 32 bit are the same.
+    //
+    if (VIEW_GET(header32, DUMP_HEADER32_LAYOUT, Signature) != DUMP_SIGNATURE32) {
+        TraceExpectedActual("Invalid DUMP_HEADER.Signature",
+                            DUMP_SIGNATURE32, VIEW_GET(header32, DUMP_HEADER32_LAYOUT, Signature));
+        goto Exit;
+    }
+
+    //
+    // Check valid dump value. This where we would see a difference between 32 bit and 64 bit header.
+    //
+    if (VIEW_GET(header32, DUMP_HEADER32_LAYOUT, ValidDump) == DUMP_VALID_DUMP64) {
+        Context->Is64Bit = TRUE;
+
+        //
+        // This dump has come from a 64 bit machine, read the rest of the
+        // DUMP_HEADER64 after the bytes already read.
+        //
+        remainderPA.QuadPart = DumpHeaderPA.QuadPart + sizeof(DUMP_HEADER32);
+        if (FAILED(hr = HRESULT_FROM_NT(ReadFromDDRSectionByPhysicalAddress(Context,
+                                                                            remainderPA,
+                                                                            sizeof(DUMP_HEADER64) - sizeof(DUMP_HEADER32),
+                                                                            DumpHeader + sizeof(DUMP_HEADER32)))))
+        {
+            TraceHRESULT("ReadFromDDRSectionByPhysicalAddress failed", hr);
+            goto Exit;
+        }
+
+        hr = S_FALSE;
+        isValid = IsValidDumpHeader(header64, &dumpInstance);
+    }
+    else if (VIEW_GET(header32, DUMP_HEADER32_LAYOUT, ValidDump) == DUMP_VALID_DUMP32) {
+        //
+        // This dump has come from a 32 bit machine.
+        //
+        isValid = IsValidDumpHeader(header32, &dumpInstance);
+    }
+    else {
+        //
+        // Invalid dump header. 
+        //
+        TraceExpectedActual("Invalid DUMP_HEADER.ValidDump",
+                            DUMP_VALID_DUMP32, VIEW_GET(header32, DUMP_HEADER32_LAYOUT, ValidDump));
+        goto Exit;
+    }
+
+    if (!isValid) {
+        goto Exit;
+    }
+
+    TraceInfo1("Expected dump instance", "Instance", Context->DumpInstance.QuadPart);
+
+    if (Context->DumpInstance.QuadPart != dumpInstance) {
+        TraceExpectedActual("Instance ID does not match",
+                            Context->DumpInstance.QuadPart,
+                            dumpInstance);
+        goto Exit;
+    }
+
+    hr = S_OK;
+
+Exit:
+    return hr;
+}
+
+
+HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
+/*++
+
+    Routine Description:
+
+    This function locates the in-memory dump data built by
+    nt!IopInitializeInMemoryDumpData and validates its DUMP_HEADER.
+
+    OffDmpSvc records where it expects the header to be (DEVICE_SPECIFIC_INFO
+    version 2 or the DumpHeader PA attribute in the info XML). For older info,
+    the same address is derived from the in-memory data PA, since the header
+    directly follows the head sentinel. That address is tried first.
+
+    If there is no hint or the header there fails validation, the DDR sections
+    are searched for the InMemoryDumpHeaderMagicString at page intervals.
+
     Arguments:
 
         Context - DMP_CONTEXT
@@ -2712,42 +3648,32 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
 --*/
 {
     HRESULT         hr = HRESULT_FROM_NT(STATUS_NOT_FOUND);
-    ULONG           dataSize = 0;
     UINT32          bytesToRead = 0;
     UINT32          bytesRemain = 0;
     UINT32          ddrSectionsCount = 0;
     UINT32          indexDDR = 0;
     UINT32          indexBuffered = 0;
     UINT32          indexPage = 0;
-    UINT32          ioBufferSize = IO_BUFFER_SIZE;
+    UINT32          ioBufferSize = Context->IoBufferSize;
     PVOID           ioBuffer = nullptr;
     UINT32          iterationsPerDDR = 0;
     PDDR_MEMORY_MAP ddrMemoryMap = nullptr;
     LARGE_INTEGER   offset;
+    LARGE_INTEGER   hintPA;
     UINT64          pagesCount = 0;
     UINT32          remainder = 0;
     UINT32          stringSize;
     PVOID           temp = nullptr;
-    PULARGE_INTEGER dumpInstance = nullptr;
-    DUMP_HEADER32   dumpHeader32;
-    DUMP_HEADER64   dumpHeader64;
+    UCHAR           dumpHeader[sizeof(DUMP_HEADER64)];
 
     BOOL IsHeaderValid = FALSE;
 
-    TraceInfo("Searching for dump data built by the kernel");
-
     stringSize = sizeof(InMemoryDumpHeaderMagicString);
 
     ddrMemoryMap = Context->DDRMemoryMap;
     ddrSectionsCount = Context->DDRSectionCount;
     ioBuffer = Context->IoBuffer;
-    RtlZeroMemory(ioBuffer, IO_BUFFER_SIZE);
-    dataSize = sizeof(DUMP_HEADER);
     Context->Is64Bit = FALSE;
-    //
-    // Allocate a buffer to store the dump header. 
-    //
-
 
     Context->DumpHeaderStatus = DHS_NOT_FOUND;
 
@@ -2757,6 +3683,37 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
     // the info file.
     //
 
+    hintPA.QuadPart = Context->DumpHeaderPAHint.QuadPart;
+    if ((hintPA.QuadPart == 0) && (Context->InMemDataInfo.DataPA.QuadPart != 0)) {
+        hintPA.QuadPart = Context->InMemDataInfo.DataPA.QuadPart + IN_MEM_DATA_DUMP_HEADER_OFFSET;
+    }
+
+    if (hintPA.QuadPart != 0) {
+        TraceInfo1("Trying DUMP_HEADER hint", "PA", hintPA.QuadPart);
+
+        hr = ValidateDumpHeaderAtPA(Context, hintPA, dumpHeader);
+        if (hr == S_OK) {
+            Context->DumpHeaderPA.QuadPart = hintPA.QuadPart;
+
+            TraceInfo1("Dump header verified", "PA", Context->DumpHeaderPA.QuadPart);
+
+            IsHeaderValid = TRUE;
+            Context->DumpHeaderStatus = DHS_VALID;
+            goto AllocateDumpHeader;
+        }
+
+        //
+        // A bad hint is not fatal, the full search below may still find the header.
+        //
+        TraceHRESULT("DUMP_HEADER hint did not validate, searching DDR sections", hr);
+        Context->DumpHeaderStatus = DHS_INVALID;
+        hr = HRESULT_FROM_NT(STATUS_NOT_FOUND);
+    }
+
+    TraceInfo("Searching for dump data built by the kernel");
+
+    RtlZeroMemory(ioBuffer, ioBufferSize);
+
     for (indexDDR = 0; indexDDR < ddrSectionsCount; indexDDR++) {
         //
         // To reduce costly disk IO. We will read a large chunk 
@@ -2773,8 +3730,6 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
         offset.QuadPart = Context->fileOffset.QuadPart + ddrMemoryMap[indexDDR].Offset;
         bytesToRead = 0;
 
-        //sectionIndex = Context->fileOffset.QuadPart + Context->FirstDDRFileIdIndex + indexDDR;
-
         TraceInfo2("DDR section requires iterations", "Index", indexDDR, "Iterations", iterationsPerDDR);
 
         for (indexBuffered = 0; indexBuffered < iterationsPerDDR; indexBuffered++) {
@@ -2784,12 +3739,7 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
             bytesRemain = bytesRemain - bytesToRead;
             bytesToRead = (ioBufferSize < bytesRemain) ? ioBufferSize : bytesRemain;
 
-            if (FAILED(hr = Context->hRawFile.SetPos(offset)))
-            {
-                TraceHRESULT("Failed to set position to DDR section ", hr);
-                goto Exit;
-            }
-            else if (FAILED(hr = Context->hRawFile.Read((PCHAR)ioBuffer, bytesToRead, &bytesProcessed)))
+            if (FAILED(hr = ReadRawDumpFile(Context, offset, ioBuffer, bytesToRead, &bytesProcessed)))
             {
                 TraceHRESULT("Failed to read DDR section from device", hr);
                 goto Exit;
@@ -2800,7 +3750,7 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
                 goto Exit;
             }
 
-            TraceInfo2("Processing DDR Section %d iteration", "indexDDR", indexDDR, "indexBuffered", indexBuffered);
+            TraceInfoBinary2("Processing DDR Section iteration", "indexDDR", indexDDR, "indexBuffered", indexBuffered);
 
             //
             // Search the buffer for the signature.
@@ -2829,143 +3779,12 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
                     TraceInfo2("Found a possible match", "Offset", Context->DumpHeaderOffset,
                         "PA", Context->DumpHeaderPA.QuadPart);
 
-                    if (FAILED(hr = HRESULT_FROM_NT(ReadFromDDRSectionByPhysicalAddress( Context, Context->DumpHeaderPA, dataSize, &dumpHeader32))))
+                    if (FAILED(hr = ValidateDumpHeaderAtPA(Context, Context->DumpHeaderPA, dumpHeader)))
                     {
-                        TraceHRESULT("ReadFromDDRSectionByPhysicalAddress failed", hr);
                         goto Exit;
                     }
-
-                    //
-                    // Check signature. Signatures for 64 bit and 32 bit are the same.
-                    //
-                    if (dumpHeader32.Signature != DUMP_SIGNATURE32) {
-                        TraceExpectedActual("Invalid DUMP_HEADER.Signature",
-                                            DUMP_SIGNATURE32, Context->DumpHeader32->Signature);
-
-                        Context->DumpHeaderStatus = DHS_INVALID;
-                        continue;
-                    }
-
-                    //
-                    // Check valid dump value. This where we would see a difference between 32 bit and 64 bit header.
-                    //
-                    if (dumpHeader32.ValidDump == DUMP_VALID_DUMP64) {
-                        Context->Is64Bit = TRUE;
-
-                        //
-                        // This dump has come from a 64 bit machine, we need to read the dumpheader 
-                        // again. This time to a DUMP_HEADER64 structure.
-                        //
-                        dataSize = sizeof(DUMP_HEADER64);
-                        if (FAILED(hr = HRESULT_FROM_NT(ReadFromDDRSectionByPhysicalAddress(Context, Context->DumpHeaderPA, dataSize, &dumpHeader64))))
-                        {
-                            TraceHRESULT("ReadFromDDRSectionByPhysicalAddress failed", hr);
-                            goto Exit;
-                        }
-
-                        //
-                        // Check bugcheck code.
-                        //
-                        if (dumpHeader64.BugCheckCode != FATAL_ABNORMAL_RESET_ERROR) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.BugCheckCode",
-                                                FATAL_ABNORMAL_RESET_ERROR, dumpHeader64.BugCheckCode);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        //
-                        // Check dump type
-                        //
-                        if (dumpHeader64.DumpType != DUMP_TYPE_FULL) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.DumpType",
-                                (ULONG)DUMP_TYPE_FULL, (ULONG)dumpHeader64.DumpType);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        //
-                        // Check RequiredDumpSpace
-                        //
-                        if (dumpHeader64.RequiredDumpSpace.LowPart != DUMP_SIGNATURE) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.RequiredDumpSpace.LowPart",
-                                                DUMP_SIGNATURE, dumpHeader64.RequiredDumpSpace.LowPart);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        TraceInfo1("Expected dump instance", "Instance", Context->DumpInstance.QuadPart);
-
-                        dumpInstance = (PULARGE_INTEGER)dumpHeader64.Comment;
-
-                        if (Context->DumpInstance.QuadPart != dumpInstance->QuadPart) {
-                            TraceExpectedActual("Instance ID does not match",
-                                                Context->DumpInstance.QuadPart,
-                                                dumpInstance->QuadPart);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                    }
-                    else if (dumpHeader32.ValidDump == DUMP_VALID_DUMP32) {
-
-                        //
-                        // This dump has come from a 64 bit machine.
-                        // Check bugcheck code.
-                        //
-                        if (dumpHeader32.BugCheckCode != FATAL_ABNORMAL_RESET_ERROR) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.BugCheckCode",
-                                                FATAL_ABNORMAL_RESET_ERROR, dumpHeader32.BugCheckCode);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        //
-                        // Check dump type
-                        //
-                        if (dumpHeader32.DumpType != DUMP_TYPE_FULL) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.DumpType",
-                                (ULONG)DUMP_TYPE_FULL, (ULONG)dumpHeader32.DumpType);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        //
-                        // Check RequiredDumpSpace
-                        //
-                        if (dumpHeader32.RequiredDumpSpace.LowPart != DUMP_SIGNATURE) {
-                            TraceExpectedActual("Invalid DUMP_HEADER.RequiredDumpSpace.LowPart",
-                                                DUMP_SIGNATURE, dumpHeader32.RequiredDumpSpace.LowPart);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-
-                        TraceInfo1("Expected dump instance", "Instance", Context->DumpInstance.QuadPart);
-
-                        dumpInstance = (PULARGE_INTEGER)dumpHeader32.Comment;
-
-                        if (Context->DumpInstance.QuadPart != dumpInstance->QuadPart) {
-                            TraceExpectedActual("Instance ID does not match",
-                                                Context->DumpInstance.QuadPart,
-                                                dumpInstance->QuadPart);
-
-                            Context->DumpHeaderStatus = DHS_INVALID;
-                            continue;
-                        }
-                    }
-                    else {
-                        //
-                        // Invalid dump header. 
-                        //
-                        TraceExpectedActual("Invalid DUMP_HEADER.ValidDump",
-                                            DUMP_VALID_DUMP32, Context->DumpHeader32->ValidDump);
-
+                    else if (hr == S_FALSE)
+                    {
                         Context->DumpHeaderStatus = DHS_INVALID;
                         continue;
                     }
@@ -2983,10 +3802,18 @@ HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context)
 
     if (IsHeaderValid == FALSE) {
         TraceInfo("Failed to find a valid DUMP_HEADER");
+        hr = HRESULT_FROM_NT(STATUS_NOT_FOUND);
         goto Exit;
     }
 
 AllocateDumpHeader:
+    //
+    // The kernel places the decoded KdDebuggerDataBlock, its original PA and
+    // the CONTEXT PAs right after the page that holds the DUMP_HEADER, the
+    // CPU context readers locate them from DumpHeaderAddress.
+    //
+    Context->DumpHeaderAddress.QuadPart = Context->DumpHeaderPA.QuadPart;
+
     //
     // Allocate memory to Context->DumpHeaderxx and copy the contents.
     //
@@ -2997,7 +3824,7 @@ AllocateDumpHeader:
             TraceHRESULT("Failed to allocate memory for DUMP_HEADER", hr);
             goto Exit;
         }
-        memcpy(Context->DumpHeader64, &dumpHeader64, sizeof(DUMP_HEADER64));
+        memcpy(Context->DumpHeader64, dumpHeader, sizeof(DUMP_HEADER64));
     }
     else {
         Context->DumpHeader32 = (PDUMP_HEADER32)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DUMP_HEADER32));
@@ -3006,7 +3833,7 @@ AllocateDumpHeader:
             TraceHRESULT("Failed to allocate memory for DUMP_HEADER", hr);
             goto Exit;
         }
-        memcpy(Context->DumpHeader32, &dumpHeader32, sizeof(DUMP_HEADER32));
+        memcpy(Context->DumpHeader32, dumpHeader, sizeof(DUMP_HEADER32));
     }
 
 Exit:
@@ -3023,6 +3850,11 @@ NTSTATUS BuildCompleteMemoryMap(_Inout_ PDMP_CONTEXT Context)
     This function builds a memory map consisting of nonOS
     and OS memory ranges in DDR sections.
 
+    The OS ranges are the DDR sections intersected with the memory runs and
+    the nonOS ranges are the DDR sections minus the memory runs. Both are
+    split at DDR section boundaries so each entry maps to a single section.
+    The map is sized from the results, there is no fixed upper bound.
+
     Arguments:
 
         Context - PDMP_CONTEXT
@@ -3034,25 +3866,20 @@ NTSTATUS BuildCompleteMemoryMap(_Inout_ PDMP_CONTEXT Context)
 --*/
 {
     PDDR_MEMORY_MAP               completeMemoryMap = nullptr;
-    UINT32                        completeMemoryMapAllocSize = 0;
     UINT32                        currentComplete = 0;
-    UINT32                        currentDDR = 0;
-    UINT32                        currentPhysDesc = 0;
-    UINT64                        cursor = 0;
-    UINT64                        startDDR = 0;
-    UINT64                        start = 0;
-    UINT64                        endDDR = 0;
-    UINT64                        end = 0;
+    UINT32                        currentOS = 0;
+    UINT32                        currentNonOS = 0;
     UINT32                        maxComplete = 0;
-    UINT32                        maxDDR = 0;
-    UINT32                        maxPhysDesc = 0;
-    PVOID                         physDesc = nullptr;
+    EXTENT_SET                    ddrExtents;
+    EXTENT_SET                    runs;
+    EXTENT_SET                    osRuns;
+    EXTENT_SET                    osMemory;
+    EXTENT_SET                    nonOSMemory;
+    PEXTENT                       extent = nullptr;
     PDDR_MEMORY_MAP               ddrMemoryMap = nullptr;
+    PDDR_MEMORY_MAP               entry = nullptr;
+    HRESULT                       hr = S_OK;
     NTSTATUS                      status = STATUS_SUCCESS;
-    UINT64                        tempBase = 0;
-    UINT64                        tempEnd = 0;
-    UINT64                        tempLength = 0;
-    MEMORY_TYPE                   type;
 
 
     TraceInfo("BEGIN: build complete memory map");
@@ -3062,180 +3889,103 @@ NTSTATUS BuildCompleteMemoryMap(_Inout_ PDMP_CONTEXT Context)
     Context->TotalNonOSDDRSizeInBytes = 0;
 
     ddrMemoryMap = Context->DDRMemoryMap;
-    maxDDR = Context->DDRMemoryMapCount;
-    physDesc = ((Context->Is64Bit) ? (PVOID)Context->MemoryDescriptors64 : (PVOID)Context->MemoryDescriptors);
-    maxPhysDesc = ((Context->Is64Bit) ? ((PPHYSICAL_MEMORY_DESCRIPTOR64)physDesc)->NumberOfRuns : ((PPHYSICAL_MEMORY_DESCRIPTOR32)physDesc)->NumberOfRuns);
+
+    ExtentSetInit(&ddrExtents);
+    ExtentSetInit(&runs);
+    ExtentSetInit(&osRuns);
+    ExtentSetInit(&osMemory);
+    ExtentSetInit(&nonOSMemory);
 
     //
-    // Figure out how many DDR memory map descriptors to allocate.
-    // For now, just quadruple the count of physical memory descriptors.
+    // The runs have been validated against the DDR sections already.
+    // Coalesce them so they are normalized for the set operations.
     //
-    maxComplete = maxPhysDesc * 4;
-    completeMemoryMapAllocSize = maxComplete * sizeof(DDR_MEMORY_MAP);
-
-    completeMemoryMap = (PDDR_MEMORY_MAP)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, completeMemoryMapAllocSize);
-    if (completeMemoryMap == nullptr) {
-        status = STATUS_NO_MEMORY;
-        TraceNTSTATUS("Failed to allocate memory for non-OS memory map", status);
-        goto Exit;
+    hr = BuildMemoryRunExtentSet(Context, &runs);
+    if (SUCCEEDED(hr)) {
+        hr = ExtentSetCoalesce(&runs, &osRuns);
     }
 
-    for (currentDDR = 0; currentDDR < maxDDR; currentDDR++) {
-        TraceInfo1("Processing DDR", "Index", currentDDR);
-
-#ifdef VERBOSE_MSGS
-        wprintf(L"= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\r\n");
-        wprintf(L"Current DDR Section: %d\r\n", currentDDR);
-        wprintf(L"     Base: 0x%I64x (startDDR)\r\n", ddrMemoryMap[currentDDR].Base);
-        wprintf(L"      End: 0x%I64x (endDDR)\r\n", ddrMemoryMap[currentDDR].End);
-        wprintf(L"     Size: 0x%I64x\r\n", ddrMemoryMap[currentDDR].Size);
-        wprintf(L"   Offset: 0x%I64x\r\n", completeMemoryMap[currentComplete].Offset);
-        wprintf(L"     Type: %d - %s\r\n", ddrMemoryMap[currentDDR].Type,
-                            (RAW_DUMP_SECTION_TYPE_RESERVED == ddrMemoryMap[currentDDR].Type) ? L"Reserved" :
-                                (RAW_DUMP_SECTION_TYPE_DDR_RANGE == ddrMemoryMap[currentDDR].Type) ? L"DDR" :
-                                (RAW_DUMP_SECTION_TYPE_CPU_CONTEXT == ddrMemoryMap[currentDDR].Type) ? L"CPU Context" :
-                                (RAW_DUMP_SECTION_TYPE_SV_SPECIFIC == ddrMemoryMap[currentDDR].Type) ? L"SV Specific" :
-                                L"Unidentified"
-               );
-#endif
-
-        startDDR = ddrMemoryMap[currentDDR].Base;
-        endDDR = ddrMemoryMap[currentDDR].End;
-
-        if (currentDDR == 0)
-        {
-            cursor = startDDR;
-        }
-
-        while ((cursor < endDDR) &&
-            (currentComplete < maxComplete) &&
-            (currentPhysDesc < maxPhysDesc))
-        {
+    if (SUCCEEDED(hr)) {
+        hr = BuildDDRExtentSet(Context, &ddrExtents);
+    }
 
-#ifdef VERBOSE_MSGS
-            LogLibInfoPrintf(L"In while loop. cursor: 0x%I64x currentComplete: 0x%x currentPhysDesc: 0x%x\n",
-                cursor,
-                currentComplete,
-                currentPhysDesc);
-#endif
+    if (SUCCEEDED(hr)) {
+        hr = ExtentSetIntersect(&ddrExtents, &osRuns, &osMemory);
+    }
 
-            if (Context->Is64Bit)
-            {
-                tempBase   = PAGES_TO_BYTES( ((PPHYSICAL_MEMORY_DESCRIPTOR64)physDesc)->Run[currentPhysDesc].BasePage  );
-                tempLength = PAGES_TO_BYTES( ((PPHYSICAL_MEMORY_DESCRIPTOR64)physDesc)->Run[currentPhysDesc].PageCount );
-            }
-            else
-            {
-                tempBase   = PAGES_TO_BYTES( ((PPHYSICAL_MEMORY_DESCRIPTOR32)physDesc)->Run[currentPhysDesc].BasePage  );
-                tempLength = PAGES_TO_BYTES( ((PPHYSICAL_MEMORY_DESCRIPTOR32)physDesc)->Run[currentPhysDesc].PageCount );
-            }
+    if (SUCCEEDED(hr)) {
+        hr = ExtentSetDifference(&ddrExtents, &osRuns, &nonOSMemory);
+    }
 
-            tempEnd = tempBase + tempLength - 1;
+    if (FAILED(hr)) {
+        status = STATUS_NO_MEMORY;
+        TraceHRESULT("Failed to split DDR sections into OS and non-OS memory", hr);
+        goto Exit;
+    }
 
-            if (cursor < tempBase) {
-                start = cursor;
-                end = tempBase - 1;
-                end = (end < endDDR) ? end : endDDR;
-                //
-                // ASSUMPTION: There will not be any non-OS memory beyond NON_OS_MEMORY_LIMIT.
-                //
-                if ((cursor < NON_OS_MEMORY_LIMIT) || 
-                    (tempLength < NON_OS_SIZE_LIMIT)) 
-                { 
-                    type = MEMORY_NONOS;
-                }
-                else {
-                    type = MEMORY_NA;
-                }
-            } else {
-                start = (tempBase < cursor) ? cursor : tempBase;
-                end = tempEnd;
-                type = MEMORY_OS;
-
-                if (end <= endDDR) {
-                    currentPhysDesc++;
-                } else {
-                    end = endDDR;
-                }
-            }
+    maxComplete = osMemory.Count + nonOSMemory.Count;
+    if (maxComplete == 0) {
+        TraceInfo("No DDR memory to map");
+        goto Exit;
+    }
 
-            cursor = end + 1;
-            completeMemoryMap[currentComplete].Base = start;
-            completeMemoryMap[currentComplete].End = end;
-            completeMemoryMap[currentComplete].Size = completeMemoryMap[currentComplete].End -
-                completeMemoryMap[currentComplete].Base +
-                1;
-            completeMemoryMap[currentComplete].Type = type;
-            completeMemoryMap[currentComplete].Offset = ddrMemoryMap[currentDDR].Offset +
-                (completeMemoryMap[currentComplete].Base -
-                ddrMemoryMap[currentDDR].Base);
-            completeMemoryMap[currentComplete].DDRIndex = currentDDR;
+    completeMemoryMap = (PDDR_MEMORY_MAP)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, maxComplete * sizeof(DDR_MEMORY_MAP));
+    if (completeMemoryMap == nullptr) {
+        status = STATUS_NO_MEMORY;
+        TraceNTSTATUS("Failed to allocate memory for non-OS memory map", status);
+        goto Exit;
+    }
 
-#ifdef VERBOSE_MSGS
-            wprintf(L"    %2d - Base: 0x%I64x  End: 0x%I64x  Size: 0x%I64x  Offset: 0x%I64x  Type: %s\r\n",
-                        currentComplete,
-                        completeMemoryMap[currentComplete].Base,
-                        completeMemoryMap[currentComplete].End,
-                        completeMemoryMap[currentComplete].Size,
-                        completeMemoryMap[currentComplete].Offset,
-                        (completeMemoryMap[currentComplete].Type == MEMORY_NONOS) ? L"NON-OS" :
-                            (completeMemoryMap[currentComplete].Type == MEMORY_OS)    ? L"OS" :
-                            (completeMemoryMap[currentComplete].Type == MEMORY_NA)    ? L"NA" :
-                            L"UNIDENTIFIED"
-                    );
-#endif
+    //
+    // Both sets are sorted and disjoint, merge them by base address.
+    //
+    for (currentComplete = 0; currentComplete < maxComplete; currentComplete++) {
+        entry = &completeMemoryMap[currentComplete];
+
+        if ((currentNonOS == nonOSMemory.Count) ||
+            ((currentOS < osMemory.Count) &&
+             (osMemory.Extents[currentOS].Base < nonOSMemory.Extents[currentNonOS].Base))) {
+            extent = &osMemory.Extents[currentOS++];
+            entry->Type = MEMORY_OS;
+        }
+        else {
+            extent = &nonOSMemory.Extents[currentNonOS++];
 
             //
-            // Do some bookeeping.
+            // ASSUMPTION: There will not be any non-OS memory beyond NON_OS_MEMORY_LIMIT,
+            // large ranges past it are holes.
             //
-            if (completeMemoryMap[currentComplete].Type == MEMORY_NONOS) {
-                Context->TotalNonOSDDRSizeInBytes += completeMemoryMap[currentComplete].Size;
-            }
-
-            currentComplete++;
-        } //while cursor
-    }// for currentDDR
+            entry->Type = ((extent->Base < NON_OS_MEMORY_LIMIT) ||
+                           (EXTENT_SIZE(*extent) < NON_OS_SIZE_LIMIT)) ? MEMORY_NONOS : MEMORY_NA;
+        }
 
-    //
-    // Append a final entry.
-    //
-    if ( (cursor <= endDDR) && 
-         !(currentPhysDesc < maxPhysDesc) && 
-         (currentComplete < maxComplete) &&
-         (cursor < NON_OS_MEMORY_LIMIT)
-       )
-    {
-         TraceInfo("Appending final entry");
-
-        completeMemoryMap[currentComplete].Base = cursor;
-        completeMemoryMap[currentComplete].End = endDDR;
-        completeMemoryMap[currentComplete].Size = completeMemoryMap[currentComplete].End -
-            completeMemoryMap[currentComplete].Base +
-            1;
-        completeMemoryMap[currentComplete].Type = 
-            (completeMemoryMap[currentComplete].Size < NON_OS_SIZE_LIMIT) ? MEMORY_NONOS : MEMORY_NA;
-        completeMemoryMap[currentComplete].Offset = ddrMemoryMap[currentDDR - 1].Offset +
-            (completeMemoryMap[currentComplete].Base -
-            ddrMemoryMap[currentDDR - 1].Base);
-        completeMemoryMap[currentComplete].DDRIndex = currentDDR - 1;
+        entry->Base = extent->Base;
+        entry->End = extent->End;
+        entry->Size = EXTENT_SIZE(*extent);
+        entry->DDRIndex = extent->Tag;
+        entry->Offset = ddrMemoryMap[extent->Tag].Offset +
+            (entry->Base - ddrMemoryMap[extent->Tag].Base);
 
 #ifdef VERBOSE_MSGS
-        wprintf(L"= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\r\nAppended entry:\r\n");
-        wprintf(L"        %2x -- Base: 0x%016I64x  End: 0x%016I64x  Size: 0x%016I64x  Offset: 0x%016I64x  Type: %s\r\n",
-                currentComplete,
-                completeMemoryMap[currentComplete].Base,
-                completeMemoryMap[currentComplete].End,
-                completeMemoryMap[currentComplete].Size,
-                completeMemoryMap[currentComplete].Offset,
-                (completeMemoryMap[currentComplete].Type == MEMORY_NONOS) ? L"NON-OS" :
-                (completeMemoryMap[currentComplete].Type == MEMORY_OS) ? L"OS" :
-                (completeMemoryMap[currentComplete].Type == MEMORY_NA) ? L"NA" :
-                L"UNIDENTIFIED"
-        );
+        wprintf(L"    %2d - Base: 0x%I64x  End: 0x%I64x  Size: 0x%I64x  Offset: 0x%I64x  Type: %s\r\n",
+                    currentComplete,
+                    entry->Base,
+                    entry->End,
+                    entry->Size,
+                    entry->Offset,
+                    (entry->Type == MEMORY_NONOS) ? L"NON-OS" :
+                        (entry->Type == MEMORY_OS)    ? L"OS" :
+                        (entry->Type == MEMORY_NA)    ? L"NA" :
+                        L"UNIDENTIFIED"
+                );
 #endif
 
-        Context->TotalNonOSDDRSizeInBytes += completeMemoryMap[currentComplete].Size;
-        currentComplete++;
+        //
+        // Do some bookeeping.
+        //
+        if (entry->Type == MEMORY_NONOS) {
+            Context->TotalNonOSDDRSizeInBytes += entry->Size;
+        }
     }
 
 #ifdef VERBOSE_MSGS
@@ -3272,27 +4022,51 @@ NTSTATUS BuildCompleteMemoryMap(_Inout_ PDMP_CONTEXT Context)
 
     Context->CompleteMemoryMap = completeMemoryMap;
     Context->CompleteMemoryMapCount = currentComplete;
+    completeMemoryMap = nullptr;
+
+    ChargeMemoryBudget(Context, (UINT64)maxComplete * sizeof(DDR_MEMORY_MAP), TRUE);
 
     LogLibInfoPrintf(L"END: Complete memory map contains %u memory ranges.\n",
         Context->CompleteMemoryMapCount);
 
 Exit:
+    if (completeMemoryMap != nullptr) {
+        HeapFree(GetProcessHeap(), 0, completeMemoryMap);
+    }
+
+    ExtentSetFree(&nonOSMemory);
+    ExtentSetFree(&osMemory);
+    ExtentSetFree(&osRuns);
+    ExtentSetFree(&runs);
+    ExtentSetFree(&ddrExtents);
 
     return status;
 }
 
 
-HRESULT WriteInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context)
+HRESULT ReadInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context)
 {
     PVOID pDiagBuff = nullptr;
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    // Read the InMemDiag buffer from the raw dump and write it to the windows dump
+    // Read the InMemDiag buffer from the raw dump, WriteInMemDiagBuffer writes it to the windows dump
+
+    if (Context->InMemDiagBuffer != nullptr) {
+        return S_OK;
+    }
 
     if (Context->InMemDataInfo.Size != 0) {
         status = STATUS_NO_MEMORY;
+        if (FAILED(ChargeMemoryBudget(Context, Context->InMemDataInfo.Size, FALSE))) {
+            TraceNTSTATUS("InMemDiag buffer exceeds the memory budget", status);
+            goto Exit;
+        }
+
         pDiagBuff = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Context->InMemDataInfo.Size);
-        if (pDiagBuff) {
+        if (pDiagBuff == nullptr) {
+            ReturnMemoryBudget(Context, Context->InMemDataInfo.Size);
+        }
+        else {
             status = ReadFromDDRSectionByPhysicalAddress(
                          Context,
                          Context->InMemDataInfo.DataPA,
@@ -3304,28 +4078,52 @@ HRESULT WriteInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context)
                 goto Exit;
             }
 
-            status = WriteToDumpByPhysicalAddress(
-                         Context,
-                         Context->InMemDataInfo.DataPA,
-                         Context->InMemDataInfo.Size,
-                         pDiagBuff
-                         );
-            if (FAILED(status)) {
-                TraceNTSTATUS("Write InMemDiag buffer failed" , status);
-                goto Exit;
-            }
+            Context->InMemDiagBuffer = pDiagBuff;
+            pDiagBuff = nullptr;
         }
     }
 
 Exit:
     if (pDiagBuff) {
         HeapFree(GetProcessHeap(), NULL, pDiagBuff);
+        ReturnMemoryBudget(Context, Context->InMemDataInfo.Size);
         pDiagBuff = nullptr;
     }
     return HRESULT_FROM_WIN32(status);
 }
 
 
+HRESULT WriteInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    HRESULT hr = S_OK;
+
+    // Write the InMemDiag buffer read by ReadInMemDiagBuffer to the windows dump
+
+    if (Context->InMemDataInfo.Size != 0) {
+        if (FAILED(hr = ReadInMemDiagBuffer(Context))) {
+            return hr;
+        }
+
+        status = WriteToDumpByPhysicalAddress(
+                     Context,
+                     Context->InMemDataInfo.DataPA,
+                     Context->InMemDataInfo.Size,
+                     Context->InMemDiagBuffer
+                     );
+        if (FAILED(status)) {
+            TraceNTSTATUS("Write InMemDiag buffer failed" , status);
+        }
+
+        HeapFree(GetProcessHeap(), NULL, Context->InMemDiagBuffer);
+        ReturnMemoryBudget(Context, Context->InMemDataInfo.Size);
+        Context->InMemDiagBuffer = nullptr;
+    }
+
+    return HRESULT_FROM_WIN32(status);
+}
+
+
 HRESULT WriteFakeDumpHeader(_Inout_ PDMP_CONTEXT Context)
 /*++
 
@@ -3461,6 +4259,8 @@ HRESULT
         Context->BugCheckParam2 = DeviceSpecificInfo.BugCheckParam2;
         Context->BugCheckParam3 = DeviceSpecificInfo.BugCheckParam3;
         Context->BugCheckParam4 = DeviceSpecificInfo.BugCheckParam4;
+
+        Context->DumpHeaderPAHint.QuadPart = DeviceSpecificInfo.DumpHeaderPA;
     }
 
     return hr;
@@ -23,6 +23,10 @@ Environment: User Mode
 
 #include "DEVICE_IO.h"
 #include "Device_Specific.h"
+#include "Batch_Read.h"
+#include "Extent_Set.h"
+#include "Chunked_Section.h"
+#include "Page_Fingerprint.h"
 #include "KdDebuggerData.h"
 #include "DbgClient.h"
 #include "ntiodump.h"
@@ -50,6 +54,110 @@ TRACELOGGING_DECLARE_PROVIDER(g_hRaw2DumpTraceLoggingProvider);
 // 
 #define IO_BUFFER_SIZE 0x800000
 
+//
+// Chunked (v2) sections are read through ReadRawDumpFile at offsets from this
+// base, see OpenChunkedSections and GetRawDumpSectionOffset.
+//
+#define RAW_DUMP_CHUNKED_VIRTUAL_BASE     0x4000000000000000ULL
+
+//
+// VerifyWindowsDumpFile compares memory in slices of up to VERIFY_SLICE_SIZE
+// bytes, with up to VERIFY_MAX_THREADS threads.
+//
+#define VERIFY_SLICE_SIZE                 0x400000
+#define VERIFY_MAX_THREADS                16
+
+//
+// SearchRawDumpFile scans DDR in slices of SEARCH_SLICE_SIZE bytes, with up to
+// SEARCH_MAX_THREADS threads, and stops recording after SEARCH_MAX_HITS hits.
+// Each hit is reported with up to SEARCH_CONTEXT_BYTES bytes on either side.
+//
+#define SEARCH_SLICE_SIZE                 0x400000
+#define SEARCH_MAX_THREADS                16
+#define SEARCH_MAX_PATTERN_LENGTH         256
+#define SEARCH_MAX_HITS                   0x100000
+#define SEARCH_CONTEXT_BYTES              16
+
+//
+// RunConversionPhases runs the phases of a conversion on up to
+// CONVERSION_MAX_THREADS threads. A table holds at most CONVERSION_MAX_PHASES.
+//
+#define CONVERSION_MAX_THREADS            4
+#define CONVERSION_MAX_PHASES             32
+
+//
+// Up to MEMORY_POOL_MAX_FREE idle I/O buffers are kept for reuse, see
+// AllocatePooledBuffer. Buffer sizes are rounded up to whole pages.
+//
+#define MEMORY_POOL_MAX_FREE              8
+#define MEMORY_POOL_ROUND(Size)           ((UINT32)(((Size) + (PAGE_SIZE - 1)) & ~(PAGE_SIZE - 1)))
+
+//
+// A sharded conversion is planned in <dump>.shards, see ShardedConversion.cpp.
+//
+#define DUMP_SHARD_PLAN_EXTENSION         L".shards"
+#define DUMP_SHARD_PLAN_SIGNATURE         (UINT64)(0x6472616853443252)  // "R2DShard"
+#define DUMP_SHARD_PLAN_VERSION           1
+#define DUMP_SHARD_MAX_COUNT              256
+
+#define DUMP_SHARD_PENDING                0
+#define DUMP_SHARD_DONE                   1
+#define DUMP_SHARD_FAILED                 2
+
+//
+// Profiles of the kernel builds converted before are cached in the directory
+// of the dump, see KernelProfile.cpp.
+//
+#define KERNEL_PROFILE_CACHE_FILE_NAME    L"raw2dump.profiles"
+#define KERNEL_PROFILE_CACHE_SIGNATURE    (UINT64)(0x666F72504B443252)  // "R2DKProf"
+#define KERNEL_PROFILE_CACHE_VERSION      1
+#define KERNEL_PROFILE_CACHE_MAX_COUNT    64
+
+//
+// Memory held by an open chunked section, charged to the memory budget.
+//
+#define CHUNKED_SECTION_MEMORY(Section)   (sizeof(CHUNKED_SECTION) + \
+                                           (2 * (UINT64)(Section)->Header.ChunkSize) + \
+                                           ((UINT64)(Section)->Header.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY)))
+
+//
+// Fields of the in-memory DUMP_HEADER checked by ValidateDumpHeaderAtPA, read in
+// place with STRUCT_VIEW. Comment holds the dump instance in its first 8 bytes.
+//
+struct DUMP_HEADER32_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature,            ULONG,      0x000);
+    VIEW_LAYOUT_FIELD(ValidDump,            ULONG,      0x004);
+    VIEW_LAYOUT_FIELD(BugCheckCode,         ULONG,      0x028);
+    VIEW_LAYOUT_FIELD(Comment,              ULONGLONG,  0x820);
+    VIEW_LAYOUT_FIELD(DumpType,             ULONG,      0xF88);
+    VIEW_LAYOUT_FIELD(RequiredDumpSpace,    ULONG,      0xFA0);
+    static const size_t Length = 0x1000;
+};
+
+struct DUMP_HEADER64_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Signature,            ULONG,      0x000);
+    VIEW_LAYOUT_FIELD(ValidDump,            ULONG,      0x004);
+    VIEW_LAYOUT_FIELD(BugCheckCode,         ULONG,      0x038);
+    VIEW_LAYOUT_FIELD(Comment,              ULONGLONG,  0xFB0);
+    VIEW_LAYOUT_FIELD(DumpType,             ULONG,      0xF98);
+    VIEW_LAYOUT_FIELD(RequiredDumpSpace,    ULONG,      0xFA0);
+    static const size_t Length = 0x2000;
+};
+
+#define DUMP_HEADER_LAYOUT_CHECKS(layout, structure) \
+    VIEW_LAYOUT_CHECK(layout, structure, Signature); \
+    VIEW_LAYOUT_CHECK(layout, structure, ValidDump); \
+    VIEW_LAYOUT_CHECK(layout, structure, BugCheckCode); \
+    VIEW_LAYOUT_CHECK_OFFSET(layout, structure, Comment); \
+    VIEW_LAYOUT_CHECK(layout, structure, DumpType); \
+    VIEW_LAYOUT_CHECK_OFFSET(layout, structure, RequiredDumpSpace); \
+    VIEW_LAYOUT_CHECK_SIZE(layout, structure)
+
+DUMP_HEADER_LAYOUT_CHECKS(DUMP_HEADER32_LAYOUT, DUMP_HEADER32);
+DUMP_HEADER_LAYOUT_CHECKS(DUMP_HEADER64_LAYOUT, DUMP_HEADER64);
+
 // only for test. to be replaced by ETW logging
 //#define LogLibInfoPrintf wprintf
 #define LogLibInfoPrintf __noop
@@ -149,6 +257,23 @@ TRACELOGGING_DECLARE_PROVIDER(g_hRaw2DumpTraceLoggingProvider);
 #define TraceExpectedActual(DescriptionText, ExpectedValue, ActualValue) \
             TraceInfo2(DescriptionText, "Expected", ExpectedValue, "Actual", ActualValue)
 
+//
+// TraceInfoBinary2:
+// TraceInfo2 for per-chunk traces. The log gets a binary record (see
+// DMPLOG_TRACE in logging.h) instead of a formatted line, dmplogdecode
+// renders it. DescriptionText and ValueName* must be string literals
+// without '%'.
+//
+#define TraceInfoBinary2(DescriptionText, ValueName1, Value1, ValueName2, Value2) \
+            TraceLoggingWrite(                                     \
+                g_hRaw2DumpTraceLoggingProvider,                   \
+                "Raw2DumpInfo",                                    \
+                TraceLoggingValue(DescriptionText, "Description"), \
+                TraceLoggingValue(Value1, ValueName1),             \
+                TraceLoggingValue(Value2, ValueName2),             \
+                TraceLoggingKeyword(MICROSOFT_KEYWORD_TELEMETRY)); \
+                DMPLOG_INFO(DescriptionText " " ValueName1 " 0x%llx " ValueName2 " 0x%llx\n", 2, Value1, Value2, 0, 0)
+
 #pragma warning(disable: 4201) // nonstandard extension used : nameless struct/union
 // 
 // Physical Address Extension
@@ -231,6 +356,144 @@ typedef struct _IN_MEM_DATA_INFO {
 } IN_MEM_DATA_INFO, *PIN_MEM_DATA_INFO;
 
 
+//
+// A chunked section and the offset ReadRawDumpFile serves it at. The section
+// table keeps the offset of the chunk index, see GetRawDumpSectionOffset.
+//
+typedef struct _CHUNKED_SECTION_MAP {
+    UINT64              VirtualOffset;
+    UINT32              SectionIndex;
+    PCHUNKED_SECTION    Section;
+} CHUNKED_SECTION_MAP, *PCHUNKED_SECTION_MAP;
+
+
+//
+// A write to the dump file held back until ApplyDumpPatches. Sequence is the
+// order the patches were queued in, later ones win where they overlap.
+//
+#define DUMP_PATCH_INITIAL_CAPACITY     16
+#define DUMP_PATCH_BATCH_SIZE           (1024 * 1024)   // Adjacent patches merged into one write, at most
+
+typedef struct _DUMP_PATCH {
+    UINT64              FileOffset;
+    UINT32              Size;
+    UINT32              Sequence;
+    PVOID               Data;
+} DUMP_PATCH, *PDUMP_PATCH;
+
+
+//
+// Memory the conversion may use, in bytes, and the pool of idle I/O buffers.
+// InUse counts pooled buffers, idle or not, and allocations charged with
+// ChargeMemoryBudget.
+//
+typedef struct _POOLED_BUFFER {
+    PVOID               Buffer;
+    UINT32              Size;
+} POOLED_BUFFER, *PPOOLED_BUFFER;
+
+typedef struct _MEMORY_BUDGET {
+    UINT64              Limit;              // 0 for no limit
+    UINT64              InUse;
+    UINT64              Peak;
+    CRITICAL_SECTION    Lock;
+    BOOL                LockInitialized;
+    POOLED_BUFFER       Free[MEMORY_POOL_MAX_FREE];
+    UINT32              FreeCount;
+} MEMORY_BUDGET, *PMEMORY_BUDGET;
+
+//
+// The plan of a sharded conversion. Shard N holds the pages of the DDR part
+// of the dump from FirstPage on, counted in the order of the
+// PhysicalMemoryBlock runs. Each worker writes only the Status of its shard.
+//
+typedef struct _DUMP_SHARD_STATUS {
+    UINT32              State;              // DUMP_SHARD_PENDING, DONE or FAILED
+    HRESULT             hr;
+} DUMP_SHARD_STATUS, *PDUMP_SHARD_STATUS;
+
+typedef struct _DUMP_SHARD {
+    UINT64              FirstPage;
+    UINT64              PageCount;
+    DUMP_SHARD_STATUS   Status;
+} DUMP_SHARD, *PDUMP_SHARD;
+
+typedef struct _DUMP_SHARD_PLAN {
+    UINT64              Signature;
+    UINT32              Version;
+    UINT32              ShardCount;
+    UINT64              DumpInstance;       // Of the raw dump the plan was made for
+    UINT64              DDRFileOffset;
+    UINT64              DDRPageCount;
+    DUMP_SHARD          Shards[DUMP_SHARD_MAX_COUNT];
+} DUMP_SHARD_PLAN, *PDUMP_SHARD_PLAN;
+
+//
+// What a conversion learned about a kernel build through dbgeng. The build is
+// told apart by the TimeDateStamp, SizeOfImage and Machine of the kernel
+// image; addresses are kept from the kernel base, which moves between boots.
+//
+typedef struct _KERNEL_PROFILE {
+    UINT32              TimeDateStamp;
+    UINT32              SizeOfImage;
+    UINT16              Machine;
+    UINT16              Reserved;
+    UINT32              KdDebuggerDataBlockSize;    // DBGKD_DEBUG_DATA_HEADER64.Size
+    UINT64              KdDebuggerDataBlockRva;
+    UINT64              KiProcessorBlockRva;
+    UINT32              OffsetPrcbContext;
+    UINT32              Reserved2;
+} KERNEL_PROFILE, *PKERNEL_PROFILE;
+
+typedef struct _KERNEL_PROFILE_CACHE {
+    UINT64              Signature;
+    UINT32              Version;
+    UINT32              Count;
+    KERNEL_PROFILE      Profiles[KERNEL_PROFILE_CACHE_MAX_COUNT];   // Oldest first
+} KERNEL_PROFILE_CACHE, *PKERNEL_PROFILE_CACHE;
+
+typedef enum _CONVERSION_SHARD_MODE {
+    ConversionShardNone = 0,            // Convert the whole raw dump
+    ConversionShardPlan,                // Write the DUMP_HEADER and the plan
+    ConversionShardWorker,              // Copy the pages of one shard
+    ConversionShardStitch               // Write what follows DDR once all shards are done
+} CONVERSION_SHARD_MODE;
+
+//
+// Idle I/O buffers kept between conversions by a long running caller, see
+// AttachWarmBuffers and DetachWarmBuffers.
+//
+typedef struct _WARM_BUFFER_POOL {
+    POOLED_BUFFER       Buffers[MEMORY_POOL_MAX_FREE];
+    UINT32              Count;
+} WARM_BUFFER_POOL, *PWARM_BUFFER_POOL;
+
+//
+// Called as the conversion moves through its stages: Stage has done Done of
+// Total units of work. May be called from any thread running a conversion
+// phase, concurrently for different stages.
+//
+typedef VOID (*CONVERSION_PROGRESS_ROUTINE)(
+    _In_opt_ PVOID ProgressContext,
+    _In_ PCSTR Stage,
+    _In_ UINT64 Done,
+    _In_ UINT64 Total
+    );
+
+//
+// Settings of a conversion beyond its paths, see ConvertRawDumpWithOptions.
+//
+typedef struct _CONVERSION_OPTIONS {
+    UINT64                      MemoryBudget;       // 0 for no limit
+    PWARM_BUFFER_POOL           WarmPool;           // Optional
+    CONVERSION_PROGRESS_ROUTINE ProgressRoutine;    // Optional
+    PVOID                       ProgressContext;
+    CONVERSION_SHARD_MODE       ShardMode;
+    UINT32                      ShardIndex;         // ConversionShardWorker
+    UINT32                      ShardCount;         // ConversionShardPlan
+} CONVERSION_OPTIONS, *PCONVERSION_OPTIONS;
+
+
 //
 // Global context struct. 
 //
@@ -240,6 +503,15 @@ typedef struct _DMP_CONTEXT
     DEVICE_IO                                           hRawFile;
     LARGE_INTEGER                                       fileOffset;
     LARGE_INTEGER                                       RawDumpFileLength;
+
+    //
+    // Serializes ReadRawDumpFile while conversion phases run in parallel, see
+    // RunConversionPhases. Not used while RawDumpLockInitialized is FALSE.
+    //
+    CRITICAL_SECTION                                    RawDumpLock;
+    BOOL                                                RawDumpLockInitialized;
+    PCHUNKED_SECTION_MAP                                ChunkedSections;
+    UINT32                                              ChunkedSectionCount;
     
     // General dump related.
     LARGE_INTEGER                                       ConfigTableAddress;
@@ -267,6 +539,22 @@ typedef struct _DMP_CONTEXT
     BOOL                                                Is64Bit;
 
     PVOID                                               IoBuffer;
+    UINT32                                              IoBufferSize;       // IO_BUFFER_SIZE unless the budget is short
+
+    //
+    // Limit on the memory used by the conversion, see AllocatePooledBuffer.
+    //
+    MEMORY_BUDGET                                       MemoryBudget;
+
+    CONVERSION_PROGRESS_ROUTINE                         ProgressRoutine;    // Optional, see ReportConversionProgress
+    PVOID                                               ProgressContext;
+
+    //
+    // Part of a sharded conversion this process does, see ShardedConversion.cpp.
+    //
+    CONVERSION_SHARD_MODE                               ShardMode;
+    UINT32                                              ShardIndex;
+    UINT32                                              ShardCount;
 
     //
     // Dump file info
@@ -274,6 +562,12 @@ typedef struct _DMP_CONTEXT
     LPWSTR                                              WindowsDumpFilePath;
     HANDLE                                              WindowsDumpHandle;
     LARGE_INTEGER                                       WindowsDumpFileOffset;
+
+    //
+    // Unbuffered, write through handle on the dump file for the DDR pages,
+    // INVALID_HANDLE_VALUE if the volume does not allow one.
+    //
+    HANDLE                                              WindowsDumpDirectHandle;
     
     LPWSTR                                              rawdumpInfoFilePath;
     HANDLE                                              rawdumpInfoFileHandle;
@@ -290,6 +584,29 @@ typedef struct _DMP_CONTEXT
     UINT32                                              CompleteMemoryMapCount;
     PDDR_MEMORY_MAP                                     CompleteMemoryMap;
 
+    //
+    // Page hashes of the memory written to the dump, saved next to it as
+    // <dump>.pfp. Dropped, not fatal, if hashing fails.
+    //
+    PAGE_FINGERPRINT                                    PageFingerprint;
+    BOOL                                                PageFingerprintFailed;
+    UINT64                                              PageFingerprintCharge;  // Bytes charged to MemoryBudget
+
+    //
+    // Runs of the DUMP_HEADER.PhysicalMemoryBlock sorted by base, with the
+    // dump file offset of each run by run index, see BuildDumpRunIndex.
+    //
+    EXTENT_SET                                          RunIndex;
+    PUINT64                                             RunFileOffsets;
+
+    //
+    // Writes over memory already in the dump, see QueueDumpPatch.
+    //
+    PDUMP_PATCH                                         Patches;
+    UINT32                                              PatchCount;
+    UINT32                                              PatchCapacity;
+    UINT64                                              PatchBytes;             // Bytes charged to MemoryBudget
+
     // CPU Context
     LARGE_INTEGER                                       X86ContextPA;
 
@@ -297,6 +614,7 @@ typedef struct _DMP_CONTEXT
     // Data from Windows
     //
     LARGE_INTEGER                                       DumpHeaderPA;
+    LARGE_INTEGER                                       DumpHeaderPAHint;
     UINT64                                              DumpHeaderOffset;
     LARGE_INTEGER                                       DumpHeaderAddress;
     PDUMP_HEADER32                                      DumpHeader32;
@@ -314,6 +632,15 @@ typedef struct _DMP_CONTEXT
     PKDDEBUGGER_DATA64                                  KdDebuggerDataBlock;
     BOOL                                                GetKdBlockPAFromImMemData;
 
+    //
+    // Profile of the kernel build. KernelProfileHit is set while the cached
+    // profile is used in place of dbgeng, see LookupKernelProfile.
+    //
+    KERNEL_PROFILE                                      KernelProfile;
+    UINT64                                              KernelBase;
+    BOOL                                                KernelProfileKnown;     // Key read from the kernel image
+    BOOL                                                KernelProfileHit;
+
     DEVICE_SPECIFIC_INFO_STRUCT_TEMPLATE                DeviceSpecificInfo;
 
 
@@ -338,6 +665,7 @@ typedef struct _DMP_CONTEXT
 
 
     IN_MEM_DATA_INFO                                    InMemDataInfo;
+    PVOID                                               InMemDiagBuffer;    // Read by ReadInMemDiagBuffer
 
     //
     // The following flag indicates if the device specific info is present embed 
@@ -346,6 +674,43 @@ typedef struct _DMP_CONTEXT
     BOOL                                                IsDeviceInfoInRawDump;
 } DMP_CONTEXT, *PDMP_CONTEXT;
 
+//
+// A step of the conversion after the DUMP_HEADER is written. A phase runs as
+// soon as the phases in its DependsOn are done, one bit for each earlier
+// phase of the table.
+//
+typedef HRESULT (*CONVERSION_PHASE_ROUTINE)(_Inout_ PDMP_CONTEXT Context);
+
+#define CONVERSION_PHASE_REQUIRED         0x1   // Failure fails the conversion, nothing more is started
+#define CONVERSION_PHASE_CALLER_THREAD    0x2   // Uses dbgeng, which is bound to the thread that opened the dump
+
+#define CONVERSION_PHASE_BIT(Index)       (1UL << (Index))
+
+typedef struct _CONVERSION_PHASE
+{
+    PCSTR                       Name;
+    CONVERSION_PHASE_ROUTINE    Routine;
+    UINT32                      DependsOn;
+    UINT32                      Flags;
+} CONVERSION_PHASE, *PCONVERSION_PHASE;
+
+//
+// Phases of ExtractWindowsDumpFile and ExtractWindowsDumpFile64, indices into
+// their phase tables.
+//
+typedef enum _EXTRACT_PHASE
+{
+    ExtractPhaseDDR = 0,
+    ExtractPhaseSecondaryData,
+    ExtractPhaseFingerprint,
+    ExtractPhaseFindCPUContext,
+    ExtractPhaseReadInMemDiag,
+    ExtractPhaseKdDebuggerDataBlock,
+    ExtractPhaseUpdateCPUContext,
+    ExtractPhaseWriteInMemDiag,
+    ExtractPhaseCount
+} EXTRACT_PHASE;
+
 
 // 
 // Section Type values in the RAW_DUMP_HEADER
@@ -454,6 +819,22 @@ ReadFromDDRSectionByPhysicalAddress(
     _Out_ PVOID Buffer
     );
 
+HRESULT
+ReadFromDDRSectionBatch(
+    _In_ PDMP_CONTEXT Context,
+    _Inout_updates_(RequestCount) PBATCH_READ_REQUEST Requests,
+    _In_ UINT32 RequestCount
+    );
+
+HRESULT
+ReadRawDumpFile(
+    _In_ PDMP_CONTEXT Context,
+    _In_ LARGE_INTEGER Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ size_t Length,
+    _Out_opt_ size_t *BytesRead
+    );
+
 HRESULT UpdateContextFromXml(_Inout_ DMP_CONTEXT * pContext);
 NTSTATUS UpdateContextWithAPRegLegacy(_Inout_ PDMP_CONTEXT Context);
 
@@ -498,8 +879,15 @@ _Inout_ PLARGE_INTEGER      pdbgDataHeaderPA
 
 NTSTATUS ExtractRawDumpToFile(PDMP_CONTEXT Context);
 NTSTATUS VerifyRawDumpSectionTable(PDMP_CONTEXT Context);
+HRESULT OpenChunkedSections(_Inout_ PDMP_CONTEXT Context);
+VOID CloseChunkedSections(_Inout_ PDMP_CONTEXT Context);
+UINT64 GetRawDumpSectionOffset(_In_ PDMP_CONTEXT Context, _In_ UINT32 SectionIndex);
 HRESULT BuildCompleteMemoryMap(_Inout_ PDMP_CONTEXT Context);
 NTSTATUS BuildDDRMemoryMap(PDMP_CONTEXT Context);
+UINT32 FindDDRMemoryMapIndex(_In_ PDMP_CONTEXT Context, _In_ UINT64 PhysicalAddress);
+HRESULT BuildDDRExtentSet(_In_ PDMP_CONTEXT Context, _Out_ PEXTENT_SET DDRExtents);
+HRESULT BuildMemoryRunExtentSet(_In_ PDMP_CONTEXT Context, _Out_ PEXTENT_SET Runs);
+NTSTATUS ValidateMemoryRunsInDDR(_In_ PDMP_CONTEXT Context);
 VOID DumpGUID(_In_ GUID*  Guid);
 NTSTATUS ExtractWindowsDumpFile(PDMP_CONTEXT Context);
 HRESULT GetDumpHeader(_Inout_ PDMP_CONTEXT Context);
@@ -508,12 +896,52 @@ HRESULT InitDumpFile(_Inout_ PDMP_CONTEXT Context);
 HRESULT VerifyRawDumpHeader(PDMP_CONTEXT Context);
 HRESULT WriteDumpHeader(_Inout_ PDMP_CONTEXT Context);
 HRESULT WriteDDR(_Inout_ PDMP_CONTEXT Context);
+VOID AddPagesToFingerprint(_Inout_ PDMP_CONTEXT Context, _In_ UINT64 PhysicalAddress, _In_reads_bytes_(Size) PVOID Buffer, _In_ UINT32 Size, _In_ PAGE_FINGERPRINT_REGION Region);
+HRESULT WritePageFingerprint(_Inout_ PDMP_CONTEXT Context);
+HRESULT ReadInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context);
 HRESULT WriteInMemDiagBuffer(_Inout_ PDMP_CONTEXT Context);
 HRESULT WriteFakeDumpHeader(_Inout_ PDMP_CONTEXT Context);
 NTSTATUS GetKdDebuggerDataBlock(_Inout_ PDMP_CONTEXT Context);
+HRESULT FindKdDebuggerDataBlock(_Inout_ PDMP_CONTEXT Context);
 NTSTATUS UpdateContextX86(_Inout_ PDMP_CONTEXT Context);
 NTSTATUS GetX86CPUContext(_Inout_ PDMP_CONTEXT Context);
 HRESULT GetAPRegLegacy(_Inout_ PDMP_CONTEXT Context);
 BOOL ValidateKdDebuggerDataBlock(_In_ PDBGKD_DEBUG_DATA_HEADER64 Header);
 HRESULT WriteSVSpecific(_Inout_ PDMP_CONTEXT Context);
 HRESULT UpdateContextFromEmbedDeviceInfo(_Inout_ PDMP_CONTEXT Context);
+const GUID * LookupSVSectionGuid(_In_ PRAW_DUMP_SECTION_HEADER Section);
+HRESULT VerifyWindowsDumpFile(_Inout_ PDMP_CONTEXT Context, _In_ LPCWSTR RawDumpPath, _In_ LPCWSTR WindowsDumpPath, _Out_opt_ PUINT64 MismatchedBytes);
+HRESULT OpenRawDumpForSlices(_Inout_ PDMP_CONTEXT Context, _In_ LPCWSTR RawDumpPath, _Out_ PHANDLE hRawFile);
+VOID CloseRawDumpForSlices(_Inout_ PDMP_CONTEXT Context, _In_ HANDLE hRawFile);
+HRESULT ReadRawDumpSlice(_In_ PDMP_CONTEXT Context, _In_ HANDLE hRawFile, _In_ PCRITICAL_SECTION Lock, _In_ UINT64 Offset, _Out_writes_bytes_(Length) PVOID Buffer, _In_ UINT32 Length);
+VOID InitializeMemoryBudget(_Inout_ PDMP_CONTEXT Context, _In_ UINT64 Limit);
+VOID ReleaseMemoryBudget(_Inout_ PDMP_CONTEXT Context, _Out_opt_ PUINT64 PeakBytes);
+HRESULT ChargeMemoryBudget(_Inout_ PDMP_CONTEXT Context, _In_ UINT64 Size, _In_ BOOL Required);
+VOID ReturnMemoryBudget(_Inout_ PDMP_CONTEXT Context, _In_ UINT64 Size);
+HRESULT AllocatePooledBuffer(_Inout_ PDMP_CONTEXT Context, _In_ UINT32 PreferredSize, _In_ UINT32 MinimumSize, _Outptr_result_bytebuffer_(*Size) PVOID *Buffer, _Out_ PUINT32 Size);
+VOID FreePooledBuffer(_Inout_ PDMP_CONTEXT Context, _In_opt_ PVOID Buffer, _In_ UINT32 Size);
+VOID AttachWarmBuffers(_Inout_ PDMP_CONTEXT Context, _Inout_ PWARM_BUFFER_POOL Pool);
+VOID DetachWarmBuffers(_Inout_ PDMP_CONTEXT Context, _Inout_ PWARM_BUFFER_POOL Pool);
+VOID FreeWarmBuffers(_Inout_ PWARM_BUFFER_POOL Pool);
+VOID ReportConversionProgress(_In_ PDMP_CONTEXT Context, _In_ PCSTR Stage, _In_ UINT64 Done, _In_ UINT64 Total);
+HRESULT PlanDumpShards(_Inout_ PDMP_CONTEXT Context);
+HRESULT WriteDumpShard(_Inout_ PDMP_CONTEXT Context);
+HRESULT CheckDumpShards(_Inout_ PDMP_CONTEXT Context);
+HRESULT ServeConversionJobs(_In_ LPCWSTR PipeName, _In_ UINT32 MaxJobs, _In_ UINT64 MemoryBudget);
+HRESULT ConvertRawDumpWithOptions(_In_ LPWSTR RawDumpPath, _In_opt_ LPWSTR RawInfoFile, _In_opt_ LPWSTR LogFile, _In_ LPWSTR WindowsDumpFile, _In_ PCONVERSION_OPTIONS Options, _Out_opt_ PUINT64 PeakBytes);
+HRESULT RunConversionPhases(_Inout_ PDMP_CONTEXT Context, _In_reads_(PhaseCount) const CONVERSION_PHASE *Phases, _In_ UINT32 PhaseCount);
+VOID GetPhysicalMemoryRun(_In_ PDMP_CONTEXT Context, _In_ UINT32 Index, _Out_ PUINT64 BasePage, _Out_ PUINT64 PageCount);
+UINT32 GetPhysicalMemoryRunCount(_In_ PDMP_CONTEXT Context);
+HRESULT BuildDumpRunIndex(_Inout_ PDMP_CONTEXT Context);
+VOID FreeDumpRunIndex(_Inout_ PDMP_CONTEXT Context);
+NTSTATUS LookupDumpFileOffset(_In_ PDMP_CONTEXT Context, _In_ UINT64 PhysicalAddress, _In_ UINT32 Size, _Out_ PUINT64 FileOffset);
+HRESULT QueueDumpPatch(_Inout_ PDMP_CONTEXT Context, _In_ UINT64 FileOffset, _In_reads_bytes_(Size) const VOID *Buffer, _In_ UINT32 Size);
+HRESULT ApplyDumpPatches(_Inout_ PDMP_CONTEXT Context);
+VOID DiscardDumpPatches(_Inout_ PDMP_CONTEXT Context, _In_ UINT32 FirstPatch);
+VOID FreeDumpPatches(_Inout_ PDMP_CONTEXT Context);
+NTSTATUS ReadVirtualByPageWalk(_In_ PDMP_CONTEXT Context, _In_ UINT64 VirtualAddress, _In_ UINT32 Length, _Out_writes_bytes_(Length) PVOID Buffer, _Out_opt_ PLARGE_INTEGER PhysicalAddress);
+VOID LookupKernelProfile(_Inout_ PDMP_CONTEXT Context);
+BOOL CheckKernelProfile(_In_ PDMP_CONTEXT Context);
+VOID SaveKernelProfile(_Inout_ PDMP_CONTEXT Context);
+HANDLE GetDDRWriteHandle(_In_ PDMP_CONTEXT Context, _In_ LARGE_INTEGER FileOffset);
+HRESULT SearchRawDumpFile(_Inout_ PDMP_CONTEXT Context, _In_ LPCWSTR RawDumpPath, _In_ UINT32 PatternCount, _In_reads_(PatternCount) LPCWSTR *Patterns, _In_ LPCWSTR ResultPath, _Out_opt_ PUINT64 HitCount);
@@ -11,6 +11,7 @@
 
 #include "raw2dump.h"
 #include "dumputil.h"
+#include "ConversionServer.h"
 #include "dbgclient.h"
 
 //
@@ -38,10 +39,8 @@ void CleanupDmpContext(PDMP_CONTEXT Context)
         Context->DumpHeader64 = nullptr;
     }
 
-    if (Context->IoBuffer) {
-        HeapFree(GetProcessHeap(), NULL, Context->IoBuffer);
-        Context->IoBuffer = nullptr;
-    }
+    FreePooledBuffer(Context, Context->IoBuffer, Context->IoBufferSize);
+    Context->IoBuffer = nullptr;
 
     if (Context->RawDumpSectionTable) {
         HeapFree(GetProcessHeap(), NULL, Context->RawDumpSectionTable);
@@ -53,32 +52,57 @@ void CleanupDmpContext(PDMP_CONTEXT Context)
         Context->KdDebuggerDataBlock = nullptr;
     }
 
+    if (Context->InMemDiagBuffer) {
+        HeapFree(GetProcessHeap(), NULL, Context->InMemDiagBuffer);
+        Context->InMemDiagBuffer = nullptr;
+    }
+
+    PageFingerprintFree(&Context->PageFingerprint);
+    FreeDumpPatches(Context);
+    FreeDumpRunIndex(Context);
+
     if (Context->WindowsDumpHandle != INVALID_HANDLE_VALUE)
     {
        CloseHandle(Context->WindowsDumpHandle);
        Context->WindowsDumpHandle = INVALID_HANDLE_VALUE;
     }
 
+    if (Context->WindowsDumpDirectHandle != INVALID_HANDLE_VALUE)
+    {
+       CloseHandle(Context->WindowsDumpDirectHandle);
+       Context->WindowsDumpDirectHandle = INVALID_HANDLE_VALUE;
+    }
+
     if (nullptr != Context->RawDumpSectionTable)
     {
        HeapFree(GetProcessHeap(), NULL, Context->RawDumpSectionTable);
        Context->RawDumpSectionTable = nullptr;
     }
 
+    ReleaseMemoryBudget(Context, nullptr);
 }
 
 
-// This function takes the path to rawdump and rawdump info file and outputs a windows dump file.
-bool
-ConvertRawToDump(
+// This function converts a rawdump to a windows dump file with the settings in options: the memory
+// budget, the buffers to start with and where to report progress. Conversions in one process must not
+// overlap, the log file and the debugger engine are process wide.
+HRESULT
+ConvertRawDumpWithOptions(
     _In_ LPWSTR rawDumpPath,
-    _In_ LPWSTR rawInfoFile,
-    _In_ LPWSTR logFile,
-    _In_ LPWSTR windowsDumpFile
+    _In_opt_ LPWSTR rawInfoFile,
+    _In_opt_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile,
+    _In_ PCONVERSION_OPTIONS options,
+    _Out_opt_ PUINT64 peakBytes
     )
-{    
+{
     HRESULT hr = S_OK;
     DMP_CONTEXT context = { 0 };    // declare and init the context
+    WCHAR shardLogFile[MAX_PATH];
+
+    if (peakBytes) {
+        *peakBytes = 0;
+    }
 
     // Check if the inputs are correct.
     if (rawDumpPath &&
@@ -98,6 +122,14 @@ ConvertRawToDump(
         //
         logFile = L"raw2dump.log";
         context.IsDeviceInfoInRawDump = TRUE;
+
+        //
+        // Shards run side by side, each keeps its own log.
+        //
+        if ((options->ShardMode == ConversionShardWorker) &&
+            SUCCEEDED(StringCchPrintfW(shardLogFile, ARRAYSIZE(shardLogFile), L"raw2dump.shard%u.log", options->ShardIndex))) {
+            logFile = shardLogFile;
+        }
     }
     else {
         context.IsDeviceInfoInRawDump = FALSE;
@@ -110,16 +142,230 @@ ConvertRawToDump(
 
     context.rawdumpInfoFilePath = rawInfoFile;
 
+    InitializeMemoryBudget(&context, options->MemoryBudget);
+    if (options->WarmPool != nullptr) {
+        AttachWarmBuffers(&context, options->WarmPool);
+    }
+
+    context.ProgressRoutine = options->ProgressRoutine;
+    context.ProgressContext = options->ProgressContext;
+
+    context.ShardMode = options->ShardMode;
+    context.ShardIndex = options->ShardIndex;
+    context.ShardCount = options->ShardCount;
+    if (context.ShardMode != ConversionShardNone) {
+        //
+        // No one process sees all of DDR.
+        //
+        TraceInfo("Sharded conversion, no page fingerprint is written");
+        context.PageFingerprintFailed = TRUE;
+    }
+
     hr = ExtractRawDumpFile(&context, rawDumpPath);
     if (FAILED(hr)) {
         TraceHRESULT("ExtractRawDumpFile failed", hr);
     }
 
+    //
+    // The debugger engine keeps the dump open otherwise, and would hand it to
+    // the next conversion in this process.
+    //
+    DbgClient::Uninitialize();
+
+    //
+    // Report the peak memory use while the log is still open.
+    //
+    FreePooledBuffer(&context, context.IoBuffer, context.IoBufferSize);
+    context.IoBuffer = nullptr;
+    if (options->WarmPool != nullptr) {
+        DetachWarmBuffers(&context, options->WarmPool);
+    }
+
+    ReleaseMemoryBudget(&context, peakBytes);
+
     CloseLogFile();
 
 Error:
     CleanupDmpContext(&context);
+    return hr;
+
+}
+
+
+// This function takes the path to rawdump and rawdump info file and outputs a windows dump file,
+// keeping the memory it allocates for buffers, maps and caches within memoryBudget bytes (0 for no
+// limit) by using smaller I/O sizes. The peak of that memory is returned in peakBytes.
+HRESULT
+ConvertRawToDumpWithBudget(
+    _In_ LPWSTR rawDumpPath,
+    _In_ LPWSTR rawInfoFile,
+    _In_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile,
+    _In_ UINT64 memoryBudget,
+    _Out_opt_ PUINT64 peakBytes
+    )
+{
+    CONVERSION_OPTIONS options = { 0 };
+
+    options.MemoryBudget = memoryBudget;
+
+    return ConvertRawDumpWithOptions(rawDumpPath, rawInfoFile, logFile, windowsDumpFile, &options, peakBytes);
+}
+
+
+// This function takes the path to rawdump and rawdump info file and outputs a windows dump file.
+bool
+ConvertRawToDump(
+    _In_ LPWSTR rawDumpPath,
+    _In_ LPWSTR rawInfoFile,
+    _In_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile
+    )
+{
+    HRESULT hr = ConvertRawToDumpWithBudget(rawDumpPath, rawInfoFile, logFile, windowsDumpFile, 0, nullptr);
+
     return !SUCCEEDED(hr);
+}
+
+
+// These functions convert a rawdump in parts, which may run in separate processes or on separate
+// machines sharing the files. PlanRawToDumpShards writes the DUMP_HEADER and <dump>.shards, which
+// splits DDR into shardCount shards. ConvertRawToDumpShard copies one shard into the dump; shards may
+// run in any order and at the same time, each with its own log file. StitchRawToDumpShards finishes
+// the dump once all shards are done.
+HRESULT
+PlanRawToDumpShards(
+    _In_ LPWSTR rawDumpPath,
+    _In_opt_ LPWSTR rawInfoFile,
+    _In_opt_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile,
+    _In_ UINT32 shardCount
+    )
+{
+    CONVERSION_OPTIONS options = { 0 };
+
+    options.ShardMode = ConversionShardPlan;
+    options.ShardCount = shardCount;
+
+    return ConvertRawDumpWithOptions(rawDumpPath, rawInfoFile, logFile, windowsDumpFile, &options, nullptr);
+}
 
+
+HRESULT
+ConvertRawToDumpShard(
+    _In_ LPWSTR rawDumpPath,
+    _In_opt_ LPWSTR rawInfoFile,
+    _In_opt_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile,
+    _In_ UINT32 shardIndex
+    )
+{
+    CONVERSION_OPTIONS options = { 0 };
+
+    options.ShardMode = ConversionShardWorker;
+    options.ShardIndex = shardIndex;
+
+    return ConvertRawDumpWithOptions(rawDumpPath, rawInfoFile, logFile, windowsDumpFile, &options, nullptr);
+}
+
+
+HRESULT
+StitchRawToDumpShards(
+    _In_ LPWSTR rawDumpPath,
+    _In_opt_ LPWSTR rawInfoFile,
+    _In_opt_ LPWSTR logFile,
+    _In_ LPWSTR windowsDumpFile
+    )
+{
+    CONVERSION_OPTIONS options = { 0 };
+
+    options.ShardMode = ConversionShardStitch;
+
+    return ConvertRawDumpWithOptions(rawDumpPath, rawInfoFile, logFile, windowsDumpFile, &options, nullptr);
+}
+
+
+// This function serves conversion jobs on a local named pipe until a client asks it to stop, see
+// ConversionServer.h. Jobs run one at a time, at most maxJobs may be queued or running, and each is
+// limited to memoryBudget bytes (0 for no limit). pipeName defaults to CONVERSION_SERVER_PIPE_NAME.
+HRESULT
+RunConversionServer(
+    _In_opt_ LPWSTR pipeName,
+    _In_ UINT32 maxJobs,
+    _In_ UINT64 memoryBudget
+    )
+{
+    if (maxJobs == 0) {
+        maxJobs = CONVERSION_SERVER_DEFAULT_QUEUE;
+    }
+
+    return ServeConversionJobs((pipeName != nullptr) ? pipeName : CONVERSION_SERVER_PIPE_NAME,
+                               maxJobs,
+                               memoryBudget);
 }
 
+
+// This function checks a windows dump file against the rawdump it was converted from.
+HRESULT
+VerifyRawToDump(
+    _In_ LPWSTR rawDumpPath,
+    _In_ LPWSTR windowsDumpFile,
+    _Out_opt_ PUINT64 mismatchedBytes
+    )
+{
+    HRESULT hr = S_OK;
+    DMP_CONTEXT context = { 0 };    // declare and init the context
+
+    // Check if the inputs are correct.
+    if (!rawDumpPath || !windowsDumpFile) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("Invalid Path", hr);
+        goto Error;
+    }
+
+    hr = VerifyWindowsDumpFile(&context, rawDumpPath, windowsDumpFile, mismatchedBytes);
+    if (FAILED(hr)) {
+        TraceHRESULT("VerifyWindowsDumpFile failed", hr);
+    }
+    else if (hr == S_FALSE) {
+        TraceInfo("Windows dump file differs from the rawdump");
+    }
+
+Error:
+    CleanupDmpContext(&context);
+    return hr;
+}
+
+
+// This function searches the DDR sections of a rawdump for byte patterns.
+HRESULT
+SearchRawDump(
+    _In_ LPWSTR rawDumpPath,
+    _In_ UINT32 patternCount,
+    _In_reads_(patternCount) LPWSTR *patterns,
+    _In_ LPWSTR resultFile,
+    _Out_opt_ PUINT64 hitCount
+    )
+{
+    HRESULT hr = S_OK;
+    DMP_CONTEXT context = { 0 };    // declare and init the context
+
+    // Check if the inputs are correct.
+    if (!rawDumpPath || !patterns || !resultFile) {
+        hr = E_INVALIDARG;
+        TraceHRESULT("Invalid Path", hr);
+        goto Error;
+    }
+
+    hr = SearchRawDumpFile(&context, rawDumpPath, patternCount, (LPCWSTR *)patterns, resultFile, hitCount);
+    if (FAILED(hr)) {
+        TraceHRESULT("SearchRawDumpFile failed", hr);
+    }
+    else if (hr == S_FALSE) {
+        TraceInfo("Search stopped at the hit limit");
+    }
+
+Error:
+    CleanupDmpContext(&context);
+    return hr;
+}
@@ -7,5 +7,50 @@ namespace Raw2Dump
         _In_ LPWSTR rawInfoFile, 
         _In_ LPWSTR logFile,
         _In_ LPWSTR windowsDumpFile);
+
+    HRESULT ConvertRawToDumpWithBudget(
+        _In_ LPWSTR rawDumpPath,
+        _In_ LPWSTR rawInfoFile,
+        _In_ LPWSTR logFile,
+        _In_ LPWSTR windowsDumpFile,
+        _In_ UINT64 memoryBudget,
+        _Out_opt_ PUINT64 peakBytes);
+
+    HRESULT PlanRawToDumpShards(
+        _In_ LPWSTR rawDumpPath,
+        _In_opt_ LPWSTR rawInfoFile,
+        _In_opt_ LPWSTR logFile,
+        _In_ LPWSTR windowsDumpFile,
+        _In_ UINT32 shardCount);
+
+    HRESULT ConvertRawToDumpShard(
+        _In_ LPWSTR rawDumpPath,
+        _In_opt_ LPWSTR rawInfoFile,
+        _In_opt_ LPWSTR logFile,
+        _In_ LPWSTR windowsDumpFile,
+        _In_ UINT32 shardIndex);
+
+    HRESULT StitchRawToDumpShards(
+        _In_ LPWSTR rawDumpPath,
+        _In_opt_ LPWSTR rawInfoFile,
+        _In_opt_ LPWSTR logFile,
+        _In_ LPWSTR windowsDumpFile);
+
+    HRESULT RunConversionServer(
+        _In_opt_ LPWSTR pipeName,
+        _In_ UINT32 maxJobs,
+        _In_ UINT64 memoryBudget);
+
+    HRESULT VerifyRawToDump(
+        _In_ LPWSTR rawDumpPath,
+        _In_ LPWSTR windowsDumpFile,
+        _Out_opt_ PUINT64 mismatchedBytes);
+
+    HRESULT SearchRawDump(
+        _In_ LPWSTR rawDumpPath,
+        _In_ UINT32 patternCount,
+        _In_reads_(patternCount) LPWSTR *patterns,
+        _In_ LPWSTR resultFile,
+        _Out_opt_ PUINT64 hitCount);
 }
 
@@ -12,14 +12,14 @@ Author:
    radutta 
 --*/
 #include "common.h"
-#include <atlbase.h>
-#include <dbgeng.h>
+#include "Dump_Blob.h"
 
 #define IO_BUFFER_SIZE 0x800000
 
 typedef enum {
     MEMORY_OS = 1,
-    MEMORY_NONOS = 2
+    MEMORY_NONOS = 2,
+    MEMORY_NA = 3
 } MEMORY_TYPE;
 
 #define NON_OS_DDR_GUID {0x3B9DEA8E, 0x75BE, 0x478F, {0x9F, 0xB4, 0x7D, 0x2C, 0x5F, 0x9D, 0xDE, 0x31}};
@@ -78,69 +78,23 @@ static SV_SPECIFIC_NAME_TO_GUID GUIDToName[] = {{0xAB3A051F, 0xEF0B, 0x4A5F, {0x
 HRESULT
 ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
 {
-    CComPtr<IDebugDataSpaces4>  pDbgDataSpaces;
-    CComPtr<IDebugClient5>      pDbgClient;
-    CComPtr<IDebugControl4>     pDbgControl;
     HRESULT                     hr = S_OK;
     UINT32                      guidToNameIndex = 0;
     UINT32                      guidToNameTableSize = 0;
-    LPBYTE                      pData = NULL;
-    ULONG                       secondaryDataSize = 0;
     ULONG                       buffersize = 0;
     size_t                      BytesWritten = 0;
     WCHAR                       Filename[MAX_PATH];
     DEVICE_IO                   hFile;
+    PDUMP_FILE_VIEW             dumpView = NULL;
+    const DUMP_BLOB             *blob = NULL;
 
     guidToNameTableSize = sizeof(GUIDToName) / sizeof(GUIDToName[0]);
 
-    hr = DebugCreate(
-                __uuidof(IDebugClient5), 
-                (void**) &pDbgClient
-                );
-
-    if (FAILED(hr) || pDbgClient == NULL) {
-          LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to  Get IDebugClient5");
-            goto Exit;
-    }
-    
-    hr = pDbgClient->QueryInterface(
-                        __uuidof(IDebugControl4),
-                        (void**) &pDbgControl
-                        );
-    if (FAILED(hr) || pDbgControl == NULL) {
-            LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to  Get IDebugControl4");
-            goto Exit;
-    }
-   
-    hr = pDbgClient->QueryInterface(
-                        __uuidof(IDebugDataSpaces4),
-                        (void**) &pDbgDataSpaces
-                        );
-
-    if (FAILED(hr) ||pDbgDataSpaces == NULL ) {
-            LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to  Get IDebugDataSpaces4");
-        goto Exit;
-    }
-
-    hr = pDbgClient->OpenDumpFileWide(
-                dumpfile,
-                NULL
-                );
+    //
+    // Map the dump and index its secondary data, the blobs are read
+    // in place from the mapping.
+    //
+    hr = OpenDumpFileView(dumpfile, &dumpView);
     if (FAILED(hr)) {
             LogLibErrorPrintf(
                 hr,
@@ -153,20 +107,7 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
         goto Exit;
     }
 
-    hr = pDbgControl->WaitForEvent(
-                0,
-                INFINITE
-                );
-
-    if (FAILED(hr)) {
-          LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to WaitForEvent");
-        goto Exit;
-    }
+    LogLibInfoPrintf(L"Dump file has %u secondary data blobs.\r\n", dumpView->BlobCount);
 
     // Find the matching GUID for the section name.
     //
@@ -175,29 +116,11 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
         LogLibInfoPrintf(L"Extracting data for %s.",
                          GUIDToName[guidToNameIndex].Name);
 
-        hr = pDbgDataSpaces->ReadTagged(
-            &(GUIDToName[guidToNameIndex].Guid),
-            0,
-            pData,
-            0,
-            &secondaryDataSize
-        );
-
-        if (FAILED(hr)) {
-            if (hr == E_NOINTERFACE) {
-                LogLibInfoPrintf(L" Data not found for %s",
-                                 GUIDToName[guidToNameIndex].Name);
-                continue;
-            } else {
-                LogLibErrorPrintf(
-                    hr,
-                    __LINE__,
-                    WIDEN(__FUNCTION__),
-                    __WFILE__,
-                    L" Failed to ReadTagged for size. HR: 0x%x",
-                    hr);
-                goto Exit;
-            }
+        blob = FindDumpBlob(dumpView, GUIDToName[guidToNameIndex].Guid);
+        if (blob == NULL) {
+            LogLibInfoPrintf(L" Data not found for %s",
+                             GUIDToName[guidToNameIndex].Name);
+            continue;
         }
 
         //
@@ -209,49 +132,22 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
         //
         // Buffer should at least have the 20 byte name. 
         //
-        if (secondaryDataSize < RAW_DUMP_SECTION_HEADER_NAME_LENGTH) {
+        if (blob->DataSize < RAW_DUMP_SECTION_HEADER_NAME_LENGTH) {
             LogLibErrorPrintf(
                 hr,
                 __LINE__,
                 WIDEN(__FUNCTION__),
                 __WFILE__,
                 L" Data size is less than expected. Actual: 0x%x bytes",
-                secondaryDataSize);
+                blob->DataSize);
             continue;
         }
 
-        buffersize = secondaryDataSize - RAW_DUMP_SECTION_HEADER_NAME_LENGTH;
-        pData = (LPBYTE)malloc(buffersize);
-        if (pData == NULL) {
-            LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to allocate data ");
-            goto Exit;
-        }
-
-        hr = pDbgDataSpaces->ReadTagged(
-            &(GUIDToName[guidToNameIndex].Guid),
-            RAW_DUMP_SECTION_HEADER_NAME_LENGTH,
-            pData,
-            buffersize,
-            &secondaryDataSize
-        );
-        if (FAILED(hr)) {
-            LogLibErrorPrintf(
-                hr,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to ReadTagged for Data");
-            goto Exit;
-        }
+        buffersize = blob->DataSize - RAW_DUMP_SECTION_HEADER_NAME_LENGTH;
 
         wsprintf(Filename, L"%s", GUIDToName[guidToNameIndex].Name);
 
-        if (FALSE == hFile.Open(Filename))
+        if (FAILED(hFile.Open(Filename)))
         {
             LogLibErrorPrintf(
                 GetLastError(),
@@ -262,7 +158,7 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
             goto Exit;
         }
 
-        if (FAILED(hFile.Write((PCHAR)pData, buffersize, &BytesWritten)))
+        if (FAILED(hr = hFile.Write((PCHAR)(blob->Data + RAW_DUMP_SECTION_HEADER_NAME_LENGTH), buffersize, &BytesWritten)))
         {
             LogLibErrorPrintf(
                 GetLastError(),
@@ -274,10 +170,6 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
         }
 
         hFile.Close();
-        if (pData) {
-            free(pData);
-            pData = NULL;
-        }
         LogLibInfoPrintf(L"Written SV section to File %s.\r\n", Filename);
     }
 
@@ -285,9 +177,7 @@ ExtractSecondaryDataFromDumpFile(LPWSTR dumpfile)
 
 Exit:
     hFile.Close();
-    if(pData) {
-        free(pData);
-    }
+    CloseDumpFileView(dumpView);
 
     return hr;
 }
@@ -314,18 +204,19 @@ DumpDDRMemoryMap(
 HRESULT
 CopyFromDumpToBin(
     DEVICE_IO *outFile,
-    LPBYTE IoBuffer,
+    LPBYTE ZeroBuffer,
     PULONG NonOSByteOffset,
     PDDR_MEMORY_MAP Map,
-    IDebugDataSpaces4 *DataSpaces
+    const DUMP_FILE_VIEW *DumpView,
+    const DUMP_BLOB *NonOSBlob
 )
 {
     HRESULT         hr = S_OK;
 
-    if ((nullptr == DataSpaces) ||
+    if ((nullptr == DumpView) ||
         (nullptr == Map) ||
         (nullptr == NonOSByteOffset) ||
-        (nullptr == IoBuffer) ||
+        (nullptr == ZeroBuffer) ||
         (nullptr == outFile)
         )
     {
@@ -336,7 +227,6 @@ CopyFromDumpToBin(
         ULONG64         base = Map->Base;
         ULONG           bytesRemain = (ULONG)Map->Size;
         ULONG           ioIterations = (ULONG)(Map->Size / IO_BUFFER_SIZE);
-        GUID            nonOSMemoryGUID = NON_OS_DDR_GUID;
         ULONG           offset = *NonOSByteOffset;
 
 
@@ -349,63 +239,59 @@ CopyFromDumpToBin(
                          ioIterations,
                          Map->Size);
 
-        RtlZeroMemory(IoBuffer, IO_BUFFER_SIZE);
-
         for (ULONG ioIteration = 0; ioIteration < ioIterations; ioIteration++)
         {
-            ULONG           bytesRead = 0;
+            const UCHAR     *data = NULL;
             size_t          bytesWritten = 0;
             ULONG           ioSizeInBytes = (bytesRemain < IO_BUFFER_SIZE) ? bytesRemain : IO_BUFFER_SIZE;
 
             if (Map->Type == MEMORY_NONOS)
             {
-                LogLibInfoPrintf(L"[%u] Calling ReadTagged. Offset: 0x%x Size: 0x%x\r\n",
+                LogLibInfoPrintf(L"[%u] Slicing NonOS data. Offset: 0x%x Size: 0x%x\r\n",
                                  ioIteration,
                                  offset,
                                  ioSizeInBytes);
 
-                if (FAILED(hr = DataSpaces->ReadTagged(&nonOSMemoryGUID,
-                                                       offset,
-                                                       IoBuffer,
-                                                       ioSizeInBytes,
-                                                       NULL))
-                    )
+                if ((NonOSBlob == nullptr) ||
+                    (offset > NonOSBlob->DataSize) ||
+                    (ioSizeInBytes > (NonOSBlob->DataSize - offset)))
                 {
+                    hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
                     LogLibErrorPrintf(
                         hr,
                         __LINE__,
                         WIDEN(__FUNCTION__),
                         __WFILE__,
-                        L" Failed to ReadTagged for Data. Result: 0x%x", hr);
+                        L" NonOS data is missing or too short. Result: 0x%x", hr);
                     goto Exit;
                 }
 
-                bytesRead = ioSizeInBytes;
+                data = NonOSBlob->Data + offset;
             }
             else if (Map->Type == MEMORY_OS)
             {
-                LogLibInfoPrintf(L"[%u] Calling ReadPhysical. Base: 0x%I64x Size: 0x%x\r\n",
+                LogLibInfoPrintf(L"[%u] Slicing physical memory. Base: 0x%I64x Size: 0x%x\r\n",
                                  ioIteration,
                                  base,
                                  ioSizeInBytes);
 
-                DataSpaces->ReadPhysical((ULONG64)base,
-                                         IoBuffer,
-                                         ioSizeInBytes,
-                                         &bytesRead);
-
-                if (bytesRead != ioSizeInBytes)
+                if (FAILED(hr = GetDumpPhysicalSlice(DumpView, base, ioSizeInBytes, &data)))
                 {
-                    hr = E_FAIL;
                     LogLibErrorPrintf(
-                        E_FAIL,
+                        hr,
                         __LINE__,
                         WIDEN(__FUNCTION__),
                         __WFILE__,
                         L" Failed to read physical memory.");
                     goto Exit;
                 }
-
+            }
+            else if (Map->Type == MEMORY_NA)
+            {
+                //
+                // Not captured, keep the layout of the DDR section.
+                //
+                data = ZeroBuffer;
             }
             else
             {
@@ -422,7 +308,7 @@ CopyFromDumpToBin(
             //
             // Write to the bin file.
             //
-            if (FAILED(hr = outFile->Write((PCHAR)IoBuffer, bytesRead, &bytesWritten)))
+            if (FAILED(hr = outFile->Write((PCHAR)data, ioSizeInBytes, &bytesWritten)))
             {
                 LogLibErrorPrintf(
                     hr,
@@ -432,7 +318,7 @@ CopyFromDumpToBin(
                     L" ERROR: Failed on write DDR Section to File.");
                 goto Exit;
             }
-            else if (bytesRead != bytesWritten)
+            else if (ioSizeInBytes != bytesWritten)
             {
                 hr = E_FAIL;
                 LogLibErrorPrintf(
@@ -441,7 +327,7 @@ CopyFromDumpToBin(
                     WIDEN(__FUNCTION__),
                     __WFILE__,
                     L" ERROR: write DDR Section incorrect number of bytes, Expected: %#x  Actual: %#x",
-                    bytesRead, bytesWritten);
+                    ioSizeInBytes, bytesWritten);
                 goto Exit;
             }
 
@@ -473,9 +359,6 @@ CopyFromDumpToBin(
 HRESULT
 ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
 {
-    CComPtr<IDebugDataSpaces4>  pDbgDataSpaces;
-    CComPtr<IDebugClient5>      pDbgClient;
-    CComPtr<IDebugControl4>     pDbgControl;
     HRESULT                     hr = S_OK;
     ULONG                       mapSize = 0;
     WCHAR                       filename[MAX_PATH];
@@ -485,59 +368,14 @@ ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
     ULONG                       mapIndex = 0;
     ULONG                       nonOSByteOffset = 0;
     ULONG                       previousDDRSectionIndex = 0;
-    LPBYTE                      ioBuffer = NULL;
+    LPBYTE                      zeroBuffer = NULL;
     PDDR_MEMORY_MAP             memMap = NULL;
-    ULONG                       totalSizeInBytes = 0;
     GUID                        nonOSMemoryGUID = NON_OS_DDR_GUID;
+    PDUMP_FILE_VIEW             dumpView = NULL;
+    const DUMP_BLOB             *memMapBlob = NULL;
+    const DUMP_BLOB             *nonOSBlob = NULL;
 
-    hr = DebugCreate(
-        __uuidof(IDebugClient5),
-        (void**)&pDbgClient
-    );
-
-    if (FAILED(hr) || pDbgClient == NULL) {
-        LogLibErrorPrintf(
-            hr,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Failed to  Get IDebugClient5");
-        goto Exit;
-    }
-
-    hr = pDbgClient->QueryInterface(
-        __uuidof(IDebugControl4),
-        (void**)&pDbgControl
-    );
-    if (FAILED(hr) || pDbgControl == NULL) {
-        LogLibErrorPrintf(
-            hr,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Failed to  Get IDebugControl4");
-        goto Exit;
-    }
-
-    hr = pDbgClient->QueryInterface(
-        __uuidof(IDebugDataSpaces4),
-        (void**)&pDbgDataSpaces
-    );
-
-    if (FAILED(hr) || pDbgDataSpaces == NULL) {
-        LogLibErrorPrintf(
-            hr,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Failed to  Get IDebugDataSpaces4");
-        goto Exit;
-    }
-
-    hr = pDbgClient->OpenDumpFileWide(
-        dumpfile,
-        NULL
-    );
+    hr = OpenDumpFileView(dumpfile, &dumpView);
     if (FAILED(hr)) {
         LogLibErrorPrintf(
             hr,
@@ -549,30 +387,9 @@ ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
         goto Exit;
     }
 
-    hr = pDbgControl->WaitForEvent(
-        0,
-        INFINITE
-    );
-
-    if (FAILED(hr)) {
-        LogLibErrorPrintf(
-            hr,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Failed to WaitForEvent");
-        goto Exit;
-    }
-
-    hr = pDbgDataSpaces->ReadTagged(
-        &memMapGUID,
-        0,
-        NULL,
-        0,
-        &mapSize
-    );
-
-    if (FAILED(hr)) {
+    memMapBlob = FindDumpBlob(dumpView, memMapGUID);
+    if (memMapBlob == NULL) {
+        hr = E_NOINTERFACE;
         LogLibErrorPrintf(
             hr,
             __LINE__,
@@ -582,16 +399,21 @@ ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
         goto Exit;
     }
 
+    mapSize = memMapBlob->DataSize;
     mapCount = mapSize / sizeof(DDR_MEMORY_MAP);
 
     LogLibInfoPrintf(L"Data size for memory map is: 0x%x. Number of elements: %u\r\n",
                      mapSize,
                      mapCount);
 
+    //
+    // The map is small, copy it out of the mapping so the entries are aligned.
+    //
     memMap = (PDDR_MEMORY_MAP)malloc(mapSize);
 
     if (memMap == NULL)
     {
+        hr = E_OUTOFMEMORY;
         LogLibErrorPrintf(
             E_FAIL,
             __LINE__,
@@ -602,36 +424,17 @@ ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
         goto Exit;
     }
 
-    hr = pDbgDataSpaces->ReadTagged(&memMapGUID,
-                                    0,
-                                    memMap,
-                                    mapSize,
-                                    &mapSize
-    );
-
-    if (FAILED(hr)) {
-        LogLibErrorPrintf(
-            hr,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Failed to find memory map GUID");
-        goto Exit;
-    }
+    memcpy(memMap, memMapBlob->Data, mapSize);
 
-    hr = pDbgDataSpaces->ReadTagged(&nonOSMemoryGUID,
-                                    0,
-                                    NULL,
-                                    0,
-                                    &totalSizeInBytes
-    );
+    nonOSBlob = FindDumpBlob(dumpView, nonOSMemoryGUID);
 
-    LogLibInfoPrintf(L"Total size of NonOS data is 0x%x\r\n", totalSizeInBytes);
+    LogLibInfoPrintf(L"Total size of NonOS data is 0x%x\r\n", (nonOSBlob != NULL) ? nonOSBlob->DataSize : 0);
 
-    ioBuffer = (LPBYTE)malloc(IO_BUFFER_SIZE);
+    zeroBuffer = (LPBYTE)calloc(1, IO_BUFFER_SIZE);
 
-    if (ioBuffer == NULL)
+    if (zeroBuffer == NULL)
     {
+        hr = E_OUTOFMEMORY;
         LogLibErrorPrintf(
             E_FAIL,
             __LINE__,
@@ -692,10 +495,11 @@ ReconstructDDRSectionsFromDumpFile(LPWSTR dumpfile)
                          mapIndex);
 
         hr = CopyFromDumpToBin(&hFile,
-                               ioBuffer,
+                               zeroBuffer,
                                &nonOSByteOffset,
                                &memMap[mapIndex],
-                               pDbgDataSpaces);
+                               dumpView,
+                               nonOSBlob);
 
         if (FAILED(hr)) {
             LogLibErrorPrintf(
@@ -720,12 +524,14 @@ Exit:
         memMap = NULL;
     }
 
-    if (ioBuffer != NULL)
+    if (zeroBuffer != NULL)
     {
-        free(ioBuffer);
-        ioBuffer = NULL;
+        free(zeroBuffer);
+        zeroBuffer = NULL;
     }
 
+    CloseDumpFileView(dumpView);
+
     return hr;
 }
 
@@ -241,6 +241,14 @@ typedef struct _SV_SPECIFIC_NAME_TO_GUID
 
 #define ADDRESS_NOT_PRESENT ((UINT64)-1)
 
+//
+// DDR sections are extracted and merged by up to MAX_DDR_WORKER_THREADS
+// threads. The merged image holds every section at (base - lowest base).
+//
+#define DDR_MERGED_FILE_NAME            L"merged.bin"
+#define MAX_DDR_WORKER_THREADS          16
+#define DDR_PROGRESS_INTERVAL_MS        500
+
 //
 // ----------------------------------------------------------------- Prototypes
 //
@@ -290,10 +298,6 @@ ExtractWindowsDumpFromDDR( PDMP_CONTEXT Context,
                            LPWSTR FileName
                           );
 
-BOOL MergeFile(
-    HANDLE hTo, 
-    HANDLE hFrom);
-
 BOOL MergeDDRFiles(PDMP_CONTEXT Context, 
                 _Inout_ PCOMMAND_LINE_ARGS arguments,
                 LPWSTR mergedfile );
@@ -835,7 +835,7 @@ ReadFromDDRSectionByVirtualAddress(
 
 BOOL
 ISContainDumpHeader(
-    _In_ PDMP_CONTEXT Context,
+    _Out_opt_ BOOL* Is64Bit,
     _In_ BYTE* buffer,
     _In_ LONG  buffersize,
     _In_ LONG* offset)
@@ -877,7 +877,8 @@ ISContainDumpHeader(
             }
             else if (memcmp((buffer + *offset), PAGEDUMP64, sizeof(PAGEDUMP64)) == 0)
             {
-                Context->Is64Bit = TRUE;
+                if (Is64Bit != nullptr)
+                    *Is64Bit = TRUE;
                 LogLibInfoPrintf(L"Dump header type is PAGEDU64");
                 goto EXIT;
             }
@@ -958,7 +959,7 @@ SearchDumpHeaderAndAPREG(_Inout_ PDMP_CONTEXT Context)
 
         if (!foundDumpHeader)
         { // Check for a Dump Header in this buffer
-            foundDumpHeader = ISContainDumpHeader(Context, (BYTE*)buffer, buffersize, &bufferOffset);
+            foundDumpHeader = ISContainDumpHeader(&Context->Is64Bit, (BYTE*)buffer, buffersize, &bufferOffset);
             if (foundDumpHeader)
             {
                 Context->DumpHeaderAddress.QuadPart = curOffset.QuadPart + bufferOffset;
@@ -1169,6 +1170,306 @@ Exit:
     return result;
 }
 
+//
+// Result of the header search in one DDR section. Addresses are offsets in
+// the raw dump device, -1 when nothing was found in the section.
+//
+typedef struct _DDR_SECTION_SEARCH
+{
+    LONGLONG            DumpHeaderAddress;
+    BOOL                Is64Bit;
+    LONGLONG            APRegAddress;
+} DDR_SECTION_SEARCH, *PDDR_SECTION_SEARCH;
+
+//
+// Shared by the DDR section worker threads. Sections are handed out in index
+// order through NextSection; SearchDoneSection is the lowest section in which
+// both the dump header and AP_REG were found, later sections need not be
+// searched once it is set.
+//
+typedef struct _DDR_EXTRACT_CONTEXT
+{
+    PDMP_CONTEXT        Context;
+    BOOL                WriteFlag;
+    BOOL                SearchAPREG;
+    BOOL                StopEarly;
+    HANDLE              hMerged;
+    UINT64              LowestBase;
+    PDDR_SECTION_SEARCH Results;
+    CRITICAL_SECTION    DeviceLock;
+    volatile LONG       NextSection;
+    volatile LONG       SearchDoneSection;
+    volatile LONG       hr;
+    volatile LONG64     BytesProcessed;
+} DDR_EXTRACT_CONTEXT, *PDDR_EXTRACT_CONTEXT;
+
+HRESULT
+WriteAtFileOffset(
+    _In_                    HANDLE  hFile,
+    _In_reads_bytes_(Size)  PVOID   Buffer,
+    _In_                    ULONG   Size,
+    _In_                    UINT64  Offset
+    )
+/*++
+
+Routine Description:
+
+    Positional write, does not use or move the file pointer so several
+    threads can write to the same handle.
+
+Arguments:
+
+    hFile - Handle of the output file.
+
+    Buffer - Data to write.
+
+    Size - Number of bytes to write.
+
+    Offset - File offset to write at.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    OVERLAPPED  position = { 0 };
+    DWORD       written = 0;
+
+    position.Offset = (DWORD)Offset;
+    position.OffsetHigh = (DWORD)(Offset >> 32);
+
+    if (!WriteFile(hFile, Buffer, Size, &written, &position))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (written != Size)
+    {
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+ExtractDDRSection(
+    _Inout_ PDDR_EXTRACT_CONTEXT    Extract,
+    _In_    UINT32                  Index,
+    _Inout_updates_bytes_(DEFAULT_DMP_BUF_SZ) PCHAR Buffer
+    )
+/*++
+
+Routine Description:
+
+    Reads one DDR section from the device in DEFAULT_DMP_BUF_SZ chunks and,
+    while each chunk is in memory, writes it to DDRSection_<Index>.bin and to
+    its precomputed place in the merged file and searches it for the dump
+    header and AP_REG.
+
+    DEVICE_IO keeps a position and a block cache, so reads from the device are
+    serialized; writes and the search run concurrently with the other workers.
+
+Arguments:
+
+    Extract - Shared worker context.
+
+    Index - DDR section to process.
+
+    Buffer - Per thread chunk buffer.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    PDMP_CONTEXT                Context = Extract->Context;
+    PRAW_DUMP_SECTION_HEADER    section = &Context->SectionStats.FirstDDRSection[Index];
+    PDDR_SECTION_SEARCH         result = &Extract->Results[Index];
+    UINT64                      mergedOffset = section->u.DDRInformation.Base - Extract->LowestBase;
+    LARGE_INTEGER               offset = { 0 };
+    LONGLONG                    sectionEnd = 0;
+    HANDLE                      hFile = INVALID_HANDLE_VALUE;
+    WCHAR                       Filename[MAX_PATH];
+    HRESULT                     hr = S_OK;
+
+    if (TRUE == Extract->WriteFlag)
+    {
+        wsprintf(Filename, L"DDRSection_%d.bin", Index);
+        hFile = CreateFileW(Filename,
+                            GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            LogLibErrorPrintf(
+                hr,
+                __LINE__,
+                WIDEN(__FUNCTION__),
+                __WFILE__,
+                L" Create File Failed. INVALID_HANDLE_VALUE. %ls\n", Filename);
+            goto Exit;
+        }
+    }
+    else
+    {
+        LogLibInfoPrintf(L"  Processing DDR Section %d", Index);
+    }
+
+    offset.QuadPart = section->Offset;
+    sectionEnd = section->Offset + section->Size;
+
+    while ((offset.QuadPart < sectionEnd) && (S_OK == InterlockedCompareExchange(&Extract->hr, S_OK, S_OK)))
+    {
+        ULONG   readSize = (ULONG)min((LONGLONG)DEFAULT_DMP_BUF_SZ, sectionEnd - offset.QuadPart);
+        UINT64  sectionPos = offset.QuadPart - section->Offset;
+        LONG    internalOffset = 0;
+
+        if ((Extract->StopEarly) && ((LONG)Index > Extract->SearchDoneSection))
+        { // An earlier section already holds both, nothing left to do here
+            break;
+        }
+
+        EnterCriticalSection(&Extract->DeviceLock);
+        hr = Context->hDisk.ReadAtOffset(Buffer, readSize, offset, DEVICE_IO::READ_ANY);
+        LeaveCriticalSection(&Extract->DeviceLock);
+        if (FAILED(hr))
+        {
+            LogLibInfoPrintf(L"Failed to read DDR section from device. HRESULT: 0x%x\r\n", hr);
+            goto Exit;
+        }
+
+        if (TRUE == Extract->WriteFlag)
+        {
+            if (FAILED(hr = WriteAtFileOffset(hFile, Buffer, readSize, sectionPos)))
+            {
+                LogLibInfoPrintf(L"Failed to write DDR section to Bin file. Status: 0x%x\r\n", hr);
+                goto Exit;
+            }
+            else if (FAILED(hr = WriteAtFileOffset(Extract->hMerged, Buffer, readSize, mergedOffset + sectionPos)))
+            {
+                LogLibInfoPrintf(L"Failed to write DDR section to %ls. Status: 0x%x\r\n", DDR_MERGED_FILE_NAME, hr);
+                goto Exit;
+            }
+        }
+
+        //
+        // as we already read data to memory we can process it
+        //
+        if (result->DumpHeaderAddress < 0)
+        {
+            if (ISContainDumpHeader(&result->Is64Bit, (BYTE*)Buffer, readSize, &internalOffset))
+            {
+                result->DumpHeaderAddress = offset.QuadPart + internalOffset;
+            }
+        }
+
+        if ((Extract->SearchAPREG) && (result->APRegAddress < 0))
+        {
+            if (ISContainAPREG((BYTE*)Buffer, readSize, &internalOffset))
+            {
+                result->APRegAddress = offset.QuadPart + internalOffset;
+            }
+        }
+
+        if ((result->DumpHeaderAddress >= 0) && ((!Extract->SearchAPREG) || (result->APRegAddress >= 0)))
+        {
+            LONG    done = Extract->SearchDoneSection;
+
+            while ((LONG)Index < done)
+            { // Lower SearchDoneSection to this section
+                LONG    previous = InterlockedCompareExchange(&Extract->SearchDoneSection, (LONG)Index, done);
+
+                if (previous == done)
+                {
+                    break;
+                }
+                done = previous;
+            }
+
+            if (Extract->StopEarly)
+            { // Both AP_Reg (ARM32) and Magicstring found and not dumping DDR
+                InterlockedExchangeAdd64(&Extract->BytesProcessed, readSize);
+                break;
+            }
+        }
+
+        InterlockedExchangeAdd64(&Extract->BytesProcessed, readSize);
+        offset.QuadPart += readSize;
+    }
+
+    if (TRUE == Extract->WriteFlag)
+    {
+        LogLibInfoPrintf(L"      DDR Section %d - write completed", Index);
+    }
+
+Exit:
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    return hr;
+}
+
+DWORD WINAPI
+DDRSectionWorkerThread(
+    _In_ LPVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+    Processes DDR sections, taken in index order from the shared context,
+    until all are done or any worker fails.
+
+Arguments:
+
+    Parameter - PDDR_EXTRACT_CONTEXT
+
+Return Value:
+
+    0
+
+--*/
+{
+    PDDR_EXTRACT_CONTEXT    extract = (PDDR_EXTRACT_CONTEXT)Parameter;
+    PCHAR                   buffer = nullptr;
+    HRESULT                 hr = S_OK;
+
+    buffer = (PCHAR)HeapAlloc(GetProcessHeap(), 0, DEFAULT_DMP_BUF_SZ);
+    if (nullptr == buffer)
+    {
+        InterlockedCompareExchange(&extract->hr, E_OUTOFMEMORY, S_OK);
+        return 0;
+    }
+
+    while (S_OK == InterlockedCompareExchange(&extract->hr, S_OK, S_OK))
+    {
+        UINT32  index = (UINT32)(InterlockedIncrement(&extract->NextSection) - 1);
+
+        if (index >= extract->Context->SectionStats.DDRSectionCount)
+        { // All sections taken
+            break;
+        }
+        else if (RAW_DUMP_HEADER_FLAGS_VALID != (extract->Context->SectionStats.FirstDDRSection[index].Flags & RAW_DUMP_HEADER_FLAGS_VALID))
+        { // Only include DDR sections that are valid.
+            continue;
+        }
+        else if (FAILED(hr = ExtractDDRSection(extract, index, buffer)))
+        {
+            InterlockedCompareExchange(&extract->hr, hr, S_OK);
+            break;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, buffer);
+    return 0;
+}
+
 HRESULT
 WriteRAWDDRToBinAndSearchHeaders(
     _Inout_ PDMP_CONTEXT Context,
@@ -1178,12 +1479,21 @@ WriteRAWDDRToBinAndSearchHeaders(
 
 Routine Description:
 
-    This function writes RAW DDR sections to bin files 
+    This function writes RAW DDR sections to bin files and searches them for
+    the in memory dump header and AP_REG.
+
+    Sections are processed in parallel by DDRSectionWorkerThread. With
+    DDR_WriteFlag each section is written to DDRSection_<n>.bin and, at
+    (section base - lowest section base), to DDR_MERGED_FILE_NAME, so the
+    merged image is produced without a separate merge pass. The search result
+    is the same as a sequential scan: the first match in section order.
 
 Arguments:
 
     Context - Pointer to the global context structure.
 
+    DDR_WriteFlag - TRUE to write the DDR sections to files.
+
 Return Value:
 
     NT status code.
@@ -1191,32 +1501,31 @@ Return Value:
 --*/
 {
     UINT32                  index = 0;
+    UINT32                  threadCount = 0;
+    UINT32                  threadsStarted = 0;
     UINT32                  counter = 0;
-    ULONG                   bufferSize = DEFAULT_DMP_BUF_SZ; //4MB
-    ULONG                   readbufferSize = 0;
-    LONGLONG                remainsize = 0; //4MB
-    PCHAR                   tempBuffer = nullptr;
-    LARGE_INTEGER           offset = { 0 };
-    LARGE_INTEGER           sectionEnd;
-    LARGE_INTEGER           fileoffset = { 0 };
+    HANDLE                  threads[MAX_DDR_WORKER_THREADS] = { 0 };
+    DDR_EXTRACT_CONTEXT     extract = { 0 };
+    SYSTEM_INFO             systemInfo = { 0 };
     HRESULT                 hr = E_FAIL;
-    HANDLE                  hFile = INVALID_HANDLE_VALUE;
-    IO_STATUS_BLOCK         statusBlock;
-    WCHAR                   Filename[MAX_PATH];
+    DWORD                   bytesReturned = 0;
+    BOOL                    lockInitialized = FALSE;
     BOOL                    foundDumpHeader = FALSE;
     // if this is 64 bit APREG, dont attempt to find the APREG in the memory
     BOOL                    foundAPRG = (Context->isAPREG64 || !Context->IsAPREGRequested) ? TRUE : FALSE;
 
     Context->Is64Bit = FALSE;
-     
-    tempBuffer = (PCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, bufferSize);
-    if (nullptr == tempBuffer) {
-        LogLibInfoPrintf(L"Failed to allocate intermediate buffer for writing SV specific sections. Size: %u\r\n", 
-                  Context->SectionStats.LargestSVSpecificSectionSize);
-        goto Exit;
-    }
 
-    for (index = 0; index <Context->SectionStats.DDRSectionCount; index++)
+    extract.Context = Context;
+    extract.WriteFlag = DDR_WriteFlag;
+    extract.SearchAPREG = !foundAPRG;
+    extract.StopEarly = (!DDR_WriteFlag) && !(Context->isAPREG64);
+    extract.hMerged = INVALID_HANDLE_VALUE;
+    extract.LowestBase = MAXULONGLONG;
+    extract.SearchDoneSection = MAXLONG;
+    extract.hr = S_OK;
+
+    for (index = 0; index < Context->SectionStats.DDRSectionCount; index++)
     {
         if (RAW_DUMP_SECTION_TYPE_DDR_RANGE != Context->SectionStats.FirstDDRSection[index].Type)
         {
@@ -1232,137 +1541,134 @@ Return Value:
         //
         if (RAW_DUMP_HEADER_FLAGS_VALID != (Context->SectionStats.FirstDDRSection[index].Flags & RAW_DUMP_HEADER_FLAGS_VALID))
         {
-            LogLibInfoPrintf(L"Skipping DDR section with incomplete memory.\r\n");
+            LogLibInfoPrintf(L"Skipping DDR section %d with incomplete memory.\r\n", index);
             continue;
         }
 
-        if (TRUE == DDR_WriteFlag)
-        {
-            wsprintf(Filename, L"DDRSection_%d.bin", index);
-            fileoffset.QuadPart = 0;
-            hFile = CreateFileW(Filename,
-                                GENERIC_READ | GENERIC_WRITE,
-                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                                NULL,
-                                OPEN_ALWAYS,
-                                FILE_ATTRIBUTE_NORMAL,
-                                NULL);
-            if (hFile == INVALID_HANDLE_VALUE)
-            {
-                LogLibErrorPrintf(
-                    E_FAIL,
-                    __LINE__,
-                    WIDEN(__FUNCTION__),
-                    __WFILE__,
-                    L" Create File Failed. INVALID_HANDLE_VALUE. %ls\n", Filename);
-                goto Exit;
-            }
+        extract.LowestBase = min(extract.LowestBase, Context->SectionStats.FirstDDRSection[index].u.DDRInformation.Base);
+    }
 
-        }
-        else
-        {
-            LogLibInfoPrintf(L"  Processing DDR Section %d", index);
-        }
+    extract.Results = (PDDR_SECTION_SEARCH)HeapAlloc(GetProcessHeap(), 0, max(Context->SectionStats.DDRSectionCount, 1U) * sizeof(DDR_SECTION_SEARCH));
+    if (nullptr == extract.Results) {
+        hr = E_OUTOFMEMORY;
+        LogLibInfoPrintf(L"Failed to allocate the search results for %u DDR sections\r\n", Context->SectionStats.DDRSectionCount);
+        goto Exit;
+    }
 
-        offset.QuadPart = Context->SectionStats.FirstDDRSection[index].Offset;
-        sectionEnd.QuadPart = Context->SectionStats.FirstDDRSection[index].Offset + Context->SectionStats.FirstDDRSection[index].Size;
-        readbufferSize = bufferSize;
+    for (index = 0; index < Context->SectionStats.DDRSectionCount; index++)
+    {
+        extract.Results[index].DumpHeaderAddress = -1;
+        extract.Results[index].Is64Bit = FALSE;
+        extract.Results[index].APRegAddress = -1;
+    }
 
-        while (offset.QuadPart < sectionEnd.QuadPart)
+    if (TRUE == DDR_WriteFlag)
+    {
+        extract.hMerged = CreateFileW(DDR_MERGED_FILE_NAME,
+                                      GENERIC_READ | GENERIC_WRITE,
+                                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                      NULL,
+                                      CREATE_ALWAYS,
+                                      FILE_ATTRIBUTE_NORMAL,
+                                      NULL);
+        if (extract.hMerged == INVALID_HANDLE_VALUE)
         {
-            LONG    internalOffset = 0;
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            LogLibErrorPrintf(
+                hr,
+                __LINE__,
+                WIDEN(__FUNCTION__),
+                __WFILE__,
+                L" Create File Failed. INVALID_HANDLE_VALUE. %ls\n", DDR_MERGED_FILE_NAME);
+            goto Exit;
+        }
 
-            wprintf(L"      ");
-            switch (counter%4)
-            {
-                case 0:
-                    wprintf(L"-");
-                    break;
-                case 1:
-                    wprintf(L"\\");
-                    break;
-                case 2:
-                    wprintf(L"|");
-                    break;
-                case 3:
-                    wprintf(L"/");
-                    break;
-                default:
-                    wprintf(L"*");
-                    counter++;
-                    break;
-            }
-            wprintf(L" Processing DDR Memory %d MB     \r", counter*bufferSize / (1024 * 1024));
-            counter++;
+        //
+        // Holes between DDR sections are left unwritten
+        //
+        DeviceIoControl(extract.hMerged, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL);
+    }
 
-            if (FAILED(hr = Context->hDisk.ReadAtOffset((PCHAR)tempBuffer, readbufferSize, offset, DEVICE_IO::READ_ANY)))
-            {
-                LogLibInfoPrintf(L"Failed to read DDR section from device. HRESULT: 0x%x\r\n", hr);
-                goto Exit;
-            }
-            
-            if (TRUE == DDR_WriteFlag)
-            {
-                hr = HRESULT_FROM_NT(NtWriteFile(hFile,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL,
-                                                 &statusBlock,
-                                                 tempBuffer,
-                                                 readbufferSize,
-                                                 &fileoffset,
-                                                 NULL));
-                if (FAILED(hr))
-                {
-                    LogLibInfoPrintf(L"Failed to write DDR section to Bin file. Status: 0x%x\r\n", hr);
-                    goto Exit;
-                }
+    InitializeCriticalSection(&extract.DeviceLock);
+    lockInitialized = TRUE;
 
-                NtFlushBuffersFile(hFile, &statusBlock);
-                fileoffset.QuadPart += readbufferSize;
-            }
+    GetSystemInfo(&systemInfo);
+    threadCount = min(min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)MAX_DDR_WORKER_THREADS),
+                      max(Context->SectionStats.DDRSectionCount, 1U));
 
-            //
-            // as we already read data to memory we can process it
-            //
-            if(!foundDumpHeader){
-                foundDumpHeader = ISContainDumpHeader(Context, (BYTE*)tempBuffer, readbufferSize, &internalOffset);
-                if(foundDumpHeader) {
-                    Context->DumpHeaderAddress.QuadPart = offset.QuadPart + internalOffset;
-                    LogLibInfoPrintf(L"We found the magicstring at 0x%llx", Context->DumpHeaderAddress.QuadPart);
-                }
-            }
+    LogLibInfoPrintf(L"  Processing %u DDR sections with %u threads", Context->SectionStats.DDRSectionCount, threadCount);
 
-            if(!foundAPRG){
-                foundAPRG = ISContainAPREG((BYTE*)tempBuffer , readbufferSize, &internalOffset);
-                if(foundAPRG) {
-                    Context->APRegAddress.QuadPart = offset.QuadPart + internalOffset;
-                    LogLibInfoPrintf(L"We found the AP_REG at 0x%llx",  Context->APRegAddress.QuadPart);
-                }
-            }
-            
-            if (foundAPRG && foundDumpHeader && (!Context->DumpDDR) && !(Context->isAPREG64))
-            { // End if - both AP_Reg (ARM32) and Magicstring found and not dumping DDR
-                LogLibInfoPrintf(L"Completed search for AP_REG and Magicstring");
+    for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++)
+    {
+        if (NULL == (threads[threadsStarted] = CreateThread(nullptr, 0, DDRSectionWorkerThread, &extract, 0, nullptr)))
+        { // The threads already started stop at the failure
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            InterlockedCompareExchange(&extract.hr, hr, S_OK);
+            LogLibInfoPrintf(L"Failed to start DDR section worker thread. HRESULT: 0x%x\r\n", hr);
+            break;
+        }
+    }
+
+    while ((0 != threadsStarted) &&
+           (WAIT_TIMEOUT == WaitForMultipleObjects(threadsStarted, threads, TRUE, DDR_PROGRESS_INTERVAL_MS)))
+    {
+        wprintf(L"      ");
+        switch (counter%4)
+        {
+            case 0:
+                wprintf(L"-");
+                break;
+            case 1:
+                wprintf(L"\\");
+                break;
+            case 2:
+                wprintf(L"|");
+                break;
+            case 3:
+                wprintf(L"/");
                 break;
-            }
-            
-            offset.QuadPart += readbufferSize;
-            remainsize = sectionEnd.QuadPart - offset.QuadPart;
-            if (remainsize  < readbufferSize) {
-                readbufferSize = (ULONG)remainsize;
-            }
         }
+        wprintf(L" Processing DDR Memory %lld MB     \r", extract.BytesProcessed / (1024 * 1024));
+        counter++;
+    }
+
+    for (index = 0; index < threadsStarted; index++)
+    {
+        CloseHandle(threads[index]);
+    }
 
-        readbufferSize = bufferSize;
-        if (TRUE == DDR_WriteFlag)
+    if (FAILED(hr = extract.hr))
+    {
+        LogLibInfoPrintf(L"Failed to process the DDR sections. HRESULT: 0x%x\r\n", hr);
+        goto Exit;
+    }
+
+    LogLibInfoPrintf(L"      Processed DDR Memory %lld MB.\n", extract.BytesProcessed / (1024 * 1024));
+
+    //
+    // The first match in section order wins
+    //
+    for (index = 0; index < Context->SectionStats.DDRSectionCount; index++)
+    {
+        if ((!foundDumpHeader) && (extract.Results[index].DumpHeaderAddress >= 0))
         {
+            foundDumpHeader = TRUE;
+            Context->Is64Bit = extract.Results[index].Is64Bit;
+            Context->DumpHeaderAddress.QuadPart = extract.Results[index].DumpHeaderAddress;
+            LogLibInfoPrintf(L"We found the magicstring at 0x%llx", Context->DumpHeaderAddress.QuadPart);
+        }
 
-            LogLibInfoPrintf(L"\r      DDR Section %d - write completed",index );
-            CloseHandle(hFile);
-            hFile = INVALID_HANDLE_VALUE;
+        if ((!foundAPRG) && (extract.Results[index].APRegAddress >= 0))
+        {
+            foundAPRG = TRUE;
+            Context->APRegAddress.QuadPart = extract.Results[index].APRegAddress;
+            LogLibInfoPrintf(L"We found the AP_REG at 0x%llx", Context->APRegAddress.QuadPart);
         }
-        LogLibInfoPrintf(L"      Processed DDR Memory %d MB.\n", counter*bufferSize / (1024 * 1024));
+    }
+
+    if (TRUE == DDR_WriteFlag)
+    {
+        LogLibInfoPrintf(L"      DDR sections merged into %ls, lowest base 0x%llx", DDR_MERGED_FILE_NAME, extract.LowestBase);
     }
 
     hr = S_OK;
@@ -1382,8 +1688,14 @@ Exit:
         Context ->HasValidAP_REG = FALSE;
         LogLibInfoPrintf(L"Error:Failed to find APReg, looks like this offline dump not triggered by secure watchdog! \n"); 
     }
-    if (tempBuffer != NULL) {
-        HeapFree(GetProcessHeap(),0, tempBuffer);
+    if (lockInitialized) {
+        DeleteCriticalSection(&extract.DeviceLock);
+    }
+    if (extract.hMerged != INVALID_HANDLE_VALUE) {
+        CloseHandle(extract.hMerged);
+    }
+    if (extract.Results != NULL) {
+        HeapFree(GetProcessHeap(),0, extract.Results);
     }
     return hr;
 }
@@ -2124,126 +2436,166 @@ Exit:
     return status;
 }
 
-BOOL MergeFile(HANDLE hTo, HANDLE hFrom)
+//
+// Shared by the merge worker threads. Entry i of Map was read from
+// Arguments->ddr[FileIndex[i]] and is written at Map[i].Offset.
+//
+typedef struct _DDR_MERGE_CONTEXT
 {
-    BOOL     fRet = FALSE;
-    DWORD    bufferSize = DEFAULT_DMP_BUF_SZ;
-    PBYTE    pbBuf = NULL;
-    DWORD    cbDone;
-    LONG     counter = 0;
-    DWORD    bytesRead = 0;
+    PCOMMAND_LINE_ARGS  Arguments;
+    PDDR_MEMORY_MAP     Map;
+    PUINT32             FileIndex;
+    UINT32              EntryCount;
+    HANDLE              hMerged;
+    volatile LONG       NextEntry;
+    volatile LONG       hr;
+    volatile LONG64     BytesMerged;
+} DDR_MERGE_CONTEXT, *PDDR_MERGE_CONTEXT;
+
+DWORD WINAPI
+DDRMergeWorkerThread(
+    _In_ LPVOID Parameter
+    )
+/*++
 
-   
-    pbBuf = (PBYTE) malloc(bufferSize);
+Routine Description:
 
-    if (NULL == pbBuf){
-        LogLibErrorPrintf(
-                        E_FAIL,
-                        __LINE__,
-                        WIDEN(__FUNCTION__),
-                        __WFILE__, 
-                        L"Error: Failed to allocate buffer");
-        goto Exit;
+    Copies DDR files, taken in order from the shared context, to their
+    precomputed offsets in the merged file until all are copied or any
+    worker fails.
+
+Arguments:
+
+    Parameter - PDDR_MERGE_CONTEXT
+
+Return Value:
+
+    0
+
+--*/
+{
+    PDDR_MERGE_CONTEXT  merge = (PDDR_MERGE_CONTEXT)Parameter;
+    PBYTE               buffer = nullptr;
+    HRESULT             hr = S_OK;
+
+    buffer = (PBYTE)HeapAlloc(GetProcessHeap(), 0, DEFAULT_DMP_BUF_SZ);
+    if (nullptr == buffer)
+    {
+        InterlockedCompareExchange(&merge->hr, E_OUTOFMEMORY, S_OK);
+        return 0;
     }
 
-    SetFilePointer(hTo, 0, 0, FILE_END);
-    for (int i = 0; ;i++) {
-        if (!ReadFile(hFrom, pbBuf, bufferSize, &cbDone, NULL)) {
-            LogLibInfoPrintf(L"[ERROR] read the input file failed.\n");
-            goto Exit;
-        }
-        if (cbDone == 0) {
-             LogLibInfoPrintf(L"[INFO] reached the end of file at 0X%X.\n", bytesRead);
+    while (S_OK == InterlockedCompareExchange(&merge->hr, S_OK, S_OK))
+    {
+        UINT32  entry = (UINT32)(InterlockedIncrement(&merge->NextEntry) - 1);
+        PWSTR   fileName = nullptr;
+        HANDLE  hFrom = INVALID_HANDLE_VALUE;
+        UINT64  copied = 0;
+
+        if (entry >= merge->EntryCount)
+        { // All files taken
             break;
         }
-        bytesRead += cbDone;
 
-        if (!WriteFile(hTo, pbBuf, cbDone, &cbDone, NULL)) {
-            LogLibInfoPrintf(L"[ERROR] Write to merged file failed at offset 0x%x.\n", bytesRead);
-            goto Exit;
+        fileName = merge->Arguments->ddr[merge->FileIndex[entry]].DDRFileName;
+        hFrom = CreateFileW(fileName,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+        if (hFrom == INVALID_HANDLE_VALUE)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            LogLibInfoPrintf(L"[ERROR] Failed to Open input file: %ls\n", fileName);
         }
-        counter++;
-        wprintf(L"    ");
-        switch (i)
+
+        while (SUCCEEDED(hr) && (copied < merge->Map[entry].Size))
         {
-            case 4: 
-                i = 0;
-            case 0:
-                wprintf(L"-");
-                break;
-            case 1:
-                wprintf(L"\\");
-                break;
-            case 2:
-                wprintf(L"|");
-                break;
-            case 3:
-                wprintf(L"/");
-                break;
-            default:
-                wprintf(L"*");
-                i=3;
-                break;
+            DWORD   cbDone = 0;
+
+            if (!ReadFile(hFrom, buffer, DEFAULT_DMP_BUF_SZ, &cbDone, NULL))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                LogLibInfoPrintf(L"[ERROR] read the input file %ls failed at offset 0x%llx.\n", fileName, copied);
+            }
+            else if (cbDone == 0)
+            { // File shrank since it was sized
+                hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+                LogLibInfoPrintf(L"[ERROR] unexpected end of %ls at offset 0x%llx.\n", fileName, copied);
+            }
+            else if (FAILED(hr = WriteAtFileOffset(merge->hMerged, buffer, cbDone, merge->Map[entry].Offset + copied)))
+            {
+                LogLibInfoPrintf(L"[ERROR] Write to merged file failed at offset 0x%llx.\n", merge->Map[entry].Offset + copied);
+            }
+            else
+            {
+                copied += cbDone;
+                InterlockedExchangeAdd64(&merge->BytesMerged, cbDone);
+            }
         }
-        wprintf(L" merged %d MB.\r", counter*bufferSize / (1024 * 1024));
-    }
-    LogLibInfoPrintf(L"    Completed merge of %d MB.\n", counter*bufferSize / (1024 * 1024));
 
-    fRet = TRUE;
+        if (hFrom != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(hFrom);
+        }
 
-Exit:
-    if (pbBuf) {
-        free(pbBuf);
+        if (FAILED(hr))
+        {
+            InterlockedCompareExchange(&merge->hr, hr, S_OK);
+            break;
+        }
+
+        LogLibInfoPrintf(L"    Merged DDR section %d (%ls), 0x%llx bytes.\n", merge->FileIndex[entry], fileName, copied);
     }
-    return fRet;
+
+    HeapFree(GetProcessHeap(), 0, buffer);
+    return 0;
 }
 
 
 BOOL MergeDDRFiles( PDMP_CONTEXT Context, 
                    PCOMMAND_LINE_ARGS arguments,
                    LPWSTR mergedfile )
+/*++
+
+Routine Description:
+
+    Builds the DDR memory map from the DDR files on the command line, lowest
+    base first, and copies each file into mergedfile at (base - lowest base),
+    the Offset recorded in the map. The files are copied in parallel with
+    positional writes; holes between sections are left sparse.
+
+--*/
 {
-    HANDLE hmerged = INVALID_HANDLE_VALUE;
-    ULONGLONG lowestbase = 0xFFFFFFFFFFFFFFFF;
-    LARGE_INTEGER filesize = { 0 };
-    UINT sectionid = 0;
-    UINT mergedsections = 0 ;
-    ULONGLONG Gap = 0;
-    HANDLE  hFrom = INVALID_HANDLE_VALUE;
-    BOOL bRet = FALSE;
+    DDR_MERGE_CONTEXT   merge = { 0 };
+    HANDLE              threads[MAX_DDR_WORKER_THREADS] = { 0 };
+    UINT32              threadCount = 0;
+    UINT32              threadsStarted = 0;
+    SYSTEM_INFO         systemInfo = { 0 };
+    ULONGLONG           lowestbase = 0xFFFFFFFFFFFFFFFF;
+    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+    LARGE_INTEGER       filesize = { 0 };
+    UINT                sectionid = 0;
+    UINT                mergedsections = 0 ;
+    ULONGLONG           currentBaseOffset = 0;
+    DWORD               bytesReturned = 0;
+    BOOL                bRet = FALSE;
+
+    merge.hMerged = INVALID_HANDLE_VALUE;
+    merge.hr = S_OK;
+    merge.Arguments = arguments;
+    merge.EntryCount = arguments->DDRCount;
 
     Context->DDRMemoryMap = new DDR_MEMORY_MAP[arguments->DDRCount];
     ZeroMemory(Context->DDRMemoryMap, (sizeof(DDR_MEMORY_MAP)*arguments->DDRCount) );
+    merge.Map = Context->DDRMemoryMap;
 
     Context->DDRMemoryMapCount = arguments->DDRCount ;
-   Context->SectionStats.DDRSectionCount = arguments->DDRCount;
-
-//    CopyArgsToDdrMap(Context, &arguments->ddr[0], arguments->DDRCount);
-//    SortDdrArgsByBase(&arguments->ddr[0], arguments->DDRCount);
-
-
-#ifndef _DEBUG_NO_MERGE
-    hmerged = CreateFileW( mergedfile,
-                            GENERIC_READ | GENERIC_WRITE,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                            NULL,
-                            CREATE_ALWAYS,
-                            FILE_FLAG_WRITE_THROUGH,
-                            NULL );
-
-    if (hmerged == INVALID_HANDLE_VALUE){
-            LogLibErrorPrintf(
-            E_FAIL,
-            __LINE__,
-            WIDEN(__FUNCTION__),
-            __WFILE__,
-            L" Create File Failed. INVALID_HANDLE_VALUE. %ls\n", mergedfile);
-        goto Exit;
-    }
-#endif
-
-    wprintf(L"Merge file \'%s\' successfully created (handle=0x%08x) \n\n", mergedfile, (UINT32)hmerged);
+    Context->SectionStats.DDRSectionCount = arguments->DDRCount;
 
+    merge.FileIndex = new UINT32[max(arguments->DDRCount, 1U)];
 
     //
     // Find the lowest DDR section for use as the base address
@@ -2257,10 +2609,12 @@ BOOL MergeDDRFiles( PDMP_CONTEXT Context,
     }
     wprintf(L"Lowest DDR section; lowestbase = 0x%llx\n", lowestbase);
 
-    // To merge the DDR sections and extract the windows dump file.
-    wprintf(L"Begin DDR section Merge for %d files\n", arguments->DDRCount );
+    //
+    // Lay out the memory map lowest base first; each file goes at its
+    // distance from the lowest base
+    //
     for (mergedsections = 0; mergedsections < arguments->DDRCount; mergedsections++){
-        ULONGLONG currentBaseOffset = 0xffffffffffffffff;
+        currentBaseOffset = 0xffffffffffffffff;
 
         //
         // Find the lowest available DDR section (base)
@@ -2277,106 +2631,113 @@ BOOL MergeDDRFiles( PDMP_CONTEXT Context,
         }
         wprintf(L"Processing DDR section --> sectionid = %d, base = 0x%llx, File = %s\r\n", sectionid, currentBaseOffset, arguments->ddr[sectionid].DDRFileName);
 
-        //
-        // the identified section is the lowest DDR section. Read the file, merge it
-        //
-        if(mergedsections > 0) {           
-            Gap = arguments->ddr[sectionid].DDRBase.QuadPart - currentBaseOffset;
-        }
-
-        if(Gap!= 0 ){
-            LogLibInfoPrintf(
-                L"======= The DDR sections are discontinuous --> hole = 0x%llx, DDRbase = 0x%llx, currentbase = 0x%llx ============\n",
-                Gap,
-                arguments->ddr[sectionid].DDRBase.QuadPart,
-                currentBaseOffset);
-        }
-
-        hFrom = CreateFileW(arguments->ddr[sectionid].DDRFileName,
-                            GENERIC_READ,
-                            0,
-                            NULL, 
-                            OPEN_EXISTING,
-                            0,
-                            NULL);
-        if (hFrom == INVALID_HANDLE_VALUE) {
-                LogLibErrorPrintf(
-                                E_FAIL,
-                                __LINE__,
-                                WIDEN(__FUNCTION__),
-                                __WFILE__, 
-                                L"Error: Failed to Open input file: %ls\n", arguments->ddr[sectionid].DDRFileName);
-            goto Exit;
-        }
-        wprintf(L"  Reading DDR section %d from file: %ls\n", sectionid, arguments->ddr[sectionid].DDRFileName);
-            
-        if(!GetFileSizeEx(hFrom, &filesize)) {
+        if (!GetFileAttributesExW(arguments->ddr[sectionid].DDRFileName, GetFileExInfoStandard, &fileInfo)) {
             LogLibErrorPrintf(
                     E_FAIL,
                     __LINE__,
                     WIDEN(__FUNCTION__),
                     __WFILE__, 
-                    L"Error: Failed to Get File Size \n");
+                    L"Error: Failed to Get File Size of %ls\n", arguments->ddr[sectionid].DDRFileName);
             goto Exit;
         }
-        wprintf(L"    size of file 0x%llx (%lld)\n", filesize, filesize);
+        filesize.LowPart = fileInfo.nFileSizeLow;
+        filesize.HighPart = (LONG)fileInfo.nFileSizeHigh;
+        wprintf(L"    size of file 0x%llx (%lld)\n", filesize.QuadPart, filesize.QuadPart);
 
-#ifndef _DEBUG_NO_MERGE
-        if (!MergeFile(hmerged, hFrom)) {
-                LogLibErrorPrintf(
-                E_FAIL,
-                __LINE__,
-                WIDEN(__FUNCTION__),
-                __WFILE__,
-                L" Failed to merge File %s\n", arguments->ddr[sectionid].DDRFileName);
-                goto Exit;
+        if ((mergedsections > 0) &&
+            ((ULONGLONG)arguments->ddr[sectionid].DDRBase.QuadPart != Context->DDRMemoryMap[mergedsections - 1].End + 1)) {
+            LogLibInfoPrintf(
+                L"======= The DDR sections are discontinuous --> DDRbase = 0x%llx, previous end = 0x%llx ============\n",
+                arguments->ddr[sectionid].DDRBase.QuadPart,
+                Context->DDRMemoryMap[mergedsections - 1].End);
         }
-#endif
+
+        merge.FileIndex[mergedsections] = sectionid;
         Context->DDRMemoryMap[mergedsections].Base = arguments->ddr[sectionid].DDRBase.QuadPart;
         Context->DDRMemoryMap[mergedsections].Size = filesize.QuadPart;
-
-        if( currentBaseOffset >= lowestbase ) {
-            Context->DDRMemoryMap[mergedsections].Offset = currentBaseOffset - lowestbase;
-        }
-        else {
-            Context->DDRMemoryMap[mergedsections].Offset = currentBaseOffset;
-        }
-
+        Context->DDRMemoryMap[mergedsections].Offset = currentBaseOffset - lowestbase;
         Context->DDRMemoryMap[mergedsections].End = arguments->ddr[sectionid].DDRBase.QuadPart + filesize.QuadPart - 1;
         Context->DDRMemoryMap[mergedsections].Contiguous = TRUE;
         Context->SectionStats.TotalDDRSizeInBytes += filesize.QuadPart;
 
-        currentBaseOffset = arguments->ddr[sectionid].DDRBase.QuadPart + filesize.QuadPart;
-
         arguments->ddr[sectionid].AlreadyMerged = TRUE;
 
-        if (hFrom != INVALID_HANDLE_VALUE)
-        {
-            CloseHandle(hFrom);
-        }
-        
-        //merged successfully 
-        if (hmerged != INVALID_HANDLE_VALUE)
-        {
-            FlushFileBuffers(hmerged);
-        }
-
         LogLibInfoPrintf(L"         Context->DDRMemoryMap[%03d].Base = 0x%I64x", mergedsections, Context->DDRMemoryMap[mergedsections].Base);
         LogLibInfoPrintf(L"          Context->DDRMemoryMap[%03d].End = 0x%I64x", mergedsections, Context->DDRMemoryMap[mergedsections].End );
         LogLibInfoPrintf(L"         Context->DDRMemoryMap[%03d].Size = 0x%I64x", mergedsections, Context->DDRMemoryMap[mergedsections].Size);
         LogLibInfoPrintf(L"   Context->DDRMemoryMap[%03d].Contiguous = 0x%ls",   mergedsections, (Context->DDRMemoryMap[mergedsections].Contiguous?L"TRUE":L"FALSE") );
-        LogLibInfoPrintf(L"                        currentBaseOffset = 0x%I64x", currentBaseOffset);
         LogLibInfoPrintf(L"       Context->DDRMemoryMap[%03d].Offset = 0x%I64x", mergedsections, Context->DDRMemoryMap[mergedsections].Offset);
-        LogLibInfoPrintf(L"                        filesize.QuadPart = 0x%I64x", filesize.QuadPart);
     }
-    
-    if (hmerged != INVALID_HANDLE_VALUE)
+
+#ifndef _DEBUG_NO_MERGE
+    merge.hMerged = CreateFileW( mergedfile,
+                                 GENERIC_READ | GENERIC_WRITE,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL,
+                                 CREATE_ALWAYS,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL );
+
+    if (merge.hMerged == INVALID_HANDLE_VALUE){
+            LogLibErrorPrintf(
+            E_FAIL,
+            __LINE__,
+            WIDEN(__FUNCTION__),
+            __WFILE__,
+            L" Create File Failed. INVALID_HANDLE_VALUE. %ls\n", mergedfile);
+        goto Exit;
+    }
+    wprintf(L"Merge file \'%s\' successfully created\n\n", mergedfile);
+
+    DeviceIoControl(merge.hMerged, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL);
+
+    GetSystemInfo(&systemInfo);
+    threadCount = min(min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)MAX_DDR_WORKER_THREADS),
+                      max(arguments->DDRCount, 1U));
+
+    wprintf(L"Begin DDR section Merge for %d files, %d threads\n", arguments->DDRCount, threadCount);
+    for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++)
     {
-        CloseHandle(hmerged);
+        if (NULL == (threads[threadsStarted] = CreateThread(nullptr, 0, DDRMergeWorkerThread, &merge, 0, nullptr)))
+        { // The threads already started stop at the failure
+            InterlockedCompareExchange(&merge.hr, HRESULT_FROM_WIN32(GetLastError()), S_OK);
+            break;
+        }
     }
+
+    while ((0 != threadsStarted) &&
+           (WAIT_TIMEOUT == WaitForMultipleObjects(threadsStarted, threads, TRUE, DDR_PROGRESS_INTERVAL_MS)))
+    {
+        wprintf(L"     merged %lld MB.\r", merge.BytesMerged / (1024 * 1024));
+    }
+
+    for (UINT32 index = 0; index < threadsStarted; index++)
+    {
+        CloseHandle(threads[index]);
+    }
+
+    if (FAILED(merge.hr)) {
+        LogLibErrorPrintf(
+            merge.hr,
+            __LINE__,
+            WIDEN(__FUNCTION__),
+            __WFILE__,
+            L" Failed to merge DDR files into %ls\n", mergedfile);
+        goto Exit;
+    }
+
+    FlushFileBuffers(merge.hMerged);
+    LogLibInfoPrintf(L"    Completed merge of %lld MB.\n", merge.BytesMerged / (1024 * 1024));
+#endif
+
     bRet = TRUE;
 
 Exit:
+    if (merge.hMerged != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(merge.hMerged);
+    }
+    delete [] merge.FileIndex;
     return bRet;
 }
 
@@ -424,7 +424,7 @@ wmain (
     HRESULT result = ERROR_SUCCESS;
     DMP_CONTEXT context = { 0 };
     NTSTATUS status = STATUS_SUCCESS;
-    LPWSTR mergedfile = L"merged.bin";
+    LPWSTR mergedfile = DDR_MERGED_FILE_NAME;
     WCHAR ProgramFileVersion[MAX_PATH];
     COMMAND_LINE_ARGS CommandLineArgs = { 0 };
     DWORD FileVersion = 0;
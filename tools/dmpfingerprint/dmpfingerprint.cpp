@@ -0,0 +1,225 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    dmpfingerprint.cpp
+
+Abstract:
+    Builds and compares page fingerprints of Windows dump files. raw2dump
+    writes <dump>.pfp next to every dump it converts; this tool builds one for
+    any other dump, ranks earlier dumps by how many pages they share with a
+    new one, and lists the physical ranges where two dumps differ.
+
+Environment:
+    User Mode
+
+--*/
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Dump_Blob.h"
+#include "Page_Fingerprint.h"
+
+/****************************************************************************************************
+**
+** Description:
+**  Hashes the PhysicalMemoryBlock runs of a dump file and writes the
+**  fingerprint. Only the pages the OS described are covered; memory carved out
+**  from the OS is only fingerprinted during conversion, where its physical
+**  addresses are known.
+**
+*****************************************************************************************************/
+HRESULT BuildFingerprint(LPCWSTR dumpPath, LPCWSTR fingerprintPath)
+{
+    HRESULT             hr = S_OK;
+    PDUMP_FILE_VIEW     view = nullptr;
+    PAGE_FINGERPRINT    fingerprint = { 0 };
+
+    hr = OpenDumpFileView(dumpPath, &view);
+    if (FAILED(hr))
+    {
+        wprintf(L"ERROR: failed to open %s as a dump file, hr = 0x%08x\r\n", dumpPath, hr);
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < view->RunCount; index++)
+    {
+        hr = PageFingerprintAddPages(&fingerprint,
+                                     view->Runs[index].Base,
+                                     view->Base + view->Runs[index].FileOffset,
+                                     view->Runs[index].Size,
+                                     PAGE_FINGERPRINT_REGION_OS);
+        if (FAILED(hr))
+        {
+            wprintf(L"ERROR: failed to hash run %u, hr = 0x%08x\r\n", index, hr);
+            goto Exit;
+        }
+    }
+
+    hr = PageFingerprintWrite(&fingerprint, fingerprintPath);
+    if (FAILED(hr))
+    {
+        wprintf(L"ERROR: failed to write %s, hr = 0x%08x\r\n", fingerprintPath, hr);
+        goto Exit;
+    }
+
+    wprintf(L"%s: %llu pages in %u runs\r\n", fingerprintPath, fingerprint.PageCount, fingerprint.RunCount);
+
+Exit:
+    PageFingerprintFree(&fingerprint);
+    CloseDumpFileView(view);
+
+    return hr;
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  Prints the fingerprints of candidates ordered by their estimated share of
+**  pages with the fingerprint of target, most similar first. Candidates that
+**  cannot be read are reported and skipped.
+**
+*****************************************************************************************************/
+HRESULT RankSimilar(LPCWSTR targetPath, int candidateCount, LPWSTR *candidatePaths)
+{
+    HRESULT                                     hr = S_OK;
+    PAGE_FINGERPRINT                            target = { 0 };
+    PAGE_FINGERPRINT                            candidate = { 0 };
+    std::vector<std::pair<UINT32, LPCWSTR>>     ranking;
+
+    hr = PageFingerprintRead(targetPath, &target);
+    if (FAILED(hr))
+    {
+        wprintf(L"ERROR: failed to read %s, hr = 0x%08x\r\n", targetPath, hr);
+        return hr;
+    }
+
+    for (int index = 0; index < candidateCount; index++)
+    {
+        if (FAILED(hr = PageFingerprintRead(candidatePaths[index], &candidate)))
+        {
+            wprintf(L"WARNING: skipping %s, hr = 0x%08x\r\n", candidatePaths[index], hr);
+            continue;
+        }
+
+        ranking.push_back(std::make_pair(PageFingerprintSimilarity(&target, &candidate), candidatePaths[index]));
+        PageFingerprintFree(&candidate);
+    }
+
+    std::stable_sort(ranking.begin(), ranking.end(),
+                     [](const std::pair<UINT32, LPCWSTR> &first, const std::pair<UINT32, LPCWSTR> &second)
+                     {
+                         return first.first > second.first;
+                     });
+
+    for (auto &entry : ranking)
+    {
+        wprintf(L"%3u%%  %s\r\n", entry.first, entry.second);
+    }
+
+    PageFingerprintFree(&target);
+
+    return S_OK;
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  Prints the physical ranges that are present in only one of two
+**  fingerprints or whose pages hash differently.
+**
+*****************************************************************************************************/
+HRESULT DiffFingerprints(LPCWSTR firstPath, LPCWSTR secondPath)
+{
+    HRESULT             hr = S_OK;
+    PAGE_FINGERPRINT    first = { 0 };
+    PAGE_FINGERPRINT    second = { 0 };
+    EXTENT_SET          differences = { 0 };
+    UINT64              differentPages = 0;
+
+    if (FAILED(hr = PageFingerprintRead(firstPath, &first)))
+    {
+        wprintf(L"ERROR: failed to read %s, hr = 0x%08x\r\n", firstPath, hr);
+        goto Exit;
+    }
+
+    if (FAILED(hr = PageFingerprintRead(secondPath, &second)))
+    {
+        wprintf(L"ERROR: failed to read %s, hr = 0x%08x\r\n", secondPath, hr);
+        goto Exit;
+    }
+
+    if (FAILED(hr = PageFingerprintDiff(&first, &second, &differences)))
+    {
+        wprintf(L"ERROR: failed to compare the fingerprints, hr = 0x%08x\r\n", hr);
+        goto Exit;
+    }
+
+    for (UINT32 index = 0; index < differences.Count; index++)
+    {
+        wprintf(L"0x%016llx - 0x%016llx  %llu pages\r\n",
+                differences.Extents[index].Base,
+                differences.Extents[index].End,
+                EXTENT_SIZE(differences.Extents[index]) >> PAGE_FINGERPRINT_PAGE_SHIFT);
+        differentPages += EXTENT_SIZE(differences.Extents[index]) >> PAGE_FINGERPRINT_PAGE_SHIFT;
+    }
+
+    wprintf(L"%llu pages differ in %u ranges, %u%% similar\r\n",
+            differentPages, differences.Count, PageFingerprintSimilarity(&first, &second));
+
+Exit:
+    ExtentSetFree(&differences);
+    PageFingerprintFree(&first);
+    PageFingerprintFree(&second);
+
+    return hr;
+}
+
+/****************************************************************************************************
+**
+** Description:
+**  dmpfingerprint /build <dump file> [fingerprint file]
+**  dmpfingerprint /similar <fingerprint file> <fingerprint file> [...]
+**  dmpfingerprint /diff <fingerprint file> <fingerprint file>
+**
+**  /build writes <dump file>.pfp unless a fingerprint file is given.
+**
+** Return:
+**  0 on success.
+**
+*****************************************************************************************************/
+int wmain(int argc, wchar_t **argv)
+{
+    HRESULT         hr = E_INVALIDARG;
+    std::wstring    fingerprintPath;
+
+    if ((argc >= 3) && (argc <= 4) && (_wcsicmp(argv[1], L"/build") == 0))
+    {
+        fingerprintPath = (argc == 4) ? std::wstring(argv[3]) : std::wstring(argv[2]) + PAGE_FINGERPRINT_FILE_EXTENSION;
+        hr = BuildFingerprint(argv[2], fingerprintPath.c_str());
+    }
+    else if ((argc >= 4) && (_wcsicmp(argv[1], L"/similar") == 0))
+    {
+        hr = RankSimilar(argv[2], argc - 3, &argv[3]);
+    }
+    else if ((argc == 4) && (_wcsicmp(argv[1], L"/diff") == 0))
+    {
+        hr = DiffFingerprints(argv[2], argv[3]);
+    }
+    else
+    {
+        wprintf(L"Usage: dmpfingerprint /build <dump file> [fingerprint file]\r\n"
+                L"       dmpfingerprint /similar <fingerprint file> <fingerprint file> [...]\r\n"
+                L"       dmpfingerprint /diff <fingerprint file> <fingerprint file>\r\n");
+    }
+
+    return FAILED(hr) ? 1 : 0;
+}
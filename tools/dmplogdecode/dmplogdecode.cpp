@@ -0,0 +1,89 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    dmplogdecode.cpp
+
+Abstract:
+    Renders a wpdmp log file as text, see DmpLogDecode.
+
+Environment:
+    User Mode
+
+--*/
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "logging.h"
+#include "dmplogdecode.h"
+
+/****************************************************************************************************
+**
+** Description:
+**  dmplogdecode <log file> [output file]
+**
+** Return:
+**  0 on success.
+**
+*****************************************************************************************************/
+int main(int argc, char **argv)
+{
+    FILE                            *in = nullptr;
+    FILE                            *out = stdout;
+    std::vector<UCHAR>              log;
+    std::string                     text;
+    int                             result = 1;
+
+    if ((argc < 2) || (argc > 3))
+    {
+        printf("Usage: dmplogdecode <log file> [output file]\r\n");
+        goto Exit;
+    }
+
+    if ((0 != fopen_s(&in, argv[1], "rb")) || (nullptr == in))
+    {
+        printf("ERROR: failed to open %s\r\n", argv[1]);
+        goto Exit;
+    }
+
+    if ((argc == 3) && ((0 != fopen_s(&out, argv[2], "wb")) || (nullptr == out)))
+    {
+        printf("ERROR: failed to create %s\r\n", argv[2]);
+        out = nullptr;
+        goto Exit;
+    }
+
+    for (int value = fgetc(in); value != EOF; value = fgetc(in))
+    {
+        log.push_back((UCHAR)value);
+    }
+
+    if (FAILED(DmpLogDecode(log, text)))
+    {
+        printf("ERROR: %s is too small to be a log file\r\n", argv[1]);
+        goto Exit;
+    }
+
+    fwrite(text.data(), 1, text.size(), out);
+    result = 0;
+
+Exit:
+    if (nullptr != in)
+    {
+        fclose(in);
+    }
+
+    if ((nullptr != out) && (stdout != out))
+    {
+        fclose(out);
+    }
+
+    return result;
+}
@@ -31,12 +31,15 @@ Author:
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <algorithm>
 
 #include "makeDumpFile.h"
 #include "MakeHeader.h"
 #include "processArgs.h"
 #include "processDDR.h"
 #include "processSV.h"
+#include "parallelPayload.h"
+#include "syntheticImage.h"
 
 DUMP_CONFIG     config = { 0 };
 std::string     outFileName = DEFAULT_DUMP_FILE_NAME;
@@ -96,7 +99,7 @@ int main(int argc, char **argv)
             printf("ERROR: opening file \"%s\", (%#lx)\r\n", outFileName.c_str(), hr);
         }
     }
-    else if (FAILED(hr = UpdateDDRWithDefault(&config.sectionDDR, config.DDR_Size)))
+    else if (FAILED(hr = UpdateDDRWithDefault(&config.sectionDDR, config.DDR_Size, config.DDR_Gap)))
     {
         printf("ERROR: UpdateDDRWithDefault(), (%#lx)\r\n", hr);
     }
@@ -124,10 +127,22 @@ int main(int argc, char **argv)
     { // Write the sections table 
         printf("ERROR: failed to write sections table, %#lx\r\n", hr);
     }
-    else if ( config.writePayload && (FAILED(hr = WritePayload(&dumpFile, &config))) )
+    else if ( config.writePayload && config.writeChunked && (FAILED(hr = WriteChunkedPayload(&dumpFile, &config))) )
     {
+        printf("ERROR: failed to write chunked payload, (%#lx)\r\n", hr);
+    }
+    else if ( config.writePayload && !config.writeChunked && !config.outputToPartition && (FAILED(hr = WriteParallelPayload(&config, &outFileName))) )
+    { // File output, payload written in parallel and padding left as a hole
         printf("ERROR: failed to write payload, (%#lx)\r\n", hr);
     }
+    else if ( config.writePayload && !config.writeChunked && config.outputToPartition && (FAILED(hr = WritePayload(&dumpFile, &config))) )
+    {
+        printf("ERROR: failed to write payload, (%#lx)\r\n", hr);
+    }
+    else if ( (SYNTHETIC_IMAGE_NONE != config.syntheticImage) && (FAILED(hr = WriteSyntheticImage(&dumpFile, &config, &outFileName))) )
+    { // Memory image over the payload just written, for raw2dump
+        printf("ERROR: failed to write synthetic memory image, (%#lx)\r\n", hr);
+    }
     else
     {
         hr = S_OK;
@@ -256,6 +271,8 @@ HRESULT OpenOutput(_In_ PDUMP_CONFIG cfg, _In_ std::string *fName, _Out_ DEVICE_
 **          _In_ PDUMP_CONFIG cfg)
 **
 ** Description:
+**  Write the sections table at the current position. The entries are gathered in one buffer and
+**  written with a single write, tables can have tens of thousands of DDR sections.
 **
 ** Arguments:
 **  oFile - output file handle (DEVICE_IO)
@@ -267,7 +284,8 @@ HRESULT OpenOutput(_In_ PDUMP_CONFIG cfg, _In_ std::string *fName, _Out_ DEVICE_
 *****************************************************************************************************/
 HRESULT WriteSections(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg)
 {
-    HRESULT hr = S_OK;
+    HRESULT                                 hr = S_OK;
+    std::vector<RAW_DUMP_SECTION_HEADER>    table;
 
     if ((nullptr == oFile) || (nullptr == cfg))
     {
@@ -281,20 +299,28 @@ HRESULT WriteSections(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg)
     }
     else
     { // Write the Sections table
+        table.reserve(cfg->dumpFileSections.size());
+
         for (UINT i = 0; i < cfg->dumpFileSections.size(); i++)
-        { // Write each sectsion
+        { // Gather each sectsion
             PRAW_DUMP_SECTION_HEADER pSection = cfg->dumpFileSections.at(i);
 
             if (nullptr == pSection)
             { // Null pointer is bad!
                 hr = E_POINTER;
-                printf("ERROR: dump file sections %d is null, invlaid table reference, (%#lx)\r\n", hr);
-            }
-            else if (FAILED(hr = oFile->Write((PCHAR)pSection, sizeof(RAW_DUMP_SECTION_HEADER), NULL)))
-            { // failed to Write the section
-                printf("ERROR: dump file sections table is invalid and uncorrectable, (%#lx)\r\n", hr);
+                printf("ERROR: dump file sections %d is null, invlaid table reference, (%#lx)\r\n", i, hr);
+                break;
             }
 
+            table.push_back(*pSection);
+        }
+
+        if (SUCCEEDED(hr) &&
+            !table.empty() &&
+            FAILED(hr = oFile->Write((PCHAR)&table[0], SECTION_TABLE_SIZE(table.size()), NULL))
+           )
+        { // failed to Write the table
+            printf("ERROR: dump file sections table is invalid and uncorrectable, (%#lx)\r\n", hr);
         }
 
     }
@@ -548,6 +574,312 @@ HRESULT WritePattern(_Inout_ DEVICE_IO *oFile, _In_ PCHAR pattern, _In_ size_t p
 }
 
 
+/****************************************************************************************************
+** HRESULT WriteChunkedPayload(
+**          _Inout_ DEVICE_IO *oFile,
+**          _In_ PDUMP_CONFIG cfg)
+**
+** Description:
+**  /Chunked version of WritePayload. DDR sections are written as v2 chunked sections (chunk index
+**  followed by the encoded chunks), other sections are written as in v1. The payload is the same
+**  test pattern WritePayload writes, the pattern of each section still follows its v1 offset so
+**  that both files extract to the same data.
+**
+**  Section offsets are only known once each section is written, the header and the section table
+**  are written again at the end with the final offsets, flags and dump size.
+**
+** Arguments:
+**  oFile - output file handle (DEVICE_IO), positioned after the sections table
+**  cfg - dump file configuration data
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT WriteChunkedPayload(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg)
+{
+    HRESULT     hr = S_OK;
+
+    if ( (nullptr == oFile) ||
+         (nullptr == cfg)
+       )
+    {
+        printf("ERROR: Invalid arguments passed to WriteChunkedPayload()\r\n");
+        hr = E_INVALIDARG;
+    }
+    else
+    { // Write the payload, one section at a time
+        ULONGLONG       fileOffset = cfg->payloadOffset.QuadPart;
+        ULONGLONG       sizeWritten = 0;
+        ULARGE_INTEGER  bytesForPadding = { 0 };
+
+        // Create a Test pattern
+        for (size_t i = 0; i < sizeof testPattern; i++)
+        {
+            testPattern[i] = (i % TEST_PATTERN_SIZE) + TEST_PATTERN_BEGIN;
+        }
+
+        printf("INFO: Writing chunked payload data, chunk size %#x\r\n", cfg->chunkSize);
+
+        for (UINT i = 0; SUCCEEDED(hr) && (i < cfg->dumpFileSections.size()); i++)
+        {
+            PRAW_DUMP_SECTION_HEADER pSection = cfg->dumpFileSections.at(i);
+
+            if (RAW_DUMP_SECTION_TYPE_DDR_RANGE == pSection->Type)
+            { // DDR sections are chunked
+                if (FAILED(hr = WriteChunkedSection(oFile, cfg, pSection, fileOffset, &sizeWritten)))
+                {
+                    printf("ERROR: failed to write chunked section %d, (%#lx)\r\n", i, hr);
+                }
+
+            }
+            else if (FAILED(hr = oFile->SetPos(fileOffset)) ||
+                     FAILED(hr = WritePatternAt(oFile, pSection->Offset, pSection->Size))
+                    )
+            { // Other sections keep the v1 layout
+                printf("ERROR: failed to write section %d, (%#lx)\r\n", i, hr);
+            }
+            else
+            {
+                pSection->Offset = fileOffset;
+                sizeWritten = pSection->Size;
+            }
+
+            fileOffset += sizeWritten;
+        }
+
+        if (SUCCEEDED(hr))
+        { // Rewrite the header and the sections table with the final offsets
+            cfg->dumpFileHeader.DumpSize = fileOffset;
+            cfg->dumpFileHeader.TotalDumpSizeRequired = fileOffset;
+
+            if (FAILED(hr = oFile->SetPos((ULONGLONG)0)) ||
+                FAILED(hr = oFile->Write((PCHAR)&cfg->dumpFileHeader, sizeof(cfg->dumpFileHeader), NULL)) ||
+                FAILED(hr = WriteSections(oFile, cfg))
+               )
+            {
+                printf("ERROR: failed to update the header and sections table, (%#lx)\r\n", hr);
+            }
+            else
+            {
+                printf("INFO: %lld bytes of payload written in %lld bytes\r\n",
+                       (cfg->DDR_PayloadSize.QuadPart + cfg->CPU_PayloadSize.QuadPart + cfg->SV_PayloadSize.QuadPart),
+                       (fileOffset - cfg->payloadOffset.QuadPart));
+            }
+
+        }
+
+        if (SUCCEEDED(hr) && cfg->outputToPartition)
+        { // Pad the rest of the partition
+            if (fileOffset > oFile->GetCurrentPartitionSize())
+            { // If the payload is bigger than the partition, this is an error.
+                printf("ERROR: payload size is larger than the target partition.\r\n");
+                hr = E_FAIL;
+            }
+            else if (0 != (bytesForPadding.QuadPart = oFile->GetCurrentPartitionSize() - fileOffset))
+            {
+                ULARGE_INTEGER  bytesWritten;
+
+                printf("INFO: Writing padding data to partition\r\n");
+                if (FAILED(hr = oFile->SetPos(fileOffset)) ||
+                    FAILED(hr = WritePattern(oFile, (PCHAR)paddPattern, sizeof paddPattern, bytesForPadding, &bytesWritten))
+                   )
+                { // Failed to write padding data
+                    printf("ERROR: failed to write padding data\r\n");
+                }
+                else if (bytesForPadding.QuadPart != bytesWritten.QuadPart)
+                { // fail for incomplete write
+                    printf("ERROR: incomplete padding write\r\n");
+                    hr = E_FAIL;
+                }
+
+            }
+
+        }
+
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************************
+** HRESULT WriteChunkedSection(
+**          _Inout_ DEVICE_IO *oFile,
+**          _In_ PDUMP_CONFIG cfg,
+**          _Inout_ PRAW_DUMP_SECTION_HEADER section,
+**          _In_ ULONGLONG fileOffset,
+**          _Out_ ULONGLONG *sizeWritten)
+**
+** Description:
+**  Writes one section as a v2 chunked section at fileOffset: the chunk index first, then every
+**  chunk of test pattern encoded with EncodeChunk. The index is written last, once the size of
+**  every chunk is known. The section entry is updated to point to the index.
+**
+** Arguments:
+**  oFile - output file handle (DEVICE_IO)
+**  cfg - dump file configuration data
+**  section - section to write, its Offset is the v1 offset on entry
+**  fileOffset - where to write the section
+**  sizeWritten - number of bytes written, index included
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT WriteChunkedSection(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg, _Inout_ PRAW_DUMP_SECTION_HEADER section, _In_ ULONGLONG fileOffset, _Out_ ULONGLONG *sizeWritten)
+{
+    HRESULT                             hr = S_OK;
+    RAW_DUMP_CHUNK_INDEX_HEADER         indexHeader = { 0 };
+    std::vector<RAW_DUMP_CHUNK_ENTRY>   entries;
+    PUCHAR                              data = nullptr;
+    PUCHAR                              stored = nullptr;
+    PVOID                               workspace = nullptr;
+    UINT32                              workspaceSize = 0;
+
+    *sizeWritten = 0;
+
+    indexHeader.Signature = RAW_DUMP_CHUNK_INDEX_SIGNATURE;
+    indexHeader.Version = RAW_DUMP_CHUNK_INDEX_VERSION;
+    indexHeader.ChunkSize = cfg->chunkSize;
+    indexHeader.ChunkCount = RAW_DUMP_CHUNK_COUNT(section->Size, (ULONGLONG)cfg->chunkSize);
+    entries.resize(indexHeader.ChunkCount + 1);
+
+    if (FAILED(hr = GetChunkWorkspaceSize(&workspaceSize)))
+    {
+        printf("ERROR: failed to get the compression workspace size, (%#lx)\r\n", hr);
+    }
+    else if ((nullptr == (data = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, cfg->chunkSize))) ||
+             (nullptr == (stored = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, cfg->chunkSize))) ||
+             (nullptr == (workspace = HeapAlloc(GetProcessHeap(), 0, workspaceSize)))
+            )
+    {
+        hr = E_OUTOFMEMORY;
+        printf("ERROR: failed to allocate chunk buffers, (%#lx)\r\n", hr);
+    }
+    else if (FAILED(hr = oFile->SetPos(fileOffset + RAW_DUMP_CHUNK_INDEX_SIZE(indexHeader.ChunkCount))))
+    {
+        printf("ERROR: failed to seek to the chunk data, (%#lx)\r\n", hr);
+    }
+    else
+    { // Write the chunks, then the index
+        for (UINT32 chunk = 0; SUCCEEDED(hr) && (chunk < indexHeader.ChunkCount); chunk++)
+        {
+            ULONGLONG   chunkStart = (ULONGLONG)chunk * cfg->chunkSize;
+            UINT32      chunkLength = (UINT32)min((ULONGLONG)cfg->chunkSize, section->Size - chunkStart);
+
+            for (UINT32 i = 0; i < chunkLength; i++)
+            { // Same pattern the v1 layout would have at this offset
+                data[i] = (UCHAR)OFFSET2VALUE(section->Offset + chunkStart + i);
+            }
+
+            if (FAILED(hr = EncodeChunk(data, chunkLength, stored, workspace, &entries[chunk])))
+            {
+                printf("ERROR: failed to encode chunk %d, (%#lx)\r\n", chunk, hr);
+            }
+            else if ((0 != entries[chunk].StoredSize) &&
+                     FAILED(hr = oFile->Write((PCHAR)stored, entries[chunk].StoredSize, NULL))
+                    )
+            {
+                printf("ERROR: failed to write chunk %d, (%#lx)\r\n", chunk, hr);
+            }
+            else
+            {
+                entries[chunk].Offset = indexHeader.DataSize;
+                indexHeader.DataSize += entries[chunk].StoredSize;
+            }
+
+        }
+
+        indexHeader.EntriesCrc = ComputeCrc32(&entries[0], indexHeader.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY), 0);
+
+        if (SUCCEEDED(hr) &&
+            (FAILED(hr = oFile->SetPos(fileOffset)) ||
+             FAILED(hr = oFile->Write((PCHAR)&indexHeader, sizeof(indexHeader), NULL)) ||
+             FAILED(hr = oFile->Write((PCHAR)&entries[0], indexHeader.ChunkCount * sizeof(RAW_DUMP_CHUNK_ENTRY), NULL))
+            )
+           )
+        {
+            printf("ERROR: failed to write the chunk index, (%#lx)\r\n", hr);
+        }
+        else if (SUCCEEDED(hr))
+        {
+            printf("INFO: DDR section at %#016I64x, %lld bytes written in %lld\r\n",
+                   section->u.DDRInformation.Base,
+                   section->Size,
+                   RAW_DUMP_CHUNK_INDEX_SIZE(indexHeader.ChunkCount) + indexHeader.DataSize);
+
+            section->Offset = fileOffset;
+            section->Version = RAW_DUMP_SECTION_HEADER_VERSION_V2;
+            section->Flags |= RAW_DUMP_SECTION_FLAGS_CHUNKED;
+            *sizeWritten = RAW_DUMP_CHUNK_INDEX_SIZE(indexHeader.ChunkCount) + indexHeader.DataSize;
+        }
+
+    }
+
+    if (nullptr != data)
+    {
+        HeapFree(GetProcessHeap(), 0, data);
+    }
+
+    if (nullptr != stored)
+    {
+        HeapFree(GetProcessHeap(), 0, stored);
+    }
+
+    if (nullptr != workspace)
+    {
+        HeapFree(GetProcessHeap(), 0, workspace);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************************
+** HRESULT WritePatternAt(
+**          _Inout_ DEVICE_IO *oFile,
+**          _In_ ULONGLONG patternOffset,
+**          _In_ ULONGLONG writeSize)
+**
+** Description:
+**  Writes writeSize bytes of the test pattern, starting with the byte the pattern has at
+**  patternOffset, at the current position of oFile. testPattern must be initialized.
+**
+** Arguments:
+**  oFile - output file handle (DEVICE_IO)
+**  patternOffset - offset in the pattern of the first byte
+**  writeSize - number of bytes to write
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT WritePatternAt(_Inout_ DEVICE_IO *oFile, _In_ ULONGLONG patternOffset, _In_ ULONGLONG writeSize)
+{
+    HRESULT hr = S_OK;
+
+    while (SUCCEEDED(hr) && (0 != writeSize))
+    {
+        size_t  patternBegin = (size_t)(patternOffset % TEST_PATTERN_SIZE);
+        size_t  bWrite = (size_t)min((ULONGLONG)((sizeof testPattern) - patternBegin), writeSize);
+
+        if (FAILED(hr = oFile->Write((PCHAR)&testPattern[patternBegin], bWrite, NULL)))
+        {
+            printf("ERROR: failed to write test pattern, (%#lx)\r\n", hr);
+        }
+        else
+        {
+            patternOffset += bWrite;
+            writeSize -= bWrite;
+        }
+
+    }
+
+    return hr;
+}
+
+
 /****************************************************************************************************
 ** HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
 **
@@ -566,6 +898,7 @@ HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
     HRESULT hr = S_OK;
     cfg->dumpFileHeader.SectionsCount = (UINT)(cfg->sectionDDR.size() + cfg->sectionSV.size() + cfg->sectionCPU.size());
     std::vector<PRAW_DUMP_SECTION_HEADER> dumpFileSections(cfg->dumpFileHeader.SectionsCount);      // Size the final table appropriately
+    std::vector<PRAW_DUMP_SECTION_HEADER> sectionDDR;                                               // References to the DDR sections, once sorted
 
     cfg->payloadOffset.QuadPart = cfg->sectionTableOffset.QuadPart + SECTION_TABLE_SIZE(cfg->dumpFileHeader.SectionsCount);
 
@@ -581,6 +914,10 @@ HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
               );
 
     }
+    else if (FAILED(hr = referenceSectionTable(sectionDDR, cfg->sectionDDR)))
+    { // The DDR table is final, its entries are referenced like the other lists
+        printf("ERROR: failed to reference DDR sections, (%#lx)\r\n", hr);
+    }
     else if (DDR_PROXIMITY_ADJACENT == cfg->DDR_Proximity)
     { // Copy the sections to destination vector, as listed
 
@@ -588,7 +925,7 @@ HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
         { //Failed to copy section
             printf("ERROR: failed to copy SV section (ADJACENT), (%#lx)\r\n", hr);
         }
-        else if (FAILED(hr = copySectionTable(dumpFileSections, cfg->sectionDDR)))
+        else if (FAILED(hr = copySectionTable(dumpFileSections, sectionDDR)))
         { //Failed to copy section
             printf("ERROR: failed to copy DDR section (ADJACENT), (%#lx)\r\n", hr);
         }
@@ -611,11 +948,11 @@ HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
             switch (sectionSelected)
             {
                 case RAW_DUMP_SECTION_TYPE_DDR_RANGE:   // = 0x1,
-                    if ( (0 != cfg->sectionDDR.size()) &&
-                         (idxDDR < cfg->sectionDDR.size())
+                    if ( (0 != sectionDDR.size()) &&
+                         (idxDDR < sectionDDR.size())
                        )
                     {
-                        dumpFileSections[idxDst] = cfg->sectionDDR[idxDDR++];
+                        dumpFileSections[idxDst] = sectionDDR[idxDDR++];
                     }
                     else
                     {
@@ -628,7 +965,7 @@ HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg)
                          (idxCPU < cfg->sectionCPU.size())
                        )
                     {
-                        dumpFileSections[idxDst] = cfg->sectionCPU[idxDDR++];
+                        dumpFileSections[idxDst] = cfg->sectionCPU[idxCPU++];
                     }
                     else
                     {
@@ -707,6 +1044,46 @@ HRESULT setTableOffsets(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst)
 }
 
 
+/****************************************************************************************************
+** HRESULT referenceSectionTable(
+**          _Out_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst,
+**          _In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc)
+**
+** Description:
+**  Fill vDst with a pointer to each entry of vSrc, in order, so a table stored contiguously can be
+**  merged with copySectionTable. vSrc must not be resized while vDst is in use.
+**
+** Arguments:
+**  vDst - vector table of references to fill
+**  vSrc - source vector table
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT referenceSectionTable(_Out_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst, _In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc)
+{
+    HRESULT hr = S_OK;
+
+    try
+    {
+        vDst.clear();
+        vDst.reserve(vSrc.size());
+        for (size_t idx = 0; idx < vSrc.size(); idx++)
+        {
+            vDst.push_back(&vSrc[idx]);
+        }
+
+    }
+    catch (...)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    return hr;
+}
+
+
 /****************************************************************************************************
 ** HRESULT copySectionTable(
 **          _Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst,
@@ -791,7 +1168,7 @@ HRESULT copySectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst, _I
 
 /****************************************************************************************************
 ** HRESULT sortDDRSectionTable(
-**          _Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc,
+**          _Inout_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc,
 **          _In_ DDR_ORDER order)
 **
 ** Description:
@@ -806,7 +1183,7 @@ HRESULT copySectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst, _I
 **  HRESULT
 **
 *****************************************************************************************************/
-HRESULT sortDDRSectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc, _In_ DDR_ORDER order)
+HRESULT sortDDRSectionTable(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc, _In_ DDR_ORDER order)
 {
     HRESULT hr = S_OK;
 
@@ -843,12 +1220,12 @@ HRESULT sortDDRSectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc,
 
 /****************************************************************************************************
 ** HRESULT sortVector(
-**          _Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc,
+**          _Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc,
 **          _In_ DDR_ORDER order)
 **
 ** Description:
-**  Sort the table provided (vSrc) using the designated order.  Typically, DDR sections are
-**  sorted, this function sorts any vector table.
+**  Sort the table provided (vSrc) by base address using the designated order, O(n log n).
+**  Typically, DDR sections are sorted.
 **
 ** Arguments:
 **  vSrc - source vector table
@@ -858,7 +1235,7 @@ HRESULT sortDDRSectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc,
 **  HRESULT
 **
 *****************************************************************************************************/
-HRESULT sortVector(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR_ORDER order)
+HRESULT sortVector(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR_ORDER order)
 {
     HRESULT hr = S_OK;
 
@@ -869,27 +1246,15 @@ HRESULT sortVector(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR
     {
         hr = E_INVALIDARG;
     }
+    else if (DDR_ORDER_ASCENDING == order)
+    {
+        std::stable_sort(vSrc->begin(), vSrc->end(),
+                         [](const RAW_DUMP_SECTION_HEADER &a, const RAW_DUMP_SECTION_HEADER &b) { return a.u.DDRInformation.Base < b.u.DDRInformation.Base; });
+    }
     else
     {
-        size_t n = vSrc->size();
-
-        for (size_t c = 0; c < (n-1); c++)
-        {
-            for (size_t d = 0; d < (n - c - 1); d++)
-            {
-                if ( ((DDR_ORDER_ASCENDING == order)  && (vSrc->at(d)->u.DDRInformation.Base > vSrc->at(d + 1)->u.DDRInformation.Base)) ||
-                     ((DDR_ORDER_DESCENDING == order) && (vSrc->at(d)->u.DDRInformation.Base < vSrc->at(d + 1)->u.DDRInformation.Base))
-                   )
-                { //swap
-                    PRAW_DUMP_SECTION_HEADER tmp = vSrc->at(d);
-                    vSrc->at(d) = vSrc->at(d + 1);
-                    vSrc->at(d + 1) = tmp;
-                }
-
-            }
-
-        }
-
+        std::stable_sort(vSrc->begin(), vSrc->end(),
+                         [](const RAW_DUMP_SECTION_HEADER &a, const RAW_DUMP_SECTION_HEADER &b) { return a.u.DDRInformation.Base > b.u.DDRInformation.Base; });
     }
 
     return hr;
@@ -897,10 +1262,11 @@ HRESULT sortVector(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR
 
 
 /****************************************************************************************************
-** HRESULT randomizeVector(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc)
+** HRESULT randomizeVector(_In_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc)
 **
 ** Description:
-**  Randomizes the table provided (vSrc)
+**  Randomizes the table provided (vSrc), Fisher-Yates shuffle. rand() only has 15 bits, two calls
+**  are combined so tables larger than RAND_MAX are shuffled too.
 **
 ** Arguments:
 **  vSrc - vector table to randomize
@@ -909,7 +1275,7 @@ HRESULT sortVector(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR
 **  HRESULT
 **
 *****************************************************************************************************/
-HRESULT randomizeVector(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc)
+HRESULT randomizeVector(_In_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc)
 {
     HRESULT hr = S_OK;
 
@@ -919,43 +1285,13 @@ HRESULT randomizeVector(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc)
     }
     else
     {
-        UINT  s = (UINT)vSrc->size();      // Destination index
-
-        // Temporary vector - all null
-        std::vector<PRAW_DUMP_SECTION_HEADER> ddrTmp(vSrc->size());
-
-        for (size_t i = 0; i < s; i++)
-        { // Index through the source
-            UINT    idx = rand() % s;
-
-            // Find the nearest open slot
-            // Ideally, IDX will be the index of an open slot in the detination vector.
-            // This case will be caught in the first "if".  WHen IDX points to an
-            // occupued slot, the search for an open slot looks at the adjacent slots
-            // from 1 to "s" until an open slot is found.
-            for (UINT j = 0; j < s; j++)
-            {
-                if ( (idx >= j) && ((idx - j) >= 0) && (nullptr == ddrTmp[idx - j]) )
-                { // slot before is open
-                    idx -= j;
-                }
-                else if ( ((idx + j) < s) && (nullptr == ddrTmp[idx + j]) )
-                { // slot after is open
-                    idx += j;
-                }
-                else
-                { // no match, increase the distance and check again
-                    continue;
-                }
-
-                // Fall through to here when we have an open slot
-                ddrTmp[idx] = vSrc->at(i);
-                break;
-            }
+        for (size_t i = vSrc->size(); i > 1; i--)
+        { // Swap the last unshuffled entry with any entry before it
+            size_t  idx = ((((size_t)rand()) << 15) | (size_t)rand()) % i;
 
+            std::swap((*vSrc)[i - 1], (*vSrc)[idx]);
         }
-        
-        *vSrc = ddrTmp;
+
     }
 
     return hr;
@@ -1002,6 +1338,32 @@ void DumpVectorTable(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc)
 }
 
 
+/****************************************************************************************************
+** void DumpVectorTable(_In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc)
+**
+** Description:
+**  Prints a table stored contiguously, typically the DDR sections
+**
+** Arguments:
+**  vSrc - vector table to dump
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+void DumpVectorTable(_In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc)
+{
+    std::vector<PRAW_DUMP_SECTION_HEADER>   references;
+
+    if (SUCCEEDED(referenceSectionTable(references, vSrc)))
+    {
+        DumpVectorTable(references);
+    }
+
+    return;
+}
+
+
 /****************************************************************************************************
 ** HRESULT DumpConfigInfo(
 **          _Inout_ PDUMP_CONFIG cfg,
@@ -1057,6 +1419,24 @@ HRESULT DumpConfigInfo(_Inout_ PDUMP_CONFIG cfg, _In_ std::wstring fName)
         printf("\t                SV Sections : %d\r\n", cfg->sectionSV.size());
         printf("\t               CPU Sections : %d\r\n", cfg->sectionCPU.size());
         printf("\t             Total Sections : %d\r\n", cfg->sectionSV.size() + cfg->sectionDDR.size() + cfg->sectionCPU.size());
+        if (cfg->writeChunked)
+        {
+            printf("\t         Chunked DDR, chunk : %#x\r\n", cfg->chunkSize);
+        }
+        if (0 != cfg->DDR_Gap.QuadPart)
+        {
+            printf("\t            Default DDR Gap : %#I64x\r\n", cfg->DDR_Gap.QuadPart);
+        }
+        if (0 != cfg->writerThreads)
+        {
+            printf("\t      Payload Write Threads : %d\r\n", cfg->writerThreads);
+        }
+        if (SYNTHETIC_IMAGE_NONE != cfg->syntheticImage)
+        {
+            printf("\t       Synthetic Image Type : %s%s\r\n",
+                   (SYNTHETIC_IMAGE_ARM64 == cfg->syntheticImage) ? "ARM64" : "X86",
+                   cfg->encodeKdbg ? ", encoded KDBG" : "");
+        }
         if (0 != cfg->requestedRawDumpFileSize.QuadPart)
         {
             printf("\t        File Size Requested : %lld (%#016I64x)\r\n", cfg->requestedRawDumpFileSize, cfg->requestedRawDumpFileSize);
@@ -19,6 +19,7 @@ Author:
 
 #include "DEVICE_IO.h"
 #include "SV_Specific.h"
+#include "Chunked_Section.h"
 #pragma pack(1)
 #include "Dump_Header.h"
 #include "RawDumpDefs.h"
@@ -28,7 +29,7 @@ Author:
 #define INVALID_ULARGE_INTEGER              MAX_VALUE(ULONGLONG)
 #define MAX_UINT32                          MAX_VALUE(UINT32)
 #define MAX_ULONGLONG                       MAX_VALUE(ULONGLONG)
-#define MAX_DDR_SECTIONS                    250
+#define MAX_DDR_SECTIONS                    (64 * 1024)
 
 // DDR defaults
 #define DEFAULT_DDR_SECTIONS_COUNT          2
@@ -86,6 +87,14 @@ typedef enum
 } OUTPUT_CONTROL_FLAG;
 
 
+typedef enum
+{ // Memory image written over the DDR payload, set by /Synthetic
+    SYNTHETIC_IMAGE_NONE = 0,
+    SYNTHETIC_IMAGE_ARM64,
+    SYNTHETIC_IMAGE_X86
+} SYNTHETIC_IMAGE_TYPE;
+
+
 typedef struct _DDR_SECTION_DATA
 { // struct to describe a DDR entry
     UINT32            sectionID;
@@ -119,14 +128,20 @@ typedef struct _DUMP_CONFIG
     ULARGE_INTEGER                          actualRawDumpFileSize;      // Computed size of the output file, determined from table data
     ULARGE_INTEGER                          sectionTableOffset;
     ULARGE_INTEGER                          payloadOffset;
+    BOOL                                    writeChunked;               // flag - write DDR sections as v2 chunked sections, set by /Chunked
+    UINT32                                  chunkSize;                  // Chunk size for /Chunked, RAW_DUMP_CHUNK_SIZE_DEFAULT unless given
+    UINT32                                  writerThreads;              // Payload writer threads for file output, set by /Threads, 0 for one per processor
+    SYNTHETIC_IMAGE_TYPE                    syntheticImage;             // Memory image written over the DDR payload, set by /Synthetic
+    BOOL                                    encodeKdbg;                 // flag - synthetic image has an encoded KdDebuggerDataBlock, set by /Synthetic:<arch>:Encoded
 
     // DDR Section parameters
     UINT32                                  DDR_SectionCount;           // Number of sections, can be set by /DDRCount
     DDR_PROXIMITY                           DDR_Proximity;              // Proximity of DDR sections, can be set by /DDRProximity
     DDR_ORDER                               DDR_Order;                  // Ordering of DDR sections, can be set by /DDROrder
     ULARGE_INTEGER                          DDR_Size;                   // Default DDR section size, can be set by /DDRSize
+    ULARGE_INTEGER                          DDR_Gap;                    // Hole left after each default DDR section, can be set by /DDRGap
     ULARGE_INTEGER                          DDR_PayloadSize;            // Total Size of the data for all segments referred to here
-    std::vector<PRAW_DUMP_SECTION_HEADER>   sectionDDR;                 // list of DDR sections
+    std::vector<RAW_DUMP_SECTION_HEADER>    sectionDDR;                 // DDR sections, stored contiguously, rows not set yet are RAW_DUMP_SECTION_TYPE_RESERVED
 
     // ApReg Section parameters
     UINT32                                  CoreCount;
@@ -142,13 +157,18 @@ typedef struct _DUMP_CONFIG
 HRESULT OpenOutput(_In_ PDUMP_CONFIG cfg, _In_ std::string *fName, _Out_ DEVICE_IO *oHandle);
 HRESULT WriteSections(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg);
 HRESULT WritePayload(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg);
+HRESULT WriteChunkedPayload(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg);
+HRESULT WriteChunkedSection(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg, _Inout_ PRAW_DUMP_SECTION_HEADER section, _In_ ULONGLONG fileOffset, _Out_ ULONGLONG *sizeWritten);
+HRESULT WritePatternAt(_Inout_ DEVICE_IO *oFile, _In_ ULONGLONG patternOffset, _In_ ULONGLONG writeSize);
 HRESULT WritePattern(_Inout_ DEVICE_IO *oFile, _In_ PCHAR pattern, _In_ size_t patternSize, _In_ ULARGE_INTEGER writeSize, _Out_ ULARGE_INTEGER *bytesWritten);
 HRESULT CreateFullSectionsTable(_Inout_ PDUMP_CONFIG cfg);
 HRESULT setTableOffsets(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst);
+HRESULT referenceSectionTable(_Out_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst, _In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc);
 HRESULT copySectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vDst, _In_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc);
-HRESULT sortDDRSectionTable(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc, _In_ DDR_ORDER order);
-HRESULT sortVector(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR_ORDER order);
-HRESULT randomizeVector(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *vSrc);
+HRESULT sortDDRSectionTable(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc, _In_ DDR_ORDER order);
+HRESULT sortVector(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc, _In_ DDR_ORDER order);
+HRESULT randomizeVector(_In_ std::vector<RAW_DUMP_SECTION_HEADER> *vSrc);
 void    DumpVectorTable(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> &vSrc);
+void    DumpVectorTable(_In_ std::vector<RAW_DUMP_SECTION_HEADER> &vSrc);
 HRESULT DumpConfigInfo(_Inout_ PDUMP_CONFIG cfg, _In_ std::wstring fName);
 HRESULT DumpParserWarnings(_In_ std::string *str);
\ No newline at end of file
@@ -121,5 +121,59 @@ HRESULT GetSectionSize(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList,
 
     }
 
+    return ret;
+}
+
+
+/****************************************************************************************************
+** HRESULT  GetSectionSize(
+**              _In_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList,
+**              _Out_ PULARGE_INTEGER sizeTotal)
+**
+** Description:
+**  Same as above, for a table that holds the RAW_DUMP_SECTION_HEADER structures themselves, like
+**  the DDR table. A row still RAW_DUMP_SECTION_TYPE_RESERVED is a hole.
+**
+** Arguments:
+**  sectionList - table of RAW_DUMP_SECTION_HEADER elements
+**  sizeTotal - pointer to a ULARGE_INTEGER, return size of payload data
+**
+** Return:
+**  S_OK
+**  E_INVALIDARG - one of the arguments is nullptr
+**  E_FAIL - found a row that was never set, the table has holes
+**
+*****************************************************************************************************/
+HRESULT GetSectionSize(_In_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _Out_ PULARGE_INTEGER sizeTotal)
+{
+    HRESULT ret = S_OK;
+
+    if ((nullptr == sectionList) || (nullptr == sizeTotal))
+    { // fail if pointers are null
+        ret = E_INVALIDARG;
+    }
+    else
+    {
+        size_t nEntries = sectionList->size();
+
+        (*sizeTotal).QuadPart = 0;
+
+        for (size_t i = 0; i < nEntries; i++)
+        {
+            if (RAW_DUMP_SECTION_TYPE_RESERVED == (*sectionList)[i].Type)
+            { // Fail if one of the entries was never set
+                ret = E_FAIL;
+                (*sizeTotal).QuadPart = 0;
+                break;
+            }
+            else
+            {
+                (*sizeTotal).QuadPart += (*sectionList)[i].Size;
+            }
+
+        }
+
+    }
+
     return ret;
 }
\ No newline at end of file
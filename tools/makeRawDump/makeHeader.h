@@ -16,4 +16,5 @@ Author:
 #include "MakeDumpFile.h"
 
 HRESULT GetSectionSize(_In_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList, _Out_ PULARGE_INTEGER sizeTotal);
+HRESULT GetSectionSize(_In_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _Out_ PULARGE_INTEGER sizeTotal);
 HRESULT PopulateRawDumpFileHeader(_Inout_ PDUMP_CONFIG config);
@@ -0,0 +1,263 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    parallelPayload.cpp
+
+Environment:
+    User Mode
+
+--*/
+
+#include <windows.h>
+#include <winioctl.h>
+#include <stdio.h>
+
+#include "parallelPayload.h"
+
+/****************************************************************************************************
+** HRESULT WriteParallelPayload(
+**          _In_ PDUMP_CONFIG cfg,
+**          _In_ std::string *fName)
+**
+** Description:
+**  File output version of WritePayload. The payload is the same test pattern, where the value of
+**  each byte only depends on its file offset, so it can be written in any order: the payload is
+**  split in PARALLEL_WRITE_SIZE slices and cfg->writerThreads threads write them with positional
+**  writes, all from one read only pattern buffer.
+**
+**  The file is made sparse and sized to the larger of the dump size and /FileSize before the
+**  payload is written, anything past the payload is a hole rather than written padding.
+**
+**  The header and sections table must already be written, through DEVICE_IO, to fName.
+**
+** Arguments:
+**  cfg - dump file configuration data
+**  fName - name of the output file
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT WriteParallelPayload(_In_ PDUMP_CONFIG cfg, _In_ std::string *fName)
+{
+    HRESULT                 hr = S_OK;
+    PARALLEL_WRITE_CONTEXT  context = { 0 };
+    PCHAR                   pattern = nullptr;
+    HANDLE                  threads[MAX_WRITER_THREADS] = { 0 };
+    UINT32                  threadCount = 0;
+    UINT32                  threadsStarted = 0;
+    ULONGLONG               sliceCount = 0;
+    ULONGLONG               fileSize = 0;
+
+    context.hFile = INVALID_HANDLE_VALUE;
+    context.hr = S_OK;
+
+    if ((nullptr == cfg) || (nullptr == fName) || (cfg->outputToPartition))
+    {
+        printf("ERROR: Invalid arguments passed to WriteParallelPayload()\r\n");
+        hr = E_INVALIDARG;
+    }
+    else if (nullptr == (pattern = (PCHAR)HeapAlloc(GetProcessHeap(), 0, PARALLEL_PATTERN_SIZE)))
+    {
+        printf("ERROR: failed to allocate the pattern buffer\r\n");
+        hr = E_OUTOFMEMORY;
+    }
+    else if (INVALID_HANDLE_VALUE == (context.hFile = CreateFileA(fName->c_str(),
+                                                                  GENERIC_WRITE,
+                                                                  FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                                                  NULL,
+                                                                  OPEN_EXISTING,
+                                                                  FILE_ATTRIBUTE_NORMAL,
+                                                                  NULL)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        printf("ERROR: failed to open \"%s\" for positional writes, (%#lx)\r\n", fName->c_str(), hr);
+    }
+    else
+    {
+        SYSTEM_INFO     systemInfo = { 0 };
+
+        for (size_t i = 0; i < PARALLEL_PATTERN_SIZE; i++)
+        {
+            pattern[i] = OFFSET2VALUE(i);
+        }
+
+        context.pattern = pattern;
+        context.beginOffset = cfg->payloadOffset.QuadPart;
+        context.endOffset = cfg->dumpFileHeader.DumpSize;
+        sliceCount = ((context.endOffset - context.beginOffset) + PARALLEL_WRITE_SIZE - 1) / PARALLEL_WRITE_SIZE;
+
+        fileSize = max(cfg->dumpFileHeader.DumpSize, cfg->requestedRawDumpFileSize.QuadPart);
+
+        GetSystemInfo(&systemInfo);
+        threadCount = (0 != cfg->writerThreads) ? cfg->writerThreads : systemInfo.dwNumberOfProcessors;
+        threadCount = (UINT32)min(min((ULONGLONG)threadCount, (ULONGLONG)MAX_WRITER_THREADS), max(sliceCount, 1ULL));
+
+        hr = PrepareSparseFile(context.hFile, context.beginOffset, fileSize);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        printf("INFO: Writing Payload data to file, %d threads\r\n", threadCount);
+
+        for (threadsStarted = 0; threadsStarted < threadCount; threadsStarted++)
+        {
+            if (NULL == (threads[threadsStarted] = CreateThread(nullptr, 0, PayloadWriterThread, &context, 0, nullptr)))
+            { // The threads already started stop at the failure
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                InterlockedCompareExchange(&context.hr, hr, S_OK);
+                printf("ERROR: failed to start payload writer thread, (%#lx)\r\n", hr);
+                break;
+            }
+
+        }
+
+        while ((0 != threadsStarted) &&
+               (WAIT_TIMEOUT == WaitForMultipleObjects(threadsStarted, threads, TRUE, WRITER_PROGRESS_INTERVAL_MS))
+              )
+        {
+            printf("\r    %lld Mbytes written             ", context.bytesWritten / ONE_MEGABYTE);
+        }
+
+        for (UINT32 i = 0; i < threadsStarted; i++)
+        {
+            CloseHandle(threads[i]);
+        }
+
+        if (SUCCEEDED(hr) && FAILED(hr = context.hr))
+        {
+            printf("\r\nERROR: failed to write payload data, (%#lx)\r\n", hr);
+        }
+        else if (SUCCEEDED(hr))
+        {
+            printf("\r *  %lld Mbytes written successfully\r\n", context.bytesWritten / ONE_MEGABYTE);
+            if (fileSize > context.endOffset)
+            {
+                printf("INFO: %lld bytes of padding left as a sparse hole\r\n", fileSize - context.endOffset);
+            }
+
+        }
+
+    }
+
+    if (INVALID_HANDLE_VALUE != context.hFile)
+    {
+        CloseHandle(context.hFile);
+    }
+
+    if (nullptr != pattern)
+    {
+        HeapFree(GetProcessHeap(), 0, pattern);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************************
+** DWORD WINAPI PayloadWriterThread(
+**          _In_ LPVOID parameter)
+**
+** Description:
+**  Writes payload slices, taken in order from the shared context, until all are written or any
+**  thread fails. Each write starts at pattern[offset % TEST_PATTERN_SIZE], so the bytes written
+**  match OFFSET2VALUE(offset) for their file offset.
+**
+** Arguments:
+**  parameter - PPARALLEL_WRITE_CONTEXT
+**
+** Return:
+**  0
+**
+*****************************************************************************************************/
+DWORD WINAPI PayloadWriterThread(_In_ LPVOID parameter)
+{
+    PPARALLEL_WRITE_CONTEXT context = (PPARALLEL_WRITE_CONTEXT)parameter;
+
+    while (S_OK == InterlockedCompareExchange(&context->hr, S_OK, S_OK))
+    {
+        ULONGLONG   slice = (ULONGLONG)(InterlockedIncrement64(&context->nextSlice) - 1);
+        ULONGLONG   offset = context->beginOffset + (slice * PARALLEL_WRITE_SIZE);
+        DWORD       bytesToWrite = 0;
+        DWORD       bytesWritten = 0;
+        OVERLAPPED  position = { 0 };
+
+        if (offset >= context->endOffset)
+        { // All slices taken
+            break;
+        }
+
+        bytesToWrite = (DWORD)min((ULONGLONG)PARALLEL_WRITE_SIZE, context->endOffset - offset);
+        position.Offset = (DWORD)offset;
+        position.OffsetHigh = (DWORD)(offset >> 32);
+
+        if ((FALSE == WriteFile(context->hFile, &context->pattern[offset % TEST_PATTERN_SIZE], bytesToWrite, &bytesWritten, &position)) ||
+            (bytesToWrite != bytesWritten)
+           )
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+
+            InterlockedCompareExchange(&context->hr, SUCCEEDED(hr) ? E_FAIL : hr, S_OK);
+            break;
+        }
+
+        InterlockedExchangeAdd64(&context->bytesWritten, bytesWritten);
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+** HRESULT PrepareSparseFile(
+**          _In_ HANDLE hFile,
+**          _In_ ULONGLONG payloadOffset,
+**          _In_ ULONGLONG fileSize)
+**
+** Description:
+**  Marks the file sparse and sets its size to fileSize without writing anything past
+**  payloadOffset. The file is first cut at payloadOffset so that data left by an earlier, larger
+**  file does not show through the holes. A file system without sparse file support still gets the
+**  size set, the unwritten range then reads as zeros.
+**
+** Arguments:
+**  hFile - output file, opened for writing
+**  payloadOffset - end of the header and sections table
+**  fileSize - final size of the file
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT PrepareSparseFile(_In_ HANDLE hFile, _In_ ULONGLONG payloadOffset, _In_ ULONGLONG fileSize)
+{
+    HRESULT             hr = S_OK;
+    DWORD               bytesReturned = 0;
+    FILE_END_OF_FILE_INFO endOfFile = { 0 };
+
+    if (FALSE == DeviceIoControl(hFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL))
+    { // Not fatal, the file is only larger on disk
+        printf("INFO: output file cannot be made sparse, (%#lx)\r\n", HRESULT_FROM_WIN32(GetLastError()));
+    }
+
+    endOfFile.EndOfFile.QuadPart = (LONGLONG)payloadOffset;
+    if (FALSE == SetFileInformationByHandle(hFile, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        printf("ERROR: failed to truncate the output file, (%#lx)\r\n", hr);
+    }
+    else
+    {
+        endOfFile.EndOfFile.QuadPart = (LONGLONG)fileSize;
+        if (FALSE == SetFileInformationByHandle(hFile, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            printf("ERROR: failed to set the output file size, (%#lx)\r\n", hr);
+        }
+
+    }
+
+    return hr;
+}
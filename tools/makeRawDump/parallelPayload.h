@@ -0,0 +1,45 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    parallelPayload.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "makeDumpFile.h"
+
+#define PARALLEL_WRITE_SIZE                 (8 * ONE_MEGABYTE)                      // Bytes per positional write
+#define PARALLEL_PATTERN_SIZE               (TEST_PATTERN_SIZE * 0x20000)           // > PARALLEL_WRITE_SIZE + TEST_PATTERN_SIZE
+#define MAX_WRITER_THREADS                  MAXIMUM_WAIT_OBJECTS
+#define WRITER_PROGRESS_INTERVAL_MS         500
+
+static_assert(PARALLEL_PATTERN_SIZE >= (PARALLEL_WRITE_SIZE + TEST_PATTERN_SIZE), "pattern buffer too small for a write");
+
+// Shared state of the payload writer threads
+typedef struct _PARALLEL_WRITE_CONTEXT
+{
+    HANDLE              hFile;
+    const CHAR          *pattern;           // PARALLEL_PATTERN_SIZE bytes, pattern[i] == OFFSET2VALUE(i)
+    ULONGLONG           beginOffset;        // First payload byte in the file
+    ULONGLONG           endOffset;          // End of the payload
+    volatile LONGLONG   nextSlice;          // Next PARALLEL_WRITE_SIZE slice to write
+    volatile LONGLONG   bytesWritten;
+    volatile LONG       hr;                 // First failure, S_OK otherwise
+} PARALLEL_WRITE_CONTEXT, *PPARALLEL_WRITE_CONTEXT;
+
+/****************************************************************************************************
+** Functions exposed extrnal to this object file
+*****************************************************************************************************/
+HRESULT WriteParallelPayload(_In_ PDUMP_CONFIG cfg, _In_ std::string *fName);
+
+/****************************************************************************************************
+** Functions intrnal to this object file
+*****************************************************************************************************/
+DWORD WINAPI PayloadWriterThread(_In_ LPVOID parameter);
+HRESULT PrepareSparseFile(_In_ HANDLE hFile, _In_ ULONGLONG payloadOffset, _In_ ULONGLONG fileSize);
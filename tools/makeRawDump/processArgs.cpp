@@ -19,6 +19,7 @@ Author:
 
 #include "processArgs.h"
 #include "processDDR.h"
+#include "parallelPayload.h"
 
 #define HEX_PREFIX                      "0x"
 #define TOKEN_DELIMITER                 ":"
@@ -34,6 +35,10 @@ Author:
 #define DDR_ORDER_STRING_DESCENDING     "DESCENDING"
 #define DDR_ORDER_STRING_RANDOM         "RANDOM"
 
+#define SYNTHETIC_STRING_ARM64          "ARM64"
+#define SYNTHETIC_STRING_X86            "X86"
+#define SYNTHETIC_STRING_ENCODED        "ENCODED"
+
 // These belong only to the DDR argument
 #define DDR_SECTION_ID      0
 #define DDR_BASE            1
@@ -51,6 +56,7 @@ PARAM_ROW   parameterList[] = {
     {  "Part",          0,      &ProcessPart },             // Flag to make partition the target for output (short form) 
     {  "DDR",           3,      &ProcessDDRParameters },    // Define a single DDR section
     {  "DDRSize",       1,      &ProcessDDRSize},           // Change the default DDR section size, for sections not defined by /DDR
+    {  "DDRGap",        1,      &ProcessDDRGap },           // Hole left after each default DDR section, default is 0 (no holes)
     {  "DDRCount",      1,      &ProcessDDRCount },         // Number of otal DDR sections, should be more than /DDRCount
     {  "DDROrder",      1,      &ProcessDDROrder },         // How to order the DDR sections, default is ASCENDING
     {  "DDROrd",        1,      &ProcessDDROrder },         // How to order the DDR sections (short form), default is ASCENDING
@@ -59,6 +65,9 @@ PARAM_ROW   parameterList[] = {
     {  "NumCores",      1,      &ProcessNumCores },         // Number of cores to use for CPU section
     {  "NoPayload",     0,      &ProcessNoPayload },        // Sets the no-payload flag, write only header and sections data to file/partition
     {  "NoApReg",       0,      &ProcessNoAPReg },          // Flag to exclude the CPU section, default is to create one of size = 1
+    {  "Chunked",       1,      &ProcessChunked },          // Write DDR sections as v2 chunked sections, optional chunk size
+    {  "Threads",       1,      &ProcessThreads },          // Number of payload writer threads for file output, default is one per processor
+    {  "Synthetic",     1,      &ProcessSynthetic },        // Write an ARM64 or X86 memory image over the DDR payload, optionally with an encoded KDBG
     {  "NoSvData",      0,      nullptr },                  // Flag to exclude all SV sections
     {  "NoTzData",      0,      nullptr }                   // Flag to exclude the TZ section from the SV sections
 };
@@ -108,6 +117,7 @@ HRESULT ProcessCommandArguments(_In_ int argc, _In_ char** argv, _Inout_ PDUMP_C
     config->DDR_Proximity       = DDR_PROXIMITY_UNSET;             // Unset proximity of DDR sections, can be set by /DDRProximity
     config->DDR_Order           = DDR_ORDER_UNSET;              // Unset order of DDDR sections, can be set by /DDROrder
     config->DDR_Size.QuadPart   = DEFAULT_DDR_SECTION_LENGTH;   // Default DDR section size, can be set by /DDRSize
+    config->DDR_Gap.QuadPart    = 0;                            // No holes between default DDR sections, can be set by /DDRGap
 
     // set the ApReg defaults: 
     config->excludeApReg        = FALSE;
@@ -118,6 +128,11 @@ HRESULT ProcessCommandArguments(_In_ int argc, _In_ char** argv, _Inout_ PDUMP_C
     // Other defaults that could be configured via s switch
     config->writePayload        = TRUE;
     config->CoreCount           = INVALID_UINT32;
+    config->writeChunked        = FALSE;
+    config->chunkSize           = RAW_DUMP_CHUNK_SIZE_DEFAULT;
+    config->writerThreads       = 0;
+    config->syntheticImage      = SYNTHETIC_IMAGE_NONE;
+    config->encodeKdbg          = FALSE;
 
     if (argc > 1)
     {
@@ -200,6 +215,14 @@ HRESULT ProcessCommandArguments(_In_ int argc, _In_ char** argv, _Inout_ PDUMP_C
         {
             config->CoreCount = DEFAULT_CORE_COUNT;
         }
+
+        if ( (SYNTHETIC_IMAGE_NONE != config->syntheticImage) &&
+             (config->outputToPartition || config->writeChunked || !config->writePayload)
+           )
+        { // The image is written over the plain payload of a file
+            failString->append("   invalid switch ==> [Synthetic] cannot be used with Partition, Chunked or NoPayload\r\n");
+            hr = E_INVALIDARG;
+        }
     }
 
     return hr;
@@ -288,6 +311,45 @@ HRESULT ResizeSectionsList(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectio
     return ret;
 }
 
+
+/****************************************************************************************************
+** HRESULT ResizeSectionsList(
+**                    _In_out_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList,
+**                    _In_ UINT32 newSize)
+** Description:
+**  Same as above, for a vector holding the RAW_DUMP_SECTION_HEADER structures themselves (the DDR
+**  sections), so a large table is one allocation. New rows are zeroed, their Type is
+**  RAW_DUMP_SECTION_TYPE_RESERVED until they are set.
+**
+** Arguments:
+**  sectionList - vector to resize
+**  newSize - new size, has no affect if size is smaller than the current size
+**
+** Return:
+**  S_OK
+**  E_OUTOFMEMRY - when resize fails
+**
+*****************************************************************************************************/
+HRESULT ResizeSectionsList(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _In_ UINT32 newSize)
+{
+    HRESULT ret = S_OK;
+
+    if (newSize > sectionList->size())
+    { // Adjust the size of the DDR section table, in necessary
+        try
+        {
+            sectionList->resize(newSize, RAW_DUMP_SECTION_HEADER());
+        }
+        catch (...)
+        {
+            ret = E_OUTOFMEMORY;
+        }
+
+    }
+
+    return ret;
+}
+
 /*****************************************************************************************************
 ******************************************************************************************************
 **  Funcitions below are to proces the tokens for each parameter
@@ -362,6 +424,11 @@ HRESULT ProcessDDRParameters(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PC
 
     }
 
+    if (SUCCEEDED(ret) && ((sectionID < 0) || (sectionID >= MAX_DDR_SECTIONS)))
+    { // The section ID sizes the table
+        ret = E_INVALIDARG;
+    }
+
     if (SUCCEEDED(ret))
     { // DDR tokens extracted, now the section to the vector list
         if (sectionID >= (cfg->sectionDDR).size())
@@ -372,24 +439,18 @@ HRESULT ProcessDDRParameters(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PC
 
         if (SUCCEEDED(ret))
         {
-            cfg->sectionDDR[sectionID] = new RAW_DUMP_SECTION_HEADER;
-            if (nullptr == cfg->sectionDDR[sectionID])
-            {
-                ret = E_OUTOFMEMORY;
-            }
-            else
-            {
-                ZeroMemory(cfg->sectionDDR[sectionID], sizeof RAW_DUMP_SECTION_HEADER);
+            PRAW_DUMP_SECTION_HEADER    section = &cfg->sectionDDR[sectionID];
 
-                if (SUCCEEDED(MakeDDRNameString((PCHAR)(cfg->sectionDDR[sectionID]->Name), sizeof(cfg->sectionDDR[sectionID]->Name), sectionID)))
-                {
-                    cfg->sectionDDR[sectionID]->Flags = RAW_DUMP_HEADER_FLAGS_VALID;
-                    cfg->sectionDDR[sectionID]->Version = RAW_DUMP_SECTION_HEADER_VERSION;
-                    cfg->sectionDDR[sectionID]->Type = RAW_DUMP_SECTION_TYPE_DDR_RANGE;
-                    cfg->sectionDDR[sectionID]->Size = sectionSize.QuadPart;
-                    cfg->sectionDDR[sectionID]->u.DDRInformation.Base = sectionBaseAddress.QuadPart;
-                    cfg->sectionDDR[sectionID]->Offset = INVALID_ULARGE_INTEGER;
-                }
+            ZeroMemory(section, sizeof RAW_DUMP_SECTION_HEADER);
+
+            if (SUCCEEDED(MakeDDRNameString((PCHAR)(section->Name), sizeof(section->Name), sectionID)))
+            {
+                section->Flags = RAW_DUMP_HEADER_FLAGS_VALID;
+                section->Version = RAW_DUMP_SECTION_HEADER_VERSION;
+                section->Type = RAW_DUMP_SECTION_TYPE_DDR_RANGE;
+                section->Size = sectionSize.QuadPart;
+                section->u.DDRInformation.Base = sectionBaseAddress.QuadPart;
+                section->Offset = INVALID_ULARGE_INTEGER;
             }
         }
     }
@@ -443,6 +504,58 @@ HRESULT ProcessDDRSize(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR ar
 }
 
 
+/****************************************************************************************************
+** HRESULT ProcessDDRGap(
+**              _Inout_ PDUMP_CONFIG cfg,
+**              _In_ UINT32 dRow,
+**              _In_ PCHAR argList)
+**
+** Description:
+**  /DDRGap:<size> - hole left after each DDR section not defined by /DDR, so large /DDRCount
+**  tables describe fragmented memory instead of one contiguous range.
+**
+** Arguments :
+**  cfg - configuration table
+**  dRow - index of the argument in parameterList
+**  argList - argument string
+**
+** Return :
+**  S_OK
+**  E_POINTER - invalid argument pointers passed
+**  E_INVALIDARG - missing gap size
+**
+*****************************************************************************************************/
+HRESULT ProcessDDRGap(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList)
+{
+    HRESULT     ret = S_OK;
+    PCHAR       paramToken = nullptr;
+
+    if ((nullptr == cfg) || (nullptr == argList))
+    { // fail if pointers are null
+        ret = E_POINTER;
+    }
+    else if (0 != cfg->DDR_Gap.QuadPart)
+    { // Already set
+        ret = E_FAIL;
+    }
+    else if ((nullptr == (paramToken = strtok(argList, TOKEN_DELIMITER))) ||
+             (0 != _strnicmp(paramToken, parameterList[dRow].paramStr, strlen(parameterList[dRow].paramStr))) ||
+             (nullptr == (paramToken = strtok(NULL, TOKEN_DELIMITER)))
+            )
+    { // parameter is not /DDRGap or there are no tokens
+        ret = E_INVALIDARG;
+    }
+    else
+    { // ensure conversion will be either HEX or decimal
+        UINT tokenBase = (0 == _strnicmp(paramToken, HEX_PREFIX, strlen(HEX_PREFIX))) ? TOKEN_BASE_HEX : TOKEN_BASE_DECIMAL;
+
+        cfg->DDR_Gap.QuadPart = _strtoui64(paramToken, NULL, tokenBase);
+    }
+
+    return ret;
+}
+
+
 /****************************************************************************************************
 ** Description:
 **
@@ -836,3 +949,205 @@ HRESULT ProcessNoAPReg(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR ar
     return ret;
 }
 
+
+/****************************************************************************************************
+** HRESULT ProcessChunked(
+**              _Inout_ PDUMP_CONFIG cfg,
+**              _In_ UINT32 dRow,
+**              _In_ PCHAR argList)
+**
+** Description:
+**  /Chunked[:<chunk size>] - write the DDR sections as v2 chunked sections. The chunk size is
+**  optional, it must be a multiple of RAW_DUMP_CHUNK_SIZE_MIN, up to RAW_DUMP_CHUNK_SIZE_MAX.
+**
+** Arguments :
+**  cfg - configuration table
+**  dRow - index of the argument in parameterList
+**  argList - argument string
+**
+** Return :
+**  S_OK
+**  E_POINTER - invalid argument pointers passed
+**  E_INVALIDARG - invalid chunk size
+**
+*****************************************************************************************************/
+HRESULT ProcessChunked(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList)
+{
+    HRESULT         ret = S_OK;
+    PCHAR           paramToken = nullptr;
+
+    if ((nullptr == cfg) || (nullptr == argList))
+    { // fail if pointers are null
+        ret = E_POINTER;
+    }
+    else if (TRUE == cfg->writeChunked)
+    { // Already set
+        ret = E_FAIL;
+    }
+    else if ((nullptr == (paramToken = strtok(argList, TOKEN_DELIMITER))) ||
+             (0 != _strnicmp(paramToken, parameterList[dRow].paramStr, strlen(parameterList[dRow].paramStr)))
+            )
+    { // parameter is not /Chunked
+        ret = E_INVALIDARG;
+    }
+    else if (nullptr != (paramToken = strtok(NULL, TOKEN_DELIMITER)))
+    { // Chunk size given
+        UINT        tokenBase = (0 == _strnicmp(paramToken, HEX_PREFIX, strlen(HEX_PREFIX))) ? TOKEN_BASE_HEX : TOKEN_BASE_DECIMAL;
+        ULONGLONG   chunkSize = _strtoui64(paramToken, NULL, tokenBase);
+
+        if ((chunkSize < RAW_DUMP_CHUNK_SIZE_MIN) ||
+            (chunkSize > RAW_DUMP_CHUNK_SIZE_MAX) ||
+            (0 != (chunkSize % RAW_DUMP_CHUNK_SIZE_MIN))
+           )
+        {
+            ret = E_INVALIDARG;
+        }
+        else
+        {
+            cfg->chunkSize = (UINT32)chunkSize;
+        }
+
+    }
+
+    if (SUCCEEDED(ret))
+    {
+        cfg->writeChunked = TRUE;
+    }
+
+    return ret;
+}
+
+
+/****************************************************************************************************
+** HRESULT ProcessThreads(
+**              _Inout_ PDUMP_CONFIG cfg,
+**              _In_ UINT32 dRow,
+**              _In_ PCHAR argList)
+**
+** Description:
+**  /Threads:<count> - number of threads writing the payload when the output is a file, from 1 to
+**  MAX_WRITER_THREADS. Without it, one thread per processor is used.
+**
+** Arguments :
+**  cfg - configuration table
+**  dRow - index of the argument in parameterList
+**  argList - argument string
+**
+** Return :
+**  S_OK
+**  E_POINTER - invalid argument pointers passed
+**  E_INVALIDARG - missing or invalid thread count
+**
+*****************************************************************************************************/
+HRESULT ProcessThreads(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList)
+{
+    HRESULT         ret = S_OK;
+    PCHAR           paramToken = nullptr;
+
+    if ((nullptr == cfg) || (nullptr == argList))
+    { // fail if pointers are null
+        ret = E_POINTER;
+    }
+    else if (0 != cfg->writerThreads)
+    { // Already set
+        ret = E_FAIL;
+    }
+    else if ((nullptr == (paramToken = strtok(argList, TOKEN_DELIMITER))) ||
+             (0 != _strnicmp(paramToken, parameterList[dRow].paramStr, strlen(parameterList[dRow].paramStr))) ||
+             (nullptr == (paramToken = strtok(NULL, TOKEN_DELIMITER)))
+            )
+    { // parameter is not what was expeted or there are no tokens
+        ret = E_INVALIDARG;
+    }
+    else
+    {
+        UINT        tokenBase = (0 == _strnicmp(paramToken, HEX_PREFIX, strlen(HEX_PREFIX))) ? TOKEN_BASE_HEX : TOKEN_BASE_DECIMAL;
+        ULONGLONG   threads = _strtoui64(paramToken, NULL, tokenBase);
+
+        if ((0 == threads) || (MAX_WRITER_THREADS < threads))
+        {
+            ret = E_INVALIDARG;
+        }
+        else
+        {
+            cfg->writerThreads = (UINT32)threads;
+        }
+
+    }
+
+    return ret;
+}
+
+
+/****************************************************************************************************
+** HRESULT ProcessSynthetic(
+**              _Inout_ PDUMP_CONFIG cfg,
+**              _In_ UINT32 dRow,
+**              _In_ PCHAR argList)
+**
+** Description:
+**  /Synthetic:<ARM64|X86>[:Encoded] - write a memory image of the given architecture over the DDR
+**  payload of the file: dump header, KdDebuggerDataBlock, processor contexts and page tables, so
+**  raw2dump converts the file end to end. Encoded scrambles the KdDebuggerDataBlock, as on a
+**  device, so the decoded copy is used.
+**
+** Arguments :
+**  cfg - configuration table
+**  dRow - index of the argument in parameterList
+**  argList - argument string
+**
+** Return :
+**  S_OK
+**  E_POINTER - invalid argument pointers passed
+**  E_INVALIDARG - missing or invalid architecture or option
+**
+*****************************************************************************************************/
+HRESULT ProcessSynthetic(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList)
+{
+    HRESULT         ret = S_OK;
+    PCHAR           paramToken = nullptr;
+
+    if ((nullptr == cfg) || (nullptr == argList))
+    { // fail if pointers are null
+        ret = E_POINTER;
+    }
+    else if (SYNTHETIC_IMAGE_NONE != cfg->syntheticImage)
+    { // Already set
+        ret = E_FAIL;
+    }
+    else if ((nullptr == (paramToken = strtok(argList, TOKEN_DELIMITER))) ||
+             (0 != _strnicmp(paramToken, parameterList[dRow].paramStr, strlen(parameterList[dRow].paramStr))) ||
+             (nullptr == (paramToken = strtok(NULL, TOKEN_DELIMITER)))
+            )
+    { // parameter is not what was expeted or there are no tokens
+        ret = E_INVALIDARG;
+    }
+    else if (0 == _stricmp(paramToken, SYNTHETIC_STRING_ARM64))
+    {
+        cfg->syntheticImage = SYNTHETIC_IMAGE_ARM64;
+    }
+    else if (0 == _stricmp(paramToken, SYNTHETIC_STRING_X86))
+    {
+        cfg->syntheticImage = SYNTHETIC_IMAGE_X86;
+    }
+    else
+    {
+        ret = E_INVALIDARG;
+    }
+
+    if (SUCCEEDED(ret) && (nullptr != (paramToken = strtok(NULL, TOKEN_DELIMITER))))
+    {
+        if (0 == _stricmp(paramToken, SYNTHETIC_STRING_ENCODED))
+        {
+            cfg->encodeKdbg = TRUE;
+        }
+        else
+        {
+            cfg->syntheticImage = SYNTHETIC_IMAGE_NONE;
+            ret = E_INVALIDARG;
+        }
+
+    }
+
+    return ret;
+}
@@ -46,6 +46,7 @@ HRESULT ProcessCommandArguments(_In_ int argc, _In_ char** argv, _Inout_ PDUMP_C
 *****************************************************************************************************/
 UINT32  FindArgumentInParameterArray(_In_ PCHAR arg);
 HRESULT ResizeSectionsList(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList, _In_ UINT32 newSize);
+HRESULT ResizeSectionsList(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _In_ UINT32 newSize);
 
 
 /****************************************************************************************************
@@ -56,9 +57,13 @@ HRESULT ProcessFileName(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR a
 HRESULT ProcessPart(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessDDRParameters(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessDDRSize(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
+HRESULT ProcessDDRGap(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessDDRCount(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessDDRProximity(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessDDROrder(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessNumCores(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
 HRESULT ProcessNoPayload(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
-HRESULT ProcessNoAPReg(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
\ No newline at end of file
+HRESULT ProcessNoAPReg(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
+HRESULT ProcessChunked(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
+HRESULT ProcessThreads(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
+HRESULT ProcessSynthetic(_Inout_ PDUMP_CONFIG cfg, _In_ UINT32 dRow, _In_ PCHAR argList);
\ No newline at end of file
@@ -56,8 +56,9 @@ HRESULT MakeDDRNameString(_Out_ PCHAR name, _In_ size_t nameLen, _In_ UINT32 id)
 
 /****************************************************************************************************
 ** HRESULT   FillEmptyDDRWithDefault(
-**              _In_out_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList,
-**              _In_ ULARGE_INTEGER defaultSize)
+**              _In_out_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList,
+**              _In_ ULARGE_INTEGER defaultSize,
+**              _In_ ULARGE_INTEGER gapSize)
 **
 ** Description:
 **  Fill in the DDR (vector) table with default values.  The DDR table contains a default number of 
@@ -66,16 +67,21 @@ HRESULT MakeDDRNameString(_Out_ PCHAR name, _In_ size_t nameLen, _In_ UINT32 id)
 **  create a table with more entries than are defined (or defaulted) using the /DDR command line 
 **  argument. Any undefined entries will be updated with default values, by this function.
 **
+**  The table holds the section headers themselves, an undefined entry is one whose Type is still
+**  RAW_DUMP_SECTION_TYPE_RESERVED. Default sections are placed one after the other, with gapSize
+**  bytes of hole after each.
+**
 ** Arguments :
 **  sectionList - pointer to the DDR sections vector
 **  defaultSize - the size of all default sections
+**  gapSize - hole left after each default section
 **
 ** Return :
 **  S_OK
-**  E_OUTOFMEMRY - failure to allocate a DDR entry
+**  E_POINTER - sectionList is null
 **
 *****************************************************************************************************/
-HRESULT UpdateDDRWithDefault(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList, _In_ ULARGE_INTEGER defaultSize)
+HRESULT UpdateDDRWithDefault(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _In_ ULARGE_INTEGER defaultSize, _In_ ULARGE_INTEGER gapSize)
 {
     HRESULT ret = S_OK;
 
@@ -96,12 +102,12 @@ HRESULT UpdateDDRWithDefault(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sect
         {
 
             // consider only populated items in the vector
-            if ( (nullptr != sectionList->at(i)) &&
-                 ((sectionList->at(i))->u.DDRInformation.Base > maxBase.QuadPart)
+            if ( (RAW_DUMP_SECTION_TYPE_RESERVED != (*sectionList)[i].Type) &&
+                 ((*sectionList)[i].u.DDRInformation.Base > maxBase.QuadPart)
                )
             { // update the base, from the populated item, if appropriate
-                maxBase.QuadPart = (sectionList->at(i))->u.DDRInformation.Base;
-                endDDR.QuadPart = maxBase.QuadPart + (sectionList->at(i))->Size;
+                maxBase.QuadPart = (*sectionList)[i].u.DDRInformation.Base;
+                endDDR.QuadPart = maxBase.QuadPart + (*sectionList)[i].Size;
             }
 
         }
@@ -109,29 +115,20 @@ HRESULT UpdateDDRWithDefault(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sect
         // Fill in empty table entries beginning with endDDR address
         for (UINT32 i = 0; i < nEntries; i++)
         {
-            if (nullptr == sectionList->at(i))
-            { // Fill in un-populated vector entry
-                tmpRow = new RAW_DUMP_SECTION_HEADER;
-                if (nullptr == tmpRow)
-                { // Fail if we run out of memory
-                    ret = E_OUTOFMEMORY;
-                    break;
-                }
-
-                ZeroMemory(tmpRow, sizeof RAW_DUMP_SECTION_HEADER);
-                if (SUCCEEDED(MakeDDRNameString((PCHAR)(tmpRow->Name), sizeof tmpRow->Name, i)))
-                { // Create and populate the new vector item
-                    tmpRow->Flags = RAW_DUMP_HEADER_FLAGS_VALID;
-                    tmpRow->Version = RAW_DUMP_SECTION_HEADER_VERSION;
-                    tmpRow->Type = RAW_DUMP_SECTION_TYPE_DDR_RANGE;
-                    tmpRow->Size = defaultSize.QuadPart;
-                    tmpRow->u.DDRInformation.Base = endDDR.QuadPart;
-                    tmpRow->Offset = INVALID_ULARGE_INTEGER;
-
-                    sectionList->at(i) = tmpRow;
-                    endDDR.QuadPart += tmpRow->Size;
-                }
+            tmpRow = &(*sectionList)[i];
 
+            if ( (RAW_DUMP_SECTION_TYPE_RESERVED == tmpRow->Type) &&
+                 SUCCEEDED(MakeDDRNameString((PCHAR)(tmpRow->Name), sizeof tmpRow->Name, i))
+               )
+            { // Populate the un-populated vector entry
+                tmpRow->Flags = RAW_DUMP_HEADER_FLAGS_VALID;
+                tmpRow->Version = RAW_DUMP_SECTION_HEADER_VERSION;
+                tmpRow->Type = RAW_DUMP_SECTION_TYPE_DDR_RANGE;
+                tmpRow->Size = defaultSize.QuadPart;
+                tmpRow->u.DDRInformation.Base = endDDR.QuadPart;
+                tmpRow->Offset = INVALID_ULARGE_INTEGER;
+
+                endDDR.QuadPart += tmpRow->Size + gapSize.QuadPart;
             }
 
         }
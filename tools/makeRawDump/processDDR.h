@@ -25,5 +25,5 @@ Author:
 ** Functions intrnal to this object file
 *****************************************************************************************************/
 HRESULT MakeDDRNameString(_Out_ PCHAR ddrName, _In_ size_t ddrNameLen, _In_ UINT32 id);
-HRESULT UpdateDDRWithDefault(_Inout_ std::vector<PRAW_DUMP_SECTION_HEADER> *sectionList, _In_ ULARGE_INTEGER defaultSize);
+HRESULT UpdateDDRWithDefault(_Inout_ std::vector<RAW_DUMP_SECTION_HEADER> *sectionList, _In_ ULARGE_INTEGER defaultSize, _In_ ULARGE_INTEGER gapSize);
 
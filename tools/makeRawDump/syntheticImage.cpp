@@ -0,0 +1,649 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    syntheticImage.cpp
+
+Environment:
+    User Mode
+
+--*/
+
+#include <nt.h>
+#include <ntrtl.h>
+#include <nturtl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "syntheticImage.h"
+#include "Device_Specific.h"
+#include "KdDebuggerData.h"
+#include <ntiodump.h>
+#include <wdbgexts.h>
+
+// Signature raw2dump scans for, the in-memory DUMP_HEADER follows it
+static const UCHAR SyntheticDumpHeaderMagic[SYNTHETIC_MAGIC_LENGTH] = {
+    0x3B, 0x49, 0x53, 0x53, 0x94, 0x45, 0x2E, 0x30,
+    0xD4, 0xCB, 0xDA, 0x97, 0xF1, 0x11, 0x02, 0xB5,
+    0xE8, 0x36, 0x08, 0x61, 0x88, 0x70, 0x9B, 0x19 };
+
+#define SYNTHETIC_MAX_RUNS64    ((sizeof(((PDUMP_HEADER64)0)->PhysicalMemoryBlockBuffer) - FIELD_OFFSET(PHYSICAL_MEMORY_DESCRIPTOR64, Run)) / sizeof(PHYSICAL_MEMORY_RUN64))
+#define SYNTHETIC_MAX_RUNS32    ((sizeof(((PDUMP_HEADER32)0)->PhysicalMemoryBlockBuffer) - FIELD_OFFSET(PHYSICAL_MEMORY_DESCRIPTOR32, Run)) / sizeof(PHYSICAL_MEMORY_RUN32))
+
+// The context PAs follow the decoded KdDebuggerDataBlock and its address
+#define SYNTHETIC_CONTEXT_PA_OFFSET     (SYNTHETIC_DECODED_KDBG_OFFSET + sizeof(KDDEBUGGER_DATA64) + sizeof(ULONGLONG))
+
+static_assert((SYNTHETIC_DUMP_HEADER_OFFSET + sizeof(DUMP_HEADER64)) <= SYNTHETIC_KDBG_OFFSET, "DUMP_HEADER overlaps KdDebuggerDataBlock");
+static_assert((SYNTHETIC_CONTEXT_PA_OFFSET + (SYNTHETIC_X86_MAX_CORES * sizeof(ULONGLONG))) <= SYNTHETIC_KDBG_OFFSET, "Context PAs overlap KdDebuggerDataBlock");
+static_assert(sizeof(KDDEBUGGER_DATA64) <= (SYNTHETIC_BUGCHECK_OFFSET - SYNTHETIC_KDBG_OFFSET), "KdDebuggerDataBlock overlaps KiBugcheckData");
+static_assert((SYNTHETIC_X86_KERNEL_VA % SYNTHETIC_IMAGE_SIZE) == 0, "x86 kernel image must start a page table");
+static_assert((SYNTHETIC_ARM64_KERNEL_VA % SYNTHETIC_IMAGE_SIZE) == 0, "ARM64 kernel image must start a page table");
+static_assert((SYNTHETIC_IMAGE_SIZE / SYNTHETIC_PAGE_SIZE) == SYNTHETIC_PTE_COUNT, "kernel image must fill one page table");
+
+/****************************************************************************************************
+** HRESULT WriteSyntheticImage(
+**          _Inout_ DEVICE_IO *oFile,
+**          _In_ PDUMP_CONFIG cfg,
+**          _In_ std::string *fName)
+**
+** Description:
+**  Writes, over the test pattern of the DDR payload, the memory structures raw2dump looks for: the
+**  in-memory DUMP_HEADER behind its magic string, the KdDebuggerDataBlock, KiBugcheckData, the
+**  page tables of a fake kernel image and the per core data (KiProcessorBlock and PRCBs for x86,
+**  the MSM dump table for ARM64). The memory outside of DUMP_HEADER.PhysicalMemoryBlock, below the
+**  kernel image and at the top of the highest DDR range, keeps the test pattern as non-OS memory.
+**
+**  The DEVICE_SPECIFIC_INFO is appended to the file, as OffDmpSvc does, so raw2dump converts the
+**  file without a rawdumpinfo.xml.
+**
+**  The payload must already be written to fName, oFile is reopened to pick up its size.
+**
+** Arguments:
+**  oFile - output file handle (DEVICE_IO)
+**  cfg - dump file configuration data
+**  fName - name of the output file
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT WriteSyntheticImage(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg, _In_ std::string *fName)
+{
+    HRESULT                 hr = S_OK;
+    SYNTHETIC_IMAGE         image;
+    PUCHAR                  buffer = nullptr;
+    size_t                  bytesWritten = 0;
+
+    if ((nullptr == oFile) || (nullptr == cfg) || (nullptr == fName) || (SYNTHETIC_IMAGE_NONE == cfg->syntheticImage))
+    {
+        printf("ERROR: Invalid arguments passed to WriteSyntheticImage()\r\n");
+        hr = E_INVALIDARG;
+    }
+    else if (FAILED(hr = PlaceSyntheticImage(cfg, &image)))
+    {
+        printf("ERROR: DDR sections cannot hold the synthetic memory image, (%#lx)\r\n", hr);
+    }
+    else if (nullptr == (buffer = (PUCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, SYNTHETIC_BUFFER_SIZE)))
+    {
+        printf("ERROR: failed to allocate the synthetic image buffer\r\n");
+        hr = E_OUTOFMEMORY;
+    }
+    else if (FAILED(hr = BuildSyntheticImage(cfg, &image, buffer)))
+    {
+        printf("ERROR: failed to build the synthetic memory image, (%#lx)\r\n", hr);
+    }
+    else
+    {
+        oFile->Close();
+
+        if (FAILED(hr = oFile->Open(std::wstring(fName->begin(), fName->end()))))
+        {
+            printf("ERROR: reopening \"%s\", (%#lx)\r\n", fName->c_str(), hr);
+        }
+        else if (FAILED(hr = oFile->SetPos(image.imageOffset)) ||
+                 FAILED(hr = oFile->Write((PCHAR)buffer, SYNTHETIC_BUFFER_SIZE, &bytesWritten)) ||
+                 (SYNTHETIC_BUFFER_SIZE != bytesWritten)
+                )
+        {
+            hr = FAILED(hr) ? hr : E_FAIL;
+            printf("ERROR: failed to write the synthetic memory image at offset %#llx, (%#lx)\r\n", image.imageOffset, hr);
+        }
+        else
+        {
+            DEVICE_SPECIFIC_INFO    deviceInfo = { 0 };
+
+            deviceInfo.DumpHeaderInstanceID = image.instanceID;
+            deviceInfo.DumpHeaderPA = image.imagePA + SYNTHETIC_DUMP_HEADER_OFFSET;
+            deviceInfo.BugCheckCode = BUGCHECK_CODE;
+            deviceInfo.BugCheckParam1 = (ULONG)ONEFOURC_PARAM1_DEFAULT;
+            deviceInfo.BugCheckParam2 = ONEFOURC_PARAM2_DEFAULT;
+            deviceInfo.BugCheckParam3 = ONEFOURC_PARAM3_DEFAULT;
+            deviceInfo.BugCheckParam4 = (ULONG)ONEFOURC_PARAM4_DEFAULT;
+
+            if (image.is64Bit)
+            {
+                deviceInfo.Type = PROCESSOR_ARCHITECTURE_ARM64;
+                deviceInfo.APRegPA = image.imagePA + SYNTHETIC_PROCESSOR_OFFSET;
+                deviceInfo.VA = image.kernelVA + SYNTHETIC_HEADER_OFFSET;
+                deviceInfo.PA = image.imagePA + SYNTHETIC_HEADER_OFFSET;
+                deviceInfo.Size = SYNTHETIC_KDBG_OFFSET - SYNTHETIC_HEADER_OFFSET;
+            }
+            else
+            {
+                deviceInfo.Type = PROCESSOR_ARCHITECTURE_INTEL;
+                for (size_t i = 0; i < cfg->dumpFileSections.size(); i++)
+                { // raw2dump reads the x86 CONTEXTs from the CPU section
+                    if (RAW_DUMP_SECTION_TYPE_CPU_CONTEXT == cfg->dumpFileSections[i]->Type)
+                    {
+                        deviceInfo.CpuContextAddress = cfg->dumpFileSections[i]->Offset;
+                        break;
+                    }
+
+                }
+
+            }
+
+            if (FAILED(hr = WriteDeviceSpecificInfo(oFile, &deviceInfo, oFile->GetCurrentFileSize())))
+            {
+                printf("ERROR: failed to append the device specific information, (%#lx)\r\n", hr);
+            }
+            else
+            {
+                printf("INFO: Synthetic %s memory image written\r\n", image.is64Bit ? "ARM64" : "x86");
+                printf("\t         DUMP_HEADER PA : %#016I64x\r\n", deviceInfo.DumpHeaderPA);
+                printf("\t            Instance ID : %#016I64x\r\n", image.instanceID);
+                printf("\t     DirectoryTableBase : %#016I64x\r\n", image.tablesPA);
+                printf("\t        Kernel image VA : %#016I64x\r\n", image.kernelVA);
+                printf("\t         OS memory runs : %d\r\n", image.runs.size());
+                printf("\t    KdDebuggerDataBlock : %s\r\n", cfg->encodeKdbg ? "Encoded" : "Decoded");
+            }
+
+        }
+
+    }
+
+    if (nullptr != buffer)
+    {
+        HeapFree(GetProcessHeap(), 0, buffer);
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************************
+** HRESULT PlaceSyntheticImage(
+**          _In_ PDUMP_CONFIG cfg,
+**          _Out_ PSYNTHETIC_IMAGE image)
+**
+** Description:
+**  Places the kernel image SYNTHETIC_LOW_NON_OS_SIZE above the base of the lowest DDR range and
+**  builds the memory runs of DUMP_HEADER.PhysicalMemoryBlock: the DDR ranges, in address order,
+**  from the kernel image up to the top of the highest DDR range less its non-OS part, where
+**  adjacent or overlapping ranges are merged into one run.
+**
+** Arguments:
+**  cfg - dump file configuration data
+**  image - receives the addresses of the image
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT PlaceSyntheticImage(_In_ PDUMP_CONFIG cfg, _Out_ PSYNTHETIC_IMAGE image)
+{
+    HRESULT                         hr = S_OK;
+    std::vector<SYNTHETIC_RANGE>    ddr;
+    ULONGLONG                       highNonOsSize = 0;
+    UINT32                          maxCores = 0;
+    size_t                          maxRuns = 0;
+
+    image->is64Bit = (SYNTHETIC_IMAGE_ARM64 == cfg->syntheticImage);
+    image->kernelVA = image->is64Bit ? SYNTHETIC_ARM64_KERNEL_VA : SYNTHETIC_X86_KERNEL_VA;
+    image->coreCount = cfg->CoreCount;
+    image->runs.clear();
+    maxCores = image->is64Bit ? SYNTHETIC_ARM64_MAX_CORES : SYNTHETIC_X86_MAX_CORES;
+    maxRuns = image->is64Bit ? SYNTHETIC_MAX_RUNS64 : SYNTHETIC_MAX_RUNS32;
+
+    // Any value other than zero will do, raw2dump matches it with DEVICE_SPECIFIC_INFO
+    image->instanceID = ((ULONGLONG)rand() << 48) ^ ((ULONGLONG)rand() << 32) ^ ((ULONGLONG)rand() << 16) ^ (ULONGLONG)rand() ^ GetTickCount64();
+    image->instanceID |= 1;
+
+    for (size_t i = 0; i < cfg->dumpFileSections.size(); i++)
+    {
+        if (RAW_DUMP_SECTION_TYPE_DDR_RANGE == cfg->dumpFileSections[i]->Type)
+        {
+            SYNTHETIC_RANGE range = { cfg->dumpFileSections[i]->u.DDRInformation.Base,
+                                      cfg->dumpFileSections[i]->Size,
+                                      cfg->dumpFileSections[i]->Offset };
+
+            ddr.push_back(range);
+        }
+
+    }
+
+    std::sort(ddr.begin(), ddr.end(), [](const SYNTHETIC_RANGE &a, const SYNTHETIC_RANGE &b) { return a.base < b.base; });
+
+    if ((0 == image->coreCount) || (image->coreCount > maxCores))
+    {
+        printf("ERROR: the synthetic image supports 1 to %d cores, %d requested\r\n", maxCores, image->coreCount);
+        hr = E_INVALIDARG;
+    }
+    else if (ddr.empty())
+    {
+        printf("ERROR: there are no DDR sections\r\n");
+        hr = E_FAIL;
+    }
+    else
+    {
+        image->imagePA = (ddr.front().base + SYNTHETIC_LOW_NON_OS_SIZE + SYNTHETIC_PAGE_MASK) & ~(ULONGLONG)SYNTHETIC_PAGE_MASK;
+        image->imageOffset = ddr.front().offset + (image->imagePA - ddr.front().base);
+        image->tablesPA = image->imagePA + SYNTHETIC_IMAGE_SIZE;
+
+        highNonOsSize = (ddr.back().size / SYNTHETIC_HIGH_NON_OS_DIVISOR) & ~(ULONGLONG)SYNTHETIC_PAGE_MASK;
+        if ((ddr.back().base + ddr.back().size - highNonOsSize) < (image->imagePA + SYNTHETIC_BUFFER_SIZE))
+        { // Single DDR range, too small to lose its top
+            highNonOsSize = 0;
+        }
+
+        if ((image->imagePA + SYNTHETIC_BUFFER_SIZE) > (ddr.front().base + ddr.front().size))
+        {
+            printf("ERROR: the lowest DDR section must hold %#x bytes above %#I64x\r\n", SYNTHETIC_BUFFER_SIZE, image->imagePA);
+            hr = E_INVALIDARG;
+        }
+        else if (!image->is64Bit && ((image->imagePA + SYNTHETIC_BUFFER_SIZE) > SYNTHETIC_X86_MAX_TABLE_PA))
+        {
+            printf("ERROR: the x86 page tables must be below 4GB, the lowest DDR section is too high\r\n");
+            hr = E_INVALIDARG;
+        }
+
+    }
+
+    for (size_t i = 0; SUCCEEDED(hr) && (i < ddr.size()); i++)
+    {
+        ULONGLONG   start = (0 == i) ? image->imagePA : ddr[i].base;
+        ULONGLONG   end = ddr[i].base + ddr[i].size - (((ddr.size() - 1) == i) ? highNonOsSize : 0);
+
+        start = (start + SYNTHETIC_PAGE_MASK) & ~(ULONGLONG)SYNTHETIC_PAGE_MASK;
+        end &= ~(ULONGLONG)SYNTHETIC_PAGE_MASK;
+
+        if (end <= start)
+        { // Less than a page
+            continue;
+        }
+        else if (!image->runs.empty() && (start <= (image->runs.back().base + image->runs.back().size)))
+        { // Adjacent or overlapping, extend the last run
+            image->runs.back().size = max(image->runs.back().size, end - image->runs.back().base);
+        }
+        else
+        {
+            SYNTHETIC_RANGE run = { start, end - start, 0 };
+
+            image->runs.push_back(run);
+        }
+
+    }
+
+    if (SUCCEEDED(hr) && (image->runs.size() > maxRuns))
+    {
+        printf("ERROR: %d discontiguous DDR ranges, DUMP_HEADER.PhysicalMemoryBlock holds %d runs\r\n", image->runs.size(), maxRuns);
+        hr = E_INVALIDARG;
+    }
+
+    return hr;
+}
+
+
+/****************************************************************************************************
+** HRESULT BuildSyntheticImage(
+**          _In_ PDUMP_CONFIG cfg,
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _Out_writes_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+**
+** Description:
+**  Fills buffer, zeroed by the caller, with the kernel image followed by its page tables. Offsets
+**  in buffer are offsets from image->imagePA.
+**
+** Arguments:
+**  cfg - dump file configuration data
+**  image - addresses of the image
+**  buffer - SYNTHETIC_BUFFER_SIZE bytes
+**
+** Return:
+**  HRESULT
+**
+*****************************************************************************************************/
+HRESULT BuildSyntheticImage(_In_ PDUMP_CONFIG cfg, _In_ PSYNTHETIC_IMAGE image, _Out_writes_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+{
+    BuildSyntheticHeader(image, buffer);
+    BuildSyntheticKdDebuggerData(cfg, image, buffer);
+    BuildSyntheticProcessors(image, buffer);
+    BuildSyntheticPageTables(image, buffer);
+
+    return S_OK;
+}
+
+
+/****************************************************************************************************
+** VOID BuildSyntheticHeader(
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+**
+** Description:
+**  Writes the magic string and the DUMP_HEADER64 (ARM64) or DUMP_HEADER32 (x86, PAE) behind it,
+**  with the fields raw2dump validates: Signature, ValidDump, BugCheckCode, DumpType,
+**  RequiredDumpSpace and the instance ID in the first bytes of Comment.
+**
+** Arguments:
+**  image - addresses of the image
+**  buffer - the image
+**
+** Return:
+**  none
+**
+*****************************************************************************************************/
+VOID BuildSyntheticHeader(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+{
+    ULONGLONG   pageCount = 0;
+
+    memcpy(buffer + SYNTHETIC_HEADER_OFFSET, SyntheticDumpHeaderMagic, sizeof(SyntheticDumpHeaderMagic));
+
+    if (image->is64Bit)
+    {
+        PDUMP_HEADER64  header = (PDUMP_HEADER64)(buffer + SYNTHETIC_DUMP_HEADER_OFFSET);
+
+        header->Signature = DUMP_SIGNATURE32;
+        header->ValidDump = DUMP_VALID_DUMP64;
+        header->MajorVersion = SYNTHETIC_MAJOR_VERSION;
+        header->DirectoryTableBase = image->tablesPA;
+        header->PsLoadedModuleList = SyntheticImageVA(image, SYNTHETIC_MODULE_LIST_OFFSET);
+        header->PsActiveProcessHead = SyntheticImageVA(image, SYNTHETIC_PROCESS_LIST_OFFSET);
+        header->MachineImageType = IMAGE_FILE_MACHINE_ARM64;
+        header->NumberProcessors = image->coreCount;
+        header->BugCheckCode = FATAL_ABNORMAL_RESET_ERROR;
+        header->KdDebuggerDataBlock = SyntheticImageVA(image, SYNTHETIC_KDBG_OFFSET);
+        header->DumpType = DUMP_TYPE_FULL;
+        header->RequiredDumpSpace.LowPart = DUMP_SIGNATURE;
+        memcpy(header->Comment, &image->instanceID, sizeof(image->instanceID));
+
+        header->PhysicalMemoryBlock.NumberOfRuns = (ULONG)image->runs.size();
+        for (size_t i = 0; i < image->runs.size(); i++)
+        {
+            header->PhysicalMemoryBlock.Run[i].BasePage = image->runs[i].base / SYNTHETIC_PAGE_SIZE;
+            header->PhysicalMemoryBlock.Run[i].PageCount = image->runs[i].size / SYNTHETIC_PAGE_SIZE;
+            pageCount += header->PhysicalMemoryBlock.Run[i].PageCount;
+        }
+
+        header->PhysicalMemoryBlock.NumberOfPages = pageCount;
+    }
+    else
+    {
+        PDUMP_HEADER32  header = (PDUMP_HEADER32)(buffer + SYNTHETIC_DUMP_HEADER_OFFSET);
+
+        header->Signature = DUMP_SIGNATURE32;
+        header->ValidDump = DUMP_VALID_DUMP32;
+        header->MajorVersion = SYNTHETIC_MAJOR_VERSION;
+        header->DirectoryTableBase = (ULONG)image->tablesPA;
+        header->PsLoadedModuleList = (ULONG)SyntheticImageVA(image, SYNTHETIC_MODULE_LIST_OFFSET);
+        header->PsActiveProcessHead = (ULONG)SyntheticImageVA(image, SYNTHETIC_PROCESS_LIST_OFFSET);
+        header->MachineImageType = IMAGE_FILE_MACHINE_I386;
+        header->NumberProcessors = image->coreCount;
+        header->BugCheckCode = FATAL_ABNORMAL_RESET_ERROR;
+        header->PaeEnabled = TRUE;
+        header->KdDebuggerDataBlock = (ULONG)SyntheticImageVA(image, SYNTHETIC_KDBG_OFFSET);
+        header->DumpType = DUMP_TYPE_FULL;
+        header->RequiredDumpSpace.LowPart = DUMP_SIGNATURE;
+        memcpy(header->Comment, &image->instanceID, sizeof(image->instanceID));
+
+        header->PhysicalMemoryBlock.NumberOfRuns = (ULONG)image->runs.size();
+        for (size_t i = 0; i < image->runs.size(); i++)
+        {
+            header->PhysicalMemoryBlock.Run[i].BasePage = (ULONG)(image->runs[i].base / SYNTHETIC_PAGE_SIZE);
+            header->PhysicalMemoryBlock.Run[i].PageCount = (ULONG)(image->runs[i].size / SYNTHETIC_PAGE_SIZE);
+            pageCount += header->PhysicalMemoryBlock.Run[i].PageCount;
+        }
+
+        header->PhysicalMemoryBlock.NumberOfPages = (ULONG)pageCount;
+    }
+
+}
+
+
+/****************************************************************************************************
+** VOID BuildSyntheticKdDebuggerData(
+**          _In_ PDUMP_CONFIG cfg,
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+**
+** Description:
+**  Writes the KdDebuggerDataBlock, KiBugcheckData and the (empty) module and process lists. When
+**  cfg->encodeKdbg is set, the block at DUMP_HEADER.KdDebuggerDataBlock is scrambled, so its header
+**  does not validate, and the decoded copy is written a page past the DUMP_HEADER, where raw2dump
+**  looks for it. For a DUMP_HEADER64 the copy overlays the fields past the first page of the header,
+**  as on ARM64 devices.
+**
+** Arguments:
+**  cfg - dump file configuration data
+**  image - addresses of the image
+**  buffer - the image
+**
+** Return:
+**  none
+**
+*****************************************************************************************************/
+VOID BuildSyntheticKdDebuggerData(_In_ PDUMP_CONFIG cfg, _In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+{
+    KDDEBUGGER_DATA64   kdDebuggerData = { 0 };
+    PULONGLONG          encode = (PULONGLONG)&kdDebuggerData;
+
+    kdDebuggerData.Header.List.Flink = SyntheticImageVA(image, SYNTHETIC_KDBG_OFFSET);
+    kdDebuggerData.Header.List.Blink = SyntheticImageVA(image, SYNTHETIC_KDBG_OFFSET);
+    kdDebuggerData.Header.OwnerTag = KDBG_TAG;
+    kdDebuggerData.Header.Size = sizeof(KDDEBUGGER_DATA64);
+    kdDebuggerData.KernBase = SyntheticImageVA(image, 0);
+    kdDebuggerData.PsLoadedModuleList = SyntheticImageVA(image, SYNTHETIC_MODULE_LIST_OFFSET);
+    kdDebuggerData.PsActiveProcessHead = SyntheticImageVA(image, SYNTHETIC_PROCESS_LIST_OFFSET);
+    kdDebuggerData.KiBugcheckData = SyntheticImageVA(image, SYNTHETIC_BUGCHECK_OFFSET);
+
+    if (!image->is64Bit)
+    { // x86 CONTEXTs are found through KiProcessorBlock
+        kdDebuggerData.KiProcessorBlock = SyntheticImageVA(image, SYNTHETIC_PROCESSOR_OFFSET);
+        kdDebuggerData.OffsetPrcbContext = SYNTHETIC_PRCB_CONTEXT_OFFSET;
+    }
+
+    *(PULONG)(buffer + SYNTHETIC_BUGCHECK_OFFSET) = FATAL_ABNORMAL_RESET_ERROR;
+
+    // Empty lists point back at their head
+    if (image->is64Bit)
+    {
+        PLIST_ENTRY64   moduleList = (PLIST_ENTRY64)(buffer + SYNTHETIC_MODULE_LIST_OFFSET);
+        PLIST_ENTRY64   processList = (PLIST_ENTRY64)(buffer + SYNTHETIC_PROCESS_LIST_OFFSET);
+
+        moduleList->Flink = moduleList->Blink = SyntheticImageVA(image, SYNTHETIC_MODULE_LIST_OFFSET);
+        processList->Flink = processList->Blink = SyntheticImageVA(image, SYNTHETIC_PROCESS_LIST_OFFSET);
+    }
+    else
+    {
+        PLIST_ENTRY32   moduleList = (PLIST_ENTRY32)(buffer + SYNTHETIC_MODULE_LIST_OFFSET);
+        PLIST_ENTRY32   processList = (PLIST_ENTRY32)(buffer + SYNTHETIC_PROCESS_LIST_OFFSET);
+
+        moduleList->Flink = moduleList->Blink = (ULONG)SyntheticImageVA(image, SYNTHETIC_MODULE_LIST_OFFSET);
+        processList->Flink = processList->Blink = (ULONG)SyntheticImageVA(image, SYNTHETIC_PROCESS_LIST_OFFSET);
+    }
+
+    if (cfg->encodeKdbg)
+    {
+        memcpy(buffer + SYNTHETIC_DECODED_KDBG_OFFSET, &kdDebuggerData, sizeof(kdDebuggerData));
+
+        for (size_t i = 0; i < (sizeof(kdDebuggerData) / sizeof(ULONGLONG)); i++)
+        {
+            encode[i] = _rotl64(encode[i] ^ SYNTHETIC_KDBG_ENCODE_KEY, SYNTHETIC_KDBG_ENCODE_ROTATE);
+        }
+
+    }
+
+    memcpy(buffer + SYNTHETIC_KDBG_OFFSET, &kdDebuggerData, sizeof(kdDebuggerData));
+}
+
+
+/****************************************************************************************************
+** VOID BuildSyntheticProcessors(
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+**
+** Description:
+**  Writes the per core data, one page per core.
+**
+**  x86: KiProcessorBlock points at the PRCB of each core, PRCB + OffsetPrcbContext at a CONTEXT,
+**  in the same page. The physical addresses of the CONTEXTs also follow the decoded
+**  KdDebuggerDataBlock and its address. The CONTEXTs are left empty, raw2dump takes them from the
+**  CPU section of the raw dump.
+**
+**  ARM64: the MSM dump table (APRegPA) has a CPU context entry per core, pointing at a dump data
+**  record, which points at the SDI CPU context of the core.
+**
+** Arguments:
+**  image - addresses of the image
+**  buffer - the image
+**
+** Return:
+**  none
+**
+*****************************************************************************************************/
+VOID BuildSyntheticProcessors(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+{
+    if (image->is64Bit)
+    {
+        PUCHAR  table = buffer + SYNTHETIC_PROCESSOR_OFFSET;
+
+        VIEW_SET(table, SYNTHETIC_MSM_DUMP_TABLE_LAYOUT, Version, SYNTHETIC_MSM_DUMP_TABLE_VERSION);
+        VIEW_SET(table, SYNTHETIC_MSM_DUMP_TABLE_LAYOUT, NumEntries, image->coreCount);
+
+        for (UINT32 core = 0; core < image->coreCount; core++)
+        {
+            PUCHAR  entry = table + SYNTHETIC_MSM_DUMP_TABLE_LAYOUT::Length + (core * SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT::Length);
+            PUCHAR  data = buffer + SYNTHETIC_CPU_OFFSET(core);
+            PUCHAR  context = data + SYNTHETIC_CPU_CONTEXT_OFFSET;
+
+            VIEW_SET(entry, SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT, Id, core);
+            VIEW_SET(entry, SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT, Type, SYNTHETIC_MSM_DUMP_TYPE_DATA);
+            VIEW_SET(entry, SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT, Address, image->imagePA + SYNTHETIC_CPU_OFFSET(core));
+
+            VIEW_SET(data, SYNTHETIC_MSM_DUMP_DATA_LAYOUT, Version, SYNTHETIC_MSM_DUMP_DATA_VERSION);
+            VIEW_SET(data, SYNTHETIC_MSM_DUMP_DATA_LAYOUT, Magic, SYNTHETIC_MSM_DUMP_DATA_MAGIC);
+            VIEW_SET(data, SYNTHETIC_MSM_DUMP_DATA_LAYOUT, Address, image->imagePA + SYNTHETIC_CPU_OFFSET(core) + SYNTHETIC_CPU_CONTEXT_OFFSET);
+            VIEW_SET(data, SYNTHETIC_MSM_DUMP_DATA_LAYOUT, Len, SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT::Length);
+
+            // Each core stopped in the kernel image, on a stack at the top of its page
+            VIEW_SET(context, SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT, Status0, SYNTHETIC_MSM_CPU_STATUS_A57);
+            VIEW_SET(context, SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT, Pc, SyntheticImageVA(image, SYNTHETIC_IMAGE_SIZE / 2));
+            VIEW_SET(context, SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT, CurrentEL, SYNTHETIC_ARM64_CURRENT_EL1);
+            VIEW_SET(context, SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT, SpEl1, SyntheticImageVA(image, SYNTHETIC_CPU_OFFSET(core + 1)));
+        }
+
+    }
+    else
+    {
+        PULONG      processorBlock = (PULONG)(buffer + SYNTHETIC_PROCESSOR_OFFSET);
+        PULONGLONG  contextPA = (PULONGLONG)(buffer + SYNTHETIC_CONTEXT_PA_OFFSET);
+
+        contextPA[-1] = image->imagePA + SYNTHETIC_KDBG_OFFSET;
+
+        for (UINT32 core = 0; core < image->coreCount; core++)
+        {
+            PUCHAR  prcb = buffer + SYNTHETIC_CPU_OFFSET(core);
+
+            processorBlock[core] = (ULONG)SyntheticImageVA(image, SYNTHETIC_CPU_OFFSET(core));
+            *(PULONG)(prcb + SYNTHETIC_PRCB_CONTEXT_OFFSET) = (ULONG)SyntheticImageVA(image, SYNTHETIC_CPU_OFFSET(core) + SYNTHETIC_CPU_CONTEXT_OFFSET);
+            contextPA[core] = image->imagePA + SYNTHETIC_CPU_OFFSET(core) + SYNTHETIC_CPU_CONTEXT_OFFSET;
+        }
+
+    }
+
+}
+
+
+/****************************************************************************************************
+** VOID BuildSyntheticPageTables(
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+**
+** Description:
+**  Writes the page tables mapping the kernel image at image->kernelVA with 4K pages, after the
+**  image. ARM64 uses the 4 level, 48 bit VA, 4K granule format, x86 the PAE format; in both the
+**  last level is one full page table.
+**
+** Arguments:
+**  image - addresses of the image
+**  buffer - the image
+**
+** Return:
+**  none
+**
+*****************************************************************************************************/
+VOID BuildSyntheticPageTables(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer)
+{
+    PULONGLONG  tables[SYNTHETIC_TABLE_PAGES] = { 0 };
+    ULONGLONG   tablePA[SYNTHETIC_TABLE_PAGES] = { 0 };
+    PULONGLONG  pageTable = nullptr;
+    ULONGLONG   pageFlags = 0;
+
+    for (UINT32 i = 0; i < SYNTHETIC_TABLE_PAGES; i++)
+    {
+        tables[i] = (PULONGLONG)(buffer + SYNTHETIC_IMAGE_SIZE + (i * SYNTHETIC_PAGE_SIZE));
+        tablePA[i] = image->tablesPA + (i * SYNTHETIC_PAGE_SIZE);
+    }
+
+    if (image->is64Bit)
+    { // Level 0, 1 and 2 tables, then the level 3 page table
+        for (UINT32 level = 0; level < (SYNTHETIC_TABLE_PAGES - 1); level++)
+        {
+            tables[level][SYNTHETIC_ARM64_INDEX(image->kernelVA, level)] = tablePA[level + 1] | SYNTHETIC_ARM64_TABLE;
+        }
+
+        pageTable = tables[SYNTHETIC_TABLE_PAGES - 1];
+        pageFlags = SYNTHETIC_ARM64_PAGE;
+    }
+    else
+    { // PDPT and page directory, then the page table; the last table page is not used
+        tables[0][SYNTHETIC_PAE_PDPT_INDEX(image->kernelVA)] = tablePA[1] | SYNTHETIC_PAE_PDPTE;
+        tables[1][SYNTHETIC_PAE_PD_INDEX(image->kernelVA)] = tablePA[2] | SYNTHETIC_PAE_TABLE;
+
+        pageTable = tables[2];
+        pageFlags = SYNTHETIC_PAE_PAGE;
+    }
+
+    for (UINT32 i = 0; i < SYNTHETIC_PTE_COUNT; i++)
+    {
+        pageTable[i] = (image->imagePA + (i * SYNTHETIC_PAGE_SIZE)) | pageFlags;
+    }
+
+}
+
+
+/****************************************************************************************************
+** ULONGLONG SyntheticImageVA(
+**          _In_ PSYNTHETIC_IMAGE image,
+**          _In_ ULONGLONG imageOffset)
+**
+** Description:
+**  Virtual address of an offset in the kernel image, as stored in KDDEBUGGER_DATA64: x86 addresses
+**  are sign extended.
+**
+** Arguments:
+**  image - addresses of the image
+**  imageOffset - offset in the image
+**
+** Return:
+**  Virtual address
+**
+*****************************************************************************************************/
+ULONGLONG SyntheticImageVA(_In_ PSYNTHETIC_IMAGE image, _In_ ULONGLONG imageOffset)
+{
+    ULONGLONG   va = image->kernelVA + imageOffset;
+
+    return image->is64Bit ? va : (ULONGLONG)(LONGLONG)(LONG)(ULONG)va;
+}
@@ -0,0 +1,151 @@
+/*++
+
+Copyright (C) Microsoft. All rights reserved.
+
+Module Name:
+    syntheticImage.h
+
+Environment:
+    User Mode
+
+--*/
+
+#pragma once
+
+#include "makeDumpFile.h"
+#include "Struct_View.h"
+
+#define SYNTHETIC_PAGE_SIZE                 0x1000
+#define SYNTHETIC_PAGE_MASK                 (SYNTHETIC_PAGE_SIZE - 1)
+#define SYNTHETIC_PTE_COUNT                 (SYNTHETIC_PAGE_SIZE / sizeof(UINT64))
+
+// Physical layout, from the base of the lowest DDR range
+#define SYNTHETIC_LOW_NON_OS_SIZE           ONE_MEGABYTE            // Firmware carve out, below the OS memory
+#define SYNTHETIC_HIGH_NON_OS_DIVISOR       16                      // Top 1/16 of the highest DDR range is not OS memory
+#define SYNTHETIC_IMAGE_SIZE                (2 * ONE_MEGABYTE)      // Kernel image, mapped with 4K pages by one page table
+#define SYNTHETIC_TABLE_PAGES               4                       // Page table pages, right after the kernel image
+#define SYNTHETIC_BUFFER_SIZE               (SYNTHETIC_IMAGE_SIZE + (SYNTHETIC_TABLE_PAGES * SYNTHETIC_PAGE_SIZE))
+
+// Offsets in the kernel image
+#define SYNTHETIC_HEADER_OFFSET             0x0000                  // Magic string then DUMP_HEADER
+#define SYNTHETIC_MAGIC_LENGTH              24
+#define SYNTHETIC_DUMP_HEADER_OFFSET        (SYNTHETIC_HEADER_OFFSET + SYNTHETIC_MAGIC_LENGTH)
+#define SYNTHETIC_DECODED_KDBG_OFFSET       (SYNTHETIC_DUMP_HEADER_OFFSET + SYNTHETIC_PAGE_SIZE)    // Where raw2dump looks when KDBG is encoded
+#define SYNTHETIC_KDBG_OFFSET               0x4000                  // KdDebuggerDataBlock, encoded for /Synthetic:<arch>:Encoded
+#define SYNTHETIC_BUGCHECK_OFFSET           0x5000                  // KiBugcheckData
+#define SYNTHETIC_MODULE_LIST_OFFSET        0x5100                  // PsLoadedModuleList, empty
+#define SYNTHETIC_PROCESS_LIST_OFFSET       0x5200                  // PsActiveProcessHead, empty
+#define SYNTHETIC_PROCESSOR_OFFSET          0x6000                  // KiProcessorBlock (x86) or MSM dump table (ARM64)
+#define SYNTHETIC_CPU_OFFSET(core)          (0x7000 + ((core) * SYNTHETIC_PAGE_SIZE))
+#define SYNTHETIC_CPU_CONTEXT_OFFSET        0x800                   // CONTEXT or SDI CPU context, in the page of a core
+#define SYNTHETIC_PRCB_CONTEXT_OFFSET       0x18                    // KPRCB.Context (x86), KDDEBUGGER_DATA64.OffsetPrcbContext
+
+#define SYNTHETIC_MAJOR_VERSION             0xF                     // DUMP_HEADER.MajorVersion of a free build
+#define SYNTHETIC_X86_MAX_CORES             64
+#define SYNTHETIC_ARM64_MAX_CORES           16                      // MSM dump entry id >> 4 must stay MSM_DUMP_DATA_CPU_CTX
+
+// Fake kernel virtual address space
+#define SYNTHETIC_ARM64_KERNEL_VA           0xFFFFF80000000000ULL
+#define SYNTHETIC_X86_KERNEL_VA             0x81000000UL
+#define SYNTHETIC_X86_MAX_TABLE_PA          0x100000000ULL          // PAE CR3 is a 32 bit register
+
+// ARM64 4K granule, 48 bit VA: level 0 to level 3 translation tables
+#define SYNTHETIC_ARM64_TABLE               0x3ULL                  // Valid, table descriptor
+#define SYNTHETIC_ARM64_PAGE                0x403ULL                // Valid, page descriptor, access flag
+#define SYNTHETIC_ARM64_INDEX(va, level)    ((UINT32)(((va) >> (39 - (9 * (level)))) & 0x1FF))
+
+// x86 PAE: PDPT, page directory and page table
+#define SYNTHETIC_PAE_PDPTE                 0x1ULL                  // Present
+#define SYNTHETIC_PAE_TABLE                 0x3ULL                  // Present, writable
+#define SYNTHETIC_PAE_PAGE                  0x103ULL                // Present, writable, global
+#define SYNTHETIC_PAE_PDPT_INDEX(va)        ((UINT32)(((va) >> 30) & 0x3))
+#define SYNTHETIC_PAE_PD_INDEX(va)          ((UINT32)(((va) >> 21) & 0x1FF))
+
+// KdDebuggerDataBlock scrambling for the encoded image, any change of the header defeats validation
+#define SYNTHETIC_KDBG_ENCODE_KEY           0x5A17C0DE0FF1D4B5ULL
+#define SYNTHETIC_KDBG_ENCODE_ROTATE        17
+
+// MSM dump table, as read by raw2dump for ARM64
+#define SYNTHETIC_MSM_DUMP_TABLE_VERSION    0x00200000
+#define SYNTHETIC_MSM_DUMP_DATA_VERSION     0x00000011
+#define SYNTHETIC_MSM_DUMP_DATA_MAGIC       0x42445953
+#define SYNTHETIC_MSM_DUMP_TYPE_DATA        0x0
+#define SYNTHETIC_MSM_CPU_STATUS_A57        0x02
+#define SYNTHETIC_ARM64_CURRENT_EL1         (1 << 2)
+
+struct SYNTHETIC_MSM_DUMP_TABLE_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Version,      UINT32,     0x00);
+    VIEW_LAYOUT_FIELD(NumEntries,   UINT32,     0x04);
+    static const size_t Length = 0x08;
+};
+
+struct SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Id,           UINT32,     0x00);
+    VIEW_LAYOUT_FIELD(Type,         UINT32,     0x24);
+    VIEW_LAYOUT_FIELD(Address,      UINT64,     0x28);
+    static const size_t Length = 0x30;
+};
+
+struct SYNTHETIC_MSM_DUMP_DATA_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Version,      UINT32,     0x00);
+    VIEW_LAYOUT_FIELD(Magic,        UINT32,     0x04);
+    VIEW_LAYOUT_FIELD(Address,      UINT64,     0x28);
+    VIEW_LAYOUT_FIELD(Len,          UINT64,     0x30);
+    static const size_t Length = 0x40;
+};
+
+struct SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT
+{
+    VIEW_LAYOUT_FIELD(Status0,      UINT32,     0x000);
+    VIEW_LAYOUT_FIELD(Pc,           UINT64,     0x108);
+    VIEW_LAYOUT_FIELD(CurrentEL,    UINT64,     0x110);
+    VIEW_LAYOUT_FIELD(SpEl1,        UINT64,     0x148);
+    static const size_t Length = 0x310;
+};
+
+static_assert((SYNTHETIC_MSM_DUMP_TABLE_LAYOUT::Length + (SYNTHETIC_ARM64_MAX_CORES * SYNTHETIC_MSM_DUMP_ENTRY_LAYOUT::Length)) <= SYNTHETIC_PAGE_SIZE,
+              "MSM dump table does not fit its page");
+static_assert((SYNTHETIC_CPU_CONTEXT_OFFSET + SYNTHETIC_SDI_CPU_CONTEXT_LAYOUT::Length) <= SYNTHETIC_PAGE_SIZE,
+              "CPU context does not fit its page");
+static_assert(SYNTHETIC_CPU_OFFSET(SYNTHETIC_X86_MAX_CORES) <= SYNTHETIC_IMAGE_SIZE,
+              "CPU pages do not fit the kernel image");
+
+// A contiguous range of physical memory and where it is in the raw dump file
+typedef struct _SYNTHETIC_RANGE
+{
+    ULONGLONG           base;
+    ULONGLONG           size;
+    ULONGLONG           offset;
+} SYNTHETIC_RANGE, *PSYNTHETIC_RANGE;
+
+// Addresses of the synthetic memory image
+typedef struct _SYNTHETIC_IMAGE
+{
+    BOOL                is64Bit;
+    ULONGLONG           instanceID;                 // DUMP_HEADER.Comment and DEVICE_SPECIFIC_INFO.DumpHeaderInstanceID
+    ULONGLONG           imagePA;                    // Physical address of the kernel image
+    ULONGLONG           imageOffset;                // File offset of the kernel image
+    ULONGLONG           kernelVA;                   // Virtual address of the kernel image
+    ULONGLONG           tablesPA;                   // Root of the page tables, DUMP_HEADER.DirectoryTableBase
+    UINT32              coreCount;
+    std::vector<SYNTHETIC_RANGE>    runs;           // DUMP_HEADER.PhysicalMemoryBlock
+} SYNTHETIC_IMAGE, *PSYNTHETIC_IMAGE;
+
+/****************************************************************************************************
+** Functions exposed extrnal to this object file
+*****************************************************************************************************/
+HRESULT WriteSyntheticImage(_Inout_ DEVICE_IO *oFile, _In_ PDUMP_CONFIG cfg, _In_ std::string *fName);
+
+/****************************************************************************************************
+** Functions intrnal to this object file
+*****************************************************************************************************/
+HRESULT PlaceSyntheticImage(_In_ PDUMP_CONFIG cfg, _Out_ PSYNTHETIC_IMAGE image);
+HRESULT BuildSyntheticImage(_In_ PDUMP_CONFIG cfg, _In_ PSYNTHETIC_IMAGE image, _Out_writes_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer);
+VOID    BuildSyntheticHeader(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer);
+VOID    BuildSyntheticKdDebuggerData(_In_ PDUMP_CONFIG cfg, _In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer);
+VOID    BuildSyntheticProcessors(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer);
+VOID    BuildSyntheticPageTables(_In_ PSYNTHETIC_IMAGE image, _Inout_updates_bytes_(SYNTHETIC_BUFFER_SIZE) PUCHAR buffer);
+ULONGLONG SyntheticImageVA(_In_ PSYNTHETIC_IMAGE image, _In_ ULONGLONG imageOffset);